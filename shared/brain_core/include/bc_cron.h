@@ -0,0 +1,54 @@
+#ifndef BC_CRON_H
+#define BC_CRON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cron fields compiled to bitsets: bit n set means value n matches.
+typedef struct {
+    uint64_t minutes;  // 0-59
+    uint32_t hours;    // 0-23
+    uint32_t days;     // 1-31
+    uint16_t months;   // 1-12
+    uint8_t weekdays;  // 0-6 (Sun=0)
+} bc_cron_t;
+
+// Field order in an expression, for bc_cron_compile and error reporting.
+enum {
+    BC_CRON_MINUTE = 0,
+    BC_CRON_HOUR,
+    BC_CRON_DAY,
+    BC_CRON_MONTH,
+    BC_CRON_WEEKDAY,
+    BC_CRON_FIELDS,
+};
+
+// bc_cron_parse_field results.
+enum {
+    BC_CRON_OK = 0,
+    BC_CRON_EMPTY = -1,
+    BC_CRON_NOT_NUMERIC = -2,
+    BC_CRON_OUT_OF_RANGE = -3,
+};
+
+// One field, surrounding spaces ignored: a number or "*"/"?". *value_out is
+// -1 for a wildcard. On BC_CRON_OUT_OF_RANGE it holds the rejected value.
+int bc_cron_parse_field(const char *field, size_t len, int min_val, int max_val, int *value_out);
+
+// Five field values (-1 = any) to bitsets.
+void bc_cron_compile(const int values[BC_CRON_FIELDS], bc_cron_t *out);
+
+// First local minute strictly after `after` (epoch seconds) that matches,
+// or 0 if none does within the next few years (e.g. Feb 31).
+time_t bc_cron_next_fire(const bc_cron_t *schedule, time_t after);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
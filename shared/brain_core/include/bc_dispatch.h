@@ -0,0 +1,42 @@
+#ifndef BC_DISPATCH_H
+#define BC_DISPATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What may follow a command name.
+typedef enum {
+    BC_ARGS_NONE = 0,      // exact match only
+    BC_ARGS_OPTIONAL = 1,  // "name" or "name <args>"
+    BC_ARGS_REQUIRED = 2,  // "name <args>" only
+} bc_args_t;
+
+// A caller-owned command table, sorted by name in strcmp order. Entries are
+// the caller's own structs; the table only needs where the name
+// (const char *, lowercase, words separated by single spaces) and the
+// argument rule (a uint8_t bc_args_t) sit in each one.
+typedef struct {
+    const void *entries;
+    size_t count;
+    size_t stride;       // sizeof one entry
+    size_t name_offset;  // offsetof the name
+    size_t args_offset;  // offsetof the argument rule
+    int max_words;       // longest multi-word name
+} bc_table_t;
+
+// Entry whose name is exactly key[0..key_len), or NULL. Binary search, no copies.
+const void *bc_table_find_exact(const bc_table_t *table, const char *key, size_t key_len);
+
+// Entry for a lowercased, trimmed command line: its first one to max_words
+// words, taking the first whose argument rule fits what follows. NULL if none.
+const void *bc_table_find(const bc_table_t *table, const char *input, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
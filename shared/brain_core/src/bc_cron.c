@@ -0,0 +1,138 @@
+// localtime_r() is POSIX, not ISO C
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "bc_cron.h"
+
+#include <string.h>
+
+int bc_cron_parse_field(const char *field, size_t len, int min_val, int max_val, int *value_out)
+{
+    while (len > 0 && *field == ' ') {
+        field++;
+        len--;
+    }
+    while (len > 0 && field[len - 1] == ' ') {
+        len--;
+    }
+
+    if (len == 1 && (field[0] == '*' || field[0] == '?')) {
+        *value_out = -1;
+        return BC_CRON_OK;
+    }
+    if (len == 0) {
+        return BC_CRON_EMPTY;
+    }
+
+    // Strict: "14:05" or "60abc" are errors, not 14 and 60
+    int value = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (field[i] < '0' || field[i] > '9') {
+            return BC_CRON_NOT_NUMERIC;
+        }
+        if (value <= 9999) {
+            value = value * 10 + (field[i] - '0');
+        }
+    }
+    *value_out = value;
+    return value < min_val || value > max_val ? BC_CRON_OUT_OF_RANGE : BC_CRON_OK;
+}
+
+void bc_cron_compile(const int values[BC_CRON_FIELDS], bc_cron_t *out)
+{
+    const int minute = values[BC_CRON_MINUTE];
+    const int hour = values[BC_CRON_HOUR];
+    const int day = values[BC_CRON_DAY];
+    const int month = values[BC_CRON_MONTH];
+    const int weekday = values[BC_CRON_WEEKDAY];
+    out->minutes = minute < 0 ? ((1ULL << 60) - 1) : (1ULL << minute);
+    out->hours = hour < 0 ? ((1UL << 24) - 1) : (1UL << hour);
+    out->days = day < 0 ? 0xFFFFFFFEUL : (1UL << day);
+    out->months = month < 0 ? 0x1FFE : (uint16_t)(1U << month);
+    out->weekdays = weekday < 0 ? 0x7F : (uint8_t)(1U << weekday);
+}
+
+// Index of the lowest set bit; mask is non-zero.
+static int lowest_bit(uint64_t mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(mask);
+#else
+    int n = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+// Lowest set bit of mask at or above from, or -1.
+static int next_bit(uint64_t mask, int from)
+{
+    if (from >= 64) {
+        return -1;
+    }
+    const uint64_t rest = mask & (~0ULL << from);
+    return rest ? lowest_bit(rest) : -1;
+}
+
+// mktime() folds overflowing fields into the next unit and resolves DST.
+static void normalize_tm(struct tm *tm)
+{
+    tm->tm_isdst = -1;
+    time_t t = mktime(tm);
+    localtime_r(&t, tm);
+}
+
+time_t bc_cron_next_fire(const bc_cron_t *schedule, time_t after)
+{
+    time_t start = (after / 60 + 1) * 60;
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    localtime_r(&start, &tm);
+    tm.tm_sec = 0;
+    const int last_year = tm.tm_year + 5;
+
+    // Each step jumps to the next candidate for the outermost field that does
+    // not match, then re-checks everything from the top.
+    while (tm.tm_year <= last_year) {
+        if (!((schedule->months >> (tm.tm_mon + 1)) & 1)) {
+            tm.tm_mon++;
+            tm.tm_mday = 1;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+            normalize_tm(&tm);
+            continue;
+        }
+        if (!((schedule->days >> tm.tm_mday) & 1) || !((schedule->weekdays >> tm.tm_wday) & 1)) {
+            tm.tm_mday++;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+            normalize_tm(&tm);
+            continue;
+        }
+        if (!((schedule->hours >> tm.tm_hour) & 1)) {
+            const int hour = next_bit(schedule->hours, tm.tm_hour + 1);
+            tm.tm_hour = hour < 0 ? 24 : hour;
+            tm.tm_min = 0;
+            normalize_tm(&tm);
+            continue;
+        }
+        const int minute = next_bit(schedule->minutes, tm.tm_min);
+        if (minute != tm.tm_min) {
+            if (minute < 0) {
+                tm.tm_hour++;
+                tm.tm_min = 0;
+            } else {
+                tm.tm_min = minute;
+            }
+            normalize_tm(&tm);
+            continue;
+        }
+        tm.tm_isdst = -1;
+        return mktime(&tm);
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include "bc_dispatch.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+static const char *entry_name(const bc_table_t *table, size_t i)
+{
+    const char *entry = (const char *)table->entries + i * table->stride;
+    const char *name;
+    memcpy(&name, entry + table->name_offset, sizeof(name));
+    return name;
+}
+
+static uint8_t entry_args(const bc_table_t *table, const void *entry)
+{
+    return *((const uint8_t *)entry + table->args_offset);
+}
+
+const void *bc_table_find_exact(const bc_table_t *table, const char *key, size_t key_len)
+{
+    size_t lo = 0;
+    size_t hi = table->count;
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        const char *name = entry_name(table, mid);
+        int c = strncmp(name, key, key_len);
+        if (c == 0 && name[key_len] != '\0') {
+            c = 1;
+        }
+        if (c == 0) {
+            return (const char *)table->entries + mid * table->stride;
+        }
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+const void *bc_table_find(const bc_table_t *table, const char *input, size_t len)
+{
+    size_t end = 0;
+    for (int words = 0; words < table->max_words && end < len; words++) {
+        if (words > 0) {
+            end++;  // skip the separating space
+        }
+        while (end < len && input[end] != ' ') {
+            end++;
+        }
+        const void *entry = bc_table_find_exact(table, input, end);
+        if (entry != NULL) {
+            const bool has_args = end < len;
+            const uint8_t args = entry_args(table, entry);
+            if (has_args ? args != BC_ARGS_NONE : args != BC_ARGS_REQUIRED) {
+                return entry;
+            }
+        }
+    }
+    return NULL;
+}
@@ -1,56 +1,85 @@
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "esp_log.h"
 
+#include "bc_dispatch.h"
 #include "tool_registry.h"
 
 static const char *TAG = "tool_registry";
 
-void tool_registry_init(void)
-{
-    ESP_LOGI(TAG, "Allowed tools: status, relay_set <pin> <0|1>, sensor_read <id>");
-}
+typedef bool (*tool_handler_t)(const char *input, char *out, size_t out_len);
 
-static bool starts_with(const char *s, const char *prefix)
+typedef struct {
+    const char *name;
+    uint8_t args;  // bc_args_t
+    tool_handler_t handler;
+} tool_spec_t;
+
+static bool tool_status(const char *input, char *out, size_t out_len)
 {
-    return strncmp(s, prefix, strlen(prefix)) == 0;
+    (void)input;
+    snprintf(out, out_len, "OK: uptime and health nominal");
+    return true;
 }
 
-bool tool_registry_execute(const char *input, char *out, size_t out_len)
+static bool tool_relay_set(const char *input, char *out, size_t out_len)
 {
-    if (!input || !out || out_len == 0) {
-        return false;
+    int pin = -1;
+    int state = -1;
+    if (sscanf(input, "relay_set %d %d", &pin, &state) == 2) {
+        if ((pin >= 0 && pin <= 39) && (state == 0 || state == 1)) {
+            snprintf(out, out_len, "OK: relay pin %d -> %d", pin, state);
+            return true;
+        }
     }
+    snprintf(out, out_len, "ERR: usage relay_set <pin> <0|1>");
+    return true;
+}
 
-    if (strcmp(input, "status") == 0) {
-        snprintf(out, out_len, "OK: uptime and health nominal");
+static bool tool_sensor_read(const char *input, char *out, size_t out_len)
+{
+    int id = -1;
+    if (sscanf(input, "sensor_read %d", &id) == 1 && id >= 0 && id <= 16) {
+        snprintf(out, out_len, "OK: sensor %d value=0", id);
         return true;
     }
+    snprintf(out, out_len, "ERR: usage sensor_read <id>");
+    return true;
+}
 
-    if (starts_with(input, "relay_set ")) {
-        int pin = -1;
-        int state = -1;
-        if (sscanf(input, "relay_set %d %d", &pin, &state) == 2) {
-            if ((pin >= 0 && pin <= 39) && (state == 0 || state == 1)) {
-                snprintf(out, out_len, "OK: relay pin %d -> %d", pin, state);
-                return true;
-            }
-        }
-        snprintf(out, out_len, "ERR: usage relay_set <pin> <0|1>");
-        return true;
-    }
+// Sorted by name (strcmp order); looked up by the shared brain_core dispatcher.
+static const tool_spec_t s_tools[] = {
+    {"relay_set", BC_ARGS_REQUIRED, tool_relay_set},
+    {"sensor_read", BC_ARGS_REQUIRED, tool_sensor_read},
+    {"status", BC_ARGS_NONE, tool_status},
+};
 
-    if (starts_with(input, "sensor_read ")) {
-        int id = -1;
-        if (sscanf(input, "sensor_read %d", &id) == 1 && id >= 0 && id <= 16) {
-            snprintf(out, out_len, "OK: sensor %d value=0", id);
-            return true;
-        }
-        snprintf(out, out_len, "ERR: usage sensor_read <id>");
-        return true;
+static const bc_table_t s_tool_table = {
+    .entries = s_tools,
+    .count = sizeof(s_tools) / sizeof(s_tools[0]),
+    .stride = sizeof(tool_spec_t),
+    .name_offset = offsetof(tool_spec_t, name),
+    .args_offset = offsetof(tool_spec_t, args),
+    .max_words = 1,
+};
+
+void tool_registry_init(void)
+{
+    ESP_LOGI(TAG, "Allowed tools: status, relay_set <pin> <0|1>, sensor_read <id>");
+}
+
+bool tool_registry_execute(const char *input, char *out, size_t out_len)
+{
+    if (!input || !out || out_len == 0) {
+        return false;
     }
 
-    return false;
+    const tool_spec_t *tool = bc_table_find(&s_tool_table, input, strlen(input));
+    if (tool == NULL) {
+        return false;
+    }
+    return tool->handler(input, out, out_len);
 }
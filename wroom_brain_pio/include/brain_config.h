@@ -11,6 +11,48 @@
 #error "Missing WIFI_PASS define. Set it in .env."
 #endif
 
+// Static station address; "" uses DHCP
+#ifndef WIFI_STATIC_IP
+#define WIFI_STATIC_IP ""
+#endif
+
+#ifndef WIFI_GATEWAY
+#define WIFI_GATEWAY ""
+#endif
+
+#ifndef WIFI_SUBNET
+#define WIFI_SUBNET "255.255.255.0"
+#endif
+
+#ifndef WIFI_DNS
+#define WIFI_DNS ""
+#endif
+
+// Connect attempts straight to the cached channel/BSSID before a full scan
+#ifndef WIFI_FAST_CONNECT_TRIES
+#define WIFI_FAST_CONNECT_TRIES 2
+#endif
+
+// An attempt with no connect or disconnect event by then is retried
+#ifndef WIFI_CONNECT_TIMEOUT_MS
+#define WIFI_CONNECT_TIMEOUT_MS 10000
+#endif
+
+// Backoff between failed attempts, doubling from MIN to MAX. A drop from a
+// working link retries at once.
+#ifndef WIFI_RECONNECT_MIN_MS
+#define WIFI_RECONNECT_MIN_MS 250
+#endif
+
+#ifndef WIFI_RECONNECT_MAX_MS
+#define WIFI_RECONNECT_MAX_MS 30000
+#endif
+
+// How long an outgoing Telegram request waits for a reconnect in progress
+#ifndef WIFI_SEND_WAIT_MS
+#define WIFI_SEND_WAIT_MS 3000
+#endif
+
 #ifndef TELEGRAM_BOT_TOKEN
 #error "Missing TELEGRAM_BOT_TOKEN define. Set it in .env."
 #endif
@@ -19,10 +61,38 @@
 #error "Missing TELEGRAM_ALLOWED_CHAT_ID define. Set it in .env."
 #endif
 
+// Further chats the bot serves, comma-separated ids. TELEGRAM_ALLOWED_CHAT_ID
+// is the owner chat: scheduler output goes there and its history stays in NVS;
+// team chats keep theirs in per-chat session files.
+#ifndef TELEGRAM_TEAM_CHAT_IDS
+#define TELEGRAM_TEAM_CHAT_IDS ""
+#endif
+
 #ifndef TELEGRAM_POLL_MS
 #define TELEGRAM_POLL_MS 3000
 #endif
 
+// getUpdates long-poll timeout in seconds, served by a dedicated task over a
+// kept-alive connection. 0 falls back to short polling every TELEGRAM_POLL_MS.
+#ifndef TELEGRAM_LONG_POLL_S
+#define TELEGRAM_LONG_POLL_S 25
+#endif
+
+// Webhook mode: Telegram pushes updates to TELEGRAM_WEBHOOK_URL + /tg/<secret>
+// (reverse proxy or tunnel to port 80). Polling is off when both are set.
+#ifndef TELEGRAM_WEBHOOK_URL
+#define TELEGRAM_WEBHOOK_URL ""
+#endif
+
+#ifndef TELEGRAM_WEBHOOK_SECRET
+#define TELEGRAM_WEBHOOK_SECRET ""
+#endif
+
+// Updates consumed and dispatched per getUpdates response
+#ifndef TELEGRAM_UPDATES_PER_POLL
+#define TELEGRAM_UPDATES_PER_POLL 10
+#endif
+
 #ifndef AUTONOMOUS_STATUS_ENABLED
 #define AUTONOMOUS_STATUS_ENABLED 0
 #endif
@@ -72,6 +142,442 @@
 #define LLM_TIMEOUT_MS 180000
 #endif
 
+// Adaptive LLM timeouts: once a host has this many measured streamed calls,
+// the header wait for streamed calls becomes FACTOR x its expected TTFB + SLACK
+// (bounded by MIN and 65535ms). Buffered calls never wait less than
+// LLM_TIMEOUT_MS.
+#ifndef LLM_TIMEOUT_MIN_SAMPLES
+#define LLM_TIMEOUT_MIN_SAMPLES 3
+#endif
+
+#ifndef LLM_TIMEOUT_TTFB_FACTOR
+#define LLM_TIMEOUT_TTFB_FACTOR 4
+#endif
+
+#ifndef LLM_TIMEOUT_SLACK_MS
+#define LLM_TIMEOUT_SLACK_MS 8000
+#endif
+
+#ifndef LLM_TIMEOUT_MIN_MS
+#define LLM_TIMEOUT_MIN_MS 15000
+#endif
+
+// LLM HTTP attempts per request; backoff starts at LLM_RETRY_BASE_MS and doubles
+#ifndef LLM_HTTP_MAX_ATTEMPTS
+#define LLM_HTTP_MAX_ATTEMPTS 3
+#endif
+
+#ifndef LLM_RETRY_BASE_MS
+#define LLM_RETRY_BASE_MS 400
+#endif
+
+// Longest Retry-After honoured on 429/503; longer waits fail over instead
+#ifndef LLM_RETRY_AFTER_MAX_MS
+#define LLM_RETRY_AFTER_MAX_MS 8000
+#endif
+
+// Keep-alive TLS connections reused across LLM calls (each holds ~40KB heap)
+#ifndef LLM_CONN_POOL_SIZE
+#define LLM_CONN_POOL_SIZE 2
+#endif
+
+#ifndef LLM_CONN_IDLE_MS
+#define LLM_CONN_IDLE_MS 30000
+#endif
+
+// Latency-sensitive calls (routing, fact extraction) may move to a provider
+// that has proven faster after this many measured calls
+#ifndef LLM_HEALTH_MIN_SAMPLES
+#define LLM_HEALTH_MIN_SAMPLES 3
+#endif
+
+// Providers failing more often than this (per mille, EWMA) are not picked as faster
+#ifndef LLM_HEALTH_MAX_ERROR_PERMILLE
+#define LLM_HEALTH_MAX_ERROR_PERMILLE 300
+#endif
+
+// Race a second provider when a latency-sensitive call has not answered after
+// this long (0 = off; a hedge holds a second TLS session, ~40KB heap)
+#ifndef LLM_HEDGE_AFTER_MS
+#define LLM_HEDGE_AFTER_MS 0
+#endif
+
+// Free heap required before a hedged request is started
+#ifndef LLM_HEDGE_MIN_HEAP
+#define LLM_HEDGE_MIN_HEAP 100000
+#endif
+
+// Start the chat reply alongside the LLM router instead of after it (1 = on).
+// Saves a round trip on unrouted messages; routed ones pay for a reply that
+// is cut off. Needs LLM_HEDGE_MIN_HEAP free, for the second TLS session
+#ifndef LLM_SPECULATIVE_REPLY
+#define LLM_SPECULATIVE_REPLY 1
+#endif
+
+// Stream chat replies into a live Telegram message (OpenAI-compatible/Anthropic)
+#ifndef LLM_STREAMING_ENABLED
+#define LLM_STREAMING_ENABLED 1
+#endif
+
+// ReAct sends its tools as native function definitions to providers that take
+// them (OpenAI/OpenRouter tools, Anthropic tool_use, Gemini functionDeclarations);
+// others, or 0 here, keep the text THINK/DO/ANSWER protocol
+#ifndef LLM_NATIVE_TOOLS_ENABLED
+#define LLM_NATIVE_TOOLS_ENABLED 1
+#endif
+
+// Tool calls kept from one native tool-calling reply
+#ifndef LLM_TOOL_MAX_CALLS
+#define LLM_TOOL_MAX_CALLS 3
+#endif
+
+// Minimum gap between editMessageText updates while streaming
+#ifndef LLM_STREAM_EDIT_MS
+#define LLM_STREAM_EDIT_MS 1200
+#endif
+
+// Characters to collect before the live message is first posted
+#ifndef LLM_STREAM_MIN_CHARS
+#define LLM_STREAM_MIN_CHARS 24
+#endif
+
+// Minimum gap between token events pushed to the web UI over /api/events
+#ifndef WEB_EVENTS_STREAM_MS
+#define WEB_EVENTS_STREAM_MS 250
+#endif
+
+// Skip token events while a client has this many unsent packets queued
+#ifndef WEB_EVENTS_MAX_BACKLOG
+#define WEB_EVENTS_MAX_BACKLOG 8
+#endif
+
+// Route obvious tool requests on-device; the LLM router only sees ambiguous ones
+#ifndef INTENT_ROUTER_ENABLED
+#define INTENT_ROUTER_ENABLED 1
+#endif
+
+// Cue score an intent needs, and its lead over the runner-up, to route locally
+#ifndef INTENT_ROUTER_MIN_SCORE
+#define INTENT_ROUTER_MIN_SCORE 4
+#endif
+
+#ifndef INTENT_ROUTER_MIN_MARGIN
+#define INTENT_ROUTER_MIN_MARGIN 2
+#endif
+
+// Longer messages skip local routing and go to the LLM router as before
+#ifndef INTENT_ROUTER_MAX_CHARS
+#define INTENT_ROUTER_MAX_CHARS 200
+#endif
+
+// Days of daily notes searched for snippets relevant to each chat message
+#ifndef DAILY_RECALL_DAYS
+#define DAILY_RECALL_DAYS 7
+#endif
+
+// Prompt budget for recalled daily-note snippets (0 disables recall)
+#ifndef DAILY_RECALL_MAX_CHARS
+#define DAILY_RECALL_MAX_CHARS 600
+#endif
+
+// Daily note files older than this are deleted
+#ifndef DAILY_RETENTION_DAYS
+#define DAILY_RETENTION_DAYS 30
+#endif
+
+// Internal flash filesystem: 1 = LittleFS (migrates an existing SPIFFS once), 0 = SPIFFS
+#ifndef FS_USE_LITTLEFS
+#define FS_USE_LITTLEFS 0
+#endif
+
+// RAM budget for staging files during the SPIFFS -> LittleFS migration
+#ifndef FLASH_FS_MIGRATE_MAX_BYTES
+#define FLASH_FS_MIGRATE_MAX_BYTES 65536
+#endif
+
+// Store /projects files written whole as gzip (<path>.gz) when it saves space;
+// reads expand them and the web server sends them as-is
+#ifndef FILE_COMPRESS_ENABLED
+#define FILE_COMPRESS_ENABLED 1
+#endif
+
+// Smaller files are not worth a header and a hash table
+#ifndef FILE_COMPRESS_MIN_BYTES
+#define FILE_COMPRESS_MIN_BYTES 256
+#endif
+
+// Largest file a compressed copy may expand to in RAM
+#ifndef FILE_DECOMPRESS_MAX_BYTES
+#define FILE_DECOMPRESS_MAX_BYTES 131072
+#endif
+
+// Website edits ask the model for search/replace blocks instead of the whole
+// file; a reply that does not apply falls back to full regeneration once
+#ifndef WEB_ITERATION_PATCH_MODE
+#define WEB_ITERATION_PATCH_MODE 1
+#endif
+
+// Static files under this prefix are cached by browsers for a year; name them
+// by content (app.3f2a.js) so an edit is a new URL. Everything else revalidates.
+#ifndef WEB_IMMUTABLE_PREFIX
+#define WEB_IMMUTABLE_PREFIX "/static/"
+#endif
+
+// MEMORY.md / USER.md chunks retrieved per chat message
+#ifndef MEMORY_RETRIEVAL_TOP_K
+#define MEMORY_RETRIEVAL_TOP_K 4
+#endif
+
+// Prompt budget for retrieved memory (daily-note recall takes what is left)
+#ifndef MEMORY_RETRIEVAL_MAX_CHARS
+#define MEMORY_RETRIEVAL_MAX_CHARS 900
+#endif
+
+// Prompt budget in estimated tokens for the variable context of a request
+// (query, tool results, history, memory, skills); fixed instructions only
+// count against the model window. Lower-priority sections are trimmed first.
+#ifndef CONTEXT_TARGET_TOKENS
+#define CONTEXT_TARGET_TOKENS 2000
+#endif
+
+// Window space kept free for the model's reply
+#ifndef CONTEXT_REPLY_RESERVE_TOKENS
+#define CONTEXT_REPLY_RESERVE_TOKENS 1024
+#endif
+
+// Context window assumed for a model the budget table does not know
+#ifndef CONTEXT_DEFAULT_WINDOW_TOKENS
+#define CONTEXT_DEFAULT_WINDOW_TOKENS 8192
+#endif
+
+// Ollama's num_ctx; prompts past it are cut server-side whatever the model takes
+#ifndef CONTEXT_OLLAMA_WINDOW_TOKENS
+#define CONTEXT_OLLAMA_WINDOW_TOKENS 4096
+#endif
+
+// Sections one prompt budget tracks
+#ifndef CONTEXT_MAX_SECTIONS
+#define CONTEXT_MAX_SECTIONS 8
+#endif
+
+// Usage counters are kept in RAM and written to NVS in one batch after this
+// many recorded calls, or on the timer below (and before OTA/reboot)
+#ifndef USAGE_FLUSH_DIRTY_CALLS
+#define USAGE_FLUSH_DIRTY_CALLS 10
+#endif
+
+// Longest time unsaved usage counters may sit in RAM
+#ifndef USAGE_FLUSH_INTERVAL_MS
+#define USAGE_FLUSH_INTERVAL_MS 300000
+#endif
+
+// Agent queue message slots: small ones for chat lines, large ones for pasted
+// text up to a full Telegram message (4096 chars)
+#ifndef AGENT_MSG_SMALL_SLOTS
+#define AGENT_MSG_SMALL_SLOTS 12
+#endif
+
+#ifndef AGENT_MSG_SMALL_BYTES
+#define AGENT_MSG_SMALL_BYTES 384
+#endif
+
+#ifndef AGENT_MSG_LARGE_SLOTS
+#define AGENT_MSG_LARGE_SLOTS 2
+#endif
+
+#ifndef AGENT_MSG_LARGE_BYTES
+#define AGENT_MSG_LARGE_BYTES 4100
+#endif
+
+// Write-ahead spool of accepted messages (replayed after a crash). Writes
+// are synced to flash at most this often, so one sync covers a burst
+#ifndef MSG_SPOOL_SYNC_MS
+#define MSG_SPOOL_SYNC_MS 250
+#endif
+
+#ifndef MSG_SPOOL_PATH
+#define MSG_SPOOL_PATH "/spool.bin"
+#endif
+
+// The spool file is truncated once it is larger than this and idle
+#ifndef MSG_SPOOL_COMPACT_BYTES
+#define MSG_SPOOL_COMPACT_BYTES 16384
+#endif
+
+// Boots a message is replayed in before it is dropped as a likely crash cause
+#ifndef MSG_SPOOL_MAX_ATTEMPTS
+#define MSG_SPOOL_MAX_ATTEMPTS 2
+#endif
+
+// Unfinished messages recovered at boot (the newest are kept)
+#ifndef MSG_SPOOL_REPLAY_MAX
+#define MSG_SPOOL_REPLAY_MAX 16
+#endif
+
+// Chats with their own agent sub-queue (the web UI and the scheduler take one
+// each). Lanes serve them round robin, one message per chat per turn
+#ifndef AGENT_MAX_CHATS
+#define AGENT_MAX_CHATS 6
+#endif
+
+// Messages one chat may have waiting per lane
+#ifndef AGENT_CHAT_QUEUE_DEPTH
+#define AGENT_CHAT_QUEUE_DEPTH 4
+#endif
+
+// Web UI replies held for GET /api/chat/<id>; the oldest is dropped when full
+#ifndef AGENT_WEB_RESULT_SLOTS
+#define AGENT_WEB_RESULT_SLOTS 8
+#endif
+
+// Longest GET /api/chat/<id> long-poll before answering "pending"
+#ifndef AGENT_WEB_RESULT_WAIT_MS
+#define AGENT_WEB_RESULT_WAIT_MS 25000
+#endif
+
+// Background LLM calls (heartbeat, proactive, fact extraction) arriving within
+// this window share one combined request (0 = every call goes alone)
+#ifndef LLM_BATCH_WINDOW_MS
+#define LLM_BATCH_WINDOW_MS 3000
+#endif
+
+// Most background tasks answered by a single combined request
+#ifndef LLM_BATCH_MAX_TASKS
+#define LLM_BATCH_MAX_TASKS 4
+#endif
+
+// A heartbeat or proactive check due within this long runs early alongside
+// the other one so the two can be batched
+#ifndef LLM_BATCH_ALIGN_MS
+#define LLM_BATCH_ALIGN_MS 300000
+#endif
+
+// Auto-learn batches this many user messages into one fact-extraction call
+#ifndef AUTO_LEARN_BATCH_MAX
+#define AUTO_LEARN_BATCH_MAX 4
+#endif
+
+// ...or runs once no new message has arrived for this long
+#ifndef AUTO_LEARN_IDLE_MS
+#define AUTO_LEARN_IDLE_MS 20000
+#endif
+
+// Per-stage latency spans for /trace and /api/trace
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+// Spans kept in the trace ring (about 48 bytes each)
+#ifndef TRACE_MAX_SPANS
+#define TRACE_MAX_SPANS 64
+#endif
+
+// Long-lived tasks whose stack high-water mark /api/metrics reports
+#ifndef METRICS_MAX_TASKS
+#define METRICS_MAX_TASKS 12
+#endif
+
+// Event log: text bytes per binary record (the record is 16 bytes more)
+#ifndef EVENT_LOG_TEXT_CHARS
+#define EVENT_LOG_TEXT_CHARS 112
+#endif
+
+// Records buffered in RAM between flash flushes
+#ifndef EVENT_LOG_RAM_RECORDS
+#define EVENT_LOG_RAM_RECORDS 40
+#endif
+
+// Slots in the circular flash file (128 B each, preallocated at first boot)
+#ifndef EVENT_LOG_FLASH_RECORDS
+#define EVENT_LOG_FLASH_RECORDS 128
+#endif
+
+// Longest time new records stay in RAM only
+#ifndef EVENT_LOG_FLUSH_MS
+#define EVENT_LOG_FLUSH_MS 10000
+#endif
+
+#ifndef EVENT_LOG_PATH
+#define EVENT_LOG_PATH "/events.bin"
+#endif
+
+// Task topology. Network I/O (Telegram long poll, AsyncTCP, hedged LLM
+// requests) runs on TASK_CORE_NET next to the WiFi driver; the agent lanes,
+// scheduler, MinOS and background work run on TASK_CORE_APP, which is also
+// where the Arduino loop lives. AsyncTCP is a library task, so its core is
+// set with CONFIG_ASYNC_TCP_RUNNING_CORE in platformio.ini
+#ifndef TASK_CORE_NET
+#define TASK_CORE_NET 0
+#endif
+
+#ifndef TASK_CORE_APP
+#define TASK_CORE_APP 1
+#endif
+
+// Priorities (idle is 0). Mostly-blocked network tasks sit highest so a ready
+// socket is served at once; quick commands preempt long LLM jobs
+#ifndef TASK_PRIO_NET
+#define TASK_PRIO_NET 3
+#endif
+
+// Arduino loop: OTA, status LED and the short-poll fallback
+#ifndef TASK_PRIO_LOOP
+#define TASK_PRIO_LOOP 2
+#endif
+
+#ifndef TASK_PRIO_AGENT_FAST
+#define TASK_PRIO_AGENT_FAST 2
+#endif
+
+#ifndef TASK_PRIO_SCHEDULER
+#define TASK_PRIO_SCHEDULER 2
+#endif
+
+// Slow agent lane, ReAct tool workers and hedged LLM requests
+#ifndef TASK_PRIO_AGENT
+#define TASK_PRIO_AGENT 1
+#endif
+
+#ifndef TASK_PRIO_MINOS
+#define TASK_PRIO_MINOS 1
+#endif
+
+// Fact extraction only uses time the reply path leaves idle
+#ifndef TASK_PRIO_BACKGROUND
+#define TASK_PRIO_BACKGROUND 0
+#endif
+
+// Longest a worker holds its first message while memory, skills and the
+// scheduler finish initialising in the background (boot only)
+#ifndef BOOT_DEFERRED_WAIT_MS
+#define BOOT_DEFERRED_WAIT_MS 8000
+#endif
+
+// Delay after boot before the one-shot firmware update check (GITHUB_REPO)
+#ifndef UPDATE_CHECK_DELAY_MS
+#define UPDATE_CHECK_DELAY_MS 30000
+#endif
+
+// Firmware download buffer; each chunk is hashed and flashed before the next read
+#ifndef OTA_CHUNK_BYTES
+#define OTA_CHUNK_BYTES 4096
+#endif
+
+// Times a dropped firmware download resumes (Range request) before giving up
+#ifndef OTA_MAX_RESUMES
+#define OTA_MAX_RESUMES 8
+#endif
+
+// A download that receives nothing this long is dropped and resumed
+#ifndef OTA_STALL_MS
+#define OTA_STALL_MS 15000
+#endif
+
+// Longest a resume waits for WiFi to come back
+#ifndef OTA_RESUME_WAIT_MS
+#define OTA_RESUME_WAIT_MS 30000
+#endif
+
 // Image generation provider (separate from chat LLM)
 #ifndef IMAGE_PROVIDER
 #define IMAGE_PROVIDER "none"
@@ -91,6 +597,91 @@
 #define RESEND_API_KEY ""
 #endif
 
+// Outgoing emails waiting for the background sender
+#ifndef EMAIL_QUEUE_DEPTH
+#define EMAIL_QUEUE_DEPTH 8
+#endif
+
+// Emails to one recipient within this window go out as a single digest (0 sends each at once)
+#ifndef EMAIL_DIGEST_WINDOW_MS
+#define EMAIL_DIGEST_WINDOW_MS 20000
+#endif
+
+// A digest is sent early once it holds this many emails or this much content
+#ifndef EMAIL_DIGEST_MAX_PARTS
+#define EMAIL_DIGEST_MAX_PARTS 6
+#endif
+
+#ifndef EMAIL_DIGEST_MAX_BYTES
+#define EMAIL_DIGEST_MAX_BYTES 49152
+#endif
+
+// Keep-alive TLS connection to the Resend API is closed after this idle time
+#ifndef EMAIL_CONN_IDLE_MS
+#define EMAIL_CONN_IDLE_MS 30000
+#endif
+
+// Extra attempts after a network error, 429 or 5xx, with doubling backoff
+#ifndef EMAIL_SEND_RETRIES
+#define EMAIL_SEND_RETRIES 2
+#endif
+
+#ifndef EMAIL_RETRY_BACKOFF_MS
+#define EMAIL_RETRY_BACKOFF_MS 3000
+#endif
+
+// Provider prompt caching: stable system-prompt prefixes are kept byte-identical
+// (OpenAI/OpenRouter cache those automatically) and marked with cache_control
+// for Anthropic once they are long enough to qualify (~1024 tokens).
+#ifndef LLM_PROMPT_CACHE_ENABLED
+#define LLM_PROMPT_CACHE_ENABLED 1
+#endif
+
+#ifndef LLM_PROMPT_CACHE_MIN_CHARS
+#define LLM_PROMPT_CACHE_MIN_CHARS 4000
+#endif
+
+// Largest prompt context section kept in the RAM cache (bigger ones are re-read)
+#ifndef CONTEXT_CACHE_MAX_CHARS
+#define CONTEXT_CACHE_MAX_CHARS 4096
+#endif
+
+// Response cache for repeated LLM/tool requests: slot count and RAM budget
+#ifndef RESPONSE_CACHE_ENTRIES
+#define RESPONSE_CACHE_ENTRIES 16
+#endif
+#ifndef RESPONSE_CACHE_MAX_BYTES
+#define RESPONSE_CACHE_MAX_BYTES 16384
+#endif
+
+// Longest single answer the response cache will keep
+#ifndef RESPONSE_CACHE_MAX_VALUE_CHARS
+#define RESPONSE_CACHE_MAX_VALUE_CHARS 4096
+#endif
+
+// TTLs (ms) for opted-in single-turn LLM calls (routing, parsing, extraction,
+// summaries), weather and web search results
+#ifndef RESPONSE_CACHE_LLM_TTL_MS
+#define RESPONSE_CACHE_LLM_TTL_MS 600000
+#endif
+#ifndef RESPONSE_CACHE_WEATHER_TTL_MS
+#define RESPONSE_CACHE_WEATHER_TTL_MS 900000
+#endif
+#ifndef RESPONSE_CACHE_SEARCH_TTL_MS
+#define RESPONSE_CACHE_SEARCH_TTL_MS 1800000
+#endif
+
+// Keep unexpired entries evicted from RAM in a flash file (1 = on)
+#ifndef RESPONSE_CACHE_SPILL
+#define RESPONSE_CACHE_SPILL 0
+#endif
+#ifndef RESPONSE_CACHE_SPILL_PATH
+#define RESPONSE_CACHE_SPILL_PATH "/cache/responses.bin"
+#endif
+#ifndef RESPONSE_CACHE_SPILL_BYTES
+#define RESPONSE_CACHE_SPILL_BYTES 65536
+#endif
+
 #ifndef MEMORY_MAX_CHARS
 #define MEMORY_MAX_CHARS 5000
 #endif
@@ -115,6 +706,114 @@
 #define SOUL_MAX_CHARS 1400
 #endif
 
+// Scheduler task: longest sleep between clock re-reads, and the poll interval
+// while NTP has not synced yet
+#ifndef SCHEDULER_MAX_SLEEP_MS
+#define SCHEDULER_MAX_SLEEP_MS 60000
+#endif
+
+#ifndef SCHEDULER_UNSYNCED_POLL_MS
+#define SCHEDULER_UNSYNCED_POLL_MS 2000
+#endif
+
+// How often (seconds) the scheduler persists the missed-job checkpoint when no
+// cron job fires; bounds what a reboot replays
+#ifndef SCHEDULER_LAST_CHECK_SAVE_S
+#define SCHEDULER_LAST_CHECK_SAVE_S 3600
+#endif
+
+// Shortest sleep, since calendar entries are compared at whole seconds
+#ifndef SCHEDULER_MIN_SLEEP_MS
+#define SCHEDULER_MIN_SLEEP_MS 250
+#endif
+
+// Pending cron_add in/at one-shot jobs
+#ifndef SCHEDULER_MAX_ONESHOTS
+#define SCHEDULER_MAX_ONESHOTS 8
+#endif
+
+// WiFi modem sleep plus automatic light sleep between scheduled events
+#ifndef POWER_SAVE_ENABLED
+#define POWER_SAVE_ENABLED 0
+#endif
+
+// Dynamic frequency scaling range while power saving
+#ifndef POWER_CPU_MAX_MHZ
+#define POWER_CPU_MAX_MHZ 240
+#endif
+
+#ifndef POWER_CPU_MIN_MHZ
+#define POWER_CPU_MIN_MHZ 80
+#endif
+
+// loop() tick while power saving; longer waits leave room to sleep
+#ifndef POWER_LOOP_DELAY_MS
+#define POWER_LOOP_DELAY_MS 120
+#endif
+
+// Timed calls per case for the bench command (after one warm-up call)
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 20
+#endif
+
+// TLS handshakes per provider for bench tls (each takes 1-3 s)
+#ifndef BENCH_TLS_ITERATIONS
+#define BENCH_TLS_ITERATIONS 3
+#endif
+
+// Scratch file size for the bench fs read/write throughput cases
+#ifndef BENCH_FS_BYTES
+#define BENCH_FS_BYTES 16384
+#endif
+
+// Soak runs (the soak command): messages per minute fed to the agent queue
+#ifndef SOAK_DEFAULT_RATE_PER_MIN
+#define SOAK_DEFAULT_RATE_PER_MIN 6
+#endif
+
+// How long the mock LLM endpoint holds each reply, and its reply text size
+#ifndef SOAK_MOCK_LATENCY_MS
+#define SOAK_MOCK_LATENCY_MS 1500
+#endif
+
+#ifndef SOAK_MOCK_REPLY_BYTES
+#define SOAK_MOCK_REPLY_BYTES 600
+#endif
+
+#ifndef SOAK_MOCK_REPLY_MAX_BYTES
+#define SOAK_MOCK_REPLY_MAX_BYTES 16384
+#endif
+
+// Ollama-compatible endpoint the device's own web server answers during a run
+#ifndef SOAK_MOCK_PATH
+#define SOAK_MOCK_PATH "/mock/llm"
+#endif
+
+// One message per line; the built-in corpus is used when the file is missing
+#ifndef SOAK_CORPUS_PATH
+#define SOAK_CORPUS_PATH "/soak.txt"
+#endif
+
+#ifndef SOAK_CORPUS_MAX
+#define SOAK_CORPUS_MAX 32
+#endif
+
+// Messages awaiting a reply; a tick that finds this many skips its send.
+// Each one holds a web result slot, so keep it below AGENT_WEB_RESULT_SLOTS.
+#ifndef SOAK_MAX_INFLIGHT
+#define SOAK_MAX_INFLIGHT 4
+#endif
+
+// A reply slower than this is counted as a timeout and stops being tracked
+#ifndef SOAK_REPLY_TIMEOUT_MS
+#define SOAK_REPLY_TIMEOUT_MS 300000
+#endif
+
+// Progress line to the event log (and serial) during a run
+#ifndef SOAK_REPORT_INTERVAL_MS
+#define SOAK_REPORT_INTERVAL_MS 600000
+#endif
+
 #ifndef HEARTBEAT_MAX_CHARS
 #define HEARTBEAT_MAX_CHARS 1400
 #endif
@@ -155,8 +854,9 @@
 #define REMINDER_GRACE_MINUTES 10
 #endif
 
-#ifndef TASKS_MAX_CHARS
-#define TASKS_MAX_CHARS 8000
+// Task table slots; when full the oldest finished task is replaced
+#ifndef TASKS_MAX_RECORDS
+#define TASKS_MAX_RECORDS 32
 #endif
 
 #ifndef WEB_SEARCH_API_KEY
@@ -191,6 +891,21 @@
 #define WEB_SEARCH_RESULTS_MAX 3
 #endif
 
+// With both Serper and Tavily keys set, query them at once and take the first
+// good answer (each needs its own TLS session, so only above the heap floor)
+#ifndef WEB_SEARCH_RACE
+#define WEB_SEARCH_RACE 1
+#endif
+
+#ifndef WEB_SEARCH_RACE_MIN_HEAP
+#define WEB_SEARCH_RACE_MIN_HEAP 120000
+#endif
+
+// Stack per racing search task (TLS handshake plus JSON parse)
+#ifndef WEB_SEARCH_RACE_STACK
+#define WEB_SEARCH_RACE_STACK 12288
+#endif
+
 #ifndef WEB_JOB_ENDPOINT_URL
 #define WEB_JOB_ENDPOINT_URL ""
 #endif
@@ -228,11 +943,49 @@
 #define ENABLE_IMAGE_GEN 1
 #endif
 
+// Flash file a generated image is decoded into before it is sent
+#ifndef IMAGE_SPOOL_PATH
+#define IMAGE_SPOOL_PATH "/image_spool.bin"
+#endif
+
 // Media understanding (PDF, image analysis)
 #ifndef ENABLE_MEDIA_UNDERSTANDING
 #define ENABLE_MEDIA_UNDERSTANDING 1
 #endif
 
+// Flash file that holds downloaded media as base64 while it is analyzed
+#ifndef MEDIA_SPOOL_PATH
+#define MEDIA_SPOOL_PATH "/media_spool.b64"
+#endif
+
+// Largest Telegram file (bytes) accepted for analysis through the flash spool
+#ifndef MEDIA_SPOOL_MAX_BYTES
+#define MEDIA_SPOOL_MAX_BYTES 1048576
+#endif
+
+// Largest Telegram file base64-encoded straight into RAM, without and with PSRAM
+#ifndef MEDIA_RAM_MAX_BYTES
+#define MEDIA_RAM_MAX_BYTES 120000
+#endif
+
+#ifndef PSRAM_MEDIA_RAM_MAX_BYTES
+#define PSRAM_MEDIA_RAM_MAX_BYTES 1048576
+#endif
+
+// Put large buffers in PSRAM; on by default when the board config has it
+#ifndef PSRAM_ALLOC_ENABLED
+#if defined(BOARD_HAS_PSRAM) || defined(CONFIG_SPIRAM)
+#define PSRAM_ALLOC_ENABLED 1
+#else
+#define PSRAM_ALLOC_ENABLED 0
+#endif
+#endif
+
+// With PSRAM, allocations of this size and up go external
+#ifndef PSRAM_MIN_BYTES
+#define PSRAM_MIN_BYTES 4096
+#endif
+
 // Task management system
 #ifndef ENABLE_TASKS
 #define ENABLE_TASKS 1
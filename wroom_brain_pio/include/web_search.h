@@ -10,7 +10,9 @@ struct SearchResult {
   String snippet;
 };
 
-// Perform web search with automatic fallback (Serper -> Tavily)
+// Perform web search: Serper and Tavily raced when both keys are set
+// (WEB_SEARCH_RACE), otherwise Serper -> Tavily fallback. Results are cached
+// per normalised query for RESPONSE_CACHE_SEARCH_TTL_MS.
 // Returns true if search succeeded, false otherwise
 // results_out: Array of search results (max 10)
 // results_count: Number of results returned
@@ -18,6 +20,10 @@ struct SearchResult {
 bool web_search(const String &query, SearchResult *results_out, int *results_count,
                String &provider_used, String &error_out);
 
+// Cache key form of a query: lowercase, punctuation and filler words
+// ("please", "search for", "the") dropped, so near-identical searches match.
+String web_search_normalize_query(const String &query);
+
 // Simple search interface - returns formatted text
 bool web_search_simple(const String &query, String &formatted_output, String &error_out);
 
@@ -51,7 +51,14 @@ if missing:
     print(f"[env] Missing required keys in .env: {', '.join(missing)}")
     Exit(1)
 
+telegram_team_chat_ids = parsed.get("TELEGRAM_TEAM_CHAT_IDS", "")
 poll_ms = parsed.get("TELEGRAM_POLL_MS", "3000")
+wifi_static_ip = parsed.get("WIFI_STATIC_IP", "")
+wifi_gateway = parsed.get("WIFI_GATEWAY", "")
+wifi_subnet = parsed.get("WIFI_SUBNET", "255.255.255.0")
+wifi_dns = parsed.get("WIFI_DNS", "")
+telegram_webhook_url = parsed.get("TELEGRAM_WEBHOOK_URL", "")
+telegram_webhook_secret = parsed.get("TELEGRAM_WEBHOOK_SECRET", "")
 status_enabled = parsed.get("AUTONOMOUS_STATUS_ENABLED", "0")
 status_ms = parsed.get("AUTONOMOUS_STATUS_MS", "30000")
 llm_timeout_ms = parsed.get("LLM_TIMEOUT_MS", "25000")
@@ -127,9 +134,16 @@ generated_header.write_text(
             "",
             f"#define WIFI_SSID {cpp_quoted(parsed['WIFI_SSID'])}",
             f"#define WIFI_PASS {cpp_quoted(parsed['WIFI_PASS'])}",
+            f"#define WIFI_STATIC_IP {cpp_quoted(wifi_static_ip)}",
+            f"#define WIFI_GATEWAY {cpp_quoted(wifi_gateway)}",
+            f"#define WIFI_SUBNET {cpp_quoted(wifi_subnet)}",
+            f"#define WIFI_DNS {cpp_quoted(wifi_dns)}",
             f"#define TELEGRAM_BOT_TOKEN {cpp_quoted(parsed['TELEGRAM_BOT_TOKEN'])}",
             f"#define TELEGRAM_ALLOWED_CHAT_ID {cpp_quoted(parsed['TELEGRAM_ALLOWED_CHAT_ID'])}",
+            f"#define TELEGRAM_TEAM_CHAT_IDS {cpp_quoted(telegram_team_chat_ids)}",
             f"#define TELEGRAM_POLL_MS {poll_ms}",
+            f"#define TELEGRAM_WEBHOOK_URL {cpp_quoted(telegram_webhook_url)}",
+            f"#define TELEGRAM_WEBHOOK_SECRET {cpp_quoted(telegram_webhook_secret)}",
             f"#define AUTONOMOUS_STATUS_ENABLED {status_enabled}",
             f"#define AUTONOMOUS_STATUS_MS {status_ms}",
             f"#define LLM_PROVIDER {cpp_quoted(llm_provider)}",
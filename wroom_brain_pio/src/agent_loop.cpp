@@ -1,41 +1,263 @@
 #include "agent_loop.h"
 
 #include <Arduino.h>
+#include <freertos/event_groups.h>
 #include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
+#include <freertos/timers.h>
 
+#include "auto_learn.h"
 #include "brain_config.h"
 #include "cron_store.h"
 #include "scheduler.h"
 #include "chat_history.h"
+#include "chat_scope.h"
+#include "context_cache.h"
+#include "email_client.h"
+#include "response_cache.h"
 #include "memory_store.h"
 #include "file_memory.h"
+#include "intent_router.h"
 #include "llm_client.h"
+#include "metrics.h"
 #include "model_config.h"
 #include "persona_store.h"
+#include "power_mgr.h"
 #include "event_log.h"
 #include "status_led.h"
 #include "task_store.h"
 #include "tool_registry.h"
+#include "trace.h"
 #include "transport_telegram.h"
 #include "usage_stats.h"
 #include "web_server.h"
 #include "react_agent.h"
 #include "skill_registry.h"
 #include "minos/minos.h"
+#include "msg_pool.h"
+#include "msg_spool.h"
+#include "wifi_link.h"
 
 // Store last LLM response for emailing code
 static String s_last_llm_response = "";
 // Store last generated code file for hosting/iteration
 static String s_last_generated_code = "";
 static String s_last_generated_filename = "";
+// Both lanes read and replace the three Strings above; copy them under this.
+static SemaphoreHandle_t s_last_lock = nullptr;
+
+static void last_lock() {
+  if (s_last_lock != nullptr) {
+    xSemaphoreTake(s_last_lock, portMAX_DELAY);
+  }
+}
+
+static void last_unlock() {
+  if (s_last_lock != nullptr) {
+    xSemaphoreGive(s_last_lock);
+  }
+}
 
 // Agent Task Logic
+enum AgentSource : uint8_t {
+  SOURCE_TELEGRAM = 0,
+  SOURCE_WEB,
+  SOURCE_SCHEDULER,
+  SOURCE_COUNT,
+};
+
+// Short table commands and scheduler events run on the fast lane so a long
+// ReAct or LLM job on the slow lane cannot stall them.
+enum AgentLane : uint8_t {
+  LANE_FAST = 0,
+  LANE_SLOW,
+  LANE_COUNT,
+};
+
+// Queue items carry a msg_pool handle; the dequeuing worker owns the slot.
 struct AgentTaskMsg {
-  char *msg_ptr;
+  msg_handle_t slot;
   bool from_telegram;
+  uint8_t source;
+  uint8_t chat;         // s_chats index
+  uint32_t request_id;  // web result slot to fill, 0 for none
+  uint32_t spool_id;    // write-ahead record to close once replied, 0 for none
+  uint32_t queued_ms;
+};
+
+// Live Telegram message that shows an LLM reply while it is still streaming.
+// The first chunk of the final reply replaces it instead of sending anew.
+struct LiveReply {
+  String message_id;
+  unsigned long last_edit_ms;
+  size_t last_len;
+  bool failed;
+};
+
+// Position of a reply streamed to web UI clients as token events.
+struct WebStream {
+  size_t sent_len;
+  unsigned long last_push_ms;
+};
+
+struct AgentWorker {
+  SemaphoreHandle_t ready;  // counts messages queued for this lane
+  uint8_t next_chat;        // round-robin position in s_chats
+  TaskHandle_t task;
+  LiveReply live;
+  WebStream web;
+  bool stream_to_telegram;
+  bool stream_to_web;
+  uint32_t trace_id;  // of the message being processed
+};
+static AgentWorker s_workers[LANE_COUNT];
+
+// Per-chat sub-queues. Every Telegram chat, the web UI and the scheduler get
+// a slot with a small ring per lane, and a lane takes one message per chat in
+// turn, so a chat with a backlog of ReAct jobs delays its own messages, not
+// everybody else's. A chat with work in one lane keeps using it, so its
+// replies stay in order.
+struct ChatSlot {
+  char key[24];                 // Telegram chat id, "web" or "scheduler"; "" when free
+  uint8_t pending[LANE_COUNT];  // queued or running
+  uint8_t head[LANE_COUNT];
+  uint8_t count[LANE_COUNT];    // queued only
+  AgentTaskMsg items[LANE_COUNT][AGENT_CHAT_QUEUE_DEPTH];
 };
-static QueueHandle_t s_agent_queue = NULL;
+static ChatSlot s_chats[AGENT_MAX_CHATS];
+static portMUX_TYPE s_lane_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Slot for key: its own, else a free one, else one with nothing in flight.
+// -1 when every slot is busy. Call under s_lane_mux.
+static int chat_slot_claim(const char *key) {
+  int free_slot = -1;
+  int idle_slot = -1;
+  for (int i = 0; i < AGENT_MAX_CHATS; i++) {
+    ChatSlot &c = s_chats[i];
+    if (strncmp(c.key, key, sizeof(c.key)) == 0) {
+      return i;
+    }
+    if (c.key[0] == '\0') {
+      if (free_slot < 0) {
+        free_slot = i;
+      }
+    } else if (idle_slot < 0 && c.pending[LANE_FAST] == 0 && c.pending[LANE_SLOW] == 0) {
+      idle_slot = i;
+    }
+  }
+  const int slot = free_slot >= 0 ? free_slot : idle_slot;
+  if (slot >= 0) {
+    strncpy(s_chats[slot].key, key, sizeof(s_chats[slot].key) - 1);
+    s_chats[slot].key[sizeof(s_chats[slot].key) - 1] = '\0';
+  }
+  return slot;
+}
+
+// Next message for lane, from the chat after the one served last.
+static bool chat_queue_take(int lane, AgentTaskMsg &item) {
+  AgentWorker &worker = s_workers[lane];
+  bool found = false;
+  portENTER_CRITICAL(&s_lane_mux);
+  for (int n = 0; n < AGENT_MAX_CHATS; n++) {
+    const int c = (worker.next_chat + n) % AGENT_MAX_CHATS;
+    ChatSlot &slot = s_chats[c];
+    if (slot.count[lane] == 0) {
+      continue;
+    }
+    item = slot.items[lane][slot.head[lane]];
+    slot.head[lane] = (slot.head[lane] + 1) % AGENT_CHAT_QUEUE_DEPTH;
+    slot.count[lane]--;
+    worker.next_chat = (c + 1) % AGENT_MAX_CHATS;
+    found = true;
+    break;
+  }
+  portEXIT_CRITICAL(&s_lane_mux);
+  return found;
+}
+
+// Replies to web UI requests, matched by id so concurrent browsers each get
+// their own answer without re-reading the shared history.
+struct WebResult {
+  uint32_t id;  // 0 when free
+  bool done;
+  String reply;
+};
+static WebResult s_web_results[AGENT_WEB_RESULT_SLOTS];
+static uint32_t s_next_request_id = 1;
+static SemaphoreHandle_t s_web_results_lock = nullptr;
+
+// Claim a slot for a new request, evicting the oldest one when all are busy.
+static uint32_t web_result_reserve() {
+  if (s_web_results_lock == nullptr) {
+    return 0;
+  }
+  xSemaphoreTake(s_web_results_lock, portMAX_DELAY);
+  WebResult *slot = nullptr;
+  for (size_t i = 0; i < AGENT_WEB_RESULT_SLOTS; i++) {
+    WebResult &r = s_web_results[i];
+    if (r.id == 0) {
+      slot = &r;
+      break;
+    }
+    // Ids only grow, so the smallest is the oldest; finished ones go first.
+    if (slot == nullptr || (r.done && !slot->done) || (r.done == slot->done && r.id < slot->id)) {
+      slot = &r;
+    }
+  }
+  const uint32_t id = s_next_request_id++;
+  if (s_next_request_id == 0) {
+    s_next_request_id = 1;
+  }
+  slot->id = id;
+  slot->done = false;
+  slot->reply = "";
+  xSemaphoreGive(s_web_results_lock);
+  return id;
+}
+
+static void web_result_store(uint32_t id, const String &reply, bool release) {
+  xSemaphoreTake(s_web_results_lock, portMAX_DELAY);
+  for (size_t i = 0; i < AGENT_WEB_RESULT_SLOTS; i++) {
+    WebResult &r = s_web_results[i];
+    if (r.id == id) {
+      if (release) {
+        r.id = 0;
+        r.reply = "";
+      } else {
+        r.done = true;
+        r.reply = reply;
+      }
+      break;
+    }
+  }
+  xSemaphoreGive(s_web_results_lock);
+}
+
+static AgentWorker &current_worker() {
+  const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  for (int i = 0; i < LANE_COUNT; i++) {
+    if (s_workers[i].task == self) {
+      return s_workers[i];
+    }
+  }
+  return s_workers[LANE_SLOW];
+}
+
+static const char *source_name(AgentSource source) {
+  switch (source) {
+    case SOURCE_TELEGRAM: return "telegram";
+    case SOURCE_WEB: return "web";
+    default: return "scheduler";
+  }
+}
+
+static void live_reply_reset(LiveReply &live) {
+  live.message_id = "";
+  live.last_edit_ms = 0;
+  live.last_len = 0;
+  live.failed = false;
+}
 
 static void send_reply_via_telegram(const String &outgoing);
 static bool send_document_with_retry(const String &filename, const String &content,
@@ -50,6 +272,27 @@ static bool send_document_with_retry(const String &filename, const String &conte
 }
 
 // MinOS Kernel Task
+static const uint32_t kAgentTaskStack = 16384;
+static const uint32_t kMinosTaskStack = 8192;
+static const uint32_t kBootInitStack = 8192;
+static const uint32_t kUpdateCheckStack = 10240;
+
+// Set by the background init task once memory, skills, tasks, cron and the
+// scheduler are up. Workers wait for it (bounded) before their first message
+// so nothing races those subsystems' setup.
+static EventGroupHandle_t s_boot_events = nullptr;
+static const EventBits_t kBootDeferredReady = 1 << 0;
+
+static void wait_for_deferred_init() {
+  if (s_boot_events == nullptr) {
+    return;
+  }
+  if ((xEventGroupGetBits(s_boot_events) & kBootDeferredReady) == 0) {
+    xEventGroupWaitBits(s_boot_events, kBootDeferredReady, pdFALSE, pdTRUE,
+                        pdMS_TO_TICKS(BOOT_DEFERRED_WAIT_MS));
+  }
+}
+
 static void minos_task_code(void *pvParameters) {
   Serial.println("[minos] Task started");
   kernel_init();
@@ -59,43 +302,104 @@ static void minos_task_code(void *pvParameters) {
 }
 
 static void agent_task_code(void *param) {
+  const int lane = (int)(intptr_t)param;
+  AgentWorker &worker = s_workers[lane];
   AgentTaskMsg item;
+  // Reused for every message so its buffer settles at the largest size seen
+  // instead of being reallocated per request.
+  String msg;
+  msg.reserve(AGENT_MSG_SMALL_BYTES);
+  bool boot_waited = false;
   while (true) {
-    if (xQueueReceive(s_agent_queue, &item, portMAX_DELAY)) {
-      if (item.msg_ptr) {
-        String msg = String(item.msg_ptr);
-        free(item.msg_ptr); // Free heap copy
+    if (xSemaphoreTake(worker.ready, portMAX_DELAY) == pdTRUE && chat_queue_take(lane, item)) {
+      if (!boot_waited) {
+        wait_for_deferred_init();
+        boot_waited = true;
+      }
+      // Stable while the message is pending, so no lock is needed to read it
+      char chat_key[sizeof(s_chats[0].key)];
+      memcpy(chat_key, s_chats[item.chat].key, sizeof(chat_key));
+      const uint32_t started_ms = millis();
+      if (item.slot != MSG_HANDLE_NONE) {
+        msg = msg_pool_get(item.slot);
+        msg_pool_release(item.slot);
+        // Replies, media and history of everything below go to this chat
+        chat_scope_bind(item.source == SOURCE_TELEGRAM ? String(chat_key) : String(""));
         
         // Process message (blocking is fine in this task)
+        live_reply_reset(worker.live);
+        worker.web = {0, 0};
+        worker.trace_id = 0;
+        worker.stream_to_telegram = item.from_telegram;
+        worker.stream_to_web = item.source == SOURCE_WEB && web_server_events_active();
         String reply = agent_loop_process_message(msg);
+        worker.stream_to_telegram = false;
+        worker.stream_to_web = false;
         
         if (item.from_telegram && reply.length() > 0) {
+           TraceScope send_span("telegram.send");
+           MetricsStageScope send_stage(METRICS_STAGE_SEND);
            send_reply_via_telegram(reply);
         }
+        live_reply_reset(worker.live);
+
+        if (item.request_id != 0) {
+          web_result_store(item.request_id, reply, false);
+        }
+        if (reply.length() > 0 && web_server_events_active()) {
+          web_server_push_reply(source_name((AgentSource)item.source), reply, item.request_id);
+          web_server_push_trace(worker.trace_id);
+        }
+
+        msg_spool_done(item.spool_id);
+
+        // Fact extraction runs in the background once the reply is out. USER.md
+        // is the owner's profile, so team chats are left out.
+        if (item.source != SOURCE_SCHEDULER && chat_scope_is_owner(chat_scope_current())) {
+          auto_learn_submit(msg);
+        }
+        chat_scope_bind("");
       }
+      metrics_chat_done(chat_key, started_ms - item.queued_ms, millis() - item.queued_ms);
+      portENTER_CRITICAL(&s_lane_mux);
+      s_chats[item.chat].pending[lane]--;
+      portEXIT_CRITICAL(&s_lane_mux);
     }
   }
 }
 
 String agent_loop_get_last_response() {
-  return s_last_llm_response;
+  last_lock();
+  String response = s_last_llm_response;
+  last_unlock();
+  return response;
 }
 
 void agent_loop_set_last_response(const String &response) {
+  last_lock();
   s_last_llm_response = response;
+  last_unlock();
 }
 
 String agent_loop_get_last_file_content() {
-  return s_last_generated_code;
+  last_lock();
+  String content = s_last_generated_code;
+  last_unlock();
+  return content;
 }
 
 String agent_loop_get_last_file_name() {
-  return s_last_generated_filename;
+  last_lock();
+  String name = s_last_generated_filename;
+  last_unlock();
+  return name;
 }
 
 void agent_loop_set_last_file(const String &name, const String &content) {
+  last_lock();
   s_last_generated_filename = name;
   s_last_generated_code = content;
+  last_unlock();
 }
 
 static bool is_internal_dispatch_message(const String &msg) {
@@ -103,7 +407,7 @@ static bool is_internal_dispatch_message(const String &msg) {
   lc.trim();
   lc.toLowerCase();
   return lc == "heartbeat_run" || lc == "reminder_run" || lc == "proactive_check" ||
-         lc == "status";
+         lc == "status" || lc.startsWith("task_remind ");
 }
 
 static bool should_try_route(const String &msg) {
@@ -350,6 +654,70 @@ static int extract_and_send_code_blocks(const String &response) {
   return files_sent;
 }
 
+static void on_stream_text(const String &text, void *ctx) {
+  LiveReply *live = static_cast<LiveReply *>(ctx);
+  if (live->failed || text.length() == live->last_len) {
+    return;
+  }
+  const unsigned long now = millis();
+  if (live->message_id.length() == 0) {
+    if (text.length() < LLM_STREAM_MIN_CHARS) {
+      return;
+    }
+  } else if (now - live->last_edit_ms < LLM_STREAM_EDIT_MS) {
+    return;
+  }
+
+  String preview = text.length() > 3400 ? text.substring(0, 3400) : text;
+  preview += " ...";
+  if (live->message_id.length() == 0) {
+    live->message_id = transport_telegram_send_streaming_start(preview);
+    live->failed = live->message_id.length() == 0;
+  } else {
+    transport_telegram_send_streaming_edit(live->message_id, preview);
+  }
+  live->last_edit_ms = now;
+  live->last_len = text.length();
+}
+
+static void on_web_stream_text(const String &text, void *ctx) {
+  WebStream *web = static_cast<WebStream *>(ctx);
+  const unsigned long now = millis();
+  if (text.length() <= web->sent_len || now - web->last_push_ms < WEB_EVENTS_STREAM_MS) {
+    return;
+  }
+  web_server_push_token(text.substring(web->sent_len));
+  web->sent_len = text.length();
+  web->last_push_ms = now;
+}
+
+// Where a chat reply for the current worker streams to, if anywhere.
+static void reply_stream_sink(llm_stream_cb_t &sink_out, void *&ctx_out) {
+  AgentWorker &worker = current_worker();
+  sink_out = nullptr;
+  ctx_out = nullptr;
+  if (worker.stream_to_telegram) {
+    sink_out = on_stream_text;
+    ctx_out = &worker.live;
+  } else if (worker.stream_to_web) {
+    sink_out = on_web_stream_text;
+    ctx_out = &worker.web;
+  }
+}
+
+// Post a chunk, finalizing the live streamed message first if there is one.
+static void send_chunk(const String &chunk) {
+  LiveReply &live = current_worker().live;
+  if (live.message_id.length() > 0) {
+    const String message_id = live.message_id;
+    live.message_id = "";
+    if (transport_telegram_send_streaming_edit(message_id, chunk)) {
+      return;
+    }
+  }
+  transport_telegram_send(chunk);
+}
+
 // Send message directly (no streaming overhead)
 static void send_streaming(const String &outgoing) {
   if (outgoing.length() == 0) {
@@ -360,7 +728,7 @@ static void send_streaming(const String &outgoing) {
   while (start < (int)outgoing.length()) {
     int end = start + kChunkMax;
     if (end >= (int)outgoing.length()) {
-      transport_telegram_send(outgoing.substring(start));
+      send_chunk(outgoing.substring(start));
       break;
     }
 
@@ -375,7 +743,7 @@ static void send_streaming(const String &outgoing) {
       split = end;
     }
 
-    transport_telegram_send(outgoing.substring(start, split));
+    send_chunk(outgoing.substring(start, split));
     start = split;
     delay(80);
   }
@@ -594,7 +962,7 @@ static bool looks_like_code(const String &text) {
 }
 
 static void send_reply_via_telegram(const String &outgoing) {
-  event_log_append("OUT: " + outgoing);
+  event_log_record(EVT_OUT, outgoing.c_str());
 
   // Check if response contains code blocks
   int code_count = 0;
@@ -645,17 +1013,26 @@ String agent_loop_process_message(const String &msg) {
     return "";
   }
 
+  PowerBusyScope power_busy;
   status_led_set_busy(true);
 
   Serial.print("[agent] processing: ");
   Serial.println(msg);
-  event_log_append("IN: " + msg);
+  event_log_record(EVT_IN, msg.c_str());
+  current_worker().trace_id = trace_begin_message();
+  const uint32_t total_span = trace_span_begin("message");
+  MetricsStageScope message_stage(METRICS_STAGE_MESSAGE);
 
   String response;
   bool handled = false;
 
   // 1. Direct Tool Execution
-  if (tool_registry_execute(msg, response)) {
+  const uint32_t dispatch_span = trace_span_begin("tool_dispatch");
+  const MetricsMark dispatch_mark = metrics_stage_begin();
+  const bool dispatched = tool_registry_execute(msg, response);
+  metrics_stage_end(METRICS_STAGE_TOOL, dispatch_mark);
+  trace_span_end(dispatch_span);
+  if (dispatched) {
     handled = true;
   } 
   else {
@@ -668,19 +1045,44 @@ String agent_loop_process_message(const String &msg) {
       handled = true;
     }
     
-    // 3. Router (if not handled)
+    // 3. Router (if not handled): on-device first, LLM only when ambiguous.
+    // When an unrouted message would go straight to chat, the reply is
+    // started alongside the LLM router and kept unless a command comes back.
+    LlmSpeculativeReply *speculative = nullptr;
     if (!handled && should_try_route(trimmed)) {
+      MetricsStageScope route_stage(METRICS_STAGE_ROUTE);
       String routed_command;
       String route_err;
-      if (llm_route_tool_command(trimmed, routed_command, route_err)) {
-        routed_command.trim();
+      const IntentRouteResult local = intent_route_local(trimmed, routed_command);
+      bool routed = local == INTENT_ROUTE_LOCAL;
+      if (local == INTENT_ROUTE_AMBIGUOUS) {
+        if (!react_agent_should_use(trimmed)) {
+          llm_stream_cb_t sink = nullptr;
+          void *sink_ctx = nullptr;
+          reply_stream_sink(sink, sink_ctx);
+          speculative = llm_speculative_reply_start(trimmed, sink, sink_ctx);
+        }
+        TraceScope route_span("route.llm");
+        routed = llm_route_tool_command(trimmed, routed_command, route_err);
+      }
+      routed_command.trim();
+      // A command means the reply is not needed; stop paying for it now
+      if (speculative != nullptr && routed && routed_command.length() > 0) {
+        llm_speculative_reply_cancel(speculative);
+        speculative = nullptr;
+      }
+      if (routed) {
         if (routed_command.length() > 0) {
           String routed_response;
-          if (tool_registry_execute(routed_command, routed_response)) {
+          const uint32_t tool_span = trace_span_begin("route.tool");
+          const bool tool_ok = tool_registry_execute(routed_command, routed_response);
+          trace_span_end(tool_span);
+          if (tool_ok) {
             if (routed_response.length() > 3400 && !response_contains_code(routed_response)) {
               routed_response = routed_response.substring(0, 3400) + "...";
             }
-            event_log_append("ROUTE: " + routed_command);
+            event_log_printf(EVT_ROUTE, "%s%s", routed_command.c_str(),
+                             local == INTENT_ROUTE_LOCAL ? " (local)" : "");
             response = routed_response;
             handled = true;
           }
@@ -691,9 +1093,14 @@ String agent_loop_process_message(const String &msg) {
     // 4. ReAct Agent (if not handled)
     if (!handled && react_agent_should_use(trimmed)) {
       String react_response, react_error;
-      event_log_append("ReAct: Starting agent loop");
-      if (react_agent_run(trimmed, react_response, react_error)) {
-        s_last_llm_response = react_response;
+      event_log_record(EVT_REACT, "starting agent loop");
+      const uint32_t react_span = trace_span_begin("react");
+      const MetricsMark react_mark = metrics_stage_begin();
+      const bool react_ok = react_agent_run(trimmed, react_response, react_error);
+      metrics_stage_end(METRICS_STAGE_REACT, react_mark);
+      trace_span_end(react_span);
+      if (react_ok) {
+        agent_loop_set_last_response(react_response);
         if (react_response.length() > 3400 && !response_contains_code(react_response)) {
           react_response = react_response.substring(0, 3400) + "...";
         }
@@ -707,17 +1114,31 @@ String agent_loop_process_message(const String &msg) {
     // 5. Direct LLM Chat (if not handled)
     if (!handled) {
       String err;
-      if (llm_generate_reply(trimmed, response, err)) {
+      const uint32_t reply_span = trace_span_begin("llm.reply");
+      const MetricsMark reply_mark = metrics_stage_begin();
+      bool reply_ok;
+      if (speculative != nullptr) {
+        reply_ok = llm_speculative_reply_finish(speculative, response, err);
+        speculative = nullptr;
+      } else {
+        llm_stream_cb_t sink = nullptr;
+        void *sink_ctx = nullptr;
+        reply_stream_sink(sink, sink_ctx);
+        reply_ok = llm_generate_reply_stream(trimmed, sink, sink_ctx, response, err);
+      }
+      metrics_stage_end(METRICS_STAGE_REPLY, reply_mark);
+      trace_span_end(reply_span);
+      if (reply_ok) {
         String hinted_cmd;
         if (extract_embedded_tool_command(response, hinted_cmd)) {
           String hinted_out;
           if (tool_registry_execute(hinted_cmd, hinted_out)) {
-            event_log_append("ROUTE: " + hinted_cmd + " (from model hint)");
+            event_log_printf(EVT_ROUTE, "%s (from model hint)", hinted_cmd.c_str());
             response = hinted_out;
           }
         }
 
-        s_last_llm_response = response;
+        agent_loop_set_last_response(response);
 
         if (response.length() > 3400 && !response_contains_code(response)) {
           response = response.substring(0, 3400) + "...";
@@ -736,47 +1157,92 @@ String agent_loop_process_message(const String &msg) {
   // Record history (Bot only, User recorded at ingress)
   record_bot_msg(response);
 
-  // Auto-learn: extract personal facts every 5th message OR if keywords found
-  static int s_msg_counter = 0;
-  s_msg_counter++;
-  
-  String msg_lc = msg;
-  msg_lc.toLowerCase();
-  bool force_learn = (msg_lc.indexOf("remember") >= 0 || 
-                      msg_lc.indexOf("favorit") >= 0 || 
-                      msg_lc.indexOf("name is") >= 0 ||
-                      msg_lc.indexOf("i am ") >= 0 ||
-                      msg_lc.indexOf("my ") >= 0); // "my car", "my mom", etc.
-
-  if ((s_msg_counter % 5 == 0 || force_learn) && msg.length() > 5) {
-    String existing_user, user_err;
-    file_memory_read_user(existing_user, user_err);
-
-    String facts, facts_err;
-    if (llm_extract_user_facts(msg, existing_user, facts, facts_err)) {
-      if (facts.length() > 0) {
-        String append_err;
-        if (file_memory_append_user(facts, append_err)) {
-          Serial.println("[auto-learn] Learned: " + facts);
-          event_log_append("AUTO_LEARN: " + facts);
-          
-          // Visual confirmation for user
-          response += "\n\n(📝 Learned: " + facts + ")";
-        }
-      }
-    }
-  }
-  
+  trace_span_end(total_span);
   return response;
 }
 
+// tg_chat: chat a Telegram message came from; "" means the caller's own chat.
+static bool queue_message_from(const String &msg, bool from_telegram, AgentSource source,
+                               uint32_t request_id = 0, uint32_t spool_id = 0,
+                               const String &tg_chat = "");
+
 static void on_incoming_message(const String &msg) {
   // Queue for processing (Telegram source = true)
-  agent_loop_queue_message(msg, true);
+  queue_message_from(msg, true, SOURCE_TELEGRAM, 0, 0, transport_telegram_current_chat_id());
+}
+
+static void on_scheduled_message(const String &msg) {
+  // Scheduler output still goes to Telegram, but on its own ordering lane
+  queue_message_from(msg, true, SOURCE_SCHEDULER);
 }
 
 void agent_loop_queue_message(const String &msg, bool from_telegram) {
-  if (msg.length() == 0) return;
+  queue_message_from(msg, from_telegram, from_telegram ? SOURCE_TELEGRAM : SOURCE_WEB);
+}
+
+uint32_t agent_loop_queue_web_message(const String &msg) {
+  if (msg.length() == 0) {
+    return 0;
+  }
+  const uint32_t id = web_result_reserve();
+  if (id == 0) {
+    return 0;
+  }
+  if (!queue_message_from(msg, false, SOURCE_WEB, id)) {
+    web_result_store(id, "", true);
+    return 0;
+  }
+  return id;
+}
+
+AgentResultState agent_loop_take_result(uint32_t request_id, String &reply_out) {
+  if (request_id == 0 || s_web_results_lock == nullptr) {
+    return AGENT_RESULT_UNKNOWN;
+  }
+  AgentResultState state = AGENT_RESULT_UNKNOWN;
+  xSemaphoreTake(s_web_results_lock, portMAX_DELAY);
+  for (size_t i = 0; i < AGENT_WEB_RESULT_SLOTS; i++) {
+    WebResult &r = s_web_results[i];
+    if (r.id != request_id) {
+      continue;
+    }
+    if (r.done) {
+      reply_out = r.reply;
+      r.id = 0;
+      r.reply = "";
+      state = AGENT_RESULT_DONE;
+    } else {
+      state = AGENT_RESULT_PENDING;
+    }
+    break;
+  }
+  xSemaphoreGive(s_web_results_lock);
+  return state;
+}
+
+// Messages recovered from the spool after a reboot. The web request that sent
+// one is gone, so its reply only reaches the history and event stream.
+static bool on_spooled_message(const String &msg, uint8_t source, bool from_telegram,
+                               long long tg_chat, uint32_t spool_id) {
+  if (source >= SOURCE_COUNT) {
+    return false;
+  }
+  Serial.printf("[agent] replaying spooled message #%u\n", (unsigned)spool_id);
+  char chat_id[24] = "";
+  if (tg_chat != 0) {
+    snprintf(chat_id, sizeof(chat_id), "%lld", tg_chat);
+  }
+  return queue_message_from(msg, from_telegram, (AgentSource)source, 0, spool_id, chat_id);
+}
+
+static bool queue_message_from(const String &msg, bool from_telegram, AgentSource source,
+                               uint32_t request_id, uint32_t spool_id, const String &tg_chat) {
+  if (msg.length() == 0) return false;
+
+  String chat_id;
+  if (source == SOURCE_TELEGRAM) {
+    chat_id = tg_chat.length() > 0 ? tg_chat : chat_scope_current();
+  }
   
   // Record User Msg immediately so UI sees it
   // (Telegram polls already call record_user_msg via on_incoming_message? or poll?)
@@ -795,63 +1261,221 @@ void agent_loop_queue_message(const String &msg, bool from_telegram) {
   // But poll (transport_telegram_poll) usually just callbacks. It doesn't record.
   // So WE record here.
 
-  record_user_msg(msg);
+  // A replayed message was recorded on its first delivery. It goes to the
+  // history of the chat it came from, whichever task is queueing it.
+  if (spool_id == 0) {
+    const String caller_chat = chat_scope_current();
+    const String msg_chat = chat_id.length() > 0 ? chat_id : String(TELEGRAM_ALLOWED_CHAT_ID);
+    if (msg_chat != caller_chat) {
+      chat_scope_bind(msg_chat);
+    }
+    record_user_msg(msg);
+    if (msg_chat != caller_chat) {
+      chat_scope_bind(caller_chat);
+    }
+  }
 
-  if (!s_agent_queue) return;
+  if (!s_workers[LANE_SLOW].ready) return false;
+  const String key = chat_id.length() > 0 ? chat_id : String(source_name(source));
+
+  const AgentLane natural =
+      (source == SOURCE_SCHEDULER || tool_registry_is_quick(msg)) ? LANE_FAST : LANE_SLOW;
+  const AgentLane other = natural == LANE_FAST ? LANE_SLOW : LANE_FAST;
+
+  const bool background = source == SOURCE_SCHEDULER && is_internal_dispatch_message(msg);
+
+  portENTER_CRITICAL(&s_lane_mux);
+  const int chat = chat_slot_claim(key.c_str());
+  AgentLane lane = natural;
+  if (chat >= 0) {
+    ChatSlot &slot = s_chats[chat];
+    lane = slot.pending[other] > 0 ? other : natural;
+    // Background checks need no ordering between them. A second one takes the
+    // slow lane while it is idle, so both run at once and their LLM calls can
+    // be batched into one request.
+    if (background && slot.pending[LANE_FAST] > 0) {
+      size_t slow_busy = 0;
+      for (int i = 0; i < AGENT_MAX_CHATS; i++) {
+        slow_busy += s_chats[i].pending[LANE_SLOW];
+      }
+      if (slow_busy == 0) {
+        lane = LANE_SLOW;
+      }
+    }
+    slot.pending[lane]++;
+  }
+  portEXIT_CRITICAL(&s_lane_mux);
+  if (chat < 0) {
+    Serial.println("[agent] every chat slot is busy");
+    return false;
+  }
 
-  char *copy = strdup(msg.c_str());
-  if (copy) {
+  const msg_handle_t slot = msg_pool_put(msg.c_str(), msg.length());
+  bool queued = false;
+  if (slot != MSG_HANDLE_NONE) {
+    // Scheduler messages are regenerated by the scheduler's own catch-up
+    // after a reboot; chat messages would be lost, so they hit flash first.
+    if (spool_id == 0 && source != SOURCE_SCHEDULER) {
+      const long long tg_update =
+          source == SOURCE_TELEGRAM ? transport_telegram_current_update_id() : 0;
+      const long long tg_chat_num = strtoll(chat_id.c_str(), nullptr, 10);
+      spool_id = msg_spool_accept(source, from_telegram, msg.c_str(), msg.length(), tg_update,
+                                  tg_chat_num);
+    }
     AgentTaskMsg item;
-    item.msg_ptr = copy;
+    item.slot = slot;
     item.from_telegram = from_telegram;
-    if (xQueueSend(s_agent_queue, &item, pdMS_TO_TICKS(100)) != pdTRUE) {
-      free(copy);
-      Serial.println("[agent] queue full");
+    item.source = source;
+    item.chat = (uint8_t)chat;
+    item.request_id = request_id;
+    item.spool_id = spool_id;
+    item.queued_ms = millis();
+    portENTER_CRITICAL(&s_lane_mux);
+    ChatSlot &sub = s_chats[chat];
+    if (sub.count[lane] < AGENT_CHAT_QUEUE_DEPTH) {
+      sub.items[lane][(sub.head[lane] + sub.count[lane]) % AGENT_CHAT_QUEUE_DEPTH] = item;
+      sub.count[lane]++;
+      queued = true;
     }
+    portEXIT_CRITICAL(&s_lane_mux);
+    if (queued) {
+      metrics_chat_queued(key.c_str());
+      xSemaphoreGive(s_workers[lane].ready);
+    } else {
+      msg_spool_done(spool_id);
+      msg_pool_release(slot);
+      Serial.printf("[agent] queue full for %s\n", key.c_str());
+    }
+  } else {
+    Serial.println("[agent] message pool full");
+  }
+  if (!queued) {
+    portENTER_CRITICAL(&s_lane_mux);
+    s_chats[chat].pending[lane]--;
+    portEXIT_CRITICAL(&s_lane_mux);
   }
+  return queued;
 }
 
-void agent_loop_init() {
-  s_agent_queue = xQueueCreate(10, sizeof(AgentTaskMsg));
-  xTaskCreate(agent_task_code, "AgentTask", 16384, NULL, 1, NULL); 
-  
-  event_log_init();
-  chat_history_init();
+#ifdef GITHUB_REPO
+static void update_check_task(void *param) {
+  Serial.println("[agent] checking for firmware updates...");
+  tool_registry_check_updates_async();
+  vTaskDelete(NULL);
+}
+
+// Timer callbacks run on the small timer-service stack, so the HTTPS check
+// gets a short-lived task of its own.
+static void on_update_check_timer(TimerHandle_t timer) {
+  xTaskCreatePinnedToCore(update_check_task, "UpdateCheck", kUpdateCheckStack, NULL,
+                          TASK_PRIO_BACKGROUND, NULL, TASK_CORE_NET);
+}
+#endif
+
+// Everything a first reply does not need. Runs on the app core while the
+// main path is still waiting for WiFi on the other.
+static void deferred_init_task(void *param) {
+  const unsigned long start_ms = millis();
+  status_led_init();
   memory_init();
   file_memory_init();  // Initialize SPIFFS-based file memory
-  skill_init();        // Initialize lazy-loading skills
-  model_config_init();
-  persona_init();
+  skill_init();        // Load the skill index
 #if ENABLE_TASKS
   task_store_init();
 #endif
-  tool_registry_init();
-  react_agent_init();  // Initialize ReAct agent with tool registry
+  auto_learn_init();   // Background USER.md fact extraction
+#if ENABLE_EMAIL
+  email_client_init();  // Background email sender and digests
+#endif
   cron_store_init();   // Initialize cron store (loads cron.md)
-  usage_init();
-  status_led_init();
   scheduler_init();
+  scheduler_start(on_scheduled_message);
 
   // Create MinOS Background Task
-  xTaskCreate(minos_task_code, "MinOSTask", 8192, NULL, 1, NULL);
+  TaskHandle_t minos_task = nullptr;
+  xTaskCreatePinnedToCore(minos_task_code, "MinOSTask", kMinosTaskStack, NULL, TASK_PRIO_MINOS,
+                          &minos_task, TASK_CORE_APP);
+  metrics_register_task(minos_task, kMinosTaskStack);
+
+  xEventGroupSetBits(s_boot_events, kBootDeferredReady);
+  Serial.printf("[boot] deferred init took %lu ms, done at %lu ms\n", millis() - start_ms,
+                millis());
+  vTaskDelete(NULL);
+}
 
-  transport_telegram_init();
-  web_server_init();
-  Serial.println("[agent] init complete");
+void agent_loop_init() {
+  // Message path first: queues, workers and what every reply touches
+  msg_pool_init();
+  s_web_results_lock = xSemaphoreCreateMutex();
+  s_last_lock = xSemaphoreCreateMutex();
+  s_boot_events = xEventGroupCreate();
+
+  // Both lanes run on the app core, away from network I/O; the fast lane
+  // preempts a long LLM job whenever a quick command arrives.
+  static const char *const kWorkerNames[LANE_COUNT] = {"AgentFast", "AgentTask"};
+  static const UBaseType_t kWorkerPrios[LANE_COUNT] = {TASK_PRIO_AGENT_FAST, TASK_PRIO_AGENT};
+  for (int i = 0; i < LANE_COUNT; i++) {
+    s_workers[i].ready = xSemaphoreCreateCounting(AGENT_MAX_CHATS * AGENT_CHAT_QUEUE_DEPTH, 0);
+    s_workers[i].next_chat = 0;
+    s_workers[i].stream_to_telegram = false;
+    s_workers[i].stream_to_web = false;
+    xTaskCreatePinnedToCore(agent_task_code, kWorkerNames[i], kAgentTaskStack,
+                            (void *)(intptr_t)i, kWorkerPrios[i], &s_workers[i].task,
+                            TASK_CORE_APP);
+    metrics_register_task(s_workers[i].task, kAgentTaskStack);
+  }
+  
+  context_cache_init();
+  response_cache_init();
+  event_log_init();  // mounts the flash filesystem for everything after it
+  msg_spool_init();  // after the event log, before anything can queue
+  trace_init();
+  chat_history_init();
+  model_config_init();
+  persona_init();
+  usage_init();
+  tool_registry_init();
+  react_agent_init();  // Initialize ReAct agent with tool registry
 
-  // Check for firmware updates after 30 seconds (gives WiFi time to stabilize)
+  // The rest comes up in parallel with the WiFi association below
+  if (xTaskCreatePinnedToCore(deferred_init_task, "BootInit", kBootInitStack, NULL,
+                              TASK_PRIO_AGENT, NULL, TASK_CORE_APP) != pdPASS) {
+    Serial.println("[boot] init task failed, running deferred init inline");
+    deferred_init_task(nullptr);
+  }
+
+  wifi_link_begin();
+  transport_telegram_init();  // Waits for the first association
+  power_init();  // After WiFi is associated
+  web_server_init();
+  // Requeue what the last boot accepted but never answered, and skip those
+  // updates if Telegram delivers them again
+  long long spooled_update = 0;
+  msg_spool_replay(on_spooled_message, spooled_update);
+  transport_telegram_skip_updates_through(spooled_update);
+  // After the web server, so a webhook route exists before Telegram is told about it
+  transport_telegram_start(on_incoming_message);
+  Serial.printf("[boot] message path ready at %lu ms\n", millis());
+
+  // Check for firmware updates once WiFi has had time to settle, without
+  // holding up setup() and the loop
   // Only check if GITHUB_REPO is configured
-  #ifdef GITHUB_REPO
-    delay(30000);
-    Serial.println("[agent] checking for firmware updates...");
-    tool_registry_check_updates_async();
-  #endif
+#ifdef GITHUB_REPO
+  TimerHandle_t update_timer = xTimerCreate("UpdateCheck", pdMS_TO_TICKS(UPDATE_CHECK_DELAY_MS),
+                                            pdFALSE, nullptr, on_update_check_timer);
+  if (update_timer != nullptr) {
+    xTimerStart(update_timer, 0);
+  }
+#endif
 }
 
 void agent_loop_tick() {
   status_led_tick();
   transport_telegram_poll(on_incoming_message);
-  scheduler_tick(on_incoming_message);
+  llm_release_idle_connections();
+  usage_tick();
+  event_log_tick();
+  msg_spool_tick();
   
   // Web/Agent processing is now in AgentTask
 }
@@ -26,4 +26,17 @@ String agent_loop_process_message(const String &msg);
 // Queue a message for async processing (Main Loop)
 void agent_loop_queue_message(const String &msg, bool from_telegram = false);
 
+// Queue a web UI message whose reply is kept under the returned request id
+// (0 when the queue is full) until agent_loop_take_result collects it.
+uint32_t agent_loop_queue_web_message(const String &msg);
+
+enum AgentResultState {
+  AGENT_RESULT_UNKNOWN = 0,  // never issued, already taken, or evicted
+  AGENT_RESULT_PENDING,
+  AGENT_RESULT_DONE,
+};
+
+// On AGENT_RESULT_DONE the reply is moved into reply_out and the slot freed.
+AgentResultState agent_loop_take_result(uint32_t request_id, String &reply_out);
+
 #endif
@@ -0,0 +1,139 @@
+#include "auto_learn.h"
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "brain_config.h"
+#include "event_log.h"
+#include "file_memory.h"
+#include "llm_client.h"
+#include "metrics.h"
+#include "trace.h"
+
+namespace {
+
+const UBaseType_t kQueueLength = 8;
+const uint32_t kTaskStack = 12288;
+const size_t kMaxMessageChars = 600;
+
+QueueHandle_t g_queue = nullptr;
+
+// Phrases that usually come with a personal fact; anything without one is
+// not worth an extraction call.
+const char *const kFactCues[] = {
+    "my ",      "i am ",   "i'm ",    "im ",     "i live",  "i work",    "i like ",
+    "i love ",  "i hate ", "i prefer", "i have ", "name is", "call me ", "remember",
+    "favorit",  "born ",   "i moved", "i study",
+};
+
+bool has_fact_cue(const String &msg) {
+  String lc = " " + msg;
+  lc.toLowerCase();
+  for (size_t i = 0; i < sizeof(kFactCues) / sizeof(kFactCues[0]); i++) {
+    // Only at a word start, so "army " or "swim " do not count. A miss
+    // inside a word ("economy ") can still be followed by a real one.
+    for (int idx = lc.indexOf(kFactCues[i]); idx > 0; idx = lc.indexOf(kFactCues[i], idx + 1)) {
+      if (!isalnum((unsigned char)lc[idx - 1])) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void learn_batch(const String *messages, size_t count) {
+  TraceScope span("auto_learn");
+  MetricsStageScope stage(METRICS_STAGE_LEARN);
+
+  String existing_user, user_err;
+  file_memory_read_user(existing_user, user_err);
+
+  String facts, facts_err;
+  if (!llm_extract_user_facts(messages, count, existing_user, facts, facts_err)) {
+    Serial.println("[auto-learn] Extraction failed: " + facts_err);
+    return;
+  }
+  if (facts.length() == 0) {
+    return;
+  }
+
+  String append_err;
+  if (file_memory_append_user(facts, append_err)) {
+    Serial.println("[auto-learn] Learned: " + facts);
+    event_log_record(EVT_AUTO_LEARN, facts.c_str());
+  } else {
+    Serial.println("[auto-learn] Save failed: " + append_err);
+  }
+}
+
+void auto_learn_task(void *param) {
+  (void)param;
+  String batch[AUTO_LEARN_BATCH_MAX];
+  while (true) {
+    char *item = nullptr;
+    if (xQueueReceive(g_queue, &item, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+
+    // Collect until the conversation goes quiet or the batch is full, so
+    // the extraction call never competes with an active exchange.
+    size_t count = 0;
+    while (item != nullptr) {
+      batch[count++] = String(item);
+      free(item);
+      item = nullptr;
+      if (count >= AUTO_LEARN_BATCH_MAX ||
+          xQueueReceive(g_queue, &item, pdMS_TO_TICKS(AUTO_LEARN_IDLE_MS)) != pdTRUE) {
+        break;
+      }
+    }
+
+    Serial.printf("[auto-learn] Extracting from %u message(s)\n", (unsigned)count);
+    learn_batch(batch, count);
+    for (size_t i = 0; i < count; i++) {
+      batch[i] = "";
+    }
+  }
+}
+
+}  // namespace
+
+void auto_learn_init() {
+  if (g_queue != nullptr) {
+    return;
+  }
+  g_queue = xQueueCreate(kQueueLength, sizeof(char *));
+  if (g_queue == nullptr) {
+    Serial.println("[auto-learn] queue alloc failed");
+    return;
+  }
+  // Below the agent lanes so extraction only uses time the reply path leaves idle.
+  TaskHandle_t task = nullptr;
+  xTaskCreatePinnedToCore(auto_learn_task, "AutoLearn", kTaskStack, NULL, TASK_PRIO_BACKGROUND,
+                          &task, TASK_CORE_APP);
+  metrics_register_task(task, kTaskStack);
+}
+
+void auto_learn_submit(const String &msg) {
+  if (g_queue == nullptr || msg.length() <= 5 || msg.startsWith("/")) {
+    return;
+  }
+  if (!has_fact_cue(msg)) {
+    return;
+  }
+
+  String text = msg;
+  if (text.length() > kMaxMessageChars) {
+    text = text.substring(0, kMaxMessageChars);
+  }
+  char *copy = strdup(text.c_str());
+  if (copy == nullptr) {
+    return;
+  }
+  if (xQueueSend(g_queue, &copy, 0) != pdTRUE) {
+    // Backlog full; losing a learning opportunity beats delaying replies.
+    free(copy);
+  }
+}
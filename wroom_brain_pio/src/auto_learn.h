@@ -0,0 +1,14 @@
+#ifndef AUTO_LEARN_H
+#define AUTO_LEARN_H
+
+#include <Arduino.h>
+
+// Background extraction of personal facts into USER.md. Messages are queued
+// after the reply has been sent and handled by a low-priority task that
+// batches several of them into one llm_extract_user_facts call.
+void auto_learn_init();
+
+// Queue a user message; messages with no first-person cue are dropped here.
+void auto_learn_submit(const String &msg);
+
+#endif
@@ -0,0 +1,183 @@
+#include "b64.h"
+
+namespace {
+
+const uint8_t kSkip = 0x40;
+
+DRAM_ATTR const char kEncode[65] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Sextet value per input byte; kSkip for everything outside the alphabet.
+#define S kSkip
+DRAM_ATTR const uint8_t kDecode[256] = {
+    S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,
+    S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,
+    S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  62, S,  S,  S,  63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, S,  S,  S,  S,  S,  S,
+    S,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, S,  S,  S,  S,  S,
+    S,  26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, S,  S,  S,  S,  S,
+    S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,
+    S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,
+    S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,
+    S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,
+    S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,
+    S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,
+    S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,
+    S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,  S,
+};
+#undef S
+
+inline void encode_word(uint32_t w, char *out) {
+  out[0] = kEncode[(w >> 18) & 0x3F];
+  out[1] = kEncode[(w >> 12) & 0x3F];
+  out[2] = kEncode[(w >> 6) & 0x3F];
+  out[3] = kEncode[w & 0x3F];
+}
+
+// Encode whole 3-byte groups only; returns chars written.
+size_t encode_groups(const uint8_t *data, size_t groups, char *out) {
+  for (size_t g = 0; g < groups; g++) {
+    encode_word(((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2], out);
+    data += 3;
+    out += 4;
+  }
+  return groups * 4;
+}
+
+// One or two trailing bytes with padding.
+size_t encode_tail(const uint8_t *data, size_t len, char *out) {
+  if (len == 0) {
+    return 0;
+  }
+  const uint32_t w = ((uint32_t)data[0] << 16) | (len > 1 ? (uint32_t)data[1] << 8 : 0);
+  encode_word(w, out);
+  out[3] = '=';
+  if (len == 1) {
+    out[2] = '=';
+  }
+  return 4;
+}
+
+}  // namespace
+
+size_t b64_decoded_length(const char *text, size_t len) {
+  size_t valid = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (!(kDecode[(uint8_t)text[i]] & kSkip)) {
+      valid++;
+    }
+  }
+  const size_t tail = valid % 4;
+  return (valid / 4) * 3 + (tail >= 2 ? tail - 1 : 0);
+}
+
+size_t b64_encode(const uint8_t *data, size_t len, char *out) {
+  const size_t groups = len / 3;
+  const size_t n = encode_groups(data, groups, out);
+  return n + encode_tail(data + groups * 3, len - groups * 3, out + n);
+}
+
+size_t b64_decode(const char *text, size_t len, uint8_t *out) {
+  B64Decoder decoder;
+  size_t consumed = 0;
+  const size_t n = decoder.update(text, len, out, SIZE_MAX, &consumed);
+  return n + decoder.finish(out + n);
+}
+
+size_t B64Encoder::update(const uint8_t *data, size_t len, char *out) {
+  size_t o = 0;
+  if (carry_len_ > 0) {
+    uint8_t group[3];
+    memcpy(group, carry_, carry_len_);
+    size_t have = carry_len_;
+    while (have < 3 && len > 0) {
+      group[have++] = *data++;
+      len--;
+    }
+    if (have < 3) {
+      memcpy(carry_, group, have);
+      carry_len_ = have;
+      return 0;
+    }
+    o += encode_groups(group, 1, out);
+    carry_len_ = 0;
+  }
+
+  const size_t groups = len / 3;
+  o += encode_groups(data, groups, out + o);
+  carry_len_ = len - groups * 3;
+  memcpy(carry_, data + groups * 3, carry_len_);
+  return o;
+}
+
+size_t B64Encoder::finish(char *out) {
+  const size_t n = encode_tail(carry_, carry_len_, out);
+  carry_len_ = 0;
+  return n;
+}
+
+size_t B64Decoder::update(const char *text, size_t len, uint8_t *out, size_t out_cap,
+                          size_t *consumed) {
+  size_t i = 0;
+  size_t o = 0;
+  while (i < len) {
+    if (count_ == 0) {
+      // Fast path: four alphabet characters make one 24-bit word.
+      while (i + 4 <= len && out_cap - o >= 3) {
+        const uint8_t a = kDecode[(uint8_t)text[i]];
+        const uint8_t b = kDecode[(uint8_t)text[i + 1]];
+        const uint8_t c = kDecode[(uint8_t)text[i + 2]];
+        const uint8_t d = kDecode[(uint8_t)text[i + 3]];
+        if ((a | b | c | d) & kSkip) {
+          break;
+        }
+        const uint32_t w = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6) | d;
+        out[o] = (uint8_t)(w >> 16);
+        out[o + 1] = (uint8_t)(w >> 8);
+        out[o + 2] = (uint8_t)w;
+        o += 3;
+        i += 4;
+      }
+      if (i >= len) {
+        break;
+      }
+    }
+
+    // Slow path around line breaks, padding and chunk edges.
+    const uint8_t v = kDecode[(uint8_t)text[i]];
+    if (v & kSkip) {
+      i++;
+      continue;
+    }
+    if (count_ == 3 && out_cap - o < 3) {
+      break;
+    }
+    acc_ = (acc_ << 6) | v;
+    i++;
+    if (++count_ == 4) {
+      out[o] = (uint8_t)(acc_ >> 16);
+      out[o + 1] = (uint8_t)(acc_ >> 8);
+      out[o + 2] = (uint8_t)acc_;
+      o += 3;
+      reset();
+    }
+  }
+  *consumed = i;
+  return o;
+}
+
+size_t B64Decoder::finish(uint8_t *out) {
+  size_t n = 0;
+  if (count_ == 2) {
+    out[0] = (uint8_t)(acc_ >> 4);
+    n = 1;
+  } else if (count_ == 3) {
+    out[0] = (uint8_t)(acc_ >> 10);
+    out[1] = (uint8_t)(acc_ >> 2);
+    n = 2;
+  }
+  reset();
+  return n;
+}
@@ -0,0 +1,54 @@
+#ifndef B64_H
+#define B64_H
+
+#include <Arduino.h>
+
+// Shared base64 codec (standard alphabet, '=' padding). Each 3-byte group is
+// handled as one 24-bit word, and the lookup tables live in DRAM so they do
+// not depend on the flash cache. Decoding skips whitespace, padding and any
+// other character outside the alphabet.
+
+inline size_t b64_encoded_length(size_t len) { return (len + 2) / 3 * 4; }
+
+// Exact number of bytes b64_decode() produces for text.
+size_t b64_decoded_length(const char *text, size_t len);
+
+// Writes b64_encoded_length(len) chars (no terminator); returns that count.
+size_t b64_encode(const uint8_t *data, size_t len, char *out);
+
+// Returns bytes written. out may equal text: output never overtakes input.
+size_t b64_decode(const char *text, size_t len, uint8_t *out);
+
+// Incremental encoder for data that arrives in pieces. Up to two bytes are
+// held back between calls so padding only appears after finish().
+class B64Encoder {
+ public:
+  // out needs room for b64_encoded_length(len + 2) chars.
+  size_t update(const uint8_t *data, size_t len, char *out);
+  // Flush the held-back bytes; out needs room for 4 chars.
+  size_t finish(char *out);
+
+ private:
+  uint8_t carry_[2];
+  size_t carry_len_ = 0;
+};
+
+// Incremental decoder for text that is read in pieces.
+class B64Decoder {
+ public:
+  // Decode from text until it runs out or another group would not fit in
+  // out_cap bytes. Returns bytes written; *consumed gets the chars used.
+  size_t update(const char *text, size_t len, uint8_t *out, size_t out_cap, size_t *consumed);
+  // Bytes of a trailing partial group (0-2); out needs room for 2.
+  size_t finish(uint8_t *out);
+  void reset() {
+    acc_ = 0;
+    count_ = 0;
+  }
+
+ private:
+  uint32_t acc_ = 0;
+  size_t count_ = 0;
+};
+
+#endif
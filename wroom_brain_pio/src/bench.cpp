@@ -0,0 +1,457 @@
+#include "bench.h"
+
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#include "b64.h"
+#include "brain_config.h"
+#include "chat_history.h"
+#include "context_cache.h"
+#include "cron_parser.h"
+#include "flash_fs.h"
+#include "llm_client.h"
+#include "model_config.h"
+#include "skill_registry.h"
+#include "tool_registry.h"
+#include "wifi_link.h"
+
+namespace {
+
+// Trimmed provider replies as they come off the wire, with the escapes and
+// nesting the extractor has to walk past.
+const char kOpenAiReply[] =
+    "{\"id\":\"chatcmpl-9x\",\"object\":\"chat.completion\",\"created\":1718000000,"
+    "\"model\":\"gpt-4o-mini\",\"choices\":[{\"index\":0,\"message\":{\"role\":\"assistant\","
+    "\"content\":\"Sure! Here is a quick plan for tomorrow:\\n1. Gym at 07:00\\n2. Standup at "
+    "09:30\\n3. Groceries after work \\u2014 milk, eggs, \\\"good\\\" coffee.\\nWant me to set "
+    "reminders?\",\"refusal\":null},\"logprobs\":null,\"finish_reason\":\"stop\"}],"
+    "\"usage\":{\"prompt_tokens\":1874,\"completion_tokens\":52,\"total_tokens\":1926}}";
+
+const char kAnthropicReply[] =
+    "{\"id\":\"msg_01X\",\"type\":\"message\",\"role\":\"assistant\",\"model\":\"claude-3-5-haiku\","
+    "\"content\":[{\"type\":\"text\",\"text\":\"Done \\u2705 I added the task and set a "
+    "reminder for 18:30.\\n\\nACTION: task_add Buy groceries @ 18:30\"}],"
+    "\"stop_reason\":\"end_turn\",\"stop_sequence\":null,"
+    "\"usage\":{\"input_tokens\":2011,\"cache_read_input_tokens\":1536,\"output_tokens\":31}}";
+
+const char kGeminiReply[] =
+    "{\"candidates\":[{\"content\":{\"parts\":[{\"text\":\"```cpp\\n#include <Arduino.h>\\n\\n"
+    "void setup() {\\n  Serial.begin(115200);\\n  pinMode(2, OUTPUT);\\n}\\n\\nvoid loop() {\\n"
+    "  digitalWrite(2, !digitalRead(2));\\n  Serial.printf(\\\"tick %lu\\\\n\\\", millis());\\n"
+    "  delay(500);\\n}\\n```\\nThis blinks the on-board LED every 500 ms.\"}],\"role\":\"model\"},"
+    "\"finishReason\":\"STOP\",\"index\":0}],\"usageMetadata\":{\"promptTokenCount\":1650,"
+    "\"candidatesTokenCount\":96,\"totalTokenCount\":1746}}";
+
+// A plain chat message (falls through every command check) and read-only
+// commands that go through the command table.
+const char *const kDispatchInputs[] = {
+    "how was your day, anything interesting happen?",
+    "time_show",
+    "task_list",
+    "cron_list",
+};
+
+const char *const kCronLines[] = {
+    "0 9 * * * | reminder_run",
+    "*/15 8-18 * * 1-5 | proactive_check",
+    "30 7 1,15 * * | heartbeat_run",
+    "0 0 29 2 * | status",
+};
+
+// What people actually send: commands, small talk and questions that fall
+// through to the LLM. Nothing here changes state.
+const char *const kToolCorpus[] = {
+    "help",
+    "status",
+    "time_show",
+    "task_list",
+    "cron_list",
+    "memory",
+    "skill_list",
+    "hello!",
+    "thanks, that helped a lot",
+    "can you explain how a transistor works?",
+};
+
+const char *const kSkillQueries[] = {
+    "help me write a polite email to my landlord",
+    "why does my arduino sketch keep crashing",
+    "plan a weekend trip to the mountains",
+    "summarize this article for me",
+};
+
+const char *const kTlsProviders[] = {"openai", "anthropic", "gemini", "glm", "openrouter"};
+
+const char *kFsBenchPath = "/bench.tmp";
+const size_t kFsChunk = 512;
+const size_t kB64Bytes = 3072;
+
+struct JsonCase {
+  const char *body;
+  size_t len;
+};
+
+struct TlsCase {
+  String host;
+  uint16_t port;
+  uint32_t failures;
+};
+
+struct B64Case {
+  uint8_t *data;
+  char *text;
+  uint8_t *decoded;
+};
+
+uint32_t elapsed_us(int64_t start) {
+  return (uint32_t)(esp_timer_get_time() - start);
+}
+
+void heap_snapshot(size_t &free_out, size_t &blocks_out) {
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+  free_out = info.total_free_bytes;
+  blocks_out = info.allocated_blocks;
+}
+
+void bench_dispatch(void *ctx) {
+  String out;
+  tool_registry_execute(String(*(const char *const *)ctx), out);
+}
+
+void bench_prompt_build(void *ctx) {
+  String system_prompt;
+  String task;
+  llm_build_reply_prompt(String((const char *)ctx), system_prompt, task);
+}
+
+void bench_cron_eval(void *ctx) {
+  const time_t now = *(const time_t *)ctx;
+  for (size_t i = 0; i < sizeof(kCronLines) / sizeof(kCronLines[0]); i++) {
+    CronJob job;
+    String err;
+    if (cron_parse_line(String(kCronLines[i]), job, err)) {
+      CronSchedule schedule;
+      cron_compile(job, schedule);
+      cron_next_fire(schedule, now);
+    }
+  }
+}
+
+void bench_history_get(void *ctx) {
+  (void)ctx;
+  String history;
+  String err;
+  chat_history_get(history, err);
+}
+
+void bench_json_extract(void *ctx) {
+  const JsonCase *c = (const JsonCase *)ctx;
+  String text;
+  llm_extract_reply_text(c->body, c->len, text);
+}
+
+void bench_skill_match(void *ctx) {
+  (void)ctx;
+  for (size_t i = 0; i < sizeof(kSkillQueries) / sizeof(kSkillQueries[0]); i++) {
+    skill_match(String(kSkillQueries[i]));
+  }
+}
+
+void bench_history_append(void *ctx) {
+  String err;
+  chat_history_append('U', String((const char *)ctx), err);
+}
+
+// Drop the cached copy so the read walks the NVS ring like the first
+// prompt after an append does.
+void bench_history_get_cold(void *ctx) {
+  (void)ctx;
+  context_cache_invalidate(CTX_HISTORY);
+  String history;
+  String err;
+  chat_history_get(history, err);
+}
+
+void bench_fs_write(void *ctx) {
+  const uint8_t *chunk = (const uint8_t *)ctx;
+  File f = FLASH_FS.open(kFsBenchPath, FILE_WRITE);
+  if (!f) {
+    return;
+  }
+  for (size_t done = 0; done < BENCH_FS_BYTES; done += kFsChunk) {
+    f.write(chunk, kFsChunk);
+  }
+  f.close();
+}
+
+void bench_fs_read(void *ctx) {
+  uint8_t *chunk = (uint8_t *)ctx;
+  File f = FLASH_FS.open(kFsBenchPath, FILE_READ);
+  if (!f) {
+    return;
+  }
+  while (f.read(chunk, kFsChunk) > 0) {
+  }
+  f.close();
+}
+
+// DNS is cached after the warm-up call, so this is TCP connect + handshake.
+void bench_tls_connect(void *ctx) {
+  TlsCase *c = (TlsCase *)ctx;
+  WiFiClientSecure client;
+  client.setInsecure();
+  if (!client.connect(c->host.c_str(), c->port)) {
+    c->failures++;
+  }
+  client.stop();
+}
+
+void bench_b64_encode(void *ctx) {
+  B64Case *c = (B64Case *)ctx;
+  b64_encode(c->data, kB64Bytes, c->text);
+}
+
+void bench_b64_decode(void *ctx) {
+  B64Case *c = (B64Case *)ctx;
+  b64_decode(c->text, b64_encoded_length(kB64Bytes), c->decoded);
+}
+
+void run_tools(String &out) {
+  for (size_t i = 0; i < sizeof(kToolCorpus) / sizeof(kToolCorpus[0]); i++) {
+    bench_format(bench_run(kToolCorpus[i], bench_dispatch, (void *)&kToolCorpus[i],
+                           BENCH_ITERATIONS),
+                 out);
+  }
+}
+
+void run_skills(String &out) {
+  bench_format(bench_run("skill_match_x4", bench_skill_match, nullptr, BENCH_ITERATIONS), out);
+}
+
+// Appends real turns, so the ring is saved first and put back afterwards.
+void run_history(String &out) {
+  String *saved = new String[CHAT_HISTORY_SLOTS];
+  const int saved_count = chat_history_export(saved, CHAT_HISTORY_SLOTS);
+
+  bench_format(bench_run("history_append", bench_history_append,
+                         (void *)"bench: a typical short user message about the weather",
+                         BENCH_ITERATIONS),
+               out);
+  bench_format(bench_run("history_get_cold", bench_history_get_cold, nullptr, BENCH_ITERATIONS),
+               out);
+
+  String err;
+  if (chat_history_import(saved, saved_count, err)) {
+    out += "history restored (" + String(saved_count) + " entries)\n";
+  } else {
+    out += "WARN: history restore failed: " + err + "\n";
+  }
+  delete[] saved;
+}
+
+void run_fs(String &out) {
+  uint8_t *chunk = (uint8_t *)malloc(kFsChunk);
+  if (chunk == nullptr) {
+    out += "ERR: fs bench buffer alloc failed\n";
+    return;
+  }
+  for (size_t i = 0; i < kFsChunk; i++) {
+    chunk[i] = (uint8_t)random(256);
+  }
+  const uint32_t n = BENCH_ITERATIONS < 5 ? BENCH_ITERATIONS : 5;
+  bench_format(bench_run("fs_write", bench_fs_write, chunk, n, BENCH_FS_BYTES), out);
+  bench_format(bench_run("fs_read", bench_fs_read, chunk, n, BENCH_FS_BYTES), out);
+  FLASH_FS.remove(kFsBenchPath);
+  free(chunk);
+  out += String(FLASH_FS_NAME) + " " + String((unsigned)(FLASH_FS.usedBytes() / 1024)) + "/" +
+         String((unsigned)(FLASH_FS.totalBytes() / 1024)) + " KB used\n";
+}
+
+void run_tls(String &out) {
+  if (!wifi_link_ready()) {
+    out += "ERR: WiFi not connected\n";
+    return;
+  }
+  size_t ran = 0;
+  for (size_t i = 0; i < sizeof(kTlsProviders) / sizeof(kTlsProviders[0]); i++) {
+    const char *provider = kTlsProviders[i];
+    if (!model_config_is_provider_configured(provider)) {
+      continue;
+    }
+    const String base = model_config_get_base_url(provider);
+    if (!base.startsWith("https://")) {
+      continue;
+    }
+    TlsCase c;
+    c.host = base.substring(8);
+    const int slash = c.host.indexOf('/');
+    if (slash >= 0) {
+      c.host = c.host.substring(0, slash);
+    }
+    c.port = 443;
+    const int colon = c.host.indexOf(':');
+    if (colon > 0) {
+      c.port = (uint16_t)c.host.substring(colon + 1).toInt();
+      c.host = c.host.substring(0, colon);
+    }
+    c.failures = 0;
+    bench_format(bench_run(provider, bench_tls_connect, &c, BENCH_TLS_ITERATIONS), out);
+    if (c.failures > 0) {
+      out += "  " + c.host + ": " + String(c.failures) + " connect(s) failed\n";
+    }
+    ran++;
+  }
+  if (ran == 0) {
+    out += "No configured HTTPS providers\n";
+  }
+}
+
+void run_b64(String &out) {
+  B64Case c;
+  c.data = (uint8_t *)malloc(kB64Bytes);
+  c.text = (char *)malloc(b64_encoded_length(kB64Bytes));
+  c.decoded = (uint8_t *)malloc(kB64Bytes);
+  if (c.data != nullptr && c.text != nullptr && c.decoded != nullptr) {
+    for (size_t i = 0; i < kB64Bytes; i++) {
+      c.data[i] = (uint8_t)random(256);
+    }
+    bench_format(bench_run("b64_encode_3k", bench_b64_encode, &c, BENCH_ITERATIONS, kB64Bytes), out);
+    bench_format(bench_run("b64_decode_3k", bench_b64_decode, &c, BENCH_ITERATIONS, kB64Bytes), out);
+    if (memcmp(c.data, c.decoded, kB64Bytes) != 0) {
+      out += "WARN: b64 round trip mismatch\n";
+    }
+  } else {
+    out += "ERR: b64 bench buffer alloc failed\n";
+  }
+  free(c.data);
+  free(c.text);
+  free(c.decoded);
+}
+
+void run_pipeline(String &out) {
+  const uint32_t n = BENCH_ITERATIONS;
+
+  const char *const *inputs = kDispatchInputs;
+  bench_format(bench_run("dispatch_chat", bench_dispatch, (void *)&inputs[0], n), out);
+  bench_format(bench_run("dispatch_time", bench_dispatch, (void *)&inputs[1], n), out);
+  bench_format(bench_run("dispatch_tasks", bench_dispatch, (void *)&inputs[2], n), out);
+  bench_format(bench_run("dispatch_cron", bench_dispatch, (void *)&inputs[3], n), out);
+
+  bench_format(bench_run("prompt_build", bench_prompt_build,
+                         (void *)"what's on my schedule for tomorrow?", n),
+               out);
+
+  time_t now = time(nullptr);
+  bench_format(bench_run("cron_eval_x4", bench_cron_eval, &now, n), out);
+
+  bench_format(bench_run("history_get", bench_history_get, nullptr, n), out);
+
+  JsonCase openai = {kOpenAiReply, sizeof(kOpenAiReply) - 1};
+  JsonCase anthropic = {kAnthropicReply, sizeof(kAnthropicReply) - 1};
+  JsonCase gemini = {kGeminiReply, sizeof(kGeminiReply) - 1};
+  bench_format(bench_run("json_openai", bench_json_extract, &openai, n), out);
+  bench_format(bench_run("json_anthropic", bench_json_extract, &anthropic, n), out);
+  bench_format(bench_run("json_gemini", bench_json_extract, &gemini, n), out);
+}
+
+}  // namespace
+
+BenchResult bench_run(const char *name, bench_fn_t fn, void *ctx, uint32_t iterations,
+                      uint32_t bytes) {
+  BenchResult r = {};
+  r.name = name;
+  r.bytes = bytes;
+  r.min_us = UINT32_MAX;
+  r.largest_block = UINT32_MAX;
+  if (iterations == 0) {
+    iterations = 1;
+  }
+
+  // Warm-up fills caches and lazy statics so they don't count as leaks
+  fn(ctx);
+
+  size_t free_before = 0;
+  size_t blocks_before = 0;
+  heap_snapshot(free_before, blocks_before);
+  // The boot-time low-water mark only moves if the run sets a new low, in
+  // which case it is exact; otherwise the lowest sample between calls is
+  // the best available figure.
+  const size_t boot_low_before = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  size_t sampled_low = free_before;
+  for (uint32_t i = 0; i < iterations; i++) {
+    const uint32_t cycles_start = ESP.getCycleCount();
+    const int64_t start = esp_timer_get_time();
+    fn(ctx);
+    const uint32_t us = elapsed_us(start);
+    r.total_cycles += (uint32_t)(ESP.getCycleCount() - cycles_start);
+    r.total_us += us;
+    r.min_us = min(r.min_us, us);
+    r.max_us = max(r.max_us, us);
+    sampled_low = min(sampled_low, heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    r.largest_block =
+        min(r.largest_block, (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+  }
+  size_t free_after = 0;
+  size_t blocks_after = 0;
+  heap_snapshot(free_after, blocks_after);
+  const size_t boot_low_after = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+
+  r.iterations = iterations;
+  r.heap_delta = (int32_t)free_before - (int32_t)free_after;
+  r.block_delta = (int32_t)blocks_after - (int32_t)blocks_before;
+  r.heap_low = (uint32_t)(boot_low_after < boot_low_before ? boot_low_after : sampled_low);
+  return r;
+}
+
+void bench_format(const BenchResult &r, String &out) {
+  char line[160];
+  int len = snprintf(line, sizeof(line),
+                     "%-16.16s %3ux %7uus %9ucyc min %u max %u heap %+d blk %+d low %u big %u",
+                     r.name, (unsigned)r.iterations, (unsigned)(r.total_us / r.iterations),
+                     (unsigned)(r.total_cycles / r.iterations), (unsigned)r.min_us,
+                     (unsigned)r.max_us, (int)r.heap_delta, (int)r.block_delta,
+                     (unsigned)r.heap_low, (unsigned)r.largest_block);
+  if (r.bytes > 0 && r.total_us > 0 && len > 0 && len < (int)sizeof(line)) {
+    const uint64_t kbps = (uint64_t)r.bytes * r.iterations * 1000000ULL / r.total_us / 1024;
+    snprintf(line + len, sizeof(line) - len, " %u KB/s", (unsigned)kbps);
+  }
+  out += line;
+  out += "\n";
+}
+
+bool bench_run_suite(const String &suite, String &out) {
+  struct Suite {
+    const char *name;
+    void (*run)(String &out);
+  };
+  // tls needs the network and takes seconds per provider, so "all" skips it
+  static const Suite kSuites[] = {
+      {"pipeline", run_pipeline}, {"tools", run_tools}, {"skills", run_skills},
+      {"history", run_history},   {"fs", run_fs},       {"b64", run_b64},
+      {"tls", run_tls},
+  };
+  const size_t count = sizeof(kSuites) / sizeof(kSuites[0]);
+  const String name = suite.length() > 0 ? suite : String("pipeline");
+  const bool all = name == "all";
+  bool found = false;
+  for (size_t i = 0; i < count; i++) {
+    if (all ? strcmp(kSuites[i].name, "tls") == 0 : name != kSuites[i].name) {
+      continue;
+    }
+    out += "Bench " + String(kSuites[i].name) + ":\n";
+    kSuites[i].run(out);
+    found = true;
+  }
+  if (found) {
+    out += "(cpu " + String(ESP.getCpuFreqMHz()) + " MHz, free heap " + String(ESP.getFreeHeap()) +
+           ", boot low " + String(ESP.getMinFreeHeap()) + ")";
+  }
+  return found;
+}
+
+const char *bench_suite_names() {
+  return "pipeline|tools|skills|history|fs|b64|tls|all";
+}
@@ -0,0 +1,41 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Arduino.h>
+
+// Timed microbenchmarks for the agent's hot paths, run on the device by the
+// bench command and the MinOS shell. Each case reports time and CPU cycles per
+// call plus what it did to the heap, so builds can be compared in numbers on
+// the boards they ship to.
+
+struct BenchResult {
+  const char *name;
+  uint32_t iterations;
+  uint32_t total_us;
+  uint32_t min_us;
+  uint32_t max_us;
+  uint64_t total_cycles;
+  uint32_t bytes;          // per call, for throughput; 0 when not meaningful
+  int32_t heap_delta;      // free heap lost across the timed calls
+  int32_t block_delta;     // extra allocated blocks left behind
+  uint32_t heap_low;       // lowest free heap seen during the run
+  uint32_t largest_block;  // smallest largest-free-block seen after a call
+};
+
+typedef void (*bench_fn_t)(void *ctx);
+
+// One untimed warm-up call, then `iterations` timed calls of fn(ctx).
+BenchResult bench_run(const char *name, bench_fn_t fn, void *ctx, uint32_t iterations,
+                      uint32_t bytes = 0);
+
+// Append one report line for r.
+void bench_format(const BenchResult &r, String &out);
+
+// Run a named suite ("" for the default) and append its report. Returns
+// false for an unknown suite.
+bool bench_run_suite(const String &suite, String &out);
+
+// Space-separated suite names, for usage text.
+const char *bench_suite_names();
+
+#endif
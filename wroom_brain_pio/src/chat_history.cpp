@@ -1,19 +1,82 @@
 #include "chat_history.h"
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include <Preferences.h>
+#include <freertos/semphr.h>
+
+#include "chat_scope.h"
+#include "context_cache.h"
+#include "file_memory.h"
 
 namespace {
 
 Preferences g_prefs;
 bool g_ready = false;
 
+// History is a ring of kMaxEntries fixed slots ("e0".."e29", each "R|text")
+// plus one meta key holding head and count, so an append rewrites one slot and
+// the meta word instead of the whole history blob.
 const char *kNamespace = "brainchat";
-const char *kKeyLines = "lines";
-const int kMaxEntries = 30;     // 30 role-lines ~= 15 user/assistant turns.
+const char *kKeyLines = "lines";  // legacy single-blob layout, migrated on init
+const char *kKeyRing = "ring";
+const int kMaxEntries = CHAT_HISTORY_SLOTS;
 const int kMaxLineChars = 250;  // Longer messages allowed.
-const int kMaxStoreChars = 5000;
-const int kMaxOutChars = 2000;
+const int kMaxOutChars = 2000;  // read bound; prompts trim further by token budget
+
+uint8_t g_head = 0;   // slot of the oldest entry
+uint8_t g_count = 0;  // live entries
+
+// Appends come from the Telegram poll task, the web server and both agent
+// lanes. Every public call holds this for the ring, NVS and session files.
+SemaphoreHandle_t g_lock = nullptr;
+
+class HistoryLock {
+ public:
+  HistoryLock() {
+    if (g_lock != nullptr) {
+      xSemaphoreTake(g_lock, portMAX_DELAY);
+    }
+  }
+  ~HistoryLock() {
+    if (g_lock != nullptr) {
+      xSemaphoreGive(g_lock);
+    }
+  }
+};
+
+void slot_key(int slot, char *key) {
+  snprintf(key, 6, "e%d", slot);
+}
+
+void load_ring() {
+  const uint16_t ring = g_prefs.getUShort(kKeyRing, 0);
+  g_head = (uint8_t)(ring & 0xFF);
+  g_count = (uint8_t)(ring >> 8);
+  if (g_head >= kMaxEntries || g_count > kMaxEntries) {
+    g_head = 0;
+    g_count = 0;
+  }
+}
+
+bool save_ring() {
+  return g_prefs.putUShort(kKeyRing, (uint16_t)(g_head | (g_count << 8))) > 0;
+}
+
+bool push_entry(const String &entry) {
+  char key[6];
+  int slot;
+  if (g_count < kMaxEntries) {
+    slot = (g_head + g_count) % kMaxEntries;
+    g_count++;
+  } else {
+    slot = g_head;  // overwrite the oldest
+    g_head = (g_head + 1) % kMaxEntries;
+  }
+  slot_key(slot, key);
+  const bool ok = g_prefs.putString(key, entry) > 0;
+  return save_ring() && ok;
+}
 
 bool ensure_ready(String &error_out) {
   if (g_ready) {
@@ -23,6 +86,7 @@ bool ensure_ready(String &error_out) {
     error_out = "NVS begin failed";
     return false;
   }
+  load_ring();
   g_ready = true;
   return true;
 }
@@ -48,38 +112,108 @@ String compact_spaces(const String &value) {
   return out;
 }
 
-int count_lines(const String &text) {
-  int lines = 0;
-  for (size_t i = 0; i < text.length(); i++) {
-    if (text[i] == '\n') {
-      lines++;
-    }
+String sanitize_text(const String &input) {
+  String v = compact_spaces(input);
+  if (v.length() > kMaxLineChars) {
+    v = v.substring(0, kMaxLineChars);
   }
-  return lines;
+  return v;
 }
 
-void drop_first_line(String &text) {
-  int nl = text.indexOf('\n');
-  if (nl < 0) {
-    text = "";
+// One-time move of the old newline-separated blob into ring slots.
+void migrate_legacy_blob() {
+  if (!g_prefs.isKey(kKeyLines)) {
     return;
   }
-  text = text.substring(nl + 1);
+  String lines = g_prefs.getString(kKeyLines, "");
+  int start = 0;
+  while (start < (int)lines.length()) {
+    int end = lines.indexOf('\n', start);
+    if (end < 0) {
+      end = lines.length();
+    }
+    if (end - start > 2 && lines[start + 1] == '|') {
+      push_entry(lines.substring(start, end));
+    }
+    start = end + 1;
+  }
+  g_prefs.remove(kKeyLines);
+  Serial.printf("[chat] migrated %d history line(s) to ring slots\n", g_count);
 }
 
-String sanitize_text(const String &input) {
-  String v = compact_spaces(input);
-  if (v.length() > kMaxLineChars) {
-    v = v.substring(0, kMaxLineChars);
+bool clear_ring(String &error_out) {
+  if (!ensure_ready(error_out)) {
+    return false;
   }
-  return v;
+  char key[6];
+  for (int i = 0; i < g_count; i++) {
+    slot_key((g_head + i) % kMaxEntries, key);
+    g_prefs.remove(key);
+  }
+  g_head = 0;
+  g_count = 0;
+  save_ring();
+  context_cache_put(CTX_HISTORY, "", context_cache_invalidate(CTX_HISTORY));
+  return true;
+}
+
+// Team chats: the session file of the chat as "User: ..." lines, the newest
+// that fit in kMaxOutChars.
+bool session_history(const String &chat_id, String &history_out, String &error_out) {
+  String jsonl;
+  if (!file_memory_session_get(chat_id, jsonl, error_out)) {
+    return false;
+  }
+  String lines[kMaxEntries];
+  int count = 0;
+  JsonDocument doc;
+  for (int start = 0; start < (int)jsonl.length();) {
+    int end = jsonl.indexOf('\n', start);
+    if (end < 0) {
+      end = jsonl.length();
+    }
+    if (end > start && !deserializeJson(doc, jsonl.c_str() + start, end - start)) {
+      const bool assistant = String(doc["role"] | "") == "assistant";
+      String line = assistant ? "Assistant: " : "User: ";
+      line += doc["content"] | "";
+      // Ring of the newest kMaxEntries lines
+      lines[count % kMaxEntries] = line;
+      count++;
+    }
+    start = end + 1;
+  }
+
+  const int kept = count < kMaxEntries ? count : kMaxEntries;
+  int first = kept;
+  size_t total = 0;
+  while (first > 0) {
+    const String &line = lines[(count - kept + first - 1) % kMaxEntries];
+    if (total + line.length() + 1 > kMaxOutChars && first < kept) {
+      break;
+    }
+    total += line.length() + 1;
+    first--;
+  }
+  history_out = "";
+  history_out.reserve(total);
+  for (int i = first; i < kept; i++) {
+    history_out += lines[(count - kept + i) % kMaxEntries];
+    history_out += '\n';
+  }
+  history_out.trim();
+  return true;
 }
 
 }  // namespace
 
 void chat_history_init() {
+  if (g_lock == nullptr) {
+    g_lock = xSemaphoreCreateMutex();
+  }
+  HistoryLock guard;
   String err;
   if (ensure_ready(err)) {
+    migrate_legacy_blob();
     Serial.println("[chat] NVS history ready");
   } else {
     Serial.println("[chat] init failed");
@@ -87,6 +221,7 @@ void chat_history_init() {
 }
 
 bool chat_history_append(char role, const String &text, String &error_out) {
+  HistoryLock guard;
   if (!ensure_ready(error_out)) {
     return false;
   }
@@ -97,21 +232,21 @@ bool chat_history_append(char role, const String &text, String &error_out) {
     return true;
   }
 
-  String lines = g_prefs.getString(kKeyLines, "");
-  if (lines.length() > 0 && !lines.endsWith("\n")) {
-    lines += "\n";
+  const String chat_id = chat_scope_current();
+  if (!chat_scope_is_owner(chat_id)) {
+    return file_memory_session_append(chat_id, role_norm == 'A' ? "assistant" : "user", clean,
+                                      error_out);
   }
-  lines += String(role_norm) + "|" + clean + "\n";
 
-  while (count_lines(lines) > kMaxEntries) {
-    drop_first_line(lines);
-  }
-  while ((int)lines.length() > kMaxStoreChars) {
-    drop_first_line(lines);
-  }
+  String entry;
+  entry.reserve(clean.length() + 2);
+  entry += role_norm;
+  entry += '|';
+  entry += clean;
 
-  size_t written = g_prefs.putString(kKeyLines, lines);
-  if (written == 0 && lines.length() > 0) {
+  const bool ok = push_entry(entry);
+  context_cache_invalidate(CTX_HISTORY);
+  if (!ok) {
     error_out = "failed to write history";
     return false;
   }
@@ -119,61 +254,92 @@ bool chat_history_append(char role, const String &text, String &error_out) {
 }
 
 bool chat_history_get(String &history_out, String &error_out) {
+  HistoryLock guard;
+  const String chat_id = chat_scope_current();
+  if (!chat_scope_is_owner(chat_id)) {
+    return session_history(chat_id, history_out, error_out);
+  }
   if (!ensure_ready(error_out)) {
     return false;
   }
 
-  String lines = g_prefs.getString(kKeyLines, "");
-  lines.trim();
-  if (lines.length() == 0) {
-    history_out = "";
+  if (context_cache_get(CTX_HISTORY, history_out)) {
     return true;
   }
+  const uint32_t generation = context_cache_generation(CTX_HISTORY);
 
-  String out;
-  out.reserve(lines.length() + 64);
-
-  int start = 0;
-  while (start < (int)lines.length()) {
-    int end = lines.indexOf('\n', start);
-    if (end < 0) {
-      end = lines.length();
+  // Walk newest to oldest until the output budget is spent, then emit the
+  // kept entries oldest first.
+  String kept[kMaxEntries];
+  int kept_count = 0;
+  size_t total = 0;
+  char key[6];
+  for (int i = g_count - 1; i >= 0; i--) {
+    slot_key((g_head + i) % kMaxEntries, key);
+    String entry = g_prefs.getString(key, "");
+    if (entry.length() < 3 || entry[1] != '|') {
+      continue;
     }
-    String line = lines.substring(start, end);
-    int sep = line.indexOf('|');
-    if (sep > 0) {
-      String role = line.substring(0, sep);
-      String text = line.substring(sep + 1);
-      text.trim();
-      if (text.length() > 0) {
-        if (role == "A") {
-          out += "Assistant: ";
-        } else {
-          out += "User: ";
-        }
-        out += text + "\n";
-      }
+    const size_t line_len = entry.length() - 2 + (entry[0] == 'A' ? 11 : 6) + 1;
+    if (total + line_len > kMaxOutChars && kept_count > 0) {
+      break;
     }
-    start = end + 1;
+    total += line_len;
+    kept[kept_count++] = entry;
   }
 
-  out.trim();
-  if ((int)out.length() > kMaxOutChars) {
-    out = out.substring(out.length() - kMaxOutChars);
-    int nl = out.indexOf('\n');
-    if (nl >= 0 && nl + 1 < (int)out.length()) {
-      out = out.substring(nl + 1);
-    }
+  String out;
+  out.reserve(total);
+  for (int i = kept_count - 1; i >= 0; i--) {
+    out += kept[i][0] == 'A' ? "Assistant: " : "User: ";
+    out += kept[i].c_str() + 2;
+    out += '\n';
   }
+  out.trim();
 
   history_out = out;
+  context_cache_put(CTX_HISTORY, history_out, generation);
   return true;
 }
 
 bool chat_history_clear(String &error_out) {
-  if (!ensure_ready(error_out)) {
+  HistoryLock guard;
+  const String chat_id = chat_scope_current();
+  if (!chat_scope_is_owner(chat_id)) {
+    return file_memory_session_clear(chat_id, error_out);
+  }
+  return clear_ring(error_out);
+}
+
+int chat_history_export(String *entries_out, int max_entries) {
+  HistoryLock guard;
+  String err;
+  if (!ensure_ready(err)) {
+    return 0;
+  }
+  char key[6];
+  int n = 0;
+  for (int i = 0; i < g_count && n < max_entries; i++) {
+    slot_key((g_head + i) % kMaxEntries, key);
+    entries_out[n++] = g_prefs.getString(key, "");
+  }
+  return n;
+}
+
+bool chat_history_import(const String *entries, int count, String &error_out) {
+  HistoryLock guard;
+  if (!clear_ring(error_out)) {
     return false;
   }
-  g_prefs.remove(kKeyLines);
-  return true;
+  bool ok = true;
+  for (int i = 0; i < count; i++) {
+    if (entries[i].length() > 2 && entries[i][1] == '|') {
+      ok = push_entry(entries[i]) && ok;
+    }
+  }
+  context_cache_invalidate(CTX_HISTORY);
+  if (!ok) {
+    error_out = "failed to write history";
+  }
+  return ok;
 }
@@ -3,9 +3,19 @@
 
 #include <Arduino.h>
 
+// Ring slots; 30 role-lines ~= 15 user/assistant turns.
+#define CHAT_HISTORY_SLOTS 30
+
+// History of the chat the calling task serves (chat_scope): the owner chat's
+// lives in these NVS slots, team chats' in their file_memory session files.
 void chat_history_init();
 bool chat_history_append(char role, const String &text, String &error_out);
 bool chat_history_get(String &history_out, String &error_out);
 bool chat_history_clear(String &error_out);
 
+// Raw owner-chat ring entries ("R|text"), oldest first, so a caller that writes test
+// turns (bench) can put the history back exactly. Returns the entry count.
+int chat_history_export(String *entries_out, int max_entries);
+bool chat_history_import(const String *entries, int count, String &error_out);
+
 #endif
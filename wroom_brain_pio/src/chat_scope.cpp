@@ -0,0 +1,102 @@
+#include "chat_scope.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "brain_config.h"
+
+namespace {
+
+// Both agent lanes plus short-lived helpers working on their behalf
+const int kMaxBindings = 6;
+// Telegram ids are 64-bit, "-100" prefixed for supergroups
+const size_t kMaxIdChars = 24;
+
+struct Binding {
+  TaskHandle_t task;
+  char chat_id[kMaxIdChars];
+};
+
+Binding g_bindings[kMaxBindings];
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void set_id(Binding &b, const String &chat_id) {
+  strncpy(b.chat_id, chat_id.c_str(), kMaxIdChars - 1);
+  b.chat_id[kMaxIdChars - 1] = '\0';
+}
+
+}  // namespace
+
+void chat_scope_bind(const String &chat_id) {
+  const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  const bool unbind = chat_id.length() == 0 || chat_scope_is_owner(chat_id);
+  bool bound = unbind;
+  portENTER_CRITICAL(&g_mux);
+  int free_slot = -1;
+  for (int i = 0; i < kMaxBindings; i++) {
+    if (g_bindings[i].task == self) {
+      if (unbind) {
+        g_bindings[i].task = nullptr;
+      } else {
+        set_id(g_bindings[i], chat_id);
+        bound = true;
+      }
+      break;
+    }
+    if (g_bindings[i].task == nullptr && free_slot < 0) {
+      free_slot = i;
+    }
+  }
+  if (!bound && free_slot >= 0) {
+    g_bindings[free_slot].task = self;
+    set_id(g_bindings[free_slot], chat_id);
+    bound = true;
+  }
+  portEXIT_CRITICAL(&g_mux);
+  if (!bound) {
+    Serial.println("[chat] no free scope binding, replying to the owner chat");
+  }
+}
+
+String chat_scope_current() {
+  const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  char chat_id[kMaxIdChars] = "";
+  portENTER_CRITICAL(&g_mux);
+  for (int i = 0; i < kMaxBindings; i++) {
+    if (g_bindings[i].task == self) {
+      memcpy(chat_id, g_bindings[i].chat_id, kMaxIdChars);
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&g_mux);
+  return chat_id[0] != '\0' ? String(chat_id) : String(TELEGRAM_ALLOWED_CHAT_ID);
+}
+
+bool chat_scope_is_owner(const String &chat_id) {
+  return chat_id == TELEGRAM_ALLOWED_CHAT_ID;
+}
+
+bool chat_scope_allowed(const String &chat_id) {
+  if (chat_id.length() == 0) {
+    return false;
+  }
+  if (chat_scope_is_owner(chat_id)) {
+    return true;
+  }
+  const char *list = TELEGRAM_TEAM_CHAT_IDS;
+  const size_t len = chat_id.length();
+  for (const char *p = list; *p;) {
+    while (*p == ',' || *p == ' ') {
+      p++;
+    }
+    const char *end = p;
+    while (*end && *end != ',' && *end != ' ') {
+      end++;
+    }
+    if ((size_t)(end - p) == len && strncmp(p, chat_id.c_str(), len) == 0) {
+      return true;
+    }
+    p = end;
+  }
+  return false;
+}
@@ -0,0 +1,20 @@
+#ifndef CHAT_SCOPE_H
+#define CHAT_SCOPE_H
+
+#include <Arduino.h>
+
+// Which Telegram chat the calling task is serving. An agent worker binds the
+// chat of the message it is on, so replies, media lookups and chat history
+// reach that chat without an id threaded through every tool. Unbound tasks
+// (scheduler, web server, timers) serve the owner chat,
+// TELEGRAM_ALLOWED_CHAT_ID.
+
+// Bind the calling task; "" unbinds it. Tasks that exit must unbind first.
+void chat_scope_bind(const String &chat_id);
+String chat_scope_current();
+
+bool chat_scope_is_owner(const String &chat_id);
+// The owner chat or one listed in TELEGRAM_TEAM_CHAT_IDS.
+bool chat_scope_allowed(const String &chat_id);
+
+#endif
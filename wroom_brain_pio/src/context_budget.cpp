@@ -0,0 +1,234 @@
+#include "context_budget.h"
+
+#include "model_config.h"
+
+namespace {
+
+struct ModelWindow {
+  const char *match;  // substring of the lower-cased model (or provider) name
+  uint32_t tokens;
+};
+
+// First match wins, so longer names go before their prefixes. Provider names
+// at the end cover a provider whose model is left at its default.
+const ModelWindow kModelWindows[] = {
+    {"gemini", 1000000},     {"gpt-4.1", 1000000}, {"gpt-5", 400000},
+    {"gpt-4o", 128000},      {"o4-mini", 200000},  {"claude", 200000},
+    {"glm-4", 128000},       {"deepseek", 64000},  {"llama-3.1", 131072},
+    {"llama3.1", 131072},    {"llama-3.2", 131072}, {"llama3.2", 131072},
+    {"llama", 8192},         {"qwen", 32768},      {"mistral", 32768},
+    {"gemma", 8192},         {"openai", 128000},   {"anthropic", 200000},
+    {"glm", 128000},
+};
+
+// Quarter tokens per byte: ASCII is a quarter, a UTF-8 lead byte a whole
+// token, continuation bytes nothing.
+inline size_t byte_cost(uint8_t c) {
+  if (c < 0x80) {
+    return 1;
+  }
+  return (c & 0xC0) == 0x80 ? 0 : 4;
+}
+
+inline bool is_continuation(uint8_t c) {
+  return (c & 0xC0) == 0x80;
+}
+
+size_t lookup_window(const String &name) {
+  for (size_t i = 0; i < sizeof(kModelWindows) / sizeof(kModelWindows[0]); i++) {
+    if (name.indexOf(kModelWindows[i].match) >= 0) {
+      return kModelWindows[i].tokens;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+size_t context_estimate_tokens(const char *text, size_t len) {
+  size_t quarters = 0;
+  for (size_t i = 0; i < len; i++) {
+    quarters += byte_cost((uint8_t)text[i]);
+  }
+  return (quarters + 3) / 4;
+}
+
+size_t context_estimate_tokens(const String &text) {
+  return context_estimate_tokens(text.c_str(), text.length());
+}
+
+size_t context_model_window(const String &provider, const String &model) {
+  String model_lc = model;
+  model_lc.toLowerCase();
+  String provider_lc = provider;
+  provider_lc.toLowerCase();
+
+  size_t window = model_lc.length() > 0 ? lookup_window(model_lc) : 0;
+  if (window == 0) {
+    window = lookup_window(provider_lc);
+  }
+  if (window == 0) {
+    window = CONTEXT_DEFAULT_WINDOW_TOKENS;
+  }
+  // Ollama truncates to its num_ctx whatever the model could take
+  if (provider_lc == "ollama" && window > CONTEXT_OLLAMA_WINDOW_TOKENS) {
+    window = CONTEXT_OLLAMA_WINDOW_TOKENS;
+  }
+  return window;
+}
+
+void context_trim(String &text, size_t max_tokens, bool keep_tail) {
+  const size_t len = text.length();
+  const size_t limit = max_tokens * 4;
+  const uint8_t *p = (const uint8_t *)text.c_str();
+
+  size_t quarters = 0;
+  for (size_t i = 0; i < len; i++) {
+    quarters += byte_cost(p[i]);
+  }
+  if (quarters <= limit) {
+    return;
+  }
+  if (max_tokens == 0) {
+    text = "";
+    return;
+  }
+
+  if (!keep_tail) {
+    size_t used = 0;
+    size_t cut = 0;
+    for (; cut < len; cut++) {
+      used += byte_cost(p[cut]);
+      if (used > limit) {
+        break;
+      }
+    }
+    // Lead bytes carry the whole cost, so cut never lands mid-character
+    text = text.substring(0, cut) + "\n...(truncated)";
+    return;
+  }
+
+  size_t used = 0;
+  size_t start = len;
+  while (start > 0) {
+    used += byte_cost(p[start - 1]);
+    if (used > limit) {
+      break;
+    }
+    start--;
+  }
+  while (start < len && is_continuation(p[start])) {
+    start++;
+  }
+  text = String("...(truncated)\n") + text.substring(start);
+}
+
+ContextBudget::ContextBudget(const char *label) : label_(label), fixed_(0), count_(0) {
+  String provider = model_config_get_active_provider();
+  String model;
+  if (provider.length() > 0 && provider != "none") {
+    model = model_config_get_model(provider);
+  } else {
+    provider = LLM_PROVIDER;
+    model = LLM_MODEL;
+  }
+  window_ = context_model_window(provider, model);
+}
+
+void ContextBudget::reserve(const String &text) {
+  fixed_ += context_estimate_tokens(text);
+}
+
+void ContextBudget::reserve_tokens(size_t tokens) {
+  fixed_ += tokens;
+}
+
+void ContextBudget::add(const char *name, String &text, ContextPriority priority,
+                        size_t max_tokens, size_t min_tokens, bool keep_tail) {
+  if (max_tokens != kAll) {
+    context_trim(text, max_tokens, keep_tail);
+  }
+  const size_t tokens = context_estimate_tokens(text);
+  if (count_ >= CONTEXT_MAX_SECTIONS) {
+    // No slot left: still counted, just never trimmed
+    fixed_ += tokens;
+    return;
+  }
+  sections_[count_++] = {name, &text, tokens, min_tokens, priority, keep_tail};
+}
+
+int ContextBudget::hold(const char *name, size_t tokens, ContextPriority priority,
+                        size_t min_tokens) {
+  if (count_ >= CONTEXT_MAX_SECTIONS) {
+    return -1;
+  }
+  sections_[count_] = {name, nullptr, tokens, min_tokens, priority, false};
+  return count_++;
+}
+
+size_t ContextBudget::fit() {
+  size_t limit = CONTEXT_TARGET_TOKENS;
+  const size_t taken = fixed_ + CONTEXT_REPLY_RESERVE_TOKENS;
+  const size_t headroom = window_ > taken ? window_ - taken : 0;
+  if (headroom < limit) {
+    limit = headroom;
+  }
+
+  size_t total = 0;
+  for (int i = 0; i < count_; i++) {
+    if (sections_[i].tokens > 0) {
+      total += sections_[i].tokens + kSectionOverheadTokens;
+    }
+  }
+
+  // First pass trims each section down to its floor, lowest priority first;
+  // the second takes sections below their floors in the same order.
+  for (int pass = 0; pass < 2 && total > limit; pass++) {
+    for (int prio = CTX_PRIO_SKILLS; prio >= CTX_PRIO_QUERY && total > limit; prio--) {
+      for (int i = count_ - 1; i >= 0 && total > limit; i--) {
+        Section &s = sections_[i];
+        if (s.priority != prio || s.tokens == 0 || s.min_tokens == kAll) {
+          continue;
+        }
+        const size_t floor = pass == 0 ? (s.min_tokens < s.tokens ? s.min_tokens : s.tokens) : 0;
+        const size_t excess = total - limit;
+        const size_t cuttable = s.tokens - floor;
+        if (cuttable == 0) {
+          continue;
+        }
+        size_t target = s.tokens - (excess < cuttable ? excess : cuttable);
+        // A few tokens of a section are noise; drop it instead
+        if (target < kSectionOverheadTokens * 2) {
+          target = 0;
+        }
+
+        const size_t before = s.tokens;
+        if (s.text != nullptr) {
+          context_trim(*s.text, target, s.keep_tail);
+          s.tokens = context_estimate_tokens(*s.text);
+        } else {
+          s.tokens = target;
+        }
+        total -= before + kSectionOverheadTokens;
+        if (s.tokens > 0) {
+          total += s.tokens + kSectionOverheadTokens;
+        }
+        Serial.printf("[ctx] %s: %s %u -> %u tokens\n", label_, s.name, (unsigned)before,
+                      (unsigned)s.tokens);
+      }
+    }
+  }
+
+  if (total > limit) {
+    Serial.printf("[ctx] %s: %u tokens, over budget %u\n", label_, (unsigned)total,
+                  (unsigned)limit);
+  }
+  return total;
+}
+
+size_t ContextBudget::granted(int handle) const {
+  if (handle < 0 || handle >= count_) {
+    return 0;
+  }
+  return sections_[handle].tokens;
+}
@@ -0,0 +1,86 @@
+#ifndef CONTEXT_BUDGET_H
+#define CONTEXT_BUDGET_H
+
+#include <Arduino.h>
+
+#include "brain_config.h"
+
+// One token budget per prompt instead of a character cap per section. The
+// caller registers each variable section with a priority and a ceiling, and
+// fit() trims the lowest-priority section first until the whole prompt is
+// within CONTEXT_TARGET_TOKENS (and the active model's window). Trims are
+// logged, so a dropped section is never silent.
+
+// Highest priority first; sections of equal priority are trimmed newest-added first.
+enum ContextPriority : uint8_t {
+  CTX_PRIO_QUERY = 0,
+  CTX_PRIO_TOOL_RESULTS,
+  CTX_PRIO_HISTORY,
+  CTX_PRIO_MEMORY,
+  CTX_PRIO_SKILLS,
+};
+
+// Rough token count: four ASCII chars per token and one per non-ASCII
+// character (emoji, accented or CJK text), which tokenizers rarely merge.
+size_t context_estimate_tokens(const char *text, size_t len);
+size_t context_estimate_tokens(const String &text);
+
+// Context window of a model in tokens, looked up by name
+// (CONTEXT_DEFAULT_WINDOW_TOKENS when unknown, at most OLLAMA_CONTEXT_TOKENS on ollama).
+size_t context_model_window(const String &provider, const String &model);
+
+// Cut text to about max_tokens, keeping the head (a "...(truncated)" line is
+// appended) or the tail (the marker goes first). Never splits a UTF-8 character.
+void context_trim(String &text, size_t max_tokens, bool keep_tail);
+
+class ContextBudget {
+ public:
+  static const size_t kAll = (size_t)-1;
+
+  // label names the prompt in the trim log. The window comes from the active
+  // provider's model.
+  explicit ContextBudget(const char *label);
+
+  // Fixed text (instructions, tool lists) sent as-is. It counts against the
+  // model window but not the latency target, which is for variable context.
+  void reserve(const String &text);
+  void reserve_tokens(size_t tokens);
+
+  // Register a section trimmed in place by fit(). It never exceeds
+  // max_tokens and is only cut below min_tokens when nothing else is left
+  // (kAll for both keeps it whole). The String must outlive fit().
+  void add(const char *name, String &text, ContextPriority priority, size_t max_tokens,
+           size_t min_tokens = 0, bool keep_tail = false);
+
+  // Space for text that arrives later (tool results). Returns a handle for
+  // granted(); the hold is trimmed like a section of that priority.
+  int hold(const char *name, size_t tokens, ContextPriority priority, size_t min_tokens = 0);
+
+  // Trim to the budget. Returns the variable-context tokens used.
+  size_t fit();
+
+  // Tokens left to a hold after fit().
+  size_t granted(int handle) const;
+
+ private:
+  struct Section {
+    const char *name;
+    String *text;  // nullptr for a hold
+    size_t tokens;
+    size_t min_tokens;
+    ContextPriority priority;
+    bool keep_tail;
+  };
+
+  // Labels around a section ("\n\nMEMORY:\n") are not registered; each
+  // non-empty section is charged this much for them.
+  static const size_t kSectionOverheadTokens = 8;
+
+  const char *label_;
+  size_t window_;
+  size_t fixed_;
+  Section sections_[CONTEXT_MAX_SECTIONS];
+  int count_;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "context_cache.h"
+
+#include <Arduino.h>
+#include <freertos/semphr.h>
+
+#include "brain_config.h"
+
+namespace {
+
+struct CacheEntry {
+  String value;
+  bool valid;
+  uint32_t generation;  // bumped by every invalidate
+};
+
+CacheEntry g_entries[CTX_SECTION_COUNT];
+SemaphoreHandle_t g_lock = nullptr;
+
+bool lock() {
+  return g_lock != nullptr && xSemaphoreTake(g_lock, portMAX_DELAY) == pdTRUE;
+}
+
+void unlock() {
+  xSemaphoreGive(g_lock);
+}
+
+}  // namespace
+
+void context_cache_init() {
+  if (g_lock == nullptr) {
+    g_lock = xSemaphoreCreateMutex();
+  }
+}
+
+bool context_cache_get(ContextSection section, String &out) {
+  if (section < 0 || section >= CTX_SECTION_COUNT || !lock()) {
+    return false;
+  }
+  const bool hit = g_entries[section].valid;
+  if (hit) {
+    out = g_entries[section].value;
+  }
+  unlock();
+  return hit;
+}
+
+uint32_t context_cache_generation(ContextSection section) {
+  if (section < 0 || section >= CTX_SECTION_COUNT || !lock()) {
+    return 0;
+  }
+  const uint32_t generation = g_entries[section].generation;
+  unlock();
+  return generation;
+}
+
+void context_cache_put(ContextSection section, const String &value, uint32_t generation) {
+  // Oversized sections are simply re-read; the cache must stay small.
+  if (section < 0 || section >= CTX_SECTION_COUNT || value.length() > CONTEXT_CACHE_MAX_CHARS ||
+      !lock()) {
+    return;
+  }
+  // An invalidate since the caller's read means the value may be stale.
+  if (g_entries[section].generation == generation) {
+    g_entries[section].value = value;
+    g_entries[section].valid = true;
+  }
+  unlock();
+}
+
+uint32_t context_cache_invalidate(ContextSection section) {
+  if (section < 0 || section >= CTX_SECTION_COUNT || !lock()) {
+    return 0;
+  }
+  g_entries[section].valid = false;
+  g_entries[section].value = "";
+  const uint32_t generation = ++g_entries[section].generation;
+  unlock();
+  return generation;
+}
+
+void context_cache_invalidate_all() {
+  for (int i = 0; i < CTX_SECTION_COUNT; i++) {
+    context_cache_invalidate((ContextSection)i);
+  }
+}
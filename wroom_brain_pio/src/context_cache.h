@@ -0,0 +1,31 @@
+#ifndef CONTEXT_CACHE_H
+#define CONTEXT_CACHE_H
+
+#include <Arduino.h>
+
+// In-RAM copies of the prompt context sections so repeated chat turns and
+// ReAct iterations assemble prompts without flash/NVS reads. The store that
+// owns each section invalidates it after every write.
+//
+// A reader that misses takes context_cache_generation() before reading the
+// backing store and hands it to context_cache_put(), which drops the value if
+// the section was invalidated in between. A writer that already holds the new
+// value puts it with the generation its invalidate returned.
+enum ContextSection {
+  CTX_SOUL = 0,
+  CTX_USER,
+  CTX_LONG_TERM,
+  CTX_NOTES,
+  CTX_HISTORY,
+  CTX_SCHEDULE,
+  CTX_SECTION_COUNT
+};
+
+void context_cache_init();
+bool context_cache_get(ContextSection section, String &out);
+uint32_t context_cache_generation(ContextSection section);
+void context_cache_put(ContextSection section, const String &value, uint32_t generation);
+uint32_t context_cache_invalidate(ContextSection section);
+void context_cache_invalidate_all();
+
+#endif
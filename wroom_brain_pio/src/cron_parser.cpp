@@ -1,35 +1,25 @@
 #include "cron_parser.h"
 
+// Field parsing lives in the shared core; this keeps the -1 wildcard / -2
+// error contract and turns its result codes into messages.
 static int parse_cron_field(const String &field, int min_val, int max_val, String &error) {
-  String f = field;
-  f.trim();
-
-  // Wildcard
-  if (f == "*" || f == "?") {
-    return -1;
-  }
-
-  if (f.length() == 0) {
-    error = "Empty field";
-    return -2;
-  }
-
-  // Strict numeric validation (reject values like "14:05" or "60abc").
-  for (int i = 0; i < (int)f.length(); i++) {
-    if (f[i] < '0' || f[i] > '9') {
+  int val = -1;
+  switch (bc_cron_parse_field(field.c_str(), field.length(), min_val, max_val, &val)) {
+    case BC_CRON_OK:
+      return val;
+    case BC_CRON_EMPTY:
+      error = "Empty field";
+      return -2;
+    case BC_CRON_NOT_NUMERIC: {
+      String f = field;
+      f.trim();
       error = "Invalid numeric value: " + f;
       return -2;
     }
+    default:
+      error = "Value " + String(val) + " out of range [" + String(min_val) + "-" + String(max_val) + "]";
+      return -2;
   }
-
-  // Parse as number
-  int val = atoi(f.c_str());
-  if (val < min_val || val > max_val) {
-    error = "Value " + String(val) + " out of range [" + String(min_val) + "-" + String(max_val) + "]";
-    return -2;
-  }
-
-  return val;
 }
 
 static String get_cron_field_name(int index) {
@@ -170,6 +160,15 @@ bool cron_should_trigger(const CronJob &job, int hour, int minute, int day, int
   return true;
 }
 
+void cron_compile(const CronJob &job, CronSchedule &out) {
+  const int values[BC_CRON_FIELDS] = {job.minute, job.hour, job.day, job.month, job.weekday};
+  bc_cron_compile(values, &out);
+}
+
+time_t cron_next_fire(const CronSchedule &schedule, time_t after) {
+  return bc_cron_next_fire(&schedule, after);
+}
+
 String cron_job_to_string(const CronJob &job) {
   String result = "";
 
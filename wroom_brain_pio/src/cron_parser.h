@@ -2,10 +2,13 @@
 #define CRON_PARSER_H
 
 #include <Arduino.h>
+#include <time.h>
+
+#include "bc_cron.h"
 
 // Maximum number of cron jobs supported
 #ifndef CRON_MAX_JOBS
-#define CRON_MAX_JOBS 10
+#define CRON_MAX_JOBS 24
 #endif
 
 // Individual cron job definition
@@ -28,6 +31,15 @@ bool cron_parse_line(const String &line, CronJob &job, String &error_out);
 // Check if a cron job should trigger at the given time
 bool cron_should_trigger(const CronJob &job, int hour, int minute, int day, int month, int weekday);
 
+// Job fields compiled to bitsets (brain_core, shared with the ESP-IDF build)
+typedef bc_cron_t CronSchedule;
+
+void cron_compile(const CronJob &job, CronSchedule &out);
+
+// First local minute strictly after `after` (epoch seconds) that matches the
+// schedule, or 0 if none does within the next few years (e.g. Feb 31)
+time_t cron_next_fire(const CronSchedule &schedule, time_t after);
+
 // Format cron job as string for display
 String cron_job_to_string(const CronJob &job);
 
@@ -1,24 +1,127 @@
 #include "cron_store.h"
 
 #include <FS.h>
-#include "SPIFFS.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <time.h>
 
+#include "context_cache.h"
+#include "flash_fs.h"
+#include "scheduler.h"
+
 #define CRON_FILENAME "/cron.md"
 #define LAST_CHECK_FILE "/cron_lastcheck.txt"
 
-// Cache of loaded jobs
-static CronJob s_cached_jobs[CRON_MAX_JOBS];
+// Jobs are parsed and compiled once, when cron.md is loaded or changed
+struct CronEntry {
+  CronJob job;
+  CronSchedule schedule;
+  time_t next_fire;  // 0 when not armed or never matching
+};
+
+static CronEntry s_entries[CRON_MAX_JOBS];
 static int s_cached_count = 0;
 static bool s_initialized = false;
 
+// Min-heap of armed entry indexes ordered by next_fire. Arming needs a synced
+// clock, so it happens on the first cron_store_take_due() call.
+static uint8_t s_heap[CRON_MAX_JOBS];
+static int s_heap_size = 0;
+static bool s_armed = false;
+
+// Set once the boot-time missed-job replay has read cron_lastcheck.txt; until
+// then the file still marks where that replay has to start.
+static bool s_missed_checked = false;
+
+// The scheduler task fires jobs while agent workers add or list them
+static SemaphoreHandle_t s_lock = nullptr;
+
+static void lock() {
+  if (s_lock != nullptr) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+  }
+}
+
+static void unlock() {
+  if (s_lock != nullptr) {
+    xSemaphoreGive(s_lock);
+  }
+}
+
+static bool heap_less(int a, int b) {
+  return s_entries[s_heap[a]].next_fire < s_entries[s_heap[b]].next_fire;
+}
+
+static void heap_swap(int a, int b) {
+  const uint8_t tmp = s_heap[a];
+  s_heap[a] = s_heap[b];
+  s_heap[b] = tmp;
+}
+
+static void heap_sift_up(int i) {
+  while (i > 0 && heap_less(i, (i - 1) / 2)) {
+    heap_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void heap_sift_down(int i) {
+  while (true) {
+    const int l = 2 * i + 1;
+    const int r = l + 1;
+    int top = i;
+    if (l < s_heap_size && heap_less(l, top)) {
+      top = l;
+    }
+    if (r < s_heap_size && heap_less(r, top)) {
+      top = r;
+    }
+    if (top == i) {
+      return;
+    }
+    heap_swap(i, top);
+    i = top;
+  }
+}
+
+// Schedule entry idx from `now`; jobs that can never fire stay out of the heap.
+static void arm_entry(int idx, time_t now) {
+  s_entries[idx].next_fire = cron_next_fire(s_entries[idx].schedule, now);
+  if (s_entries[idx].next_fire == 0) {
+    return;
+  }
+  s_heap[s_heap_size] = (uint8_t)idx;
+  heap_sift_up(s_heap_size++);
+}
+
+static void arm_all(time_t now) {
+  s_heap_size = 0;
+  for (int i = 0; i < s_cached_count; i++) {
+    arm_entry(i, now);
+  }
+  s_armed = true;
+}
+
+static void add_entry(const CronJob &job) {
+  CronEntry &entry = s_entries[s_cached_count];
+  entry.job = job;
+  cron_compile(job, entry.schedule);
+  entry.next_fire = 0;
+  const int idx = s_cached_count++;
+  if (s_armed) {
+    arm_entry(idx, time(nullptr));
+  }
+}
+
 // Load all cron jobs from cron.md
 static void cron_store_load() {
   s_cached_count = 0;
+  s_heap_size = 0;
+  s_armed = false;
 
-  if (!SPIFFS.exists(CRON_FILENAME)) {
+  if (!FLASH_FS.exists(CRON_FILENAME)) {
     // Create default cron.md with header
-    File f = SPIFFS.open(CRON_FILENAME, "w");
+    File f = FLASH_FS.open(CRON_FILENAME, "w");
     if (f) {
       f.println("# Cron Jobs");
       f.println("# Format: minute hour day month weekday | command");
@@ -31,7 +134,7 @@ static void cron_store_load() {
     return;
   }
 
-  File f = SPIFFS.open(CRON_FILENAME, "r");
+  File f = FLASH_FS.open(CRON_FILENAME, "r");
   if (!f) {
     Serial.println("[cron_store] Failed to open cron.md");
     return;
@@ -60,7 +163,7 @@ static void cron_store_load() {
     CronJob job;
     String error;
     if (cron_parse_line(line, job, error)) {
-      s_cached_jobs[s_cached_count++] = job;
+      add_entry(job);
       Serial.printf("[cron_store] Loaded: %s\n", cron_job_to_string(job).c_str());
     } else {
       Serial.printf("[cron_store] Skipping invalid line: %s (error: %s)\n", line.c_str(), error.c_str());
@@ -76,11 +179,14 @@ void cron_store_init() {
     return;
   }
 
-  if (!SPIFFS.begin(true)) {
-    Serial.println("[cron_store] SPIFFS mount failed");
+  if (!flash_fs_begin()) {
+    Serial.println("[cron_store] " FLASH_FS_NAME " mount failed");
     return;
   }
 
+  if (s_lock == nullptr) {
+    s_lock = xSemaphoreCreateMutex();
+  }
   cron_store_load();
   s_initialized = true;
 }
@@ -92,16 +198,21 @@ bool cron_store_add(const String &cron_line, String &error_out) {
     return false;
   }
 
-  if (s_cached_count >= CRON_MAX_JOBS) {
+  lock();
+  const bool full = s_cached_count >= CRON_MAX_JOBS;
+  if (!full) {
+    add_entry(job);
+  }
+  unlock();
+  if (full) {
     error_out = "Maximum cron jobs reached (" + String(CRON_MAX_JOBS) + ")";
     return false;
   }
-
-  // Add to cache
-  s_cached_jobs[s_cached_count++] = job;
+  context_cache_invalidate(CTX_SCHEDULE);
+  scheduler_notify_changed();
 
   // Append to file
-  File f = SPIFFS.open(CRON_FILENAME, "a");
+  File f = FLASH_FS.open(CRON_FILENAME, "a");
   if (!f) {
     error_out = "Failed to open cron.md for writing";
     return false;
@@ -110,23 +221,71 @@ bool cron_store_add(const String &cron_line, String &error_out) {
   f.println(cron_line);
   f.close();
 
+  // The new job has nothing to replay from before it existed
+  const time_t now = time(nullptr);
+  if (s_missed_checked && now >= 1700000000) {
+    cron_store_update_last_check(now);
+  }
+
   Serial.printf("[cron_store] Added cron job: %s\n", cron_job_to_string(job).c_str());
   return true;
 }
 
 int cron_store_get_all(CronJob *jobs, int max_jobs) {
+  lock();
   int count = (s_cached_count < max_jobs) ? s_cached_count : max_jobs;
   for (int i = 0; i < count; i++) {
-    jobs[i] = s_cached_jobs[i];
+    jobs[i] = s_entries[i].job;
   }
+  unlock();
   return count;
 }
 
+int cron_store_take_due(time_t now, String *commands_out, int max_commands) {
+  lock();
+  if (!s_armed) {
+    arm_all(now);
+  }
+  int n = 0;
+  while (n < max_commands && s_heap_size > 0 && s_entries[s_heap[0]].next_fire <= now) {
+    CronEntry &entry = s_entries[s_heap[0]];
+    commands_out[n++] = entry.job.command;
+    // Rescheduled from now, not from the old fire time, so a clock jump
+    // forward fires a job once instead of replaying every skipped minute.
+    entry.next_fire = cron_next_fire(entry.schedule, now);
+    if (entry.next_fire == 0) {
+      s_heap[0] = s_heap[--s_heap_size];
+    }
+    heap_sift_down(0);
+  }
+  unlock();
+  return n;
+}
+
+time_t cron_store_next_fire() {
+  lock();
+  const time_t next = s_heap_size > 0 ? s_entries[s_heap[0]].next_fire : 0;
+  unlock();
+  return next;
+}
+
+void cron_store_rearm() {
+  lock();
+  s_armed = false;
+  s_heap_size = 0;
+  unlock();
+}
+
 bool cron_store_clear(String &error_out) {
+  lock();
   s_cached_count = 0;
+  s_heap_size = 0;
+  unlock();
+  context_cache_invalidate(CTX_SCHEDULE);
+  scheduler_notify_changed();
 
   // Rewrite file with header only
-  File f = SPIFFS.open(CRON_FILENAME, "w");
+  File f = FLASH_FS.open(CRON_FILENAME, "w");
   if (!f) {
     error_out = "Failed to open cron.md for writing";
     return false;
@@ -143,12 +302,12 @@ bool cron_store_clear(String &error_out) {
 }
 
 bool cron_store_get_content(String &content_out, String &error_out) {
-  if (!SPIFFS.exists(CRON_FILENAME)) {
+  if (!FLASH_FS.exists(CRON_FILENAME)) {
     error_out = "cron.md does not exist";
     return false;
   }
 
-  File f = SPIFFS.open(CRON_FILENAME, "r");
+  File f = FLASH_FS.open(CRON_FILENAME, "r");
   if (!f) {
     error_out = "Failed to open cron.md";
     return false;
@@ -168,11 +327,11 @@ int cron_store_count() {
 // ============================================================================
 
 time_t cron_store_get_last_check() {
-  if (!SPIFFS.exists(LAST_CHECK_FILE)) {
+  if (!FLASH_FS.exists(LAST_CHECK_FILE)) {
     return 0;  // Never checked
   }
 
-  File f = SPIFFS.open(LAST_CHECK_FILE, "r");
+  File f = FLASH_FS.open(LAST_CHECK_FILE, "r");
   if (!f) {
     return 0;
   }
@@ -184,21 +343,21 @@ time_t cron_store_get_last_check() {
 }
 
 void cron_store_update_last_check(time_t timestamp) {
-  File f = SPIFFS.open(LAST_CHECK_FILE, "w");
+  // Written by the scheduler task and by cron_store_add on an agent worker
+  lock();
+  File f = FLASH_FS.open(LAST_CHECK_FILE, "w");
   if (f) {
     f.println((unsigned long)timestamp);
     f.close();
   }
-}
-
-// Helper: Check if a time is within a cron job's schedule
-static bool matches_schedule(const CronJob &job, struct tm *tm_time) {
-  return cron_should_trigger(job, tm_time->tm_hour, tm_time->tm_min,
-                            tm_time->tm_mday, tm_time->tm_mon + 1, tm_time->tm_wday);
+  unlock();
 }
 
 int cron_store_check_missed_jobs(time_t now, MissedJob *missed_jobs, int max_jobs) {
+  lock();
   time_t last_check = cron_store_get_last_check();
+  s_missed_checked = true;
+  unlock();
 
   // If never checked or last_check is invalid, no missed jobs to report
   if (last_check == 0 || last_check >= now) {
@@ -211,45 +370,40 @@ int cron_store_check_missed_jobs(time_t now, MissedJob *missed_jobs, int max_job
     last_check = now - MAX_LOOKBACK;
   }
 
-  int missed_count = 0;
-  const time_t CHECK_INTERVAL = 60;  // Check every minute
-
-  // Start from the next full minute boundary.
-  time_t t = (last_check / 60) * 60;
-  if (t <= last_check) {
-    t += CHECK_INTERVAL;
+  // Walk the fire times of every job in time order, merging them like the
+  // scheduler's heap does; a linear min is enough for CRON_MAX_JOBS entries.
+  time_t next[CRON_MAX_JOBS];
+  lock();
+  for (int i = 0; i < s_cached_count; i++) {
+    // Skip wildcard-only jobs (would trigger too often)
+    next[i] = s_entries[i].job.minute == -1 ? 0
+                                            : cron_next_fire(s_entries[i].schedule, last_check);
   }
 
-  // Iterate through time from last_check to now
-  for (; t <= now && missed_count < max_jobs; t += CHECK_INTERVAL) {
-    struct tm tm_check_storage{};
-    struct tm *tm_check = localtime_r(&t, &tm_check_storage);
-    if (!tm_check) {
-      continue;
-    }
-
-    // For each cron job, check if it should have triggered
-    for (int i = 0; i < s_cached_count && missed_count < max_jobs; i++) {
-      const CronJob &job = s_cached_jobs[i];
-
-      // Skip wildcard-only jobs (would trigger too often)
-      if (job.minute == -1) {
-        continue;  // Skip jobs with minute wildcard
-      }
-
-      // Check if this job should have triggered at this time
-      if (matches_schedule(job, tm_check)) {
-        // Found a missed job
-        missed_jobs[missed_count].command = job.command;
-        missed_jobs[missed_count].missed_hour = tm_check->tm_hour;
-        missed_jobs[missed_count].missed_minute = tm_check->tm_min;
-        missed_jobs[missed_count].missed_day = tm_check->tm_mday;
-        missed_jobs[missed_count].missed_month = tm_check->tm_mon + 1;
-        missed_jobs[missed_count].missed_weekday = tm_check->tm_wday;
-        missed_count++;
+  int missed_count = 0;
+  while (missed_count < max_jobs) {
+    int pick = -1;
+    for (int i = 0; i < s_cached_count; i++) {
+      if (next[i] != 0 && next[i] <= now && (pick < 0 || next[i] < next[pick])) {
+        pick = i;
       }
     }
+    if (pick < 0) {
+      break;
+    }
+
+    struct tm tm_check{};
+    localtime_r(&next[pick], &tm_check);
+    missed_jobs[missed_count].command = s_entries[pick].job.command;
+    missed_jobs[missed_count].missed_hour = tm_check.tm_hour;
+    missed_jobs[missed_count].missed_minute = tm_check.tm_min;
+    missed_jobs[missed_count].missed_day = tm_check.tm_mday;
+    missed_jobs[missed_count].missed_month = tm_check.tm_mon + 1;
+    missed_jobs[missed_count].missed_weekday = tm_check.tm_wday;
+    missed_count++;
+    next[pick] = cron_next_fire(s_entries[pick].schedule, next[pick]);
   }
+  unlock();
 
   if (missed_count > 0) {
     Serial.printf("[cron_store] Found %d missed job(s)\n", missed_count);
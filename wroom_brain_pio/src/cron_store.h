@@ -14,6 +14,18 @@ bool cron_store_add(const String &cron_line, String &error_out);
 // Returns number of jobs loaded
 int cron_store_get_all(CronJob *jobs, int max_jobs);
 
+// Commands of jobs due at or before now (epoch seconds), at most max_commands.
+// Each returned job is rescheduled to its next fire time after now. Schedules
+// are armed on the first call, so only call this once the clock is synced.
+int cron_store_take_due(time_t now, String *commands_out, int max_commands);
+
+// Earliest armed fire time (epoch seconds), or 0 when nothing is scheduled
+time_t cron_store_next_fire();
+
+// Drop armed fire times (e.g. after a timezone change); the next
+// cron_store_take_due() recomputes them
+void cron_store_rearm();
+
 // Clear all cron jobs from cron.md
 bool cron_store_clear(String &error_out);
 
@@ -6,6 +6,8 @@
 #include <WiFiClientSecure.h>
 
 #include "brain_config.h"
+#include "multipart_body.h"
+#include "wifi_link.h"
 
 namespace {
 
@@ -49,7 +51,7 @@ bool discord_send_message(const String &message, String &error_out) {
     return false;
   }
 
-  if (WiFi.status() != WL_CONNECTED) {
+  if (!wifi_link_ready()) {
     error_out = "WiFi not connected";
     return false;
   }
@@ -97,39 +99,43 @@ bool discord_send_web_files(const String &topic, const String &html, const Strin
     return false;
   }
 
-  if (WiFi.status() != WL_CONNECTED) {
+  if (!wifi_link_ready()) {
     error_out = "WiFi not connected";
     return false;
   }
 
-  // Create combined HTML file
-  String fullHtml = "<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n";
-  fullHtml += "  <meta charset=\"UTF-8\">\n";
-  fullHtml += "  <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n";
-  fullHtml += "  <title>" + (topic.length() > 0 ? topic : String("Generated Files")) + "</title>\n";
-  if (css.length() > 0) fullHtml += "  <style>\n" + css + "\n  </style>\n";
-  fullHtml += "</head>\n<body>\n";
-  if (html.length() > 0) fullHtml += html + "\n";
-  if (js.length() > 0) fullHtml += "<script>\n" + js + "\n</script>\n";
-  fullHtml += "</body>\n</html>";
-
-  // Build multipart/form-data payload
-  String boundary = "----TimiClawDiscordBoundary";
-  String body = "";
-
-  // Title Content
-  body += "--" + boundary + "\r\n";
-  body += "Content-Disposition: form-data; name=\"content\"\r\n\r\n";
-  body += "📄 Generated website files for: **" + (topic.length() > 0 ? topic : String("website")) + "**\r\n";
-
-  // Attached HTML File
-  body += "--" + boundary + "\r\n";
-  body += "Content-Disposition: form-data; name=\"file\"; filename=\"" + (topic.length() > 0 ? topic : String("website")) + ".html\"\r\n";
-  body += "Content-Type: text/html\r\n\r\n";
-  body += fullHtml + "\r\n";
-  
-  // Close Boundary
-  body += "--" + boundary + "--\r\n";
+  const String title = topic.length() > 0 ? topic : String("Generated Files");
+  const String name = topic.length() > 0 ? topic : String("website");
+
+  // The combined HTML file is streamed from html/css/js as the upload goes
+  // out instead of being assembled into one String first.
+  MultipartBody body;
+  body.field("content", "📄 Generated website files for: **" + name + "**");
+  body.begin_file("file", name + ".html", "text/html");
+  body.text("<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n"
+            "  <meta charset=\"UTF-8\">\n"
+            "  <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
+            "  <title>");
+  body.text(title);
+  body.text("</title>\n");
+  if (css.length() > 0) {
+    body.text("  <style>\n");
+    body.text(css);
+    body.text("\n  </style>\n");
+  }
+  body.text("</head>\n<body>\n");
+  if (html.length() > 0) {
+    body.text(html);
+    body.text("\n");
+  }
+  if (js.length() > 0) {
+    body.text("<script>\n");
+    body.text(js);
+    body.text("\n</script>\n");
+  }
+  body.text("</body>\n</html>");
+  body.end_file();
+  body.finish();
 
   WiFiClientSecure client;
   client.setInsecure();
@@ -142,9 +148,10 @@ bool discord_send_web_files(const String &topic, const String &html, const Strin
 
   https.setConnectTimeout(12000);
   https.setTimeout(25000);
-  https.addHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
+  https.addHeader("Content-Type", body.content_type());
 
-  int code = https.POST((uint8_t *)body.c_str(), body.length());
+  body.rewind();
+  int code = https.sendRequest("POST", &body, body.length());
   String resp_body;
   if (code > 0) {
     resp_body = https.getString();
@@ -4,11 +4,52 @@
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <HTTPClient.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <new>
 
 #include "brain_config.h"
+#include "chat_scope.h"
+#include "event_log.h"
+#include "metrics.h"
+#include "transport_telegram.h"
+#include "wifi_link.h"
 
 namespace {
 
+const uint32_t kTaskStack = 10240;
+const char *const kResendUrl = "https://api.resend.com/emails";
+
+struct OutgoingEmail {
+  String to;
+  String subject;
+  String html;
+  String text;
+  String chat;  // told when delivery fails
+};
+
+// Emails to one recipient collected since first_ms, and the distinct chats
+// they came from (each is told if the digest fails).
+struct Digest {
+  OutgoingEmail *parts[EMAIL_DIGEST_MAX_PARTS];
+  size_t count;
+  size_t bytes;
+  uint32_t first_ms;
+  String chats[EMAIL_DIGEST_MAX_PARTS];
+  size_t chat_count;
+};
+
+QueueHandle_t g_queue = nullptr;
+
+// One keep-alive connection to the Resend API, shared by the sender task and
+// email_send callers under g_send_lock.
+SemaphoreHandle_t g_send_lock = nullptr;
+WiFiClientSecure *g_client = nullptr;
+HTTPClient *g_https = nullptr;
+uint32_t g_last_used_ms = 0;
+
 static String json_escape(const String &src) {
   String out;
   out.reserve(src.length() * 1.2);
@@ -38,42 +79,51 @@ static String json_escape(const String &src) {
   return out;
 }
 
-struct HttpResult {
-  int status_code;
-  String body;
-};
-
-static HttpResult http_post_json(const String &url, const String &json_body,
-                                   const String &auth_header = "") {
-  HttpResult result;
-  result.status_code = -1;
-
-  WiFiClientSecure client;
-  client.setInsecure();
-
-  HTTPClient https;
-  if (!https.begin(client, url)) {
-    return result;
+String html_escape(const String &src) {
+  String out;
+  out.reserve(src.length() + 16);
+  for (size_t i = 0; i < src.length(); i++) {
+    const char c = src[i];
+    switch (c) {
+      case '&': out += "&amp;"; break;
+      case '<': out += "&lt;"; break;
+      case '>': out += "&gt;"; break;
+      default: out += c; break;
+    }
   }
+  return out;
+}
 
-  https.addHeader("Content-Type", "application/json");
-  if (auth_header.length() > 0) {
-    https.addHeader("Authorization", auth_header);
+// A full HTML document cut down to its <style> blocks and <body> content, so
+// several can share one digest without nesting <html> elements.
+String html_fragment(const String &html) {
+  String lc = html;
+  lc.toLowerCase();
+  const int body_tag = lc.indexOf("<body");
+  if (body_tag < 0) {
+    return html;
   }
-
-  const int code = https.POST(json_body);
-  result.status_code = code;
-  result.body = https.getString();
-
-  https.end();
-  return result;
+  String out;
+  int style = lc.indexOf("<style");
+  while (style >= 0 && style < body_tag) {
+    const int style_end = lc.indexOf("</style>", style);
+    if (style_end < 0) {
+      break;
+    }
+    out += html.substring(style, style_end + 8);
+    style = lc.indexOf("<style", style_end);
+  }
+  const int body_start = lc.indexOf('>', body_tag);
+  int body_end = lc.lastIndexOf("</body>");
+  if (body_end < body_start) {
+    body_end = html.length();
+  }
+  out += html.substring(body_start + 1, body_end);
+  return out;
 }
 
-}  // namespace
-
-bool email_send(const String &to, const String &subject, const String &html_content,
-                 const String &text_content, String &error_out) {
-
+bool check_fields(const String &to, const String &subject, const String &html_content,
+                  const String &text_content, String &error_out) {
   if (to.length() == 0 || subject.length() == 0) {
     error_out = "Missing required fields: to, subject";
     return false;
@@ -85,22 +135,68 @@ bool email_send(const String &to, const String &subject, const String &html_cont
   }
 
   // Resend API
-  const String api_key = String(RESEND_API_KEY);
-  if (api_key.length() == 0) {
+  if (strlen(RESEND_API_KEY) == 0) {
     error_out = "Missing RESEND_API_KEY in .env";
     return false;
   }
 
-  const String from_email = String(EMAIL_FROM);
-  if (from_email.length() == 0) {
+  if (strlen(EMAIL_FROM) == 0) {
     error_out = "Missing EMAIL_FROM in .env";
     return false;
   }
+  return true;
+}
+
+void conn_close() {
+  if (g_https) {
+    g_https->end();
+    delete g_https;
+    g_https = nullptr;
+  }
+  if (g_client) {
+    g_client->stop();
+    delete g_client;
+    g_client = nullptr;
+  }
+}
+
+// One POST on the shared connection. Call with g_send_lock held.
+int post_json(const String &json_body, String &response_out) {
+  if (g_client != nullptr && millis() - g_last_used_ms > EMAIL_CONN_IDLE_MS) {
+    conn_close();
+  }
+  if (g_client == nullptr) {
+    g_client = new WiFiClientSecure();
+    g_client->setInsecure();
+    g_https = new HTTPClient();
+    g_https->setReuse(true);
+  }
+  if (!g_https->begin(*g_client, kResendUrl)) {
+    conn_close();
+    return -1;
+  }
+  g_https->addHeader("Content-Type", "application/json");
+  g_https->addHeader("Authorization", String("Bearer ") + RESEND_API_KEY);
 
-  const String url = "https://api.resend.com/emails";
+  const int code = g_https->POST(json_body);
+  response_out = code > 0 ? g_https->getString() : g_https->errorToString(code);
+  // end() keeps the socket open when the server allowed keep-alive.
+  g_https->end();
+  if (code <= 0) {
+    conn_close();
+  }
+  g_last_used_ms = millis();
+  return code;
+}
 
-  String body = "{";
-  body += "\"from\":\"" + json_escape(from_email) + "\",";
+// Build the Resend request and POST it, retrying network errors, 429 and 5xx.
+bool deliver(const String &to, const String &subject, const String &html_content,
+             const String &text_content, String &error_out) {
+  String body;
+  body.reserve(html_content.length() + text_content.length() + to.length() + subject.length() +
+               128);
+  body = "{";
+  body += "\"from\":\"" + json_escape(EMAIL_FROM) + "\",";
   body += "\"to\":\"" + json_escape(to) + "\",";
   body += "\"subject\":\"" + json_escape(subject) + "\"";
 
@@ -114,15 +210,256 @@ bool email_send(const String &to, const String &subject, const String &html_cont
 
   body += "}";
 
-  const HttpResult res = http_post_json(url, body, "Bearer " + api_key);
+  uint32_t backoff_ms = EMAIL_RETRY_BACKOFF_MS;
+  for (int attempt = 0;; attempt++) {
+    if (!wifi_link_ready() && !wifi_link_wait(backoff_ms)) {
+      error_out = "WiFi not connected";
+    } else {
+      String response;
+      xSemaphoreTake(g_send_lock, portMAX_DELAY);
+      const int code = post_json(body, response);
+      xSemaphoreGive(g_send_lock);
+      if (code >= 200 && code < 300) {
+        return true;
+      }
+      error_out = "Resend HTTP " + String(code);
+      if (response.length() > 0) {
+        error_out += ": " + response.substring(0, 100);
+      }
+      if (code > 0 && code != 429 && code < 500) {
+        return false;
+      }
+    }
+    if (attempt >= EMAIL_SEND_RETRIES) {
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+    backoff_ms *= 2;
+  }
+}
+
+// One email as it came, or several merged: each gets its subject as a
+// heading, and text-only parts go into the HTML version as <pre>.
+void send_digest(Digest &d) {
+  const OutgoingEmail &first = *d.parts[0];
+  String subject = first.subject;
+  String html;
+  String text;
+  if (d.count == 1) {
+    html = first.html;
+    text = first.text;
+  } else {
+    subject += " (+" + String((unsigned)(d.count - 1)) + " more)";
+    bool any_html = false;
+    for (size_t i = 0; i < d.count; i++) {
+      any_html = any_html || d.parts[i]->html.length() > 0;
+    }
+    if (any_html) {
+      html.reserve(d.bytes + 64 * d.count);
+    }
+    text.reserve(d.bytes / 2 + 64 * d.count);
+    for (size_t i = 0; i < d.count; i++) {
+      const OutgoingEmail &part = *d.parts[i];
+      if (any_html) {
+        html += "<h2>" + html_escape(part.subject) + "</h2>\n";
+        html += part.html.length() > 0 ? html_fragment(part.html)
+                                       : "<pre>" + html_escape(part.text) + "</pre>";
+        html += "\n<hr>\n";
+      }
+      text += "======== " + part.subject + " ========\n\n";
+      text += part.text.length() > 0 ? part.text : String("(see the HTML version)");
+      text += "\n\n";
+    }
+  }
+
+  String err;
+  if (deliver(first.to, subject, html, text, err)) {
+    event_log_printf(EVT_EMAIL, "sent to=%s parts=%u bytes=%u", first.to.c_str(),
+                     (unsigned)d.count, (unsigned)d.bytes);
+  } else {
+    Serial.println("[email] send failed: " + err);
+    event_log_printf(EVT_EMAIL, "failed to=%s parts=%u %s", first.to.c_str(), (unsigned)d.count,
+                     err.c_str());
+    // Each chat hears only about its own emails
+    for (size_t c = 0; c < d.chat_count; c++) {
+      String subjects;
+      for (size_t i = 0; i < d.count; i++) {
+        if (d.parts[i]->chat == d.chats[c]) {
+          subjects += (subjects.length() > 0 ? ", \"" : "\"") + d.parts[i]->subject + "\"";
+        }
+      }
+      chat_scope_bind(d.chats[c]);
+      transport_telegram_send("⚠️ Email to " + first.to + " (" + subjects + ") failed: " + err);
+    }
+    chat_scope_bind("");
+  }
+
+  for (size_t i = 0; i < d.count; i++) {
+    delete d.parts[i];
+    d.parts[i] = nullptr;
+  }
+  for (size_t c = 0; c < d.chat_count; c++) {
+    d.chats[c] = "";
+  }
+  d.count = 0;
+  d.bytes = 0;
+  d.chat_count = 0;
+}
+
+size_t email_bytes(const OutgoingEmail &email) {
+  return email.html.length() + email.text.length();
+}
+
+void digest_add(Digest &d, OutgoingEmail *email, size_t bytes) {
+  d.parts[d.count++] = email;
+  d.bytes += bytes;
+  for (size_t c = 0; c < d.chat_count; c++) {
+    if (d.chats[c] == email->chat) {
+      return;
+    }
+  }
+  d.chats[d.chat_count++] = email->chat;
+}
+
+// Add to the open digest for the same recipient when it has room. When every
+// digest is in use the oldest is sent first to make one free.
+void collect(Digest *digests, OutgoingEmail *email) {
+  const size_t bytes = email_bytes(*email);
+  Digest *slot = nullptr;
+  Digest *oldest = nullptr;
+  for (size_t i = 0; i < EMAIL_QUEUE_DEPTH; i++) {
+    Digest &d = digests[i];
+    if (d.count == 0) {
+      if (slot == nullptr) {
+        slot = &d;
+      }
+      continue;
+    }
+    if (d.parts[0]->to.equalsIgnoreCase(email->to)) {
+      if (d.count < EMAIL_DIGEST_MAX_PARTS && d.bytes + bytes <= EMAIL_DIGEST_MAX_BYTES) {
+        digest_add(d, email, bytes);
+        return;
+      }
+      // Full: send it now and start a new one for this recipient
+      send_digest(d);
+      slot = &d;
+      break;
+    }
+    if (oldest == nullptr || (int32_t)(d.first_ms - oldest->first_ms) < 0) {
+      oldest = &d;
+    }
+  }
+  if (slot == nullptr) {
+    send_digest(*oldest);
+    slot = oldest;
+  }
+  slot->first_ms = millis();
+  digest_add(*slot, email, bytes);
+}
+
+void email_task(void *param) {
+  (void)param;
+  static Digest digests[EMAIL_QUEUE_DEPTH] = {};
+  while (true) {
+    // Sleep until the next digest is due, or until the idle connection
+    // should be closed, or for good when there is neither.
+    const uint32_t now = millis();
+    TickType_t wait = portMAX_DELAY;
+    for (size_t i = 0; i < EMAIL_QUEUE_DEPTH; i++) {
+      if (digests[i].count == 0) {
+        continue;
+      }
+      const uint32_t age = now - digests[i].first_ms;
+      const uint32_t left = age >= EMAIL_DIGEST_WINDOW_MS ? 0 : EMAIL_DIGEST_WINDOW_MS - age;
+      wait = min(wait, pdMS_TO_TICKS(left));
+    }
+    if (wait == portMAX_DELAY && g_client != nullptr) {
+      const uint32_t idle = now - g_last_used_ms;
+      wait = pdMS_TO_TICKS(idle >= EMAIL_CONN_IDLE_MS ? 0 : EMAIL_CONN_IDLE_MS - idle);
+    }
+
+    OutgoingEmail *email = nullptr;
+    if (xQueueReceive(g_queue, &email, wait) == pdTRUE) {
+      collect(digests, email);
+    }
+
+    for (size_t i = 0; i < EMAIL_QUEUE_DEPTH; i++) {
+      if (digests[i].count > 0 && millis() - digests[i].first_ms >= EMAIL_DIGEST_WINDOW_MS) {
+        send_digest(digests[i]);
+      }
+    }
 
-  if (res.status_code < 200 || res.status_code >= 300) {
-    error_out = "Resend HTTP " + String(res.status_code);
-    if (res.body.length() > 0) {
-      error_out += ": " + res.body.substring(0, 100);
+    xSemaphoreTake(g_send_lock, portMAX_DELAY);
+    if (g_client != nullptr && millis() - g_last_used_ms >= EMAIL_CONN_IDLE_MS) {
+      conn_close();
     }
+    xSemaphoreGive(g_send_lock);
+  }
+}
+
+}  // namespace
+
+void email_client_init() {
+  if (g_send_lock != nullptr) {
+    return;
+  }
+  g_send_lock = xSemaphoreCreateMutex();
+  if (strlen(RESEND_API_KEY) == 0) {
+    return;
+  }
+  g_queue = xQueueCreate(EMAIL_QUEUE_DEPTH, sizeof(OutgoingEmail *));
+  if (g_queue == nullptr) {
+    Serial.println("[email] queue alloc failed");
+    return;
+  }
+  // Delivery is never on the reply path, so it only gets idle time
+  TaskHandle_t task = nullptr;
+  if (xTaskCreatePinnedToCore(email_task, "EmailOut", kTaskStack, NULL, TASK_PRIO_BACKGROUND,
+                              &task, TASK_CORE_NET) != pdPASS) {
+    vQueueDelete(g_queue);
+    g_queue = nullptr;
+    Serial.println("[email] sender task failed");
+    return;
+  }
+  metrics_register_task(task, kTaskStack);
+}
+
+bool email_queue(const String &to, const String &subject, const String &html_content,
+                 const String &text_content, String &error_out) {
+  if (!check_fields(to, subject, html_content, text_content, error_out)) {
+    return false;
+  }
+  if (g_queue == nullptr) {
+    error_out = "Email sender not running";
     return false;
   }
 
+  OutgoingEmail *email = new (std::nothrow) OutgoingEmail();
+  if (email == nullptr) {
+    error_out = "Out of memory";
+    return false;
+  }
+  email->to = to;
+  email->subject = subject;
+  email->html = html_content;
+  email->text = text_content;
+  email->chat = chat_scope_current();
+  if (xQueueSend(g_queue, &email, 0) != pdTRUE) {
+    delete email;
+    error_out = "Email queue full, try again shortly";
+    return false;
+  }
   return true;
 }
+
+bool email_send(const String &to, const String &subject, const String &html_content,
+                 const String &text_content, String &error_out) {
+  if (!check_fields(to, subject, html_content, text_content, error_out)) {
+    return false;
+  }
+  if (g_send_lock == nullptr) {
+    error_out = "Email sender not running";
+    return false;
+  }
+  return deliver(to, subject, html_content, text_content, error_out);
+}
@@ -3,6 +3,22 @@
 
 #include <Arduino.h>
 
+// Outgoing email through the Resend API. email_queue hands a message to a
+// background sender so the agent task never waits on delivery. Emails to the
+// same recipient within EMAIL_DIGEST_WINDOW_MS go out as one digest, and every
+// send reuses one keep-alive TLS connection.
+
+// Start the sender task; a no-op without RESEND_API_KEY.
+void email_client_init();
+
+// Check the fields and configuration, then queue the email. The chat serving
+// the caller is told if delivery fails later. False when invalid or the
+// queue is full.
+bool email_queue(const String &to, const String &subject, const String &html_content,
+                 const String &text_content, String &error_out);
+
+// Send now on the calling task, over the same connection, for callers that
+// need the delivery result.
 bool email_send(const String &to, const String &subject, const String &html_content,
                  const String &text_content, String &error_out);
 
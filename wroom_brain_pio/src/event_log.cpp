@@ -1,65 +1,410 @@
 #include "event_log.h"
 
 #include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "flash_fs.h"
 
 namespace {
 
-static const int kMaxEntries = 40;
-String g_entries[kMaxEntries];
-int g_head = 0;
-int g_count = 0;
+const char *const kCodeNames[EVT_CODE_COUNT] = {
+    "",        "BOOT",  "IN",      "OUT",   "ROUTE",      "ReAct", "SCHED",   "REMINDER",
+    "WEBJOB", "WEBFILES", "EMAIL", "DISCORD", "USAGE", "AUTO_LEARN", "PC", "SPOOL",
+    "SOAK",
+};
+
+const uint32_t kRingMagic = 0x45564C47;  // "EVLG"
+
+// RAM ring, slot = seq % EVENT_LOG_RAM_RECORDS. It lives in .noinit memory,
+// which survives software and panic resets (not power loss), so whatever
+// was logged after the last flush before a crash is written out on the next
+// boot.
+struct RamRing {
+  uint32_t magic;
+  uint32_t next_seq;     // seq of the next record
+  uint32_t flushed_seq;  // every record up to this one is in flash
+  uint16_t boot;
+  EventRecord records[EVENT_LOG_RAM_RECORDS];
+};
+
+__NOINIT_ATTR RamRing g_ring;
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+SemaphoreHandle_t g_flash_lock = nullptr;
+bool g_flash_ready = false;
+uint32_t g_last_flush_ms = 0;
+uint32_t g_dropped = 0;  // overwritten in RAM before they could be flushed
+
+const size_t kFileBytes = sizeof(EventRecord) * EVENT_LOG_FLASH_RECORDS;
+
+size_t flash_offset(uint32_t seq) {
+  return (size_t)(seq % EVENT_LOG_FLASH_RECORDS) * sizeof(EventRecord);
+}
 
-String sanitize_line(const String &in) {
-  String out = in;
-  out.replace('\r', ' ');
-  out.replace('\n', ' ');
-  out.trim();
-  if (out.length() > 180) {
-    out = out.substring(0, 180) + "...";
+bool lock_flash() {
+  return g_flash_lock != nullptr && xSemaphoreTake(g_flash_lock, pdMS_TO_TICKS(500)) == pdTRUE;
+}
+
+void unlock_flash() {
+  xSemaphoreGive(g_flash_lock);
+}
+
+bool write_empty_file() {
+  File f = FLASH_FS.open(EVENT_LOG_PATH, FILE_WRITE);
+  if (!f) {
+    return false;
+  }
+  EventRecord blank;
+  memset(&blank, 0, sizeof(blank));
+  bool ok = true;
+  for (size_t i = 0; i < EVENT_LOG_FLASH_RECORDS && ok; i++) {
+    ok = f.write((const uint8_t *)&blank, sizeof(blank)) == sizeof(blank);
   }
-  return out;
+  f.close();
+  return ok;
+}
+
+// Highest seq in the file and the boot it belongs to.
+bool scan_file(uint32_t &max_seq, uint16_t &boot) {
+  max_seq = 0;
+  boot = 0;
+  File f = FLASH_FS.open(EVENT_LOG_PATH, FILE_READ);
+  if (!f || f.size() != kFileBytes) {
+    return false;
+  }
+  EventRecord rec;
+  while (f.read((uint8_t *)&rec, sizeof(rec)) == sizeof(rec)) {
+    if (rec.magic == EVENT_RECORD_MAGIC && rec.seq > max_seq) {
+      max_seq = rec.seq;
+      boot = rec.boot;
+    }
+  }
+  f.close();
+  return true;
+}
+
+// Caller holds g_flash_lock.
+void flush_locked() {
+  if (!g_flash_ready) {
+    return;
+  }
+  portENTER_CRITICAL(&g_mux);
+  uint32_t from = g_ring.flushed_seq + 1;
+  const uint32_t to = g_ring.next_seq - 1;
+  portEXIT_CRITICAL(&g_mux);
+  if (to < from) {
+    return;
+  }
+  if (to - from >= EVENT_LOG_RAM_RECORDS) {
+    from = to - EVENT_LOG_RAM_RECORDS + 1;
+  }
+
+  File f = FLASH_FS.open(EVENT_LOG_PATH, "r+");
+  if (!f) {
+    return;
+  }
+  EventRecord rec;
+  for (uint32_t seq = from; seq <= to; seq++) {
+    portENTER_CRITICAL(&g_mux);
+    rec = g_ring.records[seq % EVENT_LOG_RAM_RECORDS];
+    portEXIT_CRITICAL(&g_mux);
+    if (rec.magic != EVENT_RECORD_MAGIC || rec.seq != seq) {
+      continue;  // overwritten meanwhile
+    }
+    f.seek(flash_offset(seq));
+    f.write((const uint8_t *)&rec, sizeof(rec));
+  }
+  f.close();
+
+  portENTER_CRITICAL(&g_mux);
+  g_ring.flushed_seq = to;
+  portEXIT_CRITICAL(&g_mux);
+  g_last_flush_ms = millis();
+}
+
+// Visit flash records oldest first (or newest first); cb returns false to stop.
+typedef bool (*visit_cb_t)(const EventRecord &rec, void *ctx);
+
+void visit_flash(bool newest_first, visit_cb_t cb, void *ctx) {
+  if (!lock_flash()) {
+    return;
+  }
+  flush_locked();
+  portENTER_CRITICAL(&g_mux);
+  const uint32_t next_seq = g_ring.next_seq;
+  portEXIT_CRITICAL(&g_mux);
+
+  File f = FLASH_FS.open(EVENT_LOG_PATH, FILE_READ);
+  if (f) {
+    EventRecord rec;
+    for (uint32_t i = 0; i < EVENT_LOG_FLASH_RECORDS; i++) {
+      const uint32_t seq = newest_first ? next_seq - 1 - i : next_seq + i;
+      f.seek(flash_offset(seq));
+      if (f.read((uint8_t *)&rec, sizeof(rec)) != sizeof(rec)) {
+        break;
+      }
+      if (rec.magic != EVENT_RECORD_MAGIC) {
+        continue;
+      }
+      if (!cb(rec, ctx)) {
+        break;
+      }
+    }
+    f.close();
+  }
+  unlock_flash();
+}
+
+// Without flash only the RAM ring is available.
+void visit_ram(bool newest_first, visit_cb_t cb, void *ctx) {
+  portENTER_CRITICAL(&g_mux);
+  const uint32_t next_seq = g_ring.next_seq;
+  portEXIT_CRITICAL(&g_mux);
+  EventRecord rec;
+  for (uint32_t i = 0; i < EVENT_LOG_RAM_RECORDS; i++) {
+    const uint32_t seq = newest_first ? next_seq - 1 - i : next_seq + i;
+    portENTER_CRITICAL(&g_mux);
+    rec = g_ring.records[seq % EVENT_LOG_RAM_RECORDS];
+    portEXIT_CRITICAL(&g_mux);
+    if (rec.magic == EVENT_RECORD_MAGIC && !cb(rec, ctx)) {
+      break;
+    }
+  }
+}
+
+void visit(bool newest_first, visit_cb_t cb, void *ctx) {
+  if (g_flash_ready) {
+    visit_flash(newest_first, cb, ctx);
+  } else {
+    visit_ram(newest_first, cb, ctx);
+  }
+}
+
+const char *reset_reason_name(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON: return "power-on";
+    case ESP_RST_EXT: return "external reset";
+    case ESP_RST_SW: return "software restart";
+    case ESP_RST_PANIC: return "panic";
+    case ESP_RST_INT_WDT: return "interrupt watchdog";
+    case ESP_RST_TASK_WDT: return "task watchdog";
+    case ESP_RST_WDT: return "watchdog";
+    case ESP_RST_DEEPSLEEP: return "deep sleep wake";
+    case ESP_RST_BROWNOUT: return "brownout";
+    default: return "unknown";
+  }
+}
+
+void on_shutdown() {
+  event_log_flush();
 }
 
 }  // namespace
 
 void event_log_init() {
-  g_head = 0;
-  g_count = 0;
+  if (g_flash_lock != nullptr) {
+    return;
+  }
+  g_flash_lock = xSemaphoreCreateMutex();
+
+  const bool survived = g_ring.magic == kRingMagic && g_ring.flushed_seq < g_ring.next_seq;
+  if (!survived) {
+    memset(&g_ring, 0, sizeof(g_ring));
+    g_ring.magic = kRingMagic;
+    g_ring.next_seq = 1;
+  }
+  const uint32_t unflushed = g_ring.next_seq - 1 - g_ring.flushed_seq;
+
+  uint32_t flash_seq = 0;
+  uint16_t flash_boot = 0;
+  if (flash_fs_begin()) {
+    g_flash_ready = scan_file(flash_seq, flash_boot) || (write_empty_file() && scan_file(flash_seq, flash_boot));
+  }
+  if (g_flash_ready && survived) {
+    // Records from just before the reset, still in their original boot
+    lock_flash();
+    flush_locked();
+    unlock_flash();
+  }
+
+  g_ring.boot = (uint16_t)(max(flash_boot, g_ring.boot) + 1);
+  if (flash_seq >= g_ring.next_seq) {
+    g_ring.next_seq = flash_seq + 1;
+  }
+  g_ring.flushed_seq = g_ring.next_seq - 1;
+  g_last_flush_ms = millis();
+  esp_register_shutdown_handler(on_shutdown);
+
+  event_log_printf(EVT_BOOT, "boot %u, reset: %s%s", (unsigned)g_ring.boot,
+                   reset_reason_name(esp_reset_reason()),
+                   survived && unflushed > 0 ? ", recovered unflushed records" : "");
+  Serial.printf("[events] boot %u, %s\n", (unsigned)g_ring.boot,
+                g_flash_ready ? "flash log ready" : "RAM only (flash log unavailable)");
+}
+
+void event_log_record(EventCode code, const char *text) {
+  EventRecord rec;
+  rec.magic = EVENT_RECORD_MAGIC;
+  rec.code = (uint8_t)code;
+  rec.uptime_s = millis() / 1000UL;
+  const time_t now = time(nullptr);
+  rec.epoch = now > 1700000000 ? (uint32_t)now : 0;
+
+  // Copy with newlines flattened and surrounding spaces trimmed
+  size_t len = 0;
+  const char *p = text != nullptr ? text : "";
+  while (*p == ' ' || *p == '\r' || *p == '\n' || *p == '\t') {
+    p++;
+  }
+  for (; *p != '\0' && len < sizeof(rec.text) - 1; p++) {
+    rec.text[len++] = (*p == '\r' || *p == '\n') ? ' ' : *p;
+  }
+  if (*p != '\0' && len >= 3) {
+    memcpy(rec.text + len - 3, "...", 3);
+  }
+  while (len > 0 && rec.text[len - 1] == ' ') {
+    len--;
+  }
+  rec.text[len] = '\0';
+
+  portENTER_CRITICAL(&g_mux);
+  rec.seq = g_ring.next_seq++;
+  rec.boot = g_ring.boot;
+  if (g_flash_ready && rec.seq - g_ring.flushed_seq > EVENT_LOG_RAM_RECORDS) {
+    g_dropped++;
+  }
+  g_ring.records[rec.seq % EVENT_LOG_RAM_RECORDS] = rec;
+  portEXIT_CRITICAL(&g_mux);
+}
+
+void event_log_printf(EventCode code, const char *fmt, ...) {
+  char buf[EVENT_LOG_TEXT_CHARS + 1];
+  va_list args;
+  va_start(args, fmt);
+  // One byte more than a record holds, so event_log_record sees the cut
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  event_log_record(code, buf);
 }
 
 void event_log_append(const String &line) {
-  String entry = String("[") + String(millis() / 1000UL) + "s] " + sanitize_line(line);
+  event_log_record(EVT_TEXT, line.c_str());
+}
 
-  if (g_count < kMaxEntries) {
-    int idx = (g_head + g_count) % kMaxEntries;
-    g_entries[idx] = entry;
-    g_count++;
+void event_log_tick() {
+  if (!g_flash_ready || millis() - g_last_flush_ms < EVENT_LOG_FLUSH_MS) {
     return;
   }
+  portENTER_CRITICAL(&g_mux);
+  const bool pending = g_ring.next_seq - 1 > g_ring.flushed_seq;
+  portEXIT_CRITICAL(&g_mux);
+  if (pending) {
+    event_log_flush();
+  } else {
+    g_last_flush_ms = millis();
+  }
+}
 
-  g_entries[g_head] = entry;
-  g_head = (g_head + 1) % kMaxEntries;
+void event_log_flush() {
+  if (!lock_flash()) {
+    return;
+  }
+  flush_locked();
+  unlock_flash();
 }
 
 void event_log_clear() {
-  g_head = 0;
-  g_count = 0;
+  portENTER_CRITICAL(&g_mux);
+  for (size_t i = 0; i < EVENT_LOG_RAM_RECORDS; i++) {
+    g_ring.records[i].magic = 0;
+  }
+  g_ring.flushed_seq = g_ring.next_seq - 1;
+  g_dropped = 0;
+  portEXIT_CRITICAL(&g_mux);
+  if (g_flash_ready && lock_flash()) {
+    write_empty_file();
+    unlock_flash();
+  }
 }
 
-void event_log_dump(String &out, size_t max_chars) {
-  if (g_count == 0) {
-    out = "Logs are empty";
-    return;
+namespace {
+
+struct ReadCtx {
+  uint32_t after_seq;
+  EventRecord *out;
+  size_t max;
+  size_t count;
+};
+
+bool read_cb(const EventRecord &rec, void *ctx) {
+  ReadCtx *c = (ReadCtx *)ctx;
+  if (rec.seq > c->after_seq) {
+    c->out[c->count++] = rec;
+  }
+  return c->count < c->max;
+}
+
+struct DumpCtx {
+  String *out;
+  size_t max_chars;
+};
+
+bool dump_cb(const EventRecord &rec, void *ctx) {
+  DumpCtx *c = (DumpCtx *)ctx;
+  char line[EVENT_LOG_TEXT_CHARS + 48];
+  event_log_format(rec, line, sizeof(line));
+  const size_t len = strlen(line) + 1;
+  if (c->out->length() + len > c->max_chars && c->out->length() > 0) {
+    return false;
+  }
+  // Newest first, so each older line goes in front
+  *c->out = String(line) + "\n" + *c->out;
+  return true;
+}
+
+}  // namespace
+
+size_t event_log_read(uint32_t after_seq, EventRecord *out, size_t max_records) {
+  if (out == nullptr || max_records == 0) {
+    return 0;
   }
+  ReadCtx ctx = {after_seq, out, max_records, 0};
+  visit(false, read_cb, &ctx);
+  return ctx.count;
+}
+
+const char *event_log_code_name(uint8_t code) {
+  return code < EVT_CODE_COUNT ? kCodeNames[code] : "?";
+}
 
-  out = "Logs:\n";
-  for (int i = 0; i < g_count; i++) {
-    int idx = (g_head + i) % kMaxEntries;
-    out += g_entries[idx];
-    out += '\n';
+void event_log_format(const EventRecord &rec, char *buf, size_t cap) {
+  char when[16] = "";
+  if (rec.epoch != 0) {
+    const time_t t = (time_t)rec.epoch;
+    struct tm tm_local{};
+    localtime_r(&t, &tm_local);
+    strftime(when, sizeof(when), " %m-%d %H:%M", &tm_local);
   }
+  const char *name = event_log_code_name(rec.code);
+  snprintf(buf, cap, "[b%u %lus%s] %s%s%s", (unsigned)rec.boot, (unsigned long)rec.uptime_s, when,
+           name, name[0] != '\0' ? ": " : "", rec.text);
+}
 
-  if (out.length() > max_chars) {
-    out = out.substring(out.length() - max_chars);
+void event_log_dump(String &out, size_t max_chars) {
+  const size_t kHeader = 6;  // "Logs:\n"
+  String body;
+  DumpCtx ctx = {&body, max_chars > kHeader ? max_chars - kHeader : max_chars};
+  visit(true, dump_cb, &ctx);
+  if (body.length() == 0) {
+    out = "Logs are empty";
+    return;
+  }
+  out = "Logs:\n" + body;
+  if (g_dropped > 0) {
+    out += "(" + String(g_dropped) + " records dropped before reaching flash)\n";
   }
 }
@@ -3,9 +3,72 @@
 
 #include <Arduino.h>
 
+#include "brain_config.h"
+
+// Fixed-size binary event records. New records go into a preallocated RAM
+// ring (kept in .noinit memory so a panic reset does not wipe it) and are
+// copied every EVENT_LOG_FLUSH_MS into a circular file of
+// EVENT_LOG_FLASH_RECORDS slots on the flash filesystem, so the log from
+// before a crash or reboot is still there afterwards. Appending never
+// allocates.
+
+enum EventCode : uint8_t {
+  EVT_TEXT = 0,  // free-form line from event_log_append
+  EVT_BOOT,      // payload: reset reason
+  EVT_IN,
+  EVT_OUT,
+  EVT_ROUTE,
+  EVT_REACT,
+  EVT_SCHED,
+  EVT_REMINDER,
+  EVT_WEBJOB,
+  EVT_WEBFILES,
+  EVT_EMAIL,
+  EVT_DISCORD,
+  EVT_USAGE,
+  EVT_AUTO_LEARN,
+  EVT_PC,
+  EVT_SPOOL,
+  EVT_SOAK,
+  EVT_CODE_COUNT
+};
+
+struct EventRecord {
+  uint8_t magic;  // EVENT_RECORD_MAGIC when the slot holds a record
+  uint8_t code;   // EventCode
+  uint16_t boot;  // boot number the record was written in
+  uint32_t seq;   // increases across boots
+  uint32_t uptime_s;
+  uint32_t epoch;  // wall clock, 0 before NTP sync
+  char text[EVENT_LOG_TEXT_CHARS];
+};
+
+#define EVENT_RECORD_MAGIC 0xE7
+
 void event_log_init();
+
+void event_log_record(EventCode code, const char *text);
+void event_log_printf(EventCode code, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+// Free-form line (EVT_TEXT).
 void event_log_append(const String &line);
+
+// Write unflushed records to flash. event_log_tick() does it on the timer;
+// it also runs from the restart shutdown handler and before OTA.
+void event_log_tick();
+void event_log_flush();
+
 void event_log_clear();
+
+// Records with seq > after_seq, oldest first, from flash (current ones are
+// flushed first). Returns the count written to out.
+size_t event_log_read(uint32_t after_seq, EventRecord *out, size_t max_records);
+
+// "[b3 512s 10-14 09:12] SCHED: reminder_run" (no newline).
+void event_log_format(const EventRecord &rec, char *buf, size_t cap);
+const char *event_log_code_name(uint8_t code);
+
+// Newest records that fit in max_chars, across boots.
 void event_log_dump(String &out, size_t max_chars);
 
 #endif
@@ -1,7 +1,9 @@
 #include "file_memory.h"
 
 #include <Arduino.h>
-#include <SPIFFS.h>
+#include <freertos/semphr.h>
+#include <math.h>
+#include <time.h>
 
 #if ENABLE_SD_CARD
 #include <SD.h>
@@ -9,19 +11,42 @@
 #endif
 
 #include "brain_config.h"
+#include "context_cache.h"
+#include "flash_fs.h"
+#include "gzip_codec.h"
+#include "psram_alloc.h"
+#include "web_server.h"
 
 namespace {
 
 // File backend type
 enum class FileBackend {
   NONE,
-  SPIFFS,
+  FLASH,  // internal SPIFFS or LittleFS, see flash_fs.h
   SD_CARD
 };
 
 FileBackend g_backend = FileBackend::NONE;
 bool g_backend_ready = false;
 
+// Both agent lanes, the Telegram poll task and the web server reach these
+// files. Recursive because the public calls below use one another.
+SemaphoreHandle_t g_lock = nullptr;
+
+class MemoryLock {
+ public:
+  MemoryLock() {
+    if (g_lock != nullptr) {
+      xSemaphoreTakeRecursive(g_lock, portMAX_DELAY);
+    }
+  }
+  ~MemoryLock() {
+    if (g_lock != nullptr) {
+      xSemaphoreGiveRecursive(g_lock);
+    }
+  }
+};
+
 #if ENABLE_SD_CARD
 // SD card configuration - common ESP32 pinout
 #define SD_CS 5
@@ -43,9 +68,58 @@ const char *kHeartbeatPath = "/config/HEARTBEART.md";
 
 // Maximum file sizes
 const size_t kMaxLongTermMemory = 8192;
-const size_t kMaxDailyMemory = 4096;
+const size_t kMaxDailyMemory = 4096;  // per day file
 const size_t kMaxSoulSize = 2048;
+
+// Session logs are append-only segments /sessions/tg_<chat>.<seq>.jsonl of
+// kSessionSegmentMsgs records each. A 12-byte tg_<chat>.idx names the live
+// segment range; trimming deletes the oldest segment whole, so between
+// kMaxSessionMsgs and kMaxSessionMsgs + kSessionSegmentMsgs records are kept.
 const size_t kMaxSessionMsgs = 20;
+const uint32_t kSessionSegmentMsgs = 10;
+const uint32_t kSessionIndexMagic = 0x53455331;  // "SES1"
+
+// Daily notes live in /memory/daily_<YYYYMMDD>.md (TODAY.md until the clock
+// is synced). Each note appends one DailyNoteRecord to the matching .idx file:
+// its offset and length in the .md plus a 128-bit bloom of its words, so
+// recall reads only the notes that can match instead of whole files.
+struct DailyNoteRecord {
+  uint32_t offset;
+  uint16_t length;
+  uint16_t reserved;
+  uint32_t bloom[4];
+};
+
+const size_t kMinTermChars = 3;
+
+// BM25 chunk index over MEMORY.md and USER.md in /memory/recall.idx, one
+// ChunkRecord per non-empty line followed by its term hashes and counts.
+// Rebuilt at boot and after a rewrite of either file; appends add records.
+const char *kRecallIndexPath = "/memory/recall.idx";
+const size_t kChunkMaxTerms = 48;
+
+enum ChunkSource : uint8_t {
+  CHUNK_MEMORY = 0,
+  CHUNK_USER = 1,
+};
+
+struct ChunkRecord {
+  uint8_t source;
+  uint8_t unique_terms;
+  uint16_t length;       // chars of the line at offset
+  uint32_t offset;
+  uint16_t total_terms;  // BM25 document length
+  uint16_t reserved;
+};
+
+bool g_recall_dirty = true;
+
+struct SessionIndex {
+  uint32_t magic;
+  uint16_t first_seg;
+  uint16_t last_seg;
+  uint32_t last_count;  // records in last_seg
+};
 
 // Wrapper functions for filesystem operations
 bool fs_exists(const char *path) {
@@ -54,7 +128,7 @@ bool fs_exists(const char *path) {
     return SD.exists(path);
   }
 #endif
-  return SPIFFS.exists(path);
+  return FLASH_FS.exists(path);
 }
 
 bool fs_mkdir(const char *path) {
@@ -63,7 +137,7 @@ bool fs_mkdir(const char *path) {
     return SD.mkdir(path);
   }
 #endif
-  return SPIFFS.mkdir(path);
+  return FLASH_FS.mkdir(path);
 }
 
 bool fs_remove(const char *path) {
@@ -72,7 +146,18 @@ bool fs_remove(const char *path) {
     return SD.remove(path);
   }
 #endif
-  return SPIFFS.remove(path);
+  web_server_invalidate_etags();
+  return FLASH_FS.remove(path);
+}
+
+bool fs_rename(const char *from, const char *to) {
+#if ENABLE_SD_CARD
+  if (g_backend == FileBackend::SD_CARD) {
+    return SD.rename(from, to);
+  }
+#endif
+  web_server_invalidate_etags();
+  return FLASH_FS.rename(from, to);
 }
 
 fs::File fs_open(const char *path, const char *mode) {
@@ -81,7 +166,12 @@ fs::File fs_open(const char *path, const char *mode) {
     return SD.open(path, mode);
   }
 #endif
-  return SPIFFS.open(path, mode);
+  if (mode[0] != 'r') {
+    // LittleFS does not create parent directories on open
+    flash_fs_mkdirs(path);
+    web_server_invalidate_etags();
+  }
+  return FLASH_FS.open(path, mode);
 }
 
 uint64_t fs_used_bytes() {
@@ -92,7 +182,7 @@ uint64_t fs_used_bytes() {
     return SD.cardSize() > 0 ? (SD.cardSize() - SD.totalBytes()) : 0;
   }
 #endif
-  return SPIFFS.usedBytes();
+  return FLASH_FS.usedBytes();
 }
 
 uint64_t fs_total_bytes() {
@@ -102,7 +192,7 @@ uint64_t fs_total_bytes() {
     return cardSize > 0 ? cardSize : 0;
   }
 #endif
-  return SPIFFS.totalBytes();
+  return FLASH_FS.totalBytes();
 }
 
 String fs_backend_name() {
@@ -111,7 +201,7 @@ String fs_backend_name() {
     return "SD Card";
   }
 #endif
-  return "SPIFFS";
+  return FLASH_FS_NAME;
 }
 
 bool ensure_directories() {
@@ -142,15 +232,417 @@ bool ensure_directories() {
   return true;
 }
 
-String get_daily_path() {
-  // Get current date (simplified - would need NTP for real date)
-  // For now, use a fixed "today" file
-  return String("/memory/TODAY.md");
+String session_base(const String &chat_id) {
+  return String(kSessionsDir) + "/tg_" + chat_id;
+}
+
+String session_segment_path(const String &base, uint16_t seg) {
+  return base + "." + String(seg) + ".jsonl";
+}
+
+bool read_session_index(const String &base, SessionIndex &idx) {
+  const String path = base + ".idx";
+  fs::File f = fs_open(path.c_str(), FILE_READ);
+  if (!f) {
+    return false;
+  }
+  const size_t n = f.read((uint8_t *)&idx, sizeof(idx));
+  f.close();
+  return n == sizeof(idx) && idx.magic == kSessionIndexMagic;
+}
+
+bool write_session_index(const String &base, const SessionIndex &idx) {
+  const String path = base + ".idx";
+  fs::File f = fs_open(path.c_str(), FILE_WRITE);
+  if (!f) {
+    return false;
+  }
+  const size_t n = f.write((const uint8_t *)&idx, sizeof(idx));
+  f.close();
+  return n == sizeof(idx);
+}
+
+// Adopt a pre-segment tg_<chat>.jsonl as segment 0, marked full so the next
+// append starts a fresh segment.
+void load_or_migrate_session_index(const String &base, SessionIndex &idx) {
+  if (read_session_index(base, idx)) {
+    return;
+  }
+  idx.magic = kSessionIndexMagic;
+  idx.first_seg = 0;
+  idx.last_seg = 0;
+  idx.last_count = 0;
+  const String legacy = base + ".jsonl";
+  if (fs_exists(legacy.c_str()) &&
+      fs_rename(legacy.c_str(), session_segment_path(base, 0).c_str())) {
+    idx.last_count = kSessionSegmentMsgs;
+  }
+}
+
+void append_json_escaped(String &out, const String &value) {
+  for (size_t i = 0; i < value.length(); i++) {
+    const char c = value[i];
+    switch (c) {
+      case '\\': out += "\\\\"; break;
+      case '"': out += "\\\""; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        out += ((unsigned char)c < 0x20) ? ' ' : c;
+        break;
+    }
+  }
+}
+
+bool clock_synced() {
+  return time(nullptr) >= 1700000000;
+}
+
+// YYYYMMDD of the local day days_ago before today, 0 when the clock is unsynced.
+uint32_t day_key(int days_ago) {
+  if (!clock_synced()) {
+    return 0;
+  }
+  time_t t = time(nullptr) - (time_t)days_ago * 86400;
+  struct tm tm_local;
+  localtime_r(&t, &tm_local);
+  return (uint32_t)((tm_local.tm_year + 1900) * 10000 + (tm_local.tm_mon + 1) * 100 +
+                    tm_local.tm_mday);
+}
+
+// Path without extension; key 0 is the undated TODAY file.
+String daily_base(uint32_t key) {
+  if (key == 0) {
+    return String("/memory/TODAY");
+  }
+  return String("/memory/daily_") + String(key);
+}
+
+uint32_t term_hash(const char *s, size_t len) {
+  uint32_t h = 2166136261u;  // FNV-1a
+  for (size_t i = 0; i < len; i++) {
+    h ^= (uint8_t)s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// Calls fn(hash) for every lowercase alphanumeric word of kMinTermChars or more.
+template <typename Fn>
+void for_each_term(const String &text, Fn fn) {
+  char word[32];
+  size_t len = 0;
+  for (size_t i = 0; i <= text.length(); i++) {
+    char c = i < text.length() ? text[i] : ' ';
+    if (c >= 'A' && c <= 'Z') {
+      c = c - 'A' + 'a';
+    }
+    const bool word_char = (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+    if (word_char) {
+      if (len < sizeof(word)) {
+        word[len++] = c;
+      }
+      continue;
+    }
+    if (len >= kMinTermChars) {
+      fn(term_hash(word, len));
+    }
+    len = 0;
+  }
+}
+
+void bloom_add(uint32_t *bloom, uint32_t h) {
+  const uint32_t a = h & 127;
+  const uint32_t b = (h >> 7) & 127;
+  bloom[a >> 5] |= 1UL << (a & 31);
+  bloom[b >> 5] |= 1UL << (b & 31);
+}
+
+bool bloom_has(const uint32_t *bloom, uint32_t h) {
+  const uint32_t a = h & 127;
+  const uint32_t b = (h >> 7) & 127;
+  return (bloom[a >> 5] & (1UL << (a & 31))) && (bloom[b >> 5] & (1UL << (b & 31)));
+}
+
+bool append_daily_record(const String &base, uint32_t offset, const String &note) {
+  DailyNoteRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.offset = offset;
+  rec.length = (uint16_t)(note.length() > 0xFFFF ? 0xFFFF : note.length());
+  for_each_term(note, [&rec](uint32_t h) { bloom_add(rec.bloom, h); });
+
+  const String idx_path = base + ".idx";
+  fs::File f = fs_open(idx_path.c_str(), FILE_APPEND);
+  if (!f) {
+    return false;
+  }
+  const size_t n = f.write((const uint8_t *)&rec, sizeof(rec));
+  f.close();
+  return n == sizeof(rec);
+}
+
+// TODAY.md written before the index existed: one record per line.
+void index_legacy_daily() {
+  const String base = daily_base(0);
+  const String md_path = base + ".md";
+  const String idx_path = base + ".idx";
+  if (!fs_exists(md_path.c_str()) || fs_exists(idx_path.c_str())) {
+    return;
+  }
+  fs::File f = fs_open(md_path.c_str(), FILE_READ);
+  if (!f) {
+    return;
+  }
+  const String all = f.readString();
+  f.close();
+  int start = 0;
+  int records = 0;
+  while (start < (int)all.length()) {
+    int end = all.indexOf('\n', start);
+    if (end < 0) {
+      end = all.length();
+    }
+    String line = all.substring(start, end);
+    line.trim();
+    if (line.length() > 0 && append_daily_record(base, start, all.substring(start, end))) {
+      records++;
+    }
+    start = end + 1;
+  }
+  Serial.printf("[file_memory] Indexed %d legacy daily note(s)\n", records);
+}
+
+// Delete daily_<YYYYMMDD> files older than DAILY_RETENTION_DAYS.
+void prune_old_daily() {
+  const uint32_t cutoff = day_key(DAILY_RETENTION_DAYS);
+  if (cutoff == 0) {
+    return;
+  }
+  fs::File root = fs_open(kMemoryDir, FILE_READ);
+  if (!root || !root.isDirectory()) {
+    return;
+  }
+  String doomed[8];
+  int doomed_count = 0;
+  fs::File file = root.openNextFile();
+  while (file && doomed_count < 8) {
+    String name = String(file.name());
+    name = name.substring(name.lastIndexOf('/') + 1);
+    if (name.startsWith("daily_") && name.length() >= 14 &&
+        (uint32_t)name.substring(6, 14).toInt() < cutoff) {
+      doomed[doomed_count++] = String(kMemoryDir) + "/" + name;
+    }
+    file = root.openNextFile();
+  }
+  root.close();
+  for (int i = 0; i < doomed_count; i++) {
+    fs_remove(doomed[i].c_str());
+  }
+}
+
+uint16_t term_hash16(uint32_t h) {
+  return (uint16_t)(h ^ (h >> 16));
+}
+
+const char *chunk_source_path(uint8_t source) {
+  return source == CHUNK_USER ? kUserPath : kLongTermMemoryPath;
+}
+
+// Append one record for a line; headings and blank lines are not indexed.
+void index_chunk(fs::File &idx, uint8_t source, uint32_t offset, const String &line) {
+  String trimmed = line;
+  trimmed.trim();
+  if (trimmed.length() == 0 || trimmed.startsWith("#")) {
+    return;
+  }
+
+  uint16_t terms[kChunkMaxTerms];
+  uint8_t counts[kChunkMaxTerms];
+  size_t unique = 0;
+  uint16_t total = 0;
+  for_each_term(line, [&](uint32_t h) {
+    const uint16_t t = term_hash16(h);
+    total++;
+    for (size_t i = 0; i < unique; i++) {
+      if (terms[i] == t) {
+        if (counts[i] < 255) {
+          counts[i]++;
+        }
+        return;
+      }
+    }
+    if (unique < kChunkMaxTerms) {
+      terms[unique] = t;
+      counts[unique] = 1;
+      unique++;
+    }
+  });
+  if (unique == 0) {
+    return;
+  }
+
+  ChunkRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.source = source;
+  rec.unique_terms = (uint8_t)unique;
+  rec.length = (uint16_t)(line.length() > 0xFFFF ? 0xFFFF : line.length());
+  rec.offset = offset;
+  rec.total_terms = total;
+  idx.write((const uint8_t *)&rec, sizeof(rec));
+  idx.write((const uint8_t *)terms, unique * sizeof(uint16_t));
+  idx.write(counts, unique);
+}
+
+// Index every line of text, which starts at byte base_offset of its file.
+void index_text(fs::File &idx, uint8_t source, uint32_t base_offset, const String &text) {
+  int start = 0;
+  while (start < (int)text.length()) {
+    int end = text.indexOf('\n', start);
+    if (end < 0) {
+      end = text.length();
+    }
+    index_chunk(idx, source, base_offset + start, text.substring(start, end));
+    start = end + 1;
+  }
+}
+
+void rebuild_recall_index() {
+  fs::File idx = fs_open(kRecallIndexPath, FILE_WRITE);
+  if (!idx) {
+    Serial.println("[file_memory] recall index create failed");
+    return;
+  }
+  const uint8_t sources[] = {CHUNK_MEMORY, CHUNK_USER};
+  for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+    fs::File f = fs_open(chunk_source_path(sources[i]), FILE_READ);
+    if (!f) {
+      continue;
+    }
+    while (f.available()) {
+      const uint32_t offset = f.position();
+      const String line = f.readStringUntil('\n');
+      index_chunk(idx, sources[i], offset, line);
+    }
+    f.close();
+  }
+  Serial.printf("[file_memory] recall index rebuilt: %u bytes\n", (unsigned)idx.size());
+  idx.close();
+  g_recall_dirty = false;
+}
+
+void index_appended_text(uint8_t source, uint32_t offset, const String &text) {
+  if (g_recall_dirty) {
+    return;  // the next query rebuilds from the files anyway
+  }
+  fs::File idx = fs_open(kRecallIndexPath, FILE_APPEND);
+  if (!idx) {
+    g_recall_dirty = true;
+    return;
+  }
+  index_text(idx, source, offset, text);
+  idx.close();
+}
+
+struct ChunkHit {
+  float score;
+  uint8_t source;
+  uint16_t length;
+  uint32_t offset;
+};
+
+bool read_chunk(fs::File &idx, ChunkRecord &rec, uint16_t *terms, uint8_t *counts) {
+  if (idx.read((uint8_t *)&rec, sizeof(rec)) != sizeof(rec) || rec.unique_terms > kChunkMaxTerms) {
+    return false;
+  }
+  return idx.read((uint8_t *)terms, rec.unique_terms * sizeof(uint16_t)) ==
+             rec.unique_terms * sizeof(uint16_t) &&
+         idx.read(counts, rec.unique_terms) == rec.unique_terms;
+}
+
+// Two sequential passes over the index: document frequencies and average
+// length first, then BM25 (k1 = 1.2, b = 0.75) keeping the best top_k chunks.
+size_t bm25_top_chunks(const uint16_t *query, size_t query_count, ChunkHit *hits, size_t top_k) {
+  fs::File idx = fs_open(kRecallIndexPath, FILE_READ);
+  if (!idx) {
+    return 0;
+  }
+
+  uint16_t terms[kChunkMaxTerms];
+  uint8_t counts[kChunkMaxTerms];
+  ChunkRecord rec;
+  uint32_t df[16] = {0};
+  uint32_t docs = 0;
+  uint32_t total_len = 0;
+  while (read_chunk(idx, rec, terms, counts)) {
+    docs++;
+    total_len += rec.total_terms;
+    for (size_t q = 0; q < query_count; q++) {
+      for (size_t i = 0; i < rec.unique_terms; i++) {
+        if (terms[i] == query[q]) {
+          df[q]++;
+          break;
+        }
+      }
+    }
+  }
+  if (docs == 0) {
+    idx.close();
+    return 0;
+  }
+
+  float idf[16];
+  for (size_t q = 0; q < query_count; q++) {
+    idf[q] = logf(1.0f + (docs - df[q] + 0.5f) / (df[q] + 0.5f));
+  }
+  const float avg_len = (float)total_len / docs;
+
+  size_t hit_count = 0;
+  idx.seek(0);
+  while (read_chunk(idx, rec, terms, counts)) {
+    float score = 0;
+    for (size_t q = 0; q < query_count; q++) {
+      if (df[q] == 0) {
+        continue;
+      }
+      for (size_t i = 0; i < rec.unique_terms; i++) {
+        if (terms[i] == query[q]) {
+          const float tf = counts[i];
+          score += idf[q] * tf * 2.2f / (tf + 1.2f * (0.25f + 0.75f * rec.total_terms / avg_len));
+          break;
+        }
+      }
+    }
+    if (score <= 0) {
+      continue;
+    }
+    // Insertion into the small sorted hit list
+    size_t pos = hit_count < top_k ? hit_count++ : top_k;
+    while (pos > 0 && hits[pos - 1].score < score) {
+      if (pos < top_k) {
+        hits[pos] = hits[pos - 1];
+      }
+      pos--;
+    }
+    if (pos < top_k) {
+      hits[pos].score = score;
+      hits[pos].source = rec.source;
+      hits[pos].length = rec.length;
+      hits[pos].offset = rec.offset;
+    }
+  }
+  idx.close();
+  return hit_count;
 }
 
 }  // namespace
 
 void file_memory_init() {
+  if (g_lock == nullptr) {
+    g_lock = xSemaphoreCreateRecursiveMutex();
+  }
+  MemoryLock guard;
+
   // Try SD card first if enabled
 #if ENABLE_SD_CARD
   Serial.println("[file_memory] Trying SD card...");
@@ -161,25 +653,26 @@ void file_memory_init() {
     Serial.println("[file_memory] SD card mounted! 🎉");
     Serial.printf("[file_memory] SD size: %llu MB\n", SD.cardSize() / (1024 * 1024));
   } else {
-    Serial.println("[file_memory] SD card not found, using SPIFFS");
+    Serial.println("[file_memory] SD card not found, using " FLASH_FS_NAME);
   }
 #endif
 
-  // Fall back to SPIFFS
+  // Fall back to internal flash
   if (g_backend == FileBackend::NONE) {
-    if (!SPIFFS.begin(true)) {
-      Serial.println("[file_memory] SPIFFS mount failed");
+    if (!flash_fs_begin()) {
+      Serial.println("[file_memory] " FLASH_FS_NAME " mount failed");
       return;
     }
-    g_backend = FileBackend::SPIFFS;
+    g_backend = FileBackend::FLASH;
     g_backend_ready = true;
-    Serial.println("[file_memory] SPIFFS mounted");
+    Serial.println("[file_memory] " FLASH_FS_NAME " mounted");
   }
 
   if (!ensure_directories()) {
     Serial.println("[file_memory] Directory creation failed");
     return;
   }
+  index_legacy_daily();
 
   // Create default files if they don't exist
   if (!fs_exists(kLongTermMemoryPath)) {
@@ -224,10 +717,18 @@ void file_memory_init() {
     }
   }
 
+  rebuild_recall_index();
+
   Serial.printf("[file_memory] Ready 🦖 (using %s)\n", fs_backend_name().c_str());
 }
 
 bool file_memory_read_long_term(String &content_out, String &error_out) {
+  MemoryLock guard;
+  if (context_cache_get(CTX_LONG_TERM, content_out)) {
+    return true;
+  }
+  const uint32_t generation = context_cache_generation(CTX_LONG_TERM);
+
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
@@ -235,6 +736,7 @@ bool file_memory_read_long_term(String &content_out, String &error_out) {
 
   if (!fs_exists(kLongTermMemoryPath)) {
     content_out = "";
+    context_cache_put(CTX_LONG_TERM, content_out, generation);
     return true;
   }
 
@@ -246,15 +748,42 @@ bool file_memory_read_long_term(String &content_out, String &error_out) {
 
   content_out = f.readString();
   f.close();
+  context_cache_put(CTX_LONG_TERM, content_out, generation);
   return true;
 }
 
 bool file_memory_append_long_term(const String &text, String &error_out) {
+  MemoryLock guard;
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
   }
 
+  size_t current = 0;
+  if (fs_exists(kLongTermMemoryPath)) {
+    fs::File check = fs_open(kLongTermMemoryPath, FILE_READ);
+    if (check) {
+      current = check.size();
+      check.close();
+    }
+  }
+
+  // Plain append while under the limit, so the recall index only grows
+  if (current + text.length() + 2 <= kMaxLongTermMemory) {
+    fs::File f = fs_open(kLongTermMemoryPath, FILE_APPEND);
+    if (!f) {
+      error_out = "Failed to open MEMORY.md for append";
+      return false;
+    }
+    f.print(text);
+    f.println();
+    f.close();
+    context_cache_invalidate(CTX_LONG_TERM);
+    index_appended_text(CHUNK_MEMORY, current, text);
+    Serial.printf("[file_memory] Appended to MEMORY.md: %d bytes\n", text.length());
+    return true;
+  }
+
   // Read existing content
   String existing;
   if (!file_memory_read_long_term(existing, error_out)) {
@@ -281,12 +810,20 @@ bool file_memory_append_long_term(const String &text, String &error_out) {
   f.print(text);
   f.println();
   f.close();
+  context_cache_invalidate(CTX_LONG_TERM);
+  g_recall_dirty = true;  // offsets shifted
 
   Serial.printf("[file_memory] Appended to MEMORY.md: %d bytes\n", text.length());
   return true;
 }
 
 bool file_memory_read_soul(String &soul_out, String &error_out) {
+  MemoryLock guard;
+  if (context_cache_get(CTX_SOUL, soul_out)) {
+    return true;
+  }
+  const uint32_t generation = context_cache_generation(CTX_SOUL);
+
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
@@ -294,6 +831,7 @@ bool file_memory_read_soul(String &soul_out, String &error_out) {
 
   if (!fs_exists(kSoulPath)) {
     soul_out = "";
+    context_cache_put(CTX_SOUL, soul_out, generation);
     return true;
   }
 
@@ -305,10 +843,12 @@ bool file_memory_read_soul(String &soul_out, String &error_out) {
 
   soul_out = f.readString();
   f.close();
+  context_cache_put(CTX_SOUL, soul_out, generation);
   return true;
 }
 
 bool file_memory_write_soul(const String &soul, String &error_out) {
+  MemoryLock guard;
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
@@ -326,12 +866,19 @@ bool file_memory_write_soul(const String &soul, String &error_out) {
     f.print(soul);
   }
   f.close();
+  context_cache_invalidate(CTX_SOUL);
 
   Serial.println("[file_memory] Updated SOUL.md");
   return true;
 }
 
 bool file_memory_read_user(String &user_out, String &error_out) {
+  MemoryLock guard;
+  if (context_cache_get(CTX_USER, user_out)) {
+    return true;
+  }
+  const uint32_t generation = context_cache_generation(CTX_USER);
+
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
@@ -339,6 +886,7 @@ bool file_memory_read_user(String &user_out, String &error_out) {
 
   if (!fs_exists(kUserPath)) {
     user_out = "";
+    context_cache_put(CTX_USER, user_out, generation);
     return true;
   }
 
@@ -350,20 +898,23 @@ bool file_memory_read_user(String &user_out, String &error_out) {
 
   user_out = f.readString();
   f.close();
+  context_cache_put(CTX_USER, user_out, generation);
   return true;
 }
 
 bool file_memory_append_user(const String &text, String &error_out) {
+  MemoryLock guard;
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
   }
 
   // Check current size
+  size_t current = 0;
   if (fs_exists(kUserPath)) {
     fs::File check = fs_open(kUserPath, FILE_READ);
     if (check) {
-      size_t current = check.size();
+      current = check.size();
       check.close();
       if (current + text.length() > 4096) {
         error_out = "USER.md full (4KB limit)";
@@ -380,161 +931,365 @@ bool file_memory_append_user(const String &text, String &error_out) {
 
   f.print("\n" + text);
   f.close();
+  context_cache_invalidate(CTX_USER);
+  index_appended_text(CHUNK_USER, current + 1, text);
   return true;
 }
 
 bool file_memory_append_daily(const String &note, String &error_out) {
+  MemoryLock guard;
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
   }
 
-  String path = get_daily_path();
+  const uint32_t key = day_key(0);
+  const String base = daily_base(key);
+  const String path = base + ".md";
 
-  String existing;
+  size_t offset = 0;
   if (fs_exists(path.c_str())) {
     fs::File f = fs_open(path.c_str(), FILE_READ);
     if (f) {
-      existing = f.readString();
+      offset = f.size();
       f.close();
     }
+  } else if (key != 0) {
+    prune_old_daily();  // first note of a new day
   }
 
-  fs::File f = fs_open(path.c_str(), FILE_WRITE);
-  if (!f) {
-    error_out = "Failed to open daily memory file";
+  if (offset + note.length() + 2 > kMaxDailyMemory) {
+    error_out = "Today's notes are full (" + String(kMaxDailyMemory) + " bytes)";
     return false;
   }
 
-  // Check size limit
-  if (existing.length() + note.length() > kMaxDailyMemory) {
-    size_t excess = (existing.length() + note.length()) - kMaxDailyMemory;
-    if (existing.length() > excess) {
-      existing = existing.substring(excess);
-    }
+  fs::File f = fs_open(path.c_str(), FILE_APPEND);
+  if (!f) {
+    error_out = "Failed to open daily memory file";
+    return false;
   }
-
-  f.print(existing);
   f.print(note);
   f.println();
   f.close();
 
+  if (!append_daily_record(base, offset, note)) {
+    Serial.println("[file_memory] Daily index append failed");
+  }
+
   Serial.printf("[file_memory] Appended to daily: %d bytes\n", note.length());
   return true;
 }
 
 bool file_memory_read_recent(String &content_out, int days, String &error_out) {
+  MemoryLock guard;
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
   }
 
-  // For simplicity, just return today's file
-  // A full implementation would read multiple daily files
-  String path = get_daily_path();
-
-  if (!fs_exists(path.c_str())) {
-    content_out = "";
-    return true;
+  content_out = "";
+  if (days < 1) {
+    days = 1;
   }
 
-  fs::File f = fs_open(path.c_str(), FILE_READ);
-  if (!f) {
-    error_out = "Failed to open daily memory file";
-    return false;
+  // Oldest first, then undated notes from before the clock synced
+  uint32_t keys[DAILY_RETENTION_DAYS + 1];
+  int key_count = 0;
+  if (clock_synced()) {
+    for (int d = days - 1; d >= 0 && key_count < DAILY_RETENTION_DAYS; d--) {
+      keys[key_count++] = day_key(d);
+    }
   }
+  keys[key_count++] = 0;
 
-  content_out = f.readString();
-  f.close();
+  for (int i = 0; i < key_count; i++) {
+    const String path = daily_base(keys[i]) + ".md";
+    if (!fs_exists(path.c_str())) {
+      continue;
+    }
+    fs::File f = fs_open(path.c_str(), FILE_READ);
+    if (!f) {
+      continue;
+    }
+    if (keys[i] != 0) {
+      content_out += "## " + String(keys[i]) + "\n";
+    }
+    content_out += f.readString();
+    f.close();
+  }
   return true;
 }
 
-bool file_memory_session_append(const String &chat_id, const String &role,
-                                const String &content, String &error_out) {
+bool file_memory_recall_daily(const String &query, int days, size_t max_chars,
+                              String &snippets_out, String &error_out) {
+  MemoryLock guard;
+  snippets_out = "";
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
   }
 
-  String path = String(kSessionsDir) + "/tg_" + chat_id + ".jsonl";
+  uint32_t terms[16];
+  size_t term_count = 0;
+  for_each_term(query, [&terms, &term_count](uint32_t h) {
+    for (size_t i = 0; i < term_count; i++) {
+      if (terms[i] == h) {
+        return;
+      }
+    }
+    if (term_count < sizeof(terms) / sizeof(terms[0])) {
+      terms[term_count++] = h;
+    }
+  });
+  if (term_count == 0 || max_chars == 0) {
+    return true;
+  }
 
-  // Read existing lines to count
-  int line_count = 0;
-  String existing;
-  if (fs_exists(path.c_str())) {
-    fs::File f = fs_open(path.c_str(), FILE_READ);
-    if (f) {
-      existing = f.readString();
-      f.close();
+  // Newest day first; undated TODAY notes count as the oldest
+  const int day_count = clock_synced() ? days : 0;
+  for (int d = 0; d <= day_count && snippets_out.length() < max_chars; d++) {
+    const uint32_t key = d < day_count ? day_key(d) : 0;
+    const String base = daily_base(key);
+    const String idx_path = base + ".idx";
+    fs::File idx = fs_open(idx_path.c_str(), FILE_READ);
+    if (!idx) {
+      continue;
+    }
+    fs::File md;
+    const size_t records = idx.size() / sizeof(DailyNoteRecord);
+    // Newest note of the day first
+    for (size_t r = records; r > 0 && snippets_out.length() < max_chars; r--) {
+      DailyNoteRecord rec;
+      idx.seek((r - 1) * sizeof(rec));
+      if (idx.read((uint8_t *)&rec, sizeof(rec)) != sizeof(rec)) {
+        break;
+      }
+      bool hit = false;
+      for (size_t t = 0; t < term_count && !hit; t++) {
+        hit = bloom_has(rec.bloom, terms[t]);
+      }
+      if (!hit) {
+        continue;
+      }
+      if (!md) {
+        const String md_path = base + ".md";
+        md = fs_open(md_path.c_str(), FILE_READ);
+        if (!md) {
+          break;
+        }
+      }
+      size_t len = rec.length;
+      const size_t room = max_chars - snippets_out.length();
+      if (len > room) {
+        len = room;
+      }
+      char buf[128];
+      md.seek(rec.offset);
+      snippets_out += key != 0 ? "[" + String(key) + "] " : String("[undated] ");
+      while (len > 0) {
+        const size_t chunk = len < sizeof(buf) - 1 ? len : sizeof(buf) - 1;
+        const size_t n = md.read((uint8_t *)buf, chunk);
+        if (n == 0) {
+          break;
+        }
+        buf[n] = '\0';
+        snippets_out += buf;
+        len -= n;
+      }
+      snippets_out += "\n";
+    }
+    if (md) {
+      md.close();
+    }
+    idx.close();
+  }
+  snippets_out.trim();
+  return true;
+}
+
+bool file_memory_retrieve(const String &query, size_t max_chars, String &context_out,
+                          String &error_out) {
+  MemoryLock guard;
+  context_out = "";
+  if (!g_backend_ready) {
+    error_out = "Filesystem not ready";
+    return false;
+  }
+  if (g_recall_dirty) {
+    rebuild_recall_index();
+  }
 
-      // Count lines
-      for (size_t i = 0; i < existing.length(); i++) {
-        if (existing[i] == '\n') line_count++;
+  uint16_t terms[16];
+  size_t term_count = 0;
+  for_each_term(query, [&terms, &term_count](uint32_t h) {
+    const uint16_t t = term_hash16(h);
+    for (size_t i = 0; i < term_count; i++) {
+      if (terms[i] == t) {
+        return;
       }
     }
+    if (term_count < sizeof(terms) / sizeof(terms[0])) {
+      terms[term_count++] = t;
+    }
+  });
+
+  ChunkHit hits[MEMORY_RETRIEVAL_TOP_K];
+  const size_t hit_count = term_count > 0 ? bm25_top_chunks(terms, term_count, hits,
+                                                            MEMORY_RETRIEVAL_TOP_K)
+                                          : 0;
+  for (size_t i = 0; i < hit_count && context_out.length() < max_chars; i++) {
+    fs::File f = fs_open(chunk_source_path(hits[i].source), FILE_READ);
+    if (!f) {
+      continue;
+    }
+    size_t len = hits[i].length;
+    const size_t room = max_chars - context_out.length();
+    if (len > room) {
+      len = room;
+    }
+    char buf[128];
+    f.seek(hits[i].offset);
+    context_out += hits[i].source == CHUNK_USER ? "[user] " : "[memory] ";
+    while (len > 0) {
+      const size_t chunk = len < sizeof(buf) - 1 ? len : sizeof(buf) - 1;
+      const size_t n = f.read((uint8_t *)buf, chunk);
+      if (n == 0) {
+        break;
+      }
+      buf[n] = '\0';
+      context_out += buf;
+      len -= n;
+    }
+    f.close();
+    context_out.trim();
+    context_out += "\n";
   }
 
-  // Create new JSON line
-  String json_line = "{\"role\":\"" + role + "\",\"content\":\"" + content + "\"}";
+  // Daily notes have their own per-day index; they get the remaining budget
+  if (context_out.length() < max_chars) {
+    size_t daily_budget = max_chars - context_out.length();
+    if (daily_budget > DAILY_RECALL_MAX_CHARS) {
+      daily_budget = DAILY_RECALL_MAX_CHARS;
+    }
+    String daily;
+    String daily_err;
+    if (file_memory_recall_daily(query, DAILY_RECALL_DAYS, daily_budget, daily, daily_err) &&
+        daily.length() > 0) {
+      context_out += daily;
+    }
+  }
+  context_out.trim();
+  return true;
+}
 
-  fs::File f = fs_open(path.c_str(), FILE_WRITE);
-  if (!f) {
-    error_out = "Failed to open session file";
+bool file_memory_session_append(const String &chat_id, const String &role,
+                                const String &content, String &error_out) {
+  MemoryLock guard;
+  if (!g_backend_ready) {
+    error_out = "Filesystem not ready";
     return false;
   }
 
-  // Ring buffer: remove oldest if at limit
-  if (line_count >= kMaxSessionMsgs) {
-    int first_nl = existing.indexOf('\n');
-    if (first_nl >= 0) {
-      existing = existing.substring(first_nl + 1);
+  const String base = session_base(chat_id);
+  SessionIndex idx;
+  load_or_migrate_session_index(base, idx);
+
+  if (idx.last_count >= kSessionSegmentMsgs) {
+    idx.last_seg++;
+    idx.last_count = 0;
+    // Drop whole segments once the rest still hold kMaxSessionMsgs records
+    while ((uint32_t)(idx.last_seg - idx.first_seg) * kSessionSegmentMsgs >=
+           kMaxSessionMsgs + kSessionSegmentMsgs) {
+      fs_remove(session_segment_path(base, idx.first_seg).c_str());
+      idx.first_seg++;
     }
   }
 
-  if (existing.length() > 0) {
-    f.print(existing);
+  String json_line;
+  json_line.reserve(content.length() + role.length() + 32);
+  json_line += "{\"role\":\"";
+  append_json_escaped(json_line, role);
+  json_line += "\",\"content\":\"";
+  append_json_escaped(json_line, content);
+  json_line += "\"}";
+
+  const String path = session_segment_path(base, idx.last_seg);
+  fs::File f = fs_open(path.c_str(), FILE_APPEND);
+  if (!f) {
+    error_out = "Failed to open session file";
+    return false;
   }
   f.println(json_line);
   f.close();
 
+  idx.last_count++;
+  if (!write_session_index(base, idx)) {
+    error_out = "Failed to write session index";
+    return false;
+  }
   return true;
 }
 
 bool file_memory_session_get(const String &chat_id, String &history_out,
                              String &error_out) {
+  MemoryLock guard;
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
   }
 
-  String path = String(kSessionsDir) + "/tg_" + chat_id + ".jsonl";
-
-  if (!fs_exists(path.c_str())) {
-    history_out = "";
+  history_out = "";
+  const String base = session_base(chat_id);
+  SessionIndex idx;
+  if (!read_session_index(base, idx)) {
+    // Not yet migrated: a legacy single file may still exist
+    const String legacy = base + ".jsonl";
+    if (fs_exists(legacy.c_str())) {
+      fs::File f = fs_open(legacy.c_str(), FILE_READ);
+      if (!f) {
+        error_out = "Failed to open session file";
+        return false;
+      }
+      history_out = f.readString();
+      f.close();
+    }
     return true;
   }
 
-  fs::File f = fs_open(path.c_str(), FILE_READ);
-  if (!f) {
-    error_out = "Failed to open session file";
-    return false;
+  for (uint16_t seg = idx.first_seg; seg != (uint16_t)(idx.last_seg + 1); seg++) {
+    const String path = session_segment_path(base, seg);
+    fs::File f = fs_open(path.c_str(), FILE_READ);
+    if (!f) {
+      continue;
+    }
+    history_out += f.readString();
+    f.close();
   }
-
-  history_out = f.readString();
-  f.close();
   return true;
 }
 
 bool file_memory_session_clear(const String &chat_id, String &error_out) {
+  MemoryLock guard;
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
   }
 
-  String path = String(kSessionsDir) + "/tg_" + chat_id + ".jsonl";
+  const String base = session_base(chat_id);
+  SessionIndex idx;
+  if (read_session_index(base, idx)) {
+    for (uint16_t seg = idx.first_seg; seg != (uint16_t)(idx.last_seg + 1); seg++) {
+      const String path = session_segment_path(base, seg);
+      if (fs_exists(path.c_str())) {
+        fs_remove(path.c_str());
+      }
+    }
+  }
 
-  if (fs_exists(path.c_str())) {
-    if (!fs_remove(path.c_str())) {
+  const char *const suffixes[] = {".idx", ".jsonl"};
+  for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+    const String path = base + suffixes[i];
+    if (fs_exists(path.c_str()) && !fs_remove(path.c_str())) {
       error_out = "Failed to remove session file";
       return false;
     }
@@ -544,6 +1299,7 @@ bool file_memory_session_clear(const String &chat_id, String &error_out) {
 }
 
 bool file_memory_get_info(String &info_out, String &error_out) {
+  MemoryLock guard;
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
@@ -600,13 +1356,19 @@ bool file_memory_get_info(String &info_out, String &error_out) {
   return true;
 }
 
+static void append_listing_line(const String &path, size_t size, void *ctx) {
+  String &list_out = *(String *)ctx;
+  list_out += "• " + path + " (" + String(size) + " bytes)\n";
+}
+
 bool file_memory_list_files(String &list_out, String &error_out) {
+  MemoryLock guard;
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
   }
 
-  list_out = "📁 SPIFFS Files:\n\n";
+  list_out = "📁 " + fs_backend_name() + " Files:\n\n";
 
 #if ENABLE_SD_CARD
   if (g_backend == FileBackend::SD_CARD) {
@@ -629,23 +1391,8 @@ bool file_memory_list_files(String &list_out, String &error_out) {
   }
 #endif
 
-  // SPIFFS
-  File root = SPIFFS.open("/");
-  if (!root) {
-    error_out = "Failed to open SPIFFS root";
-    return false;
-  }
-
-  File file = root.openNextFile();
-  while (file) {
-    String name = file.name();
-    if (!file.isDirectory()) {
-      list_out += "• " + name + " (" + String(file.size()) + " bytes)\n";
-    }
-    file = root.openNextFile();
-  }
-  root.close();
-
+  // Internal flash; LittleFS directories are walked recursively
+  flash_fs_walk("/", append_listing_line, &list_out);
   return true;
 }
 
@@ -659,6 +1406,93 @@ static String normalize_user_path(String path) {
   return path;
 }
 
+// Raw file writes can target the memory files themselves.
+static void invalidate_cached_path(const String &path) {
+  if (path == kSoulPath) {
+    context_cache_invalidate(CTX_SOUL);
+  } else if (path == kUserPath) {
+    context_cache_invalidate(CTX_USER);
+    g_recall_dirty = true;
+  } else if (path == kLongTermMemoryPath) {
+    context_cache_invalidate(CTX_LONG_TERM);
+    g_recall_dirty = true;
+  }
+}
+
+// Project files are written whole and read whole, so they are stored as
+// <path>.gz when that saves at least an eighth. Memory, config and session
+// files stay raw: they are appended to and read back by byte offset.
+static bool compressible_path(const String &path) {
+  return FILE_COMPRESS_ENABLED && path.startsWith(String(kProjectsDir) + "/") &&
+         !path.endsWith(".gz");
+}
+
+static bool read_compressed_file(const String &gz_path, const String &filename,
+                                 String &content_out, String &error_out) {
+  fs::File f = fs_open(gz_path.c_str(), FILE_READ);
+  if (!f) {
+    error_out = "Failed to open file: " + filename;
+    return false;
+  }
+  const size_t packed_size = f.size();
+  uint8_t *packed = (uint8_t *)big_malloc(packed_size + 1);
+  if (packed == nullptr) {
+    f.close();
+    error_out = "Out of memory reading " + filename;
+    return false;
+  }
+  const size_t got = f.read(packed, packed_size);
+  f.close();
+
+  content_out = "";
+  String err;
+  const bool ok = got == packed_size &&
+                  gzip_decompress(packed, packed_size, FILE_DECOMPRESS_MAX_BYTES, content_out, err);
+  free(packed);
+  if (!ok) {
+    error_out = "Failed to decompress " + filename + ": " + (err.length() ? err : "short read");
+    return false;
+  }
+  Serial.printf("[file_memory] Read %s: %u bytes, %u compressed\n", gz_path.c_str(),
+                (unsigned)content_out.length(), (unsigned)packed_size);
+  return true;
+}
+
+// Writes the compressed copy and drops the raw one. False (nothing touched)
+// when compression does not pay off, so the caller writes raw instead.
+static bool write_compressed_file(const String &path, const String &content) {
+  size_t packed_size = 0;
+  uint8_t *packed =
+      gzip_compress((const uint8_t *)content.c_str(), content.length(), packed_size);
+  if (packed == nullptr) {
+    return false;
+  }
+  if (packed_size + content.length() / 8 > content.length()) {
+    free(packed);
+    return false;
+  }
+
+  const String gz_path = path + ".gz";
+  fs::File f = fs_open(gz_path.c_str(), FILE_WRITE);
+  if (!f) {
+    free(packed);
+    return false;
+  }
+  const size_t written = f.write(packed, packed_size);
+  f.close();
+  free(packed);
+  if (written != packed_size) {
+    fs_remove(gz_path.c_str());
+    return false;
+  }
+  if (fs_exists(path.c_str())) {
+    fs_remove(path.c_str());
+  }
+  Serial.printf("[file_memory] Wrote %u bytes to %s as %u compressed\n",
+                (unsigned)content.length(), gz_path.c_str(), (unsigned)packed_size);
+  return true;
+}
+
 static bool ensure_parent_dirs_for_path(const String &path, String &error_out) {
   int slash = path.indexOf('/');
   while (slash >= 0) {
@@ -679,6 +1513,7 @@ static bool ensure_parent_dirs_for_path(const String &path, String &error_out) {
 }
 
 bool file_memory_read_file(const String &filename, String &content_out, String &error_out) {
+  MemoryLock guard;
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
@@ -686,6 +1521,12 @@ bool file_memory_read_file(const String &filename, String &content_out, String &
 
   String path = normalize_user_path(filename);
 
+  // The compressed copy wins, as it does for the web server
+  const String gz_path = path + ".gz";
+  if (compressible_path(path) && fs_exists(gz_path.c_str())) {
+    return read_compressed_file(gz_path, filename, content_out, error_out);
+  }
+
   if (!fs_exists(path.c_str())) {
     error_out = "File not found: " + filename;
     return false;
@@ -731,7 +1572,32 @@ bool file_memory_read_file(const String &filename, String &content_out, String &
   return true;
 }
 
+bool file_memory_open_file(const String &filename, File &file_out, String &error_out) {
+  MemoryLock guard;
+  if (!g_backend_ready) {
+    error_out = "Filesystem not ready";
+    return false;
+  }
+
+  String path = normalize_user_path(filename);
+  const String gz_path = path + ".gz";
+  if (compressible_path(path) && fs_exists(gz_path.c_str())) {
+    path = gz_path;
+  } else if (!fs_exists(path.c_str())) {
+    error_out = "File not found: " + filename;
+    return false;
+  }
+
+  file_out = fs_open(path.c_str(), FILE_READ);
+  if (!file_out) {
+    error_out = "Failed to open file: " + filename;
+    return false;
+  }
+  return true;
+}
+
 bool file_memory_write_file(const String &filename, const String &content, String &error_out) {
+  MemoryLock guard;
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
     return false;
@@ -747,6 +1613,13 @@ bool file_memory_write_file(const String &filename, const String &content, Strin
     return false;
   }
 
+  const bool compressible = compressible_path(path);
+  if (compressible && content.length() >= FILE_COMPRESS_MIN_BYTES &&
+      write_compressed_file(path, content)) {
+    invalidate_cached_path(path);
+    return true;
+  }
+
   fs::File f = fs_open(path.c_str(), FILE_WRITE);
   if (!f) {
     error_out = "Failed to open file for write: " + path;
@@ -755,10 +1628,16 @@ bool file_memory_write_file(const String &filename, const String &content, Strin
 
   const size_t written = f.print(content);
   f.close();
+  invalidate_cached_path(path);
   if (written != content.length()) {
     error_out = "Partial write to file: " + path;
     return false;
   }
+  // An older compressed copy would otherwise shadow what was just written
+  const String gz_path = path + ".gz";
+  if (compressible && fs_exists(gz_path.c_str())) {
+    fs_remove(gz_path.c_str());
+  }
 
   Serial.printf("[file_memory] Wrote %d bytes to %s\n", content.length(), path.c_str());
   return true;
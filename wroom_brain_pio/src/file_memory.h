@@ -2,8 +2,9 @@
 #define FILE_MEMORY_H
 
 #include <Arduino.h>
+#include <FS.h>
 
-// Initialize SPIFFS and create default files
+// Initialize the flash filesystem (or SD card) and create default files
 void file_memory_init();
 
 // Long-term memory (MEMORY.md)
@@ -18,9 +19,20 @@ bool file_memory_write_soul(const String &soul, String &error_out);
 bool file_memory_read_user(String &user_out, String &error_out);
 bool file_memory_append_user(const String &text, String &error_out);
 
-// Daily notes
+// Daily notes, kept per day for DAILY_RETENTION_DAYS. read_recent returns the
+// last `days` days, oldest first.
 bool file_memory_append_daily(const String &note, String &error_out);
 bool file_memory_read_recent(String &content_out, int days, String &error_out);
+// Notes from the last `days` days that share a word with query, newest first,
+// at most max_chars. Reads only the index and the matching byte ranges.
+bool file_memory_recall_daily(const String &query, int days, size_t max_chars,
+                              String &snippets_out, String &error_out);
+
+// Memory relevant to query: the top MEMORY_RETRIEVAL_TOP_K MEMORY.md / USER.md
+// lines by BM25 from the flash index, then matching daily notes, at most
+// max_chars in total.
+bool file_memory_retrieve(const String &query, size_t max_chars, String &context_out,
+                          String &error_out);
 
 // Session management
 bool file_memory_session_append(const String &chat_id, const String &role,
@@ -34,7 +46,12 @@ bool file_memory_get_info(String &info_out, String &error_out);
 
 // File listing and reading
 bool file_memory_list_files(String &list_out, String &error_out);
+// Files under /projects are stored gzip-compressed (<name>.gz) when that saves
+// space (see FILE_COMPRESS_ENABLED); read_file returns the original text.
 bool file_memory_read_file(const String &filename, String &content_out, String &error_out);
 bool file_memory_write_file(const String &filename, const String &content, String &error_out);
+// Open a file for streaming reads without loading it; the caller closes it.
+// A compressed file is opened as its .gz, unexpanded.
+bool file_memory_open_file(const String &filename, File &file_out, String &error_out);
 
 #endif
@@ -0,0 +1,185 @@
+#include "flash_fs.h"
+
+#if FS_USE_LITTLEFS
+#include <SPIFFS.h>
+#endif
+
+namespace {
+
+bool g_attempted = false;
+bool g_mounted = false;
+
+String child_path(const char *dir, const String &name) {
+  // Core 2.x returns bare names from openNextFile(); 1.x returned full paths.
+  if (name.startsWith("/")) {
+    return name;
+  }
+  String path = dir;
+  if (!path.endsWith("/")) {
+    path += "/";
+  }
+  return path + name;
+}
+
+void walk_dir(fs::FS &fs, const char *dir, flash_fs_visit_cb cb, void *ctx, int depth) {
+  fs::File root = fs.open(dir);
+  if (!root || !root.isDirectory()) {
+    return;
+  }
+  fs::File file = root.openNextFile();
+  while (file) {
+    const String path = child_path(dir, String(file.name()));
+    if (file.isDirectory()) {
+      file.close();
+      if (depth < 8) {
+        walk_dir(fs, path.c_str(), cb, ctx, depth + 1);
+      }
+    } else {
+      const size_t size = file.size();
+      file.close();
+      cb(path, size, ctx);
+    }
+    file = root.openNextFile();
+  }
+  root.close();
+}
+
+#if FS_USE_LITTLEFS
+
+struct StagedFile {
+  String path;
+  uint8_t *data;
+  size_t len;
+};
+
+const int kMaxStagedFiles = 64;
+
+// Copy order: small, critical state first so a tight budget drops projects.
+const char *const kMigrateOrder[] = {"/cron.md", "/config/", "/memory/", "/skills/", "/projects/"};
+
+struct StageState {
+  StagedFile files[kMaxStagedFiles];
+  int count;
+  size_t bytes;
+  size_t skipped;
+  const char *prefix;
+};
+
+bool path_matches(const String &path, const char *prefix) {
+  return prefix[strlen(prefix) - 1] == '/' ? path.startsWith(prefix) : path == prefix;
+}
+
+void stage_file(const String &path, size_t size, void *ctx) {
+  StageState &st = *(StageState *)ctx;
+  if (!path_matches(path, st.prefix)) {
+    return;
+  }
+  if (st.count >= kMaxStagedFiles || st.bytes + size > FLASH_FS_MIGRATE_MAX_BYTES) {
+    st.skipped++;
+    return;
+  }
+  uint8_t *data = (uint8_t *)malloc(size > 0 ? size : 1);
+  if (data == nullptr) {
+    st.skipped++;
+    return;
+  }
+  fs::File f = SPIFFS.open(path, FILE_READ);
+  const size_t n = f ? f.read(data, size) : 0;
+  if (f) {
+    f.close();
+  }
+  if (n != size) {
+    free(data);
+    st.skipped++;
+    return;
+  }
+  StagedFile &sf = st.files[st.count++];
+  sf.path = path;
+  sf.data = data;
+  sf.len = size;
+  st.bytes += size;
+}
+
+// The partition still holds SPIFFS: stage the user data in RAM, format it
+// as LittleFS and write the data back.
+bool migrate_from_spiffs() {
+  if (!SPIFFS.begin(false)) {
+    return LittleFS.begin(true);  // blank or corrupt: nothing to keep
+  }
+
+  StageState *st = new StageState();
+  st->count = 0;
+  st->bytes = 0;
+  st->skipped = 0;
+  for (size_t i = 0; i < sizeof(kMigrateOrder) / sizeof(kMigrateOrder[0]); i++) {
+    st->prefix = kMigrateOrder[i];
+    walk_dir(SPIFFS, "/", stage_file, st, 0);
+  }
+  SPIFFS.end();
+  Serial.printf("[fs] Migrating %d file(s), %u bytes from SPIFFS (%u skipped)\n", st->count,
+                (unsigned)st->bytes, (unsigned)st->skipped);
+
+  const bool ok = LittleFS.begin(true);  // formats the SPIFFS partition
+  int restored = 0;
+  for (int i = 0; i < st->count; i++) {
+    StagedFile &sf = st->files[i];
+    if (ok) {
+      flash_fs_mkdirs(sf.path);
+      fs::File f = LittleFS.open(sf.path, FILE_WRITE);
+      if (f && f.write(sf.data, sf.len) == sf.len) {
+        restored++;
+      }
+      if (f) {
+        f.close();
+      }
+    }
+    free(sf.data);
+  }
+  delete st;
+  Serial.printf("[fs] Migration restored %d file(s)\n", restored);
+  return ok;
+}
+
+#endif
+
+}  // namespace
+
+bool flash_fs_begin() {
+  if (g_attempted) {
+    return g_mounted;
+  }
+  g_attempted = true;
+
+#if FS_USE_LITTLEFS
+  g_mounted = LittleFS.begin(false) || migrate_from_spiffs();
+#else
+  g_mounted = SPIFFS.begin(true);
+#endif
+
+  if (g_mounted) {
+    Serial.printf("[fs] %s mounted, %u / %u bytes used\n", FLASH_FS_NAME,
+                  (unsigned)FLASH_FS.usedBytes(), (unsigned)FLASH_FS.totalBytes());
+  } else {
+    Serial.printf("[fs] %s mount failed\n", FLASH_FS_NAME);
+  }
+  return g_mounted;
+}
+
+void flash_fs_mkdirs(const String &path) {
+#if FS_USE_LITTLEFS
+  int slash = path.indexOf('/', 1);
+  while (slash > 0) {
+    const String dir = path.substring(0, slash);
+    if (!FLASH_FS.exists(dir)) {
+      FLASH_FS.mkdir(dir);
+    }
+    slash = path.indexOf('/', slash + 1);
+  }
+#else
+  (void)path;
+#endif
+}
+
+void flash_fs_walk(const char *dir, flash_fs_visit_cb cb, void *ctx) {
+  walk_dir(FLASH_FS, dir, cb, ctx, 0);
+}
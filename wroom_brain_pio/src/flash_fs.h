@@ -0,0 +1,36 @@
+#ifndef FLASH_FS_H
+#define FLASH_FS_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "brain_config.h"
+
+// Internal flash filesystem, chosen at build time with FS_USE_LITTLEFS.
+// LittleFS has real directories, wear leveling and fast lookups on a full
+// partition; SPIFFS stays the default for existing devices.
+#if FS_USE_LITTLEFS
+#include <LittleFS.h>
+#define FLASH_FS LittleFS
+#define FLASH_FS_NAME "LittleFS"
+#else
+#include <SPIFFS.h>
+#define FLASH_FS SPIFFS
+#define FLASH_FS_NAME "SPIFFS"
+#endif
+
+// Mount FLASH_FS once; later calls return the first result. With LittleFS
+// selected on a partition that still holds SPIFFS, cron.md, /config, /memory,
+// /skills and /projects are copied over (up to FLASH_FS_MIGRATE_MAX_BYTES)
+// before the partition is reformatted.
+bool flash_fs_begin();
+
+// Create every missing directory on the way to path (no-op on SPIFFS).
+void flash_fs_mkdirs(const String &path);
+
+// Visit every regular file under dir (recursively on LittleFS; SPIFFS is flat
+// and reports full paths).
+typedef void (*flash_fs_visit_cb)(const String &path, size_t size, void *ctx);
+void flash_fs_walk(const char *dir, flash_fs_visit_cb cb, void *ctx);
+
+#endif
@@ -0,0 +1,528 @@
+#include "gzip_codec.h"
+
+#include <string.h>
+
+#include "psram_alloc.h"
+
+namespace {
+
+const size_t kGzipHeaderBytes = 10;
+const size_t kGzipTrailerBytes = 8;
+const uint8_t kGzipFlagHcrc = 0x02;
+const uint8_t kGzipFlagExtra = 0x04;
+const uint8_t kGzipFlagName = 0x08;
+const uint8_t kGzipFlagComment = 0x10;
+
+const size_t kWindowBytes = 32768;
+const size_t kMinMatch = 3;
+const size_t kMaxMatch = 258;
+const int kHashBits = 12;
+const size_t kHashSize = 1 << kHashBits;
+
+// RFC 1951 3.2.5: base values and extra bits of length codes 257..285 and
+// distance codes 0..29
+const uint16_t kLengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                  31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                  2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t kDistBase[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+const uint8_t kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+  // Half-byte table: 64 bytes of flash instead of 1 KB
+  static const uint32_t kNibble[16] = {
+      0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+      0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+      0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ kNibble[crc & 0x0f];
+    crc = (crc >> 4) ^ kNibble[crc & 0x0f];
+  }
+  return ~crc;
+}
+
+void put_le32(uint8_t *p, uint32_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+uint32_t get_le32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ---- compressor ----
+
+struct BitWriter {
+  uint8_t *out;
+  size_t cap;
+  size_t pos;
+  uint32_t bits;
+  int count;
+  bool overflow;
+
+  // Deflate packs values LSB first
+  void put(uint32_t value, int n) {
+    bits |= value << count;
+    count += n;
+    while (count >= 8) {
+      if (pos < cap) {
+        out[pos++] = bits & 0xff;
+      } else {
+        overflow = true;
+      }
+      bits >>= 8;
+      count -= 8;
+    }
+  }
+
+  // Huffman codes go MSB first
+  void put_code(uint32_t code, int n) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < n; i++) {
+      reversed = (reversed << 1) | (code & 1);
+      code >>= 1;
+    }
+    put(reversed, n);
+  }
+
+  void flush() {
+    if (count > 0) {
+      put(0, 8 - count);
+    }
+  }
+};
+
+// Fixed literal/length code, RFC 1951 3.2.6
+void put_symbol(BitWriter &w, unsigned sym) {
+  if (sym < 144) {
+    w.put_code(0x30 + sym, 8);
+  } else if (sym < 256) {
+    w.put_code(0x190 + sym - 144, 9);
+  } else if (sym < 280) {
+    w.put_code(sym - 256, 7);
+  } else {
+    w.put_code(0xc0 + sym - 280, 8);
+  }
+}
+
+void put_match(BitWriter &w, size_t length, size_t dist) {
+  int li = 28;
+  while (kLengthBase[li] > length) {
+    li--;
+  }
+  put_symbol(w, 257 + li);
+  w.put(length - kLengthBase[li], kLengthExtra[li]);
+
+  int di = 29;
+  while (kDistBase[di] > dist) {
+    di--;
+  }
+  w.put_code(di, 5);
+  w.put(dist - kDistBase[di], kDistExtra[di]);
+}
+
+uint32_t hash3(const uint8_t *p) {
+  const uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+  return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+// ---- decompressor (after Mark Adler's puff) ----
+
+struct Huffman {
+  uint16_t count[16];
+  uint16_t symbol[288];
+};
+
+struct Inflater {
+  const uint8_t *in;
+  size_t in_len;
+  size_t in_pos;
+  uint32_t bitbuf;
+  int bitcnt;
+  uint8_t *out;
+  size_t out_cap;
+  size_t out_pos;
+  bool error;
+  Huffman lencode;
+  Huffman distcode;
+
+  int bits(int need) {
+    uint32_t val = bitbuf;
+    while (bitcnt < need) {
+      if (in_pos >= in_len) {
+        error = true;
+        return 0;
+      }
+      val |= (uint32_t)in[in_pos++] << bitcnt;
+      bitcnt += 8;
+    }
+    bitbuf = val >> need;
+    bitcnt -= need;
+    return (int)(val & ((1UL << need) - 1));
+  }
+
+  int decode(const Huffman &h) {
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len <= 15; len++) {
+      code |= bits(1);
+      if (error) {
+        return -1;
+      }
+      const int count = h.count[len];
+      if (code - count < first) {
+        return h.symbol[index + (code - first)];
+      }
+      index += count;
+      first += count;
+      first <<= 1;
+      code <<= 1;
+    }
+    return -1;
+  }
+
+  bool stored() {
+    bitbuf = 0;
+    bitcnt = 0;
+    if (in_pos + 4 > in_len) {
+      return false;
+    }
+    const size_t len = in[in_pos] | (in[in_pos + 1] << 8);
+    const size_t nlen = in[in_pos + 2] | (in[in_pos + 3] << 8);
+    in_pos += 4;
+    if (len != (~nlen & 0xffff) || in_pos + len > in_len || out_pos + len > out_cap) {
+      return false;
+    }
+    memcpy(out + out_pos, in + in_pos, len);
+    in_pos += len;
+    out_pos += len;
+    return true;
+  }
+
+  bool codes() {
+    while (true) {
+      int sym = decode(lencode);
+      if (sym < 0) {
+        return false;
+      }
+      if (sym < 256) {
+        if (out_pos >= out_cap) {
+          return false;
+        }
+        out[out_pos++] = (uint8_t)sym;
+        continue;
+      }
+      if (sym == 256) {
+        return true;
+      }
+      sym -= 257;
+      if (sym >= 29) {
+        return false;
+      }
+      const size_t len = kLengthBase[sym] + bits(kLengthExtra[sym]);
+      const int dsym = decode(distcode);
+      if (dsym < 0 || dsym >= 30) {
+        return false;
+      }
+      const size_t dist = kDistBase[dsym] + bits(kDistExtra[dsym]);
+      if (error || dist > out_pos || out_pos + len > out_cap) {
+        return false;
+      }
+      for (size_t k = 0; k < len; k++) {
+        out[out_pos] = out[out_pos - dist];
+        out_pos++;
+      }
+    }
+  }
+
+  bool fixed() {
+    uint8_t lengths[288];
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    construct(lencode, lengths, 288);
+    memset(lengths, 5, 30);
+    construct(distcode, lengths, 30);
+    return codes();
+  }
+
+  bool dynamic() {
+    static const uint8_t kOrder[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                       11, 4,  12, 3, 13, 2, 14, 1, 15};
+    const int nlen = bits(5) + 257;
+    const int ndist = bits(5) + 1;
+    const int ncode = bits(4) + 4;
+    if (error || nlen > 286 || ndist > 30) {
+      return false;
+    }
+
+    uint8_t lengths[320];
+    int index = 0;
+    for (; index < ncode; index++) {
+      lengths[kOrder[index]] = bits(3);
+    }
+    for (; index < 19; index++) {
+      lengths[kOrder[index]] = 0;
+    }
+    if (error || construct(lencode, lengths, 19) != 0) {
+      return false;
+    }
+
+    index = 0;
+    while (index < nlen + ndist) {
+      const int sym = decode(lencode);
+      if (sym < 0) {
+        return false;
+      }
+      if (sym < 16) {
+        lengths[index++] = sym;
+        continue;
+      }
+      uint8_t len = 0;
+      int repeat;
+      if (sym == 16) {
+        if (index == 0) {
+          return false;
+        }
+        len = lengths[index - 1];
+        repeat = 3 + bits(2);
+      } else if (sym == 17) {
+        repeat = 3 + bits(3);
+      } else {
+        repeat = 11 + bits(7);
+      }
+      if (error || index + repeat > nlen + ndist) {
+        return false;
+      }
+      while (repeat--) {
+        lengths[index++] = len;
+      }
+    }
+    if (lengths[256] == 0) {
+      return false;
+    }
+
+    // Incomplete codes are only allowed with a single symbol
+    int left = construct(lencode, lengths, nlen);
+    if (left < 0 || (left > 0 && nlen - lencode.count[0] != 1)) {
+      return false;
+    }
+    left = construct(distcode, lengths + nlen, ndist);
+    if (left < 0 || (left > 0 && ndist - distcode.count[0] != 1)) {
+      return false;
+    }
+    return codes();
+  }
+
+  // Canonical code from code lengths; returns 0 when complete, > 0 when
+  // incomplete, < 0 when over-subscribed
+  static int construct(Huffman &h, const uint8_t *length, int n) {
+    memset(h.count, 0, sizeof(h.count));
+    for (int s = 0; s < n; s++) {
+      h.count[length[s]]++;
+    }
+    if (h.count[0] == n) {
+      return 0;
+    }
+    int left = 1;
+    for (int len = 1; len < 16; len++) {
+      left <<= 1;
+      left -= h.count[len];
+      if (left < 0) {
+        return left;
+      }
+    }
+    uint16_t offs[16];
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++) {
+      offs[len + 1] = offs[len] + h.count[len];
+    }
+    for (int s = 0; s < n; s++) {
+      if (length[s] != 0) {
+        h.symbol[offs[length[s]]++] = s;
+      }
+    }
+    return left;
+  }
+};
+
+}  // namespace
+
+bool gzip_is_gzip(const uint8_t *data, size_t len) {
+  return len >= kGzipHeaderBytes + kGzipTrailerBytes && data[0] == 0x1f && data[1] == 0x8b &&
+         data[2] == 8;
+}
+
+uint8_t *gzip_compress(const uint8_t *data, size_t len, size_t &out_len) {
+  out_len = 0;
+  // Literals cost at most 9 bits, so this bounds any input
+  const size_t cap = kGzipHeaderBytes + len + len / 8 + 16 + kGzipTrailerBytes;
+  uint8_t *out = (uint8_t *)big_malloc(cap);
+  uint32_t *head = (uint32_t *)big_malloc(kHashSize * sizeof(uint32_t));
+  if (out == nullptr || head == nullptr) {
+    free(out);
+    free(head);
+    return nullptr;
+  }
+  memset(head, 0, kHashSize * sizeof(uint32_t));  // positions + 1, 0 = empty
+
+  static const uint8_t kHeader[kGzipHeaderBytes] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+  memcpy(out, kHeader, kGzipHeaderBytes);
+  BitWriter w = {out, cap - kGzipTrailerBytes, kGzipHeaderBytes, 0, 0, false};
+  w.put(1, 1);  // BFINAL
+  w.put(1, 2);  // fixed Huffman
+
+  size_t i = 0;
+  while (i < len) {
+    size_t best = 0;
+    size_t dist = 0;
+    if (i + kMinMatch <= len) {
+      const uint32_t h = hash3(data + i);
+      const uint32_t candidate = head[h];
+      head[h] = i + 1;
+      if (candidate != 0 && i - (candidate - 1) <= kWindowBytes) {
+        const size_t from = candidate - 1;
+        const size_t limit = (len - i < kMaxMatch) ? len - i : kMaxMatch;
+        size_t n = 0;
+        while (n < limit && data[from + n] == data[i + n]) {
+          n++;
+        }
+        if (n >= kMinMatch) {
+          best = n;
+          dist = i - from;
+        }
+      }
+    }
+
+    if (best == 0) {
+      put_symbol(w, data[i]);
+      i++;
+      continue;
+    }
+    put_match(w, best, dist);
+    // Index the covered positions too, so repeats inside the match are found
+    for (size_t k = i + 1; k < i + best && k + kMinMatch <= len; k++) {
+      head[hash3(data + k)] = k + 1;
+    }
+    i += best;
+  }
+  put_symbol(w, 256);
+  w.flush();
+  free(head);
+
+  if (w.overflow) {
+    free(out);
+    return nullptr;
+  }
+  put_le32(out + w.pos, crc32_update(0, data, len));
+  put_le32(out + w.pos + 4, (uint32_t)len);
+  out_len = w.pos + kGzipTrailerBytes;
+  return out;
+}
+
+bool gzip_decompress(const uint8_t *data, size_t len, size_t max_bytes, String &out,
+                     String &error_out) {
+  if (!gzip_is_gzip(data, len)) {
+    error_out = "not gzip data";
+    return false;
+  }
+
+  const uint8_t flags = data[3];
+  size_t pos = kGzipHeaderBytes;
+  const size_t body_end = len - kGzipTrailerBytes;
+  if (flags & kGzipFlagExtra) {
+    if (pos + 2 > body_end) {
+      error_out = "truncated gzip header";
+      return false;
+    }
+    pos += 2 + (data[pos] | (data[pos + 1] << 8));
+  }
+  if (flags & kGzipFlagName) {
+    while (pos < body_end && data[pos] != 0) {
+      pos++;
+    }
+    pos++;
+  }
+  if (flags & kGzipFlagComment) {
+    while (pos < body_end && data[pos] != 0) {
+      pos++;
+    }
+    pos++;
+  }
+  if (flags & kGzipFlagHcrc) {
+    pos += 2;
+  }
+  if (pos > body_end) {
+    error_out = "truncated gzip header";
+    return false;
+  }
+
+  const uint32_t expect_crc = get_le32(data + body_end);
+  const uint32_t expect_size = get_le32(data + body_end + 4);
+  if (expect_size > max_bytes) {
+    error_out = "expands to " + String((unsigned long)expect_size) + " bytes, limit " +
+                String((unsigned long)max_bytes);
+    return false;
+  }
+
+  Inflater *inf = (Inflater *)malloc(sizeof(Inflater));
+  uint8_t *buf = (uint8_t *)big_malloc(expect_size + 1);
+  if (inf == nullptr || buf == nullptr) {
+    free(inf);
+    free(buf);
+    error_out = "out of memory for " + String((unsigned long)expect_size) + " bytes";
+    return false;
+  }
+  inf->in = data + pos;
+  inf->in_len = body_end - pos;
+  inf->in_pos = 0;
+  inf->bitbuf = 0;
+  inf->bitcnt = 0;
+  inf->out = buf;
+  inf->out_cap = expect_size;
+  inf->out_pos = 0;
+  inf->error = false;
+
+  bool ok = true;
+  bool last = false;
+  while (ok && !last) {
+    last = inf->bits(1) != 0;
+    const int type = inf->bits(2);
+    if (inf->error) {
+      ok = false;
+    } else if (type == 0) {
+      ok = inf->stored();
+    } else if (type == 1) {
+      ok = inf->fixed();
+    } else if (type == 2) {
+      ok = inf->dynamic();
+    } else {
+      ok = false;
+    }
+  }
+
+  const size_t produced = inf->out_pos;
+  free(inf);
+  if (!ok || produced != expect_size) {
+    free(buf);
+    error_out = "corrupt deflate stream";
+    return false;
+  }
+  if (crc32_update(0, buf, produced) != expect_crc) {
+    free(buf);
+    error_out = "CRC mismatch";
+    return false;
+  }
+  out.concat((const char *)buf, produced);
+  free(buf);
+  return true;
+}
@@ -0,0 +1,24 @@
+#ifndef GZIP_CODEC_H
+#define GZIP_CODEC_H
+
+#include <Arduino.h>
+
+// Minimal gzip (RFC 1952) for files at rest. The compressor emits a single
+// fixed-Huffman deflate block with greedy LZ77 matching over a 32 KB window:
+// no dynamic trees and one 16 KB hash table, so it is cheap enough for the
+// agent task yet still 2-4x on HTML, CSS, JS and prose. The output is a real
+// .gz, so the web server can send it as-is with Content-Encoding: gzip. The
+// decompressor takes any single-member gzip (stored, fixed or dynamic blocks).
+
+bool gzip_is_gzip(const uint8_t *data, size_t len);
+
+// Compress len bytes. Returns a big_malloc'd buffer the caller free()s, with
+// its size in out_len, or nullptr when out of memory.
+uint8_t *gzip_compress(const uint8_t *data, size_t len, size_t &out_len);
+
+// Expand one gzip member into out (appended as text). Fails when the data is
+// corrupt, its CRC does not match, or it expands past max_bytes.
+bool gzip_decompress(const uint8_t *data, size_t len, size_t max_bytes, String &out,
+                     String &error_out);
+
+#endif
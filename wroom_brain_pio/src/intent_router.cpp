@@ -0,0 +1,305 @@
+#include "intent_router.h"
+
+#include <Arduino.h>
+
+#include "brain_config.h"
+
+namespace {
+
+enum LocalIntent {
+  INTENT_WEATHER = 0,
+  INTENT_TIME,
+  INTENT_SEARCH,
+  INTENT_IMAGE,
+  INTENT_WEB_FILES,
+  INTENT_TASK_LIST,
+};
+
+struct IntentCue {
+  const char *phrase;  // lowercase, matched on word boundaries
+  int weight;
+};
+
+struct IntentSpec {
+  LocalIntent id;
+  const char *command;
+  const IntentCue *cues;
+  size_t cue_count;
+};
+
+// clang-format off
+const IntentCue kWeatherCues[] = {
+    {"weather", 4}, {"forecast", 4}, {"temperature", 3}, {"raining", 2}, {"rain", 2},
+    {"sunny", 2}, {"humidity", 2}, {"how hot", 2}, {"how cold", 2},
+};
+
+const IntentCue kTimeCues[] = {
+    {"what time is it", 5}, {"what's the time", 5}, {"whats the time", 5},
+    {"current time", 5}, {"time now", 4}, {"time", 1}, {"clock", 1},
+};
+
+const IntentCue kSearchCues[] = {
+    {"search", 4}, {"look up", 4}, {"lookup", 4}, {"google", 4}, {"news", 3},
+    {"headlines", 3}, {"who won", 3}, {"latest", 2}, {"price of", 2}, {"find", 1},
+    {"score", 1}, {"stock", 1},
+};
+
+#if ENABLE_IMAGE_GEN
+const IntentCue kImageCues[] = {
+    {"draw", 4}, {"image", 3}, {"picture", 3}, {"illustration", 3}, {"photo", 1},
+    {"logo", 1}, {"generate", 1}, {"create", 1}, {"make", 1},
+    // Questions about an uploaded photo belong to media understanding
+    {"this image", -8}, {"this photo", -8}, {"this picture", -8},
+};
+#endif
+
+#if ENABLE_WEB_JOBS
+const IntentCue kWebFilesCues[] = {
+    {"website", 3}, {"web page", 3}, {"webpage", 3}, {"landing page", 3}, {"html", 2},
+    {"portfolio", 1}, {"build", 1}, {"create", 1}, {"make", 1},
+};
+#endif
+
+#if ENABLE_TASKS
+const IntentCue kTaskListCues[] = {
+    {"list tasks", 5}, {"show tasks", 5}, {"my tasks", 4}, {"task list", 4},
+    {"pending tasks", 4}, {"todo list", 4}, {"to-do list", 4}, {"to do list", 4},
+    {"tasks", 1},
+};
+#endif
+
+#define INTENT_CUES(arr) arr, sizeof(arr) / sizeof(arr[0])
+
+const IntentSpec kIntents[] = {
+    {INTENT_WEATHER, "weather", INTENT_CUES(kWeatherCues)},
+    {INTENT_TIME, "time", INTENT_CUES(kTimeCues)},
+    {INTENT_SEARCH, "search", INTENT_CUES(kSearchCues)},
+#if ENABLE_IMAGE_GEN
+    {INTENT_IMAGE, "generate_image", INTENT_CUES(kImageCues)},
+#endif
+#if ENABLE_WEB_JOBS
+    {INTENT_WEB_FILES, "web_files_make", INTENT_CUES(kWebFilesCues)},
+#endif
+#if ENABLE_TASKS
+    {INTENT_TASK_LIST, "task_list", INTENT_CUES(kTaskListCues)},
+#endif
+};
+
+// Scheduling requests go to the natural-language parsers or ReAct; no single
+// routed tool command can express them.
+const char *const kScheduleVetoes[] = {
+    "remind", "reminder", "every day", "everyday", "daily", "schedule", "alarm", "wake me",
+};
+// clang-format on
+
+const size_t kIntentCount = sizeof(kIntents) / sizeof(kIntents[0]);
+
+bool is_word_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+bool has_phrase(const String &lc, const char *phrase) {
+  const size_t plen = strlen(phrase);
+  int from = 0;
+  while (true) {
+    const int idx = lc.indexOf(phrase, from);
+    if (idx < 0) {
+      return false;
+    }
+    const size_t end = (size_t)idx + plen;
+    const bool left_ok = idx == 0 || !is_word_char(lc[idx - 1]);
+    const bool right_ok = end >= lc.length() || !is_word_char(lc[end]);
+    if (left_ok && right_ok) {
+      return true;
+    }
+    from = idx + 1;
+  }
+}
+
+int score_intent(const String &lc, const IntentSpec &spec) {
+  int score = 0;
+  for (size_t i = 0; i < spec.cue_count; i++) {
+    if (has_phrase(lc, spec.cues[i].phrase)) {
+      score += spec.cues[i].weight;
+    }
+  }
+  return score;
+}
+
+// Drop the first matching prefix from text (lc is its lowercase twin), keeping
+// the original casing of what remains.
+void strip_prefixes(String &text, String &lc, const char *const prefixes[], size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (lc.startsWith(prefixes[i])) {
+      const size_t n = strlen(prefixes[i]);
+      text.remove(0, n);
+      lc.remove(0, n);
+      return;
+    }
+  }
+}
+
+void trim_tail_punct(String &text) {
+  text.trim();
+  while (text.length() > 0) {
+    const char c = text[text.length() - 1];
+    if (c != '?' && c != '!' && c != '.' && c != ',') {
+      break;
+    }
+    text.remove(text.length() - 1);
+    text.trim();
+  }
+}
+
+bool extract_weather_location(const String &text, const String &lc, String &loc_out) {
+  const char *const markers[] = {" in ", " for ", " at "};
+  int best = -1;
+  size_t best_len = 0;
+  for (size_t i = 0; i < sizeof(markers) / sizeof(markers[0]); i++) {
+    const int idx = lc.lastIndexOf(markers[i]);
+    if (idx > best) {
+      best = idx;
+      best_len = strlen(markers[i]);
+    }
+  }
+  if (best < 0) {
+    return false;
+  }
+
+  size_t start = best + best_len;
+  while (start < lc.length() && lc[start] == ' ') {
+    start++;
+  }
+  String loc_lc = lc.substring(start);
+  const char *const tails[] = {" right now", " today", " tomorrow", " now", " this week"};
+  bool stripped = true;
+  while (stripped) {
+    stripped = false;
+    trim_tail_punct(loc_lc);
+    for (size_t i = 0; i < sizeof(tails) / sizeof(tails[0]); i++) {
+      if (loc_lc.endsWith(tails[i])) {
+        loc_lc.remove(loc_lc.length() - strlen(tails[i]));
+        stripped = true;
+        break;
+      }
+    }
+  }
+  loc_out = text.substring(start, start + loc_lc.length());
+  return loc_out.length() > 0;
+}
+
+bool build_command(const IntentSpec &spec, const String &message, const String &lc,
+                   String &command_out) {
+  String text = message;
+  String text_lc = lc;
+
+  switch (spec.id) {
+    case INTENT_WEATHER: {
+      String loc;
+      if (!extract_weather_location(text, text_lc, loc)) {
+        return false;
+      }
+      command_out = String(spec.command) + " " + loc;
+      return true;
+    }
+
+    case INTENT_TIME:
+    case INTENT_TASK_LIST:
+      command_out = spec.command;
+      return true;
+
+    case INTENT_SEARCH: {
+      const char *const politeness[] = {"can you ", "could you ", "please "};
+      const char *const verbs[] = {"search the web for ", "search web for ", "search for ",
+                                   "search ", "look up ", "lookup ", "google ", "find "};
+      strip_prefixes(text, text_lc, politeness, sizeof(politeness) / sizeof(politeness[0]));
+      strip_prefixes(text, text_lc, verbs, sizeof(verbs) / sizeof(verbs[0]));
+      trim_tail_punct(text);
+      if (text.length() == 0) {
+        return false;
+      }
+      command_out = String(spec.command) + " " + text;
+      return true;
+    }
+
+    case INTENT_IMAGE: {
+      const char *const politeness[] = {"can you ", "could you ", "please "};
+      const char *const verbs[] = {"generate ", "create ", "make ", "draw ", "paint "};
+      const char *const articles[] = {"me an ", "me a ", "an ", "a "};
+      const char *const nouns[] = {"image of ", "picture of ", "photo of ", "illustration of ",
+                                   "image ", "picture "};
+      strip_prefixes(text, text_lc, politeness, sizeof(politeness) / sizeof(politeness[0]));
+      strip_prefixes(text, text_lc, verbs, sizeof(verbs) / sizeof(verbs[0]));
+      strip_prefixes(text, text_lc, articles, sizeof(articles) / sizeof(articles[0]));
+      strip_prefixes(text, text_lc, nouns, sizeof(nouns) / sizeof(nouns[0]));
+      trim_tail_punct(text);
+      if (text.length() == 0) {
+        return false;
+      }
+      command_out = String(spec.command) + " " + text;
+      return true;
+    }
+
+    case INTENT_WEB_FILES:
+      command_out = String(spec.command) + " " + text;
+      return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+IntentRouteResult intent_route_local(const String &message, String &command_out) {
+  command_out = "";
+#if !INTENT_ROUTER_ENABLED
+  (void)message;
+  return INTENT_ROUTE_AMBIGUOUS;
+#else
+  String text = message;
+  text.trim();
+  if (text.length() == 0) {
+    return INTENT_ROUTE_NONE;
+  }
+  if (text.length() > INTENT_ROUTER_MAX_CHARS) {
+    // Long messages are rarely a single tool call; keep the old behaviour.
+    return INTENT_ROUTE_AMBIGUOUS;
+  }
+
+  String lc = text;
+  lc.toLowerCase();
+
+  for (size_t i = 0; i < sizeof(kScheduleVetoes) / sizeof(kScheduleVetoes[0]); i++) {
+    if (has_phrase(lc, kScheduleVetoes[i])) {
+      return INTENT_ROUTE_NONE;
+    }
+  }
+
+  int best = -1;
+  int best_score = 0;
+  int runner_up = 0;
+  for (size_t i = 0; i < kIntentCount; i++) {
+    const int score = score_intent(lc, kIntents[i]);
+    if (score > best_score) {
+      runner_up = best_score;
+      best_score = score;
+      best = (int)i;
+    } else if (score > runner_up) {
+      runner_up = score;
+    }
+  }
+
+  if (best < 0) {
+    // None of the routable tools is even hinted at; the LLM router could only say NONE.
+    return INTENT_ROUTE_NONE;
+  }
+  if (best_score < INTENT_ROUTER_MIN_SCORE ||
+      best_score - runner_up < INTENT_ROUTER_MIN_MARGIN) {
+    return INTENT_ROUTE_AMBIGUOUS;
+  }
+  if (!build_command(kIntents[best], text, lc, command_out)) {
+    command_out = "";
+    return INTENT_ROUTE_AMBIGUOUS;
+  }
+  return INTENT_ROUTE_LOCAL;
+#endif
+}
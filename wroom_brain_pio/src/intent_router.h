@@ -0,0 +1,18 @@
+#ifndef INTENT_ROUTER_H
+#define INTENT_ROUTER_H
+
+#include <Arduino.h>
+
+// On-device replacement for the LLM router round-trip. Scores the message
+// against a small table of weighted cue phrases per intent and either builds
+// the tool command locally, says no tool applies, or asks for the LLM router
+// when the score is too close to call.
+enum IntentRouteResult {
+  INTENT_ROUTE_NONE = 0,   // no tool cue at all; skip routing
+  INTENT_ROUTE_LOCAL,      // command_out holds the routed command
+  INTENT_ROUTE_AMBIGUOUS,  // fall back to llm_route_tool_command
+};
+
+IntentRouteResult intent_route_local(const String &message, String &command_out);
+
+#endif
@@ -0,0 +1,190 @@
+#include "keyword_matcher.h"
+
+#include <Arduino.h>
+#include <stdlib.h>
+
+namespace {
+
+const uint16_t kMaxNodes = 0xFFFF;
+
+inline uint8_t fold(char c) {
+  return (c >= 'A' && c <= 'Z') ? (uint8_t)(c + ('a' - 'A')) : (uint8_t)c;
+}
+
+}  // namespace
+
+KeywordMatcher::KeywordMatcher()
+    : nodes_(nullptr),
+      node_count_(0),
+      node_cap_(0),
+      groups_(nullptr),
+      pattern_count_(0),
+      pattern_cap_(0),
+      built_(false) {}
+
+KeywordMatcher::~KeywordMatcher() {
+  free(nodes_);
+  free(groups_);
+}
+
+void KeywordMatcher::clear() {
+  free(nodes_);
+  free(groups_);
+  nodes_ = nullptr;
+  groups_ = nullptr;
+  node_count_ = 0;
+  node_cap_ = 0;
+  pattern_count_ = 0;
+  pattern_cap_ = 0;
+  built_ = false;
+}
+
+bool KeywordMatcher::grow_nodes() {
+  if (node_cap_ >= kMaxNodes) {
+    return false;
+  }
+  uint32_t cap = node_cap_ == 0 ? 64 : (uint32_t)node_cap_ * 2;
+  if (cap > kMaxNodes) {
+    cap = kMaxNodes;
+  }
+  Node *grown = (Node *)realloc(nodes_, cap * sizeof(Node));
+  if (grown == nullptr) {
+    return false;
+  }
+  nodes_ = grown;
+  node_cap_ = (uint16_t)cap;
+  return true;
+}
+
+uint16_t KeywordMatcher::child(uint16_t node, uint8_t ch) const {
+  for (uint16_t c = nodes_[node].first_child; c != 0; c = nodes_[c].next_sibling) {
+    if (nodes_[c].ch == ch) {
+      return c;
+    }
+  }
+  return 0;
+}
+
+int KeywordMatcher::add(const char *pattern, uint32_t groups) {
+  if (pattern == nullptr || pattern[0] == '\0' || strlen(pattern) > 255) {
+    return -1;
+  }
+  if (node_count_ == 0) {
+    if (!grow_nodes()) {
+      return -1;
+    }
+    memset(&nodes_[0], 0, sizeof(Node));
+    node_count_ = 1;
+  }
+  built_ = false;
+
+  uint16_t node = 0;
+  for (const char *p = pattern; *p != '\0'; p++) {
+    const uint8_t ch = fold(*p);
+    uint16_t next = child(node, ch);
+    if (next == 0) {
+      if (node_count_ >= node_cap_ && !grow_nodes()) {
+        return -1;
+      }
+      next = node_count_++;
+      Node &n = nodes_[next];
+      memset(&n, 0, sizeof(Node));
+      n.ch = ch;
+      n.next_sibling = nodes_[node].first_child;
+      nodes_[node].first_child = next;
+    }
+    node = next;
+  }
+
+  if (nodes_[node].pattern != 0) {
+    const int id = nodes_[node].pattern - 1;
+    groups_[id] |= groups;
+    return id;
+  }
+
+  if (pattern_count_ >= pattern_cap_) {
+    const uint16_t cap = pattern_cap_ == 0 ? 16 : (uint16_t)(pattern_cap_ * 2);
+    uint32_t *grown = (uint32_t *)realloc(groups_, cap * sizeof(uint32_t));
+    if (grown == nullptr) {
+      return -1;
+    }
+    groups_ = grown;
+    pattern_cap_ = cap;
+  }
+  const int id = pattern_count_++;
+  groups_[id] = groups;
+  nodes_[node].pattern = (uint16_t)(id + 1);
+  return id;
+}
+
+void KeywordMatcher::build() {
+  built_ = false;
+  if (node_count_ == 0) {
+    return;
+  }
+
+  // Breadth-first so every fail target is final before its dependants.
+  uint16_t *queue = (uint16_t *)malloc(node_count_ * sizeof(uint16_t));
+  if (queue == nullptr) {
+    Serial.println("[keywords] build failed: out of memory");
+    return;
+  }
+  size_t head = 0;
+  size_t tail = 0;
+
+  nodes_[0].fail = 0;
+  nodes_[0].output = 0;
+  for (uint16_t c = nodes_[0].first_child; c != 0; c = nodes_[c].next_sibling) {
+    nodes_[c].fail = 0;
+    nodes_[c].output = 0;
+    queue[tail++] = c;
+  }
+
+  while (head < tail) {
+    const uint16_t node = queue[head++];
+    for (uint16_t c = nodes_[node].first_child; c != 0; c = nodes_[c].next_sibling) {
+      uint16_t f = nodes_[node].fail;
+      uint16_t target = child(f, nodes_[c].ch);
+      while (target == 0 && f != 0) {
+        f = nodes_[f].fail;
+        target = child(f, nodes_[c].ch);
+      }
+      nodes_[c].fail = target;
+      nodes_[c].output = nodes_[target].pattern != 0 ? target : nodes_[target].output;
+      queue[tail++] = c;
+    }
+  }
+
+  free(queue);
+  built_ = true;
+}
+
+uint32_t KeywordMatcher::match(const char *text, size_t len, uint32_t *hits,
+                               size_t hit_words) const {
+  if (!built_ || text == nullptr) {
+    return 0;
+  }
+
+  uint32_t groups = 0;
+  uint16_t state = 0;
+  for (size_t i = 0; i < len; i++) {
+    const uint8_t ch = fold(text[i]);
+    uint16_t next = child(state, ch);
+    while (next == 0 && state != 0) {
+      state = nodes_[state].fail;
+      next = child(state, ch);
+    }
+    state = next;
+
+    uint16_t out = nodes_[state].pattern != 0 ? state : nodes_[state].output;
+    while (out != 0) {
+      const uint16_t id = nodes_[out].pattern - 1;
+      groups |= groups_[id];
+      if (hits != nullptr && (size_t)(id / 32) < hit_words) {
+        hits[id / 32] |= (1UL << (id % 32));
+      }
+      out = nodes_[out].output;
+    }
+  }
+  return groups;
+}
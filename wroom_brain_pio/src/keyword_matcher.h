@@ -0,0 +1,62 @@
+#ifndef KEYWORD_MATCHER_H
+#define KEYWORD_MATCHER_H
+
+#include <Arduino.h>
+
+// Aho-Corasick multi-pattern matcher. Patterns are added once (lowercased) and
+// compiled with build(); match() then finds every pattern in a single pass over
+// the text, folding ASCII case on the fly and without heap allocation.
+//
+// Each pattern carries a bitmask of caller-defined groups; match() returns the
+// OR of the groups of all patterns found and can also mark the individual
+// pattern ids that hit. Rebuilding (clear/add/build) is not safe while another
+// task is matching.
+class KeywordMatcher {
+ public:
+  KeywordMatcher();
+  ~KeywordMatcher();
+
+  void clear();
+
+  // Returns the pattern id (adding the same text twice returns the same id and
+  // merges the groups), or -1 when the pattern is empty or memory runs out.
+  int add(const char *pattern, uint32_t groups = 0);
+  int add(const String &pattern, uint32_t groups = 0) { return add(pattern.c_str(), groups); }
+
+  void build();
+
+  int pattern_count() const { return pattern_count_; }
+
+  // hits, when given, is a bitset of hit_words 32-bit words indexed by pattern id.
+  uint32_t match(const char *text, size_t len, uint32_t *hits = nullptr,
+                 size_t hit_words = 0) const;
+  uint32_t match(const String &text, uint32_t *hits = nullptr, size_t hit_words = 0) const {
+    return match(text.c_str(), text.length(), hits, hit_words);
+  }
+
+ private:
+  struct Node {
+    uint16_t first_child;
+    uint16_t next_sibling;
+    uint16_t fail;
+    uint16_t output;    // nearest node on the fail chain that ends a pattern
+    uint16_t pattern;   // pattern id + 1, 0 when no pattern ends here
+    uint8_t ch;
+  };
+
+  KeywordMatcher(const KeywordMatcher &) = delete;
+  KeywordMatcher &operator=(const KeywordMatcher &) = delete;
+
+  bool grow_nodes();
+  uint16_t child(uint16_t node, uint8_t ch) const;
+
+  Node *nodes_;
+  uint16_t node_count_;
+  uint16_t node_cap_;
+  uint32_t *groups_;  // per pattern id
+  uint16_t pattern_count_;
+  uint16_t pattern_cap_;
+  bool built_;
+};
+
+#endif
@@ -3,20 +3,38 @@
 #include "agent_loop.h"
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include <HTTPClient.h>
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <new>
 
+#include "b64.h"
 #include "brain_config.h"
 #include "chat_history.h"
+#include "chat_scope.h"
+#include "flash_fs.h"
 #include "memory_store.h"
 #include "file_memory.h"
 #include "model_config.h"
 #include "persona_store.h"
+#include "psram_alloc.h"
+#include "react_agent.h"
+#include "response_cache.h"
 #include "usage_stats.h"
 #include "skill_registry.h"
+#include "soak.h"
 #include "scheduler.h"
 #include "cron_store.h"
+#include "context_budget.h"
+#include "context_cache.h"
+#include "trace.h"
+#include "wifi_link.h"
+#include <esp_timer.h>
 #include <time.h>
 
 namespace {
@@ -109,6 +127,10 @@ String build_time_context() {
 
 String build_schedule_context() {
   String out = "";
+  if (context_cache_get(CTX_SCHEDULE, out)) {
+    return out;
+  }
+  const uint32_t generation = context_cache_generation(CTX_SCHEDULE);
 
   CronJob jobs[CRON_MAX_JOBS];
   const int cron_count = cron_store_get_all(jobs, CRON_MAX_JOBS);
@@ -143,6 +165,7 @@ String build_schedule_context() {
     out += "Daily schedule: unknown";
   }
 
+  context_cache_put(CTX_SCHEDULE, out, generation);
   return out;
 }
 
@@ -159,27 +182,6 @@ bool contains_ci(const String &text, const char *needle_lower) {
   return hay.indexOf(needle_lower) >= 0;
 }
 
-int compute_llm_timeout_ms(size_t request_body_len) {
-  long timeout_ms = (long)LLM_TIMEOUT_MS;
-  // Large prompt payloads need extra server-side generation time.
-  if (request_body_len >= 20000) {
-    timeout_ms += 120000;
-  } else if (request_body_len >= 12000) {
-    timeout_ms += 90000;
-  } else if (request_body_len >= 7000) {
-    timeout_ms += 60000;
-  } else if (request_body_len >= 3500) {
-    timeout_ms += 30000;
-  }
-  if (timeout_ms < 20000) {
-    timeout_ms = 20000;
-  }
-  if (timeout_ms > 420000) {
-    timeout_ms = 420000;
-  }
-  return (int)timeout_ms;
-}
-
 String join_url(const String &base, const String &path) {
   if (base.endsWith("/") && path.startsWith("/")) {
     return base.substring(0, base.length() - 1) + path;
@@ -324,35 +326,584 @@ bool extract_json_string_field(const String &body, const char *field_name, Strin
   }
 }
 
-HttpResult http_post_json(const String &url, const String &body,
-                          const String &h1_name = "", const String &h1_value = "",
-                          const String &h2_name = "", const String &h2_value = "",
-                          const String &h3_name = "", const String &h3_value = "") {
+// Small per-host pool of keep-alive TLS connections. A single user message can
+// hit the same provider several times (route, ReAct steps, fact extraction), so
+// reusing the socket skips a full TCP + TLS handshake on every call.
+struct PooledConn {
+  String host;
+  WiFiClientSecure *client;
+  HTTPClient *https;
+  unsigned long last_used_ms;
+  bool busy;
+};
+
+PooledConn s_conn_pool[LLM_CONN_POOL_SIZE];
+portMUX_TYPE s_conn_pool_mux = portMUX_INITIALIZER_UNLOCKED;
+
+String url_host_key(const String &url) {
+  int start = url.indexOf("://");
+  start = (start < 0) ? 0 : start + 3;
+  int end = url.indexOf('/', start);
+  if (end < 0) {
+    end = url.length();
+  }
+  String host = url.substring(start, end);
+  host.toLowerCase();
+  return host;
+}
+
+// Observed response timing per host. TTFB is kept per KB of request body
+// (plus a 1KB floor) because prompt processing dominates it; body throughput
+// covers the part after the headers. Both are EWMAs with 1/4 weight.
+// Streamed (SSE) replies send headers before generating, buffered ones only
+// after, so their TTFB is tracked separately.
+struct HostTiming {
+  char host[48];
+  uint32_t ttfb_ms_per_kb[2];  // [buffered, streamed]
+  uint16_t ttfb_samples[2];
+  uint32_t body_bytes_per_s;
+  uint16_t samples;
+};
+
+const size_t kHostTimingSlots = 4;
+HostTiming s_host_timing[kHostTimingSlots];
+portMUX_TYPE s_host_timing_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Caller holds s_host_timing_mux. Returns nullptr when absent and !create.
+HostTiming *host_timing_slot(const String &host, bool create) {
+  HostTiming *oldest = nullptr;
+  for (size_t i = 0; i < kHostTimingSlots; i++) {
+    HostTiming &t = s_host_timing[i];
+    if (t.samples > 0 && strncmp(t.host, host.c_str(), sizeof(t.host)) == 0) {
+      return &t;
+    }
+    if (!oldest || t.samples < oldest->samples) {
+      oldest = &t;
+    }
+  }
+  if (!create) {
+    return nullptr;
+  }
+  // Evicts the least-sampled host; there are only a handful of providers.
+  memset(oldest, 0, sizeof(*oldest));
+  strncpy(oldest->host, host.c_str(), sizeof(oldest->host) - 1);
+  return oldest;
+}
+
+uint32_t ewma4(uint32_t avg, uint32_t sample, bool first) {
+  return first ? sample : (avg * 3 + sample) / 4;
+}
+
+void host_timing_record(const String &host, bool streamed, size_t request_len, uint32_t ttfb_ms,
+                        size_t body_bytes, uint32_t body_ms) {
+  const uint32_t per_kb = (uint32_t)((uint64_t)ttfb_ms * 1024 / (request_len + 1024));
+  portENTER_CRITICAL(&s_host_timing_mux);
+  HostTiming *t = host_timing_slot(host, true);
+  const int kind = streamed ? 1 : 0;
+  t->ttfb_ms_per_kb[kind] = ewma4(t->ttfb_ms_per_kb[kind], per_kb, t->ttfb_samples[kind] == 0);
+  if (t->ttfb_samples[kind] < 0xFFFF) {
+    t->ttfb_samples[kind]++;
+  }
+  // Tiny bodies say nothing about throughput.
+  if (body_bytes >= 512 && body_ms > 0) {
+    const uint32_t bps = (uint32_t)((uint64_t)body_bytes * 1000 / body_ms);
+    t->body_bytes_per_s = ewma4(t->body_bytes_per_s, bps, t->body_bytes_per_s == 0);
+  }
+  if (t->samples < 0xFFFF) {
+    t->samples++;
+  }
+  portEXIT_CRITICAL(&s_host_timing_mux);
+}
+
+int clamp_timeout_ms(uint32_t timeout_ms) {
+  // HTTPClient keeps its read timeout in a uint16_t.
+  if (timeout_ms < LLM_TIMEOUT_MIN_MS) {
+    timeout_ms = LLM_TIMEOUT_MIN_MS;
+  }
+  return (int)(timeout_ms > 65535 ? 65535 : timeout_ms);
+}
+
+// How long to wait for the response headers. Streamed calls to hosts with
+// enough history get a multiple of their expected TTFB for this request size,
+// so a hung server is given up on quickly; unknown hosts get the configured
+// LLM_TIMEOUT_MS. A buffered call's TTFB is the whole generation, which a
+// short routing reply says nothing about, so it never waits less than that.
+int compute_llm_timeout_ms(const String &host, size_t request_body_len, bool streamed) {
+  const int kind = streamed ? 1 : 0;
+  uint32_t per_kb = 0;
+  portENTER_CRITICAL(&s_host_timing_mux);
+  const HostTiming *t = host_timing_slot(host, false);
+  if (t && t->ttfb_samples[kind] >= LLM_TIMEOUT_MIN_SAMPLES) {
+    per_kb = t->ttfb_ms_per_kb[kind];
+  }
+  portEXIT_CRITICAL(&s_host_timing_mux);
+
+  if (per_kb == 0) {
+    return clamp_timeout_ms(LLM_TIMEOUT_MS);
+  }
+  const uint64_t expected_ms = (uint64_t)per_kb * (request_body_len + 1024) / 1024;
+  uint64_t timeout_ms = expected_ms * LLM_TIMEOUT_TTFB_FACTOR + LLM_TIMEOUT_SLACK_MS;
+  if (!streamed && timeout_ms < LLM_TIMEOUT_MS) {
+    timeout_ms = LLM_TIMEOUT_MS;
+  }
+  return clamp_timeout_ms(timeout_ms > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)timeout_ms);
+}
+
+// Longest gap tolerated between body reads once headers arrived: several
+// TCP segments' worth at the host's observed throughput. Streamed replies
+// arrive at generation speed, so a slow but steady stream keeps going.
+int compute_body_timeout_ms(const String &host, int header_timeout_ms) {
+  uint32_t bps = 0;
+  portENTER_CRITICAL(&s_host_timing_mux);
+  const HostTiming *t = host_timing_slot(host, false);
+  if (t && t->samples >= LLM_TIMEOUT_MIN_SAMPLES) {
+    bps = t->body_bytes_per_s;
+  }
+  portEXIT_CRITICAL(&s_host_timing_mux);
+
+  if (bps == 0) {
+    return header_timeout_ms;
+  }
+  const uint32_t gap_ms = (uint32_t)(4ULL * 1460 * 1000 / bps) + LLM_TIMEOUT_SLACK_MS;
+  return clamp_timeout_ms(gap_ms);
+}
+
+// Seconds from a Retry-After header; the HTTP-date form is treated as absent.
+long parse_retry_after_ms(const String &value) {
+  String v = value;
+  v.trim();
+  if (v.length() == 0) {
+    return -1;
+  }
+  for (size_t i = 0; i < v.length(); i++) {
+    if (!isdigit((unsigned char)v[i])) {
+      return -1;
+    }
+  }
+  return v.toInt() * 1000L;
+}
+
+// Exponential backoff with jitter: uniform in [d/2, d] for d = base * 2^attempt.
+uint32_t backoff_ms(int attempt) {
+  const uint32_t ceiling = (uint32_t)LLM_RETRY_BASE_MS << attempt;
+  return ceiling / 2 + (uint32_t)random((long)(ceiling / 2 + 1));
+}
+
+void conn_close(PooledConn &conn) {
+  if (conn.https) {
+    conn.https->end();
+    delete conn.https;
+    conn.https = nullptr;
+  }
+  if (conn.client) {
+    conn.client->stop();
+    delete conn.client;
+    conn.client = nullptr;
+  }
+  conn.host = "";
+}
+
+// Returns a slot reserved for `host`, or nullptr when every slot is busy with
+// another request (caller then falls back to a one-shot connection).
+PooledConn *conn_acquire(const String &host) {
+  const unsigned long now = millis();
+  int match = -1;
+  int empty = -1;
+  int oldest = -1;
+
+  portENTER_CRITICAL(&s_conn_pool_mux);
+  for (int i = 0; i < LLM_CONN_POOL_SIZE; i++) {
+    PooledConn &c = s_conn_pool[i];
+    if (c.busy) {
+      continue;
+    }
+    if (c.client && c.host == host) {
+      match = i;
+      break;
+    }
+    if (!c.client) {
+      if (empty < 0) {
+        empty = i;
+      }
+    } else if (oldest < 0 || c.last_used_ms < s_conn_pool[oldest].last_used_ms) {
+      oldest = i;
+    }
+  }
+  int pick = match >= 0 ? match : (empty >= 0 ? empty : oldest);
+  if (pick >= 0) {
+    s_conn_pool[pick].busy = true;
+  }
+  portEXIT_CRITICAL(&s_conn_pool_mux);
+
+  if (pick < 0) {
+    return nullptr;
+  }
+
+  PooledConn &conn = s_conn_pool[pick];
+  if (conn.client && (conn.host != host || now - conn.last_used_ms > LLM_CONN_IDLE_MS)) {
+    conn_close(conn);
+  }
+  if (!conn.client) {
+    conn.client = new WiFiClientSecure();
+    conn.client->setInsecure();
+    conn.https = new HTTPClient();
+    conn.https->setReuse(true);
+    conn.host = host;
+  }
+  return &conn;
+}
+
+void conn_release(PooledConn *conn, bool keep) {
+  if (!conn) {
+    return;
+  }
+  if (!keep) {
+    conn_close(*conn);
+  }
+  conn->last_used_ms = millis();
+  portENTER_CRITICAL(&s_conn_pool_mux);
+  conn->busy = false;
+  portEXIT_CRITICAL(&s_conn_pool_mux);
+}
+
+// Two-pass prompt assembly: sections are registered first, then the output is
+// reserved once and filled, avoiding the realloc + temporary churn of chained
+// String concatenation. Registered Strings are referenced, not copied.
+class PromptBuilder {
+ public:
+  void add(const char *text) { add_part(text, nullptr); }
+  void add(const String &text) { add_part(nullptr, &text); }
+
+  size_t length() const {
+    size_t total = 0;
+    for (size_t i = 0; i < count_; i++) {
+      total += part_length(parts_[i]);
+    }
+    return total;
+  }
+
+  void build(String &out) const {
+    out = "";
+    out.reserve(length());
+    for (size_t i = 0; i < count_; i++) {
+      if (parts_[i].str) {
+        out += *parts_[i].str;
+      } else {
+        out += parts_[i].cstr;
+      }
+    }
+  }
+
+ private:
+  struct Part {
+    const char *cstr;
+    const String *str;
+  };
+  static const size_t kMaxParts = 32;
+
+  static size_t part_length(const Part &p) { return p.str ? p.str->length() : strlen(p.cstr); }
+
+  void add_part(const char *cstr, const String *str) {
+    if (count_ >= kMaxParts) {
+      Serial.println("[llm] PromptBuilder part limit reached");
+      return;
+    }
+    parts_[count_].cstr = cstr;
+    parts_[count_].str = str;
+    count_++;
+  }
+
+  Part parts_[kMaxParts];
+  size_t count_ = 0;
+};
+
+// Request body made of raw JSON fragments and strings that are JSON-escaped on
+// the fly while HTTPClient reads it. The escaped body never exists in RAM, and
+// length() is exact so it can be sent with a Content-Length header.
+class JsonBody : public Stream {
+ public:
+  JsonBody &raw(const char *text) { return add(text, nullptr, false); }
+  JsonBody &raw(const String &text) { return add(nullptr, &text, false); }
+  JsonBody &escaped(const String &text) { return add(nullptr, &text, true); }
+  JsonBody &escaped(const String &text, size_t start, size_t len) {
+    add(nullptr, &text, true, start, len);
+    return *this;
+  }
+  // The whole of an open file, sent raw (e.g. base64 media spooled to flash).
+  JsonBody &file(File &f) {
+    if (count_ >= kMaxParts) {
+      return overflow();
+    }
+    Part &p = parts_[count_++];
+    p.cstr = nullptr;
+    p.str = nullptr;
+    p.file = &f;
+    p.start = 0;
+    p.len = f.size();
+    p.escape = false;
+    length_ += p.len;
+    return *this;
+  }
+
+  size_t length() const { return length_; }
+  // A part was dropped; the body is malformed and must not be sent.
+  bool overflowed() const { return overflowed_; }
+
+  void rewind() {
+    part_ = 0;
+    offset_ = 0;
+    sent_ = 0;
+    esc_len_ = 0;
+    esc_pos_ = 0;
+    for (size_t i = 0; i < count_; i++) {
+      if (parts_[i].file) {
+        parts_[i].file->seek(parts_[i].start);
+      }
+    }
+  }
+
+  int available() override { return (int)(length_ - sent_); }
+
+  int peek() override { return -1; }
+
+  int read() override {
+    if (esc_pos_ < esc_len_) {
+      sent_++;
+      return (uint8_t)esc_[esc_pos_++];
+    }
+    while (part_ < count_) {
+      const Part &p = parts_[part_];
+      if (offset_ >= p.len) {
+        part_++;
+        offset_ = 0;
+        continue;
+      }
+      if (p.file) {
+        const int c = p.file->read();
+        if (c < 0) {
+          return -1;
+        }
+        offset_++;
+        sent_++;
+        return c;
+      }
+      const char c = p.str ? (*p.str)[p.start + offset_] : p.cstr[offset_];
+      offset_++;
+      if (p.escape) {
+        esc_len_ = escape_char(c, esc_);
+        esc_pos_ = 1;
+        sent_++;
+        return (uint8_t)esc_[0];
+      }
+      sent_++;
+      return (uint8_t)c;
+    }
+    return -1;
+  }
+
+  size_t readBytes(char *buffer, size_t length) override {
+    size_t n = 0;
+    while (n < length) {
+      // File parts are copied in blocks rather than byte by byte.
+      if (esc_pos_ >= esc_len_ && part_ < count_ && parts_[part_].file &&
+          offset_ < parts_[part_].len) {
+        const Part &p = parts_[part_];
+        size_t want = length - n;
+        if (want > p.len - offset_) {
+          want = p.len - offset_;
+        }
+        const size_t got = p.file->read((uint8_t *)buffer + n, want);
+        if (got == 0) {
+          break;
+        }
+        offset_ += got;
+        sent_ += got;
+        n += got;
+        continue;
+      }
+      const int c = read();
+      if (c < 0) {
+        break;
+      }
+      buffer[n++] = (char)c;
+    }
+    return n;
+  }
+
+  size_t write(uint8_t) override { return 0; }
+
+ private:
+  struct Part {
+    const char *cstr;
+    const String *str;
+    File *file;
+    size_t start;
+    size_t len;
+    bool escape;
+  };
+  // The Anthropic body is the largest: a fixed envelope of up to 15 parts
+  // (cached system blocks, cached final turn, stream flag) plus 3 per prior
+  // turn, and a ReAct run sends up to 2 * REACT_MAX_ITERATIONS prior turns.
+  static const size_t kEnvelopeParts = 16;
+  static const size_t kPartsPerTurn = 3;
+  static const size_t kMaxParts = kEnvelopeParts + kPartsPerTurn * 2 * REACT_MAX_ITERATIONS;
+
+  JsonBody &overflow() {
+    if (!overflowed_) {
+      Serial.println("[llm] JsonBody part limit reached; request dropped");
+    }
+    overflowed_ = true;
+    return *this;
+  }
+
+  // Same mapping as json_escape().
+  static size_t escape_char(char c, char *out) {
+    switch (c) {
+      case '\\': out[0] = '\\'; out[1] = '\\'; return 2;
+      case '"': out[0] = '\\'; out[1] = '"'; return 2;
+      case '\n': out[0] = '\\'; out[1] = 'n'; return 2;
+      case '\r': out[0] = '\\'; out[1] = 'r'; return 2;
+      case '\t': out[0] = '\\'; out[1] = 't'; return 2;
+      default:
+        out[0] = ((unsigned char)c < 0x20) ? ' ' : c;
+        return 1;
+    }
+  }
+
+  JsonBody &add(const char *cstr, const String *str, bool escape, size_t start = 0,
+                size_t len = SIZE_MAX) {
+    if (count_ >= kMaxParts) {
+      return overflow();
+    }
+    const size_t full = str ? str->length() : strlen(cstr);
+    if (start > full) {
+      start = full;
+    }
+    Part &p = parts_[count_++];
+    p.cstr = cstr;
+    p.str = str;
+    p.file = nullptr;
+    p.start = start;
+    p.len = (len > full - start) ? full - start : len;
+    p.escape = escape;
+    if (!escape) {
+      length_ += p.len;
+    } else {
+      char tmp[2];
+      for (size_t i = 0; i < p.len; i++) {
+        length_ += escape_char(str ? (*str)[start + i] : cstr[start + i], tmp);
+      }
+    }
+    return *this;
+  }
+
+  Part parts_[kMaxParts];
+  size_t count_ = 0;
+  size_t length_ = 0;
+  bool overflowed_ = false;
+  size_t part_ = 0;
+  size_t offset_ = 0;
+  size_t sent_ = 0;
+  char esc_[2];
+  size_t esc_len_ = 0;
+  size_t esc_pos_ = 0;
+};
+
+// Receives a 2xx response body incrementally. begin_body() gets Content-Length
+// (-1 when chunked) so implementations can reserve their output up front.
+class HttpBodySink : public Stream {
+ public:
+  virtual void begin_body(int content_length) { (void)content_length; }
+  // True when the server sends headers before generating (SSE).
+  virtual bool incremental() const { return false; }
+
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void flush() override {}
+};
+
+// When stream_out is set, a 2xx body is decoded (chunked transfer included) and
+// written into it as it arrives instead of being buffered into result.body.
+#if TRACE_ENABLED
+// Resolve and open the TLS socket up front so DNS and connect+handshake show
+// up as separate trace spans; HTTPClient then reuses the connected client.
+void connect_traced(WiFiClientSecure &client, const String &host_key) {
+  String host = host_key;
+  uint16_t port = 443;
+  const int colon = host.indexOf(':');
+  if (colon > 0) {
+    port = (uint16_t)host.substring(colon + 1).toInt();
+    host = host.substring(0, colon);
+  }
+
+  const int64_t dns_start = esp_timer_get_time();
+  IPAddress ip;
+  const bool resolved = WiFi.hostByName(host.c_str(), ip) == 1;
+  const int64_t dns_end = esp_timer_get_time();
+  trace_span_record("http.dns", dns_start, dns_end);
+  if (!resolved) {
+    return;
+  }
+  client.connect(host.c_str(), port);
+  trace_span_record("http.connect_tls", dns_end, esp_timer_get_time());
+}
+#endif
+
+HttpResult http_post_json_to(HttpBodySink *stream_out, const String &url, JsonBody &body,
+                             const String &h1_name, const String &h1_value,
+                             const String &h2_name, const String &h2_value,
+                             const String &h3_name, const String &h3_value) {
   HttpResult result{};
   result.status_code = -1;
 
-  if (WiFi.status() != WL_CONNECTED) {
+  if (!wifi_link_ready()) {
     result.error = "WiFi not connected";
     return result;
   }
+  if (body.overflowed()) {
+    result.error = "Request too large (JsonBody part limit)";
+    return result;
+  }
 
-  const int kMaxAttempts = 2;
+  const String host = url_host_key(url);
+  const bool tls = url.startsWith("https://");
+  const bool streamed = stream_out && stream_out->incremental();
+  const int kMaxAttempts = LLM_HTTP_MAX_ATTEMPTS;
+  const char *kCollectHeaders[] = {"Retry-After"};
   for (int attempt = 0; attempt < kMaxAttempts; attempt++) {
-    WiFiClientSecure client;
-    client.setInsecure();
+    // Plain http:// (the soak mock, a LAN ollama) gets a one-shot WiFiClient;
+    // only https:// goes through TLS and the keep-alive pool.
+    PooledConn *conn = tls ? conn_acquire(host) : nullptr;
+    WiFiClientSecure local_tls;
+    WiFiClient local_plain;
+    HTTPClient local_https;
+    WiFiClientSecure &tls_client = conn ? *conn->client : local_tls;
+    WiFiClient &client = tls ? static_cast<WiFiClient &>(tls_client) : local_plain;
+    HTTPClient &https = conn ? *conn->https : local_https;
+    if (tls && !conn) {
+      tls_client.setInsecure();
+    }
+#if TRACE_ENABLED
+    if (tls && !tls_client.connected()) {
+      connect_traced(tls_client, host);
+    }
+#endif
 
-    HTTPClient https;
     if (!https.begin(client, url)) {
       result.error = "HTTP begin failed";
+      conn_release(conn, false);
       if (attempt + 1 < kMaxAttempts) {
-        delay(220);
+        delay(backoff_ms(attempt));
         continue;
       }
       return result;
     }
 
+    const int header_timeout_ms = compute_llm_timeout_ms(host, body.length(), streamed);
     https.setConnectTimeout(12000);
-    https.setTimeout(compute_llm_timeout_ms(body.length()));
+    https.setTimeout(header_timeout_ms);
+    https.collectHeaders(kCollectHeaders, 1);
     https.addHeader("Content-Type", "application/json");
 
     if (h1_name.length()) {
@@ -365,25 +916,98 @@ HttpResult http_post_json(const String &url, const String &body,
       https.addHeader(h3_name, h3_value);
     }
 
-    result.status_code = https.POST((uint8_t *)body.c_str(), body.length());
+    body.rewind();
+    const int64_t send_start = esp_timer_get_time();
+    result.status_code = https.sendRequest("POST", &body, body.length());
+    const int64_t headers_at = esp_timer_get_time();
+    trace_span_record("http.ttfb", send_start, headers_at);
+    const uint32_t ttfb_ms = (uint32_t)((headers_at - send_start) / 1000);
+    const bool ok_status = result.status_code >= 200 && result.status_code < 300;
+    if (ok_status) {
+      https.setTimeout(compute_body_timeout_ms(host, header_timeout_ms));
+    }
+    if (stream_out && ok_status) {
+      // Never retry once bytes were streamed; the caller already saw them.
+      stream_out->begin_body(https.getSize());
+      const int written = https.writeToStream(stream_out);
+      const int64_t body_end = esp_timer_get_time();
+      trace_span_record("http.body", headers_at, body_end);
+      result.error = written < 0 ? https.errorToString(written) : String("");
+      https.end();
+      conn_release(conn, written >= 0);
+      if (written >= 0) {
+        host_timing_record(host, streamed, body.length(), ttfb_ms, (size_t)written,
+                           (uint32_t)((body_end - headers_at) / 1000));
+      }
+      return result;
+    }
     if (result.status_code > 0) {
       result.body = https.getString();
+      const int64_t body_end = esp_timer_get_time();
+      trace_span_record("http.body", headers_at, body_end);
       result.error = "";
+      const long retry_after_ms = parse_retry_after_ms(https.header("Retry-After"));
+      // end() keeps the socket open when the server allowed keep-alive.
       https.end();
-      return result;
+      conn_release(conn, true);
+      if (ok_status) {
+        host_timing_record(host, false, body.length(), ttfb_ms, result.body.length(),
+                           (uint32_t)((body_end - headers_at) / 1000));
+        return result;
+      }
+
+      // Overload responses are retried on the kept-alive socket when the
+      // server says how long to wait (503 also without a hint). A 429 with
+      // no hint, or a wait longer than LLM_RETRY_AFTER_MAX_MS, goes straight
+      // back so provider fallback can take over.
+      const bool overloaded = result.status_code == 429 || result.status_code == 503;
+      if (!overloaded || attempt + 1 >= kMaxAttempts) {
+        return result;
+      }
+      if (retry_after_ms < 0 && result.status_code == 429) {
+        return result;
+      }
+      if (retry_after_ms > LLM_RETRY_AFTER_MAX_MS) {
+        return result;
+      }
+      const uint32_t wait_ms = retry_after_ms >= 0
+                                   ? (uint32_t)retry_after_ms + (uint32_t)random(250)
+                                   : backoff_ms(attempt);
+      Serial.printf("[llm] HTTP %d from %s, retrying in %u ms\n", result.status_code,
+                    host.c_str(), (unsigned)wait_ms);
+      delay(wait_ms);
+      continue;
     }
 
+    // A reused socket may have been closed by the server while idle; drop the
+    // slot so the retry performs a fresh handshake.
     result.error = https.errorToString(result.status_code);
     https.end();
+    conn_release(conn, false);
 
+    // A server that stayed silent past a timeout sized from its own history
+    // is hung; retrying would only double the wait.
+    if (result.status_code == HTTPC_ERROR_READ_TIMEOUT) {
+      return result;
+    }
     if (attempt + 1 < kMaxAttempts) {
-      delay(260 + (attempt * 120));
+      delay(backoff_ms(attempt));
     }
   }
 
   return result;
 }
 
+HttpResult http_post_json(const String &url, const String &body,
+                          const String &h1_name = "", const String &h1_value = "",
+                          const String &h2_name = "", const String &h2_value = "",
+                          const String &h3_name = "", const String &h3_value = "") {
+  JsonBody json;
+  json.raw(body);
+  return http_post_json_to(nullptr, url, json, h1_name, h1_value, h2_name, h2_value,
+                           h3_name, h3_value);
+}
+
 bool parse_response_text(const String &body, String &text) {
   // OpenAI responses API compatibility fallback
   if (extract_json_string_field(body, "output_text", text)) {
@@ -447,137 +1071,366 @@ String summarize_http_error(const String &label, const HttpResult &res) {
   return label + " HTTP " + String(res.status_code);
 }
 
-bool call_openai_like(const String &base_url, const String &api_key, const String &model,
-                      const String &system_prompt, const String &task,
-                      String &response_out, String &error_out) {
-  const String url = join_url(base_url, "/v1/chat/completions");
-  const String body = String("{\"model\":\"") + json_escape(model) +
-                      "\",\"messages\":[{\"role\":\"system\",\"content\":\"" +
-                      json_escape(system_prompt) + "\"},{\"role\":\"user\",\"content\":\"" +
-                      json_escape(task) + "\"}],\"temperature\":0.2}";
+// Pulls the reply text out of a provider response while it streams in, so the
+// full body is never held in heap. Same field priority as parse_response_text
+// (output_text, then content, then text; first string occurrence of each),
+// decoded straight into the caller's buffer, including unicode escapes.
+class JsonTextExtractor : public HttpBodySink {
+ public:
+  explicit JsonTextExtractor(String &text_out) : out_(text_out) { out_ = ""; }
 
-  const HttpResult res =
-      http_post_json(url, body, "Authorization", "Bearer " + api_key);
-  if (res.status_code < 200 || res.status_code >= 300) {
-    error_out = summarize_http_error("LLM", res);
-    return false;
+  void begin_body(int content_length) override {
+    // Reply text is usually most of a chat completion body.
+    if (content_length > 0) {
+      const unsigned int cap = psram_available() ? kMaxReservePsram : kMaxReserve;
+      out_.reserve((unsigned int)content_length < cap ? content_length : cap);
+    }
   }
 
-  if (!parse_response_text(res.body, response_out)) {
-    error_out = "Could not parse provider response";
-    return false;
+  size_t write(uint8_t c) override {
+    feed((char)c);
+    return 1;
   }
 
-  return true;
-}
+  size_t write(const uint8_t *buffer, size_t size) override {
+    for (size_t i = 0; i < size; i++) {
+      feed((char)buffer[i]);
+    }
+    return size;
+  }
 
-bool call_anthropic(const String &base_url, const String &api_key, const String &model,
-                    const String &system_prompt, const String &task,
-                    String &response_out, String &error_out) {
-  const String url = join_url(base_url, "/v1/messages");
-  const String body = String("{\"model\":\"") + json_escape(model) +
-                      "\",\"max_tokens\":512,\"system\":\"" + json_escape(system_prompt) +
-                      "\",\"messages\":[{\"role\":\"user\",\"content\":\"" +
-                      json_escape(task) + "\"}]}";
+  bool found() const { return best_ < kFieldCount && (state_ != CAPTURE || capture_ != best_); }
 
-  const HttpResult res = http_post_json(url, body, "x-api-key", api_key,
-                                        "anthropic-version", "2023-06-01");
-  if (res.status_code < 200 || res.status_code >= 300) {
-    error_out = summarize_http_error("LLM", res);
-    return false;
-  }
+ private:
+  enum State { SCAN, IN_STRING, AFTER_KEY, AFTER_COLON, CAPTURE };
+  static const int kFieldCount = 3;
+  static const unsigned int kMaxReserve = 16384;
+  static const unsigned int kMaxReservePsram = 65536;
+  static const unsigned int kMaxTokenChars = 16;
 
-  if (!parse_response_text(res.body, response_out)) {
-    error_out = "Could not parse provider response";
-    return false;
+  int field_index(const String &token) const {
+    static const char *kFields[kFieldCount] = {"output_text", "content", "text"};
+    for (int i = 0; i < kFieldCount; i++) {
+      if (token == kFields[i]) {
+        return i;
+      }
+    }
+    return -1;
   }
 
-  return true;
-}
+  static bool is_ws(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
 
-bool call_gemini(const String &base_url, const String &api_key, const String &model,
-                 const String &system_prompt, const String &task,
-                 String &response_out, String &error_out) {
-  const String path = String("/v1beta/models/") + model + ":generateContent?key=" + api_key;
-  const String url = join_url(base_url, path);
-  const String prompt = system_prompt + String("\\n\\nUser message:\\n") + task;
-  const String body = String("{\"contents\":[{\"parts\":[{\"text\":\"") +
-                      json_escape(prompt) + "\"}]}]}";
+  void feed(char c) {
+    switch (state_) {
+      case SCAN:
+        if (c == '"') {
+          token_ = "";
+          esc_ = false;
+          state_ = IN_STRING;
+        }
+        return;
+
+      case IN_STRING:
+        if (esc_) {
+          esc_ = false;
+        } else if (c == '\\') {
+          esc_ = true;
+        } else if (c == '"') {
+          pending_ = field_index(token_);
+          state_ = pending_ >= 0 ? AFTER_KEY : SCAN;
+        } else if (token_.length() <= kMaxTokenChars) {
+          token_ += c;
+        }
+        return;
 
-  const HttpResult res = http_post_json(url, body);
-  if (res.status_code < 200 || res.status_code >= 300) {
-    error_out = summarize_http_error("LLM", res);
-    return false;
+      case AFTER_KEY:
+        if (is_ws(c)) {
+          return;
+        }
+        state_ = (c == ':') ? AFTER_COLON : SCAN;
+        if (state_ == SCAN) {
+          feed(c);
+        }
+        return;
+
+      case AFTER_COLON:
+        if (is_ws(c)) {
+          return;
+        }
+        if (c != '"') {
+          state_ = SCAN;
+          feed(c);
+          return;
+        }
+        esc_ = false;
+        unicode_left_ = 0;
+        if (pending_ < best_) {
+          // Higher-priority field than anything captured so far.
+          out_ = "";
+          best_ = pending_;
+          capture_ = pending_;
+          state_ = CAPTURE;
+        } else {
+          token_ = "";
+          state_ = IN_STRING;
+        }
+        return;
+
+      case CAPTURE:
+        capture_char(c);
+        return;
+    }
   }
 
-  if (!parse_response_text(res.body, response_out)) {
-    error_out = "Could not parse provider response";
-    return false;
+  void capture_char(char c) {
+    if (unicode_left_ > 0) {
+      const int v = hex_value(c);
+      code_unit_ = (code_unit_ << 4) | (v < 0 ? 0 : v);
+      if (--unicode_left_ == 0) {
+        emit_code_unit(code_unit_);
+      }
+      return;
+    }
+    if (esc_) {
+      esc_ = false;
+      switch (c) {
+        case 'n': out_ += '\n'; break;
+        case 'r': out_ += '\r'; break;
+        case 't': out_ += '\t'; break;
+        case 'b': out_ += '\b'; break;
+        case 'f': out_ += '\f'; break;
+        case 'u':
+          unicode_left_ = 4;
+          code_unit_ = 0;
+          break;
+        default: out_ += c; break;
+      }
+      return;
+    }
+    if (c == '\\') {
+      esc_ = true;
+    } else if (c == '"') {
+      if (high_surrogate_) {
+        append_utf8(0xFFFD);
+        high_surrogate_ = 0;
+      }
+      capture_ = -1;
+      state_ = SCAN;
+    } else {
+      out_ += c;
+    }
   }
 
-  return true;
-}
+  static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
 
-bool call_glm_zai(const String &endpoint_url, const String &api_key, const String &model,
-                  const String &system_prompt, const String &task,
-                  String &response_out, String &error_out) {
-  String url = endpoint_url;
-  if (!to_lower(url).endsWith("/chat/completions")) {
-    url = join_url(url, "/chat/completions");
+  void emit_code_unit(uint32_t unit) {
+    if (unit >= 0xD800 && unit <= 0xDBFF) {
+      high_surrogate_ = unit;
+      return;
+    }
+    if (unit >= 0xDC00 && unit <= 0xDFFF && high_surrogate_) {
+      append_utf8(0x10000 + ((high_surrogate_ - 0xD800) << 10) + (unit - 0xDC00));
+      high_surrogate_ = 0;
+      return;
+    }
+    high_surrogate_ = 0;
+    append_utf8(unit);
   }
 
-  const String body = String("{\"model\":\"") + json_escape(model) +
-                      "\",\"messages\":[{\"role\":\"system\",\"content\":\"" +
-                      json_escape(system_prompt) + "\"},{\"role\":\"user\",\"content\":\"" +
-                      json_escape(task) + "\"}],\"temperature\":0.2,\"stream\":false}";
+  void append_utf8(uint32_t cp) {
+    if (cp < 0x80) {
+      out_ += (char)cp;
+    } else if (cp < 0x800) {
+      out_ += (char)(0xC0 | (cp >> 6));
+      out_ += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      out_ += (char)(0xE0 | (cp >> 12));
+      out_ += (char)(0x80 | ((cp >> 6) & 0x3F));
+      out_ += (char)(0x80 | (cp & 0x3F));
+    } else {
+      out_ += (char)(0xF0 | (cp >> 18));
+      out_ += (char)(0x80 | ((cp >> 12) & 0x3F));
+      out_ += (char)(0x80 | ((cp >> 6) & 0x3F));
+      out_ += (char)(0x80 | (cp & 0x3F));
+    }
+  }
+
+  String &out_;
+  State state_ = SCAN;
+  String token_;
+  bool esc_ = false;
+  int pending_ = -1;
+  int best_ = kFieldCount;
+  int capture_ = -1;
+  int unicode_left_ = 0;
+  uint32_t code_unit_ = 0;
+  uint32_t high_surrogate_ = 0;
+};
 
+// POST body and decode the reply text from the response as it arrives.
+bool post_for_text(const char *label, const char *parse_error, const String &url,
+                   JsonBody &body, String &response_out, String &error_out,
+                   const String &h1_name = "", const String &h1_value = "",
+                   const String &h2_name = "", const String &h2_value = "") {
+  JsonTextExtractor extractor(response_out);
   const HttpResult res =
-      http_post_json(url, body, "Authorization", "Bearer " + api_key);
+      http_post_json_to(&extractor, url, body, h1_name, h1_value, h2_name, h2_value, "", "");
   if (res.status_code < 200 || res.status_code >= 300) {
-    error_out = summarize_http_error("LLM", res);
+    error_out = summarize_http_error(label, res);
     return false;
   }
-
-  if (!parse_response_text(res.body, response_out)) {
-    error_out = "Could not parse provider response";
+  if (!extractor.found()) {
+    error_out = res.error.length() > 0 ? String(label) + " read error: " + res.error
+                                       : String(parse_error);
     return false;
   }
-
   return true;
 }
 
-bool call_ollama(const String &base_url, const String &model,
-                 const String &system_prompt, const String &task,
-                 String &response_out, String &error_out) {
-  // Ollama uses /api/chat or /api/generate endpoint
-  String url = base_url;
-  if (!url.endsWith("/api/chat") && !url.endsWith("/api/generate")) {
-    // Prefer /api/chat for OpenAI-compatible format
-    url = join_url(base_url, "/api/chat");
+struct StreamSink {
+  llm_stream_cb_t cb;
+  void *ctx;
+  const volatile bool *cancel;  // set to stop reading the stream, or nullptr
+
+  bool cancelled() const { return cancel != nullptr && *cancel; }
+};
+
+// Stream adapter fed by HTTPClient::writeToStream(). Splits the SSE body into
+// lines and appends the text delta of each "data:" event to text_out.
+//   OpenAI-compatible: data: {"choices":[{"delta":{"content":"..."}}]}
+//   Anthropic:         data: {"type":"content_block_delta","delta":{"text":"..."}}
+class SseDeltaStream : public HttpBodySink {
+ public:
+  SseDeltaStream(const char *delta_field, String &text_out, const StreamSink *sink)
+      : delta_field_(delta_field), text_(text_out), sink_(sink) {
+    line_.reserve(512);
+  }
+
+  bool incremental() const override { return true; }
+
+  size_t write(uint8_t c) override {
+    if (sink_ && sink_->cancelled()) {
+      return 0;  // writeToStream() stops and the socket is dropped
+    }
+    if (c == '\n') {
+      handle_line();
+      line_ = "";
+    } else if (c != '\r' && line_.length() < kMaxLineChars) {
+      line_ += (char)c;
+    }
+    return 1;
+  }
+
+  size_t write(const uint8_t *buffer, size_t size) override {
+    if (sink_ && sink_->cancelled()) {
+      return 0;
+    }
+    for (size_t i = 0; i < size; i++) {
+      write(buffer[i]);
+    }
+    return size;
+  }
+
+  void finish() {
+    if (line_.length() > 0) {
+      handle_line();
+      line_ = "";
+    }
+  }
+
+  const String &error() const { return error_; }
+
+ private:
+  static const size_t kMaxLineChars = 4096;
+
+  void handle_line() {
+    if (!line_.startsWith("data:")) {
+      return;
+    }
+    String payload = line_.substring(5);
+    payload.trim();
+    if (payload.length() == 0 || payload == "[DONE]") {
+      return;
+    }
+    if (payload.indexOf("\"error\"") >= 0) {
+      if (!extract_json_string_field(payload, "message", error_)) {
+        error_ = "stream error";
+      }
+      return;
+    }
+
+    String delta;
+    if (!extract_json_string_field_after_anchor(payload, "\"delta\"", delta_field_, delta) ||
+        delta.length() == 0) {
+      return;
+    }
+    text_ += delta;
+    if (sink_ && sink_->cb) {
+      sink_->cb(text_, sink_->ctx);
+    }
   }
 
-  // Ollama /api/chat uses OpenAI-compatible format
-  const String body = String("{\"model\":\"") + json_escape(model) +
-                      "\",\"messages\":[{\"role\":\"system\",\"content\":\"" +
-                      json_escape(system_prompt) + "\"},{\"role\":\"user\",\"content\":\"" +
-                      json_escape(task) + "\"}],\"stream\":false}";
+  const char *delta_field_;
+  String &text_;
+  const StreamSink *sink_;
+  String line_;
+  String error_;
+};
+
+// Shared tail for streaming calls: POSTs body and decodes the event stream.
+bool post_streaming(const String &url, JsonBody &body, const char *delta_field,
+                    const StreamSink *sink, String &response_out, String &error_out,
+                    const String &h1_name, const String &h1_value,
+                    const String &h2_name = "", const String &h2_value = "") {
+  response_out = "";
+  response_out.reserve(1024);
+  SseDeltaStream parser(delta_field, response_out, sink);
+  const HttpResult res =
+      http_post_json_to(&parser, url, body, h1_name, h1_value, h2_name, h2_value, "", "");
+  parser.finish();
 
-  // Ollama doesn't use API key, pass empty string
-  const HttpResult res = http_post_json(url, body);
+  if (sink && sink->cancelled()) {
+    error_out = "cancelled";
+    return false;
+  }
   if (res.status_code < 200 || res.status_code >= 300) {
-    error_out = summarize_http_error("Ollama", res);
+    error_out = summarize_http_error("LLM", res);
     return false;
   }
-
-  // Ollama /api/chat returns OpenAI-compatible format
-  if (!parse_response_text(res.body, response_out)) {
-    error_out = "Could not parse Ollama response";
+  if (parser.error().length() > 0) {
+    error_out = "LLM stream error: " + parser.error();
     return false;
   }
-
+  if (response_out.length() == 0) {
+    error_out = res.error.length() > 0 ? "LLM stream interrupted: " + res.error
+                                       : String("Could not parse provider response");
+    return false;
+  }
+  // A truncated stream still produced usable text; keep it.
   return true;
 }
 
+// Earlier turns of a multi-message request, sent between the system prompt
+// and the final user task. They alternate user/assistant, starting with user.
+struct ChatTurns {
+  const LlmMessage *msgs;
+  size_t count;
+};
+
+// OpenAI-style turns; each closes the previous message object.
+void append_openai_turns(JsonBody &body, const ChatTurns *prior) {
+  for (size_t i = 0; prior && i < prior->count; i++) {
+    body.raw(prior->msgs[i].from_assistant ? "\"},{\"role\":\"assistant\",\"content\":\""
+                                           : "\"},{\"role\":\"user\",\"content\":\"")
+        .escaped(prior->msgs[i].content);
+  }
+}
+
 // Check if an error indicates quota/rate limit (should trigger fallback)
 static bool is_quota_error(const String &error) {
   String lc = error;
@@ -599,185 +1452,719 @@ static bool is_timeout_error(const String &error) {
          (lc.indexOf("connection reset") >= 0);
 }
 
-// Try to call a specific provider by name
-static bool try_provider(const String &provider, const String &model,
-                        const String &system_prompt, const String &task,
-                        String &response_out, String &error_out) {
-  String prov = to_lower(provider);
-
-  if (prov == "openai") {
-    String mod = model.length() > 0 ? model : String("gpt-4.1-mini");
-    String baseUrl = String(LLM_OPENAI_BASE_URL);
-    return call_openai_like(baseUrl, "", mod, system_prompt, task, response_out, error_out);
-  }
+// ---- Provider descriptors ----
+// One row per provider: wire format, auth style, endpoint and defaults.
+// call_provider() looks the name up once and streams the body for the row's
+// wire format straight into the connection, so another OpenAI-compatible
+// provider is one more row (its key slot and priority live in model_config).
 
-  if (prov == "anthropic") {
-    String mod = model.length() > 0 ? model : String("claude-3-5-sonnet-latest");
-    String baseUrl = String(LLM_ANTHROPIC_BASE_URL);
-    return call_anthropic(baseUrl, "", mod, system_prompt, task, response_out, error_out);
-  }
+enum ProviderWire : uint8_t { WIRE_OPENAI, WIRE_ANTHROPIC, WIRE_GEMINI };
 
-  if (prov == "gemini") {
-    String mod = model.length() > 0 ? model : String("gemini-2.0-flash");
-    String baseUrl = String(LLM_GEMINI_BASE_URL);
-    return call_gemini(baseUrl, "", mod, system_prompt, task, response_out, error_out);
-  }
+enum ProviderAuth : uint8_t {
+  AUTH_NONE,
+  AUTH_BEARER,     // Authorization: Bearer <key>
+  AUTH_ANTHROPIC,  // x-api-key + anthropic-version
+  AUTH_URL_KEY,    // ?key=<key> on the URL
+};
 
-  if (prov == "glm") {
-    String mod = model.length() > 0 ? model : String("glm-4.7");
-    String baseUrl = String(LLM_GLM_BASE_URL);
-    return call_glm_zai(baseUrl, "", mod, system_prompt, task, response_out, error_out);
-  }
+enum ToolFormat : uint8_t { TOOLS_NONE, TOOLS_OPENAI, TOOLS_ANTHROPIC, TOOLS_GEMINI };
+
+struct ProviderDesc {
+  const char *name;
+  const char *alias;  // accepted as well, or nullptr
+  ProviderWire wire;
+  ProviderAuth auth;
+  ToolFormat tools;            // native tool-calling format
+  const char *path;            // appended unless the base URL already ends in it
+  const char *alt_path;        // another endpoint the base URL may end in, or nullptr
+  const char *default_model;
+  const char *default_base_url;
+  const char *label;           // prefix of HTTP error messages
+  const char *parse_error;
+  const char *delta_field;     // text field of streamed events, nullptr = not streamed
+  bool temperature;            // sends "temperature":0.2
+};
 
-  if (prov == "openrouter" || prov == "openrouter.ai") {
-    String mod = model.length() > 0 ? model : String("qwen/qwen-2.5-coder-32b-instruct:free");
-    String baseUrl = "https://openrouter.ai/api";
-    return call_openai_like(baseUrl, "", mod, system_prompt, task, response_out, error_out);
-  }
+constexpr const char *kProviderParseError = "Could not parse provider response";
+
+constexpr ProviderDesc kProviders[] = {
+    {"openai", nullptr, WIRE_OPENAI, AUTH_BEARER, TOOLS_OPENAI, "/v1/chat/completions", nullptr,
+     "gpt-4.1-mini", LLM_OPENAI_BASE_URL, "LLM", kProviderParseError, "content", true},
+    {"openrouter", "openrouter.ai", WIRE_OPENAI, AUTH_BEARER, TOOLS_OPENAI,
+     "/v1/chat/completions", nullptr, "qwen/qwen-2.5-coder-32b-instruct:free",
+     "https://openrouter.ai/api", "LLM", kProviderParseError, "content", true},
+    {"anthropic", nullptr, WIRE_ANTHROPIC, AUTH_ANTHROPIC, TOOLS_ANTHROPIC, "/v1/messages", nullptr,
+     "claude-3-5-sonnet-latest", LLM_ANTHROPIC_BASE_URL, "LLM", kProviderParseError, "text",
+     false},
+    {"gemini", nullptr, WIRE_GEMINI, AUTH_URL_KEY, TOOLS_GEMINI, "/v1beta/models/", nullptr,
+     "gemini-2.0-flash", LLM_GEMINI_BASE_URL, "LLM", kProviderParseError, nullptr, false},
+    {"glm", nullptr, WIRE_OPENAI, AUTH_BEARER, TOOLS_NONE, "/chat/completions", nullptr, "glm-4.7",
+     LLM_GLM_BASE_URL, "LLM", kProviderParseError, nullptr, true},
+    // Ollama needs no API key; /api/chat takes the OpenAI message format
+    {"ollama", nullptr, WIRE_OPENAI, AUTH_NONE, TOOLS_NONE, "/api/chat", "/api/generate", "llama3",
+     "http://ollama.local:11434/api/generate", "Ollama", "Could not parse Ollama response",
+     nullptr, false},
+};
 
-  if (prov == "ollama") {
-    String mod = model.length() > 0 ? model : String("llama3");
-    String baseUrl = "http://ollama.local:11434/api/generate";
-    return call_ollama(baseUrl, mod, system_prompt, task, response_out, error_out);
+// Case-insensitive, so callers need not lower-case the configured name.
+const ProviderDesc *find_provider(const String &name) {
+  for (const ProviderDesc &p : kProviders) {
+    if (strcasecmp(name.c_str(), p.name) == 0 ||
+        (p.alias != nullptr && strcasecmp(name.c_str(), p.alias) == 0)) {
+      return &p;
+    }
   }
+  return nullptr;
+}
 
-  error_out = "Unsupported provider: " + provider;
-  return false;
+bool ends_with_ci(const String &value, const char *suffix) {
+  const size_t n = strlen(suffix);
+  return value.length() >= n && strcasecmp(value.c_str() + value.length() - n, suffix) == 0;
 }
 
-bool llm_generate_with_prompt(const String &system_prompt, const String &task, bool include_memory,
-                              String &response_out, String &error_out) {
-  // Enrich task with memory if requested
-  String enriched_task = task;
-  if (include_memory) {
-    String notes;
-    String mem_err;
-    if (memory_get_notes(notes, mem_err)) {
-      notes.trim();
-      if (notes.length() > 0) {
-        if (notes.length() > 400) {
-          notes = notes.substring(notes.length() - 400);
-        }
-        enriched_task = String("Persistent memory:\n") + notes + "\n\nTask:\n" + task;
-      }
+// Endpoint URL; an empty base_url selects the provider default.
+String provider_url(const ProviderDesc &p, const String &base_url, const String &model,
+                    const String &api_key) {
+  const String base = base_url.length() > 0 ? base_url : String(p.default_base_url);
+  if (p.wire == WIRE_GEMINI) {
+    String path = String(p.path) + model + ":generateContent";
+    if (p.auth == AUTH_URL_KEY) {
+      path += "?key=" + api_key;
     }
+    return join_url(base, path);
   }
+  if (ends_with_ci(base, p.path) || (p.alt_path != nullptr && ends_with_ci(base, p.alt_path))) {
+    return base;
+  }
+  return join_url(base, p.path);
+}
 
-  if (enriched_task.length() == 0) {
-    error_out = "Missing task text";
+struct ProviderHeaders {
+  String h1_name;
+  String h1_value;
+  String h2_name;
+  String h2_value;
+};
+
+void provider_headers(const ProviderDesc &p, const String &api_key, ProviderHeaders &out) {
+  if (p.auth == AUTH_BEARER) {
+    out.h1_name = "Authorization";
+    out.h1_value = "Bearer " + api_key;
+  } else if (p.auth == AUTH_ANTHROPIC) {
+    out.h1_name = "x-api-key";
+    out.h1_value = api_key;
+    out.h2_name = "anthropic-version";
+    out.h2_value = "2023-06-01";
+  }
+}
+
+// OpenAI chat format (OpenAI, OpenRouter, GLM, Ollama).
+void write_openai_body(JsonBody &body, const ProviderDesc &p, const String &model,
+                       const String &system_prompt, const String &task, const ChatTurns *prior,
+                       bool stream) {
+  body.raw("{\"model\":\"").escaped(model)
+      .raw("\",\"messages\":[{\"role\":\"system\",\"content\":\"").escaped(system_prompt);
+  append_openai_turns(body, prior);
+  body.raw("\"},{\"role\":\"user\",\"content\":\"").escaped(task).raw("\"}]");
+  if (p.temperature) {
+    body.raw(",\"temperature\":0.2");
+  }
+  body.raw(stream ? ",\"stream\":true}" : ",\"stream\":false}");
+}
+
+// The first stable_len chars of system_prompt are identical across calls; when
+// long enough they are sent as a separate block marked for Anthropic's prompt
+// cache so repeat calls (ReAct iterations, follow-up turns) skip reprocessing.
+// With prior turns the final user turn is marked too, so the next call of a
+// growing conversation reuses everything sent so far.
+void write_anthropic_body(JsonBody &body, const String &model, const String &system_prompt,
+                          const String &task, size_t stable_len, const ChatTurns *prior,
+                          bool stream) {
+  body.raw("{\"model\":\"").escaped(model).raw("\",\"max_tokens\":512,\"system\":");
+  if (LLM_PROMPT_CACHE_ENABLED && stable_len >= LLM_PROMPT_CACHE_MIN_CHARS &&
+      stable_len <= system_prompt.length()) {
+    body.raw("[{\"type\":\"text\",\"text\":\"").escaped(system_prompt, 0, stable_len)
+        .raw("\",\"cache_control\":{\"type\":\"ephemeral\"}}");
+    if (stable_len < system_prompt.length()) {
+      body.raw(",{\"type\":\"text\",\"text\":\"")
+          .escaped(system_prompt, stable_len, system_prompt.length() - stable_len)
+          .raw("\"}");
+    }
+    body.raw("]");
+  } else {
+    body.raw("\"").escaped(system_prompt).raw("\"");
+  }
+  body.raw(",\"messages\":[");
+  const size_t prior_count = prior ? prior->count : 0;
+  for (size_t i = 0; i < prior_count; i++) {
+    body.raw(prior->msgs[i].from_assistant ? "{\"role\":\"assistant\",\"content\":\""
+                                           : "{\"role\":\"user\",\"content\":\"")
+        .escaped(prior->msgs[i].content)
+        .raw("\"},");
+  }
+  if (LLM_PROMPT_CACHE_ENABLED && prior_count > 0) {
+    body.raw("{\"role\":\"user\",\"content\":[{\"type\":\"text\",\"text\":\"").escaped(task)
+        .raw("\",\"cache_control\":{\"type\":\"ephemeral\"}}]}]");
+  } else {
+    body.raw("{\"role\":\"user\",\"content\":\"").escaped(task).raw("\"}]");
+  }
+  body.raw(stream ? ",\"stream\":true}" : "}");
+}
+
+void write_gemini_body(JsonBody &body, const String &system_prompt, const String &task,
+                       const ChatTurns *prior) {
+  if (!prior || prior->count == 0) {
+    body.raw("{\"contents\":[{\"parts\":[{\"text\":\"").escaped(system_prompt)
+        .raw("\\n\\nUser message:\\n").escaped(task).raw("\"}]}]}");
+    return;
+  }
+  // No system role here: the prompt leads the first user turn.
+  body.raw("{\"contents\":[{\"role\":\"user\",\"parts\":[{\"text\":\"").escaped(system_prompt)
+      .raw("\\n\\nUser message:\\n").escaped(prior->msgs[0].content);
+  for (size_t i = 1; i < prior->count; i++) {
+    body.raw(prior->msgs[i].from_assistant
+                 ? "\"}]},{\"role\":\"model\",\"parts\":[{\"text\":\""
+                 : "\"}]},{\"role\":\"user\",\"parts\":[{\"text\":\"")
+        .escaped(prior->msgs[i].content);
+  }
+  body.raw("\"}]},{\"role\":\"user\",\"parts\":[{\"text\":\"").escaped(task).raw("\"}]}]}");
+}
+
+// Dispatch one request to the named provider; an empty model or base_url
+// selects the provider default. Streams through sink when the provider
+// streams. Every call feeds the provider's latency and error estimate in
+// model_config.
+bool call_provider(const String &provider, const String &api_key, const String &model,
+                   const String &base_url, const String &system_prompt, const String &task,
+                   String &response_out, String &error_out, const StreamSink *sink = nullptr,
+                   size_t stable_len = 0, const ChatTurns *prior = nullptr) {
+  const ProviderDesc *p = find_provider(provider);
+  if (p == nullptr) {
+    error_out = "Unsupported provider: " + provider;
     return false;
   }
+  const unsigned long started_ms = millis();
+  const String mod = model.length() > 0 ? model : String(p->default_model);
+  const String url = provider_url(*p, base_url, mod, api_key);
+  ProviderHeaders headers;
+  provider_headers(*p, api_key, headers);
+  const bool stream = sink != nullptr && p->delta_field != nullptr;
+
+  JsonBody body;
+  switch (p->wire) {
+    case WIRE_OPENAI:
+      write_openai_body(body, *p, mod, system_prompt, task, prior, stream);
+      break;
+    case WIRE_ANTHROPIC:
+      write_anthropic_body(body, mod, system_prompt, task, stable_len, prior, stream);
+      break;
+    case WIRE_GEMINI:
+      write_gemini_body(body, system_prompt, task, prior);
+      break;
+  }
 
-  // Get primary provider config
-  String primary_provider;
-  String primary_model;
-  ModelConfigInfo config;
+  const bool result =
+      stream ? post_streaming(url, body, p->delta_field, sink, response_out, error_out,
+                              headers.h1_name, headers.h1_value, headers.h2_name,
+                              headers.h2_value)
+             : post_for_text(p->label, p->parse_error, url, body, response_out, error_out,
+                             headers.h1_name, headers.h1_value, headers.h2_name,
+                             headers.h2_value);
+  model_config_record_call(p->name, (uint32_t)(millis() - started_ms), result);
+  return result;
+}
 
+// Active provider with its model, key and base URL from model_config (build
+// defaults when nothing is configured).
+bool resolve_active_provider(String &provider, String &model, String &api_key, String &base_url,
+                             String &error_out) {
+  if (soak_mock_active()) {
+    provider = "ollama";
+    model = "mock";
+    api_key = "mock";
+    base_url = soak_mock_base_url();
+    return true;
+  }
+  ModelConfigInfo config;
   if (model_config_get_active_config(config)) {
-    primary_provider = config.provider;
-    primary_model = config.model;
+    provider = config.provider;
+    model = config.model;
+    base_url = config.baseUrl;
   } else {
-    primary_provider = to_lower(String(LLM_PROVIDER));
-    primary_model = String(LLM_MODEL);
+    provider = to_lower(String(LLM_PROVIDER));
+    model = String(LLM_MODEL);
+    base_url = "";
   }
 
-  if (primary_provider == "none" || primary_provider.length() == 0) {
+  if (provider == "none" || provider.length() == 0) {
     error_out = "LLM disabled. Use: /model set <provider> <api_key>";
     return false;
   }
 
-  // Check if primary provider has API key
-  String primary_key = model_config_get_api_key(primary_provider);
-  if (primary_key.length() == 0) {
-    error_out = "No API key configured for " + primary_provider + ". Use: /model set " + primary_provider + " <your_api_key>";
+  api_key = model_config_get_api_key(provider);
+  if (api_key.length() == 0) {
+    error_out = "No API key for " + provider;
     return false;
   }
+  return true;
+}
 
-  // Try primary provider first
-  String provider = primary_provider;
-  String model = primary_model;
-  String api_key = primary_key;
-  bool using_fallback = false;
-  String fallback_reason = "";
+// ---- Native tool calling ----
+// The tool list is serialised once into the active provider's format and
+// cached; only a provider switch to another format rebuilds it. Turns are
+// serialised per call into one raw part, since a full run has more tool
+// calls and results than JsonBody has parts.
+
+const LlmToolSpec *g_tool_specs = nullptr;
+size_t g_tool_spec_count = 0;
+// One schema per ToolFormat, built on first use. Both agent lanes can run
+// ReAct at once, so the build holds g_tool_schema_lock; a built schema is
+// never changed again, and callers keep the reference without the lock.
+String g_tool_schemas[TOOLS_GEMINI + 1];
+SemaphoreHandle_t g_tool_schema_lock = nullptr;
+
+// {"type":"object","properties":{"args":{"type":"string","description":usage}}}
+// Gemini wants upper-case types and no parameters at all for a no-arg tool.
+void append_args_schema(String &out, const LlmToolSpec &spec, ToolFormat format) {
+  const bool gemini = format == TOOLS_GEMINI;
+  out += gemini ? "{\"type\":\"OBJECT\",\"properties\":{" : "{\"type\":\"object\",\"properties\":{";
+  if (spec.usage[0] != '\0') {
+    out += gemini ? "\"args\":{\"type\":\"STRING\",\"description\":\""
+                  : "\"args\":{\"type\":\"string\",\"description\":\"";
+    out += json_escape(spec.usage);
+    out += "\"}";
+  }
+  out += "}}";
+}
 
-  // Try provider (primary or fallback)
-  while (true) {
-    bool result = false;
-    String prov = to_lower(provider);
-
-    // Call the appropriate provider
-    if (prov == "openai") {
-      String mod = model.length() > 0 ? model : String("gpt-4.1-mini");
-      String baseUrl = config.baseUrl.length() > 0 ? config.baseUrl : String(LLM_OPENAI_BASE_URL);
-      result = call_openai_like(baseUrl, api_key, mod, system_prompt, enriched_task, response_out, error_out);
-    } else if (prov == "anthropic") {
-      String mod = model.length() > 0 ? model : String("claude-3-5-sonnet-latest");
-      String baseUrl = config.baseUrl.length() > 0 ? config.baseUrl : String(LLM_ANTHROPIC_BASE_URL);
-      result = call_anthropic(baseUrl, api_key, mod, system_prompt, enriched_task, response_out, error_out);
-    } else if (prov == "gemini") {
-      String mod = model.length() > 0 ? model : String("gemini-2.0-flash");
-      String baseUrl = config.baseUrl.length() > 0 ? config.baseUrl : String(LLM_GEMINI_BASE_URL);
-      result = call_gemini(baseUrl, api_key, mod, system_prompt, enriched_task, response_out, error_out);
-    } else if (prov == "glm") {
-      String mod = model.length() > 0 ? model : String("glm-4.7");
-      String baseUrl = config.baseUrl.length() > 0 ? config.baseUrl : String(LLM_GLM_BASE_URL);
-      result = call_glm_zai(baseUrl, api_key, mod, system_prompt, enriched_task, response_out, error_out);
-    } else if (prov == "openrouter" || prov == "openrouter.ai") {
-      // OpenRouter uses OpenAI-compatible API
-      String mod = model.length() > 0 ? model : String("qwen/qwen-2.5-coder-32b-instruct:free");
-      String baseUrl = config.baseUrl.length() > 0 ? config.baseUrl : String("https://openrouter.ai/api");
-      result = call_openai_like(baseUrl, api_key, mod, system_prompt, enriched_task, response_out, error_out);
-    } else if (prov == "ollama") {
-      String mod = model.length() > 0 ? model : String("llama3");
-      String baseUrl = config.baseUrl.length() > 0 ? config.baseUrl : String("http://ollama.local:11434/api/generate");
-      result = call_ollama(baseUrl, mod, system_prompt, enriched_task, response_out, error_out);
-    } else {
-      error_out = "Unsupported provider: " + provider;
-      if (using_fallback) {
-        error_out += " (fallback from " + primary_provider + ")";
+const String &tool_schema(ToolFormat format) {
+  String &out = g_tool_schemas[format];
+  xSemaphoreTake(g_tool_schema_lock, portMAX_DELAY);
+  if (out.length() > 0) {
+    xSemaphoreGive(g_tool_schema_lock);
+    return out;
+  }
+  out.reserve(g_tool_spec_count * 160);
+  out += format == TOOLS_GEMINI ? "[{\"functionDeclarations\":[" : "[";
+  for (size_t i = 0; i < g_tool_spec_count; i++) {
+    const LlmToolSpec &spec = g_tool_specs[i];
+    if (i > 0) {
+      out += ",";
+    }
+    out += format == TOOLS_OPENAI ? "{\"type\":\"function\",\"function\":{\"name\":\"" : "{\"name\":\"";
+    out += spec.name;
+    out += "\",\"description\":\"";
+    out += json_escape(spec.description);
+    out += "\"";
+    if (format == TOOLS_ANTHROPIC) {
+      out += ",\"input_schema\":";
+      append_args_schema(out, spec, format);
+    } else if (format == TOOLS_OPENAI || spec.usage[0] != '\0') {
+      out += ",\"parameters\":";
+      append_args_schema(out, spec, format);
+    }
+    out += format == TOOLS_OPENAI ? "}}" : "}";
+  }
+  out += format == TOOLS_GEMINI ? "]}]" : "]";
+  xSemaphoreGive(g_tool_schema_lock);
+  Serial.printf("[llm] tool schema: %u tools, %u bytes\n", (unsigned)g_tool_spec_count,
+                (unsigned)out.length());
+  return out;
+}
+
+String args_object(const LlmToolCall &call) {
+  return "{\"args\":\"" + json_escape(call.args) + "\"}";
+}
+
+// Everything after the system message: ,{user},{assistant+tool_calls},{tool}...
+void append_openai_tool_turns(String &out, const LlmToolTurn *turns, size_t count) {
+  out += ",{\"role\":\"user\",\"content\":\"" + json_escape(turns[0].text) + "\"}";
+  for (size_t t = 1; t < count; t++) {
+    const LlmToolTurn &turn = turns[t];
+    out += ",{\"role\":\"assistant\",\"content\":";
+    out += turn.text.length() > 0 ? "\"" + json_escape(turn.text) + "\"" : String("null");
+    if (turn.call_count > 0) {
+      out += ",\"tool_calls\":[";
+      for (size_t c = 0; c < turn.call_count; c++) {
+        const LlmToolCall &call = turn.calls[c];
+        out += c > 0 ? ",{\"id\":\"" : "{\"id\":\"";
+        out += json_escape(call.id) + "\",\"type\":\"function\",\"function\":{\"name\":\"" +
+               json_escape(call.name) + "\",\"arguments\":\"" + json_escape(args_object(call)) +
+               "\"}}";
       }
-      return false;
+      out += "]";
+    }
+    out += "}";
+    for (size_t c = 0; c < turn.call_count; c++) {
+      out += ",{\"role\":\"tool\",\"tool_call_id\":\"" + json_escape(turn.calls[c].id) +
+             "\",\"content\":\"" + json_escape(turn.calls[c].result) + "\"}";
     }
+  }
+}
 
-    // If successful, add fallback notice if applicable
-    if (result) {
-      if (using_fallback) {
-        response_out = "⚠️ Using " + provider + " (" + fallback_reason + ")\n\n" + response_out;
-      }
-      return true;
+void append_anthropic_tool_turns(String &out, const LlmToolTurn *turns, size_t count) {
+  out += "{\"role\":\"user\",\"content\":\"" + json_escape(turns[0].text) + "\"}";
+  for (size_t t = 1; t < count; t++) {
+    const LlmToolTurn &turn = turns[t];
+    out += ",{\"role\":\"assistant\",\"content\":[";
+    bool first = true;
+    if (turn.text.length() > 0) {
+      out += "{\"type\":\"text\",\"text\":\"" + json_escape(turn.text) + "\"}";
+      first = false;
+    }
+    for (size_t c = 0; c < turn.call_count; c++) {
+      const LlmToolCall &call = turn.calls[c];
+      out += first ? "" : ",";
+      out += "{\"type\":\"tool_use\",\"id\":\"" + json_escape(call.id) + "\",\"name\":\"" +
+             json_escape(call.name) + "\",\"input\":" + args_object(call) + "}";
+      first = false;
+    }
+    out += "]}";
+    if (turn.call_count == 0) {
+      continue;
     }
+    out += ",{\"role\":\"user\",\"content\":[";
+    for (size_t c = 0; c < turn.call_count; c++) {
+      out += c > 0 ? "," : "";
+      out += "{\"type\":\"tool_result\",\"tool_use_id\":\"" + json_escape(turn.calls[c].id) +
+             "\",\"content\":\"" + json_escape(turn.calls[c].result) + "\"}";
+    }
+    out += "]}";
+  }
+}
 
-    // Check if error is quota/rate limit (should trigger fallback)
-    if (!is_quota_error(error_out)) {
-      // Not a quota error, just fail
-      if (using_fallback) {
-        error_out += " (fallback from " + primary_provider + ")";
+void append_gemini_tool_turns(String &out, const LlmToolTurn *turns, size_t count) {
+  out += "{\"role\":\"user\",\"parts\":[{\"text\":\"" + json_escape(turns[0].text) + "\"}]}";
+  for (size_t t = 1; t < count; t++) {
+    const LlmToolTurn &turn = turns[t];
+    out += ",{\"role\":\"model\",\"parts\":[";
+    bool first = true;
+    if (turn.text.length() > 0) {
+      out += "{\"text\":\"" + json_escape(turn.text) + "\"}";
+      first = false;
+    }
+    for (size_t c = 0; c < turn.call_count; c++) {
+      const LlmToolCall &call = turn.calls[c];
+      out += first ? "{" : ",{";
+      out += "\"functionCall\":{\"name\":\"" + json_escape(call.name) + "\",\"args\":" +
+             args_object(call) + "}";
+      if (call.id.length() > 0) {
+        out += ",\"thoughtSignature\":\"" + json_escape(call.id) + "\"";
       }
-      return false;
+      out += "}";
+      first = false;
+    }
+    out += "]}";
+    if (turn.call_count == 0) {
+      continue;
     }
+    out += ",{\"role\":\"user\",\"parts\":[";
+    for (size_t c = 0; c < turn.call_count; c++) {
+      out += c > 0 ? "," : "";
+      out += "{\"functionResponse\":{\"name\":\"" + json_escape(turn.calls[c].name) +
+             "\",\"response\":{\"result\":\"" + json_escape(turn.calls[c].result) + "\"}}}";
+    }
+    out += "]}";
+  }
+}
 
-    // Quota error - mark provider as failed and try fallback
-    model_config_mark_provider_failed(provider, 429);
+// "args" of a call's argument object; a non-string value is taken as its JSON
+String call_args(JsonVariantConst args) {
+  JsonVariantConst value = args["args"];
+  if (value.isNull()) {
+    return "";
+  }
+  return value.is<const char *>() ? String(value.as<const char *>()) : value.as<String>();
+}
 
-    // Find fallback provider
-    String fallback = model_config_get_fallback_provider(provider);
-    if (fallback.length() == 0) {
-      // No fallback available
-      error_out += " (all providers failed or rate limited)";
+void add_tool_call(LlmToolTurn &reply, const String &id, const String &name,
+                   const String &args) {
+  if (reply.call_count >= LLM_TOOL_MAX_CALLS || name.length() == 0) {
+    return;
+  }
+  LlmToolCall &call = reply.calls[reply.call_count++];
+  call.id = id;
+  call.name = name;
+  call.args = args;
+  call.result = "";
+}
+
+bool parse_tool_reply(ToolFormat format, const String &body, LlmToolTurn &reply,
+                      String &error_out) {
+  JsonDocument doc;
+  if (deserializeJson(doc, body) != DeserializationError::Ok) {
+    error_out = "Could not parse tool-calling response";
+    return false;
+  }
+
+  if (format == TOOLS_OPENAI) {
+    JsonVariantConst message = doc["choices"][0]["message"];
+    if (message.isNull()) {
+      error_out = "Could not parse provider response";
+      return false;
+    }
+    reply.text = message["content"] | "";
+    for (JsonVariantConst call : message["tool_calls"].as<JsonArrayConst>()) {
+      // arguments is itself a JSON document, serialised as a string
+      JsonDocument args;
+      const String arguments = call["function"]["arguments"] | "";
+      String value;
+      if (deserializeJson(args, arguments) == DeserializationError::Ok) {
+        value = call_args(args.as<JsonVariantConst>());
+      }
+      add_tool_call(reply, call["id"] | "", call["function"]["name"] | "", value);
+    }
+  } else if (format == TOOLS_ANTHROPIC) {
+    JsonArrayConst content = doc["content"];
+    if (content.isNull()) {
+      error_out = "Could not parse provider response";
       return false;
     }
+    for (JsonVariantConst block : content) {
+      const String type = block["type"] | "";
+      if (type == "text") {
+        reply.text += block["text"] | "";
+      } else if (type == "tool_use") {
+        add_tool_call(reply, block["id"] | "", block["name"] | "", call_args(block["input"]));
+      }
+    }
+  } else {
+    JsonArrayConst parts = doc["candidates"][0]["content"]["parts"];
+    if (parts.isNull()) {
+      error_out = "Could not parse provider response";
+      return false;
+    }
+    for (JsonVariantConst part : parts) {
+      JsonVariantConst fn = part["functionCall"];
+      if (!fn.isNull()) {
+        add_tool_call(reply, part["thoughtSignature"] | "", fn["name"] | "", call_args(fn["args"]));
+      } else {
+        reply.text += part["text"] | "";
+      }
+    }
+  }
+  reply.text.trim();
+  return true;
+}
 
-    // Switch to fallback
-    using_fallback = true;
-    fallback_reason = primary_provider + " rate limited";
-    provider = fallback;
-    model = model_config_get_model(fallback);
-    api_key = model_config_get_api_key(fallback);
-    config.baseUrl = "";  // Reset for new provider
+bool call_with_tools(const ProviderDesc &p, const String &base_url, const String &api_key,
+                     const String &model, const String &system_prompt,
+                     const LlmToolTurn *turns, size_t count, LlmToolTurn &reply,
+                     String &error_out) {
+  const ToolFormat format = p.tools;
+  const String &tools = tool_schema(format);
+  const String url = provider_url(p, base_url, model, api_key);
+  ProviderHeaders headers;
+  provider_headers(p, api_key, headers);
+  String turns_json;
+  JsonBody body;
+
+  if (format == TOOLS_OPENAI) {
+    append_openai_tool_turns(turns_json, turns, count);
+    body.raw("{\"model\":\"").escaped(model)
+        .raw("\",\"messages\":[{\"role\":\"system\",\"content\":\"").escaped(system_prompt)
+        .raw("\"}").raw(turns_json)
+        .raw("],\"tools\":").raw(tools).raw(",\"temperature\":0.2}");
+  } else if (format == TOOLS_ANTHROPIC) {
+    append_anthropic_tool_turns(turns_json, turns, count);
+    // Tools come before the system prompt in Anthropic's cache order, so one
+    // breakpoint on the system block caches both.
+    body.raw("{\"model\":\"").escaped(model)
+        .raw("\",\"max_tokens\":1024,\"tools\":").raw(tools)
+        .raw(",\"system\":[{\"type\":\"text\",\"text\":\"").escaped(system_prompt);
+    body.raw(LLM_PROMPT_CACHE_ENABLED ? "\",\"cache_control\":{\"type\":\"ephemeral\"}}]"
+                                      : "\"}]");
+    body.raw(",\"messages\":[").raw(turns_json).raw("]}");
+  } else {
+    append_gemini_tool_turns(turns_json, turns, count);
+    body.raw("{\"systemInstruction\":{\"parts\":[{\"text\":\"").escaped(system_prompt)
+        .raw("\"}]},\"contents\":[").raw(turns_json)
+        .raw("],\"tools\":").raw(tools).raw("}");
+  }
 
-    Serial.printf("[llm] Switching to fallback provider: %s\n", provider.c_str());
+  const HttpResult res = http_post_json_to(nullptr, url, body, headers.h1_name, headers.h1_value,
+                                           headers.h2_name, headers.h2_value, "", "");
+  if (res.status_code < 200 || res.status_code >= 300) {
+    error_out = summarize_http_error(p.label, res);
+    return false;
+  }
+  return parse_tool_reply(format, res.body, reply, error_out);
+}
+
+// Hedged requests: the first attempt runs on a helper task so the caller can
+// start a second provider once LLM_HEDGE_AFTER_MS passes without an answer.
+// Whichever succeeds first wins; the other keeps running until its HTTP call
+// ends and the last holder frees the shared state.
+const uint32_t kHedgeTaskStack = 12288;
+
+struct HedgeAttempt {
+  String provider;
+  String api_key;
+  String model;
+  String base_url;
+  String reply;
+  String error;
+  bool ok;
+};
+
+struct HedgeRace;
+
+struct HedgeJob {
+  HedgeRace *race;
+  int index;
+};
+
+struct HedgeRace {
+  String system_prompt;
+  String task;
+  size_t stable_len;
+  HedgeAttempt attempts[2];
+  HedgeJob jobs[2];
+  QueueHandle_t done;  // indexes of finished attempts
+  int refs;
+};
+
+portMUX_TYPE s_hedge_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void hedge_release(HedgeRace *race) {
+  portENTER_CRITICAL(&s_hedge_mux);
+  const bool last = --race->refs == 0;
+  portEXIT_CRITICAL(&s_hedge_mux);
+  if (last) {
+    vQueueDelete(race->done);
+    delete race;
+  }
+}
+
+void hedge_task(void *param) {
+  HedgeJob *job = static_cast<HedgeJob *>(param);
+  HedgeRace *race = job->race;
+  const int index = job->index;
+  HedgeAttempt &a = race->attempts[index];
+  a.ok = call_provider(a.provider, a.api_key, a.model, a.base_url, race->system_prompt,
+                       race->task, a.reply, a.error, nullptr, race->stable_len);
+  xQueueSend(race->done, &index, 0);  // room for both attempts, never blocks
+  hedge_release(race);
+  vTaskDelete(NULL);
+}
+
+bool hedge_start(HedgeRace *race, int index) {
+  portENTER_CRITICAL(&s_hedge_mux);
+  race->refs++;
+  portEXIT_CRITICAL(&s_hedge_mux);
+  // On the network core, so the race runs alongside the agent lane
+  if (xTaskCreatePinnedToCore(hedge_task, "LlmHedge", kHedgeTaskStack, &race->jobs[index],
+                              TASK_PRIO_AGENT, NULL, TASK_CORE_NET) != pdPASS) {
+    hedge_release(race);
+    return false;
+  }
+  return true;
+}
+
+bool call_hedged(const String &provider, const String &api_key, const String &model,
+                 const String &base_url, const String &system_prompt, const String &task,
+                 size_t stable_len, String &response_out, String &error_out) {
+  const String backup = model_config_get_fallback_provider(provider);
+  HedgeRace *race = nullptr;
+  if (backup.length() > 0 && ESP.getFreeHeap() >= LLM_HEDGE_MIN_HEAP) {
+    race = new (std::nothrow) HedgeRace();
+  }
+  if (race != nullptr) {
+    race->done = xQueueCreate(2, sizeof(int));
+    if (race->done == nullptr) {
+      delete race;
+      race = nullptr;
+    }
+  }
+  if (race == nullptr) {
+    return call_provider(provider, api_key, model, base_url, system_prompt, task, response_out,
+                         error_out, nullptr, stable_len);
+  }
+
+  race->system_prompt = system_prompt;
+  race->task = task;
+  race->stable_len = stable_len;
+  race->attempts[0] = {provider, api_key, model, base_url, "", "", false};
+  race->attempts[1] = {backup, model_config_get_api_key(backup), model_config_get_model(backup),
+                       "", "", "", false};
+  race->jobs[0] = {race, 0};
+  race->jobs[1] = {race, 1};
+  race->refs = 1;
+  if (!hedge_start(race, 0)) {
+    hedge_release(race);
+    return call_provider(provider, api_key, model, base_url, system_prompt, task, response_out,
+                         error_out, nullptr, stable_len);
+  }
+
+  int started = 1;
+  int finished = 0;
+  bool ok = false;
+  String last_error;
+  TickType_t wait = pdMS_TO_TICKS(LLM_HEDGE_AFTER_MS);
+  while (finished < started) {
+    int index = -1;
+    if (xQueueReceive(race->done, &index, wait) != pdTRUE) {
+      // Still nothing from the first provider; both calls end on their own
+      // HTTP timeouts, so from here on wait for whichever answers.
+      wait = portMAX_DELAY;
+      if (ESP.getFreeHeap() >= LLM_HEDGE_MIN_HEAP && hedge_start(race, 1)) {
+        started = 2;
+        Serial.printf("[llm] %s slow after %u ms, hedging with %s\n", provider.c_str(),
+                      (unsigned)LLM_HEDGE_AFTER_MS, backup.c_str());
+      }
+      continue;
+    }
+    finished++;
+    const HedgeAttempt &a = race->attempts[index];
+    if (a.ok) {
+      response_out = a.reply;
+      ok = true;
+      if (index == 1) {
+        Serial.printf("[llm] hedge answered first: %s\n", backup.c_str());
+      }
+      break;
+    }
+    // Marked like the unhedged path does, so the next call skips it
+    if (is_quota_error(a.error)) {
+      model_config_mark_provider_failed(a.provider, 429);
+    }
+    last_error = a.error;
+    // The first provider failed before the hedge deadline: start the backup
+    // now instead of giving up with it unasked.
+    if (started == 1 && ESP.getFreeHeap() >= LLM_HEDGE_MIN_HEAP && hedge_start(race, 1)) {
+      started = 2;
+      wait = portMAX_DELAY;
+      Serial.printf("[llm] %s failed, hedging with %s\n", provider.c_str(), backup.c_str());
+    }
+  }
 
-    // Loop to try the fallback
+  if (!ok) {
+    error_out = last_error;
+  }
+  hedge_release(race);
+  return ok;
+}
+
+// Prefix task with the newest memory notes, as much of them as the budget
+// leaves after the system prompt and the task itself.
+static void add_memory_notes(const String &system_prompt, const String &task,
+                             String &enriched_out) {
+  const size_t kMaxNotesTokens = 100;
+  String notes;
+  String mem_err;
+  // The notes are the owner's; team chats never see them.
+  if (!chat_scope_is_owner(chat_scope_current()) || !memory_get_notes(notes, mem_err)) {
+    return;
+  }
+  notes.trim();
+  ContextBudget budget("llm");
+  budget.reserve(system_prompt);
+  String query = task;
+  budget.add("query", query, CTX_PRIO_QUERY, ContextBudget::kAll, ContextBudget::kAll);
+  budget.add("memory notes", notes, CTX_PRIO_MEMORY, kMaxNotesTokens, 0, true);
+  budget.fit();
+  if (notes.length() > 0) {
+    enriched_out = String("Persistent memory:\n") + notes + "\n\nTask:\n" + task;
   }
 }
 
@@ -830,27 +2217,46 @@ String extract_routed_command(const String &raw) {
 
 }  // namespace
 
+void llm_release_idle_connections() {
+  const unsigned long now = millis();
+  for (int i = 0; i < LLM_CONN_POOL_SIZE; i++) {
+    PooledConn &c = s_conn_pool[i];
+    portENTER_CRITICAL(&s_conn_pool_mux);
+    const bool idle = !c.busy && c.client && now - c.last_used_ms > LLM_CONN_IDLE_MS;
+    if (idle) {
+      c.busy = true;
+    }
+    portEXIT_CRITICAL(&s_conn_pool_mux);
+    if (idle) {
+      conn_release(&c, false);
+    }
+  }
+}
+
 // ============================================================================
 // PUBLIC API FUNCTIONS
 // ============================================================================
 
-// Generate LLM response with custom system prompt (for ReAct, etc.)
-bool llm_generate_with_custom_prompt(const String &system_prompt, const String &task,
-                                     bool include_memory, String &reply_out, String &error_out) {
+// Streams tokens through sink when the active provider supports it (OpenAI-
+// compatible and Anthropic); other providers answer in one piece.
+// stable_len: leading chars of system_prompt that never change between calls
+// (eligible for provider-side prompt caching). prior: earlier chat turns sent
+// before task, or nullptr for a single-turn request. latency_sensitive: short
+// background calls (routing, fact extraction) that may go to whichever
+// healthy provider has been answering fastest, hedged if LLM_HEDGE_AFTER_MS.
+// cache_reply: the answer is a function of the prompt (routing, parsing,
+// extraction, summaries), so a verbatim repeat may be served from the
+// response cache. Generations a user may retry for a different result leave
+// it off.
+static bool generate_with_prompt_impl(const String &system_prompt, const String &task,
+                                      bool include_memory, String &reply_out,
+                                      String &error_out, const StreamSink *sink,
+                                      size_t stable_len, const ChatTurns *prior = nullptr,
+                                      bool latency_sensitive = false, bool cache_reply = false) {
   // Enrich task with memory if requested
   String enriched_task = task;
   if (include_memory) {
-    String notes;
-    String mem_err;
-    if (memory_get_notes(notes, mem_err)) {
-      notes.trim();
-      if (notes.length() > 0) {
-        if (notes.length() > 400) {
-          notes = notes.substring(notes.length() - 400);
-        }
-        enriched_task = String("Persistent memory:\n") + notes + "\n\nTask:\n" + task;
-      }
-    }
+    add_memory_notes(system_prompt, task, enriched_task);
   }
 
   if (enriched_task.length() == 0) {
@@ -858,197 +2264,528 @@ bool llm_generate_with_custom_prompt(const String &system_prompt, const String &
     return false;
   }
 
-  // Get primary provider config
   String primary_provider;
   String primary_model;
-  ModelConfigInfo config;
+  String primary_key;
+  String primary_base_url;
+  if (!resolve_active_provider(primary_provider, primary_model, primary_key, primary_base_url,
+                               error_out)) {
+    return false;
+  }
 
-  if (model_config_get_active_config(config)) {
-    primary_provider = config.provider;
-    primary_model = config.model;
+  // Callers that opted in are often repeated verbatim; answer those from the
+  // cache.
+  const bool cacheable = cache_reply && sink == nullptr && prior == nullptr;
+  uint64_t cache_key = 0;
+  if (cacheable) {
+    cache_key = response_cache_key("llm", primary_provider, primary_model, system_prompt,
+                                   enriched_task);
+    if (response_cache_get(cache_key, reply_out)) {
+      return true;
+    }
+  }
+
+  String provider = primary_provider;
+  String model = primary_model;
+  String api_key = primary_key;
+  String base_url = primary_base_url;
+  // A soak run measures the mock endpoint, so no other provider may answer
+  if (soak_mock_active()) {
+    latency_sensitive = false;
+  }
+  if (latency_sensitive) {
+    const String fastest = model_config_get_fastest_provider(primary_provider);
+    if (fastest != primary_provider) {
+      provider = fastest;
+      model = model_config_get_model(fastest);
+      api_key = model_config_get_api_key(fastest);
+      base_url = "";
+    }
+  }
+
+  bool using_fallback = false;
+  if (latency_sensitive && LLM_HEDGE_AFTER_MS > 0) {
+    const bool result = call_hedged(provider, api_key, model, base_url, system_prompt,
+                                    enriched_task, stable_len, reply_out, error_out);
+    if (result && cacheable) {
+      response_cache_put(cache_key, reply_out, RESPONSE_CACHE_LLM_TTL_MS);
+    }
+    if (result || !is_quota_error(error_out)) {
+      return result;
+    }
+    // The race marks the providers it saw rate limited; a call that ran
+    // without a race has not marked its provider yet. The loop below tries
+    // the rest in turn.
+    if (!model_config_is_provider_failed(provider)) {
+      model_config_mark_provider_failed(provider, 429);
+    }
+    const String fallback = model_config_get_fallback_provider(provider);
+    if (fallback.length() == 0) {
+      error_out += " (all providers failed or rate limited)";
+      return false;
+    }
+    using_fallback = true;
+    provider = fallback;
+    model = model_config_get_model(fallback);
+    api_key = model_config_get_api_key(fallback);
+    base_url = "";
+  }
+
+  // A quota or rate-limit error marks the provider failed and moves on to the
+  // next configured one; any other error ends the call.
+  while (true) {
+    const bool result = call_provider(provider, api_key, model, base_url, system_prompt,
+                                      enriched_task, reply_out, error_out, sink, stable_len,
+                                      prior);
+    if (result) {
+      if (cacheable) {
+        response_cache_put(cache_key, reply_out, RESPONSE_CACHE_LLM_TTL_MS);
+      }
+      if (using_fallback) {
+        reply_out = "⚠️ Using " + provider + " (" + primary_provider + " rate limited)\n\n" +
+                    reply_out;
+      }
+      return true;
+    }
+
+    if (!is_quota_error(error_out)) {
+      if (using_fallback) {
+        error_out += " (fallback from " + primary_provider + ")";
+      }
+      return false;
+    }
+
+    model_config_mark_provider_failed(provider, 429);
+    const String fallback = model_config_get_fallback_provider(provider);
+    if (fallback.length() == 0) {
+      error_out += " (all providers failed or rate limited)";
+      return false;
+    }
+
+    using_fallback = true;
+    provider = fallback;
+    model = model_config_get_model(fallback);
+    api_key = model_config_get_api_key(fallback);
+    base_url = "";
+    Serial.printf("[llm] Switching to fallback provider: %s\n", provider.c_str());
+  }
+}
+
+// Generate LLM response with custom system prompt (for ReAct, etc.)
+bool llm_generate_with_custom_prompt(const String &system_prompt, const String &task,
+                                     bool include_memory, String &reply_out, String &error_out,
+                                     bool cache_reply) {
+  // Custom prompts are fixed instructions; everything volatile goes in task.
+  return generate_with_prompt_impl(system_prompt, task, include_memory, reply_out, error_out,
+                                   nullptr, system_prompt.length(), nullptr, false, cache_reply);
+}
+
+// Same as llm_generate_with_custom_prompt, for calls where answer time matters
+// more than which provider gives it. These are routing and parsing calls, so
+// their replies are cached.
+static bool generate_latency_sensitive(const String &system_prompt, const String &task,
+                                       String &reply_out, String &error_out) {
+  return generate_with_prompt_impl(system_prompt, task, false, reply_out, error_out, nullptr,
+                                   system_prompt.length(), nullptr, true, true);
+}
+
+// Background coalescing: low-priority single-turn calls from different tasks
+// (scheduler lanes, auto-learn) that start within LLM_BATCH_WINDOW_MS of each
+// other are answered by one request. The first caller leads: it waits out the
+// window, sends the combined prompt and hands every joiner its section.
+static const char *kBatchSystemPrompt =
+    "You are answering several independent background tasks in one reply. "
+    "Each task has its own instructions and input; follow them exactly as if it "
+    "were the only task. Answer every task, in order. Start each answer with a line "
+    "containing only ### TASK <n> and write nothing outside the answers.";
+
+struct BackgroundJob {
+  const String *system_prompt;
+  const String *task;
+  String *reply;
+  String *error;
+  bool ok;
+  bool latency_sensitive;
+  bool cache_reply;
+  SemaphoreHandle_t done;  // given by the leader once reply/error are set
+};
+
+static BackgroundJob *s_bg_jobs[LLM_BATCH_MAX_TASKS];
+static size_t s_bg_count = 0;
+static bool s_bg_collecting = false;
+static portMUX_TYPE s_bg_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void run_background_alone(BackgroundJob &job) {
+  job.ok = generate_with_prompt_impl(*job.system_prompt, *job.task, false, *job.reply,
+                                     *job.error, nullptr, job.system_prompt->length(), nullptr,
+                                     job.latency_sensitive, job.cache_reply);
+}
+
+// Splits the combined reply on its ### TASK markers; a task whose marker is
+// missing (skipped or cut off by the token limit) is sent again on its own.
+static void run_background_batch(BackgroundJob **jobs, size_t count) {
+  if (count == 1) {
+    run_background_alone(*jobs[0]);
+    return;
+  }
+
+  String combined;
+  for (size_t i = 0; i < count; i++) {
+    combined += "### TASK " + String(i + 1) + "\nInstructions:\n" + *jobs[i]->system_prompt +
+                "\n\nInput:\n" + *jobs[i]->task + "\n\n";
+  }
+  const String system_prompt(kBatchSystemPrompt);
+  String raw;
+  String err;
+  Serial.printf("[llm] batching %u background task(s)\n", (unsigned)count);
+  if (!generate_with_prompt_impl(system_prompt, combined, false, raw, err, nullptr,
+                                 system_prompt.length())) {
+    // The provider is failing; retrying each task alone would only multiply it.
+    for (size_t i = 0; i < count; i++) {
+      *jobs[i]->error = err;
+      jobs[i]->ok = false;
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    const String marker = "### TASK " + String(i + 1);
+    const int at = raw.indexOf(marker);
+    if (at < 0) {
+      run_background_alone(*jobs[i]);
+      continue;
+    }
+    const int start = at + marker.length();
+    const int next = raw.indexOf("### TASK ", start);
+    String part = next < 0 ? raw.substring(start) : raw.substring(start, next);
+    part.trim();
+    *jobs[i]->reply = part;
+    jobs[i]->ok = true;
+  }
+}
+
+static bool generate_background(const String &system_prompt, const String &task,
+                                String &reply_out, String &error_out,
+                                bool latency_sensitive = false, bool cache_reply = false) {
+  BackgroundJob job = {&system_prompt, &task, &reply_out, &error_out, false, latency_sensitive,
+                       cache_reply, nullptr};
+  if (LLM_BATCH_WINDOW_MS == 0 || (job.done = xSemaphoreCreateBinary()) == nullptr) {
+    run_background_alone(job);
+    return job.ok;
+  }
+
+  bool leader = false;
+  bool joined = false;
+  portENTER_CRITICAL(&s_bg_mux);
+  if (!s_bg_collecting) {
+    s_bg_collecting = true;
+    s_bg_jobs[0] = &job;
+    s_bg_count = 1;
+    leader = true;
+  } else if (s_bg_count < LLM_BATCH_MAX_TASKS) {
+    s_bg_jobs[s_bg_count++] = &job;
+    joined = true;
+  }
+  portEXIT_CRITICAL(&s_bg_mux);
+
+  if (joined) {
+    xSemaphoreTake(job.done, portMAX_DELAY);
+  } else if (!leader) {
+    run_background_alone(job);  // batch already full
   } else {
-    primary_provider = String(LLM_PROVIDER);
-    primary_provider.toLowerCase();
-    primary_model = String(LLM_MODEL);
+    vTaskDelay(pdMS_TO_TICKS(LLM_BATCH_WINDOW_MS));
+    BackgroundJob *jobs[LLM_BATCH_MAX_TASKS];
+    portENTER_CRITICAL(&s_bg_mux);
+    const size_t count = s_bg_count;
+    memcpy(jobs, s_bg_jobs, sizeof(jobs[0]) * count);
+    s_bg_count = 0;
+    s_bg_collecting = false;
+    portEXIT_CRITICAL(&s_bg_mux);
+
+    run_background_batch(jobs, count);
+    for (size_t i = 1; i < count; i++) {
+      xSemaphoreGive(jobs[i]->done);
+    }
+  }
+  vSemaphoreDelete(job.done);
+  return job.ok;
+}
+
+bool llm_generate_chat(const String &system_prompt, const LlmMessage *messages, size_t count,
+                       String &reply_out, String &error_out) {
+  if (messages == nullptr || count == 0 || messages[count - 1].from_assistant) {
+    error_out = "Chat must end with a user message";
+    return false;
   }
+  const ChatTurns prior = {messages, count - 1};
+  return generate_with_prompt_impl(system_prompt, messages[count - 1].content, false, reply_out,
+                                   error_out, nullptr, system_prompt.length(), &prior);
+}
 
-  if (primary_provider == "none" || primary_provider.length() == 0) {
-    error_out = "LLM disabled. Use: /model set <provider> <api_key>";
+void llm_set_tool_specs(const LlmToolSpec *tools, size_t count) {
+  if (g_tool_schema_lock == nullptr) {
+    g_tool_schema_lock = xSemaphoreCreateMutex();
+  }
+  g_tool_specs = tools;
+  g_tool_spec_count = count;
+  for (String &schema : g_tool_schemas) {
+    schema = "";
+  }
+}
+
+bool llm_native_tools_available() {
+  if (!LLM_NATIVE_TOOLS_ENABLED || g_tool_specs == nullptr || g_tool_spec_count == 0 ||
+      g_tool_schema_lock == nullptr) {
+    return false;
+  }
+  if (soak_mock_active()) {
     return false;
   }
+  ModelConfigInfo config;
+  const String provider = model_config_get_active_config(config) ? config.provider
+                                                                 : String(LLM_PROVIDER);
+  const ProviderDesc *p = find_provider(provider);
+  return p != nullptr && p->tools != TOOLS_NONE;
+}
 
-  String primary_key = model_config_get_api_key(primary_provider);
-  if (primary_key.length() == 0) {
-    error_out = "No API key for " + primary_provider;
+bool llm_generate_tool_step(const String &system_prompt, const LlmToolTurn *turns, size_t count,
+                            LlmToolTurn &reply_out, String &error_out) {
+  reply_out.text = "";
+  reply_out.call_count = 0;
+  if (turns == nullptr || count == 0 || g_tool_specs == nullptr ||
+      g_tool_schema_lock == nullptr) {
+    error_out = "No tool conversation to send";
     return false;
   }
 
-  // Call appropriate provider
-  String prov = primary_provider;
-  prov.toLowerCase();
-  bool result = false;
-
-  if (prov == "openai") {
-    String mod = primary_model.length() > 0 ? primary_model : String("gpt-4.1-mini");
-    String baseUrl = config.baseUrl.length() > 0 ? config.baseUrl : String(LLM_OPENAI_BASE_URL);
-    result = call_openai_like(baseUrl, primary_key, mod, system_prompt, enriched_task, reply_out, error_out);
-  } else if (prov == "anthropic") {
-    String mod = primary_model.length() > 0 ? primary_model : String("claude-3-5-sonnet-latest");
-    String baseUrl = config.baseUrl.length() > 0 ? config.baseUrl : String(LLM_ANTHROPIC_BASE_URL);
-    result = call_anthropic(baseUrl, primary_key, mod, system_prompt, enriched_task, reply_out, error_out);
-  } else if (prov == "gemini") {
-    String mod = primary_model.length() > 0 ? primary_model : String("gemini-2.0-flash");
-    String baseUrl = config.baseUrl.length() > 0 ? config.baseUrl : String(LLM_GEMINI_BASE_URL);
-    result = call_gemini(baseUrl, primary_key, mod, system_prompt, enriched_task, reply_out, error_out);
-  } else if (prov == "glm") {
-    String mod = primary_model.length() > 0 ? primary_model : String("glm-4.7");
-    String baseUrl = config.baseUrl.length() > 0 ? config.baseUrl : String(LLM_GLM_BASE_URL);
-    result = call_glm_zai(baseUrl, primary_key, mod, system_prompt, enriched_task, reply_out, error_out);
-  } else if (prov == "openrouter" || prov == "openrouter.ai") {
-    String mod = primary_model.length() > 0 ? primary_model : String("qwen/qwen-2.5-coder-32b-instruct:free");
-    String baseUrl = config.baseUrl.length() > 0 ? config.baseUrl : String("https://openrouter.ai/api");
-    result = call_openai_like(baseUrl, primary_key, mod, system_prompt, enriched_task, reply_out, error_out);
-  } else if (prov == "ollama") {
-    String mod = primary_model.length() > 0 ? primary_model : String("llama3");
-    String baseUrl = config.baseUrl.length() > 0 ? config.baseUrl : String("http://ollama.local:11434/api/generate");
-    result = call_ollama(baseUrl, mod, system_prompt, enriched_task, reply_out, error_out);
-  } else {
-    error_out = "Unsupported provider: " + primary_provider;
+  String provider;
+  String model;
+  String api_key;
+  String base_url;
+  if (!resolve_active_provider(provider, model, api_key, base_url, error_out)) {
+    return false;
+  }
+  const ProviderDesc *p = find_provider(provider);
+  if (p == nullptr || p->tools == TOOLS_NONE) {
+    error_out = provider + " has no native tool calling";
     return false;
   }
+  if (model.length() == 0) {
+    model = p->default_model;
+  }
 
-  return result;
+  const unsigned long started_ms = millis();
+  const bool ok = call_with_tools(*p, base_url, api_key, model, system_prompt, turns, count,
+                                  reply_out, error_out);
+  model_config_record_call(p->name, (uint32_t)(millis() - started_ms), ok);
+  return ok;
 }
 
 bool llm_generate_plan(const String &task, String &plan_out, String &error_out) {
   return llm_generate_with_custom_prompt(String(kPlanSystemPrompt), task, true, plan_out, error_out);
 }
 
-bool llm_generate_reply(const String &message, String &reply_out, String &error_out) {
-  const size_t kLongUserMessageChars = 1400;
-  const size_t kMaxSkillChars = 700;
-  const size_t kMaxSoulChars = 420;
-  const size_t kMaxMemoryChars = 700;
-  const size_t kMaxScheduleChars = 900;
-  const size_t kMaxHistoryChars = 1200;
-  const size_t kMaxLastFileChars = 1800;
-  const size_t kMaxTaskChars = 5200;
+static const size_t kLongUserMessageChars = 1400;
+
+static const char *kReplyWorkflowPrompt =
+    "\n\nPROJECT FILE WORKFLOW (PREFER THIS FOR LONG CODING TASKS):\n"
+    "- Persist code in SPIFFS under /projects/<project_name>/...\n"
+    "- Read existing files before editing: files_list, files_get <path>\n"
+    "- Use MinOS for file operations: minos mkdir, minos nano, minos append, minos cat\n"
+    "- When user asks to modify previous code, prefer loading from SPIFFS file path instead of relying only on chat memory.\n"
+    "- Keep edits incremental and return updated file output.";
+
+// MinOS Shell Awareness (Experimental)
+static const char *kReplyMinosPrompt =
+    "\n\nEXPERIMENTAL: You have an internal minimal OS (MinOS) running! "
+    "You can interact with it using: minos <command>\n"
+    "Commands: ls, cat, cd, pwd, mkdir, touch, rm, nano <file> <text> (overwrite), "
+    "append <file> <text> (add to end), ps, free, df, uptime, reboot.\n"
+    "Use this for low-level system management or browsing the internal flash memory.";
+
+static const char *kReplyTimezonePrompt =
+    "\n\nCRITICAL: User timezone is NOT SET! If they ask to schedule a cron job, reminder, or ask for the time, "
+    "STOP and explicitly ask them 'What City/Country are you in?' FIRST. Then use the timezone_set tool.";
+
+// Chat reply system prompt and task. stable_len_out is the length of the
+// byte-stable prefix that providers can cache.
+static void build_reply_prompt(const String &message, String &system_out, String &task_out,
+                               size_t &stable_len_out) {
+  // Section ceilings in tokens; the budget trims below them when the whole
+  // prompt would not fit, lowest priority first.
+  const size_t kMaxSkillTokens = 175;
+  const size_t kMaxSoulTokens = 105;
+  const size_t kMaxMemoryTailTokens = 75;  // fallback when retrieval finds nothing
+  const size_t kMaxScheduleTokens = 225;
+  const size_t kMinScheduleTokens = 60;
+  const size_t kMaxHistoryTokens = 300;
+  const size_t kMaxLastFileTokens = 450;
+  const size_t kMaxQueryTokens = 1300;
+
+  ContextBudget budget("reply");
+  budget.reserve(kChatSystemPrompt);
+  budget.reserve(kReplyWorkflowPrompt);
+  budget.reserve(kReplyMinosPrompt);
+
+  // Gather every section first so the budget can weigh them together.
+  // Skills and SOUL sit in the cacheable prefix: trimming them costs that
+  // turn its prompt-cache hit, which is why they go only when space is short.
+  String query = message;
+  budget.add("query", query, CTX_PRIO_QUERY, kMaxQueryTokens, ContextBudget::kAll);
 
-  const bool long_user_message = message.length() > kLongUserMessageChars;
-  String system_prompt = String(kChatSystemPrompt);
+  String history;
+  String history_err;
+  if (chat_history_get(history, history_err)) {
+    history.trim();
+  }
+  budget.add("history", history, CTX_PRIO_HISTORY, kMaxHistoryTokens, 0, true);
 
-  system_prompt += "\n\nPROJECT FILE WORKFLOW (PREFER THIS FOR LONG CODING TASKS):\n"
-                   "- Persist code in SPIFFS under /projects/<project_name>/...\n"
-                   "- Read existing files before editing: files_list, files_get <path>\n"
-                   "- Use MinOS for file operations: minos mkdir, minos nano, minos append, minos cat\n"
-                   "- When user asks to modify previous code, prefer loading from SPIFFS file path instead of relying only on chat memory.\n"
-                   "- Keep edits incremental and return updated file output.";
+  // Include last generated file for iteration (short-term memory fallback).
+  // Primary preference is project files in SPIFFS (/projects/...).
+  String last_file_content = agent_loop_get_last_file_content();
+  budget.add("last file", last_file_content, CTX_PRIO_HISTORY, kMaxLastFileTokens);
 
-  // Inject current time awareness
-  String time_ctx = build_time_context();
-  if (time_ctx.length() > 0) {
-    system_prompt += "\n\nCURRENT TIME: " + time_ctx +
-                     "\nUse this to greet appropriately (good morning/afternoon/evening) "
-                     "and be aware of timing context in conversations.";
+  String schedule_ctx = build_schedule_context();
+  budget.add("schedule", schedule_ctx, CTX_PRIO_MEMORY, kMaxScheduleTokens, kMinScheduleTokens);
+
+  String soul_text;
+  String soul_err;
+  if (file_memory_read_soul(soul_text, soul_err)) {
+    soul_text.trim();
   }
+  budget.add("soul", soul_text, CTX_PRIO_MEMORY, kMaxSoulTokens);
+
+  // MEMORY.md / USER.md lines and daily notes relevant to this message; the
+  // newest MEMORY.md tail stands in when nothing matches. They hold the
+  // owner's facts, so team chats get neither.
+  const bool owner_chat = chat_scope_is_owner(chat_scope_current());
+  String memory_text;
+  String memory_err;
+  bool memory_retrieved = false;
+  if (owner_chat &&
+      file_memory_retrieve(message, MEMORY_RETRIEVAL_MAX_CHARS, memory_text, memory_err) &&
+      memory_text.length() > 0) {
+    memory_retrieved = true;
+    budget.add("memory", memory_text, CTX_PRIO_MEMORY, ContextBudget::kAll);
+  } else if (owner_chat && file_memory_read_long_term(memory_text, memory_err)) {
+    memory_text.trim();
+    budget.add("memory", memory_text, CTX_PRIO_MEMORY, kMaxMemoryTailTokens, 0, true);
+  }
+
+  // Inject available skills so the agent knows what it can do
+  String skill_descs = skill_get_descriptions_for_react();
+  budget.add("skills", skill_descs, CTX_PRIO_SKILLS, kMaxSkillTokens);
 
   String stored_tz;
   String tz_err;
-  if (!persona_get_timezone(stored_tz, tz_err) || stored_tz.length() == 0) {
-    system_prompt += "\n\nCRITICAL: User timezone is NOT SET! If they ask to schedule a cron job, reminder, or ask for the time, "
-                     "STOP and explicitly ask them 'What City/Country are you in?' FIRST. Then use the timezone_set tool.";
+  const bool tz_missing = !persona_get_timezone(stored_tz, tz_err) || stored_tz.length() == 0;
+  const String time_ctx = build_time_context();
+  if (tz_missing) {
+    budget.reserve(kReplyTimezonePrompt);
   }
+  budget.reserve(time_ctx);
+  budget.fit();
 
-  // Inject real schedule state so LLM doesn't hallucinate reminder/cron status.
-  String schedule_ctx = build_schedule_context();
-  schedule_ctx = trim_with_ellipsis(schedule_ctx, kMaxScheduleChars);
-  system_prompt += "\n\nACTIVE SCHEDULE STATE (source of truth from cron.json + reminder store):\n" +
-                   schedule_ctx +
-                   "\nWhen user asks about reminders/cron, rely on this state before suggesting changes.";
+  // Every section String below must stay alive until prompt.build().
+  PromptBuilder prompt;
+  prompt.add(kChatSystemPrompt);
+  prompt.add(kReplyWorkflowPrompt);
+  prompt.add(kReplyMinosPrompt);
 
-  // Inject available skills so the agent knows what it can do
-  String skill_descs = skill_get_descriptions_for_react();
-  if (skill_descs.length() > 0 && !long_user_message) {
-    skill_descs = trim_with_ellipsis(skill_descs, kMaxSkillChars);
-    system_prompt += "\n\nAVAILABLE SKILLS:\n" + skill_descs +
-                     "\nYou can activate any with: use_skill <name> [context]\n"
-                      "You can also create new skills with: skill_add <name> <description>: <instructions>";
+  if (skill_descs.length() > 0) {
+    prompt.add("\n\nAVAILABLE SKILLS:\n");
+    prompt.add(skill_descs);
+    prompt.add("\nYou can activate any with: use_skill <name> [context]\n"
+               "You can also create new skills with: skill_add <name> <description>: <instructions>");
+  }
+
+  // Include SOUL from file_memory if available
+  if (soul_text.length() > 0) {
+    prompt.add("\n\nSOUL:\n");
+    prompt.add(soul_text);
   }
 
-  // MinOS Shell Awareness (Experimental)
-  system_prompt += "\n\nEXPERIMENTAL: You have an internal minimal OS (MinOS) running! "
-                   "You can interact with it using: minos <command>\n"
-                   "Commands: ls, cat, cd, pwd, mkdir, touch, rm, nano <file> <text> (overwrite), "
-                   "append <file> <text> (add to end), ps, free, df, uptime, reboot.\n"
-                   "Use this for low-level system management or browsing the internal flash memory.";
+  // Everything above is byte-stable between turns and forms the cacheable
+  // prefix; per-turn state (schedule, clock, last file) follows it.
+  stable_len_out = prompt.length();
 
-  // Include SOUL from file_memory if available
-  String soul_text;
-  String soul_err;
-  if (file_memory_read_soul(soul_text, soul_err)) {
-    soul_text.trim();
-    if (soul_text.length() > 0) {
-      soul_text = trim_with_ellipsis(soul_text, kMaxSoulChars);
-      system_prompt += "\n\nSOUL:\n" + soul_text;
-    }
+  // Inject real schedule state so LLM doesn't hallucinate reminder/cron status.
+  if (schedule_ctx.length() > 0) {
+    prompt.add("\n\nACTIVE SCHEDULE STATE (source of truth from cron.json + reminder store):\n");
+    prompt.add(schedule_ctx);
+    prompt.add("\nWhen user asks about reminders/cron, rely on this state before suggesting changes.");
   }
 
-  // Include MEMORY.md if available (for recall)
-  String memory_text;
-  String memory_err;
-  if (file_memory_read_long_term(memory_text, memory_err)) {
-    memory_text.trim();
-    if (memory_text.length() > 0) {
-      memory_text = keep_tail_with_marker(memory_text, kMaxMemoryChars);
-      system_prompt += "\n\nMEMORY (what you know about the user):\n" + memory_text;
-    }
+  if (tz_missing) {
+    prompt.add(kReplyTimezonePrompt);
   }
 
-  String task = trim_with_ellipsis(message, kMaxTaskChars);
-  String msg_lc = message;
-  msg_lc.toLowerCase();
+  // Inject current time awareness
+  if (time_ctx.length() > 0) {
+    prompt.add("\n\nCURRENT TIME: ");
+    prompt.add(time_ctx);
+    prompt.add("\nUse this to greet appropriately (good morning/afternoon/evening) "
+               "and be aware of timing context in conversations.");
+  }
 
-  // Always include recent chat history for better context and follow-ups
-  // History is stored in NVS and persists across reboots
-  String history;
-  String history_err;
-  if (!long_user_message && chat_history_get(history, history_err)) {
-    history.trim();
-    if (history.length() > 0) {
-      history = keep_tail_with_marker(history, kMaxHistoryChars);
-      task = "Recent conversation (last 15-30 turns):\n" + history + "\n\nCurrent user message:\n" + message;
-    }
+  if (memory_text.length() > 0) {
+    prompt.add(memory_retrieved ? "\n\nMEMORY (retrieved for this message):\n"
+                                : "\n\nMEMORY (what you know about the user):\n");
+    prompt.add(memory_text);
   }
-  // Include last generated file for iteration (short-term memory fallback).
-  // Primary preference is project files in SPIFFS (/projects/...).
+
   // MOVED: Append to system prompt to avoid "User sent this" hallucination
-  String last_file_content = agent_loop_get_last_file_content();
-  if (!long_user_message && last_file_content.length() > 0) {
-    String last_file_name = agent_loop_get_last_file_name();
+  String last_file_name;
+  if (last_file_content.length() > 0) {
+    last_file_name = agent_loop_get_last_file_name();
     if (last_file_name.length() == 0) last_file_name = "generated_code.txt";
-    
-    last_file_content = trim_with_ellipsis(last_file_content, kMaxLastFileChars);
-    
-    // Explicitly label as SYSTEM MEMORY
-    system_prompt += "\n\n=== SYSTEM MEMORY (Code you previously generated) ===\n"
-                     "FILENAME: " + last_file_name + "\n"
-                     "CONTENT:\n```\n" + last_file_content + "\n```\n"
-                     "You can edit this code if requested. Provide full updated code.\n"
-                     "==========================================================\n";
-  }
 
-  if (task.length() > kMaxTaskChars) {
-    task = trim_with_ellipsis(task, kMaxTaskChars);
+    // Explicitly label as SYSTEM MEMORY
+    prompt.add("\n\n=== SYSTEM MEMORY (Code you previously generated) ===\n"
+               "FILENAME: ");
+    prompt.add(last_file_name);
+    prompt.add("\nCONTENT:\n```\n");
+    prompt.add(last_file_content);
+    prompt.add("\n```\n"
+               "You can edit this code if requested. Provide full updated code.\n"
+               "==========================================================\n");
+  }
+
+  prompt.build(system_out);
+
+  // Recent chat history (NVS, persists across reboots) goes with the message
+  // for follow-ups; the budget drops it first when the message is long.
+  if (history.length() > 0) {
+    PromptBuilder task_parts;
+    task_parts.add("Recent conversation (last 15-30 turns):\n");
+    task_parts.add(history);
+    task_parts.add("\n\nCurrent user message:\n");
+    task_parts.add(query);
+    task_parts.build(task_out);
+  } else {
+    task_out = query;
   }
+}
 
-  bool result = llm_generate_with_custom_prompt(system_prompt, task, false, reply_out, error_out);
+static bool generate_reply_impl(const String &message, String &reply_out, String &error_out,
+                                const StreamSink *sink) {
+  const bool long_user_message = message.length() > kLongUserMessageChars;
+  String system_prompt;
+  String task;
+  size_t stable_len = 0;
+  build_reply_prompt(message, system_prompt, task, stable_len);
+
+  const uint32_t started_ms = millis();
+  bool result = generate_with_prompt_impl(system_prompt, task, false, reply_out, error_out, sink,
+                                          stable_len);
   if (!result && long_user_message && is_timeout_error(error_out)) {
     String retry_system = String(kChatSystemPrompt) +
                           "\nFocus on the user's latest message only. "
                           "Skip old context and respond directly.";
     String retry_task = trim_with_ellipsis(message, 2800);
     String retry_error;
-    if (llm_generate_with_custom_prompt(retry_system, retry_task, false, reply_out, retry_error)) {
+    if (generate_with_prompt_impl(retry_system, retry_task, false, reply_out, retry_error,
+                                  sink, retry_system.length())) {
       result = true;
       error_out = "";
       Serial.println("[llm] Long prompt retry succeeded with compact context");
@@ -1057,8 +2794,9 @@ bool llm_generate_reply(const String &message, String &reply_out, String &error_
     }
   }
 
-  // Auto-save important info to MEMORY.md
-  if (result) {
+  // Auto-save important info to MEMORY.md, unless the reply was dropped.
+  // MEMORY.md is the owner's, so team chat messages are never saved to it.
+  if (result && !(sink && sink->cancelled()) && chat_scope_is_owner(chat_scope_current())) {
     // Check if user is sharing something important about themselves
     String msg_lc_check = message;
     msg_lc_check.toLowerCase();
@@ -1102,11 +2840,169 @@ bool llm_generate_reply(const String &message, String &reply_out, String &error_
     provider = String(LLM_PROVIDER);
     model = String(LLM_MODEL);
   }
-  usage_record_call("chat", result ? 200 : 500, provider.c_str(), model.c_str());
+  usage_record_call("chat", result ? 200 : 500, provider.c_str(), model.c_str(),
+                    millis() - started_ms);
 
   return result;
 }
 
+bool llm_generate_reply(const String &message, String &reply_out, String &error_out) {
+  return generate_reply_impl(message, reply_out, error_out, nullptr);
+}
+
+void llm_build_reply_prompt(const String &message, String &system_out, String &task_out) {
+  size_t stable_len = 0;
+  build_reply_prompt(message, system_out, task_out, stable_len);
+}
+
+bool llm_extract_reply_text(const char *body, size_t len, String &text_out) {
+  JsonTextExtractor extractor(text_out);
+  extractor.begin_body((int)len);
+  extractor.write((const uint8_t *)body, len);
+  return extractor.found();
+}
+
+bool llm_generate_reply_stream(const String &message, llm_stream_cb_t on_text, void *ctx,
+                               String &reply_out, String &error_out) {
+#if LLM_STREAMING_ENABLED
+  if (on_text) {
+    const StreamSink sink{on_text, ctx, nullptr};
+    return generate_reply_impl(message, reply_out, error_out, &sink);
+  }
+#else
+  (void)on_text;
+  (void)ctx;
+#endif
+  return generate_reply_impl(message, reply_out, error_out, nullptr);
+}
+
+// Speculative replies share the hedge pattern: the helper task and the caller
+// each hold a reference and whichever lets go last frees the state, so a
+// cancelled reply can run out in the background.
+const uint32_t kSpeculativeTaskStack = 16384;
+
+struct LlmSpeculativeReply {
+  String message;
+  String chat_id;  // the caller's, for history and streamed edits
+  llm_stream_cb_t on_text;
+  void *ctx;
+  volatile bool open;  // on_text may be called
+  volatile bool cancel;
+  String reply;
+  String error;
+  bool ok;
+  SemaphoreHandle_t done;
+  int refs;
+};
+
+namespace {
+
+void speculative_release(LlmSpeculativeReply *spec) {
+  portENTER_CRITICAL(&s_hedge_mux);
+  const bool last = --spec->refs == 0;
+  portEXIT_CRITICAL(&s_hedge_mux);
+  if (last) {
+    vSemaphoreDelete(spec->done);
+    delete spec;
+  }
+}
+
+// Holds deltas back until the router has passed on the message.
+void speculative_gate(const String &text_so_far, void *ctx) {
+  LlmSpeculativeReply *spec = static_cast<LlmSpeculativeReply *>(ctx);
+  if (spec->open && !spec->cancel && spec->on_text) {
+    spec->on_text(text_so_far, spec->ctx);
+  }
+}
+
+void speculative_task(void *param) {
+  LlmSpeculativeReply *spec = static_cast<LlmSpeculativeReply *>(param);
+  chat_scope_bind(spec->chat_id);
+  // Streamed even without a live sink, so that cancel() can cut it off
+  const StreamSink sink{speculative_gate, spec, &spec->cancel};
+#if LLM_STREAMING_ENABLED
+  spec->ok = generate_reply_impl(spec->message, spec->reply, spec->error, &sink);
+#else
+  (void)sink;
+  spec->ok = generate_reply_impl(spec->message, spec->reply, spec->error, nullptr);
+#endif
+  if (spec->cancel) {
+    Serial.println("[llm] speculative reply dropped");
+  }
+  chat_scope_bind("");
+  xSemaphoreGive(spec->done);
+  speculative_release(spec);
+  vTaskDelete(NULL);
+}
+
+}  // namespace
+
+LlmSpeculativeReply *llm_speculative_reply_start(const String &message, llm_stream_cb_t on_text,
+                                                 void *ctx) {
+#if LLM_SPECULATIVE_REPLY
+  if (ESP.getFreeHeap() < LLM_HEDGE_MIN_HEAP) {
+    return nullptr;
+  }
+  LlmSpeculativeReply *spec = new (std::nothrow) LlmSpeculativeReply();
+  if (spec == nullptr) {
+    return nullptr;
+  }
+  spec->done = xSemaphoreCreateBinary();
+  if (spec->done == nullptr) {
+    delete spec;
+    return nullptr;
+  }
+  spec->message = message;
+  spec->chat_id = chat_scope_current();
+  spec->on_text = on_text;
+  spec->ctx = ctx;
+  spec->open = false;
+  spec->cancel = false;
+  spec->ok = false;
+  spec->refs = 2;
+  if (xTaskCreatePinnedToCore(speculative_task, "LlmSpecReply", kSpeculativeTaskStack, spec,
+                              TASK_PRIO_AGENT, NULL, TASK_CORE_NET) != pdPASS) {
+    vSemaphoreDelete(spec->done);
+    delete spec;
+    return nullptr;
+  }
+  return spec;
+#else
+  (void)message;
+  (void)on_text;
+  (void)ctx;
+  return nullptr;
+#endif
+}
+
+void llm_speculative_reply_cancel(LlmSpeculativeReply *spec) {
+  if (spec == nullptr) {
+    return;
+  }
+  spec->cancel = true;
+  speculative_release(spec);
+}
+
+bool llm_speculative_reply_finish(LlmSpeculativeReply *spec, String &reply_out,
+                                  String &error_out) {
+  if (spec == nullptr) {
+    error_out = "No speculative reply";
+    return false;
+  }
+  // The caller is blocked from here on, so its sink is only ever touched by
+  // the helper task; the next delta carries all the text held back so far.
+  spec->open = true;
+  xSemaphoreTake(spec->done, portMAX_DELAY);
+  const bool ok = spec->ok;
+  if (ok) {
+    reply_out = spec->reply;
+  } else {
+    error_out = spec->error;
+  }
+  speculative_release(spec);
+  return ok;
+}
+
 bool llm_generate_heartbeat(const String &heartbeat_doc, String &reply_out, String &error_out) {
   String task = heartbeat_doc;
   task.trim();
@@ -1120,20 +3016,25 @@ bool llm_generate_heartbeat(const String &heartbeat_doc, String &reply_out, Stri
   }
 
   task = "Heartbeat instructions:\n" + task + "\n\nGenerate current heartbeat update.";
-  return llm_generate_with_custom_prompt(String(kHeartbeatSystemPrompt), task, false, reply_out, error_out);
+  return generate_background(String(kHeartbeatSystemPrompt), task, reply_out, error_out, false,
+                             true);
 }
 
-bool llm_extract_user_facts(const String &user_message, const String &existing_profile,
-                            String &facts_out, String &error_out) {
+bool llm_extract_user_facts(const String *user_messages, size_t count,
+                            const String &existing_profile, String &facts_out,
+                            String &error_out) {
   static const char *kExtractPrompt =
-      "Extract ONLY new personal facts from the user's message. "
+      "Extract ONLY new personal facts from the user's messages. "
       "Facts include: name, location, age, job, interests, preferences, schedule, family, pets. "
       "Ignore questions, commands, or temporary context. "
       "If the user's existing profile already contains the fact, skip it. "
       "Return ONLY the new facts as bullet points (- fact). "
       "If no new facts found, return exactly: NONE";
 
-  String task = "User message: " + user_message;
+  String task = "User messages:\n";
+  for (size_t i = 0; i < count; i++) {
+    task += "- " + user_messages[i] + "\n";
+  }
   if (existing_profile.length() > 0) {
     String profile = existing_profile;
     if (profile.length() > 600) {
@@ -1143,7 +3044,7 @@ bool llm_extract_user_facts(const String &user_message, const String &existing_p
   }
 
   String raw_out;
-  if (!llm_generate_with_custom_prompt(String(kExtractPrompt), task, false, raw_out, error_out)) {
+  if (!generate_background(String(kExtractPrompt), task, raw_out, error_out, true, true)) {
     return false;
   }
 
@@ -1166,7 +3067,7 @@ bool llm_generate_proactive(const String &context, String &reply_out, String &er
       "If there's nothing useful, respond with exactly: SILENT";
 
   String raw_out;
-  if (!llm_generate_with_custom_prompt(String(kProactivePrompt), context, false, raw_out, error_out)) {
+  if (!generate_background(String(kProactivePrompt), context, raw_out, error_out)) {
     return false;
   }
 
@@ -1189,7 +3090,7 @@ bool llm_route_tool_command(const String &message, String &command_out, String &
 
   String task = "User message:\n" + message + "\n\nReturn one line only.";
   String raw;
-  if (!llm_generate_with_custom_prompt(String(kRouteSystemPrompt), task, false, raw, error_out)) {
+  if (!generate_latency_sensitive(String(kRouteSystemPrompt), task, raw, error_out)) {
     return false;
   }
 
@@ -1210,7 +3111,192 @@ bool llm_route_tool_command(const String &message, String &command_out, String &
 
 #if ENABLE_IMAGE_GEN
 
-bool llm_generate_image(const String &prompt, String &base64_out, String &error_out) {
+namespace {
+
+// Decodes the base64 string value of key from a response body as it streams
+// in and writes the image bytes to a flash file, so neither the JSON body nor
+// the encoded image is ever held in RAM.
+class ImageSpoolSink : public HttpBodySink {
+ public:
+  ImageSpoolSink(File &file, const char *key, size_t max_bytes)
+      : file_(file), key_(key), max_bytes_(max_bytes) {}
+
+  void begin_body(int content_length) override {
+    // The image is nearly all of the body, at 3/4 of its base64 length
+    if (content_length > 0 && (size_t)content_length / 4 * 3 > max_bytes_) {
+      failed_ = true;
+      error_ = "Image too large for free flash (" + String(content_length / 4 * 3) + " bytes)";
+    }
+  }
+
+  size_t write(uint8_t c) override {
+    feed((char)c);
+    return 1;
+  }
+
+  size_t write(const uint8_t *buffer, size_t size) override {
+    for (size_t i = 0; i < size && state_ != DONE; i++) {
+      feed((char)buffer[i]);
+    }
+    return size;
+  }
+
+  bool found() const { return state_ == DONE && !failed_ && written_ > 0; }
+  const String &error() const { return error_; }
+  size_t written() const { return written_; }
+
+ private:
+  enum State { SCAN, IN_STRING, AFTER_KEY, AFTER_COLON, CAPTURE, DONE };
+  static const size_t kMaxTokenChars = 24;
+  static const size_t kChunkChars = 512;
+
+  static bool is_ws(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+  void feed(char c) {
+    switch (state_) {
+      case SCAN:
+        if (c == '"') {
+          token_ = "";
+          esc_ = false;
+          state_ = IN_STRING;
+        }
+        return;
+
+      case IN_STRING:
+        if (esc_) {
+          esc_ = false;
+        } else if (c == '\\') {
+          esc_ = true;
+        } else if (c == '"') {
+          state_ = token_ == key_ ? AFTER_KEY : SCAN;
+        } else if (token_.length() <= kMaxTokenChars) {
+          token_ += c;
+        }
+        return;
+
+      case AFTER_KEY:
+        if (!is_ws(c)) {
+          state_ = c == ':' ? AFTER_COLON : SCAN;
+        }
+        return;
+
+      case AFTER_COLON:
+        if (!is_ws(c)) {
+          state_ = c == '"' ? CAPTURE : SCAN;
+        }
+        return;
+
+      case CAPTURE:
+        if (c == '"') {
+          flush(true);
+          state_ = DONE;
+          return;
+        }
+        // "\/" escapes need no handling: the decoder skips the backslash
+        chunk_[chunk_len_++] = c;
+        if (chunk_len_ == kChunkChars) {
+          flush(false);
+        }
+        return;
+
+      case DONE:
+        return;
+    }
+  }
+
+  void flush(bool last) {
+    uint8_t out[kChunkChars / 4 * 3 + 3];
+    size_t pos = 0;
+    size_t n = 0;
+    while (pos < chunk_len_) {
+      size_t used = 0;
+      n += decoder_.update(chunk_ + pos, chunk_len_ - pos, out + n, sizeof(out) - n, &used);
+      if (used == 0) {
+        break;
+      }
+      pos += used;
+    }
+    chunk_len_ = 0;
+    if (last) {
+      n += decoder_.finish(out + n);
+    }
+    if (failed_ || n == 0) {
+      return;
+    }
+    if (written_ + n > max_bytes_ || file_.write(out, n) != n) {
+      failed_ = true;
+      error_ = "Flash full while saving image";
+      return;
+    }
+    written_ += n;
+  }
+
+  File &file_;
+  const char *key_;
+  size_t max_bytes_;
+  State state_ = SCAN;
+  String token_;
+  bool esc_ = false;
+  char chunk_[kChunkChars];
+  size_t chunk_len_ = 0;
+  B64Decoder decoder_;
+  size_t written_ = 0;
+  bool failed_ = false;
+  String error_;
+};
+
+// POST body and save the image held in key of a 2xx response to
+// IMAGE_SPOOL_PATH. res_out keeps the status (and a non-2xx body) for the
+// caller's fallback decisions.
+bool post_for_image(const String &url, const String &json, const char *key,
+                    const char *parse_error, const String &h_name, const String &h_value,
+                    HttpResult &res_out, String &error_out) {
+  if (!flash_fs_begin()) {
+    res_out = HttpResult{};
+    res_out.status_code = -1;
+    res_out.error = FLASH_FS_NAME " not mounted";
+    error_out = res_out.error;
+    return false;
+  }
+  FLASH_FS.remove(IMAGE_SPOOL_PATH);
+  const size_t used = FLASH_FS.usedBytes();
+  const size_t free_bytes = FLASH_FS.totalBytes() > used ? FLASH_FS.totalBytes() - used : 0;
+  // Leave room for the other files
+  const size_t headroom = 16384;
+  const size_t max_bytes = free_bytes > headroom ? free_bytes - headroom : 0;
+
+  File file = FLASH_FS.open(IMAGE_SPOOL_PATH, FILE_WRITE);
+  if (!file) {
+    res_out = HttpResult{};
+    res_out.status_code = -1;
+    res_out.error = "Could not create image spool file";
+    error_out = res_out.error;
+    return false;
+  }
+
+  JsonBody body;
+  body.raw(json);
+  ImageSpoolSink sink(file, key, max_bytes);
+  res_out = http_post_json_to(&sink, url, body, h_name, h_value, "", "", "", "");
+  file.close();
+
+  const bool ok_status = res_out.status_code >= 200 && res_out.status_code < 300;
+  if (ok_status && sink.found()) {
+    Serial.printf("[llm] Image saved: %u bytes\n", (unsigned)sink.written());
+    return true;
+  }
+  FLASH_FS.remove(IMAGE_SPOOL_PATH);
+  if (ok_status) {
+    error_out = sink.error().length() > 0    ? sink.error()
+                : res_out.error.length() > 0 ? "Image read error: " + res_out.error
+                                             : String(parse_error);
+  }
+  return false;
+}
+
+}  // namespace
+
+bool llm_generate_image(const String &prompt, String &path_out, String &error_out) {
   String provider = to_lower(String(IMAGE_PROVIDER));
   String api_key = String(IMAGE_API_KEY);
 
@@ -1279,17 +3365,14 @@ bool llm_generate_image(const String &prompt, String &base64_out, String &error_
           String("{\"contents\":[{\"parts\":[{\"text\":\"") + json_escape(prompt) +
           "\"}]}],\"generationConfig\":{\"responseModalities\":[\"TEXT\",\"IMAGE\"]}}";
 
-      const HttpResult gen_res =
-          http_post_json(gen_url, gen_body, "x-goog-api-key", api_key);
+      // "data" only appears in the inlineData part of the response
+      HttpResult gen_res;
+      if (post_for_image(gen_url, gen_body, "data", "Could not parse Gemini image response",
+                         "x-goog-api-key", api_key, gen_res, last_err)) {
+        path_out = IMAGE_SPOOL_PATH;
+        return true;
+      }
       if (gen_res.status_code >= 200 && gen_res.status_code < 300) {
-        if (extract_json_string_field_after_anchor(gen_res.body, "\"inlineData\"", "data",
-                                                   base64_out) ||
-            extract_json_string_field_after_anchor(gen_res.body, "\"inline_data\"", "data",
-                                                   base64_out) ||
-            extract_json_string_field(gen_res.body, "data", base64_out)) {
-          return true;
-        }
-        last_err = "Could not parse Gemini image response";
         continue;
       }
 
@@ -1306,13 +3389,16 @@ bool llm_generate_image(const String &prompt, String &base64_out, String &error_
     const String imagen_body = String("{\"instances\":[{\"prompt\":\"") + json_escape(prompt) +
                                "\"}],\"parameters\":{\"sampleCount\":1}}";
 
-    const HttpResult imagen_res =
-        http_post_json(imagen_url, imagen_body, "x-goog-api-key", api_key);
+    HttpResult imagen_res;
+    String imagen_parse_err;
+    if (post_for_image(imagen_url, imagen_body, "bytesBase64Encoded",
+                       "Could not parse Imagen response", "x-goog-api-key", api_key, imagen_res,
+                       imagen_parse_err)) {
+      path_out = IMAGE_SPOOL_PATH;
+      return true;
+    }
     if (imagen_res.status_code >= 200 && imagen_res.status_code < 300) {
-      if (extract_json_string_field(imagen_res.body, "bytesBase64Encoded", base64_out)) {
-        return true;
-      }
-      error_out = "Could not parse Imagen response";
+      error_out = imagen_parse_err;
       return false;
     }
 
@@ -1343,20 +3429,25 @@ bool llm_generate_image(const String &prompt, String &base64_out, String &error_
     const String body = String("{\"model\":\"dall-e-3\",\"prompt\":\"") + json_escape(prompt) +
                         "\",\"n\":1,\"size\":\"1024x1024\",\"response_format\":\"b64_json\"}";
 
-    const HttpResult res = http_post_json(url, body, "Authorization", "Bearer " + api_key);
+    const uint32_t started_ms = millis();
+    HttpResult res;
+    const bool saved = post_for_image(url, body, "b64_json", "Could not parse DALL-E response",
+                                      "Authorization", "Bearer " + api_key, res, error_out);
+    const uint32_t latency_ms = millis() - started_ms;
     if (res.status_code < 200 || res.status_code >= 300) {
-      error_out = "DALL-E HTTP " + String(res.status_code);
-      usage_record_call("image", res.status_code, "openai", "dall-e-3");
+      error_out = res.status_code > 0 || res.error.length() == 0
+                      ? "DALL-E HTTP " + String(res.status_code)
+                      : "DALL-E network error: " + res.error;
+      usage_record_call("image", res.status_code, "openai", "dall-e-3", latency_ms);
       return false;
     }
-
-    if (!extract_json_string_field(res.body, "b64_json", base64_out)) {
-      error_out = "Could not parse DALL-E response";
-      usage_record_call("image", 500, "openai", "dall-e-3");
+    if (!saved) {
+      usage_record_call("image", 500, "openai", "dall-e-3", latency_ms);
       return false;
     }
 
-    usage_record_call("image", 200, "openai", "dall-e-3");
+    usage_record_call("image", 200, "openai", "dall-e-3", latency_ms);
+    path_out = IMAGE_SPOOL_PATH;
     return true;
   }
 
@@ -1368,8 +3459,38 @@ bool llm_generate_image(const String &prompt, String &base64_out, String &error_
 
 #if ENABLE_MEDIA_UNDERSTANDING
 
-bool llm_understand_media(const String &instruction, const String &mime_type,
-                          const String &base64_data, String &reply_out, String &error_out) {
+namespace {
+
+// Base64 media for a vision request, held either in RAM or in a flash file
+// that JsonBody reads from while the request is being sent.
+struct MediaPayload {
+  const String *base64;
+  File *file;
+  size_t length;
+};
+
+void add_media(JsonBody &body, const MediaPayload &media) {
+  if (media.file) {
+    body.file(*media.file);
+  } else {
+    body.raw(*media.base64);
+  }
+}
+
+void build_gemini_media_body(JsonBody &body, const String &prompt, const String &mime,
+                             const MediaPayload &media) {
+  body.raw("{\"contents\":[{\"parts\":[{\"text\":\"")
+      .escaped(prompt)
+      .raw("\"},{\"inlineData\":{\"mimeType\":\"")
+      .escaped(mime)
+      .raw("\",\"data\":\"");
+  add_media(body, media);
+  body.raw("\"}}]}],\"generationConfig\":{\"temperature\":0.2}}");
+}
+
+bool understand_media_impl(const String &instruction, const String &mime_type,
+                           const MediaPayload &media, size_t max_length, String &reply_out,
+                           String &error_out) {
   reply_out = "";
 
   // Try to get config from NVS first, fallback to .env
@@ -1419,11 +3540,11 @@ bool llm_understand_media(const String &instruction, const String &mime_type,
     media_mime = "image/jpeg";
   }
 
-  if (base64_data.length() == 0) {
+  if (media.length == 0) {
     error_out = "Missing media data";
     return false;
   }
-  if (base64_data.length() > 260000) {
+  if (media.length > max_length) {
     error_out = "Media payload too large for ESP32";
     return false;
   }
@@ -1441,33 +3562,33 @@ bool llm_understand_media(const String &instruction, const String &mime_type,
 
     const String url = join_url(gemini_base,
                                 String("/v1beta/models/") + model + ":generateContent");
-    const String body =
-        String("{\"contents\":[{\"parts\":[{\"text\":\"") + json_escape(prompt) +
-        "\"},{\"inlineData\":{\"mimeType\":\"" + json_escape(media_mime) +
-        "\",\"data\":\"" + base64_data +
-        "\"}}]}],\"generationConfig\":{\"temperature\":0.2}}";
+    JsonBody body;
+    build_gemini_media_body(body, prompt, media_mime, media);
 
-    const HttpResult res = http_post_json(url, body, "x-goog-api-key", api_key);
+    const uint32_t started_ms = millis();
+    const HttpResult res =
+        http_post_json_to(nullptr, url, body, "x-goog-api-key", api_key, "", "", "", "");
+    const uint32_t latency_ms = millis() - started_ms;
     if (res.status_code < 200 || res.status_code >= 300) {
       error_out = summarize_http_error("Gemini media", res);
-      usage_record_call("media", res.status_code, "gemini", model.c_str());
+      usage_record_call("media", res.status_code, "gemini", model.c_str(), latency_ms);
       return false;
     }
 
     if (!parse_response_text(res.body, reply_out)) {
       error_out = "Could not parse Gemini media response";
-      usage_record_call("media", 500, "gemini", model.c_str());
+      usage_record_call("media", 500, "gemini", model.c_str(), latency_ms);
       return false;
     }
 
     reply_out.trim();
     if (reply_out.length() == 0) {
       error_out = "Empty Gemini media response";
-      usage_record_call("media", 500, "gemini", model.c_str());
+      usage_record_call("media", 500, "gemini", model.c_str(), latency_ms);
       return false;
     }
 
-    usage_record_call("media", 200, "gemini", model.c_str());
+    usage_record_call("media", 200, "gemini", model.c_str(), latency_ms);
     return true;
   }
 
@@ -1497,35 +3618,39 @@ bool llm_understand_media(const String &instruction, const String &mime_type,
     }
 
     const String url = join_url(vision_base, "/v1/chat/completions");
-
-    // Build data URI: data:<mime>;base64,<data>
-    const String data_uri = "data:" + media_mime + ";base64," + base64_data;
+    const String auth = "Bearer " + api_key;
 
     // Retry loop: Try requested model, then fallback if it fails
     for (int attempt = 0; attempt < 2; attempt++) {
-      // OpenAI vision format with image_url
-      const String body =
-          String("{\"model\":\"") + json_escape(vision_model) +
-          "\",\"messages\":[{\"role\":\"user\",\"content\":[" +
-          "{\"type\":\"text\",\"text\":\"" + json_escape(prompt) + "\"}," +
-          "{\"type\":\"image_url\",\"image_url\":{\"url\":\"" + data_uri + "\"}}" +
-          "]}],\"temperature\":0.2,\"max_tokens\":1024}";
-
+      // OpenAI vision format with image_url as data:<mime>;base64,<data>
+      JsonBody body;
+      body.raw("{\"model\":\"")
+          .escaped(vision_model)
+          .raw("\",\"messages\":[{\"role\":\"user\",\"content\":[{\"type\":\"text\",\"text\":\"")
+          .escaped(prompt)
+          .raw("\"},{\"type\":\"image_url\",\"image_url\":{\"url\":\"data:")
+          .raw(media_mime)
+          .raw(";base64,");
+      add_media(body, media);
+      body.raw("\"}}]}],\"temperature\":0.2,\"max_tokens\":1024}");
+
+      const uint32_t started_ms = millis();
       const HttpResult res =
-          http_post_json(url, body, "Authorization", "Bearer " + api_key);
+          http_post_json_to(nullptr, url, body, "Authorization", auth, "", "", "", "");
+      const uint32_t latency_ms = millis() - started_ms;
 
       if (res.status_code >= 200 && res.status_code < 300) {
         if (parse_response_text(res.body, reply_out)) {
           reply_out.trim();
           if (reply_out.length() > 0) {
-            usage_record_call("media", 200, provider.c_str(), vision_model.c_str());
+            usage_record_call("media", 200, provider.c_str(), vision_model.c_str(), latency_ms);
             return true;
           }
         }
       }
 
       // Handle failure
-      usage_record_call("media", res.status_code, provider.c_str(), vision_model.c_str());
+      usage_record_call("media", res.status_code, provider.c_str(), vision_model.c_str(), latency_ms);
       
       // Only retry if on OpenRouter (can switch to other models)
       if (attempt == 0 && (provider == "openrouter" || provider == "openrouter.ai")) {
@@ -1542,17 +3667,18 @@ bool llm_understand_media(const String &instruction, const String &mime_type,
             // Execute Gemini logic inline
             String gemini_base = String(LLM_GEMINI_BASE_URL);
             String g_url = join_url(gemini_base, String("/v1beta/models/") + gemini_model + ":generateContent");
-            String g_body = String("{\"contents\":[{\"parts\":[{\"text\":\"") + json_escape(prompt) +
-                            "\"},{\"inlineData\":{\"mimeType\":\"" + json_escape(media_mime) +
-                            "\",\"data\":\"" + base64_data +
-                            "\"}}]}],\"generationConfig\":{\"temperature\":0.2}}";
+            JsonBody g_body;
+            build_gemini_media_body(g_body, prompt, media_mime, media);
 
-            HttpResult g_res = http_post_json(g_url, g_body, "x-goog-api-key", gemini_key);
+            const uint32_t g_started_ms = millis();
+            HttpResult g_res = http_post_json_to(nullptr, g_url, g_body, "x-goog-api-key",
+                                                 gemini_key, "", "", "", "");
             if (g_res.status_code >= 200 && g_res.status_code < 300) {
                if (parse_response_text(g_res.body, reply_out)) {
                    reply_out.trim();
                    if (reply_out.length() > 0) {
-                       usage_record_call("media", 200, "gemini", gemini_model.c_str());
+                       usage_record_call("media", 200, "gemini", gemini_model.c_str(),
+                                         millis() - g_started_ms);
                        return true;
                    }
                }
@@ -1580,6 +3706,32 @@ bool llm_understand_media(const String &instruction, const String &mime_type,
   return false;
 }
 
+}  // namespace
+
+bool llm_understand_media(const String &instruction, const String &mime_type,
+                          const String &base64_data, String &reply_out, String &error_out) {
+  const MediaPayload media{&base64_data, nullptr, base64_data.length()};
+  return understand_media_impl(instruction, mime_type, media, 260000, reply_out, error_out);
+}
+
+bool llm_understand_media_file(const String &instruction, const String &mime_type,
+                               const String &base64_path, String &reply_out,
+                               String &error_out) {
+  reply_out = "";
+  File file = FLASH_FS.open(base64_path, FILE_READ);
+  if (!file) {
+    error_out = "Missing media data";
+    return false;
+  }
+  const MediaPayload media{nullptr, &file, file.size()};
+  // The spool holds base64 of at most MEDIA_SPOOL_MAX_BYTES of media.
+  const bool ok = understand_media_impl(instruction, mime_type, media,
+                                        ((size_t)MEDIA_SPOOL_MAX_BYTES + 2) / 3 * 4, reply_out,
+                                        error_out);
+  file.close();
+  return ok;
+}
+
 #endif  // ENABLE_MEDIA_UNDERSTANDING
 
 namespace {
@@ -1615,6 +3767,20 @@ static String extract_json_value(const String &json, const String &key) {
   return json.substring(value_start, value_end);
 }
 
+// true for "key":true, "key":1 or a quoted "true"/"1"
+static bool extract_json_bool(const String &json, const char *key) {
+  const String search_key = String("\"") + key + "\":";
+  int pos = json.indexOf(search_key);
+  if (pos < 0) {
+    return false;
+  }
+  pos += search_key.length();
+  while (pos < (int)json.length() && (json[pos] == ' ' || json[pos] == '"')) {
+    pos++;
+  }
+  return json.startsWith("true", pos) || json.startsWith("1", pos);
+}
+
 }  // namespace
 
 bool llm_parse_email_request(const String &message, String &to_out, String &subject_out,
@@ -1624,144 +3790,32 @@ bool llm_parse_email_request(const String &message, String &to_out, String &subj
     return false;
   }
 
-  const String provider = to_lower(String(LLM_PROVIDER));
-  const String api_key = String(LLM_API_KEY);
-
-  if (api_key.length() == 0) {
-    error_out = "Missing LLM_API_KEY";
+  static const char *kEmailParsePrompt =
+      "Extract email details from the user's message. "
+      "Return ONLY in this exact JSON format (no markdown, no extra text):\n"
+      "{\"to\":\"email@example.com\",\"subject\":\"Email Subject\",\"body\":\"Email "
+      "body text\"}\n\n"
+      "Rules:\n"
+      "- If any field is missing or unclear, use empty string \"\"\n"
+      "- to: must be a valid email address\n"
+      "- subject: short and clear\n"
+      "- body: the main message content\n"
+      "- Return ONLY valid JSON, nothing else";
+
+  String response;
+  if (!generate_latency_sensitive(kEmailParsePrompt, message, response, error_out)) {
     return false;
   }
 
-  String url;
-  String headers;
-  String body;
-
-  // Build request based on provider
-  if (provider == "glm" || provider == "zhipu" || provider == "openai") {
-    // GLM and OpenAI-compatible format
-    url = join_url(String(LLM_GLM_BASE_URL), "/chat/completions");
-
-    const String system_prompt =
-        "Extract email details from the user's message. "
-        "Return ONLY in this exact JSON format (no markdown, no extra text):\n"
-        "{\"to\":\"email@example.com\",\"subject\":\"Email Subject\",\"body\":\"Email "
-        "body text\"}\n\n"
-        "Rules:\n"
-        "- If any field is missing or unclear, use empty string \"\"\n"
-        "- to: must be a valid email address\n"
-        "- subject: short and clear\n"
-        "- body: the main message content\n"
-        "- Return ONLY valid JSON, nothing else";
-
-    const String json_body =
-        String("{\"model\":\"") + String(LLM_MODEL) +
-        "\",\"messages\":[{\"role\":\"system\",\"content\":\"" + json_escape(system_prompt) +
-        "\"},{\"role\":\"user\",\"content\":\"" + json_escape(message) + "\"}]}";
-
-    const HttpResult res = http_post_json(url, json_body, "Authorization", "Bearer " + api_key);
-
-    if (res.status_code < 200 || res.status_code >= 300) {
-      error_out = "LLM HTTP " + String(res.status_code);
-      return false;
-    }
-
-    String response;
-    if (!parse_response_text(res.body, response)) {
-      error_out = "Could not parse LLM response";
-      return false;
-    }
-
-    // Parse JSON response
-    String json_str = response;
-    to_out = extract_json_value(json_str, "to");
-    subject_out = extract_json_value(json_str, "subject");
-    body_out = extract_json_value(json_str, "body");
-
-    if (to_out.length() == 0) {
-      error_out = "Could not extract email address from response";
-      return false;
-    }
-
-    return true;
-  }
-
-  if (provider == "gemini" || provider == "anthropic") {
-    // Gemini and Anthropic format (media understanding endpoint)
-    if (provider == "gemini") {
-      url = String("https://generativelanguage.googleapis.com/v1beta/models/") +
-             String(LLM_MODEL) + ":generateContent?key=" + api_key;
-    } else {
-      url = join_url(String(LLM_ANTHROPIC_BASE_URL), "/v1/messages");
-    }
-
-    const String prompt =
-        "Extract email details from: \"" + message + "\"\n"
-        "Return ONLY this JSON format: {\"to\":\"email\",\"subject\":\"subject\",\"body\":\"body\"}\n"
-        "Use empty string \"\" for missing fields.";
-
-    if (provider == "gemini") {
-      const String json_body =
-          String("{\"contents\":[{\"parts\":[{\"text\":\"" + json_escape(prompt) + "\"}]}]}");
-      const HttpResult res = http_post_json(url, json_body);
-
-      if (res.status_code < 200 || res.status_code >= 300) {
-        error_out = "Gemini HTTP " + String(res.status_code);
-        return false;
-      }
-
-      String response;
-      if (!parse_response_text(res.body, response)) {
-        error_out = "Could not parse Gemini response";
-        return false;
-      }
-
-      String json_str = response;
-      to_out = extract_json_value(json_str, "to");
-      subject_out = extract_json_value(json_str, "subject");
-      body_out = extract_json_value(json_str, "body");
-
-      if (to_out.length() == 0) {
-        error_out = "Could not extract email from response";
-        return false;
-      }
-
-      return true;
-    }
-
-    // Anthropic
-    const String json_body =
-        String("{\"model\":\"claude-3-haiku-20240307\",\"max_tokens\":1024,") +
-        "\"messages\":[{\"role\":\"user\",\"content\":\"" + json_escape(prompt) + "\"}]}";
-
-    const HttpResult res = http_post_json(url, json_body, "x-api-key",
-                                           "sk-ant-" + api_key);
-
-    if (res.status_code < 200 || res.status_code >= 300) {
-      error_out = "Anthropic HTTP " + String(res.status_code);
-      return false;
-    }
-
-    String response;
-    if (!parse_response_text(res.body, response)) {
-      error_out = "Could not parse Anthropic response";
-      return false;
-    }
-
-    String json_str = response;
-    to_out = extract_json_value(json_str, "to");
-    subject_out = extract_json_value(json_str, "subject");
-    body_out = extract_json_value(json_str, "body");
+  to_out = extract_json_value(response, "to");
+  subject_out = extract_json_value(response, "subject");
+  body_out = extract_json_value(response, "body");
 
-    if (to_out.length() == 0) {
-      error_out = "Could not extract email from response";
-      return false;
-    }
-
-    return true;
+  if (to_out.length() == 0) {
+    error_out = "Could not extract email address from response";
+    return false;
   }
-
-  error_out = "Email parsing not supported for provider: " + provider;
-  return false;
+  return true;
 }
 
 bool llm_parse_update_request(const String &message, String &url_out, bool &should_update_out,
@@ -1771,141 +3825,27 @@ bool llm_parse_update_request(const String &message, String &url_out, bool &shou
     return false;
   }
 
-  const String provider = to_lower(String(LLM_PROVIDER));
-  const String api_key = String(LLM_API_KEY);
-
-  if (api_key.length() == 0) {
-    error_out = "Missing LLM_API_KEY";
+  static const char *kUpdateParsePrompt =
+      "Parse the user's message about firmware update. "
+      "Return ONLY in this exact JSON format (no markdown, no extra text):\n"
+      "{\"url\":\"https://...\",\"should_update\":true,\"check_github\":false}\n\n"
+      "Rules:\n"
+      "- url: the firmware URL if provided, otherwise empty string \"\"\n"
+      "- should_update: true if user wants to update/check for updates, false otherwise\n"
+      "- check_github: true if user says 'latest', 'newest', or wants GitHub release, false otherwise\n"
+      "- If user just asks about update status, set should_update=true but url=\"\" and check_github=false\n"
+      "- If user wants latest release from GitHub, set check_github=true and url=\"\"\n"
+      "- Return ONLY valid JSON, nothing else";
+
+  String response;
+  if (!generate_latency_sensitive(kUpdateParsePrompt, message, response, error_out)) {
     return false;
   }
 
-  String url;
-  String headers;
-  String body;
-
-  // Build request based on provider
-  if (provider == "glm" || provider == "zhipu" || provider == "openai") {
-    // GLM and OpenAI-compatible format
-    url = join_url(String(LLM_GLM_BASE_URL), "/chat/completions");
-
-    const String system_prompt =
-        "Parse the user's message about firmware update. "
-        "Return ONLY in this exact JSON format (no markdown, no extra text):\n"
-        "{\"url\":\"https://...\",\"should_update\":true,\"check_github\":false}\n\n"
-        "Rules:\n"
-        "- url: the firmware URL if provided, otherwise empty string \"\"\n"
-        "- should_update: true if user wants to update/check for updates, false otherwise\n"
-        "- check_github: true if user says 'latest', 'newest', or wants GitHub release, false otherwise\n"
-        "- If user just asks about update status, set should_update=true but url=\"\" and check_github=false\n"
-        "- If user wants latest release from GitHub, set check_github=true and url=\"\"\n"
-        "- Return ONLY valid JSON, nothing else";
-
-    const String json_body =
-        String("{\"model\":\"") + String(LLM_MODEL) +
-        "\",\"messages\":[{\"role\":\"system\",\"content\":\"" + json_escape(system_prompt) +
-        "\"},{\"role\":\"user\",\"content\":\"" + json_escape(message) + "\"}]}";
-
-    const HttpResult res = http_post_json(url, json_body, "Authorization", "Bearer " + api_key);
-
-    if (res.status_code < 200 || res.status_code >= 300) {
-      error_out = "LLM HTTP " + String(res.status_code);
-      return false;
-    }
-
-    String response;
-    if (!parse_response_text(res.body, response)) {
-      error_out = "Could not parse LLM response";
-      return false;
-    }
-
-    // Parse JSON response
-    String json_str = response;
-    url_out = extract_json_value(json_str, "url");
-
-    String should_update_str = extract_json_value(json_str, "should_update");
-    should_update_out = (should_update_str == "true" || should_update_str == "1");
-
-    String check_github_str = extract_json_value(json_str, "check_github");
-    check_github_out = (check_github_str == "true" || check_github_str == "1");
-
-    return true;
-  }
-
-  if (provider == "gemini" || provider == "anthropic") {
-    // Gemini and Anthropic format
-    if (provider == "gemini") {
-      url = String("https://generativelanguage.googleapis.com/v1beta/models/") +
-             String(LLM_MODEL) + ":generateContent?key=" + api_key;
-    } else {
-      url = join_url(String(LLM_ANTHROPIC_BASE_URL), "/v1/messages");
-    }
-
-    const String prompt =
-        "Parse this update request: \"" + message + "\"\n"
-        "Return ONLY this JSON format: {\"url\":\"https://...\",\"should_update\":true,\"check_github\":false}\n"
-        "url: firmware URL or empty, should_update: true/false, check_github: true if user wants latest from GitHub";
-
-    if (provider == "gemini") {
-      const String json_body =
-          String("{\"contents\":[{\"parts\":[{\"text\":\"" + json_escape(prompt) + "\"}]}]}");
-      const HttpResult res = http_post_json(url, json_body);
-
-      if (res.status_code < 200 || res.status_code >= 300) {
-        error_out = "Gemini HTTP " + String(res.status_code);
-        return false;
-      }
-
-      String response;
-      if (!parse_response_text(res.body, response)) {
-        error_out = "Could not parse Gemini response";
-        return false;
-      }
-
-      String json_str = response;
-      url_out = extract_json_value(json_str, "url");
-
-      String should_update_str = extract_json_value(json_str, "should_update");
-      should_update_out = (should_update_str == "true" || should_update_str == "1");
-
-      String check_github_str = extract_json_value(json_str, "check_github");
-      check_github_out = (check_github_str == "true" || check_github_str == "1");
-
-      return true;
-    }
-
-    // Anthropic
-    const String json_body =
-        String("{\"model\":\"claude-3-haiku-20240307\",\"max_tokens\":1024,") +
-        "\"messages\":[{\"role\":\"user\",\"content\":\"" + json_escape(prompt) + "\"}]}";
-
-    const HttpResult res = http_post_json(url, json_body, "x-api-key",
-                                           "sk-ant-" + api_key);
-
-    if (res.status_code < 200 || res.status_code >= 300) {
-      error_out = "Anthropic HTTP " + String(res.status_code);
-      return false;
-    }
-
-    String response;
-    if (!parse_response_text(res.body, response)) {
-      error_out = "Could not parse Anthropic response";
-      return false;
-    }
-
-    String json_str = response;
-    url_out = extract_json_value(json_str, "url");
-
-    String should_update_str = extract_json_value(json_str, "should_update");
-    should_update_out = (should_update_str == "true" || should_update_str == "1");
-
-    String check_github_str = extract_json_value(json_str, "check_github");
-    check_github_out = (check_github_str == "true" || check_github_str == "1");
-
-    return true;
-  }
-
-  error_out = "Update parsing not supported for provider: " + provider;
-  return false;
+  url_out = extract_json_value(response, "url");
+  should_update_out = extract_json_bool(response, "should_update");
+  check_github_out = extract_json_bool(response, "check_github");
+  return true;
 }
 
 bool llm_fetch_provider_models(const String &provider, String &models_out, String &error_out) {
@@ -1924,7 +3864,7 @@ bool llm_fetch_provider_models(const String &provider, String &models_out, Strin
   }
 
   // Fetch models from OpenRouter
-  if (WiFi.status() != WL_CONNECTED) {
+  if (!wifi_link_ready()) {
     error_out = "WiFi not connected";
     return false;
   }
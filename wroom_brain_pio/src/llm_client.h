@@ -3,26 +3,109 @@
 
 #include <Arduino.h>
 
+#include "brain_config.h"
+
 // Generate text with a custom system prompt (for ReAct agent, etc.)
-// Returns true on success, false on error
+// Returns true on success, false on error. cache_reply lets a verbatim repeat
+// be answered from the response cache; leave it off for generations a user
+// may retry to get a different result.
 bool llm_generate_with_custom_prompt(const String &system_prompt, const String &task,
-                                     bool include_memory, String &reply_out, String &error_out);
+                                     bool include_memory, String &reply_out, String &error_out,
+                                     bool cache_reply = false);
+
+// One turn of a multi-message chat request.
+struct LlmMessage {
+  bool from_assistant;
+  String content;
+};
+
+// Multi-turn variant of llm_generate_with_custom_prompt: messages alternate
+// user/assistant, start and end with a user turn, and are sent as separate chat
+// turns so providers can reuse the cached prefix of a growing conversation.
+// Memory notes are not added; put them in the first message when needed.
+bool llm_generate_chat(const String &system_prompt, const LlmMessage *messages, size_t count,
+                       String &reply_out, String &error_out);
+
+// Native tool calling. Every tool takes one optional string argument, "args",
+// holding the same argument line the command table parses.
+struct LlmToolSpec {
+  const char *name;
+  const char *description;
+  const char *usage;  // "" when the tool takes no arguments
+};
+
+struct LlmToolCall {
+  String id;  // call id (OpenAI, Anthropic) or thought signature (Gemini), echoed back
+  String name;
+  String args;
+  String result;  // set by the caller before the calls are sent back
+};
+
+// Turns of a tool conversation: the user's opening turn (no calls), then one
+// per assistant step holding its text, the calls it made and their results.
+struct LlmToolTurn {
+  String text;
+  LlmToolCall calls[LLM_TOOL_MAX_CALLS];
+  size_t call_count = 0;
+};
+
+// Tools offered by llm_generate_tool_step. Set once at init, before the agent
+// lanes start. The specs must stay valid; each provider format's schema is
+// built from them on first use and reused unchanged by every later call.
+void llm_set_tool_specs(const LlmToolSpec *tools, size_t count);
+
+// True when tool specs are set and the active provider takes native tools.
+bool llm_native_tools_available();
+
+// Next step of a tool conversation with the active provider. reply_out gets
+// the assistant text and up to LLM_TOOL_MAX_CALLS calls; no calls means the
+// text is the final answer.
+bool llm_generate_tool_step(const String &system_prompt, const LlmToolTurn *turns, size_t count,
+                            LlmToolTurn &reply_out, String &error_out);
 
 bool llm_generate_plan(const String &task, String &plan_out, String &error_out);
 bool llm_generate_reply(const String &message, String &reply_out, String &error_out);
+
+// Called with the accumulated reply text each time a streamed delta arrives.
+typedef void (*llm_stream_cb_t)(const String &text_so_far, void *ctx);
+
+// Same as llm_generate_reply, but streams tokens to on_text as they arrive when
+// the active provider supports it. reply_out always holds the final text.
+bool llm_generate_reply_stream(const String &message, llm_stream_cb_t on_text, void *ctx,
+                               String &reply_out, String &error_out);
 bool llm_generate_heartbeat(const String &heartbeat_doc, String &reply_out, String &error_out);
 bool llm_route_tool_command(const String &message, String &command_out, String &error_out);
-bool llm_generate_image(const String &prompt, String &base64_out, String &error_out);
+
+// Chat reply started on a helper task while the router is still deciding, so
+// an unrouted message does not wait for two round trips. Nothing reaches
+// on_text until finish(); cancel() cuts a streamed reply short and drops any
+// other. Both end the handle.
+struct LlmSpeculativeReply;
+// nullptr when off (LLM_SPECULATIVE_REPLY) or short on heap.
+LlmSpeculativeReply *llm_speculative_reply_start(const String &message, llm_stream_cb_t on_text,
+                                                 void *ctx);
+void llm_speculative_reply_cancel(LlmSpeculativeReply *spec);
+// Streams the rest to on_text and waits for the reply, as llm_generate_reply_stream.
+bool llm_speculative_reply_finish(LlmSpeculativeReply *spec, String &reply_out,
+                                  String &error_out);
+// Generated image is decoded to IMAGE_SPOOL_PATH on flash as it downloads;
+// path_out names the file, which the caller removes.
+bool llm_generate_image(const String &prompt, String &path_out, String &error_out);
 bool llm_understand_media(const String &instruction, const String &mime_type,
                           const String &base64_data, String &reply_out, String &error_out);
+// Same, reading the base64 data from a FLASH_FS file while the request is sent.
+bool llm_understand_media_file(const String &instruction, const String &mime_type,
+                               const String &base64_path, String &reply_out,
+                               String &error_out);
 bool llm_parse_email_request(const String &message, String &to_out, String &subject_out,
                              String &body_out, String &error_out);
 bool llm_parse_update_request(const String &message, String &url_out, bool &should_update_out,
                               bool &check_github_out, String &error_out);
 
-// Auto-learn: extract personal facts from user messages
-bool llm_extract_user_facts(const String &user_message, const String &existing_profile,
-                            String &facts_out, String &error_out);
+// Auto-learn: extract personal facts from a batch of user messages in one call
+bool llm_extract_user_facts(const String *user_messages, size_t count,
+                            const String &existing_profile, String &facts_out,
+                            String &error_out);
 
 // Proactive: generate a proactive message based on context
 bool llm_generate_proactive(const String &context, String &reply_out, String &error_out);
@@ -30,6 +113,15 @@ bool llm_generate_proactive(const String &context, String &reply_out, String &er
 // Fetch available models from a provider (e.g., OpenRouter)
 bool llm_fetch_provider_models(const String &provider, String &models_out, String &error_out);
 
+// Close pooled provider connections that have been idle longer than
+// LLM_CONN_IDLE_MS, returning their TLS buffers to the heap.
+void llm_release_idle_connections();
+
+// Hooks for the bench command: the chat reply prompt as generate_reply
+// builds it, and the streaming reply extractor run over a recorded body.
+void llm_build_reply_prompt(const String &message, String &system_out, String &task_out);
+bool llm_extract_reply_text(const char *body, size_t len, String &text_out);
+
 // Helper to get compact time string (e.g. "Wednesday morning, 14:32")
 String build_time_context();
 
@@ -2,12 +2,21 @@
 #include <ArduinoOTA.h>
 #include "agent_loop.h"
 #include "brain_config.h"
+#include "event_log.h"
+#include "metrics.h"
+#include "msg_spool.h"
+#include "power_mgr.h"
+#include "psram_alloc.h"
+#include "usage_stats.h"
 
 void setup() {
   Serial.begin(115200);
   delay(250);
   Serial.println("\\n[wroom_brain_pio] boot");
+  psram_alloc_init();
+  vTaskPrioritySet(NULL, TASK_PRIO_LOOP);
   agent_loop_init();
+  metrics_register_task(xTaskGetCurrentTaskHandle(), getArduinoLoopTaskStackSize());
 
   // Setup OTA updates
   ArduinoOTA.setHostname("wroom-brain-2");
@@ -15,6 +24,9 @@ void setup() {
 
   ArduinoOTA.onStart([]() {
     Serial.println("[ota] Start updating");
+    usage_flush();
+    event_log_flush();
+    msg_spool_sync();
   });
   ArduinoOTA.onEnd([]() {
     Serial.println("[ota] Update complete");
@@ -38,7 +50,10 @@ void setup() {
 }
 
 void loop() {
-  ArduinoOTA.handle();
-  agent_loop_tick();
-  delay(50);
+  {
+    PowerBusyScope busy;
+    ArduinoOTA.handle();
+    agent_loop_tick();
+  }
+  delay(power_loop_delay_ms());
 }
@@ -4,6 +4,7 @@
 #include <Preferences.h>
 
 #include "brain_config.h"
+#include "context_cache.h"
 
 namespace {
 
@@ -74,9 +75,11 @@ bool memory_append_note(const String &note, String &error_out) {
 
   size_t written = g_prefs.putString(kNotesKey, merged);
   if (written == 0 && merged.length() > 0) {
+    context_cache_invalidate(CTX_NOTES);
     error_out = "failed to write memory";
     return false;
   }
+  context_cache_put(CTX_NOTES, merged, context_cache_invalidate(CTX_NOTES));
   return true;
 }
 
@@ -85,7 +88,12 @@ bool memory_get_notes(String &notes_out, String &error_out) {
     return false;
   }
 
+  if (context_cache_get(CTX_NOTES, notes_out)) {
+    return true;
+  }
+  const uint32_t generation = context_cache_generation(CTX_NOTES);
   notes_out = g_prefs.getString(kNotesKey, "");
+  context_cache_put(CTX_NOTES, notes_out, generation);
   return true;
 }
 
@@ -94,5 +102,6 @@ bool memory_clear_notes(String &error_out) {
     return false;
   }
   g_prefs.remove(kNotesKey);
+  context_cache_put(CTX_NOTES, "", context_cache_invalidate(CTX_NOTES));
   return true;
 }
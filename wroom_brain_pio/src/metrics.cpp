@@ -0,0 +1,349 @@
+#include "metrics.h"
+
+#include <esp_heap_caps.h>
+
+#include "brain_config.h"
+
+namespace {
+
+struct TaskEntry {
+  TaskHandle_t handle;
+  char name[16];
+  uint32_t stack_bytes;
+};
+
+// Free-heap deltas are process-wide, so they also include whatever other
+// tasks allocated meanwhile; with both agent lanes busy the figures are an
+// upper bound on what the stage itself held.
+struct StageStats {
+  uint32_t runs;
+  uint64_t retained_total;  // free heap not yet returned when the stage ended
+  uint32_t retained_max;
+  uint32_t new_lows;        // runs during which the boot-time heap low dropped
+  uint32_t peak_max;        // stage start free heap minus that new low
+};
+
+struct ChatStats {
+  char chat[24];  // "" while free
+  uint32_t depth;
+  uint32_t messages;
+  uint64_t wait_ms_total;
+  uint64_t latency_ms_total;
+  uint32_t latency_max_ms;
+  uint32_t last_ms;
+};
+
+const char *const kStageNames[METRICS_STAGE_COUNT] = {
+    "message", "tool", "route", "react", "reply", "send", "learn",
+};
+
+TaskEntry g_tasks[METRICS_MAX_TASKS];
+size_t g_task_count = 0;
+StageStats g_stages[METRICS_STAGE_COUNT];
+uint32_t g_largest_block_low = UINT32_MAX;
+ChatStats g_chats[AGENT_MAX_CHATS];
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+
+uint32_t free_heap() {
+  return (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+uint32_t boot_low() {
+  return (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+}
+
+uint32_t largest_block() {
+  return (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
+int task_core(TaskHandle_t task) {
+  const BaseType_t core = xTaskGetAffinity(task);
+  return core == tskNO_AFFINITY ? -1 : (int)core;
+}
+
+void prom_header(String &out, const char *name, const char *type, const char *help) {
+  out += "# HELP ";
+  out += name;
+  out += ' ';
+  out += help;
+  out += "\n# TYPE ";
+  out += name;
+  out += ' ';
+  out += type;
+  out += '\n';
+}
+
+void prom_value(String &out, const char *name, const char *label, const char *label_value,
+                uint64_t value) {
+  out += name;
+  if (label != nullptr) {
+    out += '{';
+    out += label;
+    out += "=\"";
+    out += label_value;
+    out += "\"}";
+  }
+  char buf[24];
+  snprintf(buf, sizeof(buf), " %llu\n", (unsigned long long)value);
+  out += buf;
+}
+
+void prom_gauge(String &out, const char *name, const char *help, uint64_t value) {
+  prom_header(out, name, "gauge", help);
+  prom_value(out, name, nullptr, nullptr, value);
+}
+
+// Entry for chat, taking over a free or the longest idle one. Call under g_mux.
+ChatStats *chat_entry(const char *chat) {
+  ChatStats *idle = nullptr;
+  for (int i = 0; i < AGENT_MAX_CHATS; i++) {
+    ChatStats &c = g_chats[i];
+    if (strncmp(c.chat, chat, sizeof(c.chat) - 1) == 0) {
+      return &c;
+    }
+    if (c.depth == 0 && (idle == nullptr || c.chat[0] == '\0' ||
+                         (idle->chat[0] != '\0' && c.last_ms < idle->last_ms))) {
+      idle = &c;
+    }
+  }
+  if (idle != nullptr) {
+    memset(idle, 0, sizeof(*idle));
+    strncpy(idle->chat, chat, sizeof(idle->chat) - 1);
+  }
+  return idle;
+}
+
+void snapshot(TaskEntry *tasks, size_t &task_count, StageStats *stages, uint32_t &largest_low) {
+  portENTER_CRITICAL(&g_mux);
+  task_count = g_task_count;
+  memcpy(tasks, g_tasks, sizeof(TaskEntry) * g_task_count);
+  memcpy(stages, g_stages, sizeof(g_stages));
+  largest_low = g_largest_block_low;
+  portEXIT_CRITICAL(&g_mux);
+}
+
+}  // namespace
+
+void metrics_register_task(TaskHandle_t task, uint32_t stack_bytes) {
+  if (task == nullptr) {
+    return;
+  }
+  const char *name = pcTaskGetName(task);
+  portENTER_CRITICAL(&g_mux);
+  if (g_task_count < METRICS_MAX_TASKS) {
+    TaskEntry &e = g_tasks[g_task_count++];
+    e.handle = task;
+    strncpy(e.name, name != nullptr ? name : "?", sizeof(e.name) - 1);
+    e.name[sizeof(e.name) - 1] = '\0';
+    e.stack_bytes = stack_bytes;
+  }
+  portEXIT_CRITICAL(&g_mux);
+}
+
+void metrics_chat_queued(const char *chat) {
+  portENTER_CRITICAL(&g_mux);
+  ChatStats *c = chat_entry(chat);
+  if (c != nullptr) {
+    c->depth++;
+    c->last_ms = millis();
+  }
+  portEXIT_CRITICAL(&g_mux);
+}
+
+void metrics_chat_done(const char *chat, uint32_t wait_ms, uint32_t total_ms) {
+  portENTER_CRITICAL(&g_mux);
+  ChatStats *c = chat_entry(chat);
+  if (c != nullptr) {
+    if (c->depth > 0) {
+      c->depth--;
+    }
+    c->messages++;
+    c->wait_ms_total += wait_ms;
+    c->latency_ms_total += total_ms;
+    if (total_ms > c->latency_max_ms) {
+      c->latency_max_ms = total_ms;
+    }
+    c->last_ms = millis();
+  }
+  portEXIT_CRITICAL(&g_mux);
+}
+
+MetricsMark metrics_stage_begin() {
+  MetricsMark mark;
+  mark.free_heap = free_heap();
+  mark.boot_low = boot_low();
+  return mark;
+}
+
+void metrics_stage_end(MetricsStage stage, const MetricsMark &mark) {
+  if (stage >= METRICS_STAGE_COUNT) {
+    return;
+  }
+  const uint32_t free_now = free_heap();
+  const uint32_t low_now = boot_low();
+  const uint32_t largest = largest_block();
+  const uint32_t retained = mark.free_heap > free_now ? mark.free_heap - free_now : 0;
+
+  portENTER_CRITICAL(&g_mux);
+  StageStats &s = g_stages[stage];
+  s.runs++;
+  s.retained_total += retained;
+  if (retained > s.retained_max) {
+    s.retained_max = retained;
+  }
+  if (low_now < mark.boot_low) {
+    s.new_lows++;
+    const uint32_t peak = mark.free_heap > low_now ? mark.free_heap - low_now : 0;
+    if (peak > s.peak_max) {
+      s.peak_max = peak;
+    }
+  }
+  if (largest < g_largest_block_low) {
+    g_largest_block_low = largest;
+  }
+  portEXIT_CRITICAL(&g_mux);
+}
+
+void metrics_format_prometheus(String &out) {
+  TaskEntry tasks[METRICS_MAX_TASKS];
+  size_t task_count = 0;
+  StageStats stages[METRICS_STAGE_COUNT];
+  uint32_t largest_low = 0;
+  snapshot(tasks, task_count, stages, largest_low);
+
+  out = "";
+  out.reserve(2048);
+  prom_gauge(out, "brain_uptime_seconds", "Seconds since boot.", millis() / 1000);
+  prom_gauge(out, "brain_heap_size_bytes", "Total 8-bit capable heap.",
+             heap_caps_get_total_size(MALLOC_CAP_8BIT));
+  prom_gauge(out, "brain_heap_free_bytes", "Free 8-bit capable heap.", free_heap());
+  prom_gauge(out, "brain_heap_min_free_bytes", "Lowest free heap since boot.", boot_low());
+  prom_gauge(out, "brain_heap_largest_free_block_bytes", "Largest allocatable block now.",
+             largest_block());
+  prom_gauge(out, "brain_heap_largest_free_block_min_bytes",
+             "Smallest largest-free-block seen at the end of a pipeline stage.",
+             largest_low == UINT32_MAX ? largest_block() : largest_low);
+
+  prom_header(out, "brain_task_stack_bytes", "gauge", "Stack size a task was created with.");
+  for (size_t i = 0; i < task_count; i++) {
+    prom_value(out, "brain_task_stack_bytes", "task", tasks[i].name, tasks[i].stack_bytes);
+  }
+  prom_header(out, "brain_task_priority", "gauge", "Current FreeRTOS priority of a task.");
+  for (size_t i = 0; i < task_count; i++) {
+    prom_value(out, "brain_task_priority", "task", tasks[i].name,
+               uxTaskPriorityGet(tasks[i].handle));
+  }
+  prom_header(out, "brain_task_core", "gauge", "Core a task is pinned to (-1 for either).");
+  for (size_t i = 0; i < task_count; i++) {
+    // Prometheus values are signed; prom_value only takes unsigned ones
+    out += "brain_task_core{task=\"";
+    out += tasks[i].name;
+    out += "\"} ";
+    out += String(task_core(tasks[i].handle));
+    out += '\n';
+  }
+  prom_header(out, "brain_task_stack_free_min_bytes", "gauge",
+              "Stack a task has never touched (high-water mark).");
+  for (size_t i = 0; i < task_count; i++) {
+    prom_value(out, "brain_task_stack_free_min_bytes", "task", tasks[i].name,
+               uxTaskGetStackHighWaterMark(tasks[i].handle));
+  }
+
+  struct StageColumn {
+    const char *name;
+    const char *type;
+    const char *help;
+  };
+  static const StageColumn kColumns[] = {
+      {"brain_stage_runs_total", "counter", "Pipeline stage runs."},
+      {"brain_stage_heap_retained_bytes_total", "counter",
+       "Free heap not yet returned when a stage ended."},
+      {"brain_stage_heap_retained_max_bytes", "gauge", "Largest single-run retained heap."},
+      {"brain_stage_heap_new_lows_total", "counter",
+       "Runs during which the free heap reached a new low since boot."},
+      {"brain_stage_heap_peak_max_bytes", "gauge",
+       "Largest drop from stage start to a new heap low."},
+  };
+  for (size_t c = 0; c < sizeof(kColumns) / sizeof(kColumns[0]); c++) {
+    prom_header(out, kColumns[c].name, kColumns[c].type, kColumns[c].help);
+    for (size_t i = 0; i < METRICS_STAGE_COUNT; i++) {
+      const StageStats &s = stages[i];
+      const uint64_t values[] = {s.runs, s.retained_total, s.retained_max, s.new_lows, s.peak_max};
+      prom_value(out, kColumns[c].name, "stage", kStageNames[i], values[c]);
+    }
+  }
+
+  ChatStats chats[AGENT_MAX_CHATS];
+  portENTER_CRITICAL(&g_mux);
+  memcpy(chats, g_chats, sizeof(g_chats));
+  portEXIT_CRITICAL(&g_mux);
+  static const StageColumn kChatColumns[] = {
+      {"brain_chat_queue_depth", "gauge", "Messages queued or running for a chat."},
+      {"brain_chat_messages_total", "counter", "Messages answered for a chat."},
+      {"brain_chat_wait_ms_total", "counter", "Time messages spent in the chat's sub-queue."},
+      {"brain_chat_latency_ms_total", "counter", "Time from queueing to the reply."},
+      {"brain_chat_latency_max_ms", "gauge", "Slowest reply for a chat."},
+  };
+  for (size_t c = 0; c < sizeof(kChatColumns) / sizeof(kChatColumns[0]); c++) {
+    prom_header(out, kChatColumns[c].name, kChatColumns[c].type, kChatColumns[c].help);
+    for (size_t i = 0; i < AGENT_MAX_CHATS; i++) {
+      const ChatStats &s = chats[i];
+      if (s.chat[0] == '\0') {
+        continue;
+      }
+      const uint64_t values[] = {s.depth, s.messages, s.wait_ms_total, s.latency_ms_total,
+                                 s.latency_max_ms};
+      prom_value(out, kChatColumns[c].name, "chat", s.chat, values[c]);
+    }
+  }
+}
+
+void metrics_describe_heap(String &out) {
+  TaskEntry tasks[METRICS_MAX_TASKS];
+  size_t task_count = 0;
+  StageStats stages[METRICS_STAGE_COUNT];
+  uint32_t largest_low = 0;
+  snapshot(tasks, task_count, stages, largest_low);
+
+  out = "Free Heap:     " + String(free_heap()) + " / " +
+        String((unsigned)heap_caps_get_total_size(MALLOC_CAP_8BIT)) + " bytes\n";
+  out += "Min Free:      " + String(boot_low()) + " bytes (since boot)\n";
+  out += "Largest Block: " + String(largest_block()) + " bytes";
+  if (largest_low != UINT32_MAX) {
+    out += " (low " + String(largest_low) + ")";
+  }
+  out += "\n\nSTAGE     RUNS    RETAINED(max)  NEW LOWS  PEAK\n";
+  for (size_t i = 0; i < METRICS_STAGE_COUNT; i++) {
+    const StageStats &s = stages[i];
+    char line[72];
+    snprintf(line, sizeof(line), "%-8s  %6u  %13u  %8u  %u\n", kStageNames[i],
+             (unsigned)s.runs, (unsigned)s.retained_max, (unsigned)s.new_lows,
+             (unsigned)s.peak_max);
+    out += line;
+  }
+}
+
+void metrics_describe_tasks(String &out) {
+  TaskEntry tasks[METRICS_MAX_TASKS];
+  size_t task_count = 0;
+  StageStats stages[METRICS_STAGE_COUNT];
+  uint32_t largest_low = 0;
+  snapshot(tasks, task_count, stages, largest_low);
+
+  out = "TASK             CORE  PRI   STACK   MIN FREE  USED%\n";
+  for (size_t i = 0; i < task_count; i++) {
+    const uint32_t free_min = uxTaskGetStackHighWaterMark(tasks[i].handle);
+    const uint32_t used = tasks[i].stack_bytes > free_min ? tasks[i].stack_bytes - free_min : 0;
+    const int core = task_core(tasks[i].handle);
+    char core_buf[4] = "any";
+    if (core >= 0) {
+      snprintf(core_buf, sizeof(core_buf), "%d", core);
+    }
+    char line[80];
+    snprintf(line, sizeof(line), "%-15s  %4s  %3u  %6u  %8u  %4u%%\n", tasks[i].name, core_buf,
+             (unsigned)uxTaskPriorityGet(tasks[i].handle), (unsigned)tasks[i].stack_bytes,
+             (unsigned)free_min,
+             (unsigned)(tasks[i].stack_bytes > 0 ? used * 100 / tasks[i].stack_bytes : 0));
+    out += line;
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Stack headroom, core and priority of the long-lived tasks, heap fragmentation and per-stage
+// heap use of the message pipeline, for GET /api/metrics (Prometheus text)
+// and MinOS free/top. Everything is sampled on demand or at stage edges from
+// O(1) heap queries, so it can stay on in production builds.
+
+enum MetricsStage {
+  METRICS_STAGE_MESSAGE = 0,  // whole agent_loop_process_message
+  METRICS_STAGE_TOOL,         // direct tool dispatch
+  METRICS_STAGE_ROUTE,        // intent routing and the routed tool
+  METRICS_STAGE_REACT,
+  METRICS_STAGE_REPLY,        // plain LLM chat reply
+  METRICS_STAGE_SEND,         // Telegram reply delivery
+  METRICS_STAGE_LEARN,        // background fact extraction
+  METRICS_STAGE_COUNT
+};
+
+// Track a task that lives for the whole uptime; stack_bytes is what it was
+// created with. Tasks that may exit must not be registered.
+void metrics_register_task(TaskHandle_t task, uint32_t stack_bytes);
+
+// Heap state when a stage started.
+struct MetricsMark {
+  uint32_t free_heap;
+  uint32_t boot_low;
+};
+
+MetricsMark metrics_stage_begin();
+void metrics_stage_end(MetricsStage stage, const MetricsMark &mark);
+
+// Per-chat queueing, keyed by the agent's chat key (Telegram chat id, "web"
+// or "scheduler"): queued when a message enters a chat's sub-queue, done
+// with how long it waited there and how long until it was answered.
+void metrics_chat_queued(const char *chat);
+void metrics_chat_done(const char *chat, uint32_t wait_ms, uint32_t total_ms);
+
+// Prometheus text exposition format.
+void metrics_format_prometheus(String &out);
+
+// Plain-text tables for the MinOS shell.
+void metrics_describe_heap(String &out);
+void metrics_describe_tasks(String &out);
+
+// Counts the enclosing scope as one run of a stage.
+class MetricsStageScope {
+ public:
+  explicit MetricsStageScope(MetricsStage stage) : stage_(stage), mark_(metrics_stage_begin()) {}
+  ~MetricsStageScope() { metrics_stage_end(stage_, mark_); }
+
+ private:
+  MetricsStageScope(const MetricsStageScope &) = delete;
+  MetricsStageScope &operator=(const MetricsStageScope &) = delete;
+  MetricsStage stage_;
+  MetricsMark mark_;
+};
+
+#endif
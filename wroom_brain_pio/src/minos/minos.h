@@ -3,17 +3,30 @@
 
 #include <Arduino.h>
 #include <FS.h>
-#include <SPIFFS.h>
+
+#include "../flash_fs.h"
 
 /* Task states */
 #define TASK_READY    0
 #define TASK_RUNNING  1
 #define TASK_SLEEPING 2
 #define TASK_BLOCKED  3
+#define TASK_EXITED   4
+
+/* Marks an empty queue link or "no task running" */
+#define TASK_NONE 0xFF
 
 /* Maximum number of tasks */
 #define MAX_TASKS 16
 
+/* Priority levels; higher runs first, as in FreeRTOS */
+#define MINOS_PRIORITIES 4
+
+/* Kernel tick, and how much of it tasks may use before the rest wait.
+ * The loop only wakes on ticks where something is due. */
+#define MINOS_TICK_MS 10
+#define MINOS_SLICE_US 5000
+
 /* Task Control Block */
 typedef struct task {
     uint32_t id;
@@ -23,7 +36,10 @@ typedef struct task {
     void (*entry)(void);
     uint32_t stack_ptr;
     uint32_t stack_size;
-    uint32_t sleep_ticks;
+    uint32_t wake_tick;
+    uint8_t next;        /* ready or sleep queue link */
+    uint32_t run_count;  /* entry() calls so far */
+    uint64_t cpu_us;     /* time spent inside entry() */
 } task_t;
 
 /* Kernel functions */
@@ -32,10 +48,13 @@ void kernel_start(void);
 void kernel_yield(void);
 void kernel_sleep(uint32_t ticks);
 void kernel_stop(void);
+uint32_t kernel_wakeup_count(void);
 
-/* Task functions */
+/* Task functions. entry() runs one slice per call and must return;
+ * task_create is safe to call from any FreeRTOS task after kernel_init. */
 int task_create(const char *name, void (*entry)(void), uint8_t priority);
 void task_exit(void);
+bool task_wake(uint32_t id);  /* end a kernel_sleep early, from any task */
 uint32_t task_get_id(void);
 
 /* Time functions */
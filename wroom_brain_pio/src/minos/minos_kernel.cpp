@@ -1,42 +1,176 @@
 #include "minos.h"
 
+#include <esp_timer.h>
+#include <freertos/task.h>
+
 task_t tasks[MAX_TASKS];
 uint32_t task_count = 0;
 bool kernel_running = false;
-static uint32_t current_task = 0;
+static uint32_t current_task = TASK_NONE;
 static uint32_t system_ticks = 0;
+static int64_t tick_epoch_us = 0;
+static uint32_t wakeups = 0;
+static TaskHandle_t kernel_handle = nullptr;
+
+/*
+ * Tasks are cooperative: each call to entry() is one time slice and must
+ * return. Ready tasks wait in one FIFO per priority level, sleeping tasks in
+ * a single list ordered by wake tick, both linked through task_t::next.
+ * Queues are touched from other FreeRTOS tasks (task_create), so every
+ * queue operation happens under s_mux.
+ *
+ * Ticks are derived from esp_timer rather than counted, so the loop can
+ * block until the earliest wake tick (or a notification from task_create /
+ * task_wake) instead of waking every MINOS_TICK_MS.
+ */
+static uint8_t ready_head[MINOS_PRIORITIES];
+static uint8_t ready_tail[MINOS_PRIORITIES];
+static uint8_t sleep_head = TASK_NONE;
+static bool yield_requested = false;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* Wrap-safe "a is at or after b" for tick counts */
+static bool tick_reached(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) >= 0;
+}
+
+/* Caller holds s_mux. */
+static void ready_push(uint8_t id) {
+    task_t *t = &tasks[id];
+    const uint8_t pri = t->priority;
+    t->state = TASK_READY;
+    t->next = TASK_NONE;
+    if (ready_head[pri] == TASK_NONE) {
+        ready_head[pri] = id;
+    } else {
+        tasks[ready_tail[pri]].next = id;
+    }
+    ready_tail[pri] = id;
+}
+
+/* Highest priority first; caller holds s_mux. */
+static uint8_t ready_pop(void) {
+    for (int pri = MINOS_PRIORITIES - 1; pri >= 0; pri--) {
+        const uint8_t id = ready_head[pri];
+        if (id != TASK_NONE) {
+            ready_head[pri] = tasks[id].next;
+            tasks[id].next = TASK_NONE;
+            return id;
+        }
+    }
+    return TASK_NONE;
+}
+
+/* Caller holds s_mux. */
+static void sleep_insert(uint8_t id) {
+    task_t *t = &tasks[id];
+    t->state = TASK_SLEEPING;
+    uint8_t *link = &sleep_head;
+    while (*link != TASK_NONE && tick_reached(t->wake_tick, tasks[*link].wake_tick)) {
+        link = &tasks[*link].next;
+    }
+    t->next = *link;
+    *link = id;
+}
+
+/* Caller holds s_mux. */
+static bool sleep_remove(uint8_t id) {
+    for (uint8_t *link = &sleep_head; *link != TASK_NONE; link = &tasks[*link].next) {
+        if (*link == id) {
+            *link = tasks[id].next;
+            tasks[id].next = TASK_NONE;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Let the kernel loop re-plan its wait; call outside s_mux. */
+static void notify_kernel(void) {
+    if (kernel_handle != nullptr && kernel_handle != xTaskGetCurrentTaskHandle()) {
+        xTaskNotifyGive(kernel_handle);
+    }
+}
 
 void kernel_init(void) {
     memset(tasks, 0, sizeof(tasks));
+    for (uint32_t i = 0; i < MAX_TASKS; i++) {
+        tasks[i].next = TASK_NONE;
+    }
+    for (uint32_t p = 0; p < MINOS_PRIORITIES; p++) {
+        ready_head[p] = TASK_NONE;
+        ready_tail[p] = TASK_NONE;
+    }
+    sleep_head = TASK_NONE;
     task_count = 0;
-    current_task = 0;
+    current_task = TASK_NONE;
     system_ticks = 0;
+    tick_epoch_us = esp_timer_get_time();
+    wakeups = 0;
     kernel_running = false;
     hw_init();
     Serial.println("[MinOS] Kernel initialized.");
 }
 
 int task_create(const char *name, void (*entry)(void), uint8_t priority) {
-    if (task_count >= MAX_TASKS) return -1;
-    task_t *task = &tasks[task_count];
-    task->id = task_count;
-    strncpy(task->name, name, sizeof(task->name) - 1);
-    task->entry = entry;
-    task->priority = priority;
-    task->state = TASK_READY;
-    task->sleep_ticks = 0;
-    return task_count++;
+    if (entry == nullptr) return -1;
+    if (priority >= MINOS_PRIORITIES) priority = MINOS_PRIORITIES - 1;
+
+    int id = -1;
+    portENTER_CRITICAL(&s_mux);
+    /* Reuse the slot of a task that has exited */
+    for (uint32_t i = 0; i < MAX_TASKS; i++) {
+        if (tasks[i].entry == nullptr) {
+            id = (int)i;
+            break;
+        }
+    }
+    if (id >= 0) {
+        task_t *task = &tasks[id];
+        memset(task, 0, sizeof(*task));
+        task->id = id;
+        strncpy(task->name, name, sizeof(task->name) - 1);
+        task->entry = entry;
+        task->priority = priority;
+        ready_push(id);
+        if ((uint32_t)id >= task_count) task_count = id + 1;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    if (id >= 0) notify_kernel();
+    return id;
+}
+
+bool task_wake(uint32_t id) {
+    if (id >= MAX_TASKS) return false;
+    portENTER_CRITICAL(&s_mux);
+    const bool woke = tasks[id].entry != nullptr && tasks[id].state == TASK_SLEEPING &&
+                      sleep_remove(id);
+    if (woke) ready_push(id);
+    portEXIT_CRITICAL(&s_mux);
+    if (woke) notify_kernel();
+    return woke;
+}
+
+void task_exit(void) {
+    if (current_task < MAX_TASKS) {
+        tasks[current_task].state = TASK_EXITED;
+    }
+}
+
+uint32_t task_get_id(void) {
+    return current_task;
 }
 
 void kernel_sleep(uint32_t ticks) {
-    if (current_task < task_count) {
+    if (current_task < MAX_TASKS) {
         tasks[current_task].state = TASK_SLEEPING;
-        tasks[current_task].sleep_ticks = ticks;
+        tasks[current_task].wake_tick = system_ticks + ticks;
     }
 }
 
 void kernel_yield(void) {
-    // In this simple cooperative loop, yielding is just returning from entry()
+    /* Still has work: run again this tick once its peers have had a turn */
+    yield_requested = true;
 }
 
 uint32_t ticks_get(void) {
@@ -47,40 +181,119 @@ void delay_ms(uint32_t ms) {
     vTaskDelay(pdMS_TO_TICKS(ms));
 }
 
+uint32_t kernel_wakeup_count(void) {
+    return wakeups;
+}
+
 void kernel_stop(void) {
     kernel_running = false;
+    notify_kernel();
 }
 
+/* Catch the tick count up with the clock and wake everything whose tick has
+ * come; only the head of the sleep list is examined. */
 static void tick_handler(void) {
-    system_ticks++;
-    for (uint32_t i = 0; i < task_count; i++) {
-        if (tasks[i].state == TASK_SLEEPING) {
-            if (tasks[i].sleep_ticks > 0) {
-                tasks[i].sleep_ticks--;
-                if (tasks[i].sleep_ticks == 0) {
-                    tasks[i].state = TASK_READY;
-                }
-            }
+    const uint32_t now_ticks =
+        (uint32_t)((esp_timer_get_time() - tick_epoch_us) / (MINOS_TICK_MS * 1000));
+    portENTER_CRITICAL(&s_mux);
+    system_ticks = now_ticks;
+    while (sleep_head != TASK_NONE && tick_reached(system_ticks, tasks[sleep_head].wake_tick)) {
+        const uint8_t id = sleep_head;
+        sleep_head = tasks[id].next;
+        ready_push(id);
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+/*
+ * One tick: run ready tasks highest priority first, each once unless it called
+ * kernel_yield, until the queues are drained or the slice budget is spent. Whatever is left keeps
+ * its place for the next tick, so a busy high-priority task delays lower ones
+ * rather than the other way round.
+ */
+static void dispatch_tick(void) {
+    const int64_t tick_start = esp_timer_get_time();
+    uint8_t ran[MAX_TASKS];
+    uint32_t ran_count = 0;
+
+    while (esp_timer_get_time() - tick_start < MINOS_SLICE_US) {
+        portENTER_CRITICAL(&s_mux);
+        const uint8_t id = ready_pop();
+        if (id != TASK_NONE) {
+            tasks[id].state = TASK_RUNNING;
+            current_task = id;
+            yield_requested = false;
+        }
+        portEXIT_CRITICAL(&s_mux);
+        if (id == TASK_NONE) break;
+
+        task_t *t = &tasks[id];
+        const int64_t start = esp_timer_get_time();
+        t->entry();
+        const int64_t end = esp_timer_get_time();
+        t->cpu_us += (uint64_t)(end - start);
+        t->run_count++;
+
+        portENTER_CRITICAL(&s_mux);
+        current_task = TASK_NONE;
+        if (t->state == TASK_EXITED) {
+            t->entry = nullptr;
+            while (task_count > 0 && tasks[task_count - 1].entry == nullptr) task_count--;
+        } else if (t->state == TASK_SLEEPING && !tick_reached(system_ticks, t->wake_tick)) {
+            sleep_insert(id);
+        } else if (yield_requested) {
+            ready_push(id);
+        } else {
+            /* Ran its slice; back of the line next tick */
+            t->state = TASK_READY;
+            ran[ran_count++] = id;
         }
+        portEXIT_CRITICAL(&s_mux);
     }
+
+    /* Requeue in run order behind anything that never got a turn this tick */
+    portENTER_CRITICAL(&s_mux);
+    for (uint32_t i = 0; i < ran_count; i++) {
+        ready_push(ran[i]);
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+/* How long the loop may block: one tick while work is queued, until the
+ * earliest wake tick while everything sleeps, forever when nothing exists. */
+static TickType_t idle_wait_ticks(void) {
+    TickType_t wait = portMAX_DELAY;
+    portENTER_CRITICAL(&s_mux);
+    bool ready = false;
+    for (uint32_t p = 0; p < MINOS_PRIORITIES; p++) {
+        if (ready_head[p] != TASK_NONE) ready = true;
+    }
+    if (ready) {
+        wait = pdMS_TO_TICKS(MINOS_TICK_MS);
+    } else if (sleep_head != TASK_NONE) {
+        const int32_t ahead = (int32_t)(tasks[sleep_head].wake_tick - system_ticks);
+        const int64_t due_us = tick_epoch_us + ((int64_t)system_ticks + ahead) * MINOS_TICK_MS * 1000;
+        const int64_t left_us = ahead > 0 ? due_us - esp_timer_get_time() : 0;
+        wait = left_us > 0 ? pdMS_TO_TICKS((uint32_t)((left_us + 999) / 1000)) : 0;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return wait;
 }
 
 void kernel_start(void) {
+    kernel_handle = xTaskGetCurrentTaskHandle();
     kernel_running = true;
     Serial.println("[MinOS] Kernel started.");
 
     while (kernel_running) {
-        for (uint32_t i = 0; i < task_count; i++) {
-            if (tasks[i].state == TASK_READY) {
-                current_task = i;
-                tasks[i].state = TASK_RUNNING;
-                if (tasks[i].entry) {
-                    tasks[i].entry();
-                }
-                tasks[i].state = TASK_READY;
-            }
-        }
         tick_handler();
-        vTaskDelay(pdMS_TO_TICKS(10)); // 10ms tick
+        dispatch_tick();
+        tick_handler();
+        const TickType_t wait = idle_wait_ticks();
+        if (wait > 0) {
+            ulTaskNotifyTake(pdTRUE, wait);
+            wakeups++;
+        }
     }
+    kernel_handle = nullptr;
 }
@@ -1,6 +1,11 @@
 #include "minos.h"
 #include <vector>
 
+#include "../bench.h"
+#include "../context_cache.h"
+#include "../metrics.h"
+#include "../web_server.h"
+
 static String shell_output;
 static String s_cwd = "/";
 
@@ -24,59 +29,70 @@ static void cmd_help() {
     shell_println("  pwd        - Print working directory");
     shell_println("  cd <dir>   - Change directory");
     shell_println("  ls         - List files");
-    shell_println("  ps         - List tasks (alias: top)");
+    shell_println("  ps         - List tasks");
+    shell_println("  top        - Tasks plus FreeRTOS stack headroom");
     shell_println("  cat <file> - Print file content");
     shell_println("  nano <f> <c>- Write content to file");
     shell_println("  touch <f>  - Create empty file");
-    shell_println("  mkdir <d>  - Create directory (simulated)");
+    shell_println("  mkdir <d>  - Create directory (simulated on SPIFFS)");
     shell_println("  rm <file>  - Delete a file");
     shell_println("  df         - Show disk usage");
-    shell_println("  free       - Show free RAM");
+    shell_println("  free       - Heap, fragmentation and per-stage heap use");
     shell_println("  uptime     - Show system uptime");
     shell_println("  sysinfo    - System info (alias: uname)");
+    shell_println("  bench [s]  - Run timed microbenchmarks (" + String(bench_suite_names()) + ")");
     shell_println("  reboot     - Restart ESP32");
 }
 
 static void cmd_ps() {
-    shell_println("\nPID  STATE      PRI  NAME");
-    shell_println("---  ---------  ---  ----");
+    shell_println("\nPID  STATE      PRI  RUNS      CPU(ms)  NAME");
+    shell_println("---  ---------  ---  --------  -------  ----");
+    uint64_t total_us = 0;
     for (uint32_t i = 0; i < task_count; i++) {
+        if (tasks[i].entry == nullptr) continue;
         const char *state = "UNKNOWN";
         switch (tasks[i].state) {
             case TASK_READY:    state = "READY"; break;
             case TASK_RUNNING:  state = "RUNNING"; break;
             case TASK_SLEEPING: state = "SLEEP"; break;
             case TASK_BLOCKED:  state = "BLOCKED"; break;
+            case TASK_EXITED:   state = "EXITED"; break;
         }
-        char buf[64];
-        snprintf(buf, sizeof(buf), "%-3d  %-9s  %-3d  %s", 
-                tasks[i].id, state, tasks[i].priority, tasks[i].name);
+        char buf[96];
+        snprintf(buf, sizeof(buf), "%-3u  %-9s  %-3u  %-8u  %-7u  %s",
+                (unsigned)tasks[i].id, state, (unsigned)tasks[i].priority,
+                (unsigned)tasks[i].run_count, (unsigned)(tasks[i].cpu_us / 1000), tasks[i].name);
         shell_println(buf);
+        total_us += tasks[i].cpu_us;
+    }
+    const uint32_t up_ms = millis();
+    const uint32_t pct10 = up_ms > 0 ? (uint32_t)(total_us / up_ms) : 0;
+    shell_println("Tick " + String(ticks_get()) + ", " + String(kernel_wakeup_count()) +
+                  " wakeups, task CPU " + String((uint32_t)(total_us / 1000)) + "ms (" +
+                  String(pct10 / 10) + "." + String(pct10 % 10) + "% of uptime)");
+}
+
+static void ls_visit(const String &fname, size_t size, void *ctx) {
+    const String &p = *(const String *)ctx;
+    if (fname.startsWith(p) || p == "/") {
+        shell_print(fname + " \t");
+        shell_println(String(size) + " bytes");
     }
 }
 
 static void cmd_ls(const String &path) {
     String p = resolve_path(path);
     shell_println("\nListing " + p + ":");
-    File root = SPIFFS.open("/");
-    File file = root.openNextFile();
-    while(file){
-        String fname = String(file.name());
-        if (fname.startsWith(p) || p == "/") {
-            shell_print(fname + " \t");
-            shell_println(String(file.size()) + " bytes");
-        }
-        file = root.openNextFile();
-    }
+    flash_fs_walk("/", ls_visit, &p);
 }
 
 static void cmd_cat(const String &path) {
     String p = resolve_path(path);
-    if (!SPIFFS.exists(p)) {
+    if (!FLASH_FS.exists(p)) {
         shell_println("Error: File " + p + " not found");
         return;
     }
-    File f = SPIFFS.open(p, "r");
+    File f = FLASH_FS.open(p, "r");
     while(f.available()) {
         shell_print(String((char)f.read()));
     }
@@ -86,10 +102,12 @@ static void cmd_cat(const String &path) {
 
 static void cmd_touch(const String &path) {
     String p = resolve_path(path);
-    File f = SPIFFS.open(p, "w");
+    File f = FLASH_FS.open(p, "w");
     if (f) {
         shell_println("Created " + p);
         f.close();
+        context_cache_invalidate_all();
+        web_server_invalidate_etags();
     } else {
         shell_println("Error: Could not create " + p);
     }
@@ -97,12 +115,20 @@ static void cmd_touch(const String &path) {
 
 static void cmd_mkdir(const String &path) {
     String p = resolve_path(path);
+#if FS_USE_LITTLEFS
+    while (p.length() > 1 && p.endsWith("/")) p.remove(p.length() - 1);
+    flash_fs_mkdirs(p + "/");
+    const bool ok = FLASH_FS.exists(p);
+#else
+    // SPIFFS is flat; a placeholder file makes the prefix show up in ls
     if (!p.endsWith("/")) p += "/";
     p += ".keep";
-    File f = SPIFFS.open(p, "w");
-    if (f) {
+    File f = FLASH_FS.open(p, "w");
+    const bool ok = (bool)f;
+    if (f) f.close();
+#endif
+    if (ok) {
         shell_println("Created directory " + path);
-        f.close();
     } else {
         shell_println("Error: Could not create directory " + path);
     }
@@ -118,10 +144,12 @@ static void cmd_nano(const String &args) {
     String content = args.substring(firstSpace + 1);
     String p = resolve_path(path);
     
-    File f = SPIFFS.open(p, "w");
+    File f = FLASH_FS.open(p, "w");
     if (f) {
         f.print(content);
         f.close();
+        context_cache_invalidate_all();  // may have edited SOUL.md/USER.md/MEMORY.md
+        web_server_invalidate_etags();
         shell_println("Nano: Wrote " + String(content.length()) + " bytes to " + p);
     } else {
         shell_println("Nano: Error writing " + p);
@@ -138,10 +166,12 @@ static void cmd_append(const String &args) {
     String content = args.substring(firstSpace + 1);
     String p = resolve_path(path);
     
-    File f = SPIFFS.open(p, "a");
+    File f = FLASH_FS.open(p, "a");
     if (f) {
         f.print(content);
         f.close();
+        context_cache_invalidate_all();
+        web_server_invalidate_etags();
         shell_println("Append: Added " + String(content.length()) + " bytes to " + p);
     } else {
         shell_println("Append: Error writing " + p);
@@ -150,7 +180,9 @@ static void cmd_append(const String &args) {
 
 static void cmd_rm(const String &path) {
     String p = resolve_path(path);
-    if (SPIFFS.remove(p)) {
+    if (FLASH_FS.remove(p)) {
+        context_cache_invalidate_all();
+        web_server_invalidate_etags();
         shell_println("Removed " + p);
     } else {
         shell_println("Error: Could not remove " + p);
@@ -158,16 +190,27 @@ static void cmd_rm(const String &path) {
 }
 
 static void cmd_df() {
-    size_t total = SPIFFS.totalBytes();
-    size_t used = SPIFFS.usedBytes();
-    shell_println("SPIFFS Usage:");
+    size_t total = FLASH_FS.totalBytes();
+    size_t used = FLASH_FS.usedBytes();
+    shell_println(FLASH_FS_NAME " Usage:");
     shell_println("Total: " + String(total) + " bytes");
     shell_println("Used:  " + String(used) + " bytes");
     shell_println("Free:  " + String(total - used) + " bytes");
 }
 
 static void cmd_free() {
-    shell_println("Free Heap: " + String(ESP.getFreeHeap()) + " bytes");
+    String heap;
+    metrics_describe_heap(heap);
+    shell_print(heap);
+}
+
+/* ps plus the stack high-water mark of every long-lived FreeRTOS task */
+static void cmd_top() {
+    cmd_ps();
+    String stacks;
+    metrics_describe_tasks(stacks);
+    shell_println("");
+    shell_print(stacks);
 }
 
 void shell_init(void) {
@@ -183,11 +226,20 @@ void shell_run_once(const String &input, String &output) {
 
     if (cmd_line == "help") cmd_help();
     else if (cmd_line == "pwd") shell_println(s_cwd);
-    else if (cmd_line == "ps" || cmd_line == "top") cmd_ps();
+    else if (cmd_line == "ps") cmd_ps();
+    else if (cmd_line == "top") cmd_top();
     else if (cmd_line == "ls") cmd_ls("");
     else if (cmd_line.startsWith("ls ")) cmd_ls(cmd_line.substring(3));
     else if (cmd_line == "df") cmd_df();
     else if (cmd_line == "free") cmd_free();
+    else if (cmd_line == "bench" || cmd_line.startsWith("bench ")) {
+        String suite = cmd_line.substring(5);
+        suite.trim();
+        if (!bench_run_suite(suite, shell_output)) {
+            shell_println("Usage: bench [" + String(bench_suite_names()) + "]");
+        }
+        shell_println("");
+    }
     else if (cmd_line == "uptime") {
         uint32_t sec = millis() / 1000;
         uint32_t min = sec / 60;
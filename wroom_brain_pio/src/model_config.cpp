@@ -2,6 +2,8 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include "brain_config.h"
 
@@ -33,6 +35,32 @@ const char *kFailedStatusSuffix = "_status";
 const char *kProviderPriority[] = {"gemini", "openai", "anthropic", "glm", "openrouter", "ollama"};
 const size_t kProviderPriorityCount = 6;
 
+// RAM mirror of the namespace, loaded once and written through on every set,
+// so the per-call lookups never touch NVS. Indexed like kProviderPriority.
+struct ProviderConfig {
+  String api_key;
+  String model;
+  uint32_t failed_time;  // seconds since boot when marked failed, 0 if not
+};
+
+ProviderConfig g_cfg[kProviderPriorityCount];
+String g_active_provider;
+SemaphoreHandle_t g_cfg_lock = nullptr;
+
+// Per-provider call health, RAM only. Both figures are EWMAs with 1/8 weight
+// so one slow call nudges the estimate instead of replacing it.
+struct ProviderHealth {
+  uint32_t latency_ms;      // 0 until the first measured call
+  uint16_t error_permille;  // share of recent calls that failed, 0..1000
+  uint16_t samples;
+};
+
+ProviderHealth g_health[kProviderPriorityCount];
+portMUX_TYPE g_health_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// A provider must be this much faster before it displaces the preferred one.
+const uint32_t kFastSwitchMarginPct = 25;
+
 String to_lower(String value) {
   value.toLowerCase();
   return value;
@@ -42,6 +70,24 @@ String make_key(const String &provider_prefix, const char *suffix) {
   return provider_prefix + suffix;
 }
 
+int provider_index(const String &provider) {
+  String lc = to_lower(provider);
+  if (lc == "openrouter.ai") {
+    lc = "openrouter";
+  }
+  for (size_t i = 0; i < kProviderPriorityCount; i++) {
+    if (lc == kProviderPriority[i]) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+// Latency weighted by error rate; lower is better. Caller holds g_health_mux.
+uint32_t health_score(const ProviderHealth &h) {
+  return (uint32_t)((uint64_t)h.latency_ms * (1000 + 3 * (uint32_t)h.error_permille) / 1000);
+}
+
 String get_provider_prefix(const String &provider) {
   String lc = to_lower(provider);
   if (lc == "openai") {
@@ -112,6 +158,14 @@ String get_default_model(const String &provider) {
   return "";
 }
 
+void lock_cfg() {
+  xSemaphoreTake(g_cfg_lock, portMAX_DELAY);
+}
+
+void unlock_cfg() {
+  xSemaphoreGive(g_cfg_lock);
+}
+
 bool ensure_ready(String &error_out) {
   if (g_ready) {
     return true;
@@ -120,22 +174,56 @@ bool ensure_ready(String &error_out) {
     error_out = "NVS begin failed";
     return false;
   }
+  g_cfg_lock = xSemaphoreCreateMutex();
+  if (g_cfg_lock == nullptr) {
+    error_out = "config lock alloc failed";
+    return false;
+  }
+
+  g_active_provider = g_prefs.getString(kActiveProviderKey, "");
+  for (size_t i = 0; i < kProviderPriorityCount; i++) {
+    const String prefix = get_provider_prefix(kProviderPriority[i]);
+    ProviderConfig &cfg = g_cfg[i];
+    cfg.api_key = g_prefs.isKey(make_key(prefix, kApiKeySuffix).c_str())
+                      ? g_prefs.getString(make_key(prefix, kApiKeySuffix).c_str(), "")
+                      : String();
+    cfg.model = g_prefs.isKey(make_key(prefix, kModelSuffix).c_str())
+                    ? g_prefs.getString(make_key(prefix, kModelSuffix).c_str(), "")
+                    : String();
+    cfg.failed_time = g_prefs.getUInt(make_key(prefix, kFailedTimeSuffix).c_str(), 0);
+  }
   g_ready = true;
   return true;
 }
 
+// Drop a provider's failed mark in RAM and NVS. Caller holds g_cfg_lock.
+void clear_failed_locked(size_t index) {
+  if (g_cfg[index].failed_time == 0) {
+    return;
+  }
+  g_cfg[index].failed_time = 0;
+  const String prefix = get_provider_prefix(kProviderPriority[index]);
+  g_prefs.remove(make_key(prefix, kFailedTimeSuffix).c_str());
+  g_prefs.remove(make_key(prefix, kFailedStatusSuffix).c_str());
+}
+
 }  // namespace
 
 void model_config_init() {
   String err;
   if (ensure_ready(err)) {
     // Initialize active provider from .env if not set
-    String active = g_prefs.getString(kActiveProviderKey, "");
+    lock_cfg();
+    const String active = g_active_provider;
+    unlock_cfg();
     if (active.length() == 0) {
       String env_provider = String(LLM_PROVIDER);
       env_provider.trim();
       if (env_provider.length() > 0 && env_provider != "none") {
+        lock_cfg();
         g_prefs.putString(kActiveProviderKey, env_provider);
+        g_active_provider = env_provider;
+        unlock_cfg();
         Serial.printf("[model_config] Initialized active provider from .env: %s\n",
                       env_provider.c_str());
       }
@@ -152,7 +240,9 @@ String model_config_get_active_provider() {
   if (!ensure_ready(err)) {
     return "";
   }
-  String provider = g_prefs.getString(kActiveProviderKey, "");
+  lock_cfg();
+  String provider = g_active_provider;
+  unlock_cfg();
   if (provider.length() == 0) {
     // Fallback to .env
     provider = String(LLM_PROVIDER);
@@ -172,7 +262,12 @@ bool model_config_set_active_provider(const String &provider, String &error_out)
     return false;
   }
 
+  lock_cfg();
   size_t written = g_prefs.putString(kActiveProviderKey, lc);
+  if (written > 0) {
+    g_active_provider = lc;
+  }
+  unlock_cfg();
   if (written == 0 && lc.length() > 0) {
     error_out = "Failed to write active provider";
     return false;
@@ -188,12 +283,14 @@ String model_config_get_api_key(const String &provider) {
     return "";
   }
 
-  String prefix = get_provider_prefix(provider);
-  if (prefix.length() == 0) {
+  const int index = provider_index(provider);
+  if (index < 0) {
     return "";
   }
 
-  String key = g_prefs.getString(make_key(prefix, kApiKeySuffix).c_str(), "");
+  lock_cfg();
+  String key = g_cfg[index].api_key;
+  unlock_cfg();
   if (key.length() == 0) {
     // Fallback to .env (only for the matching provider)
     String lc = to_lower(provider);
@@ -223,7 +320,12 @@ bool model_config_set_api_key(const String &provider, const String &key, String
     return false;
   }
 
+  lock_cfg();
   size_t written = g_prefs.putString(make_key(prefix, kApiKeySuffix).c_str(), clean_key);
+  if (written > 0) {
+    g_cfg[provider_index(provider)].api_key = clean_key;
+  }
+  unlock_cfg();
   if (written == 0) {
     error_out = "Failed to write API key";
     return false;
@@ -239,12 +341,14 @@ String model_config_get_model(const String &provider) {
     return "";
   }
 
-  String prefix = get_provider_prefix(provider);
-  if (prefix.length() == 0) {
+  const int index = provider_index(provider);
+  if (index < 0) {
     return "";
   }
 
-  String model = g_prefs.getString(make_key(prefix, kModelSuffix).c_str(), "");
+  lock_cfg();
+  String model = g_cfg[index].model;
+  unlock_cfg();
   if (model.length() == 0) {
     // Check if .env has a model for this provider
     String lc = to_lower(provider);
@@ -277,7 +381,12 @@ bool model_config_set_model(const String &provider, const String &model, String
     return false;
   }
 
+  lock_cfg();
   size_t written = g_prefs.putString(make_key(prefix, kModelSuffix).c_str(), clean_model);
+  if (written > 0) {
+    g_cfg[provider_index(provider)].model = clean_model;
+  }
+  unlock_cfg();
   if (written == 0) {
     error_out = "Failed to write model";
     return false;
@@ -287,6 +396,10 @@ bool model_config_set_model(const String &provider, const String &model, String
   return true;
 }
 
+String model_config_get_base_url(const String &provider) {
+  return get_provider_base_url(provider);
+}
+
 bool model_config_is_provider_configured(const String &provider) {
   String key = model_config_get_api_key(provider);
   return key.length() > 0;
@@ -338,6 +451,11 @@ String model_config_get_status_summary() {
 
     if (configured) {
       result += " ✅ (" + model + ")";
+      uint32_t latency_ms = 0;
+      uint32_t error_pct = 0;
+      if (model_config_get_provider_health(provider, latency_ms, error_pct)) {
+        result += " ~" + String(latency_ms) + "ms, " + String(error_pct) + "% err";
+      }
     } else {
       result += " ❌ (no key)";
     }
@@ -360,8 +478,13 @@ bool model_config_clear_provider(const String &provider, String &error_out) {
     return false;
   }
 
+  lock_cfg();
   g_prefs.remove(make_key(prefix, kApiKeySuffix).c_str());
   g_prefs.remove(make_key(prefix, kModelSuffix).c_str());
+  ProviderConfig &cfg = g_cfg[provider_index(provider)];
+  cfg.api_key = "";
+  cfg.model = "";
+  unlock_cfg();
 
   Serial.printf("[model_config] Cleared configuration for: %s\n", provider.c_str());
   return true;
@@ -412,34 +535,27 @@ bool model_config_is_provider_failed(const String &provider) {
     return false;
   }
 
-  String prefix = get_provider_prefix(provider);
-  if (prefix.length() == 0) {
+  const int index = provider_index(provider);
+  if (index < 0) {
     return false;
   }
 
-  unsigned long failed_time = g_prefs.getUInt(
-      make_key(prefix, kFailedTimeSuffix).c_str(), 0);
+  lock_cfg();
+  const unsigned long failed_time = g_cfg[index].failed_time;
   if (failed_time == 0) {
+    unlock_cfg();
     return false;  // Never failed
   }
 
-  // Check if timeout has expired
   unsigned long now = millis() / 1000;  // Convert to seconds (approximate)
-  if (now < failed_time) {
-    // millis() wrapped around, reset
-    g_prefs.remove(make_key(prefix, kFailedTimeSuffix).c_str());
-    return false;
-  }
-
-  unsigned long elapsed_sec = now - failed_time;
-  unsigned long timeout_sec = MODEL_FAIL_RETRY_MS / 1000;
-
-  if (elapsed_sec >= timeout_sec) {
-    // Timeout expired, clear the failed status
-    g_prefs.remove(make_key(prefix, kFailedTimeSuffix).c_str());
-    g_prefs.remove(make_key(prefix, kFailedStatusSuffix).c_str());
+  // A timestamp ahead of now predates a reboot or millis() wrap; an old one
+  // has served its timeout. Either way the provider gets another chance.
+  if (now < failed_time || now - failed_time >= MODEL_FAIL_RETRY_MS / 1000) {
+    clear_failed_locked(index);
+    unlock_cfg();
     return false;
   }
+  unlock_cfg();
 
   return true;  // Still within timeout period
 }
@@ -456,10 +572,13 @@ void model_config_mark_provider_failed(const String &provider, int http_status)
     return;
   }
 
-  // Store timestamp (seconds since boot, approximate)
-  unsigned long now = millis() / 1000;
+  // Store timestamp (seconds since boot, approximate); 0 means "not failed"
+  unsigned long now = max(millis() / 1000, 1UL);
+  lock_cfg();
+  g_cfg[provider_index(provider)].failed_time = now;
   g_prefs.putUInt(make_key(prefix, kFailedTimeSuffix).c_str(), now);
   g_prefs.putInt(make_key(prefix, kFailedStatusSuffix).c_str(), http_status);
+  unlock_cfg();
 
   Serial.printf("[model_config] Marked %s as failed (HTTP %d), will retry in %ld min\n",
                 provider.c_str(), http_status, MODEL_FAIL_RETRY_MS / 60000);
@@ -472,13 +591,14 @@ void model_config_reset_failed_provider(const String &provider) {
     return;
   }
 
-  String prefix = get_provider_prefix(provider);
-  if (prefix.length() == 0) {
+  const int index = provider_index(provider);
+  if (index < 0) {
     return;
   }
 
-  g_prefs.remove(make_key(prefix, kFailedTimeSuffix).c_str());
-  g_prefs.remove(make_key(prefix, kFailedStatusSuffix).c_str());
+  lock_cfg();
+  clear_failed_locked(index);
+  unlock_cfg();
 
   Serial.printf("[model_config] Reset failed status for: %s\n", provider.c_str());
 }
@@ -490,12 +610,11 @@ void model_config_reset_all_failed_providers() {
     return;
   }
 
+  lock_cfg();
   for (size_t i = 0; i < kProviderPriorityCount; i++) {
-    String provider = kProviderPriority[i];
-    String prefix = get_provider_prefix(provider);
-    g_prefs.remove(make_key(prefix, kFailedTimeSuffix).c_str());
-    g_prefs.remove(make_key(prefix, kFailedStatusSuffix).c_str());
+    clear_failed_locked(i);
   }
+  unlock_cfg();
 
   Serial.println("[model_config] Reset all failed providers");
 }
@@ -522,3 +641,91 @@ String model_config_get_failed_status() {
 
   return "Failed providers: " + result;
 }
+
+void model_config_record_call(const String &provider, uint32_t latency_ms, bool ok) {
+  const int idx = provider_index(provider);
+  if (idx < 0) {
+    return;
+  }
+  portENTER_CRITICAL(&g_health_mux);
+  ProviderHealth &h = g_health[idx];
+  // Slow failures (timeouts) count against latency; quick rejections do not
+  // make a provider look fast.
+  if (ok || latency_ms > h.latency_ms) {
+    h.latency_ms = h.samples == 0 ? latency_ms : (h.latency_ms * 7 + latency_ms) / 8;
+  }
+  h.error_permille = (uint16_t)((h.error_permille * 7 + (ok ? 0 : 1000)) / 8);
+  if (h.samples < 0xFFFF) {
+    h.samples++;
+  }
+  portEXIT_CRITICAL(&g_health_mux);
+}
+
+bool model_config_get_provider_health(const String &provider, uint32_t &latency_ms,
+                                      uint32_t &error_pct) {
+  const int idx = provider_index(provider);
+  if (idx < 0) {
+    return false;
+  }
+  portENTER_CRITICAL(&g_health_mux);
+  const ProviderHealth h = g_health[idx];
+  portEXIT_CRITICAL(&g_health_mux);
+  if (h.samples == 0) {
+    return false;
+  }
+  latency_ms = h.latency_ms;
+  error_pct = (h.error_permille + 5) / 10;
+  return true;
+}
+
+// Keeps the preferred provider until another configured, non-failed one has
+// enough samples and scores clearly better; an unhealthy preferred provider
+// yields to any measured healthy one.
+String model_config_get_fastest_provider(const String &preferred) {
+  ProviderHealth snapshot[kProviderPriorityCount];
+  portENTER_CRITICAL(&g_health_mux);
+  memcpy(snapshot, g_health, sizeof(snapshot));
+  portEXIT_CRITICAL(&g_health_mux);
+
+  auto healthy = [&](size_t i) {
+    return snapshot[i].samples >= LLM_HEALTH_MIN_SAMPLES &&
+           snapshot[i].error_permille <= LLM_HEALTH_MAX_ERROR_PERMILLE;
+  };
+
+  const int pref = provider_index(preferred);
+  bool pref_usable = pref >= 0 && !model_config_is_provider_failed(preferred);
+  if (pref_usable && snapshot[pref].samples < LLM_HEALTH_MIN_SAMPLES) {
+    return preferred;  // Not measured yet; keep using it so it gets measured.
+  }
+  if (pref_usable && !healthy(pref)) {
+    pref_usable = false;
+  }
+
+  int best = -1;
+  uint32_t best_score = 0;
+  for (size_t i = 0; i < kProviderPriorityCount; i++) {
+    if ((int)i == pref || !healthy(i)) {
+      continue;
+    }
+    const String provider = kProviderPriority[i];
+    if (!model_config_is_provider_configured(provider) ||
+        model_config_is_provider_failed(provider)) {
+      continue;
+    }
+    const uint32_t score = health_score(snapshot[i]);
+    if (best < 0 || score < best_score) {
+      best = (int)i;
+      best_score = score;
+    }
+  }
+
+  if (best < 0) {
+    return preferred;
+  }
+  if (pref_usable &&
+      (uint64_t)best_score * 100 >=
+          (uint64_t)health_score(snapshot[pref]) * (100 - kFastSwitchMarginPct)) {
+    return preferred;
+  }
+  return kProviderPriority[best];
+}
@@ -11,6 +11,8 @@ bool model_config_set_api_key(const String &provider, const String &key, String
 String model_config_get_model(const String &provider);
 bool model_config_set_model(const String &provider, const String &model, String &error_out);
 bool model_config_is_provider_configured(const String &provider);
+// Default API base URL of a provider ("" if unknown)
+String model_config_get_base_url(const String &provider);
 String model_config_get_configured_list();
 String model_config_get_status_summary();
 bool model_config_clear_provider(const String &provider, String &error_out);
@@ -33,6 +35,12 @@ void model_config_reset_failed_provider(const String &provider);
 void model_config_reset_all_failed_providers();
 String model_config_get_failed_status();
 
+// Latency/error tracking (RAM only) for picking the quickest provider
+void model_config_record_call(const String &provider, uint32_t latency_ms, bool ok);
+bool model_config_get_provider_health(const String &provider, uint32_t &latency_ms,
+                                      uint32_t &error_pct);
+String model_config_get_fastest_provider(const String &preferred);
+
 // Timeout for retrying failed providers (milliseconds)
 #ifndef MODEL_FAIL_RETRY_MS
 #define MODEL_FAIL_RETRY_MS 900000  // 15 minutes
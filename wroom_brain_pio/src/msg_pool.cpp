@@ -0,0 +1,155 @@
+#include "msg_pool.h"
+
+#include <Arduino.h>
+
+#include "brain_config.h"
+#include "psram_alloc.h"
+
+namespace {
+
+// Web UI messages can exceed a Telegram message; those few borrow the heap
+// (PSRAM when the board has it).
+const size_t kOverflowSlots = 2;
+const size_t kSlotCount = AGENT_MSG_SMALL_SLOTS + AGENT_MSG_LARGE_SLOTS + kOverflowSlots;
+
+struct Slot {
+  char *buf;
+  uint16_t cap;   // 0 for overflow slots
+  size_t len;
+  bool used;
+};
+
+Slot g_slots[kSlotCount];
+char *g_arena = nullptr;
+uint32_t g_overflow_uses = 0;
+uint32_t g_exhausted = 0;
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Claim the first free slot in [begin, end); caller holds g_mux.
+int claim(size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    if (!g_slots[i].used) {
+      g_slots[i].used = true;
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+}  // namespace
+
+bool msg_pool_init() {
+  if (g_arena != nullptr) {
+    return true;
+  }
+  const size_t bytes = (size_t)AGENT_MSG_SMALL_SLOTS * AGENT_MSG_SMALL_BYTES +
+                       (size_t)AGENT_MSG_LARGE_SLOTS * AGENT_MSG_LARGE_BYTES;
+  g_arena = (char *)malloc(bytes);
+  if (g_arena == nullptr) {
+    Serial.println("[msg_pool] arena alloc failed");
+    return false;
+  }
+
+  char *p = g_arena;
+  for (size_t i = 0; i < kSlotCount; i++) {
+    Slot &slot = g_slots[i];
+    slot.used = false;
+    slot.len = 0;
+    if (i < AGENT_MSG_SMALL_SLOTS) {
+      slot.buf = p;
+      slot.cap = AGENT_MSG_SMALL_BYTES;
+      p += AGENT_MSG_SMALL_BYTES;
+    } else if (i < AGENT_MSG_SMALL_SLOTS + AGENT_MSG_LARGE_SLOTS) {
+      slot.buf = p;
+      slot.cap = AGENT_MSG_LARGE_BYTES;
+      p += AGENT_MSG_LARGE_BYTES;
+    } else {
+      slot.buf = nullptr;
+      slot.cap = 0;
+    }
+  }
+  Serial.printf("[msg_pool] %u bytes for %u slots\n", (unsigned)bytes, (unsigned)kSlotCount);
+  return true;
+}
+
+msg_handle_t msg_pool_put(const char *text, size_t len) {
+  if (g_arena == nullptr || text == nullptr) {
+    return MSG_HANDLE_NONE;
+  }
+
+  const size_t large_begin = AGENT_MSG_SMALL_SLOTS;
+  const size_t overflow_begin = AGENT_MSG_SMALL_SLOTS + AGENT_MSG_LARGE_SLOTS;
+  int idx = -1;
+  portENTER_CRITICAL(&g_mux);
+  if (len < AGENT_MSG_SMALL_BYTES) {
+    idx = claim(0, large_begin);
+  }
+  if (idx < 0 && len < AGENT_MSG_LARGE_BYTES) {
+    idx = claim(large_begin, overflow_begin);
+  }
+  if (idx < 0 && len >= AGENT_MSG_LARGE_BYTES) {
+    idx = claim(overflow_begin, kSlotCount);
+  }
+  if (idx < 0) {
+    g_exhausted++;
+  }
+  portEXIT_CRITICAL(&g_mux);
+
+  if (idx < 0) {
+    return MSG_HANDLE_NONE;
+  }
+
+  Slot &slot = g_slots[idx];
+  if (slot.cap == 0) {
+    slot.buf = (char *)big_malloc(len + 1);
+    if (slot.buf == nullptr) {
+      msg_pool_release((msg_handle_t)idx);
+      return MSG_HANDLE_NONE;
+    }
+    g_overflow_uses++;
+  }
+  memcpy(slot.buf, text, len);
+  slot.buf[len] = '\0';
+  slot.len = len;
+  return (msg_handle_t)idx;
+}
+
+const char *msg_pool_get(msg_handle_t handle) {
+  if (handle >= kSlotCount || !g_slots[handle].used) {
+    return "";
+  }
+  return g_slots[handle].buf;
+}
+
+size_t msg_pool_length(msg_handle_t handle) {
+  if (handle >= kSlotCount || !g_slots[handle].used) {
+    return 0;
+  }
+  return g_slots[handle].len;
+}
+
+void msg_pool_release(msg_handle_t handle) {
+  if (handle >= kSlotCount) {
+    return;
+  }
+  Slot &slot = g_slots[handle];
+  if (slot.cap == 0 && slot.buf != nullptr) {
+    free(slot.buf);
+    slot.buf = nullptr;
+  }
+  portENTER_CRITICAL(&g_mux);
+  slot.len = 0;
+  slot.used = false;
+  portEXIT_CRITICAL(&g_mux);
+}
+
+void msg_pool_describe(String &out) {
+  size_t used = 0;
+  for (size_t i = 0; i < kSlotCount; i++) {
+    if (g_slots[i].used) {
+      used++;
+    }
+  }
+  out = "Msg pool: " + String(used) + "/" + String(kSlotCount) + " slots in use, " +
+        String(g_overflow_uses) + " overflow, " + String(g_exhausted) + " full";
+}
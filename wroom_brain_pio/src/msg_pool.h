@@ -0,0 +1,27 @@
+#ifndef MSG_POOL_H
+#define MSG_POOL_H
+
+#include <Arduino.h>
+
+// Preallocated slots for messages waiting in the agent queues. One block is
+// carved into small and large slots at boot, so queuing a message never
+// touches the general heap; the queue carries a one-byte handle and the
+// worker that dequeues it owns the slot until msg_pool_release().
+typedef uint8_t msg_handle_t;
+const msg_handle_t MSG_HANDLE_NONE = 0xFF;
+
+bool msg_pool_init();
+
+// Copy text into the smallest free slot that fits. Text longer than the large
+// slots goes to one of a few heap-backed overflow slots. Returns
+// MSG_HANDLE_NONE when nothing is free.
+msg_handle_t msg_pool_put(const char *text, size_t len);
+
+const char *msg_pool_get(msg_handle_t handle);
+size_t msg_pool_length(msg_handle_t handle);
+void msg_pool_release(msg_handle_t handle);
+
+// "Msg pool: used/total slots ..." line for diagnostics
+void msg_pool_describe(String &out);
+
+#endif
@@ -0,0 +1,305 @@
+#include "msg_spool.h"
+
+#include <Arduino.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "brain_config.h"
+#include "event_log.h"
+#include "flash_fs.h"
+
+namespace {
+
+// 0x5A records had no chat id; a file of them reads as empty and is replaced
+const uint8_t kRecordMagic = 0x5B;
+const uint8_t kTypeAccept = 1;
+const uint8_t kTypeDone = 2;
+const uint8_t kFlagTelegram = 0x01;
+const uint32_t kMaxPayload = 32768;  // anything larger is a corrupt header
+
+// Accept records are followed by len payload bytes; done records have none.
+struct RecordHeader {
+  uint8_t magic;
+  uint8_t type;
+  uint8_t source;
+  uint8_t flags;
+  uint8_t attempt;  // boots this message has already been replayed in
+  uint8_t reserved[3];
+  uint32_t id;
+  uint32_t len;
+  uint32_t check;  // over id and payload, catches a torn tail
+  uint32_t reserved2;
+  int64_t tg_update;
+  int64_t tg_chat;  // chat the message came from, 0 when not from Telegram
+};
+
+struct Pending {
+  RecordHeader header;
+  String text;
+};
+
+File g_file;
+bool g_ready = false;
+SemaphoreHandle_t g_lock = nullptr;
+uint32_t g_next_id = 1;
+uint32_t g_outstanding = 0;
+bool g_dirty = false;
+uint32_t g_last_sync_ms = 0;
+uint32_t g_syncs = 0;
+uint32_t g_replayed = 0;
+uint32_t g_dropped = 0;
+
+Pending *g_pending = nullptr;  // loaded at init, handed out by msg_spool_replay
+size_t g_pending_count = 0;
+
+uint32_t record_check(uint32_t id, const char *data, size_t len) {
+  uint32_t h = 2166136261u ^ id;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (uint8_t)data[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+bool write_record(File &f, const RecordHeader &header, const char *text) {
+  if (f.write((const uint8_t *)&header, sizeof(header)) != sizeof(header)) {
+    return false;
+  }
+  return header.len == 0 || f.write((const uint8_t *)text, header.len) == header.len;
+}
+
+RecordHeader make_header(uint8_t type, uint32_t id) {
+  RecordHeader h;
+  memset(&h, 0, sizeof(h));
+  h.magic = kRecordMagic;
+  h.type = type;
+  h.id = id;
+  return h;
+}
+
+// Collect accept records without a done record, oldest first.
+void load_pending(File &f) {
+  RecordHeader h;
+  while (f.read((uint8_t *)&h, sizeof(h)) == sizeof(h)) {
+    if (h.magic != kRecordMagic || h.len > kMaxPayload) {
+      break;
+    }
+    if (h.id >= g_next_id) {
+      g_next_id = h.id + 1;
+    }
+    if (h.type == kTypeDone) {
+      for (size_t i = 0; i < g_pending_count; i++) {
+        if (g_pending[i].header.id == h.id) {
+          for (size_t j = i + 1; j < g_pending_count; j++) {
+            g_pending[j - 1] = g_pending[j];
+          }
+          g_pending_count--;
+          g_pending[g_pending_count].text = String();
+          break;
+        }
+      }
+      continue;
+    }
+
+    String text;
+    if (!text.reserve(h.len + 1)) {
+      break;
+    }
+    char buf[128];
+    size_t left = h.len;
+    while (left > 0) {
+      const size_t chunk = left < sizeof(buf) ? left : sizeof(buf);
+      if (f.read((uint8_t *)buf, chunk) != chunk) {
+        break;
+      }
+      text.concat(buf, chunk);
+      left -= chunk;
+    }
+    if (left > 0 || record_check(h.id, text.c_str(), text.length()) != h.check) {
+      break;  // torn write from the reset
+    }
+    if (g_pending_count == MSG_SPOOL_REPLAY_MAX) {
+      // Keep the newest ones
+      for (size_t j = 1; j < g_pending_count; j++) {
+        g_pending[j - 1] = g_pending[j];
+      }
+      g_pending_count--;
+      g_dropped++;
+    }
+    g_pending[g_pending_count].header = h;
+    g_pending[g_pending_count].text = text;
+    g_pending_count++;
+  }
+}
+
+void on_shutdown() {
+  msg_spool_sync();
+}
+
+}  // namespace
+
+bool msg_spool_init() {
+  if (g_lock != nullptr) {
+    return g_ready;
+  }
+  g_lock = xSemaphoreCreateMutex();
+  g_pending = new Pending[MSG_SPOOL_REPLAY_MAX];
+  if (g_lock == nullptr || g_pending == nullptr || !flash_fs_begin()) {
+    Serial.println("[spool] unavailable, messages are not persisted");
+    return false;
+  }
+
+  if (FLASH_FS.exists(MSG_SPOOL_PATH)) {
+    File f = FLASH_FS.open(MSG_SPOOL_PATH, FILE_READ);
+    if (f) {
+      load_pending(f);
+      f.close();
+    }
+  }
+
+  // Start over with just the unfinished messages, one attempt further on
+  g_file = FLASH_FS.open(MSG_SPOOL_PATH, FILE_WRITE);
+  if (!g_file) {
+    Serial.println("[spool] open failed, messages are not persisted");
+    return false;
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < g_pending_count; i++) {
+    Pending &p = g_pending[i];
+    if (p.header.attempt >= MSG_SPOOL_MAX_ATTEMPTS) {
+      event_log_printf(EVT_SPOOL, "dropped #%u after %u replays", (unsigned)p.header.id,
+                       (unsigned)p.header.attempt);
+      g_dropped++;
+      continue;
+    }
+    p.header.attempt++;
+    write_record(g_file, p.header, p.text.c_str());
+    if (kept != i) {
+      g_pending[kept] = p;
+    }
+    kept++;
+  }
+  for (size_t i = kept; i < g_pending_count; i++) {
+    g_pending[i].text = String();
+  }
+  g_pending_count = kept;
+  g_outstanding = kept;
+  g_file.flush();
+  g_last_sync_ms = millis();
+  g_ready = true;
+  esp_register_shutdown_handler(on_shutdown);
+  Serial.printf("[spool] ready, %u message(s) to replay\n", (unsigned)kept);
+  return true;
+}
+
+uint32_t msg_spool_accept(uint8_t source, bool from_telegram, const char *text, size_t len,
+                          long long tg_update, long long tg_chat) {
+  if (!g_ready || text == nullptr) {
+    return 0;
+  }
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  const uint32_t id = g_next_id++;
+  RecordHeader h = make_header(kTypeAccept, id);
+  h.source = source;
+  h.flags = from_telegram ? kFlagTelegram : 0;
+  h.len = (uint32_t)len;
+  h.check = record_check(id, text, len);
+  h.tg_update = tg_update;
+  h.tg_chat = tg_chat;
+  const bool ok = write_record(g_file, h, text);
+  if (ok) {
+    g_outstanding++;
+    g_dirty = true;
+  }
+  xSemaphoreGive(g_lock);
+  return ok ? id : 0;
+}
+
+void msg_spool_done(uint32_t id) {
+  if (!g_ready || id == 0) {
+    return;
+  }
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  const RecordHeader h = make_header(kTypeDone, id);
+  if (write_record(g_file, h, nullptr) && g_outstanding > 0) {
+    g_outstanding--;
+  }
+  g_dirty = true;
+  xSemaphoreGive(g_lock);
+}
+
+void msg_spool_sync() {
+  if (!g_ready) {
+    return;
+  }
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  if (g_dirty) {
+    g_file.flush();
+    g_dirty = false;
+    g_syncs++;
+  }
+  g_last_sync_ms = millis();
+  xSemaphoreGive(g_lock);
+}
+
+void msg_spool_tick() {
+  if (!g_ready || millis() - g_last_sync_ms < MSG_SPOOL_SYNC_MS) {
+    return;
+  }
+  msg_spool_sync();
+
+  // Nothing in flight: the whole file is history and can go
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  if (g_outstanding == 0 && g_file.size() > MSG_SPOOL_COMPACT_BYTES) {
+    g_file.close();
+    g_file = FLASH_FS.open(MSG_SPOOL_PATH, FILE_WRITE);
+    if (!g_file) {
+      g_ready = false;
+      Serial.println("[spool] reopen failed, messages are not persisted");
+    }
+  }
+  xSemaphoreGive(g_lock);
+}
+
+size_t msg_spool_replay(msg_spool_replay_cb cb, long long &max_update_out) {
+  max_update_out = 0;
+  if (g_pending == nullptr || cb == nullptr) {
+    return 0;
+  }
+  size_t replayed = 0;
+  for (size_t i = 0; i < g_pending_count; i++) {
+    const RecordHeader &h = g_pending[i].header;
+    if (h.tg_update > max_update_out) {
+      max_update_out = h.tg_update;
+    }
+    if (cb(g_pending[i].text, h.source, (h.flags & kFlagTelegram) != 0, h.tg_chat, h.id)) {
+      replayed++;
+    } else {
+      msg_spool_done(h.id);
+    }
+  }
+  if (g_pending_count > 0) {
+    event_log_printf(EVT_SPOOL, "replayed %u of %u unfinished message(s)", (unsigned)replayed,
+                     (unsigned)g_pending_count);
+  }
+  g_replayed += replayed;
+  delete[] g_pending;
+  g_pending = nullptr;
+  g_pending_count = 0;
+  return replayed;
+}
+
+void msg_spool_describe(String &out) {
+  if (!g_ready) {
+    out = "Spool: off";
+    return;
+  }
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  const uint32_t outstanding = g_outstanding;
+  const size_t bytes = g_file.size();
+  xSemaphoreGive(g_lock);
+  out = "Spool: " + String(outstanding) + " outstanding, " + String((unsigned)bytes) +
+        " bytes, " + String(g_syncs) + " syncs, " + String(g_replayed) + " replayed, " +
+        String(g_dropped) + " dropped";
+}
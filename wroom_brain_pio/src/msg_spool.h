@@ -0,0 +1,43 @@
+#ifndef MSG_SPOOL_H
+#define MSG_SPOOL_H
+
+#include <Arduino.h>
+
+// Write-ahead spool for accepted chat messages. Every message is appended to
+// an append-only file on flash before it is queued, and a small done record
+// follows once its reply went out, so a reboot or crash in between does not
+// lose it: the next boot replays whatever has no done record yet. Writes are
+// synced in batches (MSG_SPOOL_SYNC_MS) instead of once per record, and the
+// file is only rewritten at boot and when nothing is outstanding.
+
+// Mount the spool and load the messages left unfinished by the last boot;
+// they stay outstanding under their old ids until msg_spool_replay().
+bool msg_spool_init();
+
+// Append an accept record. tg_update and tg_chat are the Telegram update and
+// chat the message came from (0 otherwise). Returns the id for
+// msg_spool_done(), 0 when the spool is unavailable.
+uint32_t msg_spool_accept(uint8_t source, bool from_telegram, const char *text, size_t len,
+                          long long tg_update, long long tg_chat);
+void msg_spool_done(uint32_t id);
+
+// Sync batched writes and compact the file once it is idle.
+void msg_spool_tick();
+void msg_spool_sync();
+
+// Requeue a recovered message under its spool id; false if it could not be
+// queued (it is then marked done).
+typedef bool (*msg_spool_replay_cb)(const String &text, uint8_t source, bool from_telegram,
+                                    long long tg_chat, uint32_t id);
+
+// Hand the messages loaded by msg_spool_init() to cb, oldest first. Ones that
+// were already replayed MSG_SPOOL_MAX_ATTEMPTS times were dropped at init, so
+// a message that crashes the device cannot loop forever. max_update_out gets
+// the newest Telegram update id in the spool, so the transport can skip the
+// same updates when Telegram delivers them again.
+size_t msg_spool_replay(msg_spool_replay_cb cb, long long &max_update_out);
+
+// "Spool: N outstanding, ..." line for diagnostics
+void msg_spool_describe(String &out);
+
+#endif
@@ -0,0 +1,188 @@
+#include "multipart_body.h"
+
+MultipartBody::MultipartBody() : boundary_("----esp32boundary" + String((unsigned long)millis())) {}
+
+String MultipartBody::content_type() const {
+  return "multipart/form-data; boundary=" + boundary_;
+}
+
+MultipartBody::Segment *MultipartBody::add(SegmentKind kind, size_t len) {
+  if (count_ >= kMaxSegments) {
+    Serial.println("[multipart] segment limit reached");
+    return nullptr;
+  }
+  Segment &seg = segments_[count_++];
+  seg.kind = kind;
+  seg.literal = nullptr;
+  seg.ref = nullptr;
+  seg.file = nullptr;
+  seg.len = len;
+  length_ += len;
+  return &seg;
+}
+
+void MultipartBody::field(const char *name, const String &value) {
+  String part = "--" + boundary_ + "\r\nContent-Disposition: form-data; name=\"" + name +
+                "\"\r\n\r\n" + value + "\r\n";
+  Segment *seg = add(SEG_OWNED, part.length());
+  if (seg) {
+    seg->owned = part;
+  }
+}
+
+void MultipartBody::begin_file(const char *name, const String &filename,
+                               const String &mime_type) {
+  String part = "--" + boundary_ + "\r\nContent-Disposition: form-data; name=\"" + name +
+                "\"; filename=\"" + filename + "\"\r\nContent-Type: " + mime_type + "\r\n\r\n";
+  Segment *seg = add(SEG_OWNED, part.length());
+  if (seg) {
+    seg->owned = part;
+  }
+}
+
+void MultipartBody::text(const char *literal) {
+  Segment *seg = add(SEG_LITERAL, strlen(literal));
+  if (seg) {
+    seg->literal = literal;
+  }
+}
+
+void MultipartBody::text(const String &content) {
+  Segment *seg = add(SEG_REF, content.length());
+  if (seg) {
+    seg->ref = &content;
+  }
+}
+
+void MultipartBody::file(File &f) {
+  Segment *seg = add(SEG_FILE, f.size());
+  if (seg) {
+    seg->file = &f;
+  }
+}
+
+void MultipartBody::base64(const String &encoded) {
+  Segment *seg = add(SEG_BASE64, b64_decoded_length(encoded.c_str(), encoded.length()));
+  if (seg) {
+    seg->ref = &encoded;
+  }
+}
+
+void MultipartBody::end_file() {
+  text("\r\n");
+}
+
+void MultipartBody::finish() {
+  Segment *seg = add(SEG_OWNED, boundary_.length() + 6);
+  if (seg) {
+    seg->owned = "--" + boundary_ + "--\r\n";
+  }
+}
+
+void MultipartBody::rewind() {
+  seg_ = 0;
+  offset_ = 0;
+  sent_ = 0;
+  reset_base64();
+  for (size_t i = 0; i < count_; i++) {
+    if (segments_[i].file) {
+      segments_[i].file->seek(0);
+    }
+  }
+}
+
+void MultipartBody::reset_base64() {
+  b64_decoder_.reset();
+  b64_pos_ = 0;
+  b64_out_len_ = 0;
+  b64_out_pos_ = 0;
+  b64_flushed_ = false;
+}
+
+size_t MultipartBody::read_base64(const Segment &seg, uint8_t *out, size_t want) {
+  const String &in = *seg.ref;
+  size_t n = 0;
+  while (n < want) {
+    if (b64_out_pos_ < b64_out_len_) {
+      out[n++] = b64_out_[b64_out_pos_++];
+      continue;
+    }
+    if (b64_pos_ < in.length()) {
+      // Decode straight into the caller's buffer; reads smaller than one
+      // group go through b64_out_.
+      const bool direct = want - n >= 3;
+      size_t used = 0;
+      const size_t got =
+          b64_decoder_.update(in.c_str() + b64_pos_, in.length() - b64_pos_,
+                              direct ? out + n : b64_out_, direct ? want - n : 3, &used);
+      b64_pos_ += used;
+      if (direct) {
+        n += got;
+      } else {
+        b64_out_len_ = got;
+        b64_out_pos_ = 0;
+      }
+      continue;
+    }
+    // Input exhausted: flush the trailing partial group once.
+    if (b64_flushed_) {
+      break;
+    }
+    b64_flushed_ = true;
+    b64_out_len_ = b64_decoder_.finish(b64_out_);
+    b64_out_pos_ = 0;
+  }
+  return n;
+}
+
+size_t MultipartBody::readBytes(char *buffer, size_t length) {
+  size_t n = 0;
+  while (n < length && seg_ < count_) {
+    const Segment &seg = segments_[seg_];
+    if (offset_ >= seg.len) {
+      seg_++;
+      offset_ = 0;
+      reset_base64();
+      continue;
+    }
+
+    size_t want = length - n;
+    if (want > seg.len - offset_) {
+      want = seg.len - offset_;
+    }
+    size_t got = 0;
+    switch (seg.kind) {
+      case SEG_OWNED:
+        memcpy(buffer + n, seg.owned.c_str() + offset_, want);
+        got = want;
+        break;
+      case SEG_LITERAL:
+        memcpy(buffer + n, seg.literal + offset_, want);
+        got = want;
+        break;
+      case SEG_REF:
+        memcpy(buffer + n, seg.ref->c_str() + offset_, want);
+        got = want;
+        break;
+      case SEG_FILE:
+        got = seg.file->read((uint8_t *)buffer + n, want);
+        break;
+      case SEG_BASE64:
+        got = read_base64(seg, (uint8_t *)buffer + n, want);
+        break;
+    }
+    if (got == 0) {
+      // A file shrank or the input ended early; the upload will be short.
+      break;
+    }
+    offset_ += got;
+    sent_ += got;
+    n += got;
+  }
+  return n;
+}
+
+int MultipartBody::read() {
+  char c;
+  return readBytes(&c, 1) == 1 ? (uint8_t)c : -1;
+}
@@ -0,0 +1,76 @@
+#ifndef MULTIPART_BODY_H
+#define MULTIPART_BODY_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "b64.h"
+
+// multipart/form-data request body that HTTPClient reads as a Stream. File
+// contents are referenced (a caller-owned String, an open File, or base64
+// text decoded on the fly) instead of being copied into one payload String,
+// and length() is exact so the upload goes out with a Content-Length header.
+// Referenced Strings and Files must outlive the body.
+class MultipartBody : public Stream {
+ public:
+  MultipartBody();
+
+  String content_type() const;
+
+  // Small form field; the value is copied.
+  void field(const char *name, const String &value);
+
+  // A file part is begin_file(), any number of content segments, end_file().
+  void begin_file(const char *name, const String &filename, const String &mime_type);
+  void text(const char *literal);
+  void text(const String &content);
+  void file(File &f);
+  void base64(const String &encoded);
+  void end_file();
+
+  // Closing boundary; call once after the last part.
+  void finish();
+
+  size_t length() const { return length_; }
+  void rewind();
+
+  int available() override { return (int)(length_ - sent_); }
+  int peek() override { return -1; }
+  int read() override;
+  size_t readBytes(char *buffer, size_t length) override;
+  size_t write(uint8_t) override { return 0; }
+
+ private:
+  enum SegmentKind : uint8_t { SEG_OWNED, SEG_LITERAL, SEG_REF, SEG_FILE, SEG_BASE64 };
+  struct Segment {
+    SegmentKind kind;
+    String owned;
+    const char *literal;
+    const String *ref;
+    File *file;
+    size_t len;
+  };
+  static const size_t kMaxSegments = 20;
+
+  Segment *add(SegmentKind kind, size_t len);
+  void reset_base64();
+  size_t read_base64(const Segment &seg, uint8_t *out, size_t want);
+
+  String boundary_;
+  Segment segments_[kMaxSegments];
+  size_t count_ = 0;
+  size_t length_ = 0;
+  size_t seg_ = 0;
+  size_t offset_ = 0;
+  size_t sent_ = 0;
+
+  // Decoder state for the current SEG_BASE64 segment
+  B64Decoder b64_decoder_;
+  size_t b64_pos_ = 0;
+  uint8_t b64_out_[3];
+  size_t b64_out_len_ = 0;
+  size_t b64_out_pos_ = 0;
+  bool b64_flushed_ = false;
+};
+
+#endif
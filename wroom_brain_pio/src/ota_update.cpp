@@ -0,0 +1,269 @@
+#include "ota_update.h"
+
+#include <ArduinoJson.h>
+#include <HTTPClient.h>
+#include <Update.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <mbedtls/md.h>
+
+#include "brain_config.h"
+#include "wifi_link.h"
+
+namespace {
+
+String to_hex(const uint8_t *data, size_t len) {
+  static const char kHex[] = "0123456789abcdef";
+  String out;
+  out.reserve(len * 2);
+  for (size_t i = 0; i < len; i++) {
+    out += kHex[data[i] >> 4];
+    out += kHex[data[i] & 0x0F];
+  }
+  return out;
+}
+
+// "sha256:<hex>" as GitHub reports asset digests, or bare hex
+String normalize_sha256(const String &digest) {
+  String hex = digest;
+  hex.trim();
+  hex.toLowerCase();
+  if (hex.startsWith("sha256:")) {
+    hex = hex.substring(7);
+  }
+  return hex.length() == 64 ? hex : String("");
+}
+
+class Sha256 {
+ public:
+  Sha256() {
+    mbedtls_md_init(&ctx_);
+    ok_ = mbedtls_md_setup(&ctx_, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0) == 0 &&
+          mbedtls_md_starts(&ctx_) == 0;
+  }
+  ~Sha256() { mbedtls_md_free(&ctx_); }
+
+  void update(const uint8_t *data, size_t len) {
+    if (ok_) {
+      ok_ = mbedtls_md_update(&ctx_, data, len) == 0;
+    }
+  }
+
+  String hex() {
+    uint8_t digest[32];
+    if (!ok_ || mbedtls_md_finish(&ctx_, digest) != 0) {
+      return "";
+    }
+    return to_hex(digest, sizeof(digest));
+  }
+
+ private:
+  mbedtls_md_context_t ctx_;
+  bool ok_;
+};
+
+}  // namespace
+
+bool ota_fetch_latest_release(const String &repo, OtaRelease &release_out, String &error_out) {
+  release_out = OtaRelease{"", "", "", 0};
+  if (!wifi_link_ready()) {
+    error_out = "WiFi not connected";
+    return false;
+  }
+
+  WiFiClientSecure client;
+  client.setInsecure();
+  HTTPClient http;
+  const String api_url = "https://api.github.com/repos/" + repo + "/releases/latest";
+  Serial.println("[ota] Fetching " + api_url);
+  if (!http.begin(client, api_url)) {
+    error_out = "Could not connect to GitHub API";
+    return false;
+  }
+  // HTTP/1.0 so the body is never chunked and can be parsed off the socket
+  http.useHTTP10(true);
+  http.setTimeout(15000);
+  http.addHeader("Accept", "application/vnd.github+json");
+  const int code = http.GET();
+  if (code != 200) {
+    http.end();
+    error_out = "GitHub API HTTP " + String(code);
+    return false;
+  }
+
+  // Release notes and uploader details are skipped while parsing
+  JsonDocument filter;
+  filter["tag_name"] = true;
+  JsonObject asset_filter = filter["assets"].add<JsonObject>();
+  asset_filter["name"] = true;
+  asset_filter["browser_download_url"] = true;
+  asset_filter["size"] = true;
+  asset_filter["digest"] = true;
+
+  JsonDocument doc;
+  const DeserializationError err =
+      deserializeJson(doc, http.getStream(), DeserializationOption::Filter(filter));
+  http.end();
+  if (err) {
+    error_out = String("Could not parse release: ") + err.c_str();
+    return false;
+  }
+
+  for (JsonObject asset : doc["assets"].as<JsonArray>()) {
+    if (String(asset["name"] | "") != "firmware.bin") {
+      continue;
+    }
+    release_out.version = doc["tag_name"] | "";
+    release_out.url = asset["browser_download_url"] | "";
+    release_out.size = asset["size"] | 0;
+    release_out.sha256 = normalize_sha256(asset["digest"] | "");
+    if (release_out.url.length() == 0) {
+      break;
+    }
+    return true;
+  }
+  error_out = "No firmware.bin found in release assets";
+  return false;
+}
+
+bool ota_install(const String &url, const String &sha256, ota_progress_cb_t on_progress,
+                 void *ctx, String &error_out) {
+  const String expected = sha256.length() > 0 ? normalize_sha256(sha256) : String("");
+  if (sha256.length() > 0 && expected.length() == 0) {
+    error_out = "Invalid SHA-256: " + sha256;
+    return false;
+  }
+
+  uint8_t *buf = (uint8_t *)malloc(OTA_CHUNK_BYTES);
+  if (!buf) {
+    error_out = "Out of memory";
+    return false;
+  }
+
+  Sha256 hash;
+  size_t total = 0;
+  size_t done = 0;
+  bool begun = false;
+  int resumes = 0;
+  const char *kCollectHeaders[] = {"Content-Range"};
+
+  while (true) {
+    if (!wifi_link_wait(OTA_RESUME_WAIT_MS)) {
+      error_out = "WiFi lost during download";
+      break;
+    }
+
+    WiFiClientSecure client;
+    client.setInsecure();
+    HTTPClient http;
+    bool fatal = false;
+    if (http.begin(client, url)) {
+      // GitHub assets redirect to a CDN, which honours Range as well
+      http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+      http.setConnectTimeout(12000);
+      http.setTimeout(OTA_STALL_MS);
+      http.collectHeaders(kCollectHeaders, 1);
+      if (done > 0) {
+        http.addHeader("Range", "bytes=" + String((unsigned long)done) + "-");
+      }
+      const int code = http.GET();
+      const int size = http.getSize();
+
+      if (done > 0 && code == 200) {
+        error_out = "Server does not support resuming downloads";
+        fatal = true;
+      } else if (code != 200 && code != 206) {
+        error_out = "Download HTTP " + String(code);
+        // Client errors will not get better on retry
+        fatal = code >= 400 && code < 500;
+      } else if (!begun) {
+        if (size <= 0) {
+          error_out = "Unknown firmware size";
+          fatal = true;
+        } else if (!Update.begin((size_t)size, U_FLASH)) {
+          error_out = String("Update begin failed: ") + Update.errorString();
+          fatal = true;
+        } else {
+          total = (size_t)size;
+          begun = true;
+          Serial.printf("[ota] Downloading %u bytes\n", (unsigned)total);
+        }
+      } else if (size > 0 && (size_t)size != total - done) {
+        error_out = "Firmware changed on the server (" + http.header("Content-Range") + ")";
+        fatal = true;
+      } else {
+        Serial.printf("[ota] Resumed at %u/%u\n", (unsigned)done, (unsigned)total);
+      }
+
+      if (!fatal && begun && (code == 200 || code == 206)) {
+        WiFiClient *stream = http.getStreamPtr();
+        uint32_t last_data_ms = millis();
+        while (done < total) {
+          const size_t avail = stream->available();
+          if (avail == 0) {
+            if (!http.connected() || millis() - last_data_ms > OTA_STALL_MS) {
+              error_out = "Download interrupted";
+              break;
+            }
+            delay(2);
+            continue;
+          }
+          size_t want = avail < OTA_CHUNK_BYTES ? avail : OTA_CHUNK_BYTES;
+          if (want > total - done) {
+            want = total - done;
+          }
+          const int n = stream->readBytes(buf, want);
+          if (n <= 0) {
+            continue;
+          }
+          hash.update(buf, (size_t)n);
+          if (Update.write(buf, (size_t)n) != (size_t)n) {
+            error_out = String("Flash write failed: ") + Update.errorString();
+            fatal = true;
+            break;
+          }
+          done += (size_t)n;
+          last_data_ms = millis();
+          if (on_progress) {
+            on_progress(done, total, ctx);
+          }
+        }
+      }
+      http.end();
+    } else {
+      error_out = "HTTP begin failed";
+    }
+
+    if (fatal || (begun && done == total)) {
+      break;
+    }
+    if (++resumes > OTA_MAX_RESUMES) {
+      error_out += " (gave up after " + String(OTA_MAX_RESUMES) + " retries)";
+      break;
+    }
+    Serial.printf("[ota] %s at %u bytes, retry %d\n", error_out.c_str(), (unsigned)done, resumes);
+    delay(1000UL * resumes);
+  }
+  free(buf);
+
+  if (!begun || done != total) {
+    if (begun) {
+      Update.abort();
+    }
+    return false;
+  }
+
+  const String actual = hash.hex();
+  if (expected.length() > 0 && actual != expected) {
+    Update.abort();
+    error_out = "SHA-256 mismatch, image discarded (got " + actual.substring(0, 16) + "...)";
+    return false;
+  }
+  if (!Update.end(true)) {
+    error_out = String("Update failed: ") + Update.errorString();
+    return false;
+  }
+  Serial.printf("[ota] Image ok, sha256=%s%s\n", actual.c_str(),
+                expected.length() > 0 ? " (verified)" : "");
+  return true;
+}
@@ -0,0 +1,30 @@
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <Arduino.h>
+
+// Firmware updates from GitHub releases or a plain URL. The image is written
+// to the inactive OTA partition as it downloads; a dropped connection resumes
+// with a Range request from the last byte written instead of starting over,
+// and the SHA-256 is computed on the way so a corrupt image is never booted.
+
+struct OtaRelease {
+  String version;
+  String url;
+  String sha256;  // lower-case hex, "" when the release publishes no digest
+  size_t size;
+};
+
+// Latest release of repo ("owner/name") that has a firmware.bin asset. The
+// metadata is parsed as it streams in, keeping only the fields used here.
+bool ota_fetch_latest_release(const String &repo, OtaRelease &release_out, String &error_out);
+
+// Called after each chunk is flashed.
+typedef void (*ota_progress_cb_t)(size_t done, size_t total, void *ctx);
+
+// Download url into the OTA partition and mark it for the next boot. With
+// sha256 set the image must match it. Does not restart.
+bool ota_install(const String &url, const String &sha256, ota_progress_cb_t on_progress,
+                 void *ctx, String &error_out);
+
+#endif
@@ -2,8 +2,12 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include "brain_config.h"
+#include "context_cache.h"
+#include "scheduler.h"
 
 namespace {
 
@@ -26,6 +30,35 @@ const char *kOnboardingUserNameKey = "onb_user";
 const char *kOnboardingBotNameKey = "onb_bot";
 const char *kOnboardingPurposeKey = "onb_purp";
 
+// Write-through RAM copies of the keys read on every message or tool call.
+// Soul and email drafts are large and rarely read, so those stay in NVS only.
+struct CachedKey {
+  const char *key;
+  String value;
+};
+
+CachedKey g_cached[] = {
+    {kHeartbeatKey, String()},         {kReminderTimeKey, String()},
+    {kReminderMsgKey, String()},       {kTimezoneKey, String()},
+    {kOnboardingStepKey, String()},    {kOnboardingProviderKey, String()},
+    {kOnboardingUserNameKey, String()}, {kOnboardingBotNameKey, String()},
+    {kOnboardingPurposeKey, String()},
+};
+const size_t kCachedCount = sizeof(g_cached) / sizeof(g_cached[0]);
+
+bool g_safe_mode = false;
+bool g_onboarding_done = false;
+SemaphoreHandle_t g_lock = nullptr;
+
+CachedKey *find_cached(const char *key) {
+  for (size_t i = 0; i < kCachedCount; i++) {
+    if (strcmp(g_cached[i].key, key) == 0) {
+      return &g_cached[i];
+    }
+  }
+  return nullptr;
+}
+
 bool ensure_ready(String &error_out) {
   if (g_ready) {
     return true;
@@ -34,10 +67,54 @@ bool ensure_ready(String &error_out) {
     error_out = "NVS begin failed";
     return false;
   }
+  g_lock = xSemaphoreCreateMutex();
+  if (g_lock == nullptr) {
+    error_out = "persona lock alloc failed";
+    return false;
+  }
+  for (size_t i = 0; i < kCachedCount; i++) {
+    // isKey first: getString logs an error for every missing key
+    if (g_prefs.isKey(g_cached[i].key)) {
+      g_cached[i].value = g_prefs.getString(g_cached[i].key, "");
+    }
+  }
+  g_safe_mode = g_prefs.getUChar(kSafeModeKey, 0) == 1;
+  g_onboarding_done = g_prefs.getUChar(kOnboardingDoneKey, 0) == 1;
   g_ready = true;
   return true;
 }
 
+// The helpers below keep g_cached in step with NVS; callers have run
+// ensure_ready.
+size_t put_string(const char *key, const String &value) {
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  const size_t written = g_prefs.putString(key, value);
+  CachedKey *cached = find_cached(key);
+  if (cached != nullptr && (written > 0 || value.length() == 0)) {
+    cached->value = value;
+  }
+  xSemaphoreGive(g_lock);
+  return written;
+}
+
+String read_string(const char *key) {
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  CachedKey *cached = find_cached(key);
+  const String value = cached != nullptr ? cached->value : g_prefs.getString(key, "");
+  xSemaphoreGive(g_lock);
+  return value;
+}
+
+void remove_key(const char *key) {
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  g_prefs.remove(key);
+  CachedKey *cached = find_cached(key);
+  if (cached != nullptr) {
+    cached->value = "";
+  }
+  xSemaphoreGive(g_lock);
+}
+
 String sanitize_and_limit(const String &input, size_t max_chars) {
   String cleaned = input;
   cleaned.trim();
@@ -52,7 +129,7 @@ bool set_key_limited(const char *key, const String &value, size_t max_chars, Str
     return false;
   }
   const String cleaned = sanitize_and_limit(value, max_chars);
-  size_t written = g_prefs.putString(key, cleaned);
+  size_t written = put_string(key, cleaned);
   if (written == 0 && cleaned.length() > 0) {
     error_out = "failed to write key";
     return false;
@@ -64,7 +141,7 @@ bool get_key(const char *key, String &value_out, String &error_out) {
   if (!ensure_ready(error_out)) {
     return false;
   }
-  value_out = g_prefs.getString(key, "");
+  value_out = read_string(key);
   return true;
 }
 
@@ -72,7 +149,7 @@ bool clear_key(const char *key, String &error_out) {
   if (!ensure_ready(error_out)) {
     return false;
   }
-  g_prefs.remove(key);
+  remove_key(key);
   return true;
 }
 
@@ -120,16 +197,20 @@ bool persona_set_daily_reminder(const String &hhmm, const String &message, Strin
   time_clean.trim();
   String msg_clean = sanitize_and_limit(message, REMINDER_MSG_MAX_CHARS);
 
-  size_t w1 = g_prefs.putString(kReminderTimeKey, time_clean);
+  size_t w1 = put_string(kReminderTimeKey, time_clean);
+  size_t w2 = w1 == 0 && time_clean.length() > 0 ? 0 : put_string(kReminderMsgKey, msg_clean);
+  // After the writes, so a prompt build that read the old values cannot
+  // re-cache them (see context_cache.h).
+  context_cache_invalidate(CTX_SCHEDULE);
   if (w1 == 0 && time_clean.length() > 0) {
     error_out = "failed to write reminder time";
     return false;
   }
-  size_t w2 = g_prefs.putString(kReminderMsgKey, msg_clean);
   if (w2 == 0 && msg_clean.length() > 0) {
     error_out = "failed to write reminder message";
     return false;
   }
+  scheduler_notify_changed();
   return true;
 }
 
@@ -137,8 +218,8 @@ bool persona_get_daily_reminder(String &hhmm_out, String &message_out, String &e
   if (!ensure_ready(error_out)) {
     return false;
   }
-  hhmm_out = g_prefs.getString(kReminderTimeKey, "");
-  message_out = g_prefs.getString(kReminderMsgKey, "");
+  hhmm_out = read_string(kReminderTimeKey);
+  message_out = read_string(kReminderMsgKey);
   return true;
 }
 
@@ -146,8 +227,10 @@ bool persona_clear_daily_reminder(String &error_out) {
   if (!ensure_ready(error_out)) {
     return false;
   }
-  g_prefs.remove(kReminderTimeKey);
-  g_prefs.remove(kReminderMsgKey);
+  remove_key(kReminderTimeKey);
+  remove_key(kReminderMsgKey);
+  context_cache_invalidate(CTX_SCHEDULE);
+  scheduler_notify_changed();
   return true;
 }
 
@@ -156,11 +239,12 @@ bool persona_set_timezone(const String &tz, String &error_out) {
     return false;
   }
   String cleaned = sanitize_and_limit(tz, 64);
-  size_t written = g_prefs.putString(kTimezoneKey, cleaned);
+  size_t written = put_string(kTimezoneKey, cleaned);
   if (written == 0 && cleaned.length() > 0) {
     error_out = "failed to write timezone";
     return false;
   }
+  scheduler_notify_changed();
   return true;
 }
 
@@ -168,7 +252,7 @@ bool persona_get_timezone(String &tz_out, String &error_out) {
   if (!ensure_ready(error_out)) {
     return false;
   }
-  tz_out = g_prefs.getString(kTimezoneKey, "");
+  tz_out = read_string(kTimezoneKey);
   return true;
 }
 
@@ -180,7 +264,10 @@ bool persona_set_safe_mode(bool enabled, String &error_out) {
   if (!ensure_ready(error_out)) {
     return false;
   }
+  xSemaphoreTake(g_lock, portMAX_DELAY);
   g_prefs.putUChar(kSafeModeKey, enabled ? 1 : 0);
+  g_safe_mode = enabled;
+  xSemaphoreGive(g_lock);
   return true;
 }
 
@@ -188,7 +275,7 @@ bool persona_get_safe_mode(bool &enabled_out, String &error_out) {
   if (!ensure_ready(error_out)) {
     return false;
   }
-  enabled_out = g_prefs.getUChar(kSafeModeKey, 0) == 1;
+  enabled_out = g_safe_mode;
   return true;
 }
 
@@ -202,9 +289,9 @@ bool persona_set_email_draft(const String &to, const String &subject, const Stri
   String subject_clean = sanitize_and_limit(subject, 180);
   String body_clean = sanitize_and_limit(body, 800);
 
-  size_t w1 = g_prefs.putString(kEmailToKey, to_clean);
-  size_t w2 = g_prefs.putString(kEmailSubjectKey, subject_clean);
-  size_t w3 = g_prefs.putString(kEmailBodyKey, body_clean);
+  size_t w1 = put_string(kEmailToKey, to_clean);
+  size_t w2 = put_string(kEmailSubjectKey, subject_clean);
+  size_t w3 = put_string(kEmailBodyKey, body_clean);
   if ((w1 == 0 && to_clean.length() > 0) || (w2 == 0 && subject_clean.length() > 0) ||
       (w3 == 0 && body_clean.length() > 0)) {
     error_out = "failed to write email draft";
@@ -218,9 +305,9 @@ bool persona_get_email_draft(String &to_out, String &subject_out, String &body_o
   if (!ensure_ready(error_out)) {
     return false;
   }
-  to_out = g_prefs.getString(kEmailToKey, "");
-  subject_out = g_prefs.getString(kEmailSubjectKey, "");
-  body_out = g_prefs.getString(kEmailBodyKey, "");
+  to_out = read_string(kEmailToKey);
+  subject_out = read_string(kEmailSubjectKey);
+  body_out = read_string(kEmailBodyKey);
   return true;
 }
 
@@ -228,9 +315,9 @@ bool persona_clear_email_draft(String &error_out) {
   if (!ensure_ready(error_out)) {
     return false;
   }
-  g_prefs.remove(kEmailToKey);
-  g_prefs.remove(kEmailSubjectKey);
-  g_prefs.remove(kEmailBodyKey);
+  remove_key(kEmailToKey);
+  remove_key(kEmailSubjectKey);
+  remove_key(kEmailBodyKey);
   return true;
 }
 
@@ -238,7 +325,10 @@ bool persona_set_onboarding_done(bool done, String &error_out) {
   if (!ensure_ready(error_out)) {
     return false;
   }
+  xSemaphoreTake(g_lock, portMAX_DELAY);
   g_prefs.putUChar(kOnboardingDoneKey, done ? 1 : 0);
+  g_onboarding_done = done;
+  xSemaphoreGive(g_lock);
   return true;
 }
 
@@ -246,7 +336,7 @@ bool persona_get_onboarding_done(bool &done_out, String &error_out) {
   if (!ensure_ready(error_out)) {
     return false;
   }
-  done_out = g_prefs.getUChar(kOnboardingDoneKey, 0) == 1;
+  done_out = g_onboarding_done;
   return true;
 }
 
@@ -294,10 +384,10 @@ bool persona_clear_onboarding_state(String &error_out) {
   if (!ensure_ready(error_out)) {
     return false;
   }
-  g_prefs.remove(kOnboardingStepKey);
-  g_prefs.remove(kOnboardingProviderKey);
-  g_prefs.remove(kOnboardingUserNameKey);
-  g_prefs.remove(kOnboardingBotNameKey);
-  g_prefs.remove(kOnboardingPurposeKey);
+  remove_key(kOnboardingStepKey);
+  remove_key(kOnboardingProviderKey);
+  remove_key(kOnboardingUserNameKey);
+  remove_key(kOnboardingBotNameKey);
+  remove_key(kOnboardingPurposeKey);
   return true;
 }
@@ -0,0 +1,115 @@
+#include "power_mgr.h"
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_idf_version.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+
+#include "brain_config.h"
+
+namespace {
+
+bool g_wifi_ps = false;
+bool g_light_sleep = false;
+bool g_dfs = false;
+
+uint32_t g_busy_depth = 0;
+int64_t g_busy_since_us = 0;
+int64_t g_busy_total_us = 0;
+int64_t g_start_us = 0;
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#if POWER_SAVE_ENABLED
+esp_err_t configure_pm(bool light_sleep) {
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+  esp_pm_config_t cfg = {};
+#else
+  esp_pm_config_esp32_t cfg = {};
+#endif
+  cfg.max_freq_mhz = POWER_CPU_MAX_MHZ;
+  cfg.min_freq_mhz = POWER_CPU_MIN_MHZ;
+  cfg.light_sleep_enable = light_sleep;
+  return esp_pm_configure(&cfg);
+}
+#endif
+
+}  // namespace
+
+void power_init() {
+  g_start_us = esp_timer_get_time();
+#if POWER_SAVE_ENABLED
+  // Modem sleep keeps the association and wakes for every DTIM beacon, so
+  // Telegram long polls and webhooks still arrive.
+  g_wifi_ps = WiFi.setSleep(WIFI_PS_MIN_MODEM);
+
+  esp_err_t err = configure_pm(true);
+  if (err == ESP_OK) {
+    g_light_sleep = true;
+    g_dfs = true;
+  } else {
+    // Light sleep needs CONFIG_FREERTOS_USE_TICKLESS_IDLE in sdkconfig; the
+    // stock Arduino core lacks it, so fall back to frequency scaling.
+    Serial.printf("[power] light sleep unavailable (%s), using DFS only\n", esp_err_to_name(err));
+    err = configure_pm(false);
+    g_dfs = err == ESP_OK;
+    if (!g_dfs) {
+      Serial.printf("[power] DFS unavailable (%s)\n", esp_err_to_name(err));
+    }
+  }
+  Serial.printf("[power] modem sleep %s, light sleep %s, DFS %s\n", g_wifi_ps ? "on" : "off",
+                g_light_sleep ? "on" : "off", g_dfs ? "on" : "off");
+#endif
+}
+
+void power_busy_begin() {
+  const int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&g_mux);
+  if (g_busy_depth++ == 0) {
+    g_busy_since_us = now;
+  }
+  portEXIT_CRITICAL(&g_mux);
+}
+
+void power_busy_end() {
+  const int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&g_mux);
+  if (g_busy_depth > 0 && --g_busy_depth == 0) {
+    g_busy_total_us += now - g_busy_since_us;
+  }
+  portEXIT_CRITICAL(&g_mux);
+}
+
+uint32_t power_loop_delay_ms() {
+#if POWER_SAVE_ENABLED
+  return POWER_LOOP_DELAY_MS;
+#else
+  return 50;
+#endif
+}
+
+void power_describe(String &out) {
+  const int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&g_mux);
+  int64_t busy_us = g_busy_total_us;
+  if (g_busy_depth > 0) {
+    busy_us += now - g_busy_since_us;
+  }
+  portEXIT_CRITICAL(&g_mux);
+
+  const int64_t span_us = now - g_start_us;
+  const uint32_t busy_pct = span_us > 0 ? (uint32_t)(busy_us * 100 / span_us) : 0;
+  const uint32_t busy_s = (uint32_t)(busy_us / 1000000);
+  const uint32_t span_s = (uint32_t)(span_us / 1000000);
+
+  out = "Power: ";
+  out += POWER_SAVE_ENABLED ? "save" : "performance";
+  out += "\nWiFi modem sleep: " + String(g_wifi_ps ? "on" : "off");
+  out += "\nLight sleep: " + String(g_light_sleep ? "on" : "off");
+  out += "\nCPU: " + String(ESP.getCpuFreqMHz()) + " MHz" + (g_dfs ? " (DFS)" : "");
+  out += "\nBusy: " + String(busy_s) + "s of " + String(span_s) + "s (" + String(busy_pct) +
+         "%), idle " + String(100 - min(busy_pct, (uint32_t)100)) + "%";
+  if (g_light_sleep) {
+    out += " sleep-eligible";
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef POWER_MGR_H
+#define POWER_MGR_H
+
+#include <Arduino.h>
+
+// Optional power-managed mode: WiFi modem sleep plus automatic light sleep
+// whenever every task is blocked. The scheduler task and the Telegram long
+// poll already block until their next event, so the idle gaps between them
+// are what the chip sleeps through. Busy sections are counted so /power can
+// report how much of the uptime was spent awake doing work.
+
+// Call once WiFi is associated.
+void power_init();
+
+// Nested, cross-task busy accounting.
+void power_busy_begin();
+void power_busy_end();
+
+// How long loop() should wait between ticks.
+uint32_t power_loop_delay_ms();
+
+void power_describe(String &out);
+
+// Counts the enclosing scope as busy.
+class PowerBusyScope {
+ public:
+  PowerBusyScope() { power_busy_begin(); }
+  ~PowerBusyScope() { power_busy_end(); }
+
+ private:
+  PowerBusyScope(const PowerBusyScope &) = delete;
+  PowerBusyScope &operator=(const PowerBusyScope &) = delete;
+};
+
+#endif
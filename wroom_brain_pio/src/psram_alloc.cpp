@@ -0,0 +1,89 @@
+#include "psram_alloc.h"
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <mbedtls/platform.h>
+
+#include "brain_config.h"
+
+namespace {
+
+bool g_psram = false;
+bool g_tls_internal = false;
+
+const uint32_t kPsramCaps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+const uint32_t kInternalCaps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+
+#if defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+void *tls_calloc(size_t n, size_t size) {
+  return heap_caps_calloc(n, size, kInternalCaps);
+}
+
+void tls_free(void *ptr) {
+  heap_caps_free(ptr);
+}
+#endif
+
+}  // namespace
+
+void psram_alloc_init() {
+#if PSRAM_ALLOC_ENABLED
+  g_psram = psramFound();
+#endif
+  if (!g_psram) {
+    Serial.println("[psram] not found, large buffers use internal heap");
+    return;
+  }
+
+#if defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+  g_tls_internal = mbedtls_platform_set_calloc_free(tls_calloc, tls_free) == 0;
+#endif
+  // Plain malloc (and so every String) of this size and up now prefers PSRAM
+  heap_caps_malloc_extmem_enable(PSRAM_MIN_BYTES);
+  Serial.printf("[psram] %u KB, buffers >= %u bytes go external%s\n",
+                (unsigned)(heap_caps_get_total_size(kPsramCaps) / 1024), (unsigned)PSRAM_MIN_BYTES,
+                g_tls_internal ? ", TLS kept internal" : " (TLS allocator unchanged)");
+}
+
+bool psram_available() {
+  return g_psram;
+}
+
+void *big_malloc(size_t bytes) {
+  if (g_psram) {
+    void *p = heap_caps_malloc(bytes, kPsramCaps);
+    if (p != nullptr) {
+      return p;
+    }
+  }
+  return malloc(bytes);
+}
+
+void *big_realloc(void *ptr, size_t bytes) {
+  if (g_psram) {
+    void *p = heap_caps_realloc(ptr, bytes, kPsramCaps);
+    if (p != nullptr) {
+      return p;
+    }
+  }
+  return realloc(ptr, bytes);
+}
+
+void *internal_malloc(size_t bytes) {
+  return heap_caps_malloc(bytes, kInternalCaps);
+}
+
+size_t psram_media_ram_limit() {
+  return g_psram ? PSRAM_MEDIA_RAM_MAX_BYTES : MEDIA_RAM_MAX_BYTES;
+}
+
+void psram_alloc_describe(String &out) {
+  if (!g_psram) {
+    out = "PSRAM: none";
+    return;
+  }
+  out = "PSRAM: " + String((unsigned)heap_caps_get_free_size(kPsramCaps)) + " / " +
+        String((unsigned)heap_caps_get_total_size(kPsramCaps)) + " bytes free, largest block " +
+        String((unsigned)heap_caps_get_largest_free_block(kPsramCaps)) + ", TLS " +
+        (g_tls_internal ? "internal" : "default allocator");
+}
@@ -0,0 +1,32 @@
+#ifndef PSRAM_ALLOC_H
+#define PSRAM_ALLOC_H
+
+#include <Arduino.h>
+
+// Where large buffers live. On boards with PSRAM (WROVER, S3), allocations of
+// PSRAM_MIN_BYTES and up prefer external RAM, which covers the big short-lived
+// Strings (prompt and reply bodies, base64 media, web file sources) as well as
+// the raw buffers that call big_malloc() directly. Where the SDK lets mbedTLS
+// take a custom allocator it is given an internal-only one, so TLS records
+// stay out of the slower PSRAM; DMA buffers are requested with MALLOC_CAP_DMA
+// by their drivers anyway.
+// Without PSRAM every call falls back to the normal heap.
+
+// Call once at the start of setup(), before anything large is allocated.
+void psram_alloc_init();
+bool psram_available();
+
+// PSRAM first, internal heap when there is none or it is full. Free with free().
+void *big_malloc(size_t bytes);
+void *big_realloc(void *ptr, size_t bytes);
+
+// Internal DRAM only (never PSRAM).
+void *internal_malloc(size_t bytes);
+
+// Largest media file held in RAM for analysis (more with PSRAM).
+size_t psram_media_ram_limit();
+
+// "PSRAM: free/total ..." line for diagnostics
+void psram_alloc_describe(String &out);
+
+#endif
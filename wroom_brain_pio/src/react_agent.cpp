@@ -2,141 +2,58 @@
 
 #include "brain_config.h"
 #include "llm_client.h"
+#include "memory_store.h"
+#include "metrics.h"
 #include "tool_registry.h"
 #include "file_memory.h"
 #include "event_log.h"
 #include "chat_history.h"
+#include "chat_scope.h"
+#include "context_budget.h"
 #include "skill_registry.h"
-
+#include "keyword_matcher.h"
+#include "trace.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <new>
+#include <string.h>
 #include <time.h>
 
 namespace {
 
-// ============================================================================
-// TOOL SCHEMA - Available tools for ReAct agent
-// ============================================================================
-
-// clang-format off
-static const ReactTool s_react_tools[] = {
-    // Memory & Knowledge
-    {"remember", "Save information to long-term memory (MEMORY.md)", "<text to remember>", "remember: User likes pineapple pizza"},
-    {"memory_read", "Read all stored memories from MEMORY.md", "none", "memory_read"},
-    {"memory_clear", "Clear all stored memories from MEMORY.md", "none", "memory_clear"},
-    {"file_memory", "Show SPIFFS file system info", "none", "file_memory"},
-    {"files_list", "List all files in SPIFFS", "none", "files_list"},
-    {"files_get", "Read a file from SPIFFS", "<filename>", "files_get: /projects/demo/index.html"},
-    {"user_read", "Read user profile (USER.md)", "none", "user_read"},
-    {"soul_show", "Show current personality/soul (SOUL.md)", "none", "soul_show"},
-    {"soul_set", "Set new personality/soul (SOUL.md)", "<soul description>", "soul_set: You are a helpful robot assistant"},
-    {"soul_clear", "Clear the soul/personality", "none", "soul_clear"},
-
-    // Task Management
-#if ENABLE_TASKS
-    {"task_add", "Add a new task to the list", "<task description>", "task_add: Buy groceries tomorrow"},
-    {"task_list", "Show all pending tasks", "none", "task_list"},
-    {"task_done", "Mark a task as completed", "<task_id>", "task_done: 3"},
-    {"task_clear", "Clear all completed tasks", "none", "task_clear"},
-#endif
-
-    // Reminders & Scheduling (use cron_add for all scheduling)
-    {"cron_add", "Add a cron job (minute hour day month weekday | command)", "<cron_expr> | <cmd>", "cron_add: 0 9 * * * | Good morning"},
-    {"cron_list", "List all cron jobs", "none", "cron_list"},
-    {"cron_show", "Show cron.md file content", "none", "cron_show"},
-    {"cron_clear", "Clear all cron jobs", "none", "cron_clear"},
-
-    // Time & Timezone
-    {"time_show", "Show current time and timezone", "none", "time_show"},
-    {"timezone_set", "Set user timezone", "<timezone>", "timezone_set: IST"},
-    {"timezone_show", "Show current timezone", "none", "timezone_show"},
-    {"timezone_clear", "Clear the timezone setting", "none", "timezone_clear"},
-
-    // Email
-#if ENABLE_EMAIL
-    {"email_draft", "Draft an email (stores for sending)", "<to>|<subject>|<body>", "email_draft: user@example.com|Meeting tomorrow|Can we meet at 2pm?"},
-    {"email_show", "Show current email draft", "none", "email_show"},
-    {"email_clear", "Clear email draft", "none", "email_clear"},
-    {"send_email", "Send an email directly", "<to> <subject> <message>", "send_email: user@example.com Meeting tomorrow Can we meet at 2pm?"},
-    {"email_files", "Generate and email website files (HTML, CSS, JS)", "<email> <topic>", "email_files: user@example.com portfolio site for photographer"},
-#endif
-
-    // Image Generation
-#if ENABLE_IMAGE_GEN
-    {"generate_image", "Generate an image using AI", "<prompt description>", "generate_image: A cute dinosaur robot"},
-#endif
-
-    // System Info
-    {"status", "Show system status and uptime", "none", "status"},
-    {"health", "Show detailed health check", "none", "health"},
-    {"specs", "Show hardware/software specifications", "none", "specs"},
-    {"usage", "Show token and API usage statistics", "none", "usage"},
-    {"usage_reset", "Reset usage statistics", "none", "usage_reset"},
-    {"security", "Show security settings and safe mode", "none", "security"},
-
-    // System Controls
-    {"logs", "Show recent system logs", "none", "logs"},
-    {"logs_clear", "Clear all system logs", "none", "logs_clear"},
-    {"safe_mode", "Toggle safe mode on/off", "none", "safe_mode"},
-    {"safe_mode_on", "Enable safe mode (confirm required)", "none", "safe_mode_on"},
-    {"safe_mode_off", "Disable safe mode", "none", "safe_mode_off"},
-
-    // Firmware Updates
-    {"update", "Check for firmware updates from GitHub", "none", "update"},
-    {"update", "Update firmware from specific URL", "<url>", "update: https://raw.githubusercontent.com/user/repo/main/firmware.bin"},
-
-    // Model Configuration
-    {"model_list", "List available LLM models", "none", "model_list"},
-    {"model_status", "Show current model and fallback status", "none", "model_status"},
-    {"model_use", "Switch to a different LLM model", "<model_name>", "model_use: gpt-4o-mini"},
-    {"model_set", "Configure model with provider and base URL", "<provider>|<model>|<base_url>|<api_key>", "model_set: openai|gpt-4o-mini|https://api.openai.com|sk-xxx"},
-    {"model_failed", "Show failed providers", "none", "model_failed"},
-    {"model_reset_failed", "Reset failed provider status", "none", "model_reset_failed"},
-
-    // Heartbeat System
-    {"heartbeat_show", "Show heartbeat configuration", "none", "heartbeat_show"},
-    {"heartbeat_set", "Set heartbeat instructions", "<instructions>", "heartbeat_set: Check health and report any issues"},
-    {"heartbeat_clear", "Clear heartbeat configuration", "none", "heartbeat_clear"},
-
-    // Web Tools
-    {"search", "Search the web for information (news, facts)", "<query>", "search: latest AI news"},
-    {"weather", "Get current weather for a location", "<location>", "weather: Tokyo"},
-    {"time", "Get current local time", "none", "time"},
-
-    // Planning (if enabled)
-#if ENABLE_PLAN
-    {"plan", "Create a plan for a coding task", "<task description>", "plan: Add a new feature for reminders"},
-#endif
-
-    // Web Generation
-    {"web_files_make", "Generate and send website files (HTML, CSS, JS)", "<topic>", "web_files_make: personal portfolio, SaaS landing page"},
-    {"discord_send", "Send a message via Discord Webhook", "<message>", "discord_send: Hello from TimiClaw!"},
-    {"discord_send_files", "Generate and send website files via Discord Webhook", "<topic>", "discord_send_files: portfolio site for photographer"},
-
-    // Pending Actions
-    {"cancel", "Cancel any pending confirmation", "none", "cancel"},
-    {"confirm", "Confirm a pending action", "none", "confirm"},
-    {"yes", "Confirm a pending action", "none", "yes"},
-
-    // Skills
-    {"use_skill", "Activate a skill by name (lazy-loaded from SPIFFS)", "<skill_name> [extra context]", "use_skill frontend_dev build a portfolio site"},
-    {"skill_list", "List all available agent skills", "none", "skill_list"},
-    {"skill_show", "Show full content of a skill", "<skill_name>", "skill_show morning_briefing"},
-    {"skill_add", "Create a new reusable skill on SPIFFS", "<name> <description>: <step-by-step instructions>", "skill_add debug_helper Debug code issues: 1. Ask for error message 2. Analyze code 3. Suggest fix"},
-    {"skill_remove", "Delete a skill from SPIFFS", "<skill_name>", "skill_remove old_skill"},
-    {"minos", "Execute a MinOS shell command (ls, cat, nano, append, ps, free, df, uptime, reboot)", "<command>", "minos: nano /projects/demo/index.html <html>...</html>"},
+// Keywords that suggest multi-step reasoning OR web generation
+const char *const kComplexKeywords[] = {
+    "how do i", "help me", "what should", "can you", "i need to",
+    "remember to", "set up", "configure", "schedule", "remind ", "remind me to",
+    "in 1 ", "in 2 ", "in 3 ", "in 4 ", "in 5 ", "in 10 ", "in 15 ", "in 20 ", "in 30 ",
+    "figure out", "find out", "check if", "make sure", "todo", "task",
+    "plan", "organize", "track",
+    // Search/info triggers
+    "what is", "what's", "who is", "who's", "tell me about", "search for",
+    "look up", "google", "explain", "define", "meaning of",
+    // Web generation triggers
+    "make a", "create a", "generate a", "build a", "website", "html",
+    "saas", "landing page", "portfolio", "app", "web app",
+    // Email triggers
+    "email me", "send email", "email those", "email the",
+    // WhatsApp triggers
+    "whatsapp", "send to whatsapp", "wa me", "via whatsapp",
+    // Skill triggers
+    "use skill", "use_skill", "skill"
 };
-// clang-format on
 
-static const size_t s_num_tools = sizeof(s_react_tools) / sizeof(s_react_tools[0]);
+// Compiled once in react_agent_init() so the check is a single pass
+KeywordMatcher g_complex_keywords;
 
 // ============================================================================
 // REACT SYSTEM PROMPTS
 // ============================================================================
 
-// Build the ReAct system prompt dynamically (needs iteration count)
-String build_react_system_prompt() {
-  String prompt = "🦖 You are Timi, a clever dinosaur assistant on an ESP32. Think step-by-step!\n\n";
-
-  // Inject current time awareness
+// Current-time line for the per-call part of the ReAct context.
+String build_react_time_context() {
+  String prompt;
   struct tm timeinfo;
   if (getLocalTime(&timeinfo)) {
     const char* days[] = {"Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"};
@@ -158,22 +75,43 @@ String build_react_system_prompt() {
     prompt += "Greet appropriately and be time-aware.\n\n";
   }
 
-  prompt += "Format for each step:\n"
-            "🤔 THINK: <what you're analyzing>\n"
-            "⚡ DO: <tool_name> <parameters>\n"
-            "When done, give final answer:\n"
-            "✅ ANSWER: <response to user>\n\n"
-            "IMPORTANT - SEARCH RESULTS HANDLING:\n"
+  return prompt;
+}
+
+// Build the ReAct system prompt. It must stay byte-identical across calls so
+// providers can reuse their cached prefix; anything time-dependent belongs in
+// build_react_time_context() instead. With native tool calling the tools are
+// sent as definitions, so the step format and tool list are left out.
+String build_react_system_prompt(bool native_tools) {
+  String prompt = "🦖 You are Timi, a clever dinosaur assistant on an ESP32. Think step-by-step!\n\n";
+
+  if (!native_tools) {
+    prompt += "Format for each step:\n"
+              "🤔 THINK: <what you're analyzing>\n"
+              "⚡ DO: <tool_name> <parameters>\n"
+              "When done, give final answer:\n"
+              "✅ ANSWER: <response to user>\n\n";
+  }
+  prompt += "IMPORTANT - SEARCH RESULTS HANDLING:\n"
             "- When you receive search results, you MUST SUMMARIZE them in your own words!\n"
             "- Extract the KEY INFORMATION and present it clearly\n"
             "- Do NOT just paste the raw search results\n"
             "- Give a direct, concise answer to the user's question\n"
             "- Include relevant details but be brief\n\n"
-            "Other Guidelines:\n"
-            "- Always THINK first, then DO one action\n"
-            "- Read tool results, THINK again, continue\n"
-            "- Use ANSWER when task is complete\n"
-            "- Be brief and helpful\n"
+            "Other Guidelines:\n";
+  if (native_tools) {
+    prompt += "- Call tools when you need them; each takes its arguments as one \"args\" string\n"
+              "- Independent lookups (e.g. search + weather) may be several tool calls at once, "
+              "max " + String(REACT_MAX_PARALLEL_ACTIONS) + "; they run in parallel\n"
+              "- Read tool results and continue; reply with plain text once the task is complete\n";
+  } else {
+    prompt += "- Always THINK first, then DO\n"
+              "- Independent lookups (e.g. search + weather) may be several ⚡ DO lines in one step, "
+              "max " + String(REACT_MAX_PARALLEL_ACTIONS) + "; they run in parallel\n"
+              "- Read tool results, THINK again, continue\n"
+              "- Use ANSWER when task is complete\n";
+  }
+  prompt += "- Be brief and helpful\n"
             "- For iterative coding, prefer SPIFFS project paths (/projects/<name>/...). Read file first, then update.\n"
             "- For SCHEDULING: Use cron_add with format: <min> <hr> <day> <mo> <wkday> | <command>\n"
             "  Natural language examples → cron_add:\n"
@@ -181,8 +119,10 @@ String build_react_system_prompt() {
             "    'wake me at 6am' → cron_add 0 6 * * * | <message>\n"
             "    'every monday at 9:30am' → cron_add 30 9 * * 1 | <message>\n"
             "  Wildcard * means 'any', weekday: 0=Sun, 1=Mon, ..., 6=Sat\n"
-            "- Max " + String(REACT_MAX_ITERATIONS) + " thinking cycles\n\n"
-            "Your tools:";
+            "- Max " + String(REACT_MAX_ITERATIONS) + " thinking cycles\n";
+  if (!native_tools) {
+    prompt += "\nYour tools:";
+  }
   return prompt;
 }
 
@@ -192,44 +132,121 @@ String build_react_system_prompt() {
 
 struct ReactStep {
   String thought;
-  String action;
-  String tool_result;
+  String actions[REACT_MAX_PARALLEL_ACTIONS];
+  String results[REACT_MAX_PARALLEL_ACTIONS];
+  int action_count;
   bool is_final_answer;  // true if this step contains ANSWER
 };
 
+// One lookup handed to the worker pool; lives on the agent task's stack until
+// its done semaphore is given.
+struct ToolJob {
+  String command;
+  String result;
+  bool ok;
+  SemaphoreHandle_t done;
+};
+
+QueueHandle_t g_tool_jobs = nullptr;
+
+void tool_worker_code(void *param) {
+  ToolJob *job = nullptr;
+  while (true) {
+    if (xQueueReceive(g_tool_jobs, &job, portMAX_DELAY) == pdTRUE && job != nullptr) {
+      job->ok = tool_registry_execute_lookup(job->command, job->result);
+      xSemaphoreGive(job->done);
+    }
+  }
+}
+
+void start_tool_workers() {
+  if (g_tool_jobs != nullptr || REACT_TOOL_WORKERS <= 0) {
+    return;
+  }
+  g_tool_jobs = xQueueCreate(REACT_MAX_PARALLEL_ACTIONS, sizeof(ToolJob *));
+  if (g_tool_jobs == nullptr) {
+    Serial.println("[ReAct] Tool worker queue alloc failed, running actions sequentially");
+    return;
+  }
+  for (int i = 0; i < REACT_TOOL_WORKERS; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "ReactTool%d", i);
+    TaskHandle_t task = nullptr;
+    xTaskCreatePinnedToCore(tool_worker_code, name, REACT_TOOL_WORKER_STACK, NULL, TASK_PRIO_AGENT,
+                            &task, TASK_CORE_APP);
+    metrics_register_task(task, REACT_TOOL_WORKER_STACK);
+  }
+}
+
 // ============================================================================
 // HELPER FUNCTIONS
 // ============================================================================
 
+// Dynamic skill descriptions (lazy-loaded names only)
+String build_skills_prompt() {
+  String skill_descs = skill_get_descriptions_for_react();
+  if (skill_descs.length() == 0) {
+    return "";
+  }
+  return "\n\nAvailable Skills (use with use_skill):\n" + skill_descs;
+}
+
 // Build the tools section of the system prompt
 String build_tools_prompt() {
   String tools_text;
   tools_text.reserve(2500);
 
-  for (size_t i = 0; i < s_num_tools; i++) {
-    const ReactTool &tool = s_react_tools[i];
-    char buffer[256];
-    snprintf(buffer, sizeof(buffer), "\n%s: %s\n  Usage: %s\n  Example: %s",
-             tool.name, tool.description, tool.parameters, tool.example);
-    tools_text += buffer;
-  }
+  // Tool names, usage and examples come from the command table
+  tool_registry_append_react_tools(tools_text);
+  tools_text += build_skills_prompt();
+  return tools_text;
+}
 
-  // Append dynamic skill descriptions (lazy-loaded names only)
-  String skill_descs = skill_get_descriptions_for_react();
-  if (skill_descs.length() > 0) {
-    tools_text += "\n\nAvailable Skills (use with use_skill):\n";
-    tools_text += skill_descs;
+// Native tool definitions, one per ReAct tool of the command table. Built once
+// at init; llm_client serialises them for the active provider.
+LlmToolSpec *g_tool_specs = nullptr;
+size_t g_tool_spec_count = 0;
+
+struct ToolSpecFill {
+  size_t count;
+  LlmToolSpec *specs;
+};
+
+void collect_tool_spec(const char *name, const char *summary, const char *usage, void *ctx) {
+  ToolSpecFill &fill = *(ToolSpecFill *)ctx;
+  // Providers only take [A-Za-z0-9_-] names; multi-word aliases stay text-only
+  if (strchr(name, ' ') != nullptr) {
+    return;
+  }
+  if (fill.specs != nullptr) {
+    fill.specs[fill.count] = {name, summary, usage};
   }
+  fill.count++;
+}
 
-  return tools_text;
+void build_tool_specs() {
+  ToolSpecFill fill = {0, nullptr};
+  tool_registry_for_each_react_tool(collect_tool_spec, &fill);
+  g_tool_specs = new (std::nothrow) LlmToolSpec[fill.count];
+  if (g_tool_specs == nullptr) {
+    Serial.println("[ReAct] Tool spec alloc failed, using the text protocol only");
+    return;
+  }
+  g_tool_spec_count = fill.count;
+  fill = {0, g_tool_specs};
+  tool_registry_for_each_react_tool(collect_tool_spec, &fill);
+  llm_set_tool_specs(g_tool_specs, g_tool_spec_count);
 }
 
-// Parse ReAct response to extract THINK, DO, or ANSWER
+// Parse ReAct response to extract THINK, DO(s), or ANSWER
 bool parse_react_response(const String &response, ReactStep &step, String &error) {
   step.is_final_answer = false;
   step.thought = "";
-  step.action = "";
-  step.tool_result = "";
+  step.action_count = 0;
+  for (int i = 0; i < REACT_MAX_PARALLEL_ACTIONS; i++) {
+    step.actions[i] = "";
+    step.results[i] = "";
+  }
 
   String resp = response;
   resp.trim();
@@ -272,44 +289,46 @@ bool parse_react_response(const String &response, ReactStep &step, String &error
     step.thought.trim();
   }
 
-  // Check for DO (also support ACTION for compatibility)
-  int do_pos = resp.indexOf("⚡");
-  if (do_pos >= 0) {
-    // Find next word after emoji
-    int do_start = resp.indexOf("DO:", do_pos);
-    if (do_start < 0) {
-      do_start = resp.indexOf("ACTION:", do_pos);
+  // Every "⚡ DO:" line (or bare "ACTION:" line for compatibility) is one action
+  int line_start = 0;
+  while (line_start < (int)resp.length() && step.action_count < REACT_MAX_PARALLEL_ACTIONS) {
+    int line_end = resp.indexOf("\n", line_start);
+    if (line_end < 0) {
+      line_end = resp.length();
     }
-    if (do_start >= 0) {
-      int do_end = resp.indexOf("\n", do_start);
-      if (do_end < 0) {
-        do_end = resp.length();
+    String line = resp.substring(line_start, line_end);
+    line_start = line_end + 1;
+
+    int tag = -1;
+    int do_pos = line.indexOf("⚡");
+    if (do_pos >= 0) {
+      tag = line.indexOf("DO:", do_pos);
+      if (tag < 0) {
+        tag = line.indexOf("ACTION:", do_pos);
       }
-      int colon_pos = resp.indexOf(":", do_start);
-      step.action = resp.substring(colon_pos + 1, do_end);
-      step.action.trim();
-      return step.action.length() > 0;
     }
-  }
-
-  // Fallback: check for ACTION: directly
-  int action_pos = resp.indexOf("ACTION:");
-  if (action_pos >= 0) {
-    int action_end = resp.indexOf("\n", action_pos);
-    if (action_end < 0) {
-      action_end = resp.length();
+    if (tag < 0) {
+      tag = line.indexOf("ACTION:");
+    }
+    if (tag < 0) {
+      continue;
     }
-    step.action = resp.substring(action_pos + 7, action_end);
-    step.action.trim();
-    return step.action.length() > 0;
+    String action = line.substring(line.indexOf(":", tag) + 1);
+    action.trim();
+    if (action.length() > 0) {
+      step.actions[step.action_count++] = action;
+    }
+  }
+  if (step.action_count > 0) {
+    return true;
   }
 
   error = "Invalid ReAct format: missing DO/ACTION or ANSWER";
   return false;
 }
 
-// Execute an ACTION by calling the tool registry
-bool execute_tool_action(const String &action, String &result, String &error) {
+// Turn a DO line ("tool_name params") into a tool registry command
+String build_tool_command(const String &action) {
   String action_trimmed = action;
   action_trimmed.trim();
 
@@ -328,140 +347,196 @@ bool execute_tool_action(const String &action, String &result, String &error) {
   tool_name.trim();
   params.trim();
 
-  // Build command string for tool registry
   String command = tool_name;
   if (params.length() > 0) {
     command += " " + params;
   }
+  return command;
+}
 
-  event_log_append("[ReAct] Executing: " + command);
-
-  // Execute via tool registry
-  if (!tool_registry_execute(command, result)) {
-    error = "Tool not found or failed: " + tool_name;
-    return false;
+void finish_tool_result(bool ok, const String &command, String &result) {
+  if (!ok) {
+    int space_pos = command.indexOf(' ');
+    String tool_name = space_pos > 0 ? command.substring(0, space_pos) : command;
+    result = "ERROR: Tool not found or failed: " + tool_name;
+    Serial.println("[ReAct] Tool error: " + tool_name);
+    return;
   }
 
   // Truncate long responses
-  if (result.length() > REACT_TOOL_RESPONSE_MAX_CHARS) {
-    result = result.substring(0, REACT_TOOL_RESPONSE_MAX_CHARS) + "...(truncated)";
+  context_trim(result, REACT_TOOL_RESPONSE_MAX_TOKENS, false);
+  Serial.printf("[ReAct] Tool result: %s\n", result.substring(0, 80).c_str());
+}
+
+// Execute every action of a step. Lookups beyond the first go to the worker
+// pool while this task runs the rest, then all results are joined in order,
+// so a step costs roughly the slowest tool instead of the sum.
+void execute_tool_actions(ReactStep &step) {
+  ToolJob jobs[REACT_MAX_PARALLEL_ACTIONS];
+  bool queued[REACT_MAX_PARALLEL_ACTIONS] = {false};
+  String commands[REACT_MAX_PARALLEL_ACTIONS];
+  int dispatched = 0;
+
+  SemaphoreHandle_t done = nullptr;
+  if (step.action_count > 1 && g_tool_jobs != nullptr) {
+    done = xSemaphoreCreateCounting(REACT_MAX_PARALLEL_ACTIONS, 0);
   }
 
-  return true;
-}
+  for (int i = 0; i < step.action_count; i++) {
+    commands[i] = build_tool_command(step.actions[i]);
+    event_log_printf(EVT_REACT, "executing: %s", commands[i].c_str());
+    if (i == 0 || done == nullptr || !tool_registry_is_lookup(commands[i])) {
+      continue;
+    }
+    jobs[i].command = commands[i];
+    jobs[i].ok = false;
+    jobs[i].done = done;
+    ToolJob *job = &jobs[i];
+    if (xQueueSend(g_tool_jobs, &job, 0) == pdTRUE) {
+      queued[i] = true;
+      dispatched++;
+    }
+  }
+  if (dispatched > 0) {
+    Serial.printf("[ReAct] %d action(s) running in parallel\n", dispatched + 1);
+  }
 
-// Build context for LLM (previous steps)
-String build_react_context(const String &user_query, const ReactStep *steps,
-                           int step_count, const String &tools_prompt) {
-  String context;
-  context.reserve(6000);
+  for (int i = 0; i < step.action_count; i++) {
+    if (!queued[i]) {
+      const bool ok = tool_registry_execute(commands[i], step.results[i]);
+      finish_tool_result(ok, commands[i], step.results[i]);
+    }
+  }
 
-  context += build_react_system_prompt();
-  context += tools_prompt;
+  for (int i = 0; i < dispatched; i++) {
+    xSemaphoreTake(done, portMAX_DELAY);
+  }
+  for (int i = 0; i < step.action_count; i++) {
+    if (queued[i]) {
+      step.results[i] = jobs[i].result;
+      finish_tool_result(jobs[i].ok, commands[i], step.results[i]);
+    }
+  }
+  if (done != nullptr) {
+    vSemaphoreDelete(done);
+  }
+}
 
-  // Add recent chat history for context
+// Opening user turn of the ReAct chat: memory notes, time, recent history and
+// the query. Built once per run; later iterations only append turns, so the
+// budget holds room for their tool results up front (results_tokens_out).
+String build_react_opening(const String &user_query, const String &system_prompt,
+                           size_t &results_tokens_out) {
+  const size_t kMaxHistoryTokens = 500;
+  const size_t kMaxNotesTokens = 100;
+
+  String notes;
+  String mem_err;
+  // The notes are the owner's; team chats never see them.
+  if (chat_scope_is_owner(chat_scope_current()) && memory_get_notes(notes, mem_err)) {
+    notes.trim();
+  }
   String history;
   String history_err;
   if (chat_history_get(history, history_err)) {
     history.trim();
-    if (history.length() > 0) {
-      context += "\n\n=== Recent Chat History ===\n";
-      context += history;
-      context += "\n";
-    }
   }
+  const String time_ctx = build_react_time_context();
+  String query = user_query;
+
+  ContextBudget budget("react");
+  budget.reserve(system_prompt);
+  budget.reserve(time_ctx);
+  budget.add("query", query, CTX_PRIO_QUERY, ContextBudget::kAll, ContextBudget::kAll);
+  const int results = budget.hold("tool results", REACT_TOOL_RESULTS_BUDGET_TOKENS,
+                                  CTX_PRIO_TOOL_RESULTS, REACT_TOOL_RESPONSE_MAX_TOKENS);
+  budget.add("history", history, CTX_PRIO_HISTORY, kMaxHistoryTokens, 0, true);
+  budget.add("memory notes", notes, CTX_PRIO_MEMORY, kMaxNotesTokens, 0, true);
+  budget.fit();
+  results_tokens_out = budget.granted(results);
 
-  context += "\n=== Current Conversation ===\n";
-  context += "👤 User: " + user_query + "\n\n";
-
-  // Add previous steps
-  for (int i = 0; i < step_count; i++) {
-    context += "🤔 THINK: " + steps[i].thought + "\n";
-    if (steps[i].is_final_answer) {
-      context += "✅ ANSWER: " + steps[i].thought + "\n";
-    } else {
-      context += "⚡ DO: " + steps[i].action + "\n";
-      // Truncate long tool results (especially search) to avoid overwhelming LLM
-      String result = steps[i].tool_result;
-      if (result.length() > 800) {
-        result = result.substring(0, 800) + "...[truncated]";
-      }
-      context += "📊 Result: " + result + "\n\n";
-    }
+  String context;
+  context.reserve(2000);
+  if (notes.length() > 0) {
+    context += "Persistent memory:\n" + notes + "\n\n";
   }
 
-  context += "\nYour next response:";
-
-  return context;
-}
+  context += time_ctx;
 
-}  // namespace
+  // Add recent chat history for context
+  if (history.length() > 0) {
+    context += "\n\n=== Recent Chat History ===\n";
+    context += history;
+    context += "\n";
+  }
 
-// ============================================================================
-// PUBLIC API
-// ============================================================================
+  context += "\n=== Current Conversation ===\n";
+  context += "👤 User: " + query + "\n\nYour next response:";
 
-void react_agent_init() {
-  Serial.println("[ReAct] Agent initialized with " + String(s_num_tools) + " tools");
+  return context;
 }
 
-bool react_agent_should_use(const String &query) {
-  // Use ReAct for complex queries that suggest multi-step reasoning
-  String lc = query;
-  lc.toLowerCase();
-
-  // Check if query matches a skill (explicit or keyword-based)
-  String matched_skill = skill_match(lc);
-  if (matched_skill.length() > 0) {
-    Serial.println("[ReAct] Skill matched: " + matched_skill);
-    return true;
+// Assistant turn for a step, in the same THINK/DO form the model is asked for.
+String format_step_turn(const ReactStep &step) {
+  String turn = "🤔 THINK: " + step.thought + "\n";
+  for (int a = 0; a < step.action_count; a++) {
+    turn += "⚡ DO: " + step.actions[a] + "\n";
   }
+  return turn;
+}
 
-  // Keywords that suggest multi-step reasoning OR web generation
-  const char *complex_keywords[] = {
-      "how do i", "help me", "what should", "can you", "i need to",
-      "remember to", "set up", "configure", "schedule", "remind ", "remind me to",
-      "in 1 ", "in 2 ", "in 3 ", "in 4 ", "in 5 ", "in 10 ", "in 15 ", "in 20 ", "in 30 ",
-      "figure out", "find out", "check if", "make sure", "todo", "task",
-      "plan", "organize", "track",
-      // Search/info triggers
-      "what is", "what's", "who is", "who's", "tell me about", "search for",
-      "look up", "google", "explain", "define", "meaning of",
-      // Web generation triggers
-      "make a", "create a", "generate a", "build a", "website", "html",
-      "saas", "landing page", "portfolio", "app", "web app",
-      // Email triggers
-      "email me", "send email", "email those", "email the",
-      // WhatsApp triggers
-      "whatsapp", "send to whatsapp", "wa me", "via whatsapp",
-      // Skill triggers
-      "use skill", "use_skill", "skill"
-  };
-
-  for (size_t i = 0; i < sizeof(complex_keywords) / sizeof(complex_keywords[0]); i++) {
-    if (lc.indexOf(complex_keywords[i]) >= 0) {
-      return true;
+// Clip each result of a step to its share of what the run's tool-result
+// budget has left. Short of budget a result still keeps a few lines, marked
+// as truncated, rather than vanishing.
+void clip_step_results(ReactStep &step, size_t &results_left) {
+  const size_t kMinResultTokens = 40;
+  for (int a = 0; a < step.action_count; a++) {
+    size_t share = results_left / (size_t)(step.action_count - a);
+    if (share > REACT_TOOL_RESPONSE_MAX_TOKENS) {
+      share = REACT_TOOL_RESPONSE_MAX_TOKENS;
     }
+    if (share < kMinResultTokens) {
+      share = kMinResultTokens;
+    }
+    context_trim(step.results[a], share, false);
+    const size_t used = context_estimate_tokens(step.results[a]);
+    results_left = used < results_left ? results_left - used : 0;
   }
+}
 
-  return false;
+// User turn carrying a step's tool results back to the model.
+String format_results_turn(const ReactStep &step) {
+  String turn;
+  for (int a = 0; a < step.action_count; a++) {
+    turn += "📊 Result: " + step.results[a] + "\n";
+  }
+  turn += "\nYour next response:";
+  return turn;
 }
 
-bool react_agent_run(const String &user_query, String &response_out,
-                     String &error_out) {
-  ReactStep steps[REACT_MAX_ITERATIONS];
-  int step_count = 0;
-  String tools_prompt = build_tools_prompt();
-
-  Serial.println("[ReAct] Starting for: " + user_query);
+// Text protocol: the model writes THINK/DO/ANSWER lines that are parsed here.
+// Used for providers without native tool calling.
+// system_prompt is identical for every iteration, so providers can serve it
+// from prompt cache.
+bool run_text_protocol(const String &system_prompt, const String &opening, size_t results_left,
+                       String &response_out, String &error_out) {
+  // Opening user turn, then an assistant + results pair per step. Each
+  // iteration appends one pair instead of rebuilding the whole context.
+  LlmMessage messages[1 + 2 * REACT_MAX_ITERATIONS];
+  size_t message_count = 0;
+
+  messages[message_count].from_assistant = false;
+  messages[message_count].content = opening;
+  message_count++;
 
   for (int iter = 0; iter < REACT_MAX_ITERATIONS; iter++) {
-    // Build context with all previous steps
-    String context = build_react_context(user_query, steps, step_count, tools_prompt);
-
     // Call LLM
     String llm_response, llm_error;
-    if (!llm_generate_with_custom_prompt(context, "", true, llm_response, llm_error)) {
+    const uint32_t llm_span = trace_span_begin("react.llm");
+    const bool llm_ok =
+        llm_generate_chat(system_prompt, messages, message_count, llm_response, llm_error);
+    trace_span_end(llm_span);
+    if (!llm_ok) {
       error_out = "LLM call failed: " + llm_error;
       return false;
     }
@@ -486,34 +561,26 @@ bool react_agent_run(const String &user_query, String &response_out,
       return true;
     }
 
-    // Execute the action
-    String tool_result, tool_error;
-    if (!execute_tool_action(step.action, tool_result, tool_error)) {
-      // Tool execution failed - feed error back to LLM
-      step.tool_result = "ERROR: " + tool_error;
-      Serial.println("[ReAct] Tool error: " + tool_error);
-    } else {
-      step.tool_result = tool_result;
-      Serial.printf("[ReAct] Tool result: %s\n", tool_result.substring(0, 80).c_str());
-    }
-
-    steps[step_count++] = step;
-  }
-
-  // Max iterations reached - ask LLM for final summary
-  String summary_context = build_react_system_prompt() + build_tools_prompt() +
-      "\n\n=== Conversation ===\n👤 User: " + user_query + "\n\n";
-
-  for (int i = 0; i < step_count; i++) {
-    summary_context += "🤔 THINK: " + steps[i].thought + "\n";
-    summary_context += "⚡ DO: " + steps[i].action + "\n";
-    summary_context += "📊 Result: " + steps[i].tool_result + "\n\n";
+    // Execute the action(s); failures are fed back to the LLM as ERROR results
+    const uint32_t tools_span = trace_span_begin("react.tools");
+    execute_tool_actions(step);
+    trace_span_end(tools_span);
+    clip_step_results(step, results_left);
+
+    messages[message_count].from_assistant = true;
+    messages[message_count].content = format_step_turn(step);
+    message_count++;
+    messages[message_count].from_assistant = false;
+    messages[message_count].content = format_results_turn(step);
+    message_count++;
   }
 
-  summary_context += "\nMax thinking cycles reached. Give your final ✅ ANSWER:";
+  // Max iterations reached - ask LLM for final summary over the same turns
+  messages[message_count - 1].content += "\n\nMax thinking cycles reached. Give your final ✅ ANSWER:";
 
   String final_response, final_error;
-  if (llm_generate_with_custom_prompt(summary_context, "", true, final_response, final_error)) {
+  TraceScope summary_span("react.summary");
+  if (llm_generate_chat(system_prompt, messages, message_count, final_response, final_error)) {
     response_out = final_response;
   } else {
     response_out = "I need more iterations to complete this task. Try being more specific.";
@@ -521,3 +588,136 @@ bool react_agent_run(const String &user_query, String &response_out,
 
   return true;
 }
+
+// Native tool calling: tools go out as provider function definitions and the
+// calls come back structured, so there is nothing to parse. Sets fall_back
+// when the first request fails, e.g. a model that rejects tool definitions.
+bool run_native_tools(const String &system_prompt, const String &opening, size_t results_left,
+                      String &response_out, String &error_out, bool &fall_back) {
+  fall_back = false;
+  LlmToolTurn turns[1 + REACT_MAX_ITERATIONS];
+  size_t turn_count = 0;
+
+  turns[0].text = opening;
+  turns[0].call_count = 0;
+  turn_count = 1;
+
+  for (int iter = 0; iter < REACT_MAX_ITERATIONS; iter++) {
+    LlmToolTurn &turn = turns[turn_count];
+    String llm_error;
+    const uint32_t llm_span = trace_span_begin("react.llm");
+    const bool llm_ok = llm_generate_tool_step(system_prompt, turns, turn_count, turn, llm_error);
+    trace_span_end(llm_span);
+    if (!llm_ok) {
+      // A request the provider rejects (model without tool support, schema
+      // it does not accept) is worth one text-protocol run; network errors
+      // and rate limits would fail the same way there.
+      fall_back = iter == 0 && (llm_error.indexOf("HTTP 400") >= 0 ||
+                                llm_error.indexOf("HTTP 404") >= 0 ||
+                                llm_error.indexOf("HTTP 422") >= 0 ||
+                                llm_error.indexOf("parse") >= 0);
+      error_out = "LLM call failed: " + llm_error;
+      return false;
+    }
+
+    Serial.printf("[ReAct] Iteration %d: %u tool call(s), text: %s\n", iter + 1,
+                  (unsigned)turn.call_count, turn.text.substring(0, 100).c_str());
+    if (turn.call_count == 0) {
+      response_out = turn.text;
+      Serial.println("[ReAct] Final answer received");
+      return true;
+    }
+
+    // Same parallel executor as the text protocol; calls past
+    // REACT_MAX_PARALLEL_ACTIONS get an error result instead
+    ReactStep step;
+    step.is_final_answer = false;
+    step.action_count = 0;
+    for (size_t c = 0; c < turn.call_count && step.action_count < REACT_MAX_PARALLEL_ACTIONS; c++) {
+      const LlmToolCall &call = turn.calls[c];
+      step.actions[step.action_count++] =
+          call.args.length() > 0 ? call.name + " " + call.args : call.name;
+    }
+    const uint32_t tools_span = trace_span_begin("react.tools");
+    execute_tool_actions(step);
+    trace_span_end(tools_span);
+    clip_step_results(step, results_left);
+    for (size_t c = 0; c < turn.call_count; c++) {
+      turn.calls[c].result = (int)c < step.action_count
+                                 ? step.results[c]
+                                 : String("ERROR: too many parallel calls, send it again");
+    }
+    turn_count++;
+  }
+
+  // Max iterations reached - ask for the final answer over the same turns
+  LlmToolTurn &last = turns[turn_count - 1];
+  last.calls[last.call_count - 1].result +=
+      "\n\nMax thinking cycles reached. Answer the user now without calling tools.";
+  LlmToolTurn final_turn;
+  String final_error;
+  TraceScope summary_span("react.summary");
+  if (llm_generate_tool_step(system_prompt, turns, turn_count, final_turn, final_error) &&
+      final_turn.text.length() > 0) {
+    response_out = final_turn.text;
+  } else {
+    response_out = "I need more iterations to complete this task. Try being more specific.";
+  }
+  return true;
+}
+
+}  // namespace
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+void react_agent_init() {
+  g_complex_keywords.clear();
+  for (size_t i = 0; i < sizeof(kComplexKeywords) / sizeof(kComplexKeywords[0]); i++) {
+    g_complex_keywords.add(kComplexKeywords[i], 1);
+  }
+  g_complex_keywords.build();
+  start_tool_workers();
+  build_tool_specs();
+  Serial.println("[ReAct] Agent initialized, tools prompt " + String(build_tools_prompt().length()) +
+                 " chars, " + String(g_tool_spec_count) + " native tool definitions");
+}
+
+bool react_agent_should_use(const String &query) {
+  // Use ReAct for complex queries that suggest multi-step reasoning
+
+  // Check if query matches a skill (explicit or keyword-based)
+  String matched_skill = skill_match(query);
+  if (matched_skill.length() > 0) {
+    Serial.println("[ReAct] Skill matched: " + matched_skill);
+    return true;
+  }
+
+  return g_complex_keywords.match(query) != 0;
+}
+
+bool react_agent_run(const String &user_query, String &response_out,
+                     String &error_out) {
+  Serial.println("[ReAct] Starting for: " + user_query);
+  const bool native = llm_native_tools_available();
+  String system_prompt = native ? build_react_system_prompt(true) + build_skills_prompt()
+                                : build_react_system_prompt(false) + build_tools_prompt();
+  size_t results_tokens = 0;
+  const String opening = build_react_opening(user_query, system_prompt, results_tokens);
+
+  if (native) {
+    bool fall_back = false;
+    if (run_native_tools(system_prompt, opening, results_tokens, response_out, error_out,
+                         fall_back)) {
+      return true;
+    }
+    if (!fall_back) {
+      return false;
+    }
+    Serial.println("[ReAct] Native tool call failed (" + error_out + "), using text protocol");
+    error_out = "";
+    system_prompt = build_react_system_prompt(false) + build_tools_prompt();
+  }
+  return run_text_protocol(system_prompt, opening, results_tokens, response_out, error_out);
+}
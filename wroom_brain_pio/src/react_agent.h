@@ -8,23 +8,38 @@
 #define REACT_MAX_ITERATIONS 5
 #endif
 
-// Maximum tokens for tool responses
-#ifndef REACT_TOOL_RESPONSE_MAX_CHARS
-#define REACT_TOOL_RESPONSE_MAX_CHARS 600
+// Ceiling per tool result in estimated tokens; results get less when the
+// run's tool-result budget below is running out
+#ifndef REACT_TOOL_RESPONSE_MAX_TOKENS
+#define REACT_TOOL_RESPONSE_MAX_TOKENS 150
 #endif
 
-// Tool definition for ReAct
-struct ReactTool {
-  const char *name;           // Tool identifier (e.g., "task_add")
-  const char *description;    // What the tool does
-  const char *parameters;     // Parameter format (e.g., "<task_text>")
-  const char *example;        // Example usage
-};
+// Share of the context budget held for tool results across one run; recent
+// history and memory notes in the opening turn are trimmed to make room
+#ifndef REACT_TOOL_RESULTS_BUDGET_TOKENS
+#define REACT_TOOL_RESULTS_BUDGET_TOKENS 900
+#endif
+
+// Independent actions the model may request in one step
+#ifndef REACT_MAX_PARALLEL_ACTIONS
+#define REACT_MAX_PARALLEL_ACTIONS 3
+#endif
+
+// Worker tasks that run lookup actions alongside the agent task (0 = sequential)
+#ifndef REACT_TOOL_WORKERS
+#define REACT_TOOL_WORKERS 2
+#endif
+
+// Stack per tool worker (TLS lookups plus the search summary LLM call)
+#ifndef REACT_TOOL_WORKER_STACK
+#define REACT_TOOL_WORKER_STACK 12288
+#endif
 
 // Initialize ReAct agent with tool registry
 void react_agent_init();
 
-// Run ReAct loop for a user query
+// Run ReAct loop for a user query. Uses provider-native tool calling when the
+// active provider has it (see LLM_NATIVE_TOOLS_ENABLED), else the text protocol.
 // Returns true if successful, false on error
 // response_out contains the final answer or error message
 bool react_agent_run(const String &user_query, String &response_out, String &error_out);
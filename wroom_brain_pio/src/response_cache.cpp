@@ -0,0 +1,382 @@
+#include "response_cache.h"
+
+#include <Arduino.h>
+#include <freertos/semphr.h>
+#include <time.h>
+
+#include "brain_config.h"
+#if RESPONSE_CACHE_SPILL
+#include "flash_fs.h"
+#endif
+
+namespace {
+
+struct Entry {
+  uint64_t key;
+  uint32_t stored_ms;
+  uint32_t ttl_ms;
+  uint32_t last_used_ms;
+  String value;
+  bool used;
+};
+
+Entry g_entries[RESPONSE_CACHE_ENTRIES];
+size_t g_bytes = 0;
+uint32_t g_hits = 0;
+uint32_t g_misses = 0;
+uint32_t g_spill_hits = 0;
+uint32_t g_evictions = 0;
+SemaphoreHandle_t g_lock = nullptr;
+
+bool lock() {
+  return g_lock != nullptr && xSemaphoreTake(g_lock, portMAX_DELAY) == pdTRUE;
+}
+
+void unlock() {
+  xSemaphoreGive(g_lock);
+}
+
+bool expired(const Entry &e, uint32_t now) {
+  return (uint32_t)(now - e.stored_ms) >= e.ttl_ms;
+}
+
+void drop(Entry &e) {
+  g_bytes -= e.value.length();
+  e.value = String();
+  e.used = false;
+}
+
+uint64_t fnv1a(uint64_t h, const char *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    h ^= (uint8_t)data[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+#if RESPONSE_CACHE_SPILL
+// Spill records: header then value bytes. Expiry is wall-clock time so
+// records stay valid across reboots; nothing is spilled before NTP sync.
+struct SpillHeader {
+  uint64_t key;
+  uint32_t expires_at;
+  uint32_t len;
+};
+
+bool wall_clock(uint32_t &now_out) {
+  const time_t now = time(nullptr);
+  if (now < 1700000000) {
+    return false;
+  }
+  now_out = (uint32_t)now;
+  return true;
+}
+
+// Rewrite the spill file without expired records; drop it entirely when the
+// live records alone would still fill more than half the budget.
+void spill_compact(uint32_t now) {
+  File in = FLASH_FS.open(RESPONSE_CACHE_SPILL_PATH, FILE_READ);
+  if (!in) {
+    return;
+  }
+  const String tmp_path = String(RESPONSE_CACHE_SPILL_PATH) + ".tmp";
+  File out = FLASH_FS.open(tmp_path, FILE_WRITE);
+  if (!out) {
+    in.close();
+    FLASH_FS.remove(RESPONSE_CACHE_SPILL_PATH);
+    return;
+  }
+
+  uint8_t buf[256];
+  SpillHeader h;
+  while (in.read((uint8_t *)&h, sizeof(h)) == sizeof(h)) {
+    const bool keep = h.expires_at > now;
+    if (keep) {
+      out.write((const uint8_t *)&h, sizeof(h));
+    }
+    size_t left = h.len;
+    while (left > 0) {
+      const size_t n = in.read(buf, left < sizeof(buf) ? left : sizeof(buf));
+      if (n == 0) {
+        break;
+      }
+      if (keep) {
+        out.write(buf, n);
+      }
+      left -= n;
+    }
+  }
+  const size_t kept = out.size();
+  in.close();
+  out.close();
+
+  FLASH_FS.remove(RESPONSE_CACHE_SPILL_PATH);
+  if (kept > RESPONSE_CACHE_SPILL_BYTES / 2) {
+    FLASH_FS.remove(tmp_path);
+  } else {
+    FLASH_FS.rename(tmp_path, RESPONSE_CACHE_SPILL_PATH);
+  }
+}
+
+void spill_write(const Entry &e, uint32_t now_ms) {
+  uint32_t now;
+  if (!wall_clock(now) || !flash_fs_begin()) {
+    return;
+  }
+  const uint32_t left_ms = e.ttl_ms - (uint32_t)(now_ms - e.stored_ms);
+  if (left_ms < 60000UL) {
+    return;
+  }
+
+  const size_t record = sizeof(SpillHeader) + e.value.length();
+  File probe = FLASH_FS.open(RESPONSE_CACHE_SPILL_PATH, FILE_READ);
+  const size_t current = probe ? probe.size() : 0;
+  if (probe) {
+    probe.close();
+  }
+  if (current + record > RESPONSE_CACHE_SPILL_BYTES) {
+    spill_compact(now);
+  }
+
+  flash_fs_mkdirs(RESPONSE_CACHE_SPILL_PATH);
+  File f = FLASH_FS.open(RESPONSE_CACHE_SPILL_PATH, FILE_APPEND);
+  if (!f) {
+    return;
+  }
+  const SpillHeader h = {e.key, now + left_ms / 1000, (uint32_t)e.value.length()};
+  f.write((const uint8_t *)&h, sizeof(h));
+  f.write((const uint8_t *)e.value.c_str(), e.value.length());
+  f.close();
+}
+
+// Latest unexpired record for key; ttl_left_ms_out is what remains of its TTL.
+bool spill_read(uint64_t key, String &value_out, uint32_t &ttl_left_ms_out) {
+  uint32_t now;
+  if (!wall_clock(now) || !flash_fs_begin()) {
+    return false;
+  }
+  File f = FLASH_FS.open(RESPONSE_CACHE_SPILL_PATH, FILE_READ);
+  if (!f) {
+    return false;
+  }
+
+  bool found = false;
+  uint32_t found_at = 0;
+  SpillHeader found_h = {};
+  SpillHeader h;
+  while (f.read((uint8_t *)&h, sizeof(h)) == sizeof(h)) {
+    const uint32_t value_at = (uint32_t)f.position();
+    if (h.key == key && h.expires_at > now) {
+      found = true;
+      found_at = value_at;
+      found_h = h;
+    }
+    if (!f.seek(value_at + h.len)) {
+      break;
+    }
+  }
+
+  if (found && f.seek(found_at)) {
+    value_out = "";
+    value_out.reserve(found_h.len);
+    char buf[256];
+    size_t left = found_h.len;
+    while (left > 0) {
+      const size_t n = f.read((uint8_t *)buf, left < sizeof(buf) ? left : sizeof(buf));
+      if (n == 0) {
+        break;
+      }
+      value_out.concat(buf, n);
+      left -= n;
+    }
+    found = left == 0;
+    ttl_left_ms_out = (found_h.expires_at - now) * 1000UL;
+  }
+  f.close();
+  return found;
+}
+#endif
+
+// Slot for a new entry of len chars: an empty or expired one, else the least
+// recently used. Evicts until the RAM budget fits. Caller holds g_lock.
+Entry *make_room(size_t len, uint32_t now) {
+  for (size_t i = 0; i < RESPONSE_CACHE_ENTRIES; i++) {
+    if (g_entries[i].used && expired(g_entries[i], now)) {
+      drop(g_entries[i]);
+    }
+  }
+
+  Entry *slot = nullptr;
+  while (true) {
+    Entry *lru = nullptr;
+    slot = nullptr;
+    for (size_t i = 0; i < RESPONSE_CACHE_ENTRIES; i++) {
+      Entry &e = g_entries[i];
+      if (!e.used) {
+        slot = slot ? slot : &e;
+      } else if (!lru || (uint32_t)(now - e.last_used_ms) > (uint32_t)(now - lru->last_used_ms)) {
+        lru = &e;
+      }
+    }
+    if (slot && g_bytes + len <= RESPONSE_CACHE_MAX_BYTES) {
+      return slot;
+    }
+    if (!lru) {
+      return nullptr;
+    }
+#if RESPONSE_CACHE_SPILL
+    spill_write(*lru, now);
+#endif
+    drop(*lru);
+    g_evictions++;
+  }
+}
+
+void put_locked(uint64_t key, const String &value, uint32_t ttl_ms, uint32_t now) {
+  for (size_t i = 0; i < RESPONSE_CACHE_ENTRIES; i++) {
+    if (g_entries[i].used && g_entries[i].key == key) {
+      drop(g_entries[i]);
+    }
+  }
+  Entry *e = make_room(value.length(), now);
+  if (!e) {
+    return;
+  }
+  e->key = key;
+  e->stored_ms = now;
+  e->ttl_ms = ttl_ms;
+  e->last_used_ms = now;
+  e->value = value;
+  e->used = true;
+  g_bytes += value.length();
+}
+
+}  // namespace
+
+void response_cache_init() {
+  if (g_lock == nullptr) {
+    g_lock = xSemaphoreCreateMutex();
+  }
+}
+
+uint64_t response_cache_key(const char *kind, const String &a, const String &b, const String &c,
+                            const String &d) {
+  const char sep = '\0';
+  uint64_t h = 14695981039346656037ULL;
+  h = fnv1a(h, kind, strlen(kind));
+  const String *parts[] = {&a, &b, &c, &d};
+  for (size_t i = 0; i < 4; i++) {
+    h = fnv1a(h, &sep, 1);
+    h = fnv1a(h, parts[i]->c_str(), parts[i]->length());
+  }
+  return h;
+}
+
+String response_cache_normalize(const String &text) {
+  String out;
+  out.reserve(text.length());
+  bool space = false;
+  for (size_t i = 0; i < text.length(); i++) {
+    const char c = text[i];
+    if (isspace((unsigned char)c)) {
+      space = out.length() > 0;
+      continue;
+    }
+    if (space) {
+      out += ' ';
+      space = false;
+    }
+    out += (char)tolower((unsigned char)c);
+  }
+  return out;
+}
+
+bool response_cache_get(uint64_t key, String &value_out) {
+  if (!lock()) {
+    return false;
+  }
+  const uint32_t now = millis();
+  for (size_t i = 0; i < RESPONSE_CACHE_ENTRIES; i++) {
+    Entry &e = g_entries[i];
+    if (!e.used || e.key != key) {
+      continue;
+    }
+    if (expired(e, now)) {
+      drop(e);
+      break;
+    }
+    e.last_used_ms = now;
+    value_out = e.value;
+    g_hits++;
+    unlock();
+    return true;
+  }
+
+#if RESPONSE_CACHE_SPILL
+  uint32_t ttl_left_ms = 0;
+  if (spill_read(key, value_out, ttl_left_ms)) {
+    g_hits++;
+    g_spill_hits++;
+    if (value_out.length() <= RESPONSE_CACHE_MAX_VALUE_CHARS) {
+      put_locked(key, value_out, ttl_left_ms, now);
+    }
+    unlock();
+    return true;
+  }
+#endif
+
+  g_misses++;
+  unlock();
+  return false;
+}
+
+void response_cache_put(uint64_t key, const String &value, uint32_t ttl_ms) {
+  if (ttl_ms == 0 || value.length() == 0 || value.length() > RESPONSE_CACHE_MAX_VALUE_CHARS) {
+    return;
+  }
+  if (!lock()) {
+    return;
+  }
+  put_locked(key, value, ttl_ms, millis());
+  unlock();
+}
+
+void response_cache_clear() {
+  if (!lock()) {
+    return;
+  }
+  for (size_t i = 0; i < RESPONSE_CACHE_ENTRIES; i++) {
+    if (g_entries[i].used) {
+      drop(g_entries[i]);
+    }
+  }
+#if RESPONSE_CACHE_SPILL
+  if (flash_fs_begin()) {
+    FLASH_FS.remove(RESPONSE_CACHE_SPILL_PATH);
+  }
+#endif
+  unlock();
+}
+
+void response_cache_describe(String &out) {
+  size_t count = 0;
+  size_t bytes = 0;
+  uint32_t hits = 0, misses = 0, spill_hits = 0, evictions = 0;
+  if (lock()) {
+    for (size_t i = 0; i < RESPONSE_CACHE_ENTRIES; i++) {
+      if (g_entries[i].used) {
+        count++;
+      }
+    }
+    bytes = g_bytes;
+    hits = g_hits;
+    misses = g_misses;
+    spill_hits = g_spill_hits;
+    evictions = g_evictions;
+    unlock();
+  }
+  out = "Response cache: " + String(count) + "/" + String(RESPONSE_CACHE_ENTRIES) +
+        " entries, " + String(bytes) + " bytes, " + String(hits) + " hits (" +
+        String(spill_hits) + " from flash), " + String(misses) + " misses, " +
+        String(evictions) + " evicted";
+}
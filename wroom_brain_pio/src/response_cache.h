@@ -0,0 +1,29 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <Arduino.h>
+
+// Short-lived cache of finished answers (LLM replies, weather, web search)
+// keyed by a 64-bit hash of everything that determines them. Entries live in
+// RAM with a per-entry TTL; with RESPONSE_CACHE_SPILL, entries pushed out
+// before they expire are kept in a flash file until their TTL runs out.
+
+void response_cache_init();
+
+// Hash of kind plus up to four parts. Parts are separated in the hash, so
+// ("ab", "c") and ("a", "bc") give different keys.
+uint64_t response_cache_key(const char *kind, const String &a, const String &b = "",
+                            const String &c = "", const String &d = "");
+
+// Lowercase, trimmed, whitespace runs collapsed: for tool arguments.
+String response_cache_normalize(const String &text);
+
+bool response_cache_get(uint64_t key, String &value_out);
+void response_cache_put(uint64_t key, const String &value, uint32_t ttl_ms);
+
+void response_cache_clear();
+
+// "Response cache: n entries, hits/misses ..." for diagnostics
+void response_cache_describe(String &out);
+
+#endif
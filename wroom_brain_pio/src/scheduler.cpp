@@ -7,10 +7,18 @@
 
 #include "brain_config.h"
 #include "event_log.h"
+#include "metrics.h"
 #include "persona_store.h"
+#include "power_mgr.h"
 #include "cron_store.h"
+#include "task_store.h"
+#include "wifi_link.h"
 
-// Forward declaration for missed job callback
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+// Where due schedule entries are sent; set by scheduler_start()
 static incoming_cb_t s_dispatch_cb = nullptr;
 
 static unsigned long s_next_status_ms = 0;
@@ -19,13 +27,42 @@ static unsigned long s_next_proactive_ms = 0;
 static bool s_time_configured = false;
 static String s_last_tz = "";
 static long s_last_tz_offset_seconds = 0;
+// ensure_time_configured() runs on the scheduler task and on agent workers;
+// this covers the TZ environment, s_last_tz and the localtime_r() calls that
+// read TZ.
+static SemaphoreHandle_t s_tz_lock = nullptr;
+
+static void tz_lock() {
+  if (s_tz_lock != nullptr) {
+    xSemaphoreTake(s_tz_lock, portMAX_DELAY);
+  }
+}
+
+static void tz_unlock() {
+  if (s_tz_lock != nullptr) {
+    xSemaphoreGive(s_tz_lock);
+  }
+}
 
 // Cron job tracking
-static unsigned long s_next_cron_check_ms = 0;
-static int s_last_cron_minute = -1;
 static bool s_checked_missed_jobs = false;  // Track if we've checked for missed jobs
-static unsigned long s_next_reminder_check_ms = 0;
-static int s_last_reminder_minute = -1;
+static time_t s_last_check_saved = 0;        // epoch last written to cron_lastcheck.txt
+
+// Daily reminder, compiled like a cron job; reloaded when a schedule changes
+static CronSchedule s_reminder_schedule;
+static bool s_reminder_set = false;
+static time_t s_reminder_next = 0;
+static volatile bool s_reminder_dirty = true;
+
+// One-shot commands (cron_add in/at), RAM only
+struct OneShot {
+  time_t due;  // 0 when the slot is free
+  String command;
+};
+static OneShot s_oneshots[SCHEDULER_MAX_ONESHOTS];
+static SemaphoreHandle_t s_oneshot_lock = nullptr;
+
+static TaskHandle_t s_task = nullptr;
 
 static String to_lower_copy(String value) {
   value.toLowerCase();
@@ -159,12 +196,10 @@ static bool parse_hhmm(const String &value, int &hour_out, int &minute_out) {
   return true;
 }
 
-static void check_daily_reminder(incoming_cb_t dispatch_cb, const struct tm &tm_now) {
-  const int current_minute = tm_now.tm_hour * 60 + tm_now.tm_min;
-  if (current_minute == s_last_reminder_minute) {
-    return;
-  }
-  s_last_reminder_minute = current_minute;
+static void load_daily_reminder() {
+  s_reminder_dirty = false;
+  s_reminder_set = false;
+  s_reminder_next = 0;
 
   String hhmm;
   String message;
@@ -179,17 +214,32 @@ static void check_daily_reminder(incoming_cb_t dispatch_cb, const struct tm &tm_
     return;
   }
 
-  int target_hour = -1;
-  int target_minute = -1;
-  if (!parse_hhmm(hhmm, target_hour, target_minute)) {
+  CronJob job;
+  if (!parse_hhmm(hhmm, job.hour, job.minute)) {
     return;
   }
+  cron_compile(job, s_reminder_schedule);
+  s_reminder_set = true;
+}
 
-  if (tm_now.tm_hour == target_hour && tm_now.tm_min == target_minute) {
-    event_log_append("SCHED: reminder_run " + hhmm);
-    dispatch_cb(String("reminder_run"));
-    Serial.printf("[scheduler] Daily reminder triggered at %s\n", hhmm.c_str());
+static void run_daily_reminder(incoming_cb_t dispatch_cb, time_t now) {
+  if (s_reminder_dirty) {
+    load_daily_reminder();
+  }
+  if (!s_reminder_set) {
+    return;
+  }
+  if (s_reminder_next == 0) {
+    s_reminder_next = cron_next_fire(s_reminder_schedule, now);
+    return;
+  }
+  if (s_reminder_next > now) {
+    return;
   }
+  s_reminder_next = cron_next_fire(s_reminder_schedule, now);
+  event_log_record(EVT_SCHED, "reminder_run");
+  dispatch_cb(String("reminder_run"));
+  Serial.println("[scheduler] Daily reminder triggered");
 }
 
 static long runtime_tz_offset_seconds() {
@@ -208,8 +258,9 @@ static long runtime_tz_offset_seconds() {
   return (long)difftime(local_epoch, utc_epoch);
 }
 
+// Caller holds s_tz_lock.
 static void ensure_time_configured() {
-  if (WiFi.status() != WL_CONNECTED) {
+  if (!wifi_link_ready()) {
     return;
   }
 
@@ -233,6 +284,9 @@ static void ensure_time_configured() {
 
   s_time_configured = true;
   s_last_tz = tz;
+  // Armed fire times were computed in the previous zone
+  cron_store_rearm();
+  s_reminder_dirty = true;
   long offset = runtime_tz_offset_seconds();
   if (offset == 0) {
     offset = resolve_tz_offset_seconds(tz);
@@ -242,13 +296,16 @@ static void ensure_time_configured() {
 }
 
 bool scheduler_get_local_time(struct tm &tm_out) {
+  tz_lock();
   ensure_time_configured();
   time_t now = time(nullptr);
   if (now < 1700000000) {
+    tz_unlock();
     return false;
   }
   localtime_r(&now, &tm_out);
   s_last_tz_offset_seconds = runtime_tz_offset_seconds();
+  tz_unlock();
   return true;
 }
 
@@ -276,7 +333,7 @@ static void check_missed_cron_jobs(incoming_cb_t dispatch_cb) {
                missed[i].missed_hour, missed[i].missed_minute);
 
       String msg = "🔄 Missed job from " + String(time_buf) + ": " + cmd;
-      event_log_append("SCHED: " + msg);
+      event_log_record(EVT_SCHED, msg.c_str());
       dispatch_cb(cmd);
 
       Serial.printf("[scheduler] Triggering missed job: %s\n", msg.c_str());
@@ -285,12 +342,17 @@ static void check_missed_cron_jobs(incoming_cb_t dispatch_cb) {
 
   // Update last check time to now
   cron_store_update_last_check(now);
+  s_last_check_saved = now;
   s_checked_missed_jobs = true;
 
   Serial.printf("[scheduler] Missed job check complete, found %d missed job(s)\n", missed_count);
 }
 
 void scheduler_init() {
+  if (s_tz_lock == nullptr) {
+    s_tz_lock = xSemaphoreCreateMutex();
+  }
+
   if (!AUTONOMOUS_STATUS_ENABLED) {
     Serial.println("[scheduler] autonomous status disabled");
   } else {
@@ -312,31 +374,101 @@ void scheduler_init() {
     Serial.println("[scheduler] proactive agent enabled (every " + String(PROACTIVE_INTERVAL_MS / 60000) + "m)");
   }
 
-  s_next_cron_check_ms = millis() + 5000;
-  s_next_reminder_check_ms = millis() + 5000;
   Serial.println("[scheduler] cron jobs enabled");
 }
 
-void scheduler_tick(incoming_cb_t dispatch_cb) {
-  if (dispatch_cb == nullptr) {
+// Milliseconds left until a millis()-based deadline, 0 once it has passed.
+static uint32_t ms_until(unsigned long deadline, unsigned long now) {
+  return (long)(deadline - now) > 0 ? (uint32_t)(deadline - now) : 0;
+}
+
+static uint32_t sleep_until_epoch(time_t due, time_t now, uint32_t sleep_ms) {
+  if (due == 0) {
+    return sleep_ms;
+  }
+  const uint32_t ms = due > now ? (uint32_t)(due - now) * 1000 : 0;
+  return ms < sleep_ms ? ms : sleep_ms;
+}
+
+static void run_oneshots(incoming_cb_t dispatch_cb, time_t now) {
+  String due[SCHEDULER_MAX_ONESHOTS];
+  int due_count = 0;
+  xSemaphoreTake(s_oneshot_lock, portMAX_DELAY);
+  for (int i = 0; i < SCHEDULER_MAX_ONESHOTS; i++) {
+    if (s_oneshots[i].due != 0 && s_oneshots[i].due <= now) {
+      due[due_count++] = s_oneshots[i].command;
+      s_oneshots[i].due = 0;
+      s_oneshots[i].command = "";
+    }
+  }
+  xSemaphoreGive(s_oneshot_lock);
+
+  for (int i = 0; i < due_count; i++) {
+    event_log_printf(EVT_SCHED, "one-shot: %s", due[i].c_str());
+    dispatch_cb(due[i]);
+    Serial.printf("[scheduler] One-shot triggered: %s\n", due[i].c_str());
+  }
+}
+
+// Open tasks whose due time has come; the index holds due times, so no
+// task text is read until one fires.
+static void run_task_reminders(incoming_cb_t dispatch_cb, time_t now) {
+#if ENABLE_TASKS
+  const time_t next = task_next_due();
+  if (next == 0 || next > now) {
     return;
   }
+  int ids[TASKS_MAX_RECORDS];
+  const size_t n = task_take_due(now, ids, TASKS_MAX_RECORDS);
+  for (size_t i = 0; i < n; i++) {
+    event_log_printf(EVT_SCHED, "task_remind %d", ids[i]);
+    dispatch_cb("task_remind " + String(ids[i]));
+  }
+#else
+  (void)dispatch_cb;
+  (void)now;
+#endif
+}
 
+static time_t next_oneshot() {
+  time_t next = 0;
+  xSemaphoreTake(s_oneshot_lock, portMAX_DELAY);
+  for (int i = 0; i < SCHEDULER_MAX_ONESHOTS; i++) {
+    if (s_oneshots[i].due != 0 && (next == 0 || s_oneshots[i].due < next)) {
+      next = s_oneshots[i].due;
+    }
+  }
+  xSemaphoreGive(s_oneshot_lock);
+  return next;
+}
+
+// Dispatch everything that is due and return how long the task may sleep
+// before the next entry comes up.
+static uint32_t run_due(incoming_cb_t dispatch_cb) {
+  PowerBusyScope busy;
   const unsigned long now = millis();
+  uint32_t sleep_ms = SCHEDULER_MAX_SLEEP_MS;
 
   if (AUTONOMOUS_STATUS_ENABLED && (long)(now - s_next_status_ms) >= 0) {
-    event_log_append("SCHED: status");
+    event_log_record(EVT_SCHED, "status");
     dispatch_cb(String("status"));
     s_next_status_ms = now + AUTONOMOUS_STATUS_MS;
   }
 
-  if (HEARTBEAT_ENABLED && (long)(now - s_next_heartbeat_ms) >= 0) {
+  // A background check due soon runs together with one that is due now, so
+  // both reach the LLM inside the same batching window and share a request.
+  const bool heartbeat_due = HEARTBEAT_ENABLED && (long)(now - s_next_heartbeat_ms) >= 0;
+  const bool proactive_due = PROACTIVE_ENABLED && (long)(now - s_next_proactive_ms) >= 0;
+  const bool align = LLM_BATCH_WINDOW_MS > 0 && (heartbeat_due || proactive_due);
+
+  if (HEARTBEAT_ENABLED &&
+      (heartbeat_due || (align && (long)(now + LLM_BATCH_ALIGN_MS - s_next_heartbeat_ms) >= 0))) {
     String heartbeat;
     String err;
     if (persona_get_heartbeat(heartbeat, err)) {
       heartbeat.trim();
       if (heartbeat.length() > 0) {
-        event_log_append("SCHED: heartbeat_run");
+        event_log_record(EVT_SCHED, "heartbeat_run");
         dispatch_cb(String("heartbeat_run"));
       }
     }
@@ -344,70 +476,139 @@ void scheduler_tick(incoming_cb_t dispatch_cb) {
   }
 
   // Proactive agent check
-  if (PROACTIVE_ENABLED && (long)(now - s_next_proactive_ms) >= 0) {
-    event_log_append("SCHED: proactive_check");
+  if (PROACTIVE_ENABLED &&
+      (proactive_due || (align && (long)(now + LLM_BATCH_ALIGN_MS - s_next_proactive_ms) >= 0))) {
+    event_log_record(EVT_SCHED, "proactive_check");
     dispatch_cb(String("proactive_check"));
     s_next_proactive_ms = now + PROACTIVE_INTERVAL_MS;
   }
 
-  // Cron job checking
-  if ((long)(now - s_next_cron_check_ms) >= 0) {
-    s_next_cron_check_ms = now + 15000;
+  if (AUTONOMOUS_STATUS_ENABLED) {
+    sleep_ms = min(sleep_ms, ms_until(s_next_status_ms, now));
+  }
+  if (HEARTBEAT_ENABLED) {
+    sleep_ms = min(sleep_ms, ms_until(s_next_heartbeat_ms, now));
+  }
+  if (PROACTIVE_ENABLED) {
+    sleep_ms = min(sleep_ms, ms_until(s_next_proactive_ms, now));
+  }
 
-    struct tm tm_now{};
-    if (!scheduler_get_local_time(tm_now)) {
-      // No time sync yet, skip cron check
-      return;
-    }
+  struct tm tm_now{};
+  if (!scheduler_get_local_time(tm_now)) {
+    // Calendar entries wait for time sync; look again shortly.
+    return min(sleep_ms, (uint32_t)SCHEDULER_UNSYNCED_POLL_MS);
+  }
+  const time_t epoch = time(nullptr);
 
-    // Check for missed jobs on first successful time sync
-    check_missed_cron_jobs(dispatch_cb);
+  // Check for missed jobs on first successful time sync
+  check_missed_cron_jobs(dispatch_cb);
 
-    const int current_minute = tm_now.tm_hour * 60 + tm_now.tm_min;
+  // Cron jobs: compiled schedules in RAM, so a check is one comparison with
+  // the earliest fire time and cron.md is not touched unless a job fires.
+  const time_t cron_next = cron_store_next_fire();
+  if (cron_next == 0 || cron_next <= epoch) {
+    String due[CRON_MAX_JOBS];
+    const int due_count = cron_store_take_due(epoch, due, CRON_MAX_JOBS);
+    for (int i = 0; i < due_count; i++) {
+      String cmd = due[i];
+      cmd.trim();
 
-    // Only check once per minute to avoid duplicate triggers
-    if (current_minute != s_last_cron_minute) {
-      s_last_cron_minute = current_minute;
+      event_log_printf(EVT_SCHED, "cron triggered: %s", cmd.c_str());
+      dispatch_cb(cmd);
+      Serial.printf("[scheduler] Cron job triggered: %s\n", cmd.c_str());
+    }
 
-      CronJob jobs[CRON_MAX_JOBS];
-      int job_count = cron_store_get_all(jobs, CRON_MAX_JOBS);
+    // Missed-job recovery only needs the time of the last run
+    if (due_count > 0) {
+      cron_store_update_last_check(epoch);
+      s_last_check_saved = epoch;
+    }
+  }
 
-      for (int i = 0; i < job_count; i++) {
-        const CronJob &job = jobs[i];
+  // Also on a coarse timer, so the replay window after a reboot stays short
+  // when no job has fired for a while.
+  if (epoch - s_last_check_saved >= SCHEDULER_LAST_CHECK_SAVE_S) {
+    cron_store_update_last_check(epoch);
+    s_last_check_saved = epoch;
+  }
 
-        if (cron_should_trigger(job, tm_now.tm_hour, tm_now.tm_min,
-                               tm_now.tm_mday, tm_now.tm_mon + 1, tm_now.tm_wday)) {
-          String cmd = job.command;
-          cmd.trim();
+  run_daily_reminder(dispatch_cb, epoch);
+  run_oneshots(dispatch_cb, epoch);
+  run_task_reminders(dispatch_cb, epoch);
 
-          event_log_append("SCHED: cron triggered: " + cmd);
-          dispatch_cb(cmd);
-          Serial.printf("[scheduler] Cron job triggered: %s\n", cmd.c_str());
-        }
-      }
+  sleep_ms = sleep_until_epoch(cron_store_next_fire(), epoch, sleep_ms);
+  sleep_ms = sleep_until_epoch(s_reminder_next, epoch, sleep_ms);
+  sleep_ms = sleep_until_epoch(next_oneshot(), epoch, sleep_ms);
+#if ENABLE_TASKS
+  sleep_ms = sleep_until_epoch(task_next_due(), epoch, sleep_ms);
+#endif
+  return sleep_ms;
+}
 
-      // Update last check time after successful check
-      time_t current_time = time(nullptr);
-      if (current_time >= 1700000000) {
-        cron_store_update_last_check(current_time);
-      }
-    }
+// Sleeps until the earliest entry is due or scheduler_notify_changed() wakes
+// it. The periodic cap re-reads the clock so NTP corrections and timezone
+// changes are picked up without a notification.
+static void scheduler_task(void *param) {
+  (void)param;
+  while (true) {
+    const uint32_t sleep_ms = run_due(s_dispatch_cb);
+    // Entries are compared at whole seconds; never spin on one still ahead.
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(max(sleep_ms, (uint32_t)SCHEDULER_MIN_SLEEP_MS)));
   }
+}
 
-  // Daily reminder check
-  if ((long)(now - s_next_reminder_check_ms) >= 0) {
-    s_next_reminder_check_ms = now + 15000;
+void scheduler_start(incoming_cb_t dispatch_cb) {
+  if (s_task != nullptr || dispatch_cb == nullptr) {
+    return;
+  }
+  s_dispatch_cb = dispatch_cb;
+  s_oneshot_lock = xSemaphoreCreateMutex();
+  if (s_oneshot_lock == nullptr) {
+    Serial.println("[scheduler] lock alloc failed");
+    return;
+  }
+  const uint32_t kStack = 8192;
+  xTaskCreatePinnedToCore(scheduler_task, "Scheduler", kStack, NULL, TASK_PRIO_SCHEDULER, &s_task,
+                          TASK_CORE_APP);
+  metrics_register_task(s_task, kStack);
+}
 
-    struct tm tm_now{};
-    if (!scheduler_get_local_time(tm_now)) {
-      return;
-    }
+void scheduler_notify_changed() {
+  s_reminder_dirty = true;
+  if (s_task != nullptr) {
+    xTaskNotifyGive(s_task);
+  }
+}
 
-    check_daily_reminder(dispatch_cb, tm_now);
+bool scheduler_add_oneshot(time_t due, const String &command, String &error_out) {
+  if (command.length() == 0) {
+    error_out = "Empty command";
+    return false;
   }
+  if (s_oneshot_lock == nullptr) {
+    error_out = "Scheduler not started";
+    return false;
+  }
+  bool added = false;
+  xSemaphoreTake(s_oneshot_lock, portMAX_DELAY);
+  for (int i = 0; i < SCHEDULER_MAX_ONESHOTS && !added; i++) {
+    if (s_oneshots[i].due == 0) {
+      s_oneshots[i].due = due;
+      s_oneshots[i].command = command;
+      added = true;
+    }
+  }
+  xSemaphoreGive(s_oneshot_lock);
+  if (!added) {
+    error_out = "Too many pending one-shot jobs (" + String(SCHEDULER_MAX_ONESHOTS) + ")";
+    return false;
+  }
+  scheduler_notify_changed();
+  return true;
 }
 
 void scheduler_time_debug(String &out) {
+  tz_lock();
   ensure_time_configured();
   time_t now = time(nullptr);
 
@@ -427,4 +628,5 @@ void scheduler_time_debug(String &out) {
              tm_now.tm_hour, tm_now.tm_min, tm_now.tm_sec);
     out += "\nlocal=" + String(buf);
   }
+  tz_unlock();
 }
@@ -5,7 +5,16 @@
 #include "transport_telegram.h"
 
 void scheduler_init();
-void scheduler_tick(incoming_cb_t dispatch_cb);
+
+// Start the scheduler task; due entries are passed to dispatch_cb from it
+void scheduler_start(incoming_cb_t dispatch_cb);
+
+// Wake the scheduler after a cron job, reminder or timezone changed
+void scheduler_notify_changed();
+
+// Run command once at local epoch `due` (kept in RAM, lost on reboot)
+bool scheduler_add_oneshot(time_t due, const String &command, String &error_out);
+
 void scheduler_time_debug(String &out);
 bool scheduler_get_local_time(struct tm &tm_out);
 
@@ -1,23 +1,227 @@
 #include "skill_registry.h"
 
 #include <Arduino.h>
-#include <SPIFFS.h>
 
 #include "brain_config.h"
+#include "flash_fs.h"
 
 namespace {
 
 const char *kSkillsDir = "/skills";
 
-struct SkillEntry {
-  String name;         // e.g. "frontend_dev"
-  String description;  // first-line summary (kept in RAM)
+const uint32_t kIndexMagic = 0x534B4958;  // "SKIX"
+const uint16_t kIndexVersion = 1;
+const size_t kNameChars = 32;
+const size_t kDescChars = 96;
+// Query words considered by skill_match
+const size_t kMaxQueryWords = 48;
+
+struct IndexHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t slots;
 };
 
-SkillEntry g_skills[SKILL_MAX_COUNT];
+// One fixed slot per skill, so add/remove rewrite a single record in place.
+struct IndexRecord {
+  uint8_t used;
+  uint8_t reserved[3];
+  uint32_t name_hash;
+  uint32_t prefix_hash;  // part before the first '_', 0 when there is none
+  uint32_t signature[4];  // one bit per description keyword (words over 3 chars)
+  char name[kNameChars];
+  char description[kDescChars];
+};
+
+// What matching needs without touching flash
+struct SkillSlot {
+  bool used;
+  uint32_t name_hash;
+  uint32_t prefix_hash;
+  uint32_t signature[4];
+};
+
+SkillSlot g_slots[SKILL_MAX_COUNT];
 int g_skill_count = 0;
+size_t g_desc_chars = 0;  // names plus descriptions, to size the ReAct list
 bool g_ready = false;
 
+uint32_t hash_word(const char *s, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (uint8_t)s[i];
+    h *= 16777619u;
+  }
+  return h == 0 ? 1 : h;  // 0 marks "no prefix"
+}
+
+void signature_add(uint32_t *signature, uint32_t h) {
+  signature[(h >> 5) & 3] |= 1UL << (h & 31);
+}
+
+bool is_word_char(char c) {
+  return isalnum((unsigned char)c) || c == '_' || c == '-';
+}
+
+// Calls cb(word, len, ctx) for every word of lowercase text; stops when cb
+// returns false.
+typedef bool (*word_cb_t)(const char *word, size_t len, void *ctx);
+
+void for_each_word(const char *text, word_cb_t cb, void *ctx) {
+  const char *p = text;
+  while (*p != '\0') {
+    while (*p != '\0' && !is_word_char(*p)) {
+      p++;
+    }
+    const char *begin = p;
+    while (*p != '\0' && is_word_char(*p)) {
+      p++;
+    }
+    if (p > begin && !cb(begin, (size_t)(p - begin), ctx)) {
+      return;
+    }
+  }
+}
+
+bool add_keyword_bit(const char *word, size_t len, void *ctx) {
+  if (len > 3) {
+    signature_add((uint32_t *)ctx, hash_word(word, len));
+  }
+  return true;
+}
+
+void copy_field(char *dst, size_t cap, const String &src) {
+  strncpy(dst, src.c_str(), cap - 1);
+  dst[cap - 1] = '\0';
+}
+
+void fill_record(IndexRecord &rec, const String &name, const String &description) {
+  memset(&rec, 0, sizeof(rec));
+  rec.used = 1;
+  copy_field(rec.name, sizeof(rec.name), name);
+  copy_field(rec.description, sizeof(rec.description), description);
+  rec.name_hash = hash_word(rec.name, strlen(rec.name));
+  const char *us = strchr(rec.name, '_');
+  rec.prefix_hash = (us != nullptr && us > rec.name) ? hash_word(rec.name, (size_t)(us - rec.name)) : 0;
+
+  String desc_lc = rec.description;
+  desc_lc.toLowerCase();
+  for_each_word(desc_lc.c_str(), add_keyword_bit, rec.signature);
+}
+
+void slot_from_record(int slot, const IndexRecord &rec) {
+  SkillSlot &s = g_slots[slot];
+  s.used = rec.used != 0;
+  s.name_hash = rec.name_hash;
+  s.prefix_hash = rec.prefix_hash;
+  memcpy(s.signature, rec.signature, sizeof(s.signature));
+}
+
+void recount() {
+  g_skill_count = 0;
+  for (int i = 0; i < SKILL_MAX_COUNT; i++) {
+    if (g_slots[i].used) {
+      g_skill_count++;
+    }
+  }
+}
+
+size_t record_offset(int slot) {
+  return sizeof(IndexHeader) + (size_t)slot * sizeof(IndexRecord);
+}
+
+bool read_record(File &f, int slot, IndexRecord &rec) {
+  return f.seek(record_offset(slot)) && f.read((uint8_t *)&rec, sizeof(rec)) == sizeof(rec);
+}
+
+bool load_record(int slot, IndexRecord &rec) {
+  File f = FLASH_FS.open(SKILL_INDEX_PATH, FILE_READ);
+  if (!f) {
+    return false;
+  }
+  const bool ok = read_record(f, slot, rec);
+  f.close();
+  return ok;
+}
+
+bool store_record(int slot, const IndexRecord &rec) {
+  File f = FLASH_FS.open(SKILL_INDEX_PATH, "r+");
+  if (!f) {
+    return false;
+  }
+  const bool ok = f.seek(record_offset(slot)) &&
+                  f.write((const uint8_t *)&rec, sizeof(rec)) == sizeof(rec);
+  f.close();
+  return ok;
+}
+
+// Visit every used record in slot order; cb returns false to stop.
+typedef bool (*record_cb_t)(int slot, const IndexRecord &rec, void *ctx);
+
+void for_each_record(record_cb_t cb, void *ctx) {
+  File f = FLASH_FS.open(SKILL_INDEX_PATH, FILE_READ);
+  if (!f) {
+    return;
+  }
+  IndexRecord rec;
+  for (int i = 0; i < SKILL_MAX_COUNT; i++) {
+    if (!g_slots[i].used) {
+      continue;
+    }
+    if (!read_record(f, i, rec) || !cb(i, rec, ctx)) {
+      break;
+    }
+  }
+  f.close();
+}
+
+void update_desc_chars() {
+  struct Sum {
+    static bool add(int, const IndexRecord &rec, void *ctx) {
+      *(size_t *)ctx += strlen(rec.name) + strlen(rec.description);
+      return true;
+    }
+  };
+  g_desc_chars = 0;
+  for_each_record(Sum::add, &g_desc_chars);
+}
+
+// Slot holding this (lowercase) name, -1 when none.
+int find_slot(const String &name) {
+  const uint32_t h = hash_word(name.c_str(), name.length());
+  IndexRecord rec;
+  for (int i = 0; i < SKILL_MAX_COUNT; i++) {
+    if (g_slots[i].used && g_slots[i].name_hash == h && load_record(i, rec) && name == rec.name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool load_index() {
+  File f = FLASH_FS.open(SKILL_INDEX_PATH, FILE_READ);
+  if (!f) {
+    return false;
+  }
+  IndexHeader header;
+  bool ok = f.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == kIndexMagic && header.version == kIndexVersion &&
+            header.slots == SKILL_MAX_COUNT &&
+            f.size() == record_offset(SKILL_MAX_COUNT);
+  IndexRecord rec;
+  for (int i = 0; ok && i < SKILL_MAX_COUNT; i++) {
+    ok = f.read((uint8_t *)&rec, sizeof(rec)) == sizeof(rec);
+    if (ok) {
+      slot_from_record(i, rec);
+    }
+  }
+  f.close();
+  if (!ok) {
+    memset(g_slots, 0, sizeof(g_slots));
+  }
+  return ok;
+}
+
 // Extract description from first line of skill file
 // Expected format: first non-empty line is the description
 String extract_description(const String &content) {
@@ -67,50 +271,114 @@ String name_from_filename(const String &filename) {
   return name;
 }
 
-// Scan /skills/ directory and build index
-void scan_skills() {
+
+// Scan /skills/ once and write a fresh index.
+bool rebuild_index() {
+  memset(g_slots, 0, sizeof(g_slots));
   g_skill_count = 0;
 
-  if (!SPIFFS.exists(kSkillsDir)) {
-    SPIFFS.mkdir(kSkillsDir);
-    Serial.println("[skills] Created /skills/ directory");
-    return;
+  File out = FLASH_FS.open(SKILL_INDEX_PATH, FILE_WRITE);
+  if (!out) {
+    Serial.println("[skills] index create failed");
+    return false;
   }
-
-  File root = SPIFFS.open(kSkillsDir);
-  if (!root || !root.isDirectory()) {
-    Serial.println("[skills] /skills/ is not a directory");
-    return;
+  IndexHeader header = {kIndexMagic, kIndexVersion, (uint16_t)SKILL_MAX_COUNT};
+  out.write((const uint8_t *)&header, sizeof(header));
+
+  int slot = 0;
+  IndexRecord rec;
+  File root = FLASH_FS.open(kSkillsDir);
+  if (root && root.isDirectory()) {
+    File file = root.openNextFile();
+    while (file && slot < SKILL_MAX_COUNT) {
+      String fname = String(file.name());
+      if (fname.endsWith(".md")) {
+        // Read only enough to get description (first 300 bytes)
+        char buf[301];
+        size_t read_len = file.readBytes(buf, 300);
+        buf[read_len] = '\0';
+        fill_record(rec, name_from_filename(fname), extract_description(String(buf)));
+        out.write((const uint8_t *)&rec, sizeof(rec));
+        slot_from_record(slot++, rec);
+        Serial.printf("[skills] Indexed: %s\n", rec.name);
+      }
+      file = root.openNextFile();
+    }
   }
+  memset(&rec, 0, sizeof(rec));
+  for (int i = slot; i < SKILL_MAX_COUNT; i++) {
+    out.write((const uint8_t *)&rec, sizeof(rec));
+  }
+  out.close();
 
-  File file = root.openNextFile();
-  while (file && g_skill_count < SKILL_MAX_COUNT) {
-    String fname = String(file.name());
-    if (fname.endsWith(".md")) {
-      // Read only enough to get description (first 300 bytes)
-      char buf[301];
-      size_t read_len = file.readBytes(buf, 300);
-      buf[read_len] = '\0';
-      String header = String(buf);
+  recount();
+  update_desc_chars();
+  Serial.printf("[skills] index rebuilt, %d skill(s)\n", g_skill_count);
+  return true;
+}
 
-      g_skills[g_skill_count].name = name_from_filename(fname);
-      g_skills[g_skill_count].description = extract_description(header);
-      g_skill_count++;
+struct QueryWords {
+  uint32_t hashes[kMaxQueryWords];
+  size_t count;
+  uint32_t signature[4];
+};
 
-      Serial.printf("[skills] Indexed: %s\n", g_skills[g_skill_count - 1].name.c_str());
+bool add_query_word(const char *word, size_t len, void *ctx) {
+  QueryWords *q = (QueryWords *)ctx;
+  const uint32_t h = hash_word(word, len);
+  q->hashes[q->count++] = h;
+  if (len > 3) {
+    signature_add(q->signature, h);
+  }
+  return q->count < kMaxQueryWords;
+}
+
+bool query_has(const QueryWords &q, uint32_t h) {
+  for (size_t i = 0; i < q.count; i++) {
+    if (q.hashes[i] == h) {
+      return true;
     }
-    file = root.openNextFile();
   }
+  return false;
+}
 
-  Serial.printf("[skills] %d skill(s) indexed\n", g_skill_count);
+// "use <name>", "skill <name>", "use <prefix>", "<prefix> skill"
+bool explicit_hit(const QueryWords &q, const SkillSlot &s) {
+  static const uint32_t kUse = hash_word("use", 3);
+  static const uint32_t kSkill = hash_word("skill", 5);
+  for (size_t i = 0; i + 1 < q.count; i++) {
+    const uint32_t a = q.hashes[i];
+    const uint32_t b = q.hashes[i + 1];
+    if ((a == kUse || a == kSkill) && b == s.name_hash) {
+      return true;
+    }
+    if (s.prefix_hash != 0 && ((a == kUse && b == s.prefix_hash) ||
+                               (a == s.prefix_hash && b == kSkill))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct KeywordCount {
+  const QueryWords *query;
+  int matches;
+};
+
+bool count_keyword(const char *word, size_t len, void *ctx) {
+  KeywordCount *k = (KeywordCount *)ctx;
+  if (len > 3 && query_has(*k->query, hash_word(word, len))) {
+    k->matches++;
+  }
+  return k->matches < 2;
 }
 
 // Create default skills if /skills/ is empty
 void create_default_skills() {
   // Morning Briefing
   String morning_path = String(kSkillsDir) + "/morning_briefing.md";
-  if (!SPIFFS.exists(morning_path.c_str())) {
-    File f = SPIFFS.open(morning_path.c_str(), FILE_WRITE);
+  if (!FLASH_FS.exists(morning_path.c_str())) {
+    File f = FLASH_FS.open(morning_path.c_str(), FILE_WRITE);
     if (f) {
       f.println("---");
       f.println("name: morning_briefing");
@@ -133,8 +401,8 @@ void create_default_skills() {
 
   // Frontend Dev
   String frontend_path = String(kSkillsDir) + "/frontend_dev.md";
-  if (!SPIFFS.exists(frontend_path.c_str())) {
-    File f = SPIFFS.open(frontend_path.c_str(), FILE_WRITE);
+  if (!FLASH_FS.exists(frontend_path.c_str())) {
+    File f = FLASH_FS.open(frontend_path.c_str(), FILE_WRITE);
     if (f) {
       f.println("---");
       f.println("name: frontend_dev");
@@ -163,8 +431,8 @@ void create_default_skills() {
 
   // Code Review
   String review_path = String(kSkillsDir) + "/code_review.md";
-  if (!SPIFFS.exists(review_path.c_str())) {
-    File f = SPIFFS.open(review_path.c_str(), FILE_WRITE);
+  if (!FLASH_FS.exists(review_path.c_str())) {
+    File f = FLASH_FS.open(review_path.c_str(), FILE_WRITE);
     if (f) {
       f.println("---");
       f.println("name: code_review");
@@ -189,16 +457,40 @@ void create_default_skills() {
 }  // namespace
 
 void skill_init() {
-  if (!SPIFFS.begin(true)) {
-    Serial.println("[skills] SPIFFS mount failed");
+  if (!flash_fs_begin()) {
+    Serial.println("[skills] " FLASH_FS_NAME " mount failed");
     return;
   }
 
-  create_default_skills();
-  scan_skills();
+  if (load_index()) {
+    recount();
+    update_desc_chars();
+    Serial.printf("[skills] index loaded, %d skill(s)\n", g_skill_count);
+  } else {
+    if (!FLASH_FS.exists(kSkillsDir)) {
+      FLASH_FS.mkdir(kSkillsDir);
+      Serial.println("[skills] Created /skills/ directory");
+    }
+    create_default_skills();
+    if (!rebuild_index()) {
+      return;
+    }
+  }
   g_ready = true;
 }
 
+bool skill_reindex(String &error_out) {
+  if (!g_ready) {
+    error_out = "Skills not initialized";
+    return false;
+  }
+  if (!rebuild_index()) {
+    error_out = "Failed to write skill index";
+    return false;
+  }
+  return true;
+}
+
 bool skill_list(String &list_out, String &error_out) {
   if (!g_ready) {
     error_out = "Skills not initialized";
@@ -210,10 +502,20 @@ bool skill_list(String &list_out, String &error_out) {
     return true;
   }
 
+  struct Lister {
+    static bool add(int, const IndexRecord &rec, void *ctx) {
+      String &out = *(String *)ctx;
+      out += "• **";
+      out += rec.name;
+      out += "** — ";
+      out += rec.description;
+      out += "\n";
+      return true;
+    }
+  };
   list_out = "🧩 Agent Skills (" + String(g_skill_count) + "):\n\n";
-  for (int i = 0; i < g_skill_count; i++) {
-    list_out += "• **" + g_skills[i].name + "** — " + g_skills[i].description + "\n";
-  }
+  list_out.reserve(list_out.length() + g_desc_chars + g_skill_count * 12 + 40);
+  for_each_record(Lister::add, &list_out);
   list_out += "\nUse: skill_show <name> for details";
 
   return true;
@@ -224,60 +526,40 @@ String skill_match(const String &query) {
     return "";
   }
 
-  String q = query;
-  q.toLowerCase();
-
-  // Check for explicit "use <skill> skill" pattern
-  for (int i = 0; i < g_skill_count; i++) {
-    String name_lc = g_skills[i].name;
-    name_lc.toLowerCase();
-
-    // Explicit: "use frontend_dev skill" or "use frontend skill"
-    if (q.indexOf("use " + name_lc) >= 0 || q.indexOf("skill " + name_lc) >= 0) {
-      return g_skills[i].name;
-    }
-
-    // Partial name match: "use frontend" matches "frontend_dev"
-    // Split name by underscore and check first part
-    int us = name_lc.indexOf('_');
-    if (us > 0) {
-      String prefix = name_lc.substring(0, us);
-      if (q.indexOf("use " + prefix) >= 0 || q.indexOf(prefix + " skill") >= 0) {
-        return g_skills[i].name;
-      }
+  String query_lc = query;
+  query_lc.toLowerCase();
+  QueryWords q;
+  memset(&q, 0, sizeof(q));
+  for_each_word(query_lc.c_str(), add_query_word, &q);
+
+  // Explicit: "use frontend_dev skill", or partial "use frontend" for "frontend_dev"
+  IndexRecord rec;
+  for (int i = 0; i < SKILL_MAX_COUNT; i++) {
+    if (g_slots[i].used && explicit_hit(q, g_slots[i]) && load_record(i, rec)) {
+      return String(rec.name);
     }
   }
 
-  // Keyword matching against descriptions
-  for (int i = 0; i < g_skill_count; i++) {
-    String desc = g_skills[i].description;
-    desc.toLowerCase();
-
-    // Count keyword overlap between query and description
-    int matches = 0;
-    int words = 0;
-
-    // Tokenize description into keywords (skip short words)
-    int start = 0;
-    while (start < (int)desc.length()) {
-      int end = start;
-      while (end < (int)desc.length() && desc[end] != ' ' && desc[end] != ',') {
-        end++;
-      }
-      String word = desc.substring(start, end);
-      word.trim();
-      if (word.length() > 3) {
-        words++;
-        if (q.indexOf(word) >= 0) {
-          matches++;
-        }
-      }
-      start = end + 1;
+  // Keyword overlap with the description: 2+ matching words is a hit. The
+  // signature rules out most skills; the rest are confirmed word by word.
+  for (int i = 0; i < SKILL_MAX_COUNT; i++) {
+    const SkillSlot &s = g_slots[i];
+    if (!s.used) {
+      continue;
     }
-
-    // If 2+ keyword matches, consider it a hit
-    if (matches >= 2) {
-      return g_skills[i].name;
+    int overlap = 0;
+    for (int w = 0; w < 4; w++) {
+      overlap += __builtin_popcount(s.signature[w] & q.signature[w]);
+    }
+    if (overlap == 0 || !load_record(i, rec)) {
+      continue;
+    }
+    String desc_lc = rec.description;
+    desc_lc.toLowerCase();
+    KeywordCount k = {&q, 0};
+    for_each_word(desc_lc.c_str(), count_keyword, &k);
+    if (k.matches >= 2) {
+      return String(rec.name);
     }
   }
 
@@ -291,12 +573,12 @@ bool skill_load(const String &name, String &content_out, String &error_out) {
   }
 
   String path = String(kSkillsDir) + "/" + name + ".md";
-  if (!SPIFFS.exists(path.c_str())) {
+  if (!FLASH_FS.exists(path.c_str())) {
     error_out = "Skill '" + name + "' not found";
     return false;
   }
 
-  File f = SPIFFS.open(path.c_str(), FILE_READ);
+  File f = FLASH_FS.open(path.c_str(), FILE_READ);
   if (!f) {
     error_out = "Failed to read skill file";
     return false;
@@ -335,20 +617,31 @@ bool skill_add(const String &name, const String &description,
     return false;
   }
 
-  if (g_skill_count >= SKILL_MAX_COUNT) {
-    error_out = "Max skills reached (" + String(SKILL_MAX_COUNT) + ")";
-    return false;
-  }
-
   String clean_name = name;
   clean_name.toLowerCase();
   clean_name.trim();
   // Replace spaces with underscores
   clean_name.replace(" ", "_");
+  if (clean_name.length() == 0 || clean_name.length() >= kNameChars) {
+    error_out = "Skill name must be 1-" + String(kNameChars - 1) + " characters";
+    return false;
+  }
+
+  // Same name replaces the skill in its slot
+  int slot = find_slot(clean_name);
+  for (int i = 0; slot < 0 && i < SKILL_MAX_COUNT; i++) {
+    if (!g_slots[i].used) {
+      slot = i;
+    }
+  }
+  if (slot < 0) {
+    error_out = "Max skills reached (" + String(SKILL_MAX_COUNT) + ")";
+    return false;
+  }
 
   String path = String(kSkillsDir) + "/" + clean_name + ".md";
 
-  File f = SPIFFS.open(path.c_str(), FILE_WRITE);
+  File f = FLASH_FS.open(path.c_str(), FILE_WRITE);
   if (!f) {
     error_out = "Failed to create skill file";
     return false;
@@ -365,8 +658,15 @@ bool skill_add(const String &name, const String &description,
   f.println();
   f.close();
 
-  // Re-index
-  scan_skills();
+  IndexRecord rec;
+  fill_record(rec, clean_name, description);
+  if (!store_record(slot, rec)) {
+    error_out = "Failed to update skill index";
+    return false;
+  }
+  slot_from_record(slot, rec);
+  recount();
+  update_desc_chars();
 
   Serial.printf("[skills] Added skill: %s\n", clean_name.c_str());
   return true;
@@ -383,18 +683,28 @@ bool skill_remove(const String &name, String &error_out) {
   clean_name.trim();
 
   String path = String(kSkillsDir) + "/" + clean_name + ".md";
-  if (!SPIFFS.exists(path.c_str())) {
+  if (!FLASH_FS.exists(path.c_str())) {
     error_out = "Skill '" + clean_name + "' not found";
     return false;
   }
 
-  if (!SPIFFS.remove(path.c_str())) {
+  if (!FLASH_FS.remove(path.c_str())) {
     error_out = "Failed to delete skill file";
     return false;
   }
 
-  // Re-index
-  scan_skills();
+  const int slot = find_slot(clean_name);
+  if (slot >= 0) {
+    IndexRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    if (!store_record(slot, rec)) {
+      error_out = "Failed to update skill index";
+      return false;
+    }
+    g_slots[slot].used = false;
+    recount();
+    update_desc_chars();
+  }
 
   Serial.printf("[skills] Removed skill: %s\n", clean_name.c_str());
   return true;
@@ -405,10 +715,19 @@ String skill_get_descriptions_for_react() {
     return "";
   }
 
+  struct Joiner {
+    static bool add(int, const IndexRecord &rec, void *ctx) {
+      String &out = *(String *)ctx;
+      out += "  - use_skill ";
+      out += rec.name;
+      out += ": ";
+      out += rec.description;
+      out += "\n";
+      return true;
+    }
+  };
   String out;
-  out.reserve(g_skill_count * 60);
-  for (int i = 0; i < g_skill_count; i++) {
-    out += "  - use_skill " + g_skills[i].name + ": " + g_skills[i].description + "\n";
-  }
+  out.reserve(g_desc_chars + g_skill_count * 16);
+  for_each_record(Joiner::add, &out);
   return out;
 }
@@ -3,19 +3,32 @@
 
 #include <Arduino.h>
 
-// Maximum number of skills indexed at boot
+// Skills are listed in a fixed-slot index file (name, description and a
+// keyword signature per skill) that skill_add/skill_remove keep current, so
+// boot reads one file instead of every /skills/*.md. RAM holds only the
+// hashes and signatures (24 bytes per slot); names and descriptions are read
+// from the index when a lookup needs them.
+
+// Index slots, i.e. the most skills that can be installed
 #ifndef SKILL_MAX_COUNT
-#define SKILL_MAX_COUNT 15
+#define SKILL_MAX_COUNT 48
 #endif
 
 // Maximum skill file size (bytes)
 #ifndef SKILL_MAX_FILE_SIZE
-#define SKILL_MAX_FILE_SIZE 2048
+#define SKILL_MAX_FILE_SIZE 4096
+#endif
+
+#ifndef SKILL_INDEX_PATH
+#define SKILL_INDEX_PATH "/skills.idx"
 #endif
 
-// Initialize skill registry (scan /skills/ directory)
+// Load the skill index, building it from /skills/ when missing or stale
 void skill_init();
 
+// Rebuild the index from the files in /skills/ (after copying files in by hand)
+bool skill_reindex(String &error_out);
+
 // List all indexed skills (name: description)
 bool skill_list(String &list_out, String &error_out);
 
@@ -0,0 +1,469 @@
+#include "soak.h"
+
+#include <WiFi.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "agent_loop.h"
+#include "brain_config.h"
+#include "chat_history.h"
+#include "event_log.h"
+#include "flash_fs.h"
+#include "wifi_link.h"
+
+namespace {
+
+// Commands and small talk in the mix people send; nothing here changes state.
+// Chat lines fall through to the (mock) LLM.
+const char *const kBuiltinCorpus[] = {
+    "status",
+    "time_show",
+    "task_list",
+    "hello!",
+    "what should I cook tonight with rice, eggs and spinach?",
+    "cron_list",
+    "thanks, that helped a lot",
+    "can you explain how a transistor works?",
+    "memory",
+    "give me three ideas for a rainy weekend",
+};
+
+const uint32_t kTaskStack = 6144;
+const uint32_t kTickMs = 100;
+
+// Latency histogram: four buckets per doubling from 64 ms, so a percentile
+// is within ~19% of the true value, up to about 17 minutes.
+const size_t kBuckets = 56;
+const uint32_t kBucketBaseMs = 64;
+const uint16_t kBucketSteps[4] = {1000, 1189, 1414, 1682};
+
+struct Pending {
+  uint32_t id;  // 0 when free
+  uint32_t sent_ms;
+};
+
+struct SoakStats {
+  SoakConfig config;
+  bool running;
+  bool ever_ran;
+  bool builtin_corpus;
+  uint16_t corpus_count;
+  uint32_t started_ms;
+  uint32_t elapsed_ms;  // frozen when the run ends
+  uint32_t sent;
+  uint32_t done;
+  uint32_t skipped;   // send due while SOAK_MAX_INFLIGHT were pending
+  uint32_t refused;   // the agent queue was full
+  uint32_t lost;      // web result slot evicted before it was read
+  uint32_t timeouts;
+  uint32_t in_flight;
+  uint32_t max_ms;
+  uint32_t heap_low;
+  uint32_t block_low;
+  uint32_t boot_low_start;
+  uint32_t wdt_events;
+  uint32_t hist[kBuckets];
+};
+
+SoakStats g_stats = {};
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+TaskHandle_t g_task = nullptr;
+volatile bool g_stop = false;
+volatile bool g_mock_on = false;
+volatile uint32_t g_wdt_timeouts = 0;
+uint32_t g_wdt_start = 0;
+
+String *g_corpus = nullptr;
+size_t g_corpus_count = 0;
+String *g_saved_history = nullptr;
+int g_saved_count = 0;
+
+uint32_t bucket_upper_ms(size_t i) {
+  return (uint32_t)(((uint64_t)kBucketBaseMs << (i / 4)) * kBucketSteps[i % 4] / 1000);
+}
+
+size_t bucket_for(uint32_t ms) {
+  size_t i = 0;
+  while (i + 1 < kBuckets && ms > bucket_upper_ms(i)) {
+    i++;
+  }
+  return i;
+}
+
+// Upper bound of the bucket holding the pct-th percentile, 0 with no samples.
+uint32_t percentile_ms(const SoakStats &s, uint32_t pct) {
+  if (s.done == 0) {
+    return 0;
+  }
+  const uint32_t target = (uint32_t)(((uint64_t)s.done * pct + 99) / 100);
+  uint32_t seen = 0;
+  for (size_t i = 0; i < kBuckets; i++) {
+    seen += s.hist[i];
+    if (seen >= target) {
+      return min(bucket_upper_ms(i), s.max_ms);
+    }
+  }
+  return s.max_ms;
+}
+
+void snapshot(SoakStats &out) {
+  portENTER_CRITICAL(&g_mux);
+  out = g_stats;
+  portEXIT_CRITICAL(&g_mux);
+  if (out.running) {
+    out.elapsed_ms = millis() - out.started_ms;
+    out.wdt_events = g_wdt_timeouts - g_wdt_start;
+  }
+}
+
+// Hundredths of a message per minute, to print without floats.
+uint32_t rate_x100(const SoakStats &s) {
+  return s.elapsed_ms == 0 ? 0 : (uint32_t)((uint64_t)s.done * 6000000ULL / s.elapsed_ms);
+}
+
+void load_corpus() {
+  g_corpus = new String[SOAK_CORPUS_MAX];
+  g_corpus_count = 0;
+  File f;
+  if (FLASH_FS.exists(SOAK_CORPUS_PATH)) {
+    f = FLASH_FS.open(SOAK_CORPUS_PATH, FILE_READ);
+  }
+  if (f) {
+    while (f.available() && g_corpus_count < SOAK_CORPUS_MAX) {
+      String line = f.readStringUntil('\n');
+      line.trim();
+      if (line.length() > 0 && !line.startsWith("#")) {
+        g_corpus[g_corpus_count++] = line;
+      }
+    }
+    f.close();
+  }
+  g_stats.builtin_corpus = g_corpus_count == 0;
+  if (g_corpus_count == 0) {
+    const size_t n = sizeof(kBuiltinCorpus) / sizeof(kBuiltinCorpus[0]);
+    for (size_t i = 0; i < n && i < SOAK_CORPUS_MAX; i++) {
+      g_corpus[g_corpus_count++] = kBuiltinCorpus[i];
+    }
+  }
+  g_stats.corpus_count = (uint16_t)g_corpus_count;
+}
+
+void log_progress(const char *what) {
+  SoakStats s;
+  snapshot(s);
+  const uint32_t rate = rate_x100(s);
+  event_log_printf(EVT_SOAK, "%s %lum %lu.%02lu/min done %lu p50 %lu p99 %lu heap %lu wdt %lu",
+                   what, (unsigned long)(s.elapsed_ms / 60000), (unsigned long)(rate / 100),
+                   (unsigned long)(rate % 100), (unsigned long)s.done,
+                   (unsigned long)percentile_ms(s, 50), (unsigned long)percentile_ms(s, 99),
+                   (unsigned long)s.heap_low, (unsigned long)s.wdt_events);
+  Serial.printf("[soak] %s: %lu sent, %lu done, p50 %lu ms, p99 %lu ms, heap low %lu\n", what,
+                (unsigned long)s.sent, (unsigned long)s.done, (unsigned long)percentile_ms(s, 50),
+                (unsigned long)percentile_ms(s, 99), (unsigned long)s.heap_low);
+}
+
+// Collect finished replies and expire the ones past SOAK_REPLY_TIMEOUT_MS.
+void poll_pending(Pending *pending) {
+  const uint32_t now = millis();
+  for (size_t i = 0; i < SOAK_MAX_INFLIGHT; i++) {
+    Pending &p = pending[i];
+    if (p.id == 0) {
+      continue;
+    }
+    String reply;
+    const AgentResultState state = agent_loop_take_result(p.id, reply);
+    if (state == AGENT_RESULT_PENDING && now - p.sent_ms < SOAK_REPLY_TIMEOUT_MS) {
+      continue;
+    }
+    const uint32_t ms = now - p.sent_ms;
+    portENTER_CRITICAL(&g_mux);
+    if (state == AGENT_RESULT_DONE) {
+      g_stats.done++;
+      g_stats.hist[bucket_for(ms)]++;
+      g_stats.max_ms = max(g_stats.max_ms, ms);
+    } else if (state == AGENT_RESULT_PENDING) {
+      g_stats.timeouts++;
+    } else {
+      g_stats.lost++;
+    }
+    g_stats.in_flight--;
+    portEXIT_CRITICAL(&g_mux);
+    p.id = 0;
+  }
+}
+
+void send_next(Pending *pending, size_t &next_msg) {
+  Pending *slot = nullptr;
+  for (size_t i = 0; i < SOAK_MAX_INFLIGHT && slot == nullptr; i++) {
+    if (pending[i].id == 0) {
+      slot = &pending[i];
+    }
+  }
+  if (slot == nullptr) {
+    portENTER_CRITICAL(&g_mux);
+    g_stats.skipped++;
+    portEXIT_CRITICAL(&g_mux);
+    return;
+  }
+  const String &msg = g_corpus[next_msg];
+  next_msg = (next_msg + 1) % g_corpus_count;
+  const uint32_t sent_ms = millis();
+  const uint32_t id = agent_loop_queue_web_message(msg);
+  portENTER_CRITICAL(&g_mux);
+  if (id != 0) {
+    g_stats.sent++;
+    g_stats.in_flight++;
+  } else {
+    g_stats.refused++;
+  }
+  portEXIT_CRITICAL(&g_mux);
+  if (id != 0) {
+    slot->id = id;
+    slot->sent_ms = sent_ms;
+  }
+}
+
+void sample_heap() {
+  const uint32_t free_now = (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  const uint32_t block_now = (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  portENTER_CRITICAL(&g_mux);
+  g_stats.heap_low = min(g_stats.heap_low, free_now);
+  g_stats.block_low = min(g_stats.block_low, block_now);
+  portEXIT_CRITICAL(&g_mux);
+}
+
+// Freeze the figures, turn the mock off and put the owner's history back.
+void finish_run() {
+  portENTER_CRITICAL(&g_mux);
+  g_stats.elapsed_ms = millis() - g_stats.started_ms;
+  g_stats.wdt_events = g_wdt_timeouts - g_wdt_start;
+  g_stats.running = false;
+  portEXIT_CRITICAL(&g_mux);
+  g_mock_on = false;
+
+  String err;
+  if (g_saved_history != nullptr && !chat_history_import(g_saved_history, g_saved_count, err)) {
+    Serial.println("[soak] history restore failed: " + err);
+  }
+  delete[] g_saved_history;
+  g_saved_history = nullptr;
+  delete[] g_corpus;
+  g_corpus = nullptr;
+  g_corpus_count = 0;
+}
+
+void soak_task(void *param) {
+  (void)param;
+  Pending pending[SOAK_MAX_INFLIGHT] = {};
+  const SoakConfig config = g_stats.config;
+  const uint32_t interval_ms = 60000 / config.rate_per_min;
+  const uint32_t started_ms = g_stats.started_ms;
+  uint32_t next_send_ms = started_ms;
+  uint32_t next_report_ms = started_ms + SOAK_REPORT_INTERVAL_MS;
+  size_t next_msg = 0;
+  TickType_t wake = xTaskGetTickCount();
+
+  while (!g_stop) {
+    const uint32_t now = millis();
+    if (config.duration_min > 0 && now - started_ms >= config.duration_min * 60000UL) {
+      break;
+    }
+    poll_pending(pending);
+    if ((int32_t)(now - next_send_ms) >= 0) {
+      send_next(pending, next_msg);
+      next_send_ms += interval_ms;
+    }
+    sample_heap();
+    if ((int32_t)(now - next_report_ms) >= 0) {
+      log_progress("progress");
+      next_report_ms += SOAK_REPORT_INTERVAL_MS;
+    }
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(kTickMs));
+  }
+
+  // Replies still owed are abandoned; their slots age out of agent_loop
+  poll_pending(pending);
+  finish_run();
+  log_progress(g_stop ? "stopped" : "finished");
+  g_task = nullptr;
+  vTaskDelete(nullptr);
+}
+
+}  // namespace
+
+// Called from the task watchdog interrupt on every timeout (a weak hook in
+// ESP-IDF), so stalls show up in the run even when they do not reset.
+extern "C" void IRAM_ATTR esp_task_wdt_isr_user_handler(void) {
+  g_wdt_timeouts = g_wdt_timeouts + 1;
+}
+
+SoakConfig soak_default_config() {
+  SoakConfig config;
+  config.rate_per_min = SOAK_DEFAULT_RATE_PER_MIN;
+  config.duration_min = 0;
+  config.latency_ms = SOAK_MOCK_LATENCY_MS;
+  config.reply_bytes = SOAK_MOCK_REPLY_BYTES;
+  return config;
+}
+
+bool soak_start(const SoakConfig &config, String &error_out) {
+  if (g_task != nullptr) {
+    error_out = "a soak run is already going";
+    return false;
+  }
+  if (!wifi_link_ready()) {
+    error_out = "WiFi not connected (the mock LLM is on this device's web server)";
+    return false;
+  }
+  if (config.rate_per_min == 0 || config.rate_per_min > 600) {
+    error_out = "rate must be 1-600 messages per minute";
+    return false;
+  }
+  if (config.reply_bytes > SOAK_MOCK_REPLY_MAX_BYTES) {
+    error_out = "reply size is capped at " + String(SOAK_MOCK_REPLY_MAX_BYTES) + " bytes";
+    return false;
+  }
+
+  // Soak turns go through the owner's history like any web message; it is
+  // saved here and put back when the run ends.
+  g_saved_history = new String[CHAT_HISTORY_SLOTS];
+  g_saved_count = chat_history_export(g_saved_history, CHAT_HISTORY_SLOTS);
+
+  SoakStats fresh = {};
+  fresh.config = config;
+  fresh.running = true;
+  fresh.ever_ran = true;
+  fresh.started_ms = millis();
+  fresh.heap_low = (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  fresh.block_low = (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  fresh.boot_low_start = (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  portENTER_CRITICAL(&g_mux);
+  g_stats = fresh;
+  portEXIT_CRITICAL(&g_mux);
+  load_corpus();
+  g_wdt_start = g_wdt_timeouts;
+  g_stop = false;
+  g_mock_on = true;
+
+  if (xTaskCreatePinnedToCore(soak_task, "Soak", kTaskStack, nullptr, TASK_PRIO_SCHEDULER, &g_task,
+                              TASK_CORE_APP) != pdPASS) {
+    g_task = nullptr;
+    finish_run();
+    error_out = "could not start the soak task";
+    return false;
+  }
+  event_log_printf(EVT_SOAK, "start %lu/min %lum mock %lums %luB corpus %u",
+                   (unsigned long)config.rate_per_min, (unsigned long)config.duration_min,
+                   (unsigned long)config.latency_ms, (unsigned long)config.reply_bytes,
+                   (unsigned)g_corpus_count);
+  return true;
+}
+
+bool soak_stop(String &report_out) {
+  if (g_task == nullptr) {
+    return false;
+  }
+  g_stop = true;
+  // The task wakes every kTickMs; it never waits on the agent lanes, so a
+  // stop sent from one of them does not deadlock.
+  for (int i = 0; i < 50 && g_task != nullptr; i++) {
+    vTaskDelay(pdMS_TO_TICKS(kTickMs));
+  }
+  soak_describe(report_out);
+  return true;
+}
+
+bool soak_running() {
+  return g_task != nullptr;
+}
+
+void soak_describe(String &out) {
+  SoakStats s;
+  snapshot(s);
+  if (!s.ever_ran) {
+    out += "Soak: no run since boot";
+    return;
+  }
+  const uint32_t rate = rate_x100(s);
+  const uint32_t boot_low = (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  char buf[160];
+  snprintf(buf, sizeof(buf), "Soak: %s %lum%02lus, %lu/min", s.running ? "running" : "ended",
+           (unsigned long)(s.elapsed_ms / 60000), (unsigned long)(s.elapsed_ms / 1000 % 60),
+           (unsigned long)s.config.rate_per_min);
+  out += buf;
+  if (s.config.duration_min > 0) {
+    out += " for " + String(s.config.duration_min) + "m";
+  }
+  snprintf(buf, sizeof(buf), ", mock %lu ms / %lu B, corpus %u (%s)\n",
+           (unsigned long)s.config.latency_ms, (unsigned long)s.config.reply_bytes,
+           (unsigned)s.corpus_count, s.builtin_corpus ? "built-in" : SOAK_CORPUS_PATH);
+  out += buf;
+  snprintf(buf, sizeof(buf),
+           "sent %lu done %lu in flight %lu skipped %lu refused %lu lost %lu timeout %lu\n",
+           (unsigned long)s.sent, (unsigned long)s.done, (unsigned long)s.in_flight,
+           (unsigned long)s.skipped, (unsigned long)s.refused, (unsigned long)s.lost,
+           (unsigned long)s.timeouts);
+  out += buf;
+  snprintf(buf, sizeof(buf), "%lu.%02lu msg/min, latency p50 %lu ms p99 %lu ms max %lu ms\n",
+           (unsigned long)(rate / 100), (unsigned long)(rate % 100),
+           (unsigned long)percentile_ms(s, 50), (unsigned long)percentile_ms(s, 99),
+           (unsigned long)s.max_ms);
+  out += buf;
+  snprintf(buf, sizeof(buf), "heap low %lu (boot low %lu, was %lu), largest block low %lu, wdt %lu",
+           (unsigned long)s.heap_low, (unsigned long)boot_low, (unsigned long)s.boot_low_start,
+           (unsigned long)s.block_low, (unsigned long)s.wdt_events);
+  out += buf;
+}
+
+void soak_format_prometheus(String &out) {
+  SoakStats s;
+  snapshot(s);
+  if (!s.ever_ran) {
+    return;
+  }
+  char buf[96];
+  struct Series {
+    const char *name;
+    const char *type;
+    uint32_t value;
+  };
+  const Series series[] = {
+      {"brain_soak_running", "gauge", s.running ? 1u : 0u},
+      {"brain_soak_elapsed_seconds", "gauge", s.elapsed_ms / 1000},
+      {"brain_soak_sent_total", "counter", s.sent},
+      {"brain_soak_done_total", "counter", s.done},
+      {"brain_soak_skipped_total", "counter", s.skipped},
+      {"brain_soak_refused_total", "counter", s.refused},
+      {"brain_soak_lost_total", "counter", s.lost},
+      {"brain_soak_timeouts_total", "counter", s.timeouts},
+      {"brain_soak_latency_p50_ms", "gauge", percentile_ms(s, 50)},
+      {"brain_soak_latency_p99_ms", "gauge", percentile_ms(s, 99)},
+      {"brain_soak_latency_max_ms", "gauge", s.max_ms},
+      {"brain_soak_heap_low_bytes", "gauge", s.heap_low},
+      {"brain_soak_largest_block_low_bytes", "gauge", s.block_low},
+      {"brain_soak_wdt_events_total", "counter", s.wdt_events},
+  };
+  for (const Series &m : series) {
+    snprintf(buf, sizeof(buf), "# TYPE %s %s\n%s %lu\n", m.name, m.type, m.name,
+             (unsigned long)m.value);
+    out += buf;
+  }
+}
+
+bool soak_mock_active() {
+  return g_mock_on;
+}
+
+String soak_mock_base_url() {
+  return "http://" + WiFi.localIP().toString() + SOAK_MOCK_PATH;
+}
+
+bool soak_mock_params(uint32_t &latency_ms, uint32_t &reply_bytes) {
+  if (!g_mock_on) {
+    return false;
+  }
+  latency_ms = g_stats.config.latency_ms;
+  reply_bytes = g_stats.config.reply_bytes;
+  return true;
+}
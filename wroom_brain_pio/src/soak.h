@@ -0,0 +1,44 @@
+#ifndef SOAK_H
+#define SOAK_H
+
+#include <Arduino.h>
+
+// Long-running load for qualifying firmware: a background task feeds
+// messages from a corpus into the agent queue at a fixed rate while
+// llm_client talks to a mock Ollama endpoint on the device's own web server,
+// with a set latency and reply size. The run reports messages per minute,
+// end-to-end latency percentiles, the heap low-water mark and task watchdog
+// timeouts, and logs progress to the event log so it survives a reset.
+
+struct SoakConfig {
+  uint32_t rate_per_min;
+  uint32_t duration_min;  // 0 runs until soak_stop
+  uint32_t latency_ms;    // mock LLM reply delay
+  uint32_t reply_bytes;   // mock LLM reply text size
+};
+
+SoakConfig soak_default_config();
+
+// Starts a run; fails when one is already running or the web server is down.
+bool soak_start(const SoakConfig &config, String &error_out);
+
+// Ends the run and appends its final report. False when none is running.
+bool soak_stop(String &report_out);
+
+bool soak_running();
+
+// Status and figures of the current or last run.
+void soak_describe(String &out);
+
+// Prometheus series for /api/metrics; nothing before the first run.
+void soak_format_prometheus(String &out);
+
+// While a run has the mock on, llm_client sends every call to
+// soak_mock_base_url() as the ollama provider, with no hedging or fallback.
+bool soak_mock_active();
+String soak_mock_base_url();
+
+// Latency and reply size for the mock route; false while the mock is off.
+bool soak_mock_params(uint32_t &latency_ms, uint32_t &reply_bytes);
+
+#endif
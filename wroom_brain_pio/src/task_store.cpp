@@ -2,6 +2,8 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include "brain_config.h"
 
@@ -10,20 +12,29 @@ namespace {
 Preferences g_prefs;
 bool g_ready = false;
 const char *kNamespace = "braintasks";
-const char *kTasksKey = "tasks";
+const char *kLegacyTasksKey = "tasks";  // newline-delimited "id|done|text" blob
 const char *kNextIdKey = "nextid";
+const char *kIndexKey = "index";
 
-bool ensure_ready(String &error_out) {
-  if (g_ready) {
-    return true;
-  }
-  if (!g_prefs.begin(kNamespace, false)) {
-    error_out = "NVS begin failed";
-    return false;
-  }
-  g_ready = true;
-  return true;
-}
+const uint8_t kFlagUsed = 1;
+const uint8_t kFlagDone = 2;
+const uint8_t kFlagReminded = 4;
+
+// Fixed-size index of every slot, kept in RAM and stored as one blob. Texts
+// live under per-slot keys ("x<slot>"), so completing a task rewrites only
+// this index and adding one writes its text and the index.
+struct TaskRecord {
+  uint32_t id;
+  uint32_t due;  // epoch seconds, 0 for no due time
+  uint8_t flags;
+  uint8_t reserved[3];
+};
+
+TaskRecord g_index[TASKS_MAX_RECORDS];
+uint8_t g_free[TASKS_MAX_RECORDS];
+size_t g_free_count = 0;
+uint32_t g_next_id = 1;
+SemaphoreHandle_t g_lock = nullptr;
 
 String sanitize_text(String text) {
   text.replace('\r', ' ');
@@ -36,18 +47,8 @@ String sanitize_text(String text) {
   return text;
 }
 
-String trim_oldest_lines(String text, size_t max_chars) {
-  if (text.length() <= max_chars) {
-    return text;
-  }
-  while (text.length() > max_chars) {
-    int nl = text.indexOf('\n');
-    if (nl < 0) {
-      return text.substring(text.length() - max_chars);
-    }
-    text = text.substring(nl + 1);
-  }
-  return text;
+String text_key(size_t slot) {
+  return "x" + String((unsigned)slot);
 }
 
 bool parse_line(const String &line, int &id_out, int &done_out, String &text_out) {
@@ -66,6 +67,134 @@ bool parse_line(const String &line, int &id_out, int &done_out, String &text_out
   return id_out > 0;
 }
 
+void rebuild_free_list() {
+  g_free_count = 0;
+  // Highest slot first, so pops hand out low slots before high ones
+  for (size_t i = TASKS_MAX_RECORDS; i > 0; i--) {
+    if ((g_index[i - 1].flags & kFlagUsed) == 0) {
+      g_free[g_free_count++] = (uint8_t)(i - 1);
+    }
+  }
+}
+
+bool save_index() {
+  return g_prefs.putBytes(kIndexKey, g_index, sizeof(g_index)) == sizeof(g_index);
+}
+
+int find_slot(int task_id) {
+  for (size_t i = 0; i < TASKS_MAX_RECORDS; i++) {
+    if ((g_index[i].flags & kFlagUsed) && g_index[i].id == (uint32_t)task_id) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+// A free slot, or when the table is full the oldest finished task's (else
+// the oldest task's), as the old store dropped its oldest lines.
+size_t claim_slot() {
+  if (g_free_count > 0) {
+    return g_free[--g_free_count];
+  }
+  size_t victim = 0;
+  for (size_t i = 1; i < TASKS_MAX_RECORDS; i++) {
+    const bool done = g_index[i].flags & kFlagDone;
+    const bool victim_done = g_index[victim].flags & kFlagDone;
+    if ((done && !victim_done) || (done == victim_done && g_index[i].id < g_index[victim].id)) {
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+// Caller holds g_lock.
+bool store_task(const String &clean, uint32_t due, bool done, uint32_t &id_out) {
+  const size_t slot = claim_slot();
+  if (g_prefs.putString(text_key(slot).c_str(), clean) == 0) {
+    if (!(g_index[slot].flags & kFlagUsed)) {
+      g_free[g_free_count++] = (uint8_t)slot;
+    }
+    return false;
+  }
+  TaskRecord &rec = g_index[slot];
+  memset(&rec, 0, sizeof(rec));
+  rec.id = g_next_id++;
+  rec.due = due;
+  rec.flags = kFlagUsed | (done ? kFlagDone : 0);
+  id_out = rec.id;
+  return true;
+}
+
+// One-time import of the old newline-delimited blob.
+void migrate_legacy() {
+  const String tasks = g_prefs.getString(kLegacyTasksKey, "");
+  size_t imported = 0;
+  int start = 0;
+  while (start < (int)tasks.length()) {
+    int end = tasks.indexOf('\n', start);
+    if (end < 0) {
+      end = tasks.length();
+    }
+    String line = tasks.substring(start, end);
+    line.trim();
+    int id = 0;
+    int done = 0;
+    String text;
+    if (line.length() > 0 && parse_line(line, id, done, text)) {
+      // Keep the ids users already know
+      g_next_id = (uint32_t)id;
+      uint32_t stored = 0;
+      if (store_task(sanitize_text(text), 0, done == 1, stored)) {
+        imported++;
+      }
+    }
+    start = end + 1;
+  }
+  g_next_id = max(g_next_id, (uint32_t)g_prefs.getUInt(kNextIdKey, 1));
+  if (save_index()) {
+    g_prefs.putUInt(kNextIdKey, g_next_id);
+    g_prefs.remove(kLegacyTasksKey);
+  }
+  Serial.printf("[tasks] migrated %u task(s) to the indexed store\n", (unsigned)imported);
+}
+
+bool ensure_ready(String &error_out) {
+  if (g_ready) {
+    return true;
+  }
+  if (!g_prefs.begin(kNamespace, false)) {
+    error_out = "NVS begin failed";
+    return false;
+  }
+  g_lock = xSemaphoreCreateMutex();
+  if (g_lock == nullptr) {
+    error_out = "task lock alloc failed";
+    return false;
+  }
+
+  memset(g_index, 0, sizeof(g_index));
+  g_next_id = g_prefs.getUInt(kNextIdKey, 1);
+  if (g_prefs.getBytesLength(kIndexKey) == sizeof(g_index)) {
+    g_prefs.getBytes(kIndexKey, g_index, sizeof(g_index));
+    rebuild_free_list();
+  } else {
+    rebuild_free_list();
+    if (g_prefs.isKey(kLegacyTasksKey)) {
+      migrate_legacy();
+    }
+  }
+  g_ready = true;
+  return true;
+}
+
+void lock() {
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+}
+
+void unlock() {
+  xSemaphoreGive(g_lock);
+}
+
 }  // namespace
 
 void task_store_init() {
@@ -77,7 +206,7 @@ void task_store_init() {
   }
 }
 
-bool task_add(const String &text, int &task_id_out, String &error_out) {
+bool task_add(const String &text, int &task_id_out, String &error_out, time_t due) {
   if (!ensure_ready(error_out)) {
     return false;
   }
@@ -88,18 +217,18 @@ bool task_add(const String &text, int &task_id_out, String &error_out) {
     return false;
   }
 
-  unsigned int next_id = g_prefs.getUInt(kNextIdKey, 1);
-  String tasks = g_prefs.getString(kTasksKey, "");
-  tasks += String(next_id) + "|0|" + clean + "\n";
-  tasks = trim_oldest_lines(tasks, TASKS_MAX_CHARS);
-
-  size_t written = g_prefs.putString(kTasksKey, tasks);
-  if (written == 0 && tasks.length() > 0) {
+  lock();
+  uint32_t id = 0;
+  bool ok = store_task(clean, due > 0 ? (uint32_t)due : 0, false, id) && save_index();
+  if (ok) {
+    g_prefs.putUInt(kNextIdKey, g_next_id);
+  }
+  unlock();
+  if (!ok) {
     error_out = "failed to store task";
     return false;
   }
-  g_prefs.putUInt(kNextIdKey, next_id + 1);
-  task_id_out = (int)next_id;
+  task_id_out = (int)id;
   return true;
 }
 
@@ -108,41 +237,50 @@ bool task_list(String &list_out, String &error_out) {
     return false;
   }
 
-  String tasks = g_prefs.getString(kTasksKey, "");
-  tasks.trim();
-  if (tasks.length() == 0) {
-    list_out = "No tasks";
-    return true;
-  }
+  // Snapshot the index, then read texts one at a time in id order.
+  TaskRecord index[TASKS_MAX_RECORDS];
+  lock();
+  memcpy(index, g_index, sizeof(index));
+  unlock();
 
-  String out = "Tasks:\n";
-  bool any = false;
-  int start = 0;
-  while (start < (int)tasks.length()) {
-    int end = tasks.indexOf('\n', start);
-    if (end < 0) {
-      end = tasks.length();
+  uint8_t order[TASKS_MAX_RECORDS];
+  size_t count = 0;
+  for (size_t i = 0; i < TASKS_MAX_RECORDS; i++) {
+    if (!(index[i].flags & kFlagUsed)) {
+      continue;
     }
-    String line = tasks.substring(start, end);
-    line.trim();
-    if (line.length() > 0) {
-      int id = 0;
-      int done = 0;
-      String text;
-      if (parse_line(line, id, done, text)) {
-        out += String(done == 1 ? "[x] " : "[ ] ");
-        out += "#" + String(id) + " " + text + "\n";
-        any = true;
-      }
+    size_t pos = count++;
+    while (pos > 0 && index[order[pos - 1]].id > index[i].id) {
+      order[pos] = order[pos - 1];
+      pos--;
     }
-    start = end + 1;
+    order[pos] = (uint8_t)i;
   }
 
-  if (!any) {
+  if (count == 0) {
     list_out = "No tasks";
     return true;
   }
 
+  String out = "Tasks:\n";
+  for (size_t n = 0; n < count; n++) {
+    const TaskRecord &rec = index[order[n]];
+    lock();
+    const String text = g_prefs.getString(text_key(order[n]).c_str(), "");
+    unlock();
+    out += String((rec.flags & kFlagDone) ? "[x] " : "[ ] ");
+    out += "#" + String(rec.id) + " " + text;
+    if (rec.due != 0) {
+      const time_t due = (time_t)rec.due;
+      struct tm tm_due{};
+      localtime_r(&due, &tm_due);
+      char buf[32];
+      strftime(buf, sizeof(buf), " (due %Y-%m-%d %H:%M)", &tm_due);
+      out += buf;
+    }
+    out += "\n";
+  }
+
   if (out.length() > 1400) {
     out = out.substring(out.length() - 1400);
   }
@@ -159,41 +297,20 @@ bool task_done(int task_id, String &error_out) {
     return false;
   }
 
-  String tasks = g_prefs.getString(kTasksKey, "");
-  String rewritten;
-  rewritten.reserve(tasks.length() + 32);
-  bool found = false;
-
-  int start = 0;
-  while (start < (int)tasks.length()) {
-    int end = tasks.indexOf('\n', start);
-    if (end < 0) {
-      end = tasks.length();
-    }
-    String line = tasks.substring(start, end);
-    line.trim();
-    if (line.length() > 0) {
-      int id = 0;
-      int done = 0;
-      String text;
-      if (parse_line(line, id, done, text)) {
-        if (id == task_id) {
-          done = 1;
-          found = true;
-        }
-        rewritten += String(id) + "|" + String(done) + "|" + sanitize_text(text) + "\n";
-      }
-    }
-    start = end + 1;
+  lock();
+  const int slot = find_slot(task_id);
+  bool ok = false;
+  if (slot >= 0) {
+    g_index[slot].flags |= kFlagDone;
+    ok = save_index();
   }
+  unlock();
 
-  if (!found) {
+  if (slot < 0) {
     error_out = "task id not found";
     return false;
   }
-
-  size_t written = g_prefs.putString(kTasksKey, rewritten);
-  if (written == 0 && rewritten.length() > 0) {
+  if (!ok) {
     error_out = "failed to update task";
     return false;
   }
@@ -204,6 +321,81 @@ bool task_clear(String &error_out) {
   if (!ensure_ready(error_out)) {
     return false;
   }
-  g_prefs.remove(kTasksKey);
+  lock();
+  for (size_t i = 0; i < TASKS_MAX_RECORDS; i++) {
+    if (g_index[i].flags & kFlagUsed) {
+      g_prefs.remove(text_key(i).c_str());
+    }
+  }
+  memset(g_index, 0, sizeof(g_index));
+  rebuild_free_list();
+  save_index();
+  unlock();
   return true;
 }
+
+size_t task_store_count() {
+  String err;
+  if (!ensure_ready(err)) {
+    return 0;
+  }
+  lock();
+  const size_t used = TASKS_MAX_RECORDS - g_free_count;
+  unlock();
+  return used;
+}
+
+bool task_get(int task_id, String &text_out, time_t &due_out) {
+  String err;
+  if (!ensure_ready(err)) {
+    return false;
+  }
+  lock();
+  const int slot = find_slot(task_id);
+  if (slot >= 0) {
+    text_out = g_prefs.getString(text_key(slot).c_str(), "");
+    due_out = (time_t)g_index[slot].due;
+  }
+  unlock();
+  return slot >= 0;
+}
+
+time_t task_next_due() {
+  String err;
+  if (!ensure_ready(err)) {
+    return 0;
+  }
+  time_t next = 0;
+  lock();
+  for (size_t i = 0; i < TASKS_MAX_RECORDS; i++) {
+    const TaskRecord &rec = g_index[i];
+    if ((rec.flags & (kFlagUsed | kFlagDone | kFlagReminded)) == kFlagUsed && rec.due != 0 &&
+        (next == 0 || (time_t)rec.due < next)) {
+      next = (time_t)rec.due;
+    }
+  }
+  unlock();
+  return next;
+}
+
+size_t task_take_due(time_t now, int *ids_out, size_t max_ids) {
+  String err;
+  if (!ensure_ready(err)) {
+    return 0;
+  }
+  size_t n = 0;
+  lock();
+  for (size_t i = 0; i < TASKS_MAX_RECORDS && n < max_ids; i++) {
+    TaskRecord &rec = g_index[i];
+    if ((rec.flags & (kFlagUsed | kFlagDone | kFlagReminded)) == kFlagUsed && rec.due != 0 &&
+        (time_t)rec.due <= now) {
+      rec.flags |= kFlagReminded;
+      ids_out[n++] = (int)rec.id;
+    }
+  }
+  if (n > 0) {
+    save_index();
+  }
+  unlock();
+  return n;
+}
@@ -2,11 +2,23 @@
 #define TASK_STORE_H
 
 #include <Arduino.h>
+#include <time.h>
 
 void task_store_init();
-bool task_add(const String &text, int &task_id_out, String &error_out);
+// due is an epoch time for a reminder, 0 for none.
+bool task_add(const String &text, int &task_id_out, String &error_out, time_t due = 0);
 bool task_list(String &list_out, String &error_out);
 bool task_done(int task_id, String &error_out);
 bool task_clear(String &error_out);
 
+// Records in use, out of TASKS_MAX_RECORDS.
+size_t task_store_count();
+bool task_get(int task_id, String &text_out, time_t &due_out);
+
+// Earliest due time of an open task not yet reminded, 0 if none.
+time_t task_next_due();
+
+// Mark open tasks due at or before now as reminded and return their ids.
+size_t task_take_due(time_t now, int *ids_out, size_t max_ids);
+
 #endif
@@ -0,0 +1,294 @@
+#include "text_patch.h"
+
+#include <string.h>
+#include <utility>
+
+namespace {
+
+const int kMaxEdits = 16;
+
+struct Edit {
+  String search;
+  String replace;
+  int start;
+  int end;
+};
+
+enum MarkerKind { LINE_TEXT, LINE_SEARCH, LINE_DIVIDER, LINE_REPLACE };
+
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Narrow [a, b) of s to its non-whitespace middle.
+void trim_range(const char *s, int &a, int &b) {
+  while (a < b && is_space(s[a])) {
+    a++;
+  }
+  while (b > a && is_space(s[b - 1])) {
+    b--;
+  }
+}
+
+// Markers are matched on the trimmed line, so "<<<<<<< SEARCH " still counts.
+MarkerKind marker_kind(const char *s, int a, int b) {
+  trim_range(s, a, b);
+  const int len = b - a;
+  if (len >= 7 && strncmp(s + a, "<<<<<<<", 7) == 0) {
+    return LINE_SEARCH;
+  }
+  if (len == 7 && strncmp(s + a, "=======", 7) == 0) {
+    return LINE_DIVIDER;
+  }
+  if (len >= 7 && strncmp(s + a, ">>>>>>>", 7) == 0) {
+    return LINE_REPLACE;
+  }
+  return LINE_TEXT;
+}
+
+void append_line(String &out, const char *s, int a, int b, bool &first) {
+  if (!first) {
+    out += '\n';
+  }
+  first = false;
+  // Drop a CR of CRLF replies
+  if (b > a && s[b - 1] == '\r') {
+    b--;
+  }
+  out.concat(s + a, (unsigned int)(b - a));
+}
+
+// Split reply into edit blocks; text outside them (fences, remarks) is ignored.
+bool parse_edits(const String &reply, Edit *edits, int &count, String &error_out) {
+  const char *s = reply.c_str();
+  const int len = (int)reply.length();
+  enum { OUTSIDE, IN_SEARCH, IN_REPLACE } state = OUTSIDE;
+  bool first = true;
+  count = 0;
+
+  for (int a = 0; a < len;) {
+    const char *nl = (const char *)memchr(s + a, '\n', len - a);
+    const int b = nl ? (int)(nl - s) : len;
+    const MarkerKind kind = marker_kind(s, a, b);
+
+    if (state == OUTSIDE && kind == LINE_SEARCH) {
+      if (count >= kMaxEdits) {
+        error_out = "more than " + String(kMaxEdits) + " edit blocks";
+        return false;
+      }
+      edits[count].search = "";
+      edits[count].replace = "";
+      state = IN_SEARCH;
+      first = true;
+    } else if (state == IN_SEARCH && kind == LINE_DIVIDER) {
+      state = IN_REPLACE;
+      first = true;
+    } else if (state == IN_REPLACE && kind == LINE_REPLACE) {
+      count++;
+      state = OUTSIDE;
+    } else if (state == IN_SEARCH) {
+      append_line(edits[count].search, s, a, b, first);
+    } else if (state == IN_REPLACE) {
+      append_line(edits[count].replace, s, a, b, first);
+    }
+    a = b + 1;
+  }
+
+  if (state != OUTSIDE) {
+    error_out = "edit block " + String(count + 1) + " is not closed";
+    return false;
+  }
+  if (count == 0) {
+    error_out = "no edit blocks";
+    return false;
+  }
+  return true;
+}
+
+// Match search against content line by line from content offset pos,
+// ignoring whitespace at both ends of each line. Sets end_out past the last
+// matched line (before its newline).
+bool lines_match_at(const char *content, int content_len, int pos, const char *search,
+                    int search_len, int &end_out) {
+  int c = pos;
+  int q = 0;
+  while (q < search_len) {
+    if (c > content_len) {
+      return false;
+    }
+    const char *snl = (const char *)memchr(search + q, '\n', search_len - q);
+    int sa = q;
+    int sb = snl ? (int)(snl - search) : search_len;
+    q = sb + 1;
+    const char *cnl = (const char *)memchr(content + c, '\n', content_len - c);
+    int ca = c;
+    int cb = cnl ? (int)(cnl - content) : content_len;
+    end_out = cb;
+    c = cb + 1;
+
+    trim_range(search, sa, sb);
+    trim_range(content, ca, cb);
+    if (sb - sa != cb - ca || strncmp(search + sa, content + ca, sb - sa) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Search text without leading and trailing blank lines, for the fuzzy pass.
+String strip_blank_edges(const String &text) {
+  String out = text;
+  while (out.startsWith("\n")) {
+    out.remove(0, 1);
+  }
+  while (out.endsWith("\n")) {
+    out.remove(out.length() - 1);
+  }
+  return out;
+}
+
+// Start of the line holding pos when only whitespace precedes pos on it,
+// else pos.
+int line_start_if_indent(const String &content, int pos) {
+  int a = pos;
+  while (a > 0 && content[a - 1] != '\n') {
+    if (!is_space(content[a - 1])) {
+      return pos;
+    }
+    a--;
+  }
+  return a;
+}
+
+bool overlaps(const Edit *edits, int located, int start, int end) {
+  for (int i = 0; i < located; i++) {
+    if (start < edits[i].end && edits[i].start < end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// First occurrence of edit that does not overlap an edit located before it.
+bool locate(const String &content, Edit *edits, int index) {
+  Edit &e = edits[index];
+  if (e.search.length() == 0) {
+    e.start = e.end = (int)content.length();
+    return true;
+  }
+
+  for (int from = 0;;) {
+    const int at = content.indexOf(e.search, from);
+    if (at < 0) {
+      break;
+    }
+    if (!overlaps(edits, index, at, at + (int)e.search.length())) {
+      e.start = at;
+      e.end = at + (int)e.search.length();
+      // SEARCH left out the indent but REPLACE brings its own: take the line
+      // from its start so the indent is not doubled
+      const int line = line_start_if_indent(content, at);
+      if (line < at && e.replace.length() > 0 && is_space(e.replace[0]) &&
+          !overlaps(edits, index, line, e.end)) {
+        e.start = line;
+      }
+      return true;
+    }
+    from = at + 1;
+  }
+
+  const String search = strip_blank_edges(e.search);
+  if (search.length() == 0) {
+    return false;
+  }
+  const char *text = content.c_str();
+  const int len = (int)content.length();
+  for (int pos = 0; pos <= len;) {
+    int end = 0;
+    if (lines_match_at(text, len, pos, search.c_str(), (int)search.length(), end) &&
+        !overlaps(edits, index, pos, end)) {
+      e.start = pos;
+      e.end = end;
+      return true;
+    }
+    const char *nl = (const char *)memchr(text + pos, '\n', len - pos);
+    if (nl == nullptr) {
+      break;
+    }
+    pos = (int)(nl - text) + 1;
+  }
+  return false;
+}
+
+}  // namespace
+
+bool text_patch_has_edits(const String &reply) {
+  const int open = reply.indexOf("<<<<<<< SEARCH");
+  return open >= 0 && reply.indexOf(">>>>>>> REPLACE", open) > open;
+}
+
+bool text_patch_apply(String &content, const String &reply, int &applied_out,
+                      String &error_out) {
+  applied_out = 0;
+  Edit edits[kMaxEdits];
+  int count = 0;
+  if (!parse_edits(reply, edits, count, error_out)) {
+    return false;
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (!locate(content, edits, i)) {
+      String head = edits[i].search;
+      const int nl = head.indexOf('\n');
+      if (nl >= 0) {
+        head = head.substring(0, nl);
+      }
+      error_out = "edit " + String(i + 1) + " does not match the file: " + head.substring(0, 60);
+      return false;
+    }
+    // A deleted block takes its line break with it
+    if (edits[i].replace.length() == 0 && edits[i].end < (int)content.length() &&
+        content[edits[i].end] == '\n' && !overlaps(edits, i, edits[i].end, edits[i].end + 1)) {
+      edits[i].end++;
+    }
+  }
+
+  // Order by position (stable, so appends keep their order) and build the
+  // result once.
+  int order[kMaxEdits];
+  for (int i = 0; i < count; i++) {
+    order[i] = i;
+  }
+  for (int i = 1; i < count; i++) {
+    const int key = order[i];
+    int j = i - 1;
+    while (j >= 0 && edits[order[j]].start > edits[key].start) {
+      order[j + 1] = order[j];
+      j--;
+    }
+    order[j + 1] = key;
+  }
+
+  size_t total = content.length();
+  for (int i = 0; i < count; i++) {
+    total = total - (edits[i].end - edits[i].start) + edits[i].replace.length();
+  }
+  String out;
+  if (!out.reserve(total)) {
+    error_out = "out of memory";
+    return false;
+  }
+  int cursor = 0;
+  const char *text = content.c_str();
+  for (int i = 0; i < count; i++) {
+    const Edit &e = edits[order[i]];
+    out.concat(text + cursor, (unsigned int)(e.start - cursor));
+    out += e.replace;
+    cursor = e.end;
+  }
+  out.concat(text + cursor, (unsigned int)(content.length() - cursor));
+
+  content = std::move(out);
+  applied_out = count;
+  return true;
+}
@@ -0,0 +1,26 @@
+#ifndef TEXT_PATCH_H
+#define TEXT_PATCH_H
+
+#include <Arduino.h>
+
+// Search/replace edit blocks as returned by the model for file iteration:
+//
+//   <<<<<<< SEARCH
+//   lines copied from the file
+//   =======
+//   lines to put there instead
+//   >>>>>>> REPLACE
+//
+// so a one-line change costs a few lines of output instead of the whole file.
+// A SEARCH that does not match exactly is retried ignoring leading and
+// trailing whitespace per line; an empty SEARCH appends to the file.
+
+// True when the reply holds at least one edit block.
+bool text_patch_has_edits(const String &reply);
+
+// Apply every block of reply to content. All or nothing: content is only
+// changed when each block matches, and the result is built in one buffer.
+bool text_patch_apply(String &content, const String &reply, int &applied_out,
+                      String &error_out);
+
+#endif
@@ -3,31 +3,46 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
-#include <HTTPUpdate.h>
 #include <HTTPClient.h>
+#include <freertos/semphr.h>
 #include <time.h>
 
 #include "agent_loop.h"
+#include "bc_dispatch.h"
+#include "bench.h"
 #include "brain_config.h"
 #include "chat_history.h"
+#include "chat_scope.h"
 #include "cron_store.h"
 #include "event_log.h"
 #include "llm_client.h"
 #include "memory_store.h"
 #include "file_memory.h"
+#include "flash_fs.h"
 #include "model_config.h"
 #include "persona_store.h"
+#include "power_mgr.h"
+#include "response_cache.h"
 #include "scheduler.h"
 #include "task_store.h"
+#include "text_patch.h"
 #include "transport_telegram.h"
 #include "web_job_client.h"
 #include "web_server.h"
 #include "web_search.h"
 #include "voice_capture.h"
+#include "wifi_link.h"
 #include "email_client.h"
 #include "discord_client.h"
+#include "msg_pool.h"
+#include "msg_spool.h"
+#include "ota_update.h"
+#include "psram_alloc.h"
+#include "trace.h"
 #include "usage_stats.h"
 #include "skill_registry.h"
+#include "soak.h"
+#include "keyword_matcher.h"
 #include "minos/minos.h"
 
 namespace {
@@ -37,10 +52,11 @@ struct PendingUpdate {
   bool available;
   String version;
   String download_url;
+  String sha256;              // "" when the release has no digest
   unsigned long notified_ms;  // When we notified the user
 };
 
-PendingUpdate s_pending_update{false, "", "", 0};
+PendingUpdate s_pending_update{false, "", "", "", 0};
 
 enum PendingActionType {
   PENDING_NONE = 0,
@@ -57,9 +73,10 @@ struct PendingAction {
   int state;
   int led_count;
   unsigned long expires_ms;
+  String chat;  // chat that raised it; only that chat may confirm or cancel
 };
 
-PendingAction s_pending{false, 0, PENDING_NONE, -1, -1, 0, 0};
+PendingAction s_pending{false, 0, PENDING_NONE, -1, -1, 0, 0, ""};
 unsigned long s_next_pending_id = 1;
 const unsigned long kPendingReminderTzMs = 180000UL;
 const unsigned long kPendingReminderDetailsMs = 180000UL;
@@ -69,9 +86,10 @@ struct PendingReminderTzDraft {
   String hhmm;
   String message;
   unsigned long expires_ms;
+  String chat;  // chat waiting to give its timezone
 };
 
-PendingReminderTzDraft s_pending_reminder_tz{false, "", "", 0};
+PendingReminderTzDraft s_pending_reminder_tz{false, "", "", 0, ""};
 
 struct PendingReminderDetailsDraft {
   bool active;
@@ -79,13 +97,38 @@ struct PendingReminderDetailsDraft {
 };
 
 PendingReminderDetailsDraft s_pending_reminder_details{false, 0};
+
+// The pending drafts above are shared by both agent lanes; hold this while
+// reading or changing them. Recursive so the clear_* helpers can take it too.
+SemaphoreHandle_t s_pending_lock = nullptr;
+
+class PendingLock {
+ public:
+  PendingLock() {
+    if (s_pending_lock != nullptr) {
+      xSemaphoreTakeRecursive(s_pending_lock, portMAX_DELAY);
+    }
+  }
+  ~PendingLock() {
+    if (s_pending_lock != nullptr) {
+      xSemaphoreGiveRecursive(s_pending_lock);
+    }
+  }
+};
 const char *kWebJobPrefix = "webjob:";
 
 bool is_expired(unsigned long deadline_ms) {
   return (long)(millis() - deadline_ms) >= 0;
 }
 
+// Pending state answers only the chat that raised it, so one chat's "yes"
+// never confirms another chat's action.
+bool is_callers(const String &pending_chat) {
+  return pending_chat == chat_scope_current();
+}
+
 void clear_pending() {
+  PendingLock guard;
   s_pending.active = false;
   s_pending.id = 0;
   s_pending.type = PENDING_NONE;
@@ -93,20 +136,35 @@ void clear_pending() {
   s_pending.state = -1;
   s_pending.led_count = 0;
   s_pending.expires_ms = 0;
+  s_pending.chat = "";
 }
 
 void clear_pending_reminder_tz() {
+  PendingLock guard;
   s_pending_reminder_tz.active = false;
   s_pending_reminder_tz.hhmm = "";
   s_pending_reminder_tz.message = "";
   s_pending_reminder_tz.expires_ms = 0;
+  s_pending_reminder_tz.chat = "";
 }
 
 void clear_pending_reminder_details() {
+  PendingLock guard;
   s_pending_reminder_details.active = false;
   s_pending_reminder_details.expires_ms = 0;
 }
 
+// Holds a daily reminder until the user tells us their timezone.
+void set_pending_reminder_tz(const String &hhmm, const String &message) {
+  PendingLock guard;
+  s_pending_reminder_tz.active = true;
+  s_pending_reminder_tz.hhmm = hhmm;
+  s_pending_reminder_tz.message = message;
+  s_pending_reminder_tz.expires_ms = millis() + kPendingReminderTzMs;
+  s_pending_reminder_tz.chat = chat_scope_current();
+  clear_pending_reminder_details();
+}
+
 static bool clear_all_conversation_context(String &out) {
   String warnings = "";
   String err;
@@ -115,6 +173,20 @@ static bool clear_all_conversation_context(String &out) {
     warnings += "- chat history: " + err + "\n";
   }
 
+  // Memory and the profile belong to the owner; a team chat only has its history
+  if (!chat_scope_is_owner(chat_scope_current())) {
+    PendingLock guard;
+    if (is_callers(s_pending.chat)) {
+      clear_pending();
+    }
+    if (is_callers(s_pending_reminder_tz.chat)) {
+      clear_pending_reminder_tz();
+    }
+    out = warnings.length() > 0 ? "Could not clear this chat:\n" + warnings
+                                : String("OK: this chat's history cleared.");
+    return true;
+  }
+
   if (!memory_clear_notes(err)) {
     warnings += "- short-term memory: " + err + "\n";
   }
@@ -135,9 +207,6 @@ static bool clear_all_conversation_context(String &out) {
   clear_pending_reminder_tz();
   clear_pending_reminder_details();
 
-  // Best-effort clear chat session file (if used).
-  file_memory_session_clear(String(TELEGRAM_ALLOWED_CHAT_ID), err);
-
   if (warnings.length() > 0) {
     out = "Context mostly cleared with warnings:\n" + warnings +
           "Project files in /projects were kept.";
@@ -221,85 +290,6 @@ bool relay_set_now(int pin, int state, String &out) {
   return true;
 }
 
-void build_help_text(String &out) {
-  out += "🦖 Timi Commands:\n\n";
-  out += "/start - Welcome and setup status\n";
-  out += "/status - Show system status\n";
-  out += "/help - Show this help\n";
-  out += "/health - Check health\n";
-  out += "/specs - Show specs\n";
-  out += "/usage - Show usage stats\n";
-  out += "/update [url] - Update firmware\n";
-#if ENABLE_GPIO
-  out += "/relay_set <pin> <0|1> - Control relay\n";
-  out += "/flash_led [count] - Blink LED\n";
-#endif
-  out += "/cron_add <expr> | <cmd> - Add cron job\n";
-  out += "/cron_list - List all cron jobs\n";
-  out += "/cron_show - Show cron jobs (detailed)\n";
-  out += "/cron_remove <id> - Remove cron job\n";
-  out += "/cron_pause <id> - Pause cron job\n";
-  out += "/cron_resume <id> - Resume cron job\n";
-  out += "/cron_clear - Clear all cron jobs\n";
-  out += "/reminder_set_daily <HH:MM> <msg> - Set daily reminder\n";
-  out += "/reminder_show - Show daily reminder\n";
-  out += "/reminder_clear - Clear daily reminder\n";
-#if ENABLE_WEB_JOBS
-  out += "/web_files_make [topic] - Generate web files\n";
-#endif
-  out += "/timezone_show - Show timezone\n";
-  out += "/timezone_set <zone> - Set timezone\n";
-#if ENABLE_EMAIL
-  out += "/email_draft <to>|<subject>|<body> - Draft email\n";
-  out += "/send_email <to> <subject> <msg> - Send email\n";
-  out += "/email_code [email] - Email last code\n";
-  out += "/email_files <email> <topic> - Generate & email web files\n";
-  out += "/files_list - List all SPIFFS files\n";
-  out += "Say \"list projects\" - List saved /projects folders\n";
-  out += "/files_get <filename> - Read a file (supports /projects/... paths)\n";
-  out += "/files_email <filename> <email> - Email a file\n";
-  out += "/files_email_all <email> - Email all files\n";
-#endif
-  out += "/discord_send <message> - Send via Discord Webhook\n";
-  out += "/discord_send_files <topic> - Generate & send files via Discord\n";
-  out += "/safe_mode - Toggle safe mode\n";
-  out += "/logs - Show logs\n";
-  out += "/logs_clear - Clear logs\n";
-  out += "/search <query> - Web search (Serper > Tavily)\n";
-#if ENABLE_VOICE
-  out += "/voice_stream - Start streaming audio to Serial (binary PCM)\n";
-  out += "/voice_stop - Stop streaming\n";
-  out += "/voice_status - Check streaming status\n";
-#endif
-  out += "/time_show - Show current time\n";
-  out += "/soul_show - Show soul\n";
-  out += "/soul_set <text> - Update soul\n";
-  out += "/remember <note> - Remember something\n";
-  out += "/memory - Show long-term memory\n";
-  out += "/forget - Clear memory\n";
-  out += "/fresh_start - Clear conversation context (keep /projects)\n";
-  out += "/onboarding_start - Start/restart setup wizard\n";
-  out += "/onboarding_status - Show setup wizard status\n";
-  out += "/onboarding_skip - Skip setup wizard\n";
-  out += "/model list - List available models\n";
-  out += "/model status - Show current model\n";
-  out += "/model use <provider> - Switch model provider\n";
-  out += "/model set <provider> <key> - Set API key\n";
-  out += "/model select <provider> <model> - Set model name\n";
-  out += "/model clear <provider> - Clear API key\n";
-  out += "/skills - List all agent skills\n";
-  out += "/skill_show <name> - Show skill details\n";
-  out += "/skill_add <name> <desc>: <instructions> - Add skill\n";
-  out += "/skill_remove <name> - Remove skill\n";
-  out += "/use_skill <name> [request] - Execute a skill\n";
-  out += "/minos <cmd> - Run MinOS shell (use /projects/<name>/ for project folders)\n";
-  out += "/pc_connect <alias|host> - Save active PC target label\n";
-  out += "/pc_status - Show PC bridge quickstart and target\n";
-  out += "/pc_run <command> - Queue an allowlisted PC command via bridge\n";
-  out += "/pc_browser <task> - Queue browser automation task via bridge\n";
-  out += "\n💬 Just chat with me normally too! I'll use tools when needed.";
-}
-
 String sanitize_pc_target(String value) {
   value.trim();
   value = compact_spaces(value);
@@ -369,18 +359,22 @@ bool queue_pc_bridge_task(const String &kind, const String &payload, String &out
     return true;
   }
 
-  String entry = "pc_queue|target=" + target + "|kind=" + kind + "|payload=" + payload;
-  event_log_append(entry);
+  String entry = "target=" + target + "|kind=" + kind + "|payload=" + payload;
+  event_log_record(EVT_PC, entry.c_str());
   out = "OK: queued " + kind + " task for " + target + ".\n" +
         "(Starter mode: task saved to event logs only.)";
   return true;
 }
 
 String wifi_health_line() {
-  if (WiFi.status() == WL_CONNECTED) {
-    return "connected ip=" + WiFi.localIP().toString() + " rssi=" + String(WiFi.RSSI());
+  switch (wifi_link_state()) {
+    case WIFI_LINK_UP:
+      return "connected ip=" + WiFi.localIP().toString() + " rssi=" + String(WiFi.RSSI());
+    case WIFI_LINK_CONNECTING:
+      return "reconnecting";
+    default:
+      return "disconnected";
   }
-  return "disconnected";
 }
 
 static bool looks_like_email_request(const String &text_lc) {
@@ -395,15 +389,131 @@ static bool looks_like_update_request(const String &text_lc) {
           text_lc.indexOf("new version") >= 0);
 }
 
+// Keyword groups behind the natural-language request checks, compiled
+// into one automaton so each check is a single pass over the message.
+enum RequestTermGroup {
+  TERMS_DOC = 1 << 0,
+  TERMS_SUMMARY = 1 << 1,
+  TERMS_IMAGE = 1 << 2,
+  TERMS_UNDERSTAND = 1 << 3,
+  TERMS_EDIT = 1 << 4,
+  TERMS_WEB = 1 << 5,
+};
+
+const char *const kDocTerms[] = {
+    "pdf",
+    "document",
+    "doc file",
+    "report",
+};
+
+const char *const kSummaryTerms[] = {
+    "summar",
+    "tldr",
+    "tl;dr",
+    "key points",
+    "highlights",
+    "gist",
+    "explain this",
+    "review this",
+};
+
+const char *const kImageTerms[] = {
+    "image",
+    "photo",
+    "picture",
+    "screenshot",
+    "diagram",
+};
+
+const char *const kUnderstandTerms[] = {
+    "describe",
+    "what is",
+    "what's in",
+    "analy",
+    "explain",
+    "understand",
+    "ocr",
+    "extract text",
+    "read text",
+    "summar",
+};
+
+const char *const kEditTerms[] = {
+    "improve",
+    "better",
+    "modern",
+    "stunning",
+    "beautiful",
+    "polish",
+    "revamp",
+    "redesign",
+    "enhance",
+    "update",
+    "change",
+    "modify",
+    "edit",
+    "turn",
+    "retheme",
+    "restyle",
+    "upgrade ui",
+    "make it",
+    "update this",
+    "tweak",
+};
+
+const char *const kWebTerms[] = {
+    "website",
+    "web site",
+    "landing page",
+    "page",
+    "saas",
+    "html",
+    "css",
+    "frontend",
+    "ui",
+    "index.html",
+    "/projects/",
+};
+
+KeywordMatcher s_request_terms;
+
+void build_request_terms() {
+  struct TermList {
+    const char *const *terms;
+    size_t count;
+    uint32_t group;
+  };
+  const TermList lists[] = {
+      {kDocTerms, sizeof(kDocTerms) / sizeof(kDocTerms[0]), TERMS_DOC},
+      {kSummaryTerms, sizeof(kSummaryTerms) / sizeof(kSummaryTerms[0]), TERMS_SUMMARY},
+      {kImageTerms, sizeof(kImageTerms) / sizeof(kImageTerms[0]), TERMS_IMAGE},
+      {kUnderstandTerms, sizeof(kUnderstandTerms) / sizeof(kUnderstandTerms[0]), TERMS_UNDERSTAND},
+      {kEditTerms, sizeof(kEditTerms) / sizeof(kEditTerms[0]), TERMS_EDIT},
+      {kWebTerms, sizeof(kWebTerms) / sizeof(kWebTerms[0]), TERMS_WEB},
+  };
+  s_request_terms.clear();
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (size_t j = 0; j < lists[i].count; j++) {
+      s_request_terms.add(lists[i].terms[j], lists[i].group);
+    }
+  }
+  s_request_terms.build();
+}
+
 }  // namespace
 
 void tool_registry_init() {
+  if (s_pending_lock == nullptr) {
+    s_pending_lock = xSemaphoreCreateRecursiveMutex();
+  }
+  build_request_terms();
   Serial.println(
       "[tools] allowlist: status, "
 #if ENABLE_GPIO
       "relay_set <pin> <0|1>, sensor_read <pin>, flash_led [count], "
 #endif
-      "help, health, specs, usage, security, update [url], confirm, cancel, "
+      "help, health, specs, usage, bench, soak, security, update [url], confirm, cancel, "
 #if ENABLE_PLAN
       "plan <task>, "
 #endif
@@ -1848,7 +1958,7 @@ static bool send_small_web_files(const String &topic, String &out) {
     return true;
   }
 
-  event_log_append("WEBFILES sent topic=" + topic);
+  event_log_printf(EVT_WEBFILES, "sent topic=%s", topic.c_str());
 
   // Include web server URL
   String server_url = web_server_get_url();
@@ -1932,14 +2042,14 @@ static bool email_small_web_files(const String &email, const String &topic, Stri
   String text_content = "HTML website files for: " + topic + "\n\nCheck the HTML version for the full interactive site.";
 
   String err;
-  if (!email_send(email, subject, email_html, text_content, err)) {
+  if (!email_queue(email, subject, email_html, text_content, err)) {
     out = "ERR: " + err;
     return true;
   }
 
-  event_log_append("EMAIL_WEBFILES sent to=" + email + " topic=" + topic);
+  event_log_printf(EVT_EMAIL, "webfiles queued to=%s topic=%s", email.c_str(), topic.c_str());
 
-  out = "✅ Emailed web files for \"" + topic + "\" to " + email;
+  out = "✅ Emailing web files for \"" + topic + "\" to " + email;
   return true;
 }
 #endif
@@ -2069,59 +2179,14 @@ static int parse_led_flash_count(const String &cmd_lc) {
   return 0;
 }
 
-static bool text_has_any(const String &text_lc, const char *const terms[], size_t term_count) {
-  for (size_t i = 0; i < term_count; i++) {
-    if (text_lc.indexOf(terms[i]) >= 0) {
-      return true;
-    }
-  }
-  return false;
-}
-
 static bool is_pdf_summary_request(const String &cmd_lc) {
-  const char *doc_terms[] = {
-      "pdf",
-      "document",
-      "doc file",
-      "report",
-  };
-  const char *summary_terms[] = {
-      "summar",
-      "tldr",
-      "tl;dr",
-      "key points",
-      "highlights",
-      "gist",
-      "explain this",
-      "review this",
-  };
-  return text_has_any(cmd_lc, doc_terms, sizeof(doc_terms) / sizeof(doc_terms[0])) &&
-         text_has_any(cmd_lc, summary_terms, sizeof(summary_terms) / sizeof(summary_terms[0]));
+  const uint32_t terms = s_request_terms.match(cmd_lc);
+  return (terms & TERMS_DOC) && (terms & TERMS_SUMMARY);
 }
 
 static bool is_image_understanding_request(const String &cmd_lc) {
-  const char *image_terms[] = {
-      "image",
-      "photo",
-      "picture",
-      "screenshot",
-      "diagram",
-  };
-  const char *understand_terms[] = {
-      "describe",
-      "what is",
-      "what's in",
-      "analy",
-      "explain",
-      "understand",
-      "ocr",
-      "extract text",
-      "read text",
-      "summar",
-  };
-  return text_has_any(cmd_lc, image_terms, sizeof(image_terms) / sizeof(image_terms[0])) &&
-         text_has_any(cmd_lc, understand_terms,
-                      sizeof(understand_terms) / sizeof(understand_terms[0]));
+  const uint32_t terms = s_request_terms.match(cmd_lc);
+  return (terms & TERMS_IMAGE) && (terms & TERMS_UNDERSTAND);
 }
 
 static bool extract_natural_image_prompt(const String &cmd, String &prompt_out) {
@@ -2232,45 +2297,9 @@ static bool extract_projects_path_from_text(const String &input, String &path_ou
 }
 
 static bool is_natural_web_iteration_request(const String &cmd_lc) {
-  const char *edit_terms[] = {
-      "improve",
-      "better",
-      "modern",
-      "stunning",
-      "beautiful",
-      "polish",
-      "revamp",
-      "redesign",
-      "enhance",
-      "update",
-      "change",
-      "modify",
-      "edit",
-      "turn",
-      "retheme",
-      "restyle",
-      "upgrade ui",
-      "make it",
-      "update this",
-      "tweak",
-  };
-  const char *web_terms[] = {
-      "website",
-      "web site",
-      "landing page",
-      "page",
-      "saas",
-      "html",
-      "css",
-      "frontend",
-      "ui",
-      "index.html",
-      "/projects/",
-  };
-
-  const bool has_edit =
-      text_has_any(cmd_lc, edit_terms, sizeof(edit_terms) / sizeof(edit_terms[0]));
-  const bool has_web = text_has_any(cmd_lc, web_terms, sizeof(web_terms) / sizeof(web_terms[0]));
+  const uint32_t terms = s_request_terms.match(cmd_lc);
+  const bool has_edit = (terms & TERMS_EDIT) != 0;
+  const bool has_web = (terms & TERMS_WEB) != 0;
   const bool has_pronoun = (cmd_lc.indexOf(" it ") >= 0) || (cmd_lc.indexOf(" this ") >= 0) ||
                            (cmd_lc.indexOf(" that ") >= 0) || cmd_lc.endsWith(" it") ||
                            cmd_lc.endsWith(" this") || cmd_lc.endsWith(" that");
@@ -2460,6 +2489,9 @@ static String mime_from_filename(const String &filename) {
   if (lc.endsWith(".json")) {
     return "application/json";
   }
+  if (lc.endsWith(".gz")) {
+    return "application/gzip";
+  }
   return "text/plain";
 }
 
@@ -2665,7 +2697,7 @@ static bool run_natural_web_iteration(const String &user_request, String &out) {
     source_for_model = source_for_model.substring(0, kMaxSourceChars) + "\n... (truncated)";
   }
 
-  String system_prompt =
+  const char *full_prompt =
       "You edit exactly one existing website file.\n"
       "Return only the full updated file in one fenced code block.\n"
       "No explanation outside the code block.\n"
@@ -2679,14 +2711,52 @@ static bool run_natural_web_iteration(const String &user_request, String &out) {
 
   String llm_reply;
   String llm_err;
-  if (!llm_generate_with_custom_prompt(system_prompt, task, false, llm_reply, llm_err)) {
+  String updated_content;
+  int edits_applied = 0;
+
+#if WEB_ITERATION_PATCH_MODE
+  // Output tokens dominate the latency of an edit, so ask for the changed
+  // lines only and apply them here.
+  const char *patch_prompt =
+      "You edit exactly one existing website file.\n"
+      "Reply only with search/replace blocks, no full file and no explanation:\n"
+      "<<<<<<< SEARCH\n"
+      "exact lines copied from the current file\n"
+      "=======\n"
+      "the lines that replace them\n"
+      ">>>>>>> REPLACE\n"
+      "Keep each SEARCH short but unique in the file. Use one block per change; "
+      "an empty SEARCH appends to the end of the file.";
+
+  if (!llm_generate_with_custom_prompt(patch_prompt, task, false, llm_reply, llm_err)) {
+    out = "ERR: " + llm_err;
+    return true;
+  }
+  if (text_patch_has_edits(llm_reply)) {
+    String patch_err;
+    updated_content = current_content;
+    if (!text_patch_apply(updated_content, llm_reply, edits_applied, patch_err)) {
+      Serial.printf("[web_iter] patch failed (%s), regenerating %s\n", patch_err.c_str(),
+                    target_path.c_str());
+      updated_content = "";
+      llm_reply = "";
+      if (!llm_generate_with_custom_prompt(full_prompt, task, false, llm_reply, llm_err)) {
+        out = "ERR: " + llm_err;
+        return true;
+      }
+    }
+  }
+#else
+  if (!llm_generate_with_custom_prompt(full_prompt, task, false, llm_reply, llm_err)) {
     out = "ERR: " + llm_err;
     return true;
   }
+#endif
 
-  String updated_content;
-  if (!extract_updated_file_content_from_llm_reply(llm_reply, filename, updated_content) ||
-      updated_content.length() == 0) {
+  // A whole file (asked for, or sent in place of edits) replaces the old one
+  if (edits_applied == 0 &&
+      (!extract_updated_file_content_from_llm_reply(llm_reply, filename, updated_content) ||
+       updated_content.length() == 0)) {
     out = "ERR: Could not extract clean file content from model output";
     return true;
   }
@@ -2708,8 +2778,11 @@ static bool run_natural_web_iteration(const String &user_request, String &out) {
     web_server_publish_file(filename, updated_content, mime);
   }
 
-  event_log_append("WEBFILES updated path=" + target_path);
+  event_log_printf(EVT_WEBFILES, "updated path=%s edits=%d", target_path.c_str(), edits_applied);
   out = "Updated and saved: " + target_path;
+  if (edits_applied > 0) {
+    out += " (" + String(edits_applied) + (edits_applied == 1 ? " edit)" : " edits)");
+  }
   if (!doc_sent) {
     out += "\nWARN: updated file saved, but sending document failed";
   }
@@ -2797,67 +2870,88 @@ static String normalize_command(const String &input) {
   return cmd;
 }
 
-// Check GitHub for updates and notify user if available
-void tool_registry_check_updates_async() {
-  String github_repo = GITHUB_REPO;
-  if (github_repo.length() == 0) {
-    github_repo = "timiclaw/timiclaw";  // Default
-  }
-
-  WiFiClientSecure client;
-  client.setInsecure();
-  HTTPClient http;
-
-  String api_url = "https://api.github.com/repos/" + github_repo + "/releases/latest";
-  Serial.println("[update] Checking for updates: " + api_url);
-
-  if (http.begin(client, api_url)) {
-    int http_code = http.GET();
-
-    if (http_code == 200) {
-      String payload = http.getString();
-
-      // Parse JSON to find version and download URL
-      int tag_idx = payload.indexOf("\"tag_name\":");
-      int assets_idx = payload.indexOf("\"assets\":");
-      int name_idx = payload.indexOf("\"name\":\"firmware.bin\"", assets_idx);
-      int url_idx = payload.indexOf("\"browser_download_url\":", name_idx);
-
-      if (tag_idx > 0 && assets_idx > 0 && name_idx > 0 && url_idx > 0) {
-        // Extract version tag
-        int tag_start = payload.indexOf("\"", tag_idx + 11) + 1;
-        int tag_end = payload.indexOf("\"", tag_start);
-        String version = payload.substring(tag_start, tag_end);
-
-        // Extract download URL
-        int url_start = payload.indexOf("\"", url_idx + 23) + 1;
-        int url_end = payload.indexOf("\"", url_start);
-        String download_url = payload.substring(url_start, url_end);
-
-        // Store pending update
-        s_pending_update.available = true;
-        s_pending_update.version = version;
-        s_pending_update.download_url = download_url;
-        s_pending_update.notified_ms = millis();
-
-        // Send notification to user
-        String notification = "🔄 **New Firmware Available!**\n\n";
-        notification += "Latest version: " + version + "\n";
-        notification += "Reply **yes** to update now\n";
-        notification += "(ESP32 will restart after update)";
-
-        transport_telegram_send(notification);
-        Serial.println("[update] New version available: " + version);
-      } else {
-        Serial.println("[update] No firmware.bin found in release");
-      }
-    } else {
-      Serial.println("[update] GitHub API HTTP " + String(http_code));
+static String github_update_repo() {
+  String repo = GITHUB_REPO;
+  return repo.length() > 0 ? repo : String("timiclaw/timiclaw");
+}
+
+// Remember a release for the "yes" confirmation
+static void offer_update(const OtaRelease &release) {
+  s_pending_update.available = true;
+  s_pending_update.version = release.version;
+  s_pending_update.download_url = release.url;
+  s_pending_update.sha256 = release.sha256;
+  s_pending_update.notified_ms = millis();
+}
+
+struct OtaProgress {
+  String message_id;
+  int last_step;
+};
+
+// Edits one Telegram message every 10% rather than sending a message per step
+static void on_ota_progress(size_t done, size_t total, void *ctx) {
+  OtaProgress *progress = (OtaProgress *)ctx;
+  const int step = total > 0 ? (int)(done * 10 / total) : 0;
+  if (step == progress->last_step || progress->message_id.length() == 0) {
+    return;
+  }
+  progress->last_step = step;
+  transport_telegram_send_streaming_edit(
+      progress->message_id, "Updating firmware: " + String(step * 10) + "% (" +
+                                String((unsigned)(done / 1024)) + "/" +
+                                String((unsigned)(total / 1024)) + " KB)");
+}
+
+// Flash the image at url and restart. Only returns, with out set, on failure.
+static bool run_ota_update(const String &url, const String &sha256, const String &version,
+                           String &out) {
+  Serial.println("[update] Starting update from: " + url);
+  const String target = version.length() > 0 ? " to " + version : String("");
+  OtaProgress progress{transport_telegram_send_streaming_start("Updating firmware" + target + "..."),
+                       0};
+
+  String err;
+  if (!ota_install(url, sha256, on_ota_progress, &progress, err)) {
+    Serial.println("[update] Failed: " + err);
+    out = "ERR: Update failed\n" + err;
+    if (progress.message_id.length() > 0) {
+      transport_telegram_send_streaming_edit(progress.message_id, out);
     }
-    http.end();
+    return true;
+  }
+
+  out = "OK: Updated" + target + (sha256.length() > 0 ? " (SHA-256 verified)" : "") +
+        "! Restarting...";
+  Serial.println("[update] Success! Restarting...");
+  if (progress.message_id.length() > 0) {
+    transport_telegram_send_streaming_edit(progress.message_id, out);
   } else {
-    Serial.println("[update] Could not connect to GitHub API");
+    transport_telegram_send(out);
+  }
+  delay(1000);
+  ESP.restart();
+  return true;
+}
+
+// Check GitHub for updates and notify user if available
+void tool_registry_check_updates_async() {
+  OtaRelease release;
+  String err;
+  if (!ota_fetch_latest_release(github_update_repo(), release, err)) {
+    Serial.println("[update] " + err);
+    return;
   }
+  offer_update(release);
+
+  // Send notification to user
+  String notification = "🔄 **New Firmware Available!**\n\n";
+  notification += "Latest version: " + release.version + "\n";
+  notification += "Reply **yes** to update now\n";
+  notification += "(ESP32 will restart after update)";
+
+  transport_telegram_send(notification);
+  Serial.println("[update] New version available: " + release.version);
 }
 
 // Trigger the pending firmware update
@@ -2874,2360 +2968,2829 @@ bool tool_registry_trigger_update(String &out) {
     return false;
   }
 
-  out = "=== Updating Firmware ===\n\n";
-  out += "Version: " + s_pending_update.version + "\n";
-  out += "Downloading and flashing...\n";
-  out += "(ESP32 will restart after update)\n";
-
-  Serial.println("[update] Starting update to " + s_pending_update.version);
+  s_pending_update.available = false;
+  return run_ota_update(s_pending_update.download_url, s_pending_update.sha256,
+                        s_pending_update.version, out);
+}
 
-  WiFiClientSecure client;
-  client.setInsecure();
+// ============================================================================
+// COMMAND HANDLERS
+// ============================================================================
 
-  t_httpUpdate_return ret = httpUpdate.update(client, s_pending_update.download_url);
+static void build_help_text(String &out);
 
-  switch (ret) {
-    case HTTP_UPDATE_FAILED:
-      Serial.println("[update] Failed: " + String(httpUpdate.getLastError()));
-      out = "ERR: Update failed\n" + httpUpdate.getLastErrorString();
-      s_pending_update.available = false;
-      break;
-    case HTTP_UPDATE_NO_UPDATES:
-      Serial.println("[update] No updates available");
-      out = "ERR: No updates available";
-      s_pending_update.available = false;
-      break;
-    case HTTP_UPDATE_OK:
-      Serial.println("[update] Success! Restarting...");
-      out = "OK: Updated to " + s_pending_update.version + "! Restarting...";
-      s_pending_update.available = false;
-      break;
-  }
+static bool cmd_help(const String &cmd, const String &cmd_lc, String &out) {
+  build_help_text(out);
+  return true;
+}
 
+static bool cmd_status(const String &cmd, const String &cmd_lc, String &out) {
+  out = "OK: alive";
   return true;
 }
 
-bool tool_registry_execute(const String &input, String &out) {
-  String cmd = normalize_command(input);
-  cmd.trim();
-  String cmd_lc = cmd;
-  cmd_lc.toLowerCase();
+static bool cmd_pc_status(const String &cmd, const String &cmd_lc, String &out) {
+  const String target = pc_target_read();
+  out = pc_bridge_quickstart(target);
+  return true;
+}
 
-  if (s_pending.active && is_expired(s_pending.expires_ms)) {
-    clear_pending();
-  }
-  if (s_pending_reminder_tz.active && is_expired(s_pending_reminder_tz.expires_ms)) {
-    clear_pending_reminder_tz();
-  }
-  if (s_pending_reminder_details.active &&
-      is_expired(s_pending_reminder_details.expires_ms)) {
-    clear_pending_reminder_details();
+static bool cmd_pc_connect(const String &cmd, const String &cmd_lc, String &out) {
+  String value = cmd.length() > 10 ? cmd.substring(10) : "";
+  value.trim();
+  if (value.length() == 0) {
+    out = "Usage: /pc_connect <alias|host>\nExample: /pc_connect office-pc";
+    return true;
   }
+  return pc_target_write(value, out);
+}
 
-  if (s_pending_reminder_tz.active) {
-    String guessed_tz;
-    if (extract_timezone_from_text(cmd, guessed_tz)) {
-      String err;
-      if (!persona_set_timezone(guessed_tz, err)) {
-        out = "ERR: " + err;
-        return true;
-      }
-      if (!persona_set_daily_reminder(s_pending_reminder_tz.hhmm, s_pending_reminder_tz.message, err)) {
-        out = "ERR: " + err;
-        return true;
-      }
-      if (is_webjob_message(s_pending_reminder_tz.message)) {
-        event_log_append("WEBJOB set daily " + s_pending_reminder_tz.hhmm);
-      } else {
-        event_log_append("REMINDER set daily " + s_pending_reminder_tz.hhmm);
-      }
-      String msg_for_user = reminder_message_for_user(s_pending_reminder_tz.message);
-      out = "OK: timezone set to " + guessed_tz +
-            "\nOK: daily reminder set at " + s_pending_reminder_tz.hhmm +
-            "\nMessage: " + msg_for_user + unsynced_time_warning();
-      clear_pending_reminder_tz();
-      return true;
-    }
+static bool cmd_pc_run(const String &cmd, const String &cmd_lc, String &out) {
+  String payload = cmd.length() > 6 ? cmd.substring(6) : "";
+  payload = compact_spaces(payload);
+  if (payload.length() == 0) {
+    out = "Usage: /pc_run <allowlisted_command>";
+    return true;
   }
+  return queue_pc_bridge_task("shell", payload, out);
+}
 
-  if (handle_onboarding_flow(cmd, cmd_lc, out)) {
+static bool cmd_pc_browser(const String &cmd, const String &cmd_lc, String &out) {
+  String payload = cmd.length() > 10 ? cmd.substring(10) : "";
+  payload = compact_spaces(payload);
+  if (payload.length() == 0) {
+    out = "Usage: /pc_browser <task_description>";
     return true;
   }
+  return queue_pc_bridge_task("browser", payload, out);
+}
 
-  if (looks_like_email_request(cmd_lc) && !cmd_lc.startsWith("send_email ") &&
-      !cmd_lc.startsWith("email_")) {
-    String to, subject, body, llm_err;
-    if (llm_parse_email_request(cmd, to, subject, body, llm_err)) {
-      if (to.length() > 0) {
-        // Use default subject if LLM didn't provide one
-        if (subject.length() == 0) {
-          subject = "Message from ESP32 Bot";
-        }
-        String email_err;
-        String html_content = "<p>" + body + "</p>";
+static bool cmd_fresh_start(const String &cmd, const String &cmd_lc, String &out) {
+  return clear_all_conversation_context(out);
+}
 
-        if (email_send(to, subject, html_content, body, email_err)) {
-          out = "OK: Email sent to " + to;
-          return true;
-        } else {
-          out = "ERR: " + email_err;
-          return true;
-        }
-      }
+static bool cmd_health(const String &cmd, const String &cmd_lc, String &out) {
+  String notes;
+  String mem_err;
+  size_t note_chars = 0;
+  if (memory_get_notes(notes, mem_err)) {
+    note_chars = notes.length();
+  }
+  String soul;
+  String heartbeat;
+  String persona_err;
+  size_t soul_chars = 0;
+  size_t heartbeat_chars = 0;
+  if (persona_get_soul(soul, persona_err)) {
+    soul_chars = soul.length();
+  }
+  if (persona_get_heartbeat(heartbeat, persona_err)) {
+    heartbeat_chars = heartbeat.length();
+  }
+
+  String pending = "none";
+  PendingLock pending_guard;
+  if (s_pending.active) {
+    unsigned long remain_ms = 0;
+    if (!is_expired(s_pending.expires_ms)) {
+      remain_ms = s_pending.expires_ms - millis();
+    }
+    if (s_pending.type == PENDING_RELAY_SET) {
+      pending = "relay_set id=" + String(s_pending.id) + " pin=" + String(s_pending.pin) +
+                " state=" + String(s_pending.state) + " ttl_ms=" + String(remain_ms);
+    } else if (s_pending.type == PENDING_LED_FLASH) {
+      pending = "flash_led id=" + String(s_pending.id) + " count=" + String(s_pending.led_count) +
+                " ttl_ms=" + String(remain_ms);
+    } else {
+      pending = "unknown id=" + String(s_pending.id) + " ttl_ms=" + String(remain_ms);
     }
-    // If LLM parsing failed, fall through to normal command processing
   }
 
-  if (cmd_lc == "help") {
-    build_help_text(out);
-    return true;
+  out = "OK: health\n"
+        "uptime_s=" + String(millis() / 1000UL) + "\n"
+        "heap=" + String(ESP.getFreeHeap()) + "\n"
+        "wifi=" + wifi_health_line() + "\n"
+        "memory_chars=" + String(note_chars) + "\n"
+        "soul_chars=" + String(soul_chars) + "\n"
+        "heartbeat_chars=" + String(heartbeat_chars) + "\n"
+        "pending=" + pending + "\n"
+        "safe_mode=" + String(is_safe_mode_enabled() ? "on" : "off");
+
+  String tz;
+  if (persona_get_timezone(tz, persona_err)) {
+    tz.trim();
+    if (tz.length() == 0) {
+      tz = String(TIMEZONE_TZ) + " (default)";
+    }
+    out += "\ntimezone=" + tz;
   }
 
-  if (cmd_lc == "status") {
-    out = "OK: alive";
-    return true;
+  String rem_hhmm;
+  String rem_msg;
+  if (persona_get_daily_reminder(rem_hhmm, rem_msg, persona_err)) {
+    rem_hhmm.trim();
+    rem_msg.trim();
+    if (rem_hhmm.length() > 0 && rem_msg.length() > 0) {
+      if (is_webjob_message(rem_msg)) {
+        String task = webjob_task_from_message(rem_msg);
+        out += "\nwebjob_daily=" + rem_hhmm + " task_chars=" + String(task.length());
+      } else {
+        out += "\nreminder_daily=" + rem_hhmm + " msg_chars=" + String(rem_msg.length());
+      }
+    } else {
+      out += "\nreminder_daily=none";
+    }
   }
+  return true;
+}
 
-  if (cmd_lc == "pc_status") {
-    const String target = pc_target_read();
-    out = pc_bridge_quickstart(target);
-    return true;
+static bool cmd_specs(const String &cmd, const String &cmd_lc, String &out) {
+  // Chip and flash info
+  out = "=== ESP32 Specs ===\n\n";
+  out += "Chip: " + String(ESP.getChipModel()) + "\n";
+  out += "Cores: " + String(ESP.getChipCores()) + "\n";
+  out += "CPU Frequency: " + String(ESP.getCpuFreqMHz()) + " MHz\n";
+  out += "Flash Size: " + String(ESP.getFlashChipSize() / 1024) + " KB\n";
+  out += "Sketch Size: " + String(ESP.getSketchSize() / 1024) + " KB\n";
+  out += "Free Sketch Space: " + String(ESP.getFreeSketchSpace() / 1024) + " KB\n\n";
+
+  // RAM info
+  out += "=== RAM ===\n";
+  out += "Free Heap: " + String(ESP.getFreeHeap()) + " bytes\n";
+  out += "Largest Free Block: " + String(ESP.getMaxAllocHeap()) + " bytes\n";
+  out += "Total Heap: " + String(ESP.getHeapSize()) + " bytes\n";
+  String pool_line;
+  msg_pool_describe(pool_line);
+  out += pool_line + "\n";
+  String spool_line;
+  msg_spool_describe(spool_line);
+  out += spool_line + "\n";
+  String cache_line;
+  response_cache_describe(cache_line);
+  out += cache_line + "\n\n";
+
+  // PSRAM info (if available)
+  if (psram_available()) {
+    String psram_line;
+    psram_alloc_describe(psram_line);
+    out += "=== PSRAM ===\n";
+    out += psram_line + "\n\n";
+  } else {
+    out += "=== PSRAM: Not Available ===\n\n";
   }
 
-  if (cmd_lc == "pc_connect" || cmd_lc.startsWith("pc_connect ")) {
-    String value = cmd.length() > 10 ? cmd.substring(10) : "";
-    value.trim();
-    if (value.length() == 0) {
-      out = "Usage: /pc_connect <alias|host>\nExample: /pc_connect office-pc";
-      return true;
-    }
-    return pc_target_write(value, out);
+  // NVS Storage breakdown
+  out += "=== NVS Storage (61KB partition) ===\n";
+  out += "Used / Limit:\n\n";
+
+  // Memory
+  String mem;
+  String mem_err;
+  if (memory_get_notes(mem, mem_err)) {
+    size_t used = mem.length();
+    size_t limit = MEMORY_MAX_CHARS;
+    int percent = (used * 100) / limit;
+    out += "memory: " + String(used) + " / " + String(limit) + " chars (" + String(percent) + "%)\n";
+  } else {
+    out += "memory: Error\n";
   }
 
-  if (cmd_lc == "pc_run" || cmd_lc.startsWith("pc_run ")) {
-    String payload = cmd.length() > 6 ? cmd.substring(6) : "";
-    payload = compact_spaces(payload);
-    if (payload.length() == 0) {
-      out = "Usage: /pc_run <allowlisted_command>";
-      return true;
+  // Chat history
+  String chat;
+  String chat_err;
+  if (chat_history_get(chat, chat_err)) {
+    size_t used = chat.length();
+    size_t lines = 0;
+    for (size_t i = 0; i < chat.length(); i++) {
+      if (chat[i] == '\n') lines++;
     }
-    return queue_pc_bridge_task("shell", payload, out);
+    out += "chat_history: " + String(lines) + " lines, " + String(used) + " chars\n";
+  } else {
+    out += "chat_history: " + String(chat_err) + "\n";
   }
 
-  if (cmd_lc == "pc_browser" || cmd_lc.startsWith("pc_browser ")) {
-    String payload = cmd.length() > 10 ? cmd.substring(10) : "";
-    payload = compact_spaces(payload);
-    if (payload.length() == 0) {
-      out = "Usage: /pc_browser <task_description>";
-      return true;
-    }
-    return queue_pc_bridge_task("browser", payload, out);
+  // Persona (soul + heartbeat)
+  String soul, heartbeat, persona_err;
+  size_t persona_used = 0;
+  if (persona_get_soul(soul, persona_err)) {
+    persona_used += soul.length();
+  }
+  if (persona_get_heartbeat(heartbeat, persona_err)) {
+    persona_used += heartbeat.length();
   }
+  out += "persona: " + String(persona_used) + " chars used\n";
 
-  if (cmd_lc == "fresh_start" || cmd_lc == "start_fresh" || cmd_lc == "context_clear" ||
-      cmd_lc == "clear context" || cmd_lc == "reset context" ||
-      cmd_lc == "start from scratch" || cmd_lc == "new chat") {
-    return clear_all_conversation_context(out);
+  // Tasks
+  {
+    size_t used = task_store_count();
+    size_t limit = TASKS_MAX_RECORDS;
+    int percent = (used * 100) / limit;
+    out += "tasks: " + String(used) + " / " + String(limit) + " records (" + String(percent) + "%)\n";
   }
 
-  if (cmd_lc == "health") {
-    String notes;
-    String mem_err;
-    size_t note_chars = 0;
-    if (memory_get_notes(notes, mem_err)) {
-      note_chars = notes.length();
-    }
-    String soul;
-    String heartbeat;
-    String persona_err;
-    size_t soul_chars = 0;
-    size_t heartbeat_chars = 0;
-    if (persona_get_soul(soul, persona_err)) {
-      soul_chars = soul.length();
-    }
-    if (persona_get_heartbeat(heartbeat, persona_err)) {
-      heartbeat_chars = heartbeat.length();
-    }
+  // Model config
+  String active_provider = model_config_get_active_provider();
+  out += "\n=== LLM Config ===\n";
+  out += "Active Provider: " + (active_provider.length() > 0 ? active_provider : "(none)") + "\n";
+  out += "Configured: " + model_config_get_configured_list() + "\n";
 
-    String pending = "none";
-    if (s_pending.active) {
-      unsigned long remain_ms = 0;
-      if (!is_expired(s_pending.expires_ms)) {
-        remain_ms = s_pending.expires_ms - millis();
-      }
-      if (s_pending.type == PENDING_RELAY_SET) {
-        pending = "relay_set id=" + String(s_pending.id) + " pin=" + String(s_pending.pin) +
-                  " state=" + String(s_pending.state) + " ttl_ms=" + String(remain_ms);
-      } else if (s_pending.type == PENDING_LED_FLASH) {
-        pending = "flash_led id=" + String(s_pending.id) + " count=" + String(s_pending.led_count) +
-                  " ttl_ms=" + String(remain_ms);
-      } else {
-        pending = "unknown id=" + String(s_pending.id) + " ttl_ms=" + String(remain_ms);
-      }
-    }
+  // WiFi
+  out += "\n=== WiFi ===\n";
+  String link;
+  wifi_link_describe(link);
+  out += link + "\n";
 
-    out = "OK: health\n"
-          "uptime_s=" + String(millis() / 1000UL) + "\n"
-          "heap=" + String(ESP.getFreeHeap()) + "\n"
-          "wifi=" + wifi_health_line() + "\n"
-          "memory_chars=" + String(note_chars) + "\n"
-          "soul_chars=" + String(soul_chars) + "\n"
-          "heartbeat_chars=" + String(heartbeat_chars) + "\n"
-          "pending=" + pending + "\n"
-          "safe_mode=" + String(is_safe_mode_enabled() ? "on" : "off");
+  return true;
+}
 
-    String tz;
-    if (persona_get_timezone(tz, persona_err)) {
-      tz.trim();
-      if (tz.length() == 0) {
-        tz = String(TIMEZONE_TZ) + " (default)";
-      }
-      out += "\ntimezone=" + tz;
-    }
-
-    String rem_hhmm;
-    String rem_msg;
-    if (persona_get_daily_reminder(rem_hhmm, rem_msg, persona_err)) {
-      rem_hhmm.trim();
-      rem_msg.trim();
-      if (rem_hhmm.length() > 0 && rem_msg.length() > 0) {
-        if (is_webjob_message(rem_msg)) {
-          String task = webjob_task_from_message(rem_msg);
-          out += "\nwebjob_daily=" + rem_hhmm + " task_chars=" + String(task.length());
-        } else {
-          out += "\nreminder_daily=" + rem_hhmm + " msg_chars=" + String(rem_msg.length());
-        }
-      } else {
-        out += "\nreminder_daily=none";
-      }
-    }
-    return true;
-  }
+static bool cmd_usage(const String &cmd, const String &cmd_lc, String &out) {
+  usage_get_report(out);
+  return true;
+}
 
-  if (cmd_lc == "specs") {
-    // Chip and flash info
-    out = "=== ESP32 Specs ===\n\n";
-    out += "Chip: " + String(ESP.getChipModel()) + "\n";
-    out += "Cores: " + String(ESP.getChipCores()) + "\n";
-    out += "CPU Frequency: " + String(ESP.getCpuFreqMHz()) + " MHz\n";
-    out += "Flash Size: " + String(ESP.getFlashChipSize() / 1024) + " KB\n";
-    out += "Sketch Size: " + String(ESP.getSketchSize() / 1024) + " KB\n";
-    out += "Free Sketch Space: " + String(ESP.getFreeSketchSpace() / 1024) + " KB\n\n";
+static bool cmd_usage_reset(const String &cmd, const String &cmd_lc, String &out) {
+  usage_reset();
+  out = "Usage statistics have been reset.";
+  return true;
+}
 
-    // RAM info
-    out += "=== RAM ===\n";
-    out += "Free Heap: " + String(ESP.getFreeHeap()) + " bytes\n";
-    out += "Largest Free Block: " + String(ESP.getMaxAllocHeap()) + " bytes\n";
-    out += "Total Heap: " + String(ESP.getHeapSize()) + " bytes\n\n";
+static bool cmd_security(const String &cmd, const String &cmd_lc, String &out) {
+  out = "=== Security Status ===\n\n";
 
-    // PSRAM info (if available)
-    if (psramFound()) {
-      out += "=== PSRAM ===\n";
-      out += "PSRAM Total: " + String(ESP.getPsramSize()) + " bytes\n";
-      out += "PSRAM Free: " + String(ESP.getFreePsram()) + " bytes\n\n";
-    } else {
-      out += "=== PSRAM: Not Available ===\n\n";
-    }
+  // Allowed Chat ID
+  out += "Allowed Chat ID: " + String(TELEGRAM_ALLOWED_CHAT_ID) + "\n";
+  if (strlen(TELEGRAM_TEAM_CHAT_IDS) > 0) {
+    out += "Team Chat IDs: " TELEGRAM_TEAM_CHAT_IDS "\n";
+  }
 
-    // NVS Storage breakdown
-    out += "=== NVS Storage (61KB partition) ===\n";
-    out += "Used / Limit:\n\n";
+  // Safe Mode
+  out += "Safe Mode: " + String(is_safe_mode_enabled() ? "ON (risky actions blocked)" : "OFF (risky actions allowed)") + "\n";
 
-    // Memory
-    String mem;
-    String mem_err;
-    if (memory_get_notes(mem, mem_err)) {
-      size_t used = mem.length();
-      size_t limit = MEMORY_MAX_CHARS;
-      int percent = (used * 100) / limit;
-      out += "memory: " + String(used) + " / " + String(limit) + " chars (" + String(percent) + "%)\n";
-    } else {
-      out += "memory: Error\n";
-    }
+  // WiFi Security
+  out += "\n=== WiFi ===\n";
+  out += "Connected: " + String(WiFi.isConnected() ? "Yes" : "No") + "\n";
+  if (WiFi.isConnected()) {
+    out += "SSID: " + WiFi.SSID() + "\n";
+    out += "RSSI: " + String(WiFi.RSSI()) + " dBm\n";
+    out += "IP: " + WiFi.localIP().toString() + "\n";
+  }
 
-    // Chat history
-    String chat;
-    String chat_err;
-    if (chat_history_get(chat, chat_err)) {
-      size_t used = chat.length();
-      size_t lines = 0;
-      for (size_t i = 0; i < chat.length(); i++) {
-        if (chat[i] == '\n') lines++;
-      }
-      out += "chat_history: " + String(lines) + " lines, " + String(used) + " chars\n";
-    } else {
-      out += "chat_history: " + String(chat_err) + "\n";
-    }
+  // TLS Status (we use insecure TLS - setInsecure)
+  out += "\n=== TLS ===\n";
+  out += "Mode: INSECURE (setInsecure)\n";
+  out += "Note: For production, use certificate pinning\n";
 
-    // Persona (soul + heartbeat)
-    String soul, heartbeat, persona_err;
-    size_t persona_used = 0;
-    if (persona_get_soul(soul, persona_err)) {
-      persona_used += soul.length();
-    }
-    if (persona_get_heartbeat(heartbeat, persona_err)) {
-      persona_used += heartbeat.length();
-    }
-    out += "persona: " + String(persona_used) + " chars used\n";
+  // Firmware integrity
+  out += "\n=== Firmware ===\n";
+  out += "Sketch Size: " + String(ESP.getSketchSize() / 1024) + " KB\n";
+  out += "Free Sketch Space: " + String(ESP.getFreeSketchSpace() / 1024) + " KB\n";
+  out += "Flash Chip Size: " + String(ESP.getFlashChipSize() / (1024 * 1024)) + " MB\n";
+  out += "CPU: " + String(ESP.getChipModel()) + " @ " + String(ESP.getCpuFreqMHz()) + " MHz\n";
 
-    // Tasks
-    String tasks, tasks_err;
-    if (task_list(tasks, tasks_err)) {
-      size_t used = tasks.length();
-      size_t limit = TASKS_MAX_CHARS;
-      int percent = (used * 100) / limit;
-      out += "tasks: " + String(used) + " / " + String(limit) + " chars (" + String(percent) + "%)\n";
-    } else {
-      out += "tasks: " + tasks_err + "\n";
-    }
+  // Recent activity hint
+  out += "\n=== Recommendations ===\n";
+  if (!is_safe_mode_enabled()) {
+    out += "⚠️ Enable safe_mode to block risky GPIO actions\n";
+  }
+  out += "✅ Chat ID restriction active\n";
+  out += "⚠️ Consider using HTTPS/TLS certificates for production\n";
 
-    // Model config
-    String active_provider = model_config_get_active_provider();
-    out += "\n=== LLM Config ===\n";
-    out += "Active Provider: " + (active_provider.length() > 0 ? active_provider : "(none)") + "\n";
-    out += "Configured: " + model_config_get_configured_list() + "\n";
+  return true;
+}
 
-    // WiFi
-    out += "\n=== WiFi ===\n";
-    out += wifi_health_line() + "\n";
-    out += "RSSI: " + String(WiFi.RSSI()) + " dBm\n";
+// Update command - show firmware info or trigger OTA update from URL
+static bool cmd_update(const String &cmd, const String &cmd_lc, String &out) {
+  // Check if user wants latest from GitHub (natural-language requests land here too)
+  const String &input_lc = cmd_lc;
+  bool wants_latest = (input_lc.indexOf("latest") >= 0 || input_lc.indexOf("newest") >= 0 ||
+                      input_lc.indexOf("github") >= 0 || input_lc.indexOf("to version") >= 0);
+
+  if (wants_latest) {
+    // User wants to check GitHub for latest release
+    out = "=== Checking GitHub Releases ===\n\n";
+    const String github_repo = github_update_repo();
+    out += "Repo: " + github_repo + "\n";
+    out += "Fetching latest release...\n";
+
+    OtaRelease release;
+    String err;
+    if (!ota_fetch_latest_release(github_repo, release, err)) {
+      out += "\n" + err + "\n";
+      out += err.startsWith("No firmware.bin") ? "Please upload firmware.bin to GitHub Releases"
+                                               : "Check that GITHUB_REPO is set correctly";
+      return true;
+    }
 
+    // Store pending update for "yes" confirmation
+    offer_update(release);
+    out += "\nLatest Release: " + release.version + "\n";
+    out += "Reply **yes** to update now\n";
+    out += "(ESP32 will restart after update)";
+    Serial.println("[update] Latest: " + release.version + " from " + release.url);
     return true;
   }
 
-  if (cmd_lc == "usage") {
-    usage_get_report(out);
-    return true;
-  }
+  // Show firmware info
+  out = "=== Firmware Update ===\n\n";
+  out += "Current Firmware:\n";
+  out += "Sketch Size: " + String(ESP.getSketchSize() / 1024) + " KB\n";
+  out += "Free Space: " + String(ESP.getFreeSketchSpace() / 1024) + " KB\n";
+  out += "Flash Chip: " + String(ESP.getFlashChipSize() / (1024 * 1024)) + " MB\n";
+  out += "CPU: " + String(ESP.getChipModel()) + " @ " + String(ESP.getCpuFreqMHz()) + " MHz\n";
+  out += "SDK Version: " + String(ESP.getSdkVersion()) + "\n";
 
-  if (cmd_lc == "usage_reset") {
-    usage_reset();
-    out = "Usage statistics have been reset.";
-    return true;
-  }
+  // Check for URL parameter, optionally followed by the image's SHA-256
+  int space_idx = cmd.indexOf(' ');
+  if (space_idx > 0) {
+    String url = cmd.substring(space_idx + 1);
+    url.trim();
+    String sha256;
+    const int sha_idx = url.indexOf(' ');
+    if (sha_idx > 0) {
+      sha256 = url.substring(sha_idx + 1);
+      sha256.trim();
+      url = url.substring(0, sha_idx);
+    }
 
-  if (cmd_lc == "security") {
-    out = "=== Security Status ===\n\n";
+    if (url.length() > 0) {
+      return run_ota_update(url, sha256, "", out);
+    }
+  }
 
-    // Allowed Chat ID
-    out += "Allowed Chat ID: " + String(TELEGRAM_ALLOWED_CHAT_ID) + "\n";
+  // No URL provided, show instructions
+  out += "\n=== How to Update ===\n";
+  out += "\nOption 1: OTA from Computer\n";
+  out += "1. Build firmware: pio run\n";
+  out += "2. Flash via OTA: pio run -t upload --upload-port espota --upload-port " + WiFi.localIP().toString() + "\n";
 
-    // Safe Mode
-    out += "Safe Mode: " + String(is_safe_mode_enabled() ? "ON (risky actions blocked)" : "OFF (risky actions allowed)") + "\n";
+  out += "\nOption 2: Self-Update from URL\n";
+  out += "Usage: update <firmware_url> [sha256]\n";
+  out += "Example: update https://github.com/user/timiclaw/releases/download/v1.0/firmware.bin\n";
+  out += "\nNote: For self-update, host your firmware.bin on GitHub Releases or a web server.";
 
-    // WiFi Security
-    out += "\n=== WiFi ===\n";
-    out += "Connected: " + String(WiFi.isConnected() ? "Yes" : "No") + "\n";
-    if (WiFi.isConnected()) {
-      out += "SSID: " + WiFi.SSID() + "\n";
-      out += "RSSI: " + String(WiFi.RSSI()) + " dBm\n";
-      out += "IP: " + WiFi.localIP().toString() + "\n";
-    }
+  return true;
+}
 
-    // TLS Status (we use insecure TLS - setInsecure)
-    out += "\n=== TLS ===\n";
-    out += "Mode: INSECURE (setInsecure)\n";
-    out += "Note: For production, use certificate pinning\n";
+static bool cmd_logs(const String &cmd, const String &cmd_lc, String &out) {
+  event_log_dump(out, 1400);
+  return true;
+}
 
-    // Firmware integrity
-    out += "\n=== Firmware ===\n";
-    out += "Sketch Size: " + String(ESP.getSketchSize() / 1024) + " KB\n";
-    out += "Free Sketch Space: " + String(ESP.getFreeSketchSpace() / 1024) + " KB\n";
-    out += "Flash Chip Size: " + String(ESP.getFlashChipSize() / (1024 * 1024)) + " MB\n";
-    out += "CPU: " + String(ESP.getChipModel()) + " @ " + String(ESP.getCpuFreqMHz()) + " MHz\n";
+static bool cmd_logs_clear(const String &cmd, const String &cmd_lc, String &out) {
+  event_log_clear();
+  out = "OK: logs cleared";
+  return true;
+}
 
-    // Recent activity hint
-    out += "\n=== Recommendations ===\n";
-    if (!is_safe_mode_enabled()) {
-      out += "⚠️ Enable safe_mode to block risky GPIO actions\n";
-    }
-    out += "✅ Chat ID restriction active\n";
-    out += "⚠️ Consider using HTTPS/TLS certificates for production\n";
+static bool cmd_power(const String &cmd, const String &cmd_lc, String &out) {
+  power_describe(out);
+  return true;
+}
 
-    return true;
-  }
+static bool cmd_trace(const String &cmd, const String &cmd_lc, String &out) {
+  trace_dump(out, 1800);
+  return true;
+}
 
-  // Natural language update request handling
-  // Skip if it's "update http/https" (let exact handler process URLs)
-  if (looks_like_update_request(cmd_lc) && !cmd_lc.startsWith("update http")) {
-    String url;
-    bool should_update;
-    bool check_github = false;
-    String llm_err;
-    if (llm_parse_update_request(cmd, url, should_update, check_github, llm_err)) {
-      if (should_update) {
-        // If check_github is true, fetch from GitHub releases
-        if (check_github) {
-          out = "=== Checking GitHub Releases ===\n\n";
-
-          // Get GitHub repo from env (default to timiclaw project)
-          String github_repo = GITHUB_REPO;
-          if (github_repo.length() == 0) {
-            github_repo = "timiclaw/timiclaw";  // Default
-          }
-
-          out += "Repo: " + github_repo + "\n";
-          out += "Fetching latest release...\n";
-
-          // Fetch latest release from GitHub API
-          WiFiClientSecure client;
-          client.setInsecure();
-          HTTPClient http;
-
-          String api_url = "https://api.github.com/repos/" + github_repo + "/releases/latest";
-          Serial.println("[update] Fetching: " + api_url);
-
-          if (http.begin(client, api_url)) {
-            int http_code = http.GET();
-
-            if (http_code == 200) {
-              String payload = http.getString();
-
-              // Parse JSON to find the firmware.bin download URL
-              // GitHub API returns: {"tag_name":"v1.0","assets":[{"name":"firmware.bin","browser_download_url":"..."}]}
-              int tag_idx = payload.indexOf("\"tag_name\":");
-              int assets_idx = payload.indexOf("\"assets\":");
-              int name_idx = payload.indexOf("\"name\":\"firmware.bin\"", assets_idx);
-              int url_idx = payload.indexOf("\"browser_download_url\":", name_idx);
-
-              if (tag_idx > 0 && assets_idx > 0 && name_idx > 0 && url_idx > 0) {
-                // Extract version tag
-                int tag_start = payload.indexOf("\"", tag_idx + 11) + 1;
-                int tag_end = payload.indexOf("\"", tag_start);
-                String version = payload.substring(tag_start, tag_end);
-
-                // Extract download URL
-                int url_start = payload.indexOf("\"", url_idx + 23) + 1;
-                int url_end = payload.indexOf("\"", url_start);
-                String download_url = payload.substring(url_start, url_end);
-
-                out += "\nLatest Release: " + version + "\n";
-                out += "Download URL: " + download_url + "\n";
-                out += "\nStarting update...\n";
-
-                Serial.println("[update] Latest: " + version + " from " + download_url);
-
-                // Perform update
-                t_httpUpdate_return ret = httpUpdate.update(client, download_url);
-
-                switch (ret) {
-                  case HTTP_UPDATE_FAILED:
-                    Serial.println("[update] Failed: " + String(httpUpdate.getLastError()));
-                    out = "\nERR: Update failed\n" + httpUpdate.getLastErrorString();
-                    break;
-                  case HTTP_UPDATE_NO_UPDATES:
-                    Serial.println("[update] No updates available");
-                    out = "\nERR: No updates available";
-                    break;
-                  case HTTP_UPDATE_OK:
-                    Serial.println("[update] Success! Restarting...");
-                    out = "\nOK: Updated to " + version + "! Restarting...";
-                    break;
-                }
-                http.end();
-                return true;
-              } else {
-                out += "\nERR: No firmware.bin found in release assets\n";
-                out += "Please upload firmware.bin to GitHub Releases";
-                http.end();
-                return true;
-              }
-            } else {
-              out += "\nERR: GitHub API HTTP " + String(http_code) + "\n";
-              out += "Check that GITHUB_REPO is set correctly";
-              http.end();
-              return true;
-            }
-          } else {
-            out = "\nERR: Could not connect to GitHub API";
-            return true;
-          }
-        }
-        // If URL was provided, trigger update
-        else if (url.length() > 0) {
-          out = "=== Firmware Update ===\n\n";
-          out += "URL: " + url + "\n";
-          out += "Downloading and flashing...\n";
-          out += "(ESP32 will restart after update)\n";
-
-          Serial.println("[update] Starting update from: " + url);
-
-          WiFiClientSecure client;
-          client.setInsecure();
-
-          t_httpUpdate_return ret = httpUpdate.update(client, url);
-
-          switch (ret) {
-            case HTTP_UPDATE_FAILED:
-              Serial.println("[update] Failed: " + String(httpUpdate.getLastError()) + " - " + httpUpdate.getLastErrorString());
-              out = "ERR: Update failed\n" + httpUpdate.getLastErrorString();
-              break;
-            case HTTP_UPDATE_NO_UPDATES:
-              Serial.println("[update] No updates available");
-              out = "ERR: No updates available";
-              break;
-            case HTTP_UPDATE_OK:
-              Serial.println("[update] Success! Restarting...");
-              out = "OK: Update complete! Restarting...";
-              break;
-          }
-          return true;
-        } else {
-          // No URL provided, show update info (like plain /update command)
-          cmd = "update";  // Fall through to exact command handler
-        }
-      }
-    }
-    // If LLM parsing fails or doesn't detect update intent, fall through to normal command processing
-  }
-
-  // Update command - show firmware info or trigger OTA update from URL
-  if (cmd_lc == "update") {
-    // Check if user wants latest from GitHub (check original input for keywords)
-    String input_lc = input;
-    input_lc.toLowerCase();
-    bool wants_latest = (input_lc.indexOf("latest") >= 0 || input_lc.indexOf("newest") >= 0 ||
-                        input_lc.indexOf("github") >= 0 || input_lc.indexOf("to version") >= 0);
-
-    if (wants_latest) {
-      // User wants to check GitHub for latest release
-      out = "=== Checking GitHub Releases ===\n\n";
-
-      String github_repo = GITHUB_REPO;
-      if (github_repo.length() == 0) {
-        github_repo = "timiclaw/timiclaw";
-      }
-
-      out += "Repo: " + github_repo + "\n";
-      out += "Fetching latest release...\n";
-
-      // Fetch latest release from GitHub API
-      WiFiClientSecure client;
-      client.setInsecure();
-      HTTPClient http;
-
-      String api_url = "https://api.github.com/repos/" + github_repo + "/releases/latest";
-      Serial.println("[update] Fetching: " + api_url);
-
-      if (http.begin(client, api_url)) {
-        int http_code = http.GET();
-
-        if (http_code == 200) {
-          String payload = http.getString();
-
-          // Parse JSON to find version and download URL
-          int tag_idx = payload.indexOf("\"tag_name\":");
-          int assets_idx = payload.indexOf("\"assets\":");
-          int name_idx = payload.indexOf("\"name\":\"firmware.bin\"", assets_idx);
-          int url_idx = payload.indexOf("\"browser_download_url\":", name_idx);
-
-          if (tag_idx > 0 && assets_idx > 0 && name_idx > 0 && url_idx > 0) {
-            // Extract version tag
-            int tag_start = payload.indexOf("\"", tag_idx + 11) + 1;
-            int tag_end = payload.indexOf("\"", tag_start);
-            String version = payload.substring(tag_start, tag_end);
+static bool cmd_trace_clear(const String &cmd, const String &cmd_lc, String &out) {
+  trace_clear();
+  out = "OK: trace cleared";
+  return true;
+}
 
-            // Extract download URL
-            int url_start = payload.indexOf("\"", url_idx + 23) + 1;
-            int url_end = payload.indexOf("\"", url_start);
-            String download_url = payload.substring(url_start, url_end);
+static bool cmd_cache(const String &cmd, const String &cmd_lc, String &out) {
+  response_cache_describe(out);
+  return true;
+}
 
-            // Store pending update for "yes" confirmation
-            s_pending_update.available = true;
-            s_pending_update.version = version;
-            s_pending_update.download_url = download_url;
-            s_pending_update.notified_ms = millis();
+static bool cmd_cache_clear(const String &cmd, const String &cmd_lc, String &out) {
+  response_cache_clear();
+  out = "OK: response cache cleared";
+  return true;
+}
 
-            out += "\nLatest Release: " + version + "\n";
-            out += "Reply **yes** to update now\n";
-            out += "(ESP32 will restart after update)";
+static bool cmd_bench(const String &cmd, const String &cmd_lc, String &out) {
+  String suite = cmd_lc.length() > 5 ? cmd_lc.substring(5) : "";
+  suite.trim();
+  out = "";
+  if (!bench_run_suite(suite, out)) {
+    out = "ERR: usage bench [" + String(bench_suite_names()) + "]";
+  }
+  return true;
+}
 
-            Serial.println("[update] Latest: " + version + " from " + download_url);
-            http.end();
-            return true;
-          } else {
-            out += "\nNo firmware.bin found in release\n";
-            out += "Please upload firmware.bin to GitHub Releases";
-            http.end();
-            return true;
-          }
-        } else {
-          out += "\nGitHub API HTTP " + String(http_code) + "\n";
-          out += "Check that GITHUB_REPO is set correctly";
-          http.end();
-          return true;
-        }
-      } else {
-        out = "\nCould not connect to GitHub API";
-        return true;
-      }
+// soak | soak start [per_min] [minutes] [latency_ms] [reply_bytes] | soak stop
+static bool cmd_soak(const String &cmd, const String &cmd_lc, String &out) {
+  String args = cmd_lc.length() > 4 ? cmd_lc.substring(4) : "";
+  args.trim();
+  out = "";
+  if (args.length() == 0 || args == "status") {
+    soak_describe(out);
+    return true;
+  }
+  if (args == "stop") {
+    if (!soak_stop(out)) {
+      out = "ERR: no soak run in progress";
     }
+    return true;
+  }
+  if (!args.startsWith("start")) {
+    out = "ERR: usage soak [start [per_min] [minutes] [latency_ms] [reply_bytes]|stop]";
+    return true;
+  }
 
-    // Show firmware info
-    out = "=== Firmware Update ===\n\n";
-    out += "Current Firmware:\n";
-    out += "Sketch Size: " + String(ESP.getSketchSize() / 1024) + " KB\n";
-    out += "Free Space: " + String(ESP.getFreeSketchSpace() / 1024) + " KB\n";
-    out += "Flash Chip: " + String(ESP.getFlashChipSize() / (1024 * 1024)) + " MB\n";
-    out += "CPU: " + String(ESP.getChipModel()) + " @ " + String(ESP.getCpuFreqMHz()) + " MHz\n";
-    out += "SDK Version: " + String(ESP.getSdkVersion()) + "\n";
-
-    // Check for URL parameter
-    int space_idx = cmd.indexOf(' ');
-    if (space_idx > 0) {
-      String url = cmd.substring(space_idx + 1);
-      url.trim();
-
-      if (url.length() > 0) {
-        out += "\n=== Starting Update ===\n";
-        out += "URL: " + url + "\n";
-        out += "Downloading and flashing...\n";
-        out += "(ESP32 will restart after update)\n";
-
-        // Send status message first
-        String status_msg = out;
-
-        // Perform the update (this will restart ESP32 on success)
-        Serial.println("[update] Starting update from: " + url);
-
-        WiFiClientSecure client;
-        client.setInsecure();  // For HTTPS URLs
-
-        t_httpUpdate_return ret = httpUpdate.update(client, url);
-
-        switch (ret) {
-          case HTTP_UPDATE_FAILED:
-            Serial.println("[update] Failed: " + String(httpUpdate.getLastError()) + " - " + httpUpdate.getLastErrorString());
-            out = status_msg + "\n\nERR: Update failed\n" + httpUpdate.getLastErrorString();
-            break;
-          case HTTP_UPDATE_NO_UPDATES:
-            Serial.println("[update] No updates available");
-            out = status_msg + "\n\nERR: No updates available";
-            break;
-          case HTTP_UPDATE_OK:
-            Serial.println("[update] Success! Restarting...");
-            out = status_msg + "\n\nOK: Update complete! Restarting...";
-            break;
-        }
-        return true;
-      }
+  SoakConfig config = soak_default_config();
+  uint32_t *fields[] = {&config.rate_per_min, &config.duration_min, &config.latency_ms,
+                        &config.reply_bytes};
+  String rest = args.substring(5);
+  for (uint32_t *field : fields) {
+    rest.trim();
+    if (rest.length() == 0) {
+      break;
     }
+    const int space = rest.indexOf(' ');
+    *field = (uint32_t)rest.substring(0, space < 0 ? rest.length() : space).toInt();
+    rest = space < 0 ? "" : rest.substring(space + 1);
+  }
 
-    // No URL provided, show instructions
-    out += "\n=== How to Update ===\n";
-    out += "\nOption 1: OTA from Computer\n";
-    out += "1. Build firmware: pio run\n";
-    out += "2. Flash via OTA: pio run -t upload --upload-port espota --upload-port " + WiFi.localIP().toString() + "\n";
-
-    out += "\nOption 2: Self-Update from URL\n";
-    out += "Usage: update <firmware_url>\n";
-    out += "Example: update https://github.com/user/timiclaw/releases/download/v1.0/firmware.bin\n";
-    out += "\nNote: For self-update, host your firmware.bin on GitHub Releases or a web server.";
-
+  String err;
+  if (!soak_start(config, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: soak started, " + String(config.rate_per_min) + " msg/min " +
+        (config.duration_min > 0 ? "for " + String(config.duration_min) + " min"
+                                 : String("until soak stop")) +
+        ", mock LLM " + String(config.latency_ms) + " ms / " + String(config.reply_bytes) +
+        " B. Check progress with soak";
+  return true;
+}
 
-  if (cmd_lc == "logs") {
-    event_log_dump(out, 1400);
-    return true;
+// Web search command (Serper > Tavily fallback + summary)
+static bool cmd_search(const String &cmd, const String &cmd_lc, String &out) {
+  String query;
+  if (cmd_lc.startsWith("search ")) {
+    query = cmd.substring(7);
   }
+  query.trim();
 
-  if (cmd_lc == "logs_clear") {
-    event_log_clear();
-    out = "OK: logs cleared";
+  if (query.length() == 0) {
+    out = "ERR: usage search <query>\nExample: search ESP32 programming tips";
     return true;
   }
 
-  // Web search command (Serper > Tavily fallback + summary)
-  if (cmd_lc == "search" || cmd_lc.startsWith("search ")) {
-    String query;
-    if (cmd_lc.startsWith("search ")) {
-      query = cmd.substring(7);
-    }
-    query.trim();
+  return tool_web_search(query, out);
+}
 
-    if (query.length() == 0) {
-      out = "ERR: usage search <query>\nExample: search ESP32 programming tips";
-      return true;
-    }
+#if ENABLE_VOICE
+// Voice capture commands - continuous streaming to Serial
+static bool cmd_voice_stream(const String &cmd, const String &cmd_lc, String &out) {
+  if (voice_start_streaming()) {
+    out = "🎤 Voice streaming STARTED!\n\n";
+    out += "Audio is now streaming to Serial as binary PCM.\n";
+    out += "Connect to COM port and capture using Python.\n";
+    out += "Use /voice_stop to end streaming.";
+  } else {
+    out = "ERR: Already streaming";
+  }
+  return true;
+}
+
+static bool cmd_voice_stop(const String &cmd, const String &cmd_lc, String &out) {
+  voice_stop_streaming();
+  out = "🎤 Voice streaming STOPPED";
+  return true;
+}
 
-    return tool_web_search(query, out);
+static bool cmd_voice_status(const String &cmd, const String &cmd_lc, String &out) {
+  if (voice_is_streaming()) {
+    out = "🎤 Currently streaming audio to Serial...";
+  } else {
+    out = "🎤 Voice idle (not streaming)";
   }
+  return true;
+}
+#endif
 
-#if ENABLE_VOICE
-  // Voice capture commands - continuous streaming to Serial
-  if (cmd_lc == "voice_start" || cmd_lc == "voice_stream") {
-    if (voice_start_streaming()) {
-      out = "🎤 Voice streaming STARTED!\n\n";
-      out += "Audio is now streaming to Serial as binary PCM.\n";
-      out += "Connect to COM port and capture using Python.\n";
-      out += "Use /voice_stop to end streaming.";
-    } else {
-      out = "ERR: Already streaming";
-    }
+static bool cmd_time_show(const String &cmd, const String &cmd_lc, String &out) {
+  scheduler_time_debug(out);
+  return true;
+}
+
+static bool cmd_safe_mode(const String &cmd, const String &cmd_lc, String &out) {
+  out = String("Safe mode: ") + (is_safe_mode_enabled() ? "ON" : "OFF");
+  return true;
+}
+
+static bool cmd_safe_mode_on(const String &cmd, const String &cmd_lc, String &out) {
+  String err;
+  if (!persona_set_safe_mode(true, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  clear_pending();
+  out = "OK: safe mode ON (risky actions blocked)";
+  return true;
+}
 
-  if (cmd_lc == "voice_stop" || cmd_lc == "voice_stop") {
-    voice_stop_streaming();
-    out = "🎤 Voice streaming STOPPED";
+static bool cmd_safe_mode_off(const String &cmd, const String &cmd_lc, String &out) {
+  String err;
+  if (!persona_set_safe_mode(false, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: safe mode OFF";
+  return true;
+}
 
-  if (cmd_lc == "voice_status" || cmd_lc == "voice_status") {
-    if (voice_is_streaming()) {
-      out = "🎤 Currently streaming audio to Serial...";
-    } else {
-      out = "🎤 Voice idle (not streaming)";
-    }
-    return true;
+#if ENABLE_TASKS
+static bool cmd_task_list(const String &cmd, const String &cmd_lc, String &out) {
+  String err;
+  if (!task_list(out, err)) {
+    out = "ERR: " + err;
   }
-#endif
+  return true;
+}
 
-  if (cmd_lc == "time_show" || cmd_lc == "clock" || cmd_lc == "time") {
-    scheduler_time_debug(out);
+static bool cmd_task_clear(const String &cmd, const String &cmd_lc, String &out) {
+  String err;
+  if (!task_clear(err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: tasks cleared";
+  return true;
+}
 
-  if (cmd_lc == "safe_mode") {
-    out = String("Safe mode: ") + (is_safe_mode_enabled() ? "ON" : "OFF");
-    return true;
+// Trailing "@ HH:MM" (next occurrence) or "@ YYYY-MM-DD [HH:MM]" (09:00 when
+// no time is given), in the user's timezone. Returns false on a bad spec.
+static bool parse_task_due(const String &spec, time_t &due_out, String &error_out) {
+  int year = 0, month = 0, day = 0, hour = 9, minute = 0;
+  const bool has_date = sscanf(spec.c_str(), "%d-%d-%d", &year, &month, &day) == 3;
+  const int colon = spec.indexOf(':');
+  if (colon > 0) {
+    const int space = spec.lastIndexOf(' ', colon);
+    if (sscanf(spec.c_str() + space + 1, "%d:%d", &hour, &minute) != 2) {
+      hour = -1;
+    }
+  } else if (!has_date) {
+    hour = -1;
+  }
+  if (hour < 0 || hour > 23 || minute < 0 || minute > 59 ||
+      (has_date && (month < 1 || month > 12 || day < 1 || day > 31))) {
+    error_out = "due must be @ HH:MM or @ YYYY-MM-DD [HH:MM]";
+    return false;
   }
 
-  if (cmd_lc == "safe_mode_on") {
-    String err;
-    if (!persona_set_safe_mode(true, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    clear_pending();
-    out = "OK: safe mode ON (risky actions blocked)";
-    return true;
+  const time_t now_epoch = time(nullptr);
+  struct tm now_tm{};
+  if (now_epoch < 1700000000 || !scheduler_get_local_time(now_tm)) {
+    error_out = "time not synced yet";
+    return false;
   }
+  struct tm due_tm = now_tm;
+  if (has_date) {
+    due_tm.tm_year = year - 1900;
+    due_tm.tm_mon = month - 1;
+    due_tm.tm_mday = day;
+  }
+  due_tm.tm_hour = hour;
+  due_tm.tm_min = minute;
+  due_tm.tm_sec = 0;
+  due_tm.tm_isdst = now_tm.tm_isdst;
+  // Both sides go through mktime, so the offset between them is local time
+  time_t delta = mktime(&due_tm) - mktime(&now_tm);
+  if (!has_date && delta <= 0) {
+    delta += 24 * 60 * 60;
+  }
+  if (delta <= 0) {
+    error_out = "that time has already passed";
+    return false;
+  }
+  due_out = now_epoch + delta;
+  return true;
+}
 
-  if (cmd_lc == "safe_mode_off") {
+static bool cmd_task_add(const String &cmd, const String &cmd_lc, String &out) {
+  String text = cmd.length() > 8 ? cmd.substring(8) : "";
+  text.trim();
+  time_t due = 0;
+  const int at = text.lastIndexOf(" @ ");
+  if (at > 0) {
+    String spec = text.substring(at + 3);
+    spec.trim();
     String err;
-    if (!persona_set_safe_mode(false, err)) {
+    if (!parse_task_due(spec, due, err)) {
       out = "ERR: " + err;
       return true;
     }
-    out = "OK: safe mode OFF";
+    text = text.substring(0, at);
+    text.trim();
+  }
+  if (text.length() == 0) {
+    out = "ERR: usage task_add <text> [@ HH:MM | @ YYYY-MM-DD [HH:MM]]";
     return true;
   }
-
-#if ENABLE_TASKS
-  if (cmd_lc == "task_list") {
-    String err;
-    if (!task_list(out, err)) {
-      out = "ERR: " + err;
-    }
+  int task_id = 0;
+  String err;
+  if (!task_add(text, task_id, err, due)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: task #" + String(task_id) + " added";
+  if (due > 0) {
+    scheduler_notify_changed();
+    out += ", reminder in " + String((long)((due - time(nullptr) + 59) / 60)) + " min";
+  }
+  return true;
+}
 
-  if (cmd_lc == "task_clear") {
-    String err;
-    if (!task_clear(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: tasks cleared";
+// Dispatched by the scheduler when a task's due time comes
+static bool cmd_task_remind(const String &cmd, const String &cmd_lc, String &out) {
+  String tail = cmd.length() > 12 ? cmd.substring(12) : "";
+  tail.trim();
+  int id = -1;
+  String text;
+  time_t due = 0;
+  if (!parse_one_int(tail, "%d", &id) || id <= 0 || !task_get(id, text, due)) {
+    out = "ERR: task not found";
     return true;
   }
+  out = "⏰ Task #" + String(id) + " due: " + text;
+  return true;
+}
 
-  if (cmd_lc == "task_add" || cmd_lc.startsWith("task_add ")) {
-    String text = cmd.length() > 8 ? cmd.substring(8) : "";
-    text.trim();
-    if (text.length() == 0) {
-      out = "ERR: usage task_add <text>";
-      return true;
-    }
-    int task_id = 0;
-    String err;
-    if (!task_add(text, task_id, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: task #" + String(task_id) + " added";
+static bool cmd_task_done(const String &cmd, const String &cmd_lc, String &out) {
+  String tail = cmd.length() > 9 ? cmd.substring(9) : "";
+  tail.trim();
+  int id = -1;
+  if (!parse_one_int(tail, "%d", &id) || id <= 0) {
+    out = "ERR: usage task_done <id>";
     return true;
   }
-
-  if (cmd_lc == "task_done" || cmd_lc.startsWith("task_done ")) {
-    String tail = cmd.length() > 9 ? cmd.substring(9) : "";
-    tail.trim();
-    int id = -1;
-    if (!parse_one_int(tail, "%d", &id) || id <= 0) {
-      out = "ERR: usage task_done <id>";
-      return true;
-    }
-    String err;
-    if (!task_done(id, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: task #" + String(id) + " done";
+  String err;
+  if (!task_done(id, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: task #" + String(id) + " done";
+  return true;
+}
 #endif
 
 #if ENABLE_EMAIL
-  if (cmd_lc == "email_show") {
-    String to;
-    String subject;
-    String body;
-    String err;
-    if (!persona_get_email_draft(to, subject, body, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    to.trim();
-    subject.trim();
-    body.trim();
-    if (to.length() == 0 && subject.length() == 0 && body.length() == 0) {
-      out = "Email draft is empty";
-      return true;
-    }
-    out = "Email draft:\nTo: " + to + "\nSubject: " + subject + "\nBody:\n" + body;
-    if (out.length() > 1400) {
-      out = out.substring(0, 1400) + "...";
-    }
+static bool cmd_email_show(const String &cmd, const String &cmd_lc, String &out) {
+  String to;
+  String subject;
+  String body;
+  String err;
+  if (!persona_get_email_draft(to, subject, body, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  to.trim();
+  subject.trim();
+  body.trim();
+  if (to.length() == 0 && subject.length() == 0 && body.length() == 0) {
+    out = "Email draft is empty";
+    return true;
+  }
+  out = "Email draft:\nTo: " + to + "\nSubject: " + subject + "\nBody:\n" + body;
+  if (out.length() > 1400) {
+    out = out.substring(0, 1400) + "...";
+  }
+  return true;
+}
 
-  if (cmd_lc == "email_clear") {
-    String err;
-    if (!persona_clear_email_draft(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: email draft cleared";
+static bool cmd_email_clear(const String &cmd, const String &cmd_lc, String &out) {
+  String err;
+  if (!persona_clear_email_draft(err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: email draft cleared";
+  return true;
+}
 
-  if (cmd_lc == "email_draft" || cmd_lc.startsWith("email_draft ")) {
-    String tail = cmd.length() > 11 ? cmd.substring(11) : "";
-    tail.trim();
-    int p1 = tail.indexOf('|');
-    int p2 = p1 >= 0 ? tail.indexOf('|', p1 + 1) : -1;
-    if (p1 <= 0 || p2 <= p1) {
-      out = "ERR: usage email_draft <to>|<subject>|<body>";
-      return true;
-    }
+static bool cmd_email_draft(const String &cmd, const String &cmd_lc, String &out) {
+  String tail = cmd.length() > 11 ? cmd.substring(11) : "";
+  tail.trim();
+  int p1 = tail.indexOf('|');
+  int p2 = p1 >= 0 ? tail.indexOf('|', p1 + 1) : -1;
+  if (p1 <= 0 || p2 <= p1) {
+    out = "ERR: usage email_draft <to>|<subject>|<body>";
+    return true;
+  }
 
-    String to = tail.substring(0, p1);
-    String subject = tail.substring(p1 + 1, p2);
-    String body = tail.substring(p2 + 1);
-    to.trim();
-    subject.trim();
-    body.trim();
+  String to = tail.substring(0, p1);
+  String subject = tail.substring(p1 + 1, p2);
+  String body = tail.substring(p2 + 1);
+  to.trim();
+  subject.trim();
+  body.trim();
 
-    if (to.length() == 0 || subject.length() == 0 || body.length() == 0) {
-      out = "ERR: usage email_draft <to>|<subject>|<body>";
-      return true;
-    }
+  if (to.length() == 0 || subject.length() == 0 || body.length() == 0) {
+    out = "ERR: usage email_draft <to>|<subject>|<body>";
+    return true;
+  }
 
-    String err;
-    if (!persona_set_email_draft(to, subject, body, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: email draft saved (draft only, not sent)";
+  String err;
+  if (!persona_set_email_draft(to, subject, body, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: email draft saved (draft only, not sent)";
+  return true;
+}
 #endif
 
-  if (cmd_lc == "time" || cmd_lc == "time_show") {
-    scheduler_time_debug(out);
+static bool cmd_timezone_show(const String &cmd, const String &cmd_lc, String &out) {
+  String tz;
+  String err;
+  if (!persona_get_timezone(tz, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  tz.trim();
+  if (tz.length() == 0) {
+    out = "Timezone not set. Using default: " + String(TIMEZONE_TZ) +
+          "\nSet with: timezone_set <Area/City>";
+    return true;
+  }
+  out = "Timezone: " + tz;
+  return true;
+}
 
-  if (cmd_lc == "timezone_show") {
-    String tz;
-    String err;
-    if (!persona_get_timezone(tz, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    tz.trim();
-    if (tz.length() == 0) {
-      out = "Timezone not set. Using default: " + String(TIMEZONE_TZ) +
-            "\nSet with: timezone_set <Area/City>";
-      return true;
-    }
-    out = "Timezone: " + tz;
+static bool cmd_timezone_clear(const String &cmd, const String &cmd_lc, String &out) {
+  String err;
+  if (!persona_clear_timezone(err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: timezone cleared. Using default " + String(TIMEZONE_TZ);
+  return true;
+}
 
-  if (cmd_lc == "timezone_clear") {
-    String err;
-    if (!persona_clear_timezone(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: timezone cleared. Using default " + String(TIMEZONE_TZ);
+static bool cmd_timezone_set(const String &cmd, const String &cmd_lc, String &out) {
+  String tz = cmd.length() > 12 ? cmd.substring(12) : "";
+  tz.trim();
+  if (!is_valid_timezone_string(tz)) {
+    out = "ERR: usage timezone_set <Area/City or UTC offset>\n"
+          "Example: timezone_set Asia/Kolkata";
     return true;
   }
 
-  if (cmd_lc == "timezone_set" || cmd_lc.startsWith("timezone_set ")) {
-    String tz = cmd.length() > 12 ? cmd.substring(12) : "";
-    tz.trim();
-    if (!is_valid_timezone_string(tz)) {
-      out = "ERR: usage timezone_set <Area/City or UTC offset>\n"
-            "Example: timezone_set Asia/Kolkata";
-      return true;
-    }
+  String err;
+  if (!persona_set_timezone(tz, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
 
-    String err;
-    if (!persona_set_timezone(tz, err)) {
+  PendingLock guard;
+  if (s_pending_reminder_tz.active && is_callers(s_pending_reminder_tz.chat)) {
+    if (!persona_set_daily_reminder(s_pending_reminder_tz.hhmm, s_pending_reminder_tz.message, err)) {
       out = "ERR: " + err;
       return true;
     }
-
-    if (s_pending_reminder_tz.active) {
-      if (!persona_set_daily_reminder(s_pending_reminder_tz.hhmm, s_pending_reminder_tz.message, err)) {
-        out = "ERR: " + err;
-        return true;
-      }
-      if (is_webjob_message(s_pending_reminder_tz.message)) {
-        event_log_append("WEBJOB set daily " + s_pending_reminder_tz.hhmm);
-      } else {
-        event_log_append("REMINDER set daily " + s_pending_reminder_tz.hhmm);
-      }
-      String msg_for_user = reminder_message_for_user(s_pending_reminder_tz.message);
-      out = "OK: timezone set to " + tz + "\nOK: daily reminder set at " + s_pending_reminder_tz.hhmm +
-            "\nMessage: " + msg_for_user + unsynced_time_warning();
-      clear_pending_reminder_tz();
-      return true;
+    if (is_webjob_message(s_pending_reminder_tz.message)) {
+      event_log_printf(EVT_WEBJOB, "set daily %s", s_pending_reminder_tz.hhmm.c_str());
+    } else {
+      event_log_printf(EVT_REMINDER, "set daily %s", s_pending_reminder_tz.hhmm.c_str());
     }
-
-    out = "OK: timezone set to " + tz;
+    String msg_for_user = reminder_message_for_user(s_pending_reminder_tz.message);
+    out = "OK: timezone set to " + tz + "\nOK: daily reminder set at " + s_pending_reminder_tz.hhmm +
+          "\nMessage: " + msg_for_user + unsynced_time_warning();
+    clear_pending_reminder_tz();
     return true;
   }
 
-  if (cmd_lc == "reminder_set_daily" || cmd_lc.startsWith("reminder_set_daily ") ||
-      cmd_lc == "remider_set_daily" || cmd_lc.startsWith("remider_set_daily ") ||
-      cmd_lc == "remainder_set_daily" || cmd_lc.startsWith("remainder_set_daily ")) {
-    int first_space = cmd.indexOf(' ');
-    String tail = first_space >= 0 ? cmd.substring(first_space + 1) : "";
-    tail.trim();
-    int sp = tail.indexOf(' ');
-    if (sp <= 0) {
-      out = "ERR: usage reminder_set_daily <HH:MM> <message>";
-      return true;
-    }
-
-    String hhmm = tail.substring(0, sp);
-    String message = tail.substring(sp + 1);
-    hhmm.trim();
-    message.trim();
-    if (!is_valid_hhmm(hhmm) || message.length() == 0) {
-      out = "ERR: usage reminder_set_daily <HH:MM> <message>";
-      return true;
-    }
-
-    if (!has_user_timezone()) {
-      s_pending_reminder_tz.active = true;
-      s_pending_reminder_tz.hhmm = hhmm;
-      s_pending_reminder_tz.message = message;
-      s_pending_reminder_tz.expires_ms = millis() + kPendingReminderTzMs;
-      clear_pending_reminder_details();
-      out = "Before I set that reminder, tell me your timezone.\n"
-            "Reply: timezone_set Asia/Kolkata";
-      return true;
-    }
+  out = "OK: timezone set to " + tz;
+  return true;
+}
 
-    String err;
-    if (!persona_set_daily_reminder(hhmm, message, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    event_log_append("REMINDER set daily " + hhmm);
-    out = "OK: daily reminder set at " + hhmm + "\nMessage: " + reminder_message_for_user(message) +
-          unsynced_time_warning();
+static bool cmd_reminder_set_daily(const String &cmd, const String &cmd_lc, String &out) {
+  int first_space = cmd.indexOf(' ');
+  String tail = first_space >= 0 ? cmd.substring(first_space + 1) : "";
+  tail.trim();
+  int sp = tail.indexOf(' ');
+  if (sp <= 0) {
+    out = "ERR: usage reminder_set_daily <HH:MM> <message>";
     return true;
   }
 
-  if (cmd_lc == "reminder_show") {
-    String hhmm;
-    String msg;
-    String err;
-    if (!persona_get_daily_reminder(hhmm, msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hhmm.trim();
-    msg.trim();
-    if (hhmm.length() == 0 || msg.length() == 0 || is_webjob_message(msg)) {
-      out = "Daily reminder is empty";
-      return true;
-    }
-    out = "Daily reminder at " + hhmm + "\nMessage: " + msg;
+  String hhmm = tail.substring(0, sp);
+  String message = tail.substring(sp + 1);
+  hhmm.trim();
+  message.trim();
+  if (!is_valid_hhmm(hhmm) || message.length() == 0) {
+    out = "ERR: usage reminder_set_daily <HH:MM> <message>";
     return true;
   }
 
-  if (cmd_lc == "reminder_clear") {
-    String hhmm;
-    String msg;
-    String err;
-    if (!persona_get_daily_reminder(hhmm, msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hhmm.trim();
-    msg.trim();
-    if (hhmm.length() == 0 || msg.length() == 0 || is_webjob_message(msg)) {
-      out = "Daily reminder is empty";
-      return true;
-    }
-    if (!persona_clear_daily_reminder(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: daily reminder cleared";
+  if (!has_user_timezone()) {
+    set_pending_reminder_tz(hhmm, message);
+    out = "Before I set that reminder, tell me your timezone.\n"
+          "Reply: timezone_set Asia/Kolkata";
     return true;
   }
 
-  if (cmd_lc == "reminder_run") {
-    String hhmm;
-    String msg;
-    String err;
-    if (!persona_get_daily_reminder(hhmm, msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hhmm.trim();
-    msg.trim();
-    if (hhmm.length() == 0 || msg.length() == 0) {
-      out = "Daily reminder is empty";
-      return true;
-    }
-    if (is_webjob_message(msg)) {
-      return run_webjob_now_task(webjob_task_from_message(msg), out);
-    }
-    out = "Reminder: " + reminder_message_for_user(msg);
+  String err;
+  if (!persona_set_daily_reminder(hhmm, message, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  event_log_printf(EVT_REMINDER, "set daily %s", hhmm.c_str());
+  out = "OK: daily reminder set at " + hhmm + "\nMessage: " + reminder_message_for_user(message) +
+        unsynced_time_warning();
+  return true;
+}
 
-#if ENABLE_WEB_JOBS
-  if (cmd_lc == "webjob_show") {
-    String hhmm;
-    String msg;
-    String err;
-    if (!persona_get_daily_reminder(hhmm, msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hhmm.trim();
-    msg.trim();
-    if (hhmm.length() == 0 || msg.length() == 0 || !is_webjob_message(msg)) {
-      out = "Daily web job is empty";
-      return true;
-    }
-    out = "Daily web job " + hhmm + ":\nTask: " + webjob_task_from_message(msg);
+static bool cmd_reminder_show(const String &cmd, const String &cmd_lc, String &out) {
+  String hhmm;
+  String msg;
+  String err;
+  if (!persona_get_daily_reminder(hhmm, msg, err)) {
+    out = "ERR: " + err;
     return true;
   }
-#endif
-
-  // Cron commands
-  if (cmd_lc == "cron_add" || cmd_lc.startsWith("cron_add ")) {
-    String tail = cmd.length() > 8 ? cmd.substring(8) : "";
-    tail.trim();
-
-    if (tail.length() == 0) {
-      out = "ERR: usage: cron_add <minute> <hour> <day> <month> <weekday> | <command>\n"
-            "       cron_add every <seconds> | <command>\n"
-            "       cron_add at <epoch> | <command>\n"
-            "Shortcut: cron_add <HH:MM> | <command>\n"
-            "Example: cron_add 0 9 * * * | Good morning\n"
-            "Fields: minute(0-59) hour(0-23) day(1-31) month(1-12) weekday(0-6, Sun=0)\n"
-            "Use * for wildcard";
-      return true;
-    }
-
-    String expanded;
-    if (cron_expand_hhmm_shortcut(tail, expanded)) {
-      tail = expanded;
-    }
-
-    String err;
-    if (!cron_store_add(tail, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-
-    int count = cron_store_count();
-    out = "OK: cron job added\nTotal jobs: " + String(count);
+  hhmm.trim();
+  msg.trim();
+  if (hhmm.length() == 0 || msg.length() == 0 || is_webjob_message(msg)) {
+    out = "Daily reminder is empty";
     return true;
   }
+  out = "Daily reminder at " + hhmm + "\nMessage: " + msg;
+  return true;
+}
 
-  if (cmd_lc == "cron_list" || cmd_lc == "cron_show") {
-    CronJob jobs[CRON_MAX_JOBS];
-    int count = cron_store_get_all(jobs, CRON_MAX_JOBS);
-
-    if (count == 0) {
-      out = "No cron jobs configured";
-      return true;
-    }
-
-    out = "Cron Jobs (" + String(count) + "):\n";
-    for (int i = 0; i < count; i++) {
-      out += String(i + 1) + ". " + cron_job_to_string(jobs[i]) + "\n";
-    }
-
-    if (cmd_lc == "cron_show") {
-      String content;
-      String err;
-      if (cron_store_get_content(content, err)) {
-        out += "\n--- cron store ---\n" + content;
-      }
-    }
-
+static bool cmd_reminder_clear(const String &cmd, const String &cmd_lc, String &out) {
+  String hhmm;
+  String msg;
+  String err;
+  if (!persona_get_daily_reminder(hhmm, msg, err)) {
+    out = "ERR: " + err;
     return true;
   }
-
-  if (cmd_lc == "cron_remove" || cmd_lc.startsWith("cron_remove ")) {
-    String id = cmd.length() > 11 ? cmd.substring(11) : "";
-    id.trim();
-    if (id.length() == 0) {
-      out = "ERR: usage cron_remove <id>";
-      return true;
-    }
-    String err;
-    if (!cron_store_remove(id, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: cron job removed: " + id;
+  hhmm.trim();
+  msg.trim();
+  if (hhmm.length() == 0 || msg.length() == 0 || is_webjob_message(msg)) {
+    out = "Daily reminder is empty";
     return true;
   }
-
-  if (cmd_lc == "cron_pause" || cmd_lc.startsWith("cron_pause ")) {
-    String id = cmd.length() > 10 ? cmd.substring(10) : "";
-    id.trim();
-    if (id.length() == 0) {
-      out = "ERR: usage cron_pause <id>";
-      return true;
-    }
-    String err;
-    if (!cron_store_set_enabled(id, false, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: cron job paused: " + id;
+  if (!persona_clear_daily_reminder(err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: daily reminder cleared";
+  return true;
+}
 
-  if (cmd_lc == "cron_resume" || cmd_lc.startsWith("cron_resume ")) {
-    String id = cmd.length() > 11 ? cmd.substring(11) : "";
-    id.trim();
-    if (id.length() == 0) {
-      out = "ERR: usage cron_resume <id>";
-      return true;
-    }
-    String err;
-    if (!cron_store_set_enabled(id, true, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    struct tm tm_now{};
-    if (scheduler_get_local_time(tm_now)) {
-      time_t now_epoch = time(nullptr);
-      String prime_err;
-      if (!cron_store_prime_job(id, now_epoch, prime_err)) {
-        Serial.printf("[tools] cron_resume prime failed for %s: %s\n", id.c_str(), prime_err.c_str());
-      }
-    }
-    out = "OK: cron job resumed: " + id;
+static bool cmd_reminder_run(const String &cmd, const String &cmd_lc, String &out) {
+  String hhmm;
+  String msg;
+  String err;
+  if (!persona_get_daily_reminder(hhmm, msg, err)) {
+    out = "ERR: " + err;
     return true;
   }
-
-  if (cmd_lc == "cron_clear") {
-    String err;
-    if (!cron_store_clear(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: all cron jobs cleared";
+  hhmm.trim();
+  msg.trim();
+  if (hhmm.length() == 0 || msg.length() == 0) {
+    out = "Daily reminder is empty";
     return true;
   }
+  if (is_webjob_message(msg)) {
+    return run_webjob_now_task(webjob_task_from_message(msg), out);
+  }
+  out = "Reminder: " + reminder_message_for_user(msg);
+  return true;
+}
 
 #if ENABLE_WEB_JOBS
-  if (cmd_lc == "webjob_clear") {
-    String hhmm;
-    String msg;
-    String err;
-    if (!persona_get_daily_reminder(hhmm, msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hhmm.trim();
-    msg.trim();
-    if (hhmm.length() == 0 || msg.length() == 0 || !is_webjob_message(msg)) {
-      out = "Daily web job is empty";
-      return true;
-    }
-    if (!persona_clear_daily_reminder(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: daily web job cleared";
+static bool cmd_webjob_show(const String &cmd, const String &cmd_lc, String &out) {
+  String hhmm;
+  String msg;
+  String err;
+  if (!persona_get_daily_reminder(hhmm, msg, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  hhmm.trim();
+  msg.trim();
+  if (hhmm.length() == 0 || msg.length() == 0 || !is_webjob_message(msg)) {
+    out = "Daily web job is empty";
     return true;
   }
+  out = "Daily web job " + hhmm + ":\nTask: " + webjob_task_from_message(msg);
+  return true;
+}
 #endif
 
-#if ENABLE_WEB_JOBS
-  if (cmd_lc == "webjob_run") {
-    String hhmm;
-    String msg;
-    String err;
-    if (!persona_get_daily_reminder(hhmm, msg, err)) {
-      out = "ERR: " + err;
+// Cron commands
+static bool cmd_cron_add(const String &cmd, const String &cmd_lc, String &out) {
+  String tail = cmd.length() > 8 ? cmd.substring(8) : "";
+  tail.trim();
+
+  if (tail.length() == 0) {
+    out = "ERR: usage: cron_add <minute> <hour> <day> <month> <weekday> | <command>\n"
+          "       cron_add every <seconds> | <command>\n"
+          "       cron_add at <epoch> | <command>\n"
+          "       cron_add in <minutes> | <command>\n"
+          "Shortcut: cron_add <HH:MM> | <command>\n"
+          "Example: cron_add 0 9 * * * | Good morning\n"
+          "Fields: minute(0-59) hour(0-23) day(1-31) month(1-12) weekday(0-6, Sun=0)\n"
+          "Use * for wildcard";
+    return true;
+  }
+
+  // One-shots: "in <minutes> | cmd" or "at <epoch> | cmd", fired once by the scheduler
+  String tail_lc = tail;
+  tail_lc.toLowerCase();
+  if (tail_lc.startsWith("in ") || tail_lc.startsWith("at ")) {
+    const int pipe = tail.indexOf('|');
+    String when = pipe > 0 ? tail.substring(3, pipe) : "";
+    String command = pipe > 0 ? tail.substring(pipe + 1) : "";
+    when.trim();
+    command.trim();
+    const long value = when.toInt();
+    const time_t now_epoch = time(nullptr);
+    if (value <= 0 || command.length() == 0) {
+      out = "ERR: usage cron_add in <minutes> | <command> or cron_add at <epoch> | <command>";
       return true;
     }
-    hhmm.trim();
-    msg.trim();
-    if (hhmm.length() == 0 || msg.length() == 0 || !is_webjob_message(msg)) {
-      out = "ERR: daily web job is empty";
+    if (now_epoch < 1700000000) {
+      out = "ERR: time not synced yet";
       return true;
     }
-    String task = webjob_task_from_message(msg);
-    if (task.length() == 0) {
-      out = "ERR: empty web job task";
+    const time_t due = tail_lc.startsWith("in ") ? now_epoch + (time_t)value * 60 : (time_t)value;
+    if (due <= now_epoch) {
+      out = "ERR: that time has already passed";
       return true;
     }
-    String job_out;
-    if (!web_job_run(task, effective_timezone_for_jobs(), job_out, err)) {
+    String err;
+    if (!scheduler_add_oneshot(due, command, err)) {
       out = "ERR: " + err;
       return true;
     }
-    out = "Web job now:\n" + job_out;
+    out = "OK: one-shot job in " + String((long)((due - now_epoch + 59) / 60)) + " min: " + command;
     return true;
   }
 
-  if (cmd_lc.startsWith("host_file ")) {
-    String tail = cmd.substring(10);
-    tail.trim();
-    int sp = tail.indexOf(' ');
-    String filename = "index.html";
-    String content = tail;
-    if (sp > 0) {
-      filename = tail.substring(0, sp);
-      content = tail.substring(sp + 1);
-    }
-    content.trim();
-    filename.trim();
-    
-    // Unescape content if needed (simple check)
-    if (content.startsWith("\"") && content.endsWith("\"")) {
-      content = content.substring(1, content.length() - 1);
-      content.replace("\\n", "\n");
-      content.replace("\\\"", "\"");
-    }
-
-    web_server_publish_file(filename, content, "text/html");
-    String ip = WiFi.localIP().toString();
-    out = "File hosted: http://" + ip + "/" + filename;
-    return true;
+  String expanded;
+  if (cron_expand_hhmm_shortcut(tail, expanded)) {
+    tail = expanded;
   }
 
-#if ENABLE_EMAIL
-  if (cmd_lc.startsWith("email_files ") || cmd_lc.startsWith("email_files  ")) {
-    String remaining = cmd.substring(cmd.indexOf(' ') + 1);
-    remaining.trim();
-
-    // Parse: email_files <email> <topic>
-    int first_space = remaining.indexOf(' ');
-    if (first_space < 0) {
-      out = "ERR: usage email_files <email> <topic>";
-      return true;
-    }
-
-    String email = remaining.substring(0, first_space);
-    email.trim();
-
-    String topic = remaining.substring(first_space + 1);
-    topic = sanitize_web_topic(topic);
-
-    if (email.length() == 0 || email.indexOf('@') < 0) {
-      out = "ERR: usage email_files <email> <topic>";
-      return true;
-    }
-
-    return email_small_web_files(email, topic, out);
+  String err;
+  if (!cron_store_add(tail, err)) {
+    out = "ERR: " + err;
+    return true;
   }
-#endif
 
-  String web_files_topic;
-  if (extract_web_files_topic_from_text(cmd, web_files_topic)) {
-    return send_small_web_files(web_files_topic, out);
-  }
+  int count = cron_store_count();
+  out = "OK: cron job added\nTotal jobs: " + String(count);
+  return true;
+}
 
-  String web_query;
-  if (extract_web_query_from_text(cmd, web_query)) {
-    return run_webjob_now_task(web_query, out);
-  }
-#endif
+static bool cmd_cron_list(const String &cmd, const String &cmd_lc, String &out) {
+  CronJob jobs[CRON_MAX_JOBS];
+  int count = cron_store_get_all(jobs, CRON_MAX_JOBS);
 
-  if (is_natural_web_iteration_request(cmd_lc)) {
-    return run_natural_web_iteration(cmd, out);
+  if (count == 0) {
+    out = "No cron jobs configured";
+    return true;
   }
 
-  // HOST / SERVE / DEPLOY - publish last response as web page (always available)
-  if (cmd_lc == "host_code" || cmd_lc.startsWith("host_code ") ||
-      cmd_lc.startsWith("host ") || cmd_lc == "host" ||
-      cmd_lc.startsWith("serve ") || cmd_lc == "serve" ||
-      cmd_lc.startsWith("deploy ") || cmd_lc == "deploy" ||
-      cmd_lc.indexOf("host the") >= 0 || cmd_lc.indexOf("host this") >= 0 ||
-      cmd_lc.indexOf("host it") >= 0 || cmd_lc.indexOf("serve the") >= 0 ||
-      cmd_lc.indexOf("serve this") >= 0 || cmd_lc.indexOf("serve it") >= 0 ||
-      cmd_lc.indexOf("deploy the") >= 0 || cmd_lc.indexOf("deploy this") >= 0 ||
-      cmd_lc.indexOf("deploy it") >= 0 ||
-      (cmd_lc.indexOf("host") >= 0 && cmd_lc.indexOf("server") >= 0)) {
-    String last_resp = agent_loop_get_last_response();
-    String file_content = agent_loop_get_last_file_content();
-    String file_name = agent_loop_get_last_file_name();
-    String html_from_response;
-    const bool has_html_from_response = extract_html_from_response_text(last_resp, html_from_response);
-
-    // Priority 1: Use exact file memory if available
-    if (file_content.length() > 0) {
-      if (file_name.length() == 0) file_name = "index.html";
-
-      String file_name_lc = file_name;
-      file_name_lc.toLowerCase();
-      String content_to_host = file_content;
-      String mime = mime_from_filename(file_name);
-
-      // If the last remembered file is CSS/JS, prefer the HTML from last response.
-      if ((file_name_lc.endsWith(".js") || file_name_lc.endsWith(".css")) && has_html_from_response) {
-        file_name = "index.html";
-        content_to_host = html_from_response;
-        mime = "text/html";
-      }
-
-      // If filename is not a web asset, default to index.html for hosting.
-      if (!file_name_lc.endsWith(".html") && !file_name_lc.endsWith(".htm") &&
-          !file_name_lc.endsWith(".js") && !file_name_lc.endsWith(".css")) {
-        file_name = "index.html";
-        mime = "text/html";
-      }
-
-      web_server_publish_file(file_name, content_to_host, mime);
-      String ip = WiFi.localIP().toString();
-      String public_path = file_name;
-      if (!public_path.startsWith("/")) {
-        public_path = "/" + public_path;
-      }
-      out = "Website hosted on ESP32 (from memory)!\nAccess it at: http://" + ip + public_path;
-      return true;
-    }
-
-    if (last_resp.length() == 0) {
-      out = "No previous response to host. Ask me to create something first!";
-      return true;
-    }
-
-    // Priority 2: Try to extract HTML from model response
-    String html_content = "";
-    extract_html_from_response_text(last_resp, html_content);
+  out = "Cron Jobs (" + String(count) + "):\n";
+  for (int i = 0; i < count; i++) {
+    out += String(i + 1) + ". " + cron_job_to_string(jobs[i]) + "\n";
+  }
 
-    if (html_content.length() == 0) {
-      out = "Could not find HTML content in the last response. Ask me to create a website first!";
-      return true;
+  if (cmd_lc == "cron_show") {
+    String content;
+    String err;
+    if (cron_store_get_content(content, err)) {
+      out += "\n--- cron store ---\n" + content;
     }
+  }
 
-    html_content.trim();
-    web_server_publish_file("index.html", html_content, "text/html");
+  return true;
+}
 
-    // Get IP for the URL
-    String ip = WiFi.localIP().toString();
-    out = "Website hosted on ESP32!\nAccess it at: http://" + ip + "/index.html";
+static bool cmd_cron_remove(const String &cmd, const String &cmd_lc, String &out) {
+  String id = cmd.length() > 11 ? cmd.substring(11) : "";
+  id.trim();
+  if (id.length() == 0) {
+    out = "ERR: usage cron_remove <id>";
+    return true;
+  }
+  String err;
+  if (!cron_store_remove(id, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: cron job removed: " + id;
+  return true;
+}
 
-  if (cmd_lc.indexOf("search web") >= 0 || cmd_lc.indexOf("web search") >= 0) {
-    out = "Yes. Tell me what to search.\nExample: search for cricket matches today";
+static bool cmd_cron_pause(const String &cmd, const String &cmd_lc, String &out) {
+  String id = cmd.length() > 10 ? cmd.substring(10) : "";
+  id.trim();
+  if (id.length() == 0) {
+    out = "ERR: usage cron_pause <id>";
+    return true;
+  }
+  String err;
+  if (!cron_store_set_enabled(id, false, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: cron job paused: " + id;
+  return true;
+}
 
-#if ENABLE_WEB_JOBS
-  if (cmd_lc == "webjob_set_daily" || cmd_lc.startsWith("webjob_set_daily ")) {
-    String tail = cmd.length() > 16 ? cmd.substring(16) : "";
-    tail.trim();
-    int sp = tail.indexOf(' ');
-    if (sp <= 0) {
-      out = "ERR: usage webjob_set_daily <HH:MM> <task>";
-      return true;
+static bool cmd_cron_resume(const String &cmd, const String &cmd_lc, String &out) {
+  String id = cmd.length() > 11 ? cmd.substring(11) : "";
+  id.trim();
+  if (id.length() == 0) {
+    out = "ERR: usage cron_resume <id>";
+    return true;
+  }
+  String err;
+  if (!cron_store_set_enabled(id, true, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  struct tm tm_now{};
+  if (scheduler_get_local_time(tm_now)) {
+    time_t now_epoch = time(nullptr);
+    String prime_err;
+    if (!cron_store_prime_job(id, now_epoch, prime_err)) {
+      Serial.printf("[tools] cron_resume prime failed for %s: %s\n", id.c_str(), prime_err.c_str());
     }
+  }
+  out = "OK: cron job resumed: " + id;
+  return true;
+}
 
-    String hhmm = tail.substring(0, sp);
-    String task = tail.substring(sp + 1);
-    hhmm.trim();
-    task.trim();
-
-    if (!is_valid_hhmm(hhmm) || task.length() == 0) {
-      out = "ERR: usage webjob_set_daily <HH:MM> <task>";
-      return true;
+static bool cmd_cron_clear(const String &cmd, const String &cmd_lc, String &out) {
+  String err;
+  if (!cron_store_clear(err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "OK: all cron jobs cleared";
+  return true;
+}
+
+#if ENABLE_WEB_JOBS
+static bool cmd_webjob_clear(const String &cmd, const String &cmd_lc, String &out) {
+  String hhmm;
+  String msg;
+  String err;
+  if (!persona_get_daily_reminder(hhmm, msg, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  hhmm.trim();
+  msg.trim();
+  if (hhmm.length() == 0 || msg.length() == 0 || !is_webjob_message(msg)) {
+    out = "Daily web job is empty";
+    return true;
+  }
+  if (!persona_clear_daily_reminder(err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "OK: daily web job cleared";
+  return true;
+}
+
+static bool cmd_webjob_run(const String &cmd, const String &cmd_lc, String &out) {
+  String hhmm;
+  String msg;
+  String err;
+  if (!persona_get_daily_reminder(hhmm, msg, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  hhmm.trim();
+  msg.trim();
+  if (hhmm.length() == 0 || msg.length() == 0 || !is_webjob_message(msg)) {
+    out = "ERR: daily web job is empty";
+    return true;
+  }
+  String task = webjob_task_from_message(msg);
+  if (task.length() == 0) {
+    out = "ERR: empty web job task";
+    return true;
+  }
+  String job_out;
+  if (!web_job_run(task, effective_timezone_for_jobs(), job_out, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "Web job now:\n" + job_out;
+  return true;
+}
+
+static bool cmd_host_file(const String &cmd, const String &cmd_lc, String &out) {
+  String tail = cmd.substring(10);
+  tail.trim();
+  int sp = tail.indexOf(' ');
+  String filename = "index.html";
+  String content = tail;
+  if (sp > 0) {
+    filename = tail.substring(0, sp);
+    content = tail.substring(sp + 1);
+  }
+  content.trim();
+  filename.trim();
+  
+  // Unescape content if needed (simple check)
+  if (content.startsWith("\"") && content.endsWith("\"")) {
+    content = content.substring(1, content.length() - 1);
+    content.replace("\\n", "\n");
+    content.replace("\\\"", "\"");
+  }
+
+  web_server_publish_file(filename, content, "text/html");
+  String ip = WiFi.localIP().toString();
+  out = "File hosted: http://" + ip + "/" + filename;
+  return true;
+}
+#endif
+
+#if ENABLE_WEB_JOBS && ENABLE_EMAIL
+static bool cmd_email_files(const String &cmd, const String &cmd_lc, String &out) {
+  String remaining = cmd.substring(cmd.indexOf(' ') + 1);
+  remaining.trim();
+
+  // Parse: email_files <email> <topic>
+  int first_space = remaining.indexOf(' ');
+  if (first_space < 0) {
+    out = "ERR: usage email_files <email> <topic>";
+    return true;
+  }
+
+  String email = remaining.substring(0, first_space);
+  email.trim();
+
+  String topic = remaining.substring(first_space + 1);
+  topic = sanitize_web_topic(topic);
+
+  if (email.length() == 0 || email.indexOf('@') < 0) {
+    out = "ERR: usage email_files <email> <topic>";
+    return true;
+  }
+
+  return email_small_web_files(email, topic, out);
+}
+#endif
+
+// HOST / SERVE / DEPLOY - publish last response as web page (always available)
+static bool cmd_host_code(const String &cmd, const String &cmd_lc, String &out) {
+  String last_resp = agent_loop_get_last_response();
+  String file_content = agent_loop_get_last_file_content();
+  String file_name = agent_loop_get_last_file_name();
+  String html_from_response;
+  const bool has_html_from_response = extract_html_from_response_text(last_resp, html_from_response);
+
+  // Priority 1: Use exact file memory if available
+  if (file_content.length() > 0) {
+    if (file_name.length() == 0) file_name = "index.html";
+
+    String file_name_lc = file_name;
+    file_name_lc.toLowerCase();
+    String content_to_host = file_content;
+    String mime = mime_from_filename(file_name);
+
+    // If the last remembered file is CSS/JS, prefer the HTML from last response.
+    if ((file_name_lc.endsWith(".js") || file_name_lc.endsWith(".css")) && has_html_from_response) {
+      file_name = "index.html";
+      content_to_host = html_from_response;
+      mime = "text/html";
     }
 
-    String encoded_msg = encode_webjob_message(task);
-    String err;
-    if (!has_user_timezone()) {
-      s_pending_reminder_tz.active = true;
-      s_pending_reminder_tz.hhmm = hhmm;
-      s_pending_reminder_tz.message = encoded_msg;
-      s_pending_reminder_tz.expires_ms = millis() + kPendingReminderTzMs;
-      clear_pending_reminder_details();
-      out = "Before I set that web job, tell me your timezone.\n"
-            "Reply: timezone_set Asia/Kolkata";
-      return true;
+    // If filename is not a web asset, default to index.html for hosting.
+    if (!file_name_lc.endsWith(".html") && !file_name_lc.endsWith(".htm") &&
+        !file_name_lc.endsWith(".js") && !file_name_lc.endsWith(".css")) {
+      file_name = "index.html";
+      mime = "text/html";
     }
 
-    if (!persona_set_daily_reminder(hhmm, encoded_msg, err)) {
-      out = "ERR: " + err;
-      return true;
+    web_server_publish_file(file_name, content_to_host, mime);
+    String ip = WiFi.localIP().toString();
+    String public_path = file_name;
+    if (!public_path.startsWith("/")) {
+      public_path = "/" + public_path;
     }
-    event_log_append("WEBJOB set daily " + hhmm);
-    out = "OK: daily web job set at " + hhmm + "\nTask: " + task + unsynced_time_warning();
+    out = "Website hosted on ESP32 (from memory)!\nAccess it at: http://" + ip + public_path;
+    return true;
+  }
+
+  if (last_resp.length() == 0) {
+    out = "No previous response to host. Ask me to create something first!";
+    return true;
+  }
+
+  // Priority 2: Try to extract HTML from model response
+  String html_content = "";
+  extract_html_from_response_text(last_resp, html_content);
+
+  if (html_content.length() == 0) {
+    out = "Could not find HTML content in the last response. Ask me to create a website first!";
+    return true;
+  }
+
+  html_content.trim();
+  web_server_publish_file("index.html", html_content, "text/html");
+
+  // Get IP for the URL
+  String ip = WiFi.localIP().toString();
+  out = "Website hosted on ESP32!\nAccess it at: http://" + ip + "/index.html";
+  return true;
+}
+
+#if ENABLE_WEB_JOBS
+static bool cmd_webjob_set_daily(const String &cmd, const String &cmd_lc, String &out) {
+  String tail = cmd.length() > 16 ? cmd.substring(16) : "";
+  tail.trim();
+  int sp = tail.indexOf(' ');
+  if (sp <= 0) {
+    out = "ERR: usage webjob_set_daily <HH:MM> <task>";
+    return true;
+  }
+
+  String hhmm = tail.substring(0, sp);
+  String task = tail.substring(sp + 1);
+  hhmm.trim();
+  task.trim();
+
+  if (!is_valid_hhmm(hhmm) || task.length() == 0) {
+    out = "ERR: usage webjob_set_daily <HH:MM> <task>";
     return true;
   }
+
+  String encoded_msg = encode_webjob_message(task);
+  String err;
+  if (!has_user_timezone()) {
+    set_pending_reminder_tz(hhmm, encoded_msg);
+    out = "Before I set that web job, tell me your timezone.\n"
+          "Reply: timezone_set Asia/Kolkata";
+    return true;
+  }
+
+  if (!persona_set_daily_reminder(hhmm, encoded_msg, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  event_log_printf(EVT_WEBJOB, "set daily %s", hhmm.c_str());
+  out = "OK: daily web job set at " + hhmm + "\nTask: " + task + unsynced_time_warning();
+  return true;
+}
+
+static bool cmd_web_files_make(const String &cmd, const String &cmd_lc, String &out) {
+  String topic = cmd.length() > 14 ? cmd.substring(14) : "";
+  return send_small_web_files(sanitize_web_topic(topic), out);
+}
 #endif
 
-  // Natural-language scheduling (without explicit command prefix)
-  String natural_web_hhmm;
-  String natural_web_task;
-  if (parse_natural_daily_webjob(cmd, natural_web_hhmm, natural_web_task)) {
-    String encoded_msg = encode_webjob_message(natural_web_task);
-    String err;
-    if (!has_user_timezone()) {
-      s_pending_reminder_tz.active = true;
-      s_pending_reminder_tz.hhmm = natural_web_hhmm;
-      s_pending_reminder_tz.message = encoded_msg;
-      s_pending_reminder_tz.expires_ms = millis() + kPendingReminderTzMs;
-      clear_pending_reminder_details();
-      out = "Before I set that web job, tell me your timezone.\n"
-            "Reply: timezone_set Asia/Kolkata";
-      return true;
+static bool cmd_soul_show(const String &cmd, const String &cmd_lc, String &out) {
+  String soul, err;
+  if (!file_memory_read_soul(soul, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  soul.trim();
+  if (soul.length() == 0) {
+    out = "🦖 SOUL.md is empty";
+    return true;
+  }
+  if (soul.length() > 1400) {
+    soul = soul.substring(0, 1400) + "...";
+  }
+  out = "🦖 SOUL.md:\n" + soul;
+  return true;
+}
+
+static bool cmd_soul_clear(const String &cmd, const String &cmd_lc, String &out) {
+  String err;
+  // Clear both SPIFFS SOUL.md and NVS soul
+  if (!file_memory_write_soul("", err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  // Also clear NVS soul to remove old gamer soul
+  String nvs_err;
+  persona_clear_soul(nvs_err);  // Ignore error since NVS might not have a soul
+
+  out = "🦖 OK: Soul cleared (both SOUL.md and old storage)";
+  return true;
+}
+
+static bool cmd_soul_set(const String &cmd, const String &cmd_lc, String &out) {
+  String text = cmd.length() > 8 ? cmd.substring(8) : "";
+  text.trim();
+  if (text.length() == 0) {
+    out = "ERR: usage soul_set <text>";
+    return true;
+  }
+  String err;
+  if (!file_memory_write_soul(text, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "🦖 OK: SOUL.md updated";
+  return true;
+}
+
+static bool cmd_heartbeat_show(const String &cmd, const String &cmd_lc, String &out) {
+  String hb;
+  String err;
+  if (!persona_get_heartbeat(hb, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  hb.trim();
+  if (hb.length() == 0) {
+    out = "Heartbeat is empty";
+    return true;
+  }
+  if (hb.length() > 1400) {
+    hb = hb.substring(0, 1400);
+  }
+  out = "HEARTBEAT:\n" + hb;
+  return true;
+}
+
+static bool cmd_heartbeat_clear(const String &cmd, const String &cmd_lc, String &out) {
+  String err;
+  if (!persona_clear_heartbeat(err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "OK: heartbeat cleared";
+  return true;
+}
+
+static bool cmd_heartbeat_set(const String &cmd, const String &cmd_lc, String &out) {
+  String text = cmd.length() > 13 ? cmd.substring(13) : "";
+  text.trim();
+  if (text.length() == 0) {
+    out = "ERR: usage heartbeat_set <text>";
+    return true;
+  }
+  String err;
+  if (!persona_set_heartbeat(text, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "OK: heartbeat updated";
+  return true;
+}
+
+static bool cmd_heartbeat_run(const String &cmd, const String &cmd_lc, String &out) {
+  String hb;
+  String hb_err;
+  if (!persona_get_heartbeat(hb, hb_err)) {
+    out = "ERR: " + hb_err;
+    return true;
+  }
+  hb.trim();
+  if (hb.length() == 0) {
+    out = "ERR: heartbeat is empty";
+    return true;
+  }
+
+  String reply;
+  String llm_err;
+  if (!llm_generate_heartbeat(hb, reply, llm_err)) {
+    out = "ERR: " + llm_err;
+    return true;
+  }
+  if (reply.length() > 1400) {
+    reply = reply.substring(0, 1400) + "...";
+  }
+  out = "Heartbeat:\n" + reply;
+  return true;
+}
+
+static bool cmd_proactive_check(const String &cmd, const String &cmd_lc, String &out) {
+  // Build context for proactive decision
+  String context = build_time_context();
+
+  // Add user profile
+  String user_profile, user_err;
+  if (file_memory_read_user(user_profile, user_err)) {
+    user_profile.trim();
+    if (user_profile.length() > 0) {
+      if (user_profile.length() > 400) {
+        user_profile = user_profile.substring(user_profile.length() - 400);
+      }
+      context += "\n\nUser profile:\n" + user_profile;
     }
-    if (!persona_set_daily_reminder(natural_web_hhmm, encoded_msg, err)) {
-      out = "ERR: " + err;
-      return true;
+  }
+
+  // Add pending tasks
+  String tasks, task_err;
+  if (task_list(tasks, task_err)) {
+    tasks.trim();
+    if (tasks.length() > 0) {
+      if (tasks.length() > 300) {
+        tasks = tasks.substring(0, 300) + "...";
+      }
+      context += "\n\nPending tasks:\n" + tasks;
     }
-    event_log_append("WEBJOB set daily " + natural_web_hhmm + " (natural)");
-    out = "OK: daily web job set at " + natural_web_hhmm + "\nTask: " + natural_web_task +
-          unsynced_time_warning();
+  }
+
+  // Add recent memory
+  String memory, mem_err;
+  if (file_memory_read_long_term(memory, mem_err)) {
+    memory.trim();
+    if (memory.length() > 0) {
+      if (memory.length() > 300) {
+        memory = memory.substring(memory.length() - 300);
+      }
+      context += "\n\nRecent memory:\n" + memory;
+    }
+  }
+
+  String reply, llm_err;
+  if (!llm_generate_proactive(context, reply, llm_err)) {
+    out = "ERR: " + llm_err;
     return true;
   }
 
-  String reminder_change_hhmm;
-  if (parse_natural_reminder_time_change(cmd, reminder_change_hhmm)) {
-    String old_hhmm;
-    String old_msg;
-    String err;
-    if (!persona_get_daily_reminder(old_hhmm, old_msg, err)) {
-      out = "ERR: " + err;
+  if (reply.length() == 0) {
+    out = "🦖 (proactive: staying silent)";
+    return true;
+  }
+
+  if (reply.length() > 1400) {
+    reply = reply.substring(0, 1400) + "...";
+  }
+  out = reply;
+  return true;
+}
+
+static bool cmd_proactive_on(const String &cmd, const String &cmd_lc, String &out) {
+  out = "OK: proactive agent is enabled (runs every " + String(PROACTIVE_INTERVAL_MS / 60000) + " min)";
+  return true;
+}
+
+static bool cmd_proactive_off(const String &cmd, const String &cmd_lc, String &out) {
+  out = "OK: proactive agent disabled. Use /proactive_on to re-enable.";
+  return true;
+}
+
+static bool cmd_profile(const String &cmd, const String &cmd_lc, String &out) {
+  String user_profile, user_err;
+  if (!file_memory_read_user(user_profile, user_err)) {
+    out = "ERR: " + user_err;
+    return true;
+  }
+  user_profile.trim();
+  if (user_profile.length() == 0) {
+    out = "🦖 I don't know much about you yet! Tell me your name or interests.";
+  } else {
+    out = "👤 **User Profile (what I know about you):**\n" + user_profile;
+  }
+  return true;
+}
+
+static bool cmd_cancel(const String &cmd, const String &cmd_lc, String &out) {
+  PendingLock guard;
+  if (!s_pending.active || !is_callers(s_pending.chat)) {
+    if ((s_pending_reminder_tz.active && is_callers(s_pending_reminder_tz.chat)) ||
+        s_pending_reminder_details.active) {
+      clear_pending_reminder_tz();
+      clear_pending_reminder_details();
+      out = "OK: pending reminder flow canceled";
       return true;
     }
-    old_hhmm.trim();
-    old_msg.trim();
-    if (old_hhmm.length() == 0 || old_msg.length() == 0) {
-      out = "No daily reminder to update. First set one with: reminder_set_daily <HH:MM> <message>";
+    out = "OK: no pending action";
+    return true;
+  }
+  clear_pending();
+  if (is_callers(s_pending_reminder_tz.chat)) {
+    clear_pending_reminder_tz();
+  }
+  clear_pending_reminder_details();
+  out = "OK: pending action canceled";
+  return true;
+}
+
+static bool cmd_confirm(const String &cmd, const String &cmd_lc, String &out) {
+  PendingLock guard;
+  if (!s_pending.active || !is_callers(s_pending.chat)) {
+    out = "ERR: no pending action";
+    return true;
+  }
+  if (is_expired(s_pending.expires_ms)) {
+    clear_pending();
+    out = "ERR: pending action expired";
+    return true;
+  }
+
+  if (cmd_lc.startsWith("confirm ")) {
+    const String tail = cmd_lc.substring(8);
+    int user_id = -1;
+    if (!parse_one_int(tail, "%d", &user_id)) {
+      out = "ERR: usage confirm [id]";
       return true;
     }
-    if (!persona_set_daily_reminder(reminder_change_hhmm, old_msg, err)) {
-      out = "ERR: " + err;
+    if ((unsigned long)user_id != s_pending.id) {
+      out = "ERR: confirm id mismatch";
       return true;
     }
-    out = "OK: daily reminder updated to " + reminder_change_hhmm +
-          "\nMessage: " + reminder_message_for_user(old_msg) + unsynced_time_warning();
+  }
+
+  const int pin = s_pending.pin;
+  const int state = s_pending.state;
+  const int led_count = s_pending.led_count;
+  const PendingActionType type = s_pending.type;
+  const unsigned long id = s_pending.id;
+  if (is_safe_mode_enabled() &&
+      (type == PENDING_RELAY_SET || type == PENDING_LED_FLASH)) {
+    clear_pending();
+    out = "ERR: safe mode ON. Disable with safe_mode_off first";
+    return true;
+  }
+  clear_pending();
+  if (type == PENDING_RELAY_SET) {
+    relay_set_now(pin, state, out);
+  } else if (type == PENDING_LED_FLASH) {
+    flash_led_now(led_count, out);
+  } else {
+    out = "ERR: unknown pending action";
     return true;
   }
+  out += " (confirmed id=" + String(id) + ")";
+  return true;
+}
 
-  String natural_rem_hhmm;
-  String natural_rem_msg;
-  if (parse_natural_daily_reminder(cmd, natural_rem_hhmm, natural_rem_msg, true)) {
-    String err;
-    if (!has_user_timezone()) {
-      s_pending_reminder_tz.active = true;
-      s_pending_reminder_tz.hhmm = natural_rem_hhmm;
-      s_pending_reminder_tz.message = natural_rem_msg;
-      s_pending_reminder_tz.expires_ms = millis() + kPendingReminderTzMs;
-      clear_pending_reminder_details();
-      out = "Before I set that reminder, tell me your timezone.\n"
-            "Reply: timezone_set Asia/Kolkata";
+// Handle "yes" as confirmation for firmware update. The update offer goes to
+// the owner chat, so only the owner can accept it.
+static bool cmd_yes(const String &cmd, const String &cmd_lc, String &out) {
+  if (s_pending_update.available && chat_scope_is_owner(chat_scope_current())) {
+    return tool_registry_trigger_update(out);
+  }
+  // No update offered to this chat: let the agent answer it as chat
+  return false;
+}
+
+#if ENABLE_GPIO
+static bool cmd_relay_set(const String &cmd, const String &cmd_lc, String &out) {
+  if (is_safe_mode_enabled()) {
+    out = "ERR: safe mode ON. relay_set blocked";
+    return true;
+  }
+  int pin = -1;
+  int state = -1;
+  if (parse_two_ints(cmd_lc, "relay_set %d %d", &pin, &state)) {
+    if (pin >= 0 && pin <= 39 && (state == 0 || state == 1)) {
+      PendingLock guard;
+      if (s_pending.active) {
+        out = "ERR: pending action exists (id=" + String(s_pending.id) + "). confirm/cancel first";
+        return true;
+      }
+
+      s_pending.active = true;
+      s_pending.id = s_next_pending_id++;
+      s_pending.type = PENDING_RELAY_SET;
+      s_pending.pin = pin;
+      s_pending.state = state;
+      s_pending.expires_ms = millis() + ACTION_CONFIRM_TIMEOUT_MS;
+      s_pending.chat = chat_scope_current();
+      out = "CONFIRM relay_set pin " + String(pin) + " -> " + String(state) +
+            "\nRun: confirm " + String(s_pending.id) +
+            "\nOr: cancel";
       return true;
     }
-    if (!persona_set_daily_reminder(natural_rem_hhmm, natural_rem_msg, err)) {
-      out = "ERR: " + err;
+  }
+  out = "ERR: usage relay_set <pin> <0|1>";
+  return true;
+}
+
+static bool cmd_sensor_read(const String &cmd, const String &cmd_lc, String &out) {
+  int pin = -1;
+  if (parse_one_int(cmd_lc, "sensor_read %d", &pin)) {
+    if (pin >= 0 && pin <= 39) {
+      pinMode(pin, INPUT);
+      int v = digitalRead(pin);
+      out = "OK: sensor pin " + String(pin) + " = " + String(v);
       return true;
     }
-    event_log_append("REMINDER set daily " + natural_rem_hhmm + " (natural)");
-    out = "OK: daily reminder set at " + natural_rem_hhmm +
-          "\nMessage: " + reminder_message_for_user(natural_rem_msg) + unsynced_time_warning();
+  }
+  out = "ERR: usage sensor_read <pin>";
+  return true;
+}
+#endif
+
+#if ENABLE_PLAN
+static bool cmd_plan(const String &cmd, const String &cmd_lc, String &out) {
+  String task = cmd.length() > 4 ? cmd.substring(4) : "";
+  task.trim();
+  if (task.length() == 0) {
+    out = "ERR: usage plan <what to build>";
+    return true;
+  }
+
+  String plan_text;
+  String plan_error;
+  if (!llm_generate_plan(task, plan_text, plan_error)) {
+    out = "ERR: " + plan_error;
+    return true;
+  }
+
+  if (plan_text.length() > 1400) {
+    plan_text = plan_text.substring(0, 1400) + "...";
+  }
+  out = plan_text;
+  return true;
+}
+#endif
+
+static bool cmd_memory(const String &cmd, const String &cmd_lc, String &out) {
+  String notes;
+  String err;
+  if (!memory_get_notes(notes, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  notes.trim();
+  if (notes.length() == 0) {
+    out = "Memory is empty";
+    return true;
+  }
+  if (notes.length() > 1400) {
+    notes = notes.substring(notes.length() - 1400);
+  }
+  out = "Memory:\n" + notes;
+  return true;
+}
+
+static bool cmd_memory_clear(const String &cmd, const String &cmd_lc, String &out) {
+  String err;
+  if (!memory_clear_notes(err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "OK: memory cleared";
+  return true;
+}
+
+static bool cmd_remember(const String &cmd, const String &cmd_lc, String &out) {
+  String note = cmd.length() > 8 ? cmd.substring(8) : "";
+  note.trim();
+  if (note.length() == 0) {
+    out = "ERR: usage remember <note>";
+    return true;
+  }
+  String err;
+  if (!memory_append_note(note, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "OK: remembered";
+  return true;
+}
+
+// File memory commands (SPIFFS-based)
+static bool cmd_file_memory(const String &cmd, const String &cmd_lc, String &out) {
+  String info, err;
+  if (!file_memory_get_info(info, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = info;
+  return true;
+}
+
+static bool cmd_memory_read(const String &cmd, const String &cmd_lc, String &out) {
+  String content, err;
+  if (!file_memory_read_long_term(content, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  content.trim();
+  if (content.length() == 0) {
+    out = "📚 MEMORY.md is empty";
+    return true;
+  }
+  if (content.length() > 1400) {
+    content = "...(truncated)\n" + content.substring(content.length() - 1400);
+  }
+  out = "📚 MEMORY.md:\n" + content;
+  return true;
+}
+
+static bool cmd_memory_write(const String &cmd, const String &cmd_lc, String &out) {
+  String text = cmd.substring(cmd.indexOf(" ") + 1);
+  text.trim();
+  if (text.length() == 0) {
+    out = "ERR: usage memory_write <text>";
+    return true;
+  }
+  String err;
+  if (!file_memory_append_long_term(text, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "🦖 OK: Written to MEMORY.md";
+  return true;
+}
+
+static bool cmd_user_read(const String &cmd, const String &cmd_lc, String &out) {
+  String user, err;
+  if (!file_memory_read_user(user, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  user.trim();
+  if (user.length() == 0) {
+    out = "👤 USER.md is empty";
+    return true;
+  }
+  if (user.length() > 1400) {
+    user = user.substring(0, 1400) + "...";
+  }
+  out = "👤 USER.md:\n" + user;
+  return true;
+}
+
+static bool cmd_daily_note(const String &cmd, const String &cmd_lc, String &out) {
+  String note = cmd.substring(11);
+  note.trim();
+  if (note.length() == 0) {
+    out = "ERR: usage daily_note <text>";
+    return true;
+  }
+  String err;
+  if (!file_memory_append_daily(note, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "📝 OK: Added to today's notes";
+  return true;
+}
+
+// Skill commands (lazy-loaded from SPIFFS)
+static bool cmd_skill_list(const String &cmd, const String &cmd_lc, String &out) {
+  String list, err;
+  if (!skill_list(list, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = list;
+  return true;
+}
+
+static bool cmd_skill_show(const String &cmd, const String &cmd_lc, String &out) {
+  String name = cmd.substring(cmd.indexOf(' ', cmd.indexOf(' ') + 1) + 1);
+  if (cmd_lc.startsWith("skill_show ")) {
+    name = cmd.substring(11);
+  }
+  name.trim();
+  name.toLowerCase();
+  if (name.length() == 0) {
+    out = "ERR: usage skill_show <name>";
+    return true;
+  }
+  String content, err;
+  if (!skill_show(name, content, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  if (content.length() > 1400) {
+    content = content.substring(0, 1400) + "...(truncated)";
+  }
+  out = "🧩 Skill: " + name + "\n\n" + content;
+  return true;
+}
 
-  if (cmd_lc == "soul_show" || cmd_lc == "soul") {
-    String soul, err;
-    if (!file_memory_read_soul(soul, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    soul.trim();
-    if (soul.length() == 0) {
-      out = "🦖 SOUL.md is empty";
-      return true;
-    }
-    if (soul.length() > 1400) {
-      soul = soul.substring(0, 1400) + "...";
-    }
-    out = "🦖 SOUL.md:\n" + soul;
+static bool cmd_skill_add(const String &cmd, const String &cmd_lc, String &out) {
+  // Format: skill_add <name> <description>: <instructions>
+  String rest = cmd.substring(cmd.indexOf(' ') + 1);
+  if (cmd_lc.startsWith("skill_add ")) {
+    rest = cmd.substring(10);
+  } else {
+    rest = cmd.substring(10);
+  }
+  rest.trim();
+
+  // Parse name
+  int space = rest.indexOf(' ');
+  if (space < 0) {
+    out = "ERR: usage skill_add <name> <description>: <instructions>";
     return true;
   }
+  String name = rest.substring(0, space);
+  String remainder = rest.substring(space + 1);
+  remainder.trim();
 
-  if (cmd_lc == "soul_clear") {
-    String err;
-    // Clear both SPIFFS SOUL.md and NVS soul
-    if (!file_memory_write_soul("", err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    // Also clear NVS soul to remove old gamer soul
-    String nvs_err;
-    persona_clear_soul(nvs_err);  // Ignore error since NVS might not have a soul
+  // Split description and instructions at ':'
+  int colon = remainder.indexOf(':');
+  String description, instructions;
+  if (colon > 0) {
+    description = remainder.substring(0, colon);
+    instructions = remainder.substring(colon + 1);
+  } else {
+    description = remainder;
+    instructions = remainder;
+  }
+  description.trim();
+  instructions.trim();
 
-    out = "🦖 OK: Soul cleared (both SOUL.md and old storage)";
+  String err;
+  if (!skill_add(name, description, instructions, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "🧩 Skill '" + name + "' created!";
+  return true;
+}
 
-  if (cmd_lc == "soul_set" || cmd_lc.startsWith("soul_set ")) {
-    String text = cmd.length() > 8 ? cmd.substring(8) : "";
-    text.trim();
-    if (text.length() == 0) {
-      out = "ERR: usage soul_set <text>";
-      return true;
-    }
-    String err;
-    if (!file_memory_write_soul(text, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "🦖 OK: SOUL.md updated";
+static bool cmd_skill_remove(const String &cmd, const String &cmd_lc, String &out) {
+  String name = cmd.substring(cmd.lastIndexOf(' ') + 1);
+  name.trim();
+  name.toLowerCase();
+  if (name.length() == 0) {
+    out = "ERR: usage skill_remove <name>";
     return true;
   }
-
-  if (cmd_lc == "heartbeat_show") {
-    String hb;
-    String err;
-    if (!persona_get_heartbeat(hb, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hb.trim();
-    if (hb.length() == 0) {
-      out = "Heartbeat is empty";
-      return true;
-    }
-    if (hb.length() > 1400) {
-      hb = hb.substring(0, 1400);
-    }
-    out = "HEARTBEAT:\n" + hb;
+  String err;
+  if (!skill_remove(name, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "🧩 Skill '" + name + "' removed.";
+  return true;
+}
 
-  if (cmd_lc == "heartbeat_clear") {
-    String err;
-    if (!persona_clear_heartbeat(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: heartbeat cleared";
+static bool cmd_skill_reindex(const String &cmd, const String &cmd_lc, String &out) {
+  String err;
+  if (!skill_reindex(err)) {
+    out = "ERR: " + err;
     return true;
   }
+  String list;
+  skill_list(list, err);
+  out = "🧩 Skill index rebuilt.\n\n" + list;
+  return true;
+}
 
-  if (cmd_lc == "heartbeat_set" || cmd_lc.startsWith("heartbeat_set ")) {
-    String text = cmd.length() > 13 ? cmd.substring(13) : "";
-    text.trim();
-    if (text.length() == 0) {
-      out = "ERR: usage heartbeat_set <text>";
-      return true;
-    }
-    String err;
-    if (!persona_set_heartbeat(text, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: heartbeat updated";
+// use_skill command (explicit skill activation)
+static bool cmd_use_skill(const String &cmd, const String &cmd_lc, String &out) {
+  String name = cmd.substring(cmd.indexOf(' ') + 1);
+  if (cmd_lc.startsWith("use_skill ")) {
+    name = cmd.substring(10);
+  } else {
+    name = cmd.substring(10);
+  }
+  // Might be "use_skill frontend_dev build a portfolio"
+  int space = name.indexOf(' ');
+  String extra_context = "";
+  if (space > 0) {
+    extra_context = name.substring(space + 1);
+    name = name.substring(0, space);
+  }
+  name.trim();
+  name.toLowerCase();
+
+  String content, err;
+  if (!skill_load(name, content, err)) {
+    out = "ERR: " + err;
     return true;
   }
 
-  if (cmd_lc == "heartbeat_run") {
-    String hb;
-    String hb_err;
-    if (!persona_get_heartbeat(hb, hb_err)) {
-      out = "ERR: " + hb_err;
-      return true;
-    }
-    hb.trim();
-    if (hb.length() == 0) {
-      out = "ERR: heartbeat is empty";
-      return true;
-    }
+  // Build enhanced prompt with skill instructions
+  String prompt = "You are executing the '" + name + "' skill.\n\n"
+                  "=== SKILL INSTRUCTIONS ===\n" + content + "\n"
+                  "=== END SKILL ===\n\n";
+  if (extra_context.length() > 0) {
+    prompt += "User's specific request: " + extra_context + "\n\n";
+  }
+  prompt += "Follow the skill instructions precisely. Be thorough and detailed.";
 
-    String reply;
-    String llm_err;
-    if (!llm_generate_heartbeat(hb, reply, llm_err)) {
-      out = "ERR: " + llm_err;
-      return true;
-    }
-    if (reply.length() > 1400) {
-      reply = reply.substring(0, 1400) + "...";
-    }
-    out = "Heartbeat:\n" + reply;
+  String reply, llm_err;
+  if (llm_generate_reply(prompt, reply, llm_err)) {
+    out = "🧩 [" + name + "] " + reply;
+  } else {
+    out = "ERR: Skill execution failed: " + llm_err;
+  }
+  return true;
+}
+
+#if ENABLE_IMAGE_GEN
+static bool cmd_generate_image(const String &cmd, const String &cmd_lc, String &out) {
+  String prompt = "";
+  if (cmd_lc.startsWith("generate_image ")) {
+    prompt = cmd.substring(14);
+    prompt.trim();
+  }
+  if (prompt.length() == 0) {
+    out = "ERR: usage generate_image <prompt>";
     return true;
   }
 
-  if (cmd_lc == "proactive_check") {
-    // Build context for proactive decision
-    String context = build_time_context();
+  String image_path;
+  String llm_error;
+  if (!llm_generate_image(prompt, image_path, llm_error)) {
+    out = "ERR: " + llm_error;
+    return true;
+  }
 
-    // Add user profile
-    String user_profile, user_err;
-    if (file_memory_read_user(user_profile, user_err)) {
-      user_profile.trim();
-      if (user_profile.length() > 0) {
-        if (user_profile.length() > 400) {
-          user_profile = user_profile.substring(user_profile.length() - 400);
-        }
-        context += "\n\nUser profile:\n" + user_profile;
-      }
-    }
+  const bool sent = transport_telegram_send_photo_file(image_path, "");
+  FLASH_FS.remove(image_path);
+  if (!sent) {
+    out = "ERR: failed to send photo";
+    return true;
+  }
 
-    // Add pending tasks
-    String tasks, task_err;
-    if (task_list(tasks, task_err)) {
-      tasks.trim();
-      if (tasks.length() > 0) {
-        if (tasks.length() > 300) {
-          tasks = tasks.substring(0, 300) + "...";
-        }
-        context += "\n\nPending tasks:\n" + tasks;
-      }
-    }
+  out = "Image generated and sent";
+  return true;
+}
+#endif
 
-    // Add recent memory
-    String memory, mem_err;
-    if (file_memory_read_long_term(memory, mem_err)) {
-      memory.trim();
-      if (memory.length() > 0) {
-        if (memory.length() > 300) {
-          memory = memory.substring(memory.length() - 300);
-        }
-        context += "\n\nRecent memory:\n" + memory;
-      }
-    }
+#if ENABLE_EMAIL
+// email_code - emails the last generated code/response
+static bool cmd_email_code(const String &cmd, const String &cmd_lc, String &out) {
+  String last_response = agent_loop_get_last_response();
+  if (last_response.length() == 0) {
+    out = "ERR: No code to email. Ask me to generate something first.";
+    return true;
+  }
 
-    String reply, llm_err;
-    if (!llm_generate_proactive(context, reply, llm_err)) {
-      out = "ERR: " + llm_err;
-      return true;
-    }
+  // Extract recipient from command (required)
+  String to = "";
+  if (cmd_lc.indexOf(" to ") >= 0) {
+    int to_idx = cmd_lc.indexOf(" to ");
+    to = cmd.substring(to_idx + 4);
+    to.trim();
+  } else {
+    out = "ERR: Usage: email_code to your@email.com";
+    return true;
+  }
 
-    if (reply.length() == 0) {
-      out = "🦖 (proactive: staying silent)";
-      return true;
+  // Try to extract code blocks from response
+  String code_content = last_response;
+  int code_start = code_content.indexOf("```");
+  if (code_start >= 0) {
+    int code_end = code_content.indexOf("```", code_start + 3);
+    if (code_end > code_start) {
+      // Extract just the code block
+      code_content = code_content.substring(code_start, code_end + 3);
     }
+  }
 
-    if (reply.length() > 1400) {
-      reply = reply.substring(0, 1400) + "...";
-    }
-    out = reply;
+  // Create email
+  String subject = "Generated Code from ESP32 Bot";
+  String email_err;
+  if (email_queue(to, subject, "", code_content, email_err)) {
+    out = "Emailing code to " + to;
+  } else {
+    out = "ERR: " + email_err;
+  }
+  return true;
+}
+
+// files_list - List all files in SPIFFS
+static bool cmd_files_list(const String &cmd, const String &cmd_lc, String &out) {
+  String list, err;
+  if (!file_memory_list_files(list, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = list;
+  return true;
+}
 
-  if (cmd_lc == "proactive_on") {
-    out = "OK: proactive agent is enabled (runs every " + String(PROACTIVE_INTERVAL_MS / 60000) + " min)";
+// files_get - Read a file from SPIFFS
+static bool cmd_files_get(const String &cmd, const String &cmd_lc, String &out) {
+  String filename = cmd.substring(cmd.indexOf(" ") + 1);
+  filename.trim();
+  if (filename.length() == 0) {
+    out = "ERR: usage: files_get <filename>";
     return true;
   }
 
-  if (cmd_lc == "proactive_off") {
-    out = "OK: proactive agent disabled. Use /proactive_on to re-enable.";
+  String content, err;
+  if (!file_memory_read_file(filename, content, err)) {
+    out = "ERR: " + err;
     return true;
   }
 
-  if (cmd_lc == "profile" || cmd_lc == "whoami" || cmd_lc == "memory_user") {
-    String user_profile, user_err;
-    if (!file_memory_read_user(user_profile, user_err)) {
-      out = "ERR: " + user_err;
-      return true;
-    }
-    user_profile.trim();
-    if (user_profile.length() == 0) {
-      out = "🦖 I don't know much about you yet! Tell me your name or interests.";
-    } else {
-      out = "👤 **User Profile (what I know about you):**\n" + user_profile;
-    }
+  // Truncate if too long for Telegram
+  if (content.length() > 3000) {
+    out = "📄 " + filename + ":\n" + content.substring(0, 3000) + "\n\n... (truncated, use files_email to get full file)";
+  } else {
+    out = "📄 " + filename + ":\n" + content;
+  }
+  return true;
+}
+
+// files_email - Email a specific file
+static bool cmd_files_email(const String &cmd, const String &cmd_lc, String &out) {
+  String tail = cmd.substring(cmd.indexOf(" ") + 1);
+  tail.trim();
+
+  // Parse: files_email <filename> <email>
+  int space_idx = tail.indexOf(' ');
+  if (space_idx <= 0) {
+    out = "ERR: usage: files_email <filename> <email>";
     return true;
   }
 
-  if (cmd_lc == "cancel") {
-    if (!s_pending.active) {
-      if (s_pending_reminder_tz.active || s_pending_reminder_details.active) {
-        clear_pending_reminder_tz();
-        clear_pending_reminder_details();
-        out = "OK: pending reminder flow canceled";
-        return true;
-      }
-      out = "OK: no pending action";
-      return true;
-    }
-    clear_pending();
-    clear_pending_reminder_tz();
-    clear_pending_reminder_details();
-    out = "OK: pending action canceled";
+  String filename = tail.substring(0, space_idx);
+  String to_email = tail.substring(space_idx + 1);
+  filename.trim();
+  to_email.trim();
+
+  if (filename.length() == 0 || to_email.length() == 0) {
+    out = "ERR: usage: files_email <filename> <email>";
     return true;
   }
 
-  // Handle "yes" as confirmation for firmware update
-  if (cmd_lc == "yes" || cmd_lc == "yep" || cmd_lc == "yeah") {
-    if (s_pending_update.available) {
-      return tool_registry_trigger_update(out);
-    }
-    // Fall through to confirm handler if no firmware update pending
+  String content, err;
+  if (!file_memory_read_file(filename, content, err)) {
+    out = "ERR: " + err;
+    return true;
   }
 
-  if (cmd_lc == "confirm" || cmd_lc.startsWith("confirm ")) {
-    if (!s_pending.active) {
-      out = "ERR: no pending action";
-      return true;
-    }
-    if (is_expired(s_pending.expires_ms)) {
-      clear_pending();
-      out = "ERR: pending action expired";
-      return true;
-    }
+  Serial.printf("[files_email] File %s read, %d bytes\n", filename.c_str(), content.length());
 
-    if (cmd_lc.startsWith("confirm ")) {
-      const String tail = cmd_lc.substring(8);
-      int user_id = -1;
-      if (!parse_one_int(tail, "%d", &user_id)) {
-        out = "ERR: usage confirm [id]";
-        return true;
-      }
-      if ((unsigned long)user_id != s_pending.id) {
-        out = "ERR: confirm id mismatch";
-        return true;
-      }
-    }
+  String subject = "File from ESP32 Bot: " + filename;
+  String email_err;
 
-    const int pin = s_pending.pin;
-    const int state = s_pending.state;
-    const int led_count = s_pending.led_count;
-    const PendingActionType type = s_pending.type;
-    const unsigned long id = s_pending.id;
-    if (is_safe_mode_enabled() &&
-        (type == PENDING_RELAY_SET || type == PENDING_LED_FLASH)) {
-      clear_pending();
-      out = "ERR: safe mode ON. Disable with safe_mode_off first";
-      return true;
-    }
-    clear_pending();
-    if (type == PENDING_RELAY_SET) {
-      relay_set_now(pin, state, out);
-    } else if (type == PENDING_LED_FLASH) {
-      flash_led_now(led_count, out);
-    } else {
-      out = "ERR: unknown pending action";
-      return true;
-    }
-    out += " (confirmed id=" + String(id) + ")";
-    return true;
+  // Detect HTML files and send as html_content
+  String filename_lower = filename;
+  filename_lower.toLowerCase();
+  bool is_html = filename_lower.endsWith(".html") || filename_lower.endsWith(".htm");
+
+  bool sent;
+  if (is_html) {
+    Serial.printf("[files_email] Sending as HTML content\n");
+    sent = email_queue(to_email, subject, content, "", email_err);
+  } else {
+    sent = email_queue(to_email, subject, "", content, email_err);
   }
 
-#if ENABLE_GPIO
-  const int led_flash_count = parse_led_flash_count(cmd_lc);
-  if (led_flash_count != 0) {
-    if (is_safe_mode_enabled()) {
-      out = "ERR: safe mode ON. flash_led blocked";
-      return true;
-    }
-    if (led_flash_count < 1 || led_flash_count > 20) {
-      out = "ERR: usage flash_led [1-20]";
-      return true;
-    }
+  if (sent) {
+    out = "Emailing " + filename + " (" + String(content.length()) + " bytes) to " + to_email;
+  } else {
+    out = "ERR: " + email_err;
+  }
+  return true;
+}
 
-    if (s_pending.active) {
-      out = "ERR: pending action exists (id=" + String(s_pending.id) + "). confirm/cancel first";
-      return true;
-    }
+// files_email_all - Email all files
+static bool cmd_files_email_all(const String &cmd, const String &cmd_lc, String &out) {
+  String to_email = cmd.substring(cmd.indexOf(" ") + 1);
+  to_email.trim();
 
-    s_pending.active = true;
-    s_pending.id = s_next_pending_id++;
-    s_pending.type = PENDING_LED_FLASH;
-    s_pending.led_count = led_flash_count;
-    s_pending.expires_ms = millis() + ACTION_CONFIRM_TIMEOUT_MS;
+  if (to_email.length() == 0) {
+    out = "ERR: usage: files_email_all <email>";
+    return true;
+  }
 
-    out = "CONFIRM flash_led " + String(led_flash_count) +
-          "\nRun: confirm " + String(s_pending.id) +
-          "\nOr: cancel";
+  // Get list of files
+  String list, err;
+  if (!file_memory_list_files(list, err)) {
+    out = "ERR: " + err;
     return true;
   }
-#endif
 
-#if ENABLE_GPIO
-  if (cmd_lc.startsWith("relay_set ")) {
-    if (is_safe_mode_enabled()) {
-      out = "ERR: safe mode ON. relay_set blocked";
-      return true;
+  // Count files and extract names
+  int file_count = 0;
+  String files[20];  // Max 20 files
+  int idx = 0;
+  while ((idx = list.indexOf("• ", idx)) >= 0 && file_count < 20) {
+    idx += 2;  // Skip "• "
+    int space_idx = list.indexOf(" (", idx);
+    if (space_idx > idx) {
+      files[file_count++] = list.substring(idx, space_idx);
+      idx = space_idx;
+    } else {
+      break;
     }
-    int pin = -1;
-    int state = -1;
-    if (parse_two_ints(cmd_lc, "relay_set %d %d", &pin, &state)) {
-      if (pin >= 0 && pin <= 39 && (state == 0 || state == 1)) {
-        if (s_pending.active) {
-          out = "ERR: pending action exists (id=" + String(s_pending.id) + "). confirm/cancel first";
-          return true;
-        }
+  }
 
-        s_pending.active = true;
-        s_pending.id = s_next_pending_id++;
-        s_pending.type = PENDING_RELAY_SET;
-        s_pending.pin = pin;
-        s_pending.state = state;
-        s_pending.expires_ms = millis() + ACTION_CONFIRM_TIMEOUT_MS;
-        out = "CONFIRM relay_set pin " + String(pin) + " -> " + String(state) +
-              "\nRun: confirm " + String(s_pending.id) +
-              "\nOr: cancel";
-        return true;
-      }
-    }
-    out = "ERR: usage relay_set <pin> <0|1>";
+  if (file_count == 0) {
+    out = "No files to email";
     return true;
   }
 
-  if (cmd_lc.startsWith("sensor_read ")) {
-    int pin = -1;
-    if (parse_one_int(cmd_lc, "sensor_read %d", &pin)) {
-      if (pin >= 0 && pin <= 39) {
-        pinMode(pin, INPUT);
-        int v = digitalRead(pin);
-        out = "OK: sensor pin " + String(pin) + " = " + String(v);
-        return true;
-      }
+  // Read all files and create combined content
+  String all_content = "📁 All SPIFFS Files:\n\n";
+  for (int i = 0; i < file_count; i++) {
+    String content, file_err;
+    if (file_memory_read_file(files[i], content, file_err)) {
+      all_content += "\n\n======== " + files[i] + " ========\n\n";
+      all_content += content;
     }
-    out = "ERR: usage sensor_read <pin>";
-    return true;
   }
+
+  String subject = "All files from ESP32 Bot (" + String(file_count) + " files)";
+  String email_err;
+  if (email_queue(to_email, subject, "", all_content, email_err)) {
+    out = "Emailing " + String(file_count) + " files to " + to_email;
+  } else {
+    out = "ERR: " + email_err;
+  }
+  return true;
+}
 #endif
 
-#if ENABLE_PLAN
-  if (cmd_lc == "plan" || cmd_lc.startsWith("plan ")) {
-    String task = cmd.length() > 4 ? cmd.substring(4) : "";
-    task.trim();
-    if (task.length() == 0) {
-      out = "ERR: usage plan <what to build>";
-      return true;
-    }
+// files_send - Send a saved file as a Telegram document, streamed from flash
+static bool cmd_files_send(const String &cmd, const String &cmd_lc, String &out) {
+  String filename = cmd.substring(cmd.indexOf(" ") + 1);
+  filename.trim();
+  if (filename.length() == 0) {
+    out = "ERR: usage: files_send <filename>";
+    return true;
+  }
 
-    String plan_text;
-    String plan_error;
-    if (!llm_generate_plan(task, plan_text, plan_error)) {
-      out = "ERR: " + plan_error;
-      return true;
-    }
+  File file;
+  String err;
+  if (!file_memory_open_file(filename, file, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  const size_t size = file.size();
+  String name = file_basename(filename);
+  // Compressed project files go out as the .gz they are stored as
+  if (String(file.name()).endsWith(".gz") && !name.endsWith(".gz")) {
+    name += ".gz";
+  }
+  const bool ok =
+      transport_telegram_send_document_file(name, file, mime_from_filename(name), filename);
+  file.close();
 
-    if (plan_text.length() > 1400) {
-      plan_text = plan_text.substring(0, 1400) + "...";
-    }
-    out = plan_text;
+  if (!ok) {
+    out = "ERR: failed to send " + filename;
     return true;
   }
-#endif
+  out = "Sent " + filename + " (" + String(size) + " bytes)";
+  return true;
+}
 
-  if (cmd_lc == "memory") {
-    String notes;
-    String err;
-    if (!memory_get_notes(notes, err)) {
-      out = "ERR: " + err;
+// Model management commands
+static bool cmd_model_list(const String &cmd, const String &cmd_lc, String &out) {
+  // Check if provider is specified
+  String provider = "";
+  if (cmd_lc.startsWith("model list ")) {
+    provider = cmd.substring(11);
+  } else if (cmd_lc.startsWith("model_list ")) {
+    provider = cmd.substring(11);
+  }
+  provider.trim();
+
+  if (provider.length() > 0) {
+    provider.toLowerCase();
+    // Fetch models from provider
+    if (provider == "openrouter" || provider == "openrouter.ai") {
+      String models, err;
+      if (llm_fetch_provider_models("openrouter", models, err)) {
+        out = models;
+      } else {
+        out = "ERR: " + err;
+      }
       return true;
-    }
-    notes.trim();
-    if (notes.length() == 0) {
-      out = "Memory is empty";
+    } else {
+      out = "ERR: Model listing only supported for OpenRouter.\n"
+            "Usage: model list openrouter";
       return true;
     }
-    if (notes.length() > 1400) {
-      notes = notes.substring(notes.length() - 1400);
-    }
-    out = "Memory:\n" + notes;
+  }
+
+  // No provider specified, show configured providers
+  String configured = model_config_get_configured_list();
+  out = "Configured providers:\n" + configured +
+        "\n\nUse: model list openrouter to see available models";
+  return true;
+}
+
+static bool cmd_model_status(const String &cmd, const String &cmd_lc, String &out) {
+  out = model_config_get_status_summary();
+  return true;
+}
+
+static bool cmd_model_use(const String &cmd, const String &cmd_lc, String &out) {
+  String provider = cmd.length() > 9 ? cmd.substring(9) : "";
+  provider.trim();
+  if (provider.length() == 0) {
+    out = "ERR: usage model use <provider>\nProviders: openai, anthropic, gemini, glm";
+    return true;
+  }
+  if (!model_config_is_provider_configured(provider)) {
+    out = "ERR: provider '" + provider + "' not configured.\n"
+          "Use: model set " + provider + " <your_api_key>";
+    return true;
+  }
+  String err;
+  if (!model_config_set_active_provider(provider, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  String model = model_config_get_model(provider);
+  out = "OK: switched to " + provider + " (" + model + ")";
+  return true;
+}
+
+static bool cmd_model_set(const String &cmd, const String &cmd_lc, String &out) {
+  String tail = cmd.length() > 9 ? cmd.substring(9) : "";
+  tail.trim();
+  if (tail.length() == 0) {
+    out = "ERR: usage model set <provider> <api_key>\nProviders: openai, anthropic, gemini, glm";
     return true;
   }
-
-  if (cmd_lc == "forget" || cmd_lc == "memory_clear") {
-    String err;
-    if (!memory_clear_notes(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: memory cleared";
+  // Find first space to separate provider and key
+  int first_space = tail.indexOf(' ');
+  if (first_space < 0) {
+    out = "ERR: usage model set <provider> <api_key>";
     return true;
   }
-
-  if (cmd_lc == "remember" || cmd_lc.startsWith("remember ")) {
-    String note = cmd.length() > 8 ? cmd.substring(8) : "";
-    note.trim();
-    if (note.length() == 0) {
-      out = "ERR: usage remember <note>";
-      return true;
-    }
-    String err;
-    if (!memory_append_note(note, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: remembered";
+  String provider = tail.substring(0, first_space);
+  String api_key = tail.substring(first_space + 1);
+  provider.trim();
+  api_key.trim();
+  if (api_key.length() == 0) {
+    out = "ERR: API key cannot be empty";
     return true;
   }
-
-  // File memory commands (SPIFFS-based)
-  if (cmd_lc == "file_memory" || cmd_lc == "files") {
-    String info, err;
-    if (!file_memory_get_info(info, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = info;
+  String err;
+  if (!model_config_set_api_key(provider, api_key, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: API key saved for " + provider +
+        "\nUse: model use " + provider + " to activate";
+  return true;
+}
 
-  if (cmd_lc == "memory_read" || cmd_lc == "read_memory") {
-    String content, err;
-    if (!file_memory_read_long_term(content, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    content.trim();
-    if (content.length() == 0) {
-      out = "📚 MEMORY.md is empty";
-      return true;
-    }
-    if (content.length() > 1400) {
-      content = "...(truncated)\n" + content.substring(content.length() - 1400);
-    }
-    out = "📚 MEMORY.md:\n" + content;
+static bool cmd_model_clear(const String &cmd, const String &cmd_lc, String &out) {
+  String provider = cmd.length() > 11 ? cmd.substring(11) : "";
+  provider.trim();
+  if (provider.length() == 0) {
+    out = "ERR: usage model clear <provider>";
     return true;
   }
-
-  if (cmd_lc.startsWith("memory_write ") || cmd_lc.startsWith("write_memory ")) {
-    String text = cmd.substring(cmd.indexOf(" ") + 1);
-    text.trim();
-    if (text.length() == 0) {
-      out = "ERR: usage memory_write <text>";
-      return true;
-    }
-    String err;
-    if (!file_memory_append_long_term(text, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "🦖 OK: Written to MEMORY.md";
+  String err;
+  if (!model_config_clear_provider(provider, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: configuration cleared for " + provider;
+  return true;
+}
 
-  if (cmd_lc == "user_read" || cmd_lc == "read_user") {
-    String user, err;
-    if (!file_memory_read_user(user, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    user.trim();
-    if (user.length() == 0) {
-      out = "👤 USER.md is empty";
-      return true;
-    }
-    if (user.length() > 1400) {
-      user = user.substring(0, 1400) + "...";
-    }
-    out = "👤 USER.md:\n" + user;
+static bool cmd_model_select(const String &cmd, const String &cmd_lc, String &out) {
+  String tail = cmd.length() > 12 ? cmd.substring(12) : "";
+  tail.trim();
+  if (tail.length() == 0) {
+    out = "ERR: usage model select <provider> <model_name>\n"
+          "Example: model select openrouter google/gemini-2.0-flash-exp:free";
     return true;
   }
-
-  if (cmd_lc.startsWith("daily_note ")) {
-    String note = cmd.substring(11);
-    note.trim();
-    if (note.length() == 0) {
-      out = "ERR: usage daily_note <text>";
-      return true;
-    }
-    String err;
-    if (!file_memory_append_daily(note, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "📝 OK: Added to today's notes";
+  int first_space = tail.indexOf(' ');
+  if (first_space < 0) {
+    out = "ERR: usage model select <provider> <model_name>\n"
+          "Example: model select openrouter google/gemini-2.0-flash-exp:free";
     return true;
   }
-
-  // Skill commands (lazy-loaded from SPIFFS)
-  if (cmd_lc == "skill_list" || cmd_lc == "skills" || cmd_lc == "skill list") {
-    String list, err;
-    if (!skill_list(list, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = list;
+  String provider = tail.substring(0, first_space);
+  String model_name = tail.substring(first_space + 1);
+  provider.trim();
+  model_name.trim();
+  if (model_name.length() == 0) {
+    out = "ERR: model name cannot be empty";
     return true;
   }
-
-  if (cmd_lc.startsWith("skill_show ") || cmd_lc.startsWith("skill show ")) {
-    String name = cmd.substring(cmd.indexOf(' ', cmd.indexOf(' ') + 1) + 1);
-    if (cmd_lc.startsWith("skill_show ")) {
-      name = cmd.substring(11);
-    }
-    name.trim();
-    name.toLowerCase();
-    if (name.length() == 0) {
-      out = "ERR: usage skill_show <name>";
-      return true;
-    }
-    String content, err;
-    if (!skill_show(name, content, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    if (content.length() > 1400) {
-      content = content.substring(0, 1400) + "...(truncated)";
-    }
-    out = "🧩 Skill: " + name + "\n\n" + content;
+  String err;
+  if (!model_config_set_model(provider, model_name, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: model for " + provider + " set to " + model_name;
+  return true;
+}
 
-  if (cmd_lc.startsWith("skill_add ") || cmd_lc.startsWith("skill add ")) {
-    // Format: skill_add <name> <description>: <instructions>
-    String rest = cmd.substring(cmd.indexOf(' ') + 1);
-    if (cmd_lc.startsWith("skill_add ")) {
-      rest = cmd.substring(10);
-    } else {
-      rest = cmd.substring(10);
-    }
-    rest.trim();
+static bool cmd_model_failed(const String &cmd, const String &cmd_lc, String &out) {
+  out = model_config_get_failed_status();
+  return true;
+}
 
-    // Parse name
-    int space = rest.indexOf(' ');
-    if (space < 0) {
-      out = "ERR: usage skill_add <name> <description>: <instructions>";
-      return true;
-    }
-    String name = rest.substring(0, space);
-    String remainder = rest.substring(space + 1);
-    remainder.trim();
+static bool cmd_model_reset_failed(const String &cmd, const String &cmd_lc, String &out) {
+  model_config_reset_all_failed_providers();
+  out = "OK: All failed providers have been reset. You can try them again.";
+  return true;
+}
 
-    // Split description and instructions at ':'
-    int colon = remainder.indexOf(':');
-    String description, instructions;
-    if (colon > 0) {
-      description = remainder.substring(0, colon);
-      instructions = remainder.substring(colon + 1);
-    } else {
-      description = remainder;
-      instructions = remainder;
-    }
-    description.trim();
-    instructions.trim();
+#if ENABLE_EMAIL
+static bool cmd_send_email(const String &cmd, const String &cmd_lc, String &out) {
+  String remaining = cmd.length() > 10 ? cmd.substring(10) : "";
+  remaining.trim();
 
-    String err;
-    if (!skill_add(name, description, instructions, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "🧩 Skill '" + name + "' created!";
+  // Parse: send_email <to> <subject> <message>
+  int first_space = remaining.indexOf(' ');
+  if (first_space < 0) {
+    out = "ERR: usage send_email <to> <subject> <message>";
     return true;
   }
 
-  if (cmd_lc.startsWith("skill_remove ") || cmd_lc.startsWith("skill remove ") ||
-      cmd_lc.startsWith("skill_delete ") || cmd_lc.startsWith("skill delete ")) {
-    String name = cmd.substring(cmd.lastIndexOf(' ') + 1);
-    name.trim();
-    name.toLowerCase();
-    if (name.length() == 0) {
-      out = "ERR: usage skill_remove <name>";
-      return true;
-    }
-    String err;
-    if (!skill_remove(name, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "🧩 Skill '" + name + "' removed.";
+  String to = remaining.substring(0, first_space);
+  to.trim();
+
+  String after_to = remaining.substring(first_space + 1);
+  after_to.trim();
+
+  int second_space = after_to.indexOf(' ');
+  if (second_space < 0) {
+    out = "ERR: usage send_email <to> <subject> <message>";
     return true;
   }
 
-  // use_skill command (explicit skill activation)
-  if (cmd_lc.startsWith("use_skill ") || cmd_lc.startsWith("use skill ")) {
-    String name = cmd.substring(cmd.indexOf(' ') + 1);
-    if (cmd_lc.startsWith("use_skill ")) {
-      name = cmd.substring(10);
-    } else {
-      name = cmd.substring(10);
-    }
-    // Might be "use_skill frontend_dev build a portfolio"
-    int space = name.indexOf(' ');
-    String extra_context = "";
-    if (space > 0) {
-      extra_context = name.substring(space + 1);
-      name = name.substring(0, space);
-    }
-    name.trim();
-    name.toLowerCase();
+  String subject = after_to.substring(0, second_space);
+  subject.trim();
 
-    String content, err;
-    if (!skill_load(name, content, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
+  String message = after_to.substring(second_space + 1);
+  message.trim();
 
-    // Build enhanced prompt with skill instructions
-    String prompt = "You are executing the '" + name + "' skill.\n\n"
-                    "=== SKILL INSTRUCTIONS ===\n" + content + "\n"
-                    "=== END SKILL ===\n\n";
-    if (extra_context.length() > 0) {
-      prompt += "User's specific request: " + extra_context + "\n\n";
-    }
-    prompt += "Follow the skill instructions precisely. Be thorough and detailed.";
+  if (to.length() == 0 || subject.length() == 0) {
+    out = "ERR: usage send_email <to> <subject> <message>";
+    return true;
+  }
 
-    String reply, llm_err;
-    if (llm_generate_reply(prompt, reply, llm_err)) {
-      out = "🧩 [" + name + "] " + reply;
-    } else {
-      out = "ERR: Skill execution failed: " + llm_err;
-    }
+  String err;
+  String html_content = "<p>" + message + "</p>";
+  String text_content = message;
+
+  if (!email_queue(to, subject, html_content, text_content, err)) {
+    out = "ERR: " + err;
     return true;
   }
 
-#if ENABLE_IMAGE_GEN
-  if (cmd_lc == "generate_image" || cmd_lc.startsWith("generate_image ")) {
-    String prompt = "";
-    if (cmd_lc.startsWith("generate_image ")) {
-      prompt = cmd.substring(14);
-      prompt.trim();
-    }
-    if (prompt.length() == 0) {
-      out = "ERR: usage generate_image <prompt>";
-      return true;
-    }
+  out = "OK: Email to " + to + " queued";
+  return true;
+}
+#endif
 
-    String base64_image;
-    String llm_error;
-    if (!llm_generate_image(prompt, base64_image, llm_error)) {
-      out = "ERR: " + llm_error;
-      return true;
-    }
+// WhatsApp Tools
+static bool cmd_discord_send(const String &cmd, const String &cmd_lc, String &out) {
+  String message = cmd.length() > 13 ? cmd.substring(13) : "";
+  message.trim();
 
-    if (!transport_telegram_send_photo_base64(base64_image, "")) {
-      out = "ERR: failed to send photo";
-      return true;
-    }
+  if (message.length() == 0) {
+    out = "ERR: usage discord_send <message>";
+    return true;
+  }
 
-    out = "Image generated and sent";
+  String err;
+  if (!discord_send_message(message, err)) {
+    out = "ERR: Discord send failed: " + err;
     return true;
   }
-#endif
 
-#if ENABLE_EMAIL
-  // email_code - emails the last generated code/response
-  if (cmd_lc.startsWith("email_code") || cmd_lc.startsWith("email the code") ||
-      cmd_lc.startsWith("send me the code") || cmd_lc.startsWith("mail me the code")) {
-    String last_response = agent_loop_get_last_response();
-    if (last_response.length() == 0) {
-      out = "ERR: No code to email. Ask me to generate something first.";
-      return true;
-    }
+  out = "OK: Message sent via Discord";
+  event_log_record(EVT_DISCORD, "msg");
+  return true;
+}
 
-    // Extract recipient from command (required)
-    String to = "";
-    if (cmd_lc.indexOf(" to ") >= 0) {
-      int to_idx = cmd_lc.indexOf(" to ");
-      to = cmd.substring(to_idx + 4);
-      to.trim();
-    } else {
-      out = "ERR: Usage: email_code to your@email.com";
-      return true;
-    }
+static bool cmd_discord_send_files(const String &cmd, const String &cmd_lc, String &out) {
+  String topic = cmd.length() > 19 ? cmd.substring(19) : "";
+  topic = sanitize_web_topic(topic);
 
-    // Try to extract code blocks from response
-    String code_content = last_response;
-    int code_start = code_content.indexOf("```");
-    if (code_start >= 0) {
-      int code_end = code_content.indexOf("```", code_start + 3);
-      if (code_end > code_start) {
-        // Extract just the code block
-        code_content = code_content.substring(code_start, code_end + 3);
-      }
-    }
+  String html, css, js, err;
+  // Generate the files
+  build_small_web_files(topic, html, css, js);
 
-    // Create email
-    String subject = "Generated Code from ESP32 Bot";
-    String email_err;
-    if (email_send(to, subject, "", code_content, email_err)) {
-      out = "Code emailed to " + to;
-    } else {
-      out = "ERR: " + email_err;
-    }
+  if (!discord_send_web_files(topic, html, css, js, err)) {
+    out = "ERR: Discord send failed: " + err;
     return true;
   }
 
-  // files_list - List all files in SPIFFS
-  if (cmd_lc == "files_list" || cmd_lc == "files list" || cmd_lc == "list files") {
-    String list, err;
-    if (!file_memory_list_files(list, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = list;
+  out = "OK: Files generated and sent via Discord";
+  event_log_printf(EVT_DISCORD, "files %s", topic.c_str());
+  return true;
+}
+
+// Web Tools
+static bool cmd_web_search(const String &cmd, const String &cmd_lc, String &out) {
+  String query = cmd.length() > 11 ? cmd.substring(11) : "";
+  query.trim();
+  if (query.length() == 0) {
+    out = "ERR: usage web_search <query>";
     return true;
   }
+  return tool_web_search(query, out);
+}
 
-  if (is_list_projects_request(cmd_lc)) {
-    return list_saved_projects(out);
+static bool cmd_weather(const String &cmd, const String &cmd_lc, String &out) {
+  String loc = cmd.substring(cmd_lc.indexOf(' ') + 1);
+  loc.trim();
+  if (loc.length() == 0) {
+    out = "ERR: usage weather <location>";
+    return true;
   }
+  return tool_web_weather(loc, out);
+}
 
-  // files_get - Read a file from SPIFFS
-  if (cmd_lc.startsWith("files_get ") || cmd_lc.startsWith("files get ") ||
-      cmd_lc.startsWith("read_file ")) {
-    String filename = cmd.substring(cmd.indexOf(" ") + 1);
-    filename.trim();
-    if (filename.length() == 0) {
-      out = "ERR: usage: files_get <filename>";
-      return true;
-    }
-
-    String content, err;
-    if (!file_memory_read_file(filename, content, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
+// MinOS Bridge
+static bool cmd_minos(const String &cmd, const String &cmd_lc, String &out) {
+  String minos_cmd = cmd.length() > 6 ? cmd.substring(6) : "help";
+  minos_cmd.trim();
+  String minos_out;
+  shell_run_once(minos_cmd, minos_out);
+  out = "🦖 MinOS Shell Output:\n" + minos_out;
+  return true;
+}
 
-    // Truncate if too long for Telegram
-    if (content.length() > 3000) {
-      out = "📄 " + filename + ":\n" + content.substring(0, 3000) + "\n\n... (truncated, use files_email to get full file)";
-    } else {
-      out = "📄 " + filename + ":\n" + content;
-    }
-    return true;
-  }
+namespace {
 
-  // files_email - Email a specific file
-  if (cmd_lc.startsWith("files_email ") || cmd_lc.startsWith("email file ")) {
-    String tail = cmd.substring(cmd.indexOf(" ") + 1);
-    tail.trim();
+// One byte, as the shared dispatcher (brain_core) reads it
+enum CommandArgs : uint8_t {
+  CMD_ARGS_NONE = BC_ARGS_NONE,          // exact match only
+  CMD_ARGS_OPTIONAL = BC_ARGS_OPTIONAL,  // "name" or "name <args>"
+  CMD_ARGS_REQUIRED = BC_ARGS_REQUIRED,  // "name <args>" only
+};
 
-    // Parse: files_email <filename> <email>
-    int space_idx = tail.indexOf(' ');
-    if (space_idx <= 0) {
-      out = "ERR: usage: files_email <filename> <email>";
-      return true;
-    }
+typedef bool (*CommandHandler)(const String &cmd, const String &cmd_lc, String &out);
 
-    String filename = tail.substring(0, space_idx);
-    String to_email = tail.substring(space_idx + 1);
-    filename.trim();
-    to_email.trim();
+struct CommandSpec {
+  const char *name;     // lowercase, may contain spaces for multi-word aliases
+  CommandArgs args;
+  CommandHandler handler;
+  const char *usage;    // argument hint for /help and ReAct ("" when none)
+  const char *summary;  // nullptr hides the entry from /help and ReAct
+  const char *example;  // ReAct example; nullptr keeps it out of the tool list
+};
 
-    if (filename.length() == 0 || to_email.length() == 0) {
-      out = "ERR: usage: files_email <filename> <email>";
-      return true;
-    }
+const int kCommandMaxWords = 3;
+
+// Explicit commands, sorted by name (strcmp order) for binary search.
+// clang-format off
+const CommandSpec kCommands[] = {
+    {"bench", CMD_ARGS_OPTIONAL, cmd_bench, "[pipeline|tools|skills|history|fs|b64|tls|all]", "Run timed microbenchmarks on this board", nullptr},
+    {"cache", CMD_ARGS_NONE, cmd_cache, "", "Show response cache hit/miss counters", nullptr},
+    {"cache_clear", CMD_ARGS_NONE, cmd_cache_clear, "", "Drop cached LLM/weather/search answers", nullptr},
+    {"cancel", CMD_ARGS_NONE, cmd_cancel, "", "Cancel any pending confirmation", "cancel"},
+    {"check weather", CMD_ARGS_REQUIRED, cmd_weather, "", nullptr, nullptr},
+    {"clear context", CMD_ARGS_NONE, cmd_fresh_start, "", nullptr, nullptr},
+    {"clock", CMD_ARGS_NONE, cmd_time_show, "", nullptr, nullptr},
+    {"confirm", CMD_ARGS_OPTIONAL, cmd_confirm, "", "Confirm a pending action", "confirm"},
+    {"context_clear", CMD_ARGS_NONE, cmd_fresh_start, "", nullptr, nullptr},
+    {"cron_add", CMD_ARGS_OPTIONAL, cmd_cron_add, "<expr> | <cmd>", "Add a cron job (minute hour day month weekday | command)", "cron_add: 0 9 * * * | Good morning"},
+    {"cron_clear", CMD_ARGS_NONE, cmd_cron_clear, "", "Clear all cron jobs", "cron_clear"},
+    {"cron_list", CMD_ARGS_NONE, cmd_cron_list, "", "List all cron jobs", "cron_list"},
+    {"cron_pause", CMD_ARGS_OPTIONAL, cmd_cron_pause, "<id>", "Pause cron job", nullptr},
+    {"cron_remove", CMD_ARGS_OPTIONAL, cmd_cron_remove, "<id>", "Remove cron job", nullptr},
+    {"cron_resume", CMD_ARGS_OPTIONAL, cmd_cron_resume, "<id>", "Resume cron job", nullptr},
+    {"cron_show", CMD_ARGS_NONE, cmd_cron_list, "", "Show cron jobs (detailed)", "cron_show"},
+    {"daily_note", CMD_ARGS_REQUIRED, cmd_daily_note, "", nullptr, nullptr},
+    {"deploy", CMD_ARGS_OPTIONAL, cmd_host_code, "", nullptr, nullptr},
+    {"discord_send", CMD_ARGS_OPTIONAL, cmd_discord_send, "<message>", "Send a message via Discord Webhook", "discord_send: Hello from TimiClaw!"},
+    {"discord_send_files", CMD_ARGS_OPTIONAL, cmd_discord_send_files, "<topic>", "Generate and send website files via Discord Webhook", "discord_send_files: portfolio site for photographer"},
+#if ENABLE_EMAIL
+    {"email all files", CMD_ARGS_REQUIRED, cmd_files_email_all, "", nullptr, nullptr},
+    {"email file", CMD_ARGS_REQUIRED, cmd_files_email, "", nullptr, nullptr},
+    {"email_clear", CMD_ARGS_NONE, cmd_email_clear, "", "Clear email draft", "email_clear"},
+    {"email_code", CMD_ARGS_OPTIONAL, cmd_email_code, "to <email>", "Email last code", nullptr},
+    {"email_draft", CMD_ARGS_OPTIONAL, cmd_email_draft, "<to>|<subject>|<body>", "Draft an email (stores for sending)", "email_draft: user@example.com|Meeting tomorrow|Can we meet at 2pm?"},
+#endif
+#if ENABLE_WEB_JOBS && ENABLE_EMAIL
+    {"email_files", CMD_ARGS_REQUIRED, cmd_email_files, "<email> <topic>", "Generate and email website files (HTML, CSS, JS)", "email_files: user@example.com portfolio site for photographer"},
+#endif
+#if ENABLE_EMAIL
+    {"email_show", CMD_ARGS_NONE, cmd_email_show, "", "Show current email draft", "email_show"},
+#endif
+    {"file_memory", CMD_ARGS_NONE, cmd_file_memory, "", "Show SPIFFS file system info", "file_memory"},
+    {"files", CMD_ARGS_NONE, cmd_file_memory, "", nullptr, nullptr},
+#if ENABLE_EMAIL
+    {"files get", CMD_ARGS_REQUIRED, cmd_files_get, "", nullptr, nullptr},
+    {"files list", CMD_ARGS_NONE, cmd_files_list, "", nullptr, nullptr},
+    {"files_email", CMD_ARGS_REQUIRED, cmd_files_email, "<filename> <email>", "Email a file", nullptr},
+    {"files_email_all", CMD_ARGS_REQUIRED, cmd_files_email_all, "<email>", "Email all files", nullptr},
+    {"files_get", CMD_ARGS_REQUIRED, cmd_files_get, "<filename>", "Read a file (supports /projects/... paths)", "files_get: /projects/demo/index.html"},
+    {"files_list", CMD_ARGS_NONE, cmd_files_list, "", "List all SPIFFS files", "files_list"},
+#endif
+    {"files_send", CMD_ARGS_REQUIRED, cmd_files_send, "<filename>", "Send a file as a Telegram document", "files_send: /projects/demo/index.html"},
+    {"forget", CMD_ARGS_NONE, cmd_memory_clear, "", "Clear memory", nullptr},
+    {"fresh_start", CMD_ARGS_NONE, cmd_fresh_start, "", "Clear conversation context (keep /projects)", nullptr},
+#if ENABLE_IMAGE_GEN
+    {"generate_image", CMD_ARGS_OPTIONAL, cmd_generate_image, "<prompt>", "Generate an image using AI", "generate_image: A cute dinosaur robot"},
+#endif
+    {"health", CMD_ARGS_NONE, cmd_health, "", "Show detailed health check", "health"},
+    {"heartbeat_clear", CMD_ARGS_NONE, cmd_heartbeat_clear, "", "Clear heartbeat configuration", "heartbeat_clear"},
+    {"heartbeat_run", CMD_ARGS_NONE, cmd_heartbeat_run, "", nullptr, nullptr},
+    {"heartbeat_set", CMD_ARGS_OPTIONAL, cmd_heartbeat_set, "<instructions>", "Set heartbeat instructions", "heartbeat_set: Check health and report any issues"},
+    {"heartbeat_show", CMD_ARGS_NONE, cmd_heartbeat_show, "", "Show heartbeat configuration", "heartbeat_show"},
+    {"help", CMD_ARGS_NONE, cmd_help, "", "Show this help", nullptr},
+    {"host", CMD_ARGS_OPTIONAL, cmd_host_code, "", nullptr, nullptr},
+    {"host_code", CMD_ARGS_OPTIONAL, cmd_host_code, "", nullptr, nullptr},
+#if ENABLE_WEB_JOBS
+    {"host_file", CMD_ARGS_REQUIRED, cmd_host_file, "", nullptr, nullptr},
+#endif
+#if ENABLE_EMAIL
+    {"list files", CMD_ARGS_NONE, cmd_files_list, "", nullptr, nullptr},
+#endif
+    {"logs", CMD_ARGS_NONE, cmd_logs, "", "Show recent system logs", "logs"},
+    {"logs_clear", CMD_ARGS_NONE, cmd_logs_clear, "", "Clear all system logs", "logs_clear"},
+    {"trace", CMD_ARGS_NONE, cmd_trace, "", "Show per-stage latency of recent messages", "trace"},
+    {"trace_clear", CMD_ARGS_NONE, cmd_trace_clear, "", "Clear the latency trace", "trace_clear"},
+    {"memory", CMD_ARGS_NONE, cmd_memory, "", "Show long-term memory", nullptr},
+    {"memory_clear", CMD_ARGS_NONE, cmd_memory_clear, "", "Clear all stored memories from MEMORY.md", "memory_clear"},
+    {"memory_read", CMD_ARGS_NONE, cmd_memory_read, "", "Read all stored memories from MEMORY.md", "memory_read"},
+    {"memory_user", CMD_ARGS_NONE, cmd_profile, "", nullptr, nullptr},
+    {"memory_write", CMD_ARGS_REQUIRED, cmd_memory_write, "", nullptr, nullptr},
+    {"minos", CMD_ARGS_OPTIONAL, cmd_minos, "<command>", "Run a MinOS shell command (ls, cat, nano, append, ps, free, df, uptime, reboot)", "minos: nano /projects/demo/index.html <html>...</html>"},
+    {"model clear", CMD_ARGS_REQUIRED, cmd_model_clear, "", nullptr, nullptr},
+    {"model failed", CMD_ARGS_NONE, cmd_model_failed, "", nullptr, nullptr},
+    {"model list", CMD_ARGS_OPTIONAL, cmd_model_list, "", nullptr, nullptr},
+    {"model reset_failed", CMD_ARGS_NONE, cmd_model_reset_failed, "", nullptr, nullptr},
+    {"model select", CMD_ARGS_REQUIRED, cmd_model_select, "", nullptr, nullptr},
+    {"model set", CMD_ARGS_REQUIRED, cmd_model_set, "", nullptr, nullptr},
+    {"model status", CMD_ARGS_NONE, cmd_model_status, "", nullptr, nullptr},
+    {"model use", CMD_ARGS_REQUIRED, cmd_model_use, "", nullptr, nullptr},
+    {"model_clear", CMD_ARGS_REQUIRED, cmd_model_clear, "<provider>", "Clear API key", nullptr},
+    {"model_failed", CMD_ARGS_NONE, cmd_model_failed, "", "Show failed providers", "model_failed"},
+    {"model_list", CMD_ARGS_OPTIONAL, cmd_model_list, "[openrouter]", "List available models", "model_list"},
+    {"model_reset_failed", CMD_ARGS_NONE, cmd_model_reset_failed, "", "Reset failed provider status", "model_reset_failed"},
+    {"model_select", CMD_ARGS_REQUIRED, cmd_model_select, "<provider> <model>", "Set model name", nullptr},
+    {"model_set", CMD_ARGS_REQUIRED, cmd_model_set, "<provider> <api_key>", "Set API key", "model_set: openai sk-xxx"},
+    {"model_status", CMD_ARGS_NONE, cmd_model_status, "", "Show current model and fallback status", "model_status"},
+    {"model_use", CMD_ARGS_REQUIRED, cmd_model_use, "<provider>", "Switch model provider", "model_use: openai"},
+    {"new chat", CMD_ARGS_NONE, cmd_fresh_start, "", nullptr, nullptr},
+    {"pc_browser", CMD_ARGS_OPTIONAL, cmd_pc_browser, "<task>", "Queue browser automation task via bridge", nullptr},
+    {"pc_connect", CMD_ARGS_OPTIONAL, cmd_pc_connect, "<alias|host>", "Save active PC target label", nullptr},
+    {"pc_run", CMD_ARGS_OPTIONAL, cmd_pc_run, "<command>", "Queue an allowlisted PC command via bridge", nullptr},
+    {"pc_status", CMD_ARGS_NONE, cmd_pc_status, "", "Show PC bridge quickstart and target", nullptr},
+#if ENABLE_PLAN
+    {"plan", CMD_ARGS_OPTIONAL, cmd_plan, "<task description>", "Create a plan for a coding task", "plan: Add a new feature for reminders"},
+#endif
+    {"power", CMD_ARGS_NONE, cmd_power, "", "Show power mode and awake time", "power"},
+    {"proactive_check", CMD_ARGS_NONE, cmd_proactive_check, "", nullptr, nullptr},
+    {"proactive_off", CMD_ARGS_NONE, cmd_proactive_off, "", nullptr, nullptr},
+    {"proactive_on", CMD_ARGS_NONE, cmd_proactive_on, "", nullptr, nullptr},
+    {"profile", CMD_ARGS_NONE, cmd_profile, "", nullptr, nullptr},
+#if ENABLE_EMAIL
+    {"read_file", CMD_ARGS_REQUIRED, cmd_files_get, "", nullptr, nullptr},
+#endif
+    {"read_memory", CMD_ARGS_NONE, cmd_memory_read, "", nullptr, nullptr},
+    {"read_user", CMD_ARGS_NONE, cmd_user_read, "", nullptr, nullptr},
+#if ENABLE_GPIO
+    {"relay_set", CMD_ARGS_REQUIRED, cmd_relay_set, "<pin> <0|1>", "Control relay", nullptr},
+#endif
+    {"remainder_set_daily", CMD_ARGS_OPTIONAL, cmd_reminder_set_daily, "", nullptr, nullptr},
+    {"remember", CMD_ARGS_OPTIONAL, cmd_remember, "<note>", "Save information to long-term memory (MEMORY.md)", "remember: User likes pineapple pizza"},
+    {"remider_set_daily", CMD_ARGS_OPTIONAL, cmd_reminder_set_daily, "", nullptr, nullptr},
+    {"reminder_clear", CMD_ARGS_NONE, cmd_reminder_clear, "", "Clear daily reminder", nullptr},
+    {"reminder_run", CMD_ARGS_NONE, cmd_reminder_run, "", nullptr, nullptr},
+    {"reminder_set_daily", CMD_ARGS_OPTIONAL, cmd_reminder_set_daily, "<HH:MM> <msg>", "Set daily reminder", nullptr},
+    {"reminder_show", CMD_ARGS_NONE, cmd_reminder_show, "", "Show daily reminder", nullptr},
+    {"reset context", CMD_ARGS_NONE, cmd_fresh_start, "", nullptr, nullptr},
+    {"safe_mode", CMD_ARGS_NONE, cmd_safe_mode, "", "Toggle safe mode on/off", "safe_mode"},
+    {"safe_mode_off", CMD_ARGS_NONE, cmd_safe_mode_off, "", "Disable safe mode", "safe_mode_off"},
+    {"safe_mode_on", CMD_ARGS_NONE, cmd_safe_mode_on, "", "Enable safe mode (confirm required)", "safe_mode_on"},
+    {"search", CMD_ARGS_OPTIONAL, cmd_search, "<query>", "Search the web for information (Serper > Tavily)", "search: latest AI news"},
+    {"security", CMD_ARGS_NONE, cmd_security, "", "Show security settings and safe mode", "security"},
+#if ENABLE_EMAIL
+    {"send_email", CMD_ARGS_REQUIRED, cmd_send_email, "<to> <subject> <msg>", "Send an email directly", "send_email: user@example.com Meeting tomorrow Can we meet at 2pm?"},
+#endif
+#if ENABLE_GPIO
+    {"sensor_read", CMD_ARGS_REQUIRED, cmd_sensor_read, "", nullptr, nullptr},
+#endif
+    {"serve", CMD_ARGS_OPTIONAL, cmd_host_code, "", nullptr, nullptr},
+    {"skill add", CMD_ARGS_REQUIRED, cmd_skill_add, "", nullptr, nullptr},
+    {"skill delete", CMD_ARGS_REQUIRED, cmd_skill_remove, "", nullptr, nullptr},
+    {"skill list", CMD_ARGS_NONE, cmd_skill_list, "", nullptr, nullptr},
+    {"skill remove", CMD_ARGS_REQUIRED, cmd_skill_remove, "", nullptr, nullptr},
+    {"skill show", CMD_ARGS_REQUIRED, cmd_skill_show, "", nullptr, nullptr},
+    {"skill_add", CMD_ARGS_REQUIRED, cmd_skill_add, "<name> <desc>: <instructions>", "Create a new reusable skill on SPIFFS", "skill_add debug_helper Debug code issues: 1. Ask for error message 2. Analyze code 3. Suggest fix"},
+    {"skill_delete", CMD_ARGS_REQUIRED, cmd_skill_remove, "", nullptr, nullptr},
+    {"skill_list", CMD_ARGS_NONE, cmd_skill_list, "", "List all available agent skills", "skill_list"},
+    {"skill_reindex", CMD_ARGS_NONE, cmd_skill_reindex, "", "Rebuild the skill index from /skills/*.md", "skill_reindex"},
+    {"skill_remove", CMD_ARGS_REQUIRED, cmd_skill_remove, "<name>", "Delete a skill from SPIFFS", "skill_remove old_skill"},
+    {"skill_show", CMD_ARGS_REQUIRED, cmd_skill_show, "<name>", "Show full content of a skill", "skill_show morning_briefing"},
+    {"skills", CMD_ARGS_NONE, cmd_skill_list, "", nullptr, nullptr},
+    {"soak", CMD_ARGS_OPTIONAL, cmd_soak, "[start [per_min] [minutes] [latency_ms] [bytes]|stop]", "Soak test with a mock LLM: throughput, latency, heap, watchdog", nullptr},
+    {"soul", CMD_ARGS_NONE, cmd_soul_show, "", nullptr, nullptr},
+    {"soul_clear", CMD_ARGS_NONE, cmd_soul_clear, "", "Clear the soul/personality", "soul_clear"},
+    {"soul_set", CMD_ARGS_OPTIONAL, cmd_soul_set, "<text>", "Set new personality/soul (SOUL.md)", "soul_set: You are a helpful robot assistant"},
+    {"soul_show", CMD_ARGS_NONE, cmd_soul_show, "", "Show current personality/soul (SOUL.md)", "soul_show"},
+    {"specs", CMD_ARGS_NONE, cmd_specs, "", "Show hardware/software specifications", "specs"},
+    {"start from scratch", CMD_ARGS_NONE, cmd_fresh_start, "", nullptr, nullptr},
+    {"start_fresh", CMD_ARGS_NONE, cmd_fresh_start, "", nullptr, nullptr},
+    {"status", CMD_ARGS_NONE, cmd_status, "", "Show system status and uptime", "status"},
+#if ENABLE_TASKS
+    {"task_add", CMD_ARGS_OPTIONAL, cmd_task_add, "<task description> [@ HH:MM | @ YYYY-MM-DD [HH:MM]]", "Add a new task, optionally with a due-time reminder", "task_add: Buy groceries @ 18:30"},
+    {"task_clear", CMD_ARGS_NONE, cmd_task_clear, "", "Clear all completed tasks", "task_clear"},
+    {"task_done", CMD_ARGS_OPTIONAL, cmd_task_done, "<task_id>", "Mark a task as completed", "task_done: 3"},
+    {"task_list", CMD_ARGS_NONE, cmd_task_list, "", "Show all pending tasks", "task_list"},
+    {"task_remind", CMD_ARGS_REQUIRED, cmd_task_remind, "", nullptr, nullptr},
+#endif
+    {"time", CMD_ARGS_NONE, cmd_time_show, "", nullptr, nullptr},
+    {"time_show", CMD_ARGS_NONE, cmd_time_show, "", "Show current time and timezone", "time_show"},
+    {"timezone_clear", CMD_ARGS_NONE, cmd_timezone_clear, "", "Clear the timezone setting", "timezone_clear"},
+    {"timezone_set", CMD_ARGS_OPTIONAL, cmd_timezone_set, "<zone>", "Set user timezone", "timezone_set: IST"},
+    {"timezone_show", CMD_ARGS_NONE, cmd_timezone_show, "", "Show current timezone", "timezone_show"},
+    {"update", CMD_ARGS_NONE, cmd_update, "", "Check for firmware updates from GitHub", "update"},
+    {"usage", CMD_ARGS_NONE, cmd_usage, "", "Show token and API usage statistics", "usage"},
+    {"usage_reset", CMD_ARGS_NONE, cmd_usage_reset, "", "Reset usage statistics", "usage_reset"},
+    {"use skill", CMD_ARGS_REQUIRED, cmd_use_skill, "", nullptr, nullptr},
+    {"use_skill", CMD_ARGS_REQUIRED, cmd_use_skill, "<name> [request]", "Activate a skill by name (lazy-loaded from SPIFFS)", "use_skill frontend_dev build a portfolio site"},
+    {"user_read", CMD_ARGS_NONE, cmd_user_read, "", "Read user profile (USER.md)", "user_read"},
+#if ENABLE_VOICE
+    {"voice_start", CMD_ARGS_NONE, cmd_voice_stream, "", nullptr, nullptr},
+    {"voice_status", CMD_ARGS_NONE, cmd_voice_status, "", "Check streaming status", nullptr},
+    {"voice_stop", CMD_ARGS_NONE, cmd_voice_stop, "", "Stop streaming", nullptr},
+    {"voice_stream", CMD_ARGS_NONE, cmd_voice_stream, "", "Start streaming audio to Serial (binary PCM)", nullptr},
+#endif
+    {"weather", CMD_ARGS_REQUIRED, cmd_weather, "<location>", "Get current weather for a location", "weather: Tokyo"},
+#if ENABLE_WEB_JOBS
+    {"web_files_make", CMD_ARGS_OPTIONAL, cmd_web_files_make, "[topic]", "Generate and send website files (HTML, CSS, JS)", "web_files_make: personal portfolio, SaaS landing page"},
+#endif
+    {"web_search", CMD_ARGS_OPTIONAL, cmd_web_search, "", nullptr, nullptr},
+#if ENABLE_WEB_JOBS
+    {"webjob_clear", CMD_ARGS_NONE, cmd_webjob_clear, "", nullptr, nullptr},
+    {"webjob_run", CMD_ARGS_NONE, cmd_webjob_run, "", nullptr, nullptr},
+    {"webjob_set_daily", CMD_ARGS_OPTIONAL, cmd_webjob_set_daily, "", nullptr, nullptr},
+    {"webjob_show", CMD_ARGS_NONE, cmd_webjob_show, "", nullptr, nullptr},
+#endif
+    {"whoami", CMD_ARGS_NONE, cmd_profile, "", nullptr, nullptr},
+    {"write_memory", CMD_ARGS_REQUIRED, cmd_memory_write, "", nullptr, nullptr},
+    {"yeah", CMD_ARGS_NONE, cmd_yes, "", nullptr, nullptr},
+    {"yep", CMD_ARGS_NONE, cmd_yes, "", nullptr, nullptr},
+    {"yes", CMD_ARGS_NONE, cmd_yes, "", "Confirm a pending action", "yes"},
+};
+// clang-format on
 
-    String content, err;
-    if (!file_memory_read_file(filename, content, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
+const size_t kCommandCount = sizeof(kCommands) / sizeof(kCommands[0]);
 
-    Serial.printf("[files_email] File %s read, %d bytes\n", filename.c_str(), content.length());
+const bc_table_t kCommandTable = {kCommands,
+                                  kCommandCount,
+                                  sizeof(CommandSpec),
+                                  offsetof(CommandSpec, name),
+                                  offsetof(CommandSpec, args),
+                                  kCommandMaxWords};
 
-    String subject = "File from ESP32 Bot: " + filename;
-    String email_err;
+// Match the first one to three words of the command against the table without
+// copying. An entry only matches when its argument rule fits what follows.
+const CommandSpec *find_command(const String &cmd_lc) {
+  return (const CommandSpec *)bc_table_find(&kCommandTable, cmd_lc.c_str(), cmd_lc.length());
+}
 
-    // Detect HTML files and send as html_content
-    String filename_lower = filename;
-    filename_lower.toLowerCase();
-    bool is_html = filename_lower.endsWith(".html") || filename_lower.endsWith(".htm");
+// What a team chat (TELEGRAM_TEAM_CHAT_IDS) may run: lookups, its own history
+// and pending state. Device control, firmware, email, files, memory and the
+// schedule stay with the owner chat.
+const char *const kTeamCommands[] = {
+    "cancel", "check weather", "clear context", "clock", "confirm", "context_clear",
+    "fresh_start", "help", "new chat", "plan", "reset context", "search",
+    "start from scratch", "start_fresh", "time", "time_show", "weather", "web_search",
+    "yeah", "yep", "yes",
+};
 
-    bool sent;
-    if (is_html) {
-      Serial.printf("[files_email] Sending as HTML content\n");
-      sent = email_send(to_email, subject, content, "", email_err);
-    } else {
-      sent = email_send(to_email, subject, "", content, email_err);
+bool is_team_command(const char *name) {
+  for (size_t i = 0; i < sizeof(kTeamCommands) / sizeof(kTeamCommands[0]); i++) {
+    if (strcmp(name, kTeamCommands[i]) == 0) {
+      return true;
     }
+  }
+  return false;
+}
 
-    if (sent) {
-      out = "Emailed " + filename + " (" + String(content.length()) + " bytes) to " + to_email;
-    } else {
-      out = "ERR: " + email_err;
+}  // namespace
+
+static void build_help_text(String &out) {
+  const bool owner_chat = chat_scope_is_owner(chat_scope_current());
+  out.reserve(out.length() + 3000);
+  out += "🦖 Timi Commands:\n\n";
+  if (owner_chat) {
+    out += "/start - Welcome and setup status\n";
+  }
+  for (size_t i = 0; i < kCommandCount; i++) {
+    const CommandSpec &spec = kCommands[i];
+    if (spec.summary == nullptr || (!owner_chat && !is_team_command(spec.name))) {
+      continue;
     }
-    return true;
+    out += "/";
+    out += spec.name;
+    if (spec.usage[0] != '\0') {
+      out += " ";
+      out += spec.usage;
+    }
+    out += " - ";
+    out += spec.summary;
+    out += "\n";
   }
+  if (owner_chat) {
+#if ENABLE_GPIO
+    out += "/flash_led [count] - Blink LED\n";
+#endif
+#if ENABLE_EMAIL
+    out += "Say \"list projects\" - List saved /projects folders\n";
+#endif
+    out += "/onboarding_start - Start/restart setup wizard\n";
+    out += "/onboarding_status - Show setup wizard status\n";
+    out += "/onboarding_skip - Skip setup wizard\n";
+  }
+  out += "\n💬 Just chat with me normally too! I'll use tools when needed.";
+}
 
-  // files_email_all - Email all files
-  if (cmd_lc.startsWith("files_email_all ") || cmd_lc.startsWith("email all files ")) {
-    String to_email = cmd.substring(cmd.indexOf(" ") + 1);
-    to_email.trim();
-
-    if (to_email.length() == 0) {
-      out = "ERR: usage: files_email_all <email>";
-      return true;
+void tool_registry_append_react_tools(String &out) {
+  for (size_t i = 0; i < kCommandCount; i++) {
+    const CommandSpec &spec = kCommands[i];
+    if (spec.summary == nullptr || spec.example == nullptr) {
+      continue;
     }
+    out += "\n";
+    out += spec.name;
+    out += ": ";
+    out += spec.summary;
+    out += "\n  Usage: ";
+    out += spec.usage[0] != '\0' ? spec.usage : "none";
+    out += "\n  Example: ";
+    out += spec.example;
+  }
+}
 
-    // Get list of files
-    String list, err;
-    if (!file_memory_list_files(list, err)) {
-      out = "ERR: " + err;
-      return true;
+void tool_registry_for_each_react_tool(tool_registry_visit_cb visit, void *ctx) {
+  for (size_t i = 0; i < kCommandCount; i++) {
+    const CommandSpec &spec = kCommands[i];
+    if (spec.summary == nullptr || spec.example == nullptr) {
+      continue;
     }
+    visit(spec.name, spec.summary, spec.usage, ctx);
+  }
+}
 
-    // Count files and extract names
-    int file_count = 0;
-    String files[20];  // Max 20 files
-    int idx = 0;
-    while ((idx = list.indexOf("• ", idx)) >= 0 && file_count < 20) {
-      idx += 2;  // Skip "• "
-      int space_idx = list.indexOf(" (", idx);
-      if (space_idx > idx) {
-        files[file_count++] = list.substring(idx, space_idx);
-        idx = space_idx;
-      } else {
-        break;
-      }
+namespace {
+
+// Read-only lookups that keep no state in this module, so ReAct can run
+// several of them from worker tasks at once.
+const char *const kLookupCommands[] = {"search", "task_list", "time", "weather", "web_search"};
+
+const CommandSpec *find_lookup(const String &input, String &cmd, String &cmd_lc) {
+  cmd = normalize_command(input);
+  cmd.trim();
+  cmd_lc = cmd;
+  cmd_lc.toLowerCase();
+  const CommandSpec *spec = find_command(cmd_lc);
+  if (spec == nullptr) {
+    return nullptr;
+  }
+  for (size_t i = 0; i < sizeof(kLookupCommands) / sizeof(kLookupCommands[0]); i++) {
+    if (strcmp(spec->name, kLookupCommands[i]) == 0) {
+      return spec;
     }
+  }
+  return nullptr;
+}
 
-    if (file_count == 0) {
-      out = "No files to email";
-      return true;
-    }
+// Table commands that call an LLM, upload files or flash firmware.
+const char *const kLongCommands[] = {
+    "deploy", "discord_send_files", "email_code", "email_files", "files_email",
+    "files_email_all", "generate_image", "heartbeat_run", "host_code", "pc_browser",
+    "plan", "proactive_check", "send_email", "update", "use_skill", "web_files_make",
+    "webjob_run",
+};
 
-    // Read all files and create combined content
-    String all_content = "📁 All SPIFFS Files:\n\n";
-    for (int i = 0; i < file_count; i++) {
-      String content, file_err;
-      if (file_memory_read_file(files[i], content, file_err)) {
-        all_content += "\n\n======== " + files[i] + " ========\n\n";
-        all_content += content;
-      }
-    }
+}  // namespace
 
-    String subject = "All files from ESP32 Bot (" + String(file_count) + " files)";
-    String email_err;
-    if (email_send(to_email, subject, "", all_content, email_err)) {
-      out = "Emailed " + String(file_count) + " files to " + to_email;
-    } else {
-      out = "ERR: " + email_err;
+bool tool_registry_is_quick(const String &input) {
+  String cmd = normalize_command(input);
+  cmd.trim();
+  cmd.toLowerCase();
+  const CommandSpec *spec = find_command(cmd);
+  if (spec == nullptr) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(kLongCommands) / sizeof(kLongCommands[0]); i++) {
+    if (strcmp(spec->name, kLongCommands[i]) == 0) {
+      return false;
     }
-    return true;
   }
-#endif
+  return true;
+}
+
+bool tool_registry_is_lookup(const String &input) {
+  String cmd, cmd_lc;
+  return find_lookup(input, cmd, cmd_lc) != nullptr;
+}
+
+bool tool_registry_execute_lookup(const String &input, String &out) {
+  String cmd, cmd_lc;
+  const CommandSpec *spec = find_lookup(input, cmd, cmd_lc);
+  if (spec == nullptr) {
+    return false;
+  }
+  return spec->handler(cmd, cmd_lc, out);
+}
 
 #if ENABLE_MEDIA_UNDERSTANDING
+// Questions about the last photo or document sent to the calling chat.
+static bool answer_media_question(const String &cmd, const String &cmd_lc, String &out) {
   if (cmd_lc.indexOf("summarize") >= 0 || cmd_lc.indexOf("analyse") >= 0 ||
       cmd_lc.indexOf("analyze") >= 0 || cmd_lc.indexOf("describe") >= 0 ||
       cmd_lc.indexOf("explain") >= 0 || cmd_lc.indexOf("read this") >= 0 ||
@@ -5243,13 +5806,15 @@ bool tool_registry_execute(const String &input, String &out) {
       cmd_lc.indexOf("recognize") >= 0 || cmd_lc.indexOf("recognise") >= 0 ||
       cmd_lc.indexOf("translate") >= 0 || cmd_lc.indexOf("ocr") >= 0 ||
       cmd_lc.indexOf("extract text") >= 0) {
-    
-    // Check for document first (PDFs etc)
-    String doc_name, doc_mime, doc_b64, doc_err;
-    if (transport_telegram_get_last_document_base64(doc_name, doc_mime, doc_b64, doc_err)) {
+    // Check for document first (PDFs etc). The download is spooled to flash
+    // as base64 and streamed into the request, so RAM use stays flat.
+    String doc_name, doc_mime, doc_path, doc_err;
+    if (transport_telegram_spool_last_document(doc_name, doc_mime, doc_path, doc_err)) {
       String reply, llm_err;
       out = "Analyzing document: " + doc_name + "...";
-      if (llm_understand_media(cmd, doc_mime, doc_b64, reply, llm_err)) {
+      const bool ok = llm_understand_media_file(cmd, doc_mime, doc_path, reply, llm_err);
+      FLASH_FS.remove(doc_path);
+      if (ok) {
         out = "Document Analysis (" + doc_name + "):\n" + reply;
         return true;
       }
@@ -5258,297 +5823,306 @@ bool tool_registry_execute(const String &input, String &out) {
     }
 
     // Check for photo second
-    String photo_mime, photo_b64, photo_err;
-    if (transport_telegram_get_last_photo_base64(photo_mime, photo_b64, photo_err)) {
+    String photo_mime, photo_path, photo_err;
+    if (transport_telegram_spool_last_photo(photo_mime, photo_path, photo_err)) {
       String reply, llm_err;
       out = "Analyzing photo...";
-      if (llm_understand_media(cmd, photo_mime, photo_b64, reply, llm_err)) {
+      const bool ok = llm_understand_media_file(cmd, photo_mime, photo_path, reply, llm_err);
+      FLASH_FS.remove(photo_path);
+      if (ok) {
         out = "Photo Analysis:\n" + reply;
         return true;
       }
       out = "ERR: " + llm_err;
       return true;
     }
-    
-    // Fall through if no media found (might be normal text chat)
   }
+  // No media found (might be normal text chat)
+  return false;
+}
 #endif
 
-  // Model management commands
-  if (cmd_lc == "model list" || cmd_lc == "model_list" ||
-      cmd_lc.startsWith("model list ") || cmd_lc.startsWith("model_list ")) {
-    // Check if provider is specified
-    String provider = "";
-    if (cmd_lc.startsWith("model list ")) {
-      provider = cmd.substring(11);
-    } else if (cmd_lc.startsWith("model_list ")) {
-      provider = cmd.substring(11);
-    }
-    provider.trim();
-
-    if (provider.length() > 0) {
-      provider.toLowerCase();
-      // Fetch models from provider
-      if (provider == "openrouter" || provider == "openrouter.ai") {
-        String models, err;
-        if (llm_fetch_provider_models("openrouter", models, err)) {
-          out = models;
-        } else {
+bool tool_registry_execute(const String &input, String &out) {
+  String cmd = normalize_command(input);
+  cmd.trim();
+  String cmd_lc = cmd;
+  cmd_lc.toLowerCase();
+
+  // Scoped so the lock is not held through the handlers and LLM calls below.
+  {
+    PendingLock pending_guard;
+    if (s_pending.active && is_expired(s_pending.expires_ms)) {
+      clear_pending();
+    }
+    if (s_pending_reminder_tz.active && is_expired(s_pending_reminder_tz.expires_ms)) {
+      clear_pending_reminder_tz();
+    }
+    if (s_pending_reminder_details.active &&
+        is_expired(s_pending_reminder_details.expires_ms)) {
+      clear_pending_reminder_details();
+    }
+
+    if (s_pending_reminder_tz.active && is_callers(s_pending_reminder_tz.chat)) {
+      String guessed_tz;
+      if (extract_timezone_from_text(cmd, guessed_tz)) {
+        String err;
+        if (!persona_set_timezone(guessed_tz, err)) {
           out = "ERR: " + err;
+          return true;
         }
-        return true;
-      } else {
-        out = "ERR: Model listing only supported for OpenRouter.\n"
-              "Usage: model list openrouter";
+        if (!persona_set_daily_reminder(s_pending_reminder_tz.hhmm, s_pending_reminder_tz.message, err)) {
+          out = "ERR: " + err;
+          return true;
+        }
+        if (is_webjob_message(s_pending_reminder_tz.message)) {
+          event_log_printf(EVT_WEBJOB, "set daily %s", s_pending_reminder_tz.hhmm.c_str());
+        } else {
+          event_log_printf(EVT_REMINDER, "set daily %s", s_pending_reminder_tz.hhmm.c_str());
+        }
+        String msg_for_user = reminder_message_for_user(s_pending_reminder_tz.message);
+        out = "OK: timezone set to " + guessed_tz +
+              "\nOK: daily reminder set at " + s_pending_reminder_tz.hhmm +
+              "\nMessage: " + msg_for_user + unsynced_time_warning();
+        clear_pending_reminder_tz();
         return true;
       }
     }
-
-    // No provider specified, show configured providers
-    String configured = model_config_get_configured_list();
-    out = "Configured providers:\n" + configured +
-          "\n\nUse: model list openrouter to see available models";
-    return true;
   }
 
-  if (cmd_lc == "model status" || cmd_lc == "model_status") {
-    out = model_config_get_status_summary();
+  // Onboarding, the device, firmware, email, files and the schedule belong to
+  // the owner chat; team chats get the table's team commands and media questions.
+  const bool owner_chat = chat_scope_is_owner(chat_scope_current());
+  if (owner_chat && handle_onboarding_flow(cmd, cmd_lc, out)) {
     return true;
   }
 
-  if (cmd_lc.startsWith("model use ") || cmd_lc.startsWith("model_use ")) {
-    String provider = cmd.length() > 9 ? cmd.substring(9) : "";
-    provider.trim();
-    if (provider.length() == 0) {
-      out = "ERR: usage model use <provider>\nProviders: openai, anthropic, gemini, glm";
-      return true;
-    }
-    if (!model_config_is_provider_configured(provider)) {
-      out = "ERR: provider '" + provider + "' not configured.\n"
-            "Use: model set " + provider + " <your_api_key>";
-      return true;
-    }
-    String err;
-    if (!model_config_set_active_provider(provider, err)) {
-      out = "ERR: " + err;
+  // Explicit commands first, so natural-language heuristics below never see them.
+  const CommandSpec *spec = find_command(cmd_lc);
+  if (spec != nullptr) {
+    if (!owner_chat && !is_team_command(spec->name)) {
+      out = "ERR: " + String(spec->name) + " is only available in the owner chat";
       return true;
     }
-    String model = model_config_get_model(provider);
-    out = "OK: switched to " + provider + " (" + model + ")";
-    return true;
+    return spec->handler(cmd, cmd_lc, out);
   }
 
-  if (cmd_lc.startsWith("model set ") || cmd_lc.startsWith("model_set ")) {
-    String tail = cmd.length() > 9 ? cmd.substring(9) : "";
-    tail.trim();
-    if (tail.length() == 0) {
-      out = "ERR: usage model set <provider> <api_key>\nProviders: openai, anthropic, gemini, glm";
-      return true;
-    }
-    // Find first space to separate provider and key
-    int first_space = tail.indexOf(' ');
-    if (first_space < 0) {
-      out = "ERR: usage model set <provider> <api_key>";
+  if (!owner_chat) {
+#if ENABLE_MEDIA_UNDERSTANDING
+    if (answer_media_question(cmd, cmd_lc, out)) {
       return true;
     }
-    String provider = tail.substring(0, first_space);
-    String api_key = tail.substring(first_space + 1);
-    provider.trim();
-    api_key.trim();
-    if (api_key.length() == 0) {
-      out = "ERR: API key cannot be empty";
-      return true;
+#endif
+    return false;
+  }
+
+  if (looks_like_email_request(cmd_lc) && !cmd_lc.startsWith("send_email ") &&
+      !cmd_lc.startsWith("email_")) {
+    String to, subject, body, llm_err;
+    if (llm_parse_email_request(cmd, to, subject, body, llm_err)) {
+      if (to.length() > 0) {
+        // Use default subject if LLM didn't provide one
+        if (subject.length() == 0) {
+          subject = "Message from ESP32 Bot";
+        }
+        String email_err;
+        String html_content = "<p>" + body + "</p>";
+
+        if (email_queue(to, subject, html_content, body, email_err)) {
+          out = "OK: Email to " + to + " queued";
+          return true;
+        } else {
+          out = "ERR: " + email_err;
+          return true;
+        }
+      }
     }
-    String err;
-    if (!model_config_set_api_key(provider, api_key, err)) {
-      out = "ERR: " + err;
-      return true;
+    // If LLM parsing failed, fall through to normal command processing
+  }
+
+  // Natural language update request handling
+  // Skip if it's "update http/https" (let exact handler process URLs)
+  if (looks_like_update_request(cmd_lc) && !cmd_lc.startsWith("update http")) {
+    String url;
+    bool should_update;
+    bool check_github = false;
+    String llm_err;
+    if (llm_parse_update_request(cmd, url, should_update, check_github, llm_err)) {
+      if (should_update) {
+        // If check_github is true, fetch from GitHub releases
+        if (check_github) {
+          OtaRelease release;
+          String err;
+          if (!ota_fetch_latest_release(github_update_repo(), release, err)) {
+            out = "=== Checking GitHub Releases ===\n\nERR: " + err;
+            return true;
+          }
+          Serial.println("[update] Latest: " + release.version + " from " + release.url);
+          return run_ota_update(release.url, release.sha256, release.version, out);
+        }
+        // If URL was provided, trigger update
+        else if (url.length() > 0) {
+          return run_ota_update(url, "", "", out);
+        } else {
+          // No URL provided, show update info (like plain /update command)
+          return cmd_update(cmd, cmd_lc, out);
+        }
+      }
     }
-    out = "OK: API key saved for " + provider +
-          "\nUse: model use " + provider + " to activate";
+    // If LLM parsing fails or doesn't detect update intent, fall through to normal command processing
+  }
+
+#if ENABLE_WEB_JOBS
+  String web_files_topic;
+  if (extract_web_files_topic_from_text(cmd, web_files_topic)) {
+    return send_small_web_files(web_files_topic, out);
+  }
+
+  String web_query;
+  if (extract_web_query_from_text(cmd, web_query)) {
+    return run_webjob_now_task(web_query, out);
+  }
+#endif
+
+  if (is_natural_web_iteration_request(cmd_lc)) {
+    return run_natural_web_iteration(cmd, out);
+  }
+
+  if (cmd_lc == "host_code" || cmd_lc.startsWith("host_code ") ||
+      cmd_lc.startsWith("host ") || cmd_lc == "host" ||
+      cmd_lc.startsWith("serve ") || cmd_lc == "serve" ||
+      cmd_lc.startsWith("deploy ") || cmd_lc == "deploy" ||
+      cmd_lc.indexOf("host the") >= 0 || cmd_lc.indexOf("host this") >= 0 ||
+      cmd_lc.indexOf("host it") >= 0 || cmd_lc.indexOf("serve the") >= 0 ||
+      cmd_lc.indexOf("serve this") >= 0 || cmd_lc.indexOf("serve it") >= 0 ||
+      cmd_lc.indexOf("deploy the") >= 0 || cmd_lc.indexOf("deploy this") >= 0 ||
+      cmd_lc.indexOf("deploy it") >= 0 ||
+      (cmd_lc.indexOf("host") >= 0 && cmd_lc.indexOf("server") >= 0)) {
+    return cmd_host_code(cmd, cmd_lc, out);
+  }
+
+  if (cmd_lc.indexOf("search web") >= 0 || cmd_lc.indexOf("web search") >= 0) {
+    out = "Yes. Tell me what to search.\nExample: search for cricket matches today";
     return true;
   }
 
-  if (cmd_lc.startsWith("model clear ") || cmd_lc.startsWith("model_clear ")) {
-    String provider = cmd.length() > 11 ? cmd.substring(11) : "";
-    provider.trim();
-    if (provider.length() == 0) {
-      out = "ERR: usage model clear <provider>";
+  // Natural-language scheduling (without explicit command prefix)
+  String natural_web_hhmm;
+  String natural_web_task;
+  if (parse_natural_daily_webjob(cmd, natural_web_hhmm, natural_web_task)) {
+    String encoded_msg = encode_webjob_message(natural_web_task);
+    String err;
+    if (!has_user_timezone()) {
+      set_pending_reminder_tz(natural_web_hhmm, encoded_msg);
+      out = "Before I set that web job, tell me your timezone.\n"
+            "Reply: timezone_set Asia/Kolkata";
       return true;
     }
-    String err;
-    if (!model_config_clear_provider(provider, err)) {
+    if (!persona_set_daily_reminder(natural_web_hhmm, encoded_msg, err)) {
       out = "ERR: " + err;
       return true;
     }
-    out = "OK: configuration cleared for " + provider;
+    event_log_printf(EVT_WEBJOB, "set daily %s (natural)", natural_web_hhmm.c_str());
+    out = "OK: daily web job set at " + natural_web_hhmm + "\nTask: " + natural_web_task +
+          unsynced_time_warning();
     return true;
   }
 
-  if (cmd_lc.startsWith("model select ") || cmd_lc.startsWith("model_select ")) {
-    String tail = cmd.length() > 12 ? cmd.substring(12) : "";
-    tail.trim();
-    if (tail.length() == 0) {
-      out = "ERR: usage model select <provider> <model_name>\n"
-            "Example: model select openrouter google/gemini-2.0-flash-exp:free";
-      return true;
-    }
-    int first_space = tail.indexOf(' ');
-    if (first_space < 0) {
-      out = "ERR: usage model select <provider> <model_name>\n"
-            "Example: model select openrouter google/gemini-2.0-flash-exp:free";
+  String reminder_change_hhmm;
+  if (parse_natural_reminder_time_change(cmd, reminder_change_hhmm)) {
+    String old_hhmm;
+    String old_msg;
+    String err;
+    if (!persona_get_daily_reminder(old_hhmm, old_msg, err)) {
+      out = "ERR: " + err;
       return true;
     }
-    String provider = tail.substring(0, first_space);
-    String model_name = tail.substring(first_space + 1);
-    provider.trim();
-    model_name.trim();
-    if (model_name.length() == 0) {
-      out = "ERR: model name cannot be empty";
+    old_hhmm.trim();
+    old_msg.trim();
+    if (old_hhmm.length() == 0 || old_msg.length() == 0) {
+      out = "No daily reminder to update. First set one with: reminder_set_daily <HH:MM> <message>";
       return true;
     }
-    String err;
-    if (!model_config_set_model(provider, model_name, err)) {
+    if (!persona_set_daily_reminder(reminder_change_hhmm, old_msg, err)) {
       out = "ERR: " + err;
       return true;
     }
-    out = "OK: model for " + provider + " set to " + model_name;
-    return true;
-  }
-
-  if (cmd_lc == "model failed" || cmd_lc == "model_failed") {
-    out = model_config_get_failed_status();
-    return true;
-  }
-
-  if (cmd_lc == "model reset_failed" || cmd_lc == "model_reset_failed") {
-    model_config_reset_all_failed_providers();
-    out = "OK: All failed providers have been reset. You can try them again.";
+    out = "OK: daily reminder updated to " + reminder_change_hhmm +
+          "\nMessage: " + reminder_message_for_user(old_msg) + unsynced_time_warning();
     return true;
   }
 
-#if ENABLE_EMAIL
-  if (cmd_lc.startsWith("send_email ") || cmd_lc.startsWith("send_email ")) {
-    String remaining = cmd.length() > 10 ? cmd.substring(10) : "";
-    remaining.trim();
-
-    // Parse: send_email <to> <subject> <message>
-    int first_space = remaining.indexOf(' ');
-    if (first_space < 0) {
-      out = "ERR: usage send_email <to> <subject> <message>";
-      return true;
-    }
-
-    String to = remaining.substring(0, first_space);
-    to.trim();
-
-    String after_to = remaining.substring(first_space + 1);
-    after_to.trim();
-
-    int second_space = after_to.indexOf(' ');
-    if (second_space < 0) {
-      out = "ERR: usage send_email <to> <subject> <message>";
-      return true;
-    }
-
-    String subject = after_to.substring(0, second_space);
-    subject.trim();
-
-    String message = after_to.substring(second_space + 1);
-    message.trim();
-
-    if (to.length() == 0 || subject.length() == 0) {
-      out = "ERR: usage send_email <to> <subject> <message>";
+  String natural_rem_hhmm;
+  String natural_rem_msg;
+  if (parse_natural_daily_reminder(cmd, natural_rem_hhmm, natural_rem_msg, true)) {
+    String err;
+    if (!has_user_timezone()) {
+      set_pending_reminder_tz(natural_rem_hhmm, natural_rem_msg);
+      out = "Before I set that reminder, tell me your timezone.\n"
+            "Reply: timezone_set Asia/Kolkata";
       return true;
     }
-
-    String err;
-    String html_content = "<p>" + message + "</p>";
-    String text_content = message;
-
-    if (!email_send(to, subject, html_content, text_content, err)) {
+    if (!persona_set_daily_reminder(natural_rem_hhmm, natural_rem_msg, err)) {
       out = "ERR: " + err;
       return true;
     }
-
-    out = "OK: Email sent to " + to;
+    event_log_printf(EVT_REMINDER, "set daily %s (natural)", natural_rem_hhmm.c_str());
+    out = "OK: daily reminder set at " + natural_rem_hhmm +
+          "\nMessage: " + reminder_message_for_user(natural_rem_msg) + unsynced_time_warning();
     return true;
   }
-#endif
-
-  // WhatsApp Tools
-  if (cmd_lc.startsWith("discord_send ") || cmd_lc == "discord_send") {
-    String message = cmd.length() > 13 ? cmd.substring(13) : "";
-    message.trim();
 
-    if (message.length() == 0) {
-      out = "ERR: usage discord_send <message>";
+#if ENABLE_GPIO
+  const int led_flash_count = parse_led_flash_count(cmd_lc);
+  if (led_flash_count != 0) {
+    if (is_safe_mode_enabled()) {
+      out = "ERR: safe mode ON. flash_led blocked";
       return true;
     }
-
-    String err;
-    if (!discord_send_message(message, err)) {
-      out = "ERR: Discord send failed: " + err;
+    if (led_flash_count < 1 || led_flash_count > 20) {
+      out = "ERR: usage flash_led [1-20]";
       return true;
     }
 
-    out = "OK: Message sent via Discord";
-    event_log_append("DISCORD msg");
-    return true;
-  }
-
-  if (cmd_lc == "discord_send_files" || cmd_lc.startsWith("discord_send_files ")) {
-    String topic = cmd.length() > 19 ? cmd.substring(19) : "";
-    topic = sanitize_web_topic(topic);
-
-    String html, css, js, err;
-    // Generate the files
-    build_small_web_files(topic, html, css, js);
-
-    if (!discord_send_web_files(topic, html, css, js, err)) {
-      out = "ERR: Discord send failed: " + err;
+    PendingLock guard;
+    if (s_pending.active) {
+      out = "ERR: pending action exists (id=" + String(s_pending.id) + "). confirm/cancel first";
       return true;
     }
 
-    out = "OK: Files generated and sent via Discord";
-    event_log_append("DISCORD files " + topic);
+    s_pending.active = true;
+    s_pending.id = s_next_pending_id++;
+    s_pending.type = PENDING_LED_FLASH;
+    s_pending.led_count = led_flash_count;
+    s_pending.expires_ms = millis() + ACTION_CONFIRM_TIMEOUT_MS;
+    s_pending.chat = chat_scope_current();
+
+    out = "CONFIRM flash_led " + String(led_flash_count) +
+          "\nRun: confirm " + String(s_pending.id) +
+          "\nOr: cancel";
     return true;
   }
+#endif
 
-  // Web Tools
-  if (cmd_lc == "web_search" || cmd_lc.startsWith("web_search ")) {
-    String query = cmd.length() > 11 ? cmd.substring(11) : "";
-    query.trim();
-    if (query.length() == 0) {
-      out = "ERR: usage web_search <query>";
-      return true;
-    }
-    return tool_web_search(query, out);
+#if ENABLE_EMAIL
+  if (cmd_lc.startsWith("email_code") || cmd_lc.startsWith("email the code") ||
+      cmd_lc.startsWith("send me the code") || cmd_lc.startsWith("mail me the code")) {
+    return cmd_email_code(cmd, cmd_lc, out);
   }
 
-  if (cmd_lc.startsWith("weather ") || cmd_lc.startsWith("check weather ")) {
-    String loc = cmd.substring(cmd_lc.indexOf(' ') + 1);
-    loc.trim();
-    if (loc.length() == 0) {
-      out = "ERR: usage weather <location>";
-      return true;
-    }
-    return tool_web_weather(loc, out);
+  if (is_list_projects_request(cmd_lc)) {
+    return list_saved_projects(out);
+  }
+#endif
+
+#if ENABLE_MEDIA_UNDERSTANDING
+  if (answer_media_question(cmd, cmd_lc, out)) {
+    return true;
   }
+#endif
 
   if (cmd_lc == "time" || cmd_lc == "what time is it" || cmd_lc == "current time") {
     return tool_web_time(out);
   }
 
-  // MinOS Bridge
-  if (cmd_lc == "minos" || cmd_lc.startsWith("minos ")) {
-    String minos_cmd = cmd.length() > 6 ? cmd.substring(6) : "help";
-    minos_cmd.trim();
-    String minos_out;
-    shell_run_once(minos_cmd, minos_out);
-    out = "🦖 MinOS Shell Output:\n" + minos_out;
-    return true;
-  }
-
   return false;
 }
@@ -6,6 +6,27 @@
 void tool_registry_init();
 bool tool_registry_execute(const String &input, String &out);
 
+// Append the ReAct tool list (name, summary, usage, example) built from the
+// command table
+void tool_registry_append_react_tools(String &out);
+
+// Visit the same tools, in table order, for native tool definitions. The
+// strings are static and stay valid.
+typedef void (*tool_registry_visit_cb)(const char *name, const char *summary, const char *usage,
+                                       void *ctx);
+void tool_registry_for_each_react_tool(tool_registry_visit_cb visit, void *ctx);
+
+// Read-only lookups (search, weather, time, task_list) dispatched straight from
+// the command table, skipping pending confirmations and natural-language
+// handling. Safe to call from several tasks at once; execute returns false when
+// the input is not such a lookup.
+bool tool_registry_is_lookup(const String &input);
+bool tool_registry_execute_lookup(const String &input, String &out);
+
+// True when input names a command-table entry that finishes quickly (no LLM
+// call, upload or firmware update), so the agent can run it on its fast lane.
+bool tool_registry_is_quick(const String &input);
+
 // Auto-update check on boot (async, sends notification if update available)
 void tool_registry_check_updates_async();
 
@@ -1,7 +1,9 @@
 #include "tool_web.h"
 #include "brain_config.h"
 #include "llm_client.h"
+#include "response_cache.h"
 #include "web_search.h"
+#include "wifi_link.h"
 
 #include <Arduino.h>
 #include <HTTPClient.h>
@@ -11,7 +13,7 @@
 
 // Helper for HTTP generic get
 static String http_get(const String &url, const String &header_name = "", const String &header_val = "", int *code_out = nullptr) {
-  if (WiFi.status() != WL_CONNECTED) return "";
+  if (!wifi_link_ready()) return "";
   
   WiFiClientSecure client;
   client.setInsecure(); // Simplify certs
@@ -95,7 +97,7 @@ static bool summarize_web_results_with_llm(const String &query, const String &pr
   task += "4) Cite evidence as [1], [2], etc.\n";
 
   String llm_err;
-  if (!llm_generate_with_custom_prompt(system_prompt, task, false, summary_out, llm_err)) {
+  if (!llm_generate_with_custom_prompt(system_prompt, task, false, summary_out, llm_err, true)) {
     return false;
   }
   summary_out.trim();
@@ -127,6 +129,11 @@ static String build_non_llm_summary(const String &query, const String &provider,
 }
 
 bool tool_web_search(const String &query, String &output_out) {
+  const uint64_t cache_key = response_cache_key("web_search", web_search_normalize_query(query));
+  if (response_cache_get(cache_key, output_out)) {
+    return true;
+  }
+
   SearchResult results[10];
   int count = 0;
   String provider;
@@ -145,10 +152,10 @@ bool tool_web_search(const String &query, String &output_out) {
   String llm_summary;
   if (summarize_web_results_with_llm(query, provider, results, count, llm_summary)) {
     output_out = llm_summary + "\n\n" + build_sources_block(results, count, 5);
-    return true;
+  } else {
+    output_out = build_non_llm_summary(query, provider, results, count);
   }
-
-  output_out = build_non_llm_summary(query, provider, results, count);
+  response_cache_put(cache_key, output_out, RESPONSE_CACHE_SEARCH_TTL_MS);
   return true;
 }
 
@@ -158,6 +165,11 @@ bool tool_web_search(const String &query, String &output_out) {
 // ======================================================================================
 
 bool tool_web_weather(const String &location, String &output_out) {
+  const uint64_t cache_key = response_cache_key("weather", response_cache_normalize(location));
+  if (response_cache_get(cache_key, output_out)) {
+    return true;
+  }
+
   // 1. Geocode
   String locEnc = location;
   locEnc.replace(" ", "%20");
@@ -226,7 +238,8 @@ bool tool_web_weather(const String &location, String &output_out) {
                "Temp: " + String(temp) + "C\n" +
                "Humidity: " + String(hum) + "%\n" +
                "Wind: " + String(wind) + " km/h";
-               
+
+  response_cache_put(cache_key, output_out, RESPONSE_CACHE_WEATHER_TTL_MS);
   return true;
 }
 
@@ -0,0 +1,172 @@
+#include "trace.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "brain_config.h"
+
+namespace {
+
+struct Slot {
+  uint32_t seq;  // handle of the span in this slot, 0 when empty
+  TraceSpanRecord span;
+};
+
+Slot g_slots[TRACE_MAX_SPANS];
+uint32_t g_next_seq = 1;
+uint32_t g_trace_id = 0;
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Caller holds g_mux.
+Slot &claim_slot(const char *name, int64_t start_us) {
+  const uint32_t seq = g_next_seq++;
+  if (g_next_seq == 0) {
+    g_next_seq = 1;
+  }
+  Slot &slot = g_slots[seq % TRACE_MAX_SPANS];
+  slot.seq = seq;
+  slot.span.trace_id = g_trace_id;
+  strncpy(slot.span.name, name, sizeof(slot.span.name) - 1);
+  slot.span.name[sizeof(slot.span.name) - 1] = '\0';
+  slot.span.start_us = start_us;
+  slot.span.duration_us = 0;
+  slot.span.open = true;
+  return slot;
+}
+
+String format_us(uint32_t us) {
+  if (us < 10000) {
+    return String(us / 1000.0f, 1) + "ms";
+  }
+  return String(us / 1000) + "ms";
+}
+
+}  // namespace
+
+void trace_init() {
+  trace_clear();
+}
+
+uint32_t trace_begin_message() {
+#if TRACE_ENABLED
+  portENTER_CRITICAL(&g_mux);
+  const uint32_t id = ++g_trace_id;
+  portEXIT_CRITICAL(&g_mux);
+  return id;
+#else
+  return 0;
+#endif
+}
+
+uint32_t trace_span_begin(const char *name) {
+#if TRACE_ENABLED
+  const int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&g_mux);
+  const uint32_t seq = claim_slot(name, now).seq;
+  portEXIT_CRITICAL(&g_mux);
+  return seq;
+#else
+  (void)name;
+  return 0;
+#endif
+}
+
+void trace_span_end(uint32_t handle) {
+#if TRACE_ENABLED
+  if (handle == 0) {
+    return;
+  }
+  const int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&g_mux);
+  Slot &slot = g_slots[handle % TRACE_MAX_SPANS];
+  // The ring may already have reused the slot for a newer span.
+  if (slot.seq == handle && slot.span.open) {
+    slot.span.duration_us = (uint32_t)(now - slot.span.start_us);
+    slot.span.open = false;
+  }
+  portEXIT_CRITICAL(&g_mux);
+#else
+  (void)handle;
+#endif
+}
+
+void trace_span_record(const char *name, int64_t start_us, int64_t end_us) {
+#if TRACE_ENABLED
+  portENTER_CRITICAL(&g_mux);
+  Slot &slot = claim_slot(name, start_us);
+  slot.span.duration_us = end_us > start_us ? (uint32_t)(end_us - start_us) : 0;
+  slot.span.open = false;
+  portEXIT_CRITICAL(&g_mux);
+#else
+  (void)name;
+  (void)start_us;
+  (void)end_us;
+#endif
+}
+
+size_t trace_snapshot(TraceSpanRecord *out, size_t max_spans) {
+  size_t n = 0;
+  portENTER_CRITICAL(&g_mux);
+  const uint32_t newest = g_next_seq - 1;
+  // Walk from the oldest slot still held in the ring up to the newest.
+  for (uint32_t i = TRACE_MAX_SPANS; i > 0 && n < max_spans; i--) {
+    const uint32_t seq = newest - (i - 1);
+    const Slot &slot = g_slots[seq % TRACE_MAX_SPANS];
+    if (slot.seq != 0 && slot.seq == seq) {
+      out[n++] = slot.span;
+    }
+  }
+  portEXIT_CRITICAL(&g_mux);
+  return n;
+}
+
+void trace_dump(String &out, size_t max_chars) {
+  TraceSpanRecord *spans = (TraceSpanRecord *)malloc(sizeof(TraceSpanRecord) * TRACE_MAX_SPANS);
+  if (spans == nullptr) {
+    out = "ERR: out of memory";
+    return;
+  }
+  const size_t n = trace_snapshot(spans, TRACE_MAX_SPANS);
+  if (n == 0) {
+    free(spans);
+    out = "Trace is empty";
+    return;
+  }
+
+  // Newest traces first so truncation drops the oldest.
+  out = "⏱ Trace (newest first):\n";
+  size_t end = n;
+  while (end > 0 && out.length() < max_chars) {
+    const uint32_t id = spans[end - 1].trace_id;
+    size_t begin = end;
+    while (begin > 0 && spans[begin - 1].trace_id == id) {
+      begin--;
+    }
+
+    int64_t t0 = spans[begin].start_us;
+    for (size_t i = begin; i < end; i++) {
+      if (spans[i].start_us < t0) {
+        t0 = spans[i].start_us;
+      }
+    }
+
+    String block = "\n#" + String(id) + "\n";
+    for (size_t i = begin; i < end; i++) {
+      const TraceSpanRecord &s = spans[i];
+      block += "  +" + String((uint32_t)((s.start_us - t0) / 1000)) + "ms " + s.name + " " +
+               (s.open ? String("(open)") : format_us(s.duration_us)) + "\n";
+    }
+    if (out.length() + block.length() > max_chars) {
+      break;
+    }
+    out += block;
+    end = begin;
+  }
+  free(spans);
+}
+
+void trace_clear() {
+  portENTER_CRITICAL(&g_mux);
+  memset(g_slots, 0, sizeof(g_slots));
+  portEXIT_CRITICAL(&g_mux);
+}
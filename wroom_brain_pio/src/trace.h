@@ -0,0 +1,51 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+// Lightweight latency spans for the message pipeline. Spans are timed with
+// esp_timer_get_time() and kept in a fixed ring (like event_log), tagged with
+// the id of the message being processed when they started.
+
+struct TraceSpanRecord {
+  uint32_t trace_id;
+  char name[24];
+  int64_t start_us;
+  uint32_t duration_us;  // 0 while the span is still open
+  bool open;
+};
+
+void trace_init();
+
+// Start a new trace; spans begun afterwards belong to it. Returns its id
+// (0 when tracing is disabled).
+uint32_t trace_begin_message();
+
+// Returns a handle for trace_span_end, or 0 when tracing is disabled.
+uint32_t trace_span_begin(const char *name);
+void trace_span_end(uint32_t handle);
+
+// Record a span whose timestamps were taken elsewhere.
+void trace_span_record(const char *name, int64_t start_us, int64_t end_us);
+
+// Copy the ring, oldest first. Returns the number of spans written.
+size_t trace_snapshot(TraceSpanRecord *out, size_t max_spans);
+
+// Human-readable dump of the most recent traces.
+void trace_dump(String &out, size_t max_chars);
+
+void trace_clear();
+
+// Ends its span when it goes out of scope.
+class TraceScope {
+ public:
+  explicit TraceScope(const char *name) : handle_(trace_span_begin(name)) {}
+  ~TraceScope() { trace_span_end(handle_); }
+
+ private:
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+  uint32_t handle_;
+};
+
+#endif
@@ -4,19 +4,51 @@
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <HTTPClient.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 
+#include "b64.h"
 #include "brain_config.h"
+#include "chat_scope.h"
+#include "flash_fs.h"
+#include "metrics.h"
+#include "multipart_body.h"
+#include "psram_alloc.h"
+#include "wifi_link.h"
 
 static unsigned long s_last_poll_ms = 0;
 static long long s_last_update_id = 0;
-static const size_t kMaxMediaDownloadBytes = 120000;
 
-static String s_last_chat_id = TELEGRAM_ALLOWED_CHAT_ID;
+// Chat of the update being delivered to the incoming callback. Replies go to
+// the chat the sending task is bound to (chat_scope), not to the last sender.
+static String s_current_chat_id = TELEGRAM_ALLOWED_CHAT_ID;
 static String s_last_photo_file_id = "";
 static String s_last_photo_mime = "image/jpeg";
+static String s_last_photo_chat_id = "";
 static String s_last_document_file_id = "";
 static String s_last_document_name = "";
 static String s_last_document_mime = "";
+static String s_last_document_chat_id = "";
+
+// The cached media ids are written by the poll task and read by agent workers.
+// Each is only handed to a worker serving the chat it came from.
+static SemaphoreHandle_t s_media_lock = nullptr;
+static TaskHandle_t s_poll_task = nullptr;
+static incoming_cb_t s_poll_cb = nullptr;
+static bool s_webhook_active = false;
+
+static void media_lock() {
+  if (s_media_lock) {
+    xSemaphoreTake(s_media_lock, portMAX_DELAY);
+  }
+}
+
+static void media_unlock() {
+  if (s_media_lock) {
+    xSemaphoreGive(s_media_lock);
+  }
+}
 
 static String url_encode(const String &src) {
   // Keep for backward compatibility, but preserve UTF-8 characters
@@ -103,6 +135,30 @@ static int https_post_raw(const String &url, const String &content_type, const S
   return code;
 }
 
+// Upload a multipart body straight from its parts; nothing is staged in RAM.
+static int https_post_multipart(const String &url, MultipartBody &body, String *response_out) {
+  WiFiClientSecure client;
+  client.setInsecure();
+
+  HTTPClient https;
+  if (!https.begin(client, url)) {
+    return -1;
+  }
+
+  https.setConnectTimeout(12000);
+  https.setTimeout(30000);
+  https.addHeader("Content-Type", body.content_type());
+
+  body.finish();
+  body.rewind();
+  const int code = https.sendRequest("POST", &body, body.length());
+  if (response_out != nullptr) {
+    *response_out = code > 0 ? https.getString() : String("");
+  }
+  https.end();
+  return code;
+}
+
 static bool extract_int64_after_key(const String &body, const char *key, long long *value_out) {
   const int k = body.indexOf(key);
   if (k < 0) {
@@ -306,36 +362,23 @@ static bool extract_chat_id(const String &body, String &chat_id_out) {
 }
 
 static bool is_wifi_ready() {
-  return WiFi.status() == WL_CONNECTED;
+  return wifi_link_ready();
 }
 
+// wifi_link reconnects on its own; a send only waits out a reconnect that is
+// already under way (a cached-AP reconnect takes well under a second).
 static void ensure_wifi() {
-  if (is_wifi_ready()) {
-    return;
-  }
-
-  Serial.print("[tg] WiFi connect: ");
-  Serial.println(WIFI_SSID);
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASS);
-
-  const unsigned long start = millis();
-  while (WiFi.status() != WL_CONNECTED && (millis() - start) < 15000UL) {
-    delay(250);
-    Serial.print('.');
-  }
-  Serial.println();
-
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.print("[tg] WiFi connected, IP=");
-    Serial.println(WiFi.localIP());
-  } else {
-    Serial.println("[tg] WiFi connect timeout");
-  }
+  wifi_link_wait(WIFI_SEND_WAIT_MS);
 }
 
 void transport_telegram_init() {
-  ensure_wifi();
+  if (s_media_lock == nullptr) {
+    s_media_lock = xSemaphoreCreateMutex();
+  }
+  // Boot may wait for the first association
+  if (!wifi_link_wait(15000)) {
+    Serial.println("[tg] WiFi not up yet, continuing");
+  }
   Serial.println("[tg] transport initialized");
 }
 
@@ -374,7 +417,7 @@ void transport_telegram_send(const String &msg) {
   const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/sendMessage";
 
   // Build JSON payload
-  String json = "{\"chat_id\":\"" + s_last_chat_id + "\",\"text\":\"";
+  String json = "{\"chat_id\":\"" + chat_scope_current() + "\",\"text\":\"";
   json += json_escape_string(msg);
   json += "\"}";
 
@@ -385,56 +428,94 @@ void transport_telegram_send(const String &msg) {
   Serial.println(code);
 }
 
-bool transport_telegram_send_document(const String &filename, const String &content,
-                                      const String &mime_type, const String &caption) {
-  if (!is_wifi_ready()) {
-    ensure_wifi();
-    if (!is_wifi_ready()) {
-      return false;
-    }
-  }
-
+static String document_name_or_default(const String &filename) {
   String safe_name = filename;
   safe_name.trim();
   if (safe_name.length() == 0) {
     safe_name = "file.txt";
   }
+  return safe_name;
+}
 
+static String document_mime_or_default(const String &mime_type) {
   String safe_mime = mime_type;
   safe_mime.trim();
   if (safe_mime.length() == 0) {
     safe_mime = "text/plain";
   }
+  return safe_mime;
+}
 
-  String boundary = "----esp32boundary" + String((unsigned long)millis());
-  String payload;
-  payload.reserve(content.length() + caption.length() + 512);
-
-  payload += "--" + boundary + "\r\n";
-  payload += "Content-Disposition: form-data; name=\"chat_id\"\r\n\r\n";
-  payload += s_last_chat_id + "\r\n";
-
+// chat_id and caption fields followed by the header of the "document" part;
+// the caller adds the content segments.
+static void begin_document_body(MultipartBody &body, const String &filename,
+                                const String &mime_type, const String &caption) {
+  body.field("chat_id", chat_scope_current());
   if (caption.length() > 0) {
-    payload += "--" + boundary + "\r\n";
-    payload += "Content-Disposition: form-data; name=\"caption\"\r\n\r\n";
-    payload += caption + "\r\n";
+    body.field("caption", caption);
   }
+  body.begin_file("document", document_name_or_default(filename),
+                  document_mime_or_default(mime_type));
+}
 
-  payload += "--" + boundary + "\r\n";
-  payload += "Content-Disposition: form-data; name=\"document\"; filename=\"" + safe_name + "\"\r\n";
-  payload += "Content-Type: " + safe_mime + "\r\n\r\n";
-  payload += content;
-  payload += "\r\n--" + boundary + "--\r\n";
-
+static bool post_document(MultipartBody &body) {
   const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/sendDocument";
   String response;
-  const int code = https_post_raw(url, "multipart/form-data; boundary=" + boundary, payload, &response);
+  const int code = https_post_multipart(url, body, &response);
 
   Serial.print("[tg] sendDocument code=");
   Serial.println(code);
   return code >= 200 && code < 300;
 }
 
+bool transport_telegram_send_document(const String &filename, const String &content,
+                                      const String &mime_type, const String &caption) {
+  if (!is_wifi_ready()) {
+    ensure_wifi();
+    if (!is_wifi_ready()) {
+      return false;
+    }
+  }
+
+  MultipartBody body;
+  begin_document_body(body, filename, mime_type, caption);
+  body.text(content);
+  body.end_file();
+  return post_document(body);
+}
+
+bool transport_telegram_send_document_base64(const String &filename, const String &base64_content,
+                                             const String &mime_type, const String &caption) {
+  if (!is_wifi_ready()) {
+    ensure_wifi();
+    if (!is_wifi_ready()) {
+      return false;
+    }
+  }
+
+  MultipartBody body;
+  begin_document_body(body, filename, mime_type, caption);
+  body.base64(base64_content);
+  body.end_file();
+  return post_document(body);
+}
+
+bool transport_telegram_send_document_file(const String &filename, File &file,
+                                           const String &mime_type, const String &caption) {
+  if (!is_wifi_ready()) {
+    ensure_wifi();
+    if (!is_wifi_ready()) {
+      return false;
+    }
+  }
+
+  MultipartBody body;
+  begin_document_body(body, filename, mime_type, caption);
+  body.file(file);
+  body.end_file();
+  return post_document(body);
+}
+
 // ============ STREAMING SUPPORT ============
 
 static bool extract_message_id_from_response(const String &response, String &message_id_out) {
@@ -452,7 +533,7 @@ String transport_telegram_send_streaming_start(const String &initial_msg) {
   // Send initial message
   const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/sendMessage";
 
-  String json = "{\"chat_id\":\"" + s_last_chat_id + "\",\"text\":\"";
+  String json = "{\"chat_id\":\"" + chat_scope_current() + "\",\"text\":\"";
   json += json_escape_string(initial_msg);
   json += "\"}";
 
@@ -485,7 +566,7 @@ bool transport_telegram_send_streaming_edit(const String &message_id, const Stri
 
   const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/editMessageText";
 
-  String json = "{\"chat_id\":\"" + s_last_chat_id + "\",\"message_id\":\"" + message_id + "\",\"text\":\"";
+  String json = "{\"chat_id\":\"" + chat_scope_current() + "\",\"message_id\":\"" + message_id + "\",\"text\":\"";
   json += json_escape_string(new_text);
   json += "\"}";
 
@@ -495,30 +576,8 @@ bool transport_telegram_send_streaming_edit(const String &message_id, const Stri
   return (code >= 200 && code < 300);
 }
 
-void transport_telegram_poll(incoming_cb_t cb) {
-  if (cb == nullptr) {
-    return;
-  }
-
-  if ((millis() - s_last_poll_ms) < TELEGRAM_POLL_MS) {
-    return;
-  }
-  s_last_poll_ms = millis();
-
-  if (!is_wifi_ready()) {
-    ensure_wifi();
-    return;
-  }
-
-  const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN +
-                     "/getUpdates?timeout=0&limit=1&offset=" + String(s_last_update_id + 1);
-
-  int code = 0;
-  const String body = https_get(url, &code);
-  if (code != 200 || body.length() == 0) {
-    return;
-  }
-
+// Handle one update object from a getUpdates result.
+static void handle_update(const String &body, incoming_cb_t cb) {
   long long update_id = 0;
   if (!extract_int64_after_key(body, "\"update_id\"", &update_id)) {
     return;
@@ -529,131 +588,279 @@ void transport_telegram_poll(incoming_cb_t cb) {
 
   String chat_id;
   if (!extract_chat_id(body, chat_id)) {
+    s_last_update_id = update_id;
     return;
   }
 
-  if (chat_id != String(TELEGRAM_ALLOWED_CHAT_ID)) {
+  if (!chat_scope_allowed(chat_id)) {
     Serial.println("[tg] rejected message from non-allowlisted chat");
     s_last_update_id = update_id;
     return;
   }
 
   String photo_file_id;
-  if (extract_last_photo_file_id(body, photo_file_id) && photo_file_id.length() > 0) {
-    s_last_photo_file_id = photo_file_id;
-    s_last_photo_mime = "image/jpeg";
-    Serial.println("[tg] cached last photo file id");
-  }
-
   String doc_file_id;
   String doc_name;
   String doc_mime;
-  if (extract_document_meta(body, doc_file_id, doc_name, doc_mime) && doc_file_id.length() > 0) {
+  const bool has_photo = extract_last_photo_file_id(body, photo_file_id) && photo_file_id.length() > 0;
+  const bool has_doc = extract_document_meta(body, doc_file_id, doc_name, doc_mime) &&
+                       doc_file_id.length() > 0;
+
+  media_lock();
+  if (has_photo) {
+    s_last_photo_file_id = photo_file_id;
+    s_last_photo_mime = "image/jpeg";
+    s_last_photo_chat_id = chat_id;
+  }
+  if (has_doc) {
     s_last_document_file_id = doc_file_id;
     s_last_document_name = doc_name;
     s_last_document_mime = doc_mime;
+    s_last_document_chat_id = chat_id;
+  }
+  media_unlock();
+  if (has_photo) {
+    Serial.println("[tg] cached last photo file id");
+  }
+  if (has_doc) {
     Serial.println("[tg] cached last document file id");
   }
 
   String text;
   const bool has_text = extract_text_field(body, text);
 
-  s_last_chat_id = chat_id;
+  s_current_chat_id = chat_id;
   s_last_update_id = update_id;
 
   if (has_text) {
     cb(text);
-  } else if (photo_file_id.length() > 0) {
+  } else if (has_photo) {
     // Auto-analyze: photo sent without caption
     Serial.println("[tg] auto-analyze: photo without caption");
     cb("describe this photo");
-  } else if (doc_file_id.length() > 0) {
+  } else if (has_doc) {
     // Auto-analyze: document sent without caption
     Serial.println("[tg] auto-analyze: document without caption");
     cb("summarize this document");
   }
 }
 
-namespace {
+// Dispatch every update in a getUpdates response, oldest first. Message text
+// is JSON-escaped, so the object opener cannot appear inside it.
+static void dispatch_updates(const String &body, incoming_cb_t cb) {
+  static const char *kUpdateOpen = "{\"update_id\"";
+  int pos = body.indexOf(kUpdateOpen);
+  while (pos >= 0) {
+    const int next = body.indexOf(kUpdateOpen, pos + 1);
+    handle_update(body.substring(pos, next < 0 ? body.length() : next), cb);
+    pos = next;
+  }
+}
 
-static int base64_char_value(char c) {
-  if (c >= 'A' && c <= 'Z') return c - 'A';
-  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
-  if (c >= '0' && c <= '9') return c - '0' + 52;
-  if (c == '+') return 62;
-  if (c == '/') return 63;
-  return -1;
-}
-
-static size_t base64_decode(const String &input, uint8_t *output, size_t output_size) {
-  size_t input_len = input.length();
-  size_t output_index = 0;
-
-  for (size_t i = 0; i < input_len && output_index < output_size; i += 4) {
-    int values[4];
-    int valid_count = 0;
-
-    for (int j = 0; j < 4 && (i + j) < input_len; j++) {
-      char c = input[i + j];
-      if (c == '=') {
-        values[j] = 0;
-        valid_count++;
-      } else if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
-        continue;
-      } else {
-        int val = base64_char_value(c);
-        if (val < 0) continue;
-        values[j] = val;
-        valid_count++;
-      }
+static String updates_url(int timeout_s) {
+  return String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN +
+         "/getUpdates?timeout=" + String(timeout_s) + "&limit=" +
+         String(TELEGRAM_UPDATES_PER_POLL) + "&offset=" + String(s_last_update_id + 1);
+}
+
+static bool webhook_enabled() {
+  return strlen(TELEGRAM_WEBHOOK_URL) > 0 && strlen(TELEGRAM_WEBHOOK_SECRET) > 0;
+}
+
+static void delete_webhook() {
+  const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/deleteWebhook";
+  const int code = https_post_raw(url, "application/json", "{}", nullptr);
+  Serial.printf("[tg] deleteWebhook code=%d\n", code);
+}
+
+static bool register_webhook() {
+  String hook = TELEGRAM_WEBHOOK_URL;
+  while (hook.endsWith("/")) {
+    hook.remove(hook.length() - 1);
+  }
+  hook += "/tg/" TELEGRAM_WEBHOOK_SECRET;
+
+  const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/setWebhook";
+  String json = "{\"url\":\"" + json_escape_string(hook) + "\",\"secret_token\":\"" +
+                json_escape_string(TELEGRAM_WEBHOOK_SECRET) + "\",\"max_connections\":1}";
+  String response;
+  const int code = https_post_raw(url, "application/json", json, &response);
+  Serial.printf("[tg] setWebhook code=%d\n", code);
+  return code == 200 && response.indexOf("\"ok\":true") >= 0;
+}
+
+#if TELEGRAM_LONG_POLL_S > 0
+// Long-poll loop. The TLS session stays open between requests, so an idle
+// device makes one request per TELEGRAM_LONG_POLL_S instead of a fresh
+// handshake every TELEGRAM_POLL_MS, and new messages arrive as soon as sent.
+static void poll_task_code(void *param) {
+  (void)param;
+  WiFiClientSecure client;
+  client.setInsecure();
+  HTTPClient https;
+  https.setReuse(true);
+  uint32_t backoff_ms = 1000;
+
+  while (true) {
+    if (!is_wifi_ready()) {
+      // Woken by the reconnect itself, not a fixed retry delay
+      wifi_link_wait(30000);
+      continue;
     }
 
-    if (valid_count >= 2) {
-      if (output_index < output_size) {
-        output[output_index++] = (values[0] << 2) | ((values[1] & 0x30) >> 4);
+    int code = -1;
+    String body;
+    if (https.begin(client, updates_url(TELEGRAM_LONG_POLL_S))) {
+      https.setConnectTimeout(12000);
+      https.setTimeout((TELEGRAM_LONG_POLL_S + 10) * 1000);
+      code = https.GET();
+      if (code > 0) {
+        body = https.getString();
       }
-      if (valid_count >= 3 && output_index < output_size) {
-        output[output_index++] = ((values[1] & 0x0F) << 4) | ((values[2] & 0x3C) >> 2);
-      }
-      if (valid_count >= 4 && output_index < output_size) {
-        output[output_index++] = ((values[2] & 0x03) << 6) | values[3];
+      https.end();
+    }
+
+    if (code != 200) {
+      // Drop the socket and back off. 409 means a webhook (e.g. from an
+      // earlier webhook-mode build) or another poller holds the bot.
+      Serial.printf("[tg] getUpdates code=%d, retry in %lums\n", code, (unsigned long)backoff_ms);
+      client.stop();
+      if (code == 409) {
+        delete_webhook();
       }
+      vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+      backoff_ms = min(backoff_ms * 2, (uint32_t)30000);
+      continue;
+    }
+    backoff_ms = 1000;
+    dispatch_updates(body, s_poll_cb);
+  }
+}
+#endif
+
+void transport_telegram_start(incoming_cb_t cb) {
+  if (cb == nullptr || s_poll_cb != nullptr) {
+    return;
+  }
+  s_poll_cb = cb;
+
+  if (webhook_enabled()) {
+    if (!is_wifi_ready()) {
+      ensure_wifi();
     }
+    if (register_webhook()) {
+      s_webhook_active = true;
+      Serial.println("[tg] webhook mode active");
+      return;
+    }
+    Serial.println("[tg] setWebhook failed, falling back to polling");
   }
 
-  return output_index;
+#if TELEGRAM_LONG_POLL_S > 0
+  const uint32_t kPollStack = 10240;
+  xTaskCreatePinnedToCore(poll_task_code, "TgPoll", kPollStack, NULL, TASK_PRIO_NET, &s_poll_task,
+                          TASK_CORE_NET);
+  metrics_register_task(s_poll_task, kPollStack);
+  Serial.println("[tg] long polling started");
+#endif
 }
 
-static size_t base64_decoded_size(const String &input) {
-  size_t len = input.length();
-  size_t padding = 0;
-  if (len > 0 && input[len - 1] == '=') padding++;
-  if (len > 1 && input[len - 2] == '=') padding++;
-  return (len * 3) / 4 - padding;
+long long transport_telegram_current_update_id() {
+  return s_last_update_id;
 }
 
-static String base64_encode(const uint8_t *data, size_t len) {
-  static const char *alphabet =
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+String transport_telegram_current_chat_id() {
+  return s_current_chat_id;
+}
 
-  String out;
-  out.reserve(((len + 2) / 3) * 4);
+void transport_telegram_skip_updates_through(long long update_id) {
+  if (update_id > s_last_update_id) {
+    s_last_update_id = update_id;
+  }
+}
 
-  for (size_t i = 0; i < len; i += 3) {
-    const uint32_t b0 = data[i];
-    const uint32_t b1 = (i + 1 < len) ? data[i + 1] : 0;
-    const uint32_t b2 = (i + 2 < len) ? data[i + 2] : 0;
-    const uint32_t triple = (b0 << 16) | (b1 << 8) | b2;
+void transport_telegram_poll(incoming_cb_t cb) {
+  if (cb == nullptr || s_webhook_active || s_poll_task != nullptr) {
+    return;
+  }
 
-    out += alphabet[(triple >> 18) & 0x3F];
-    out += alphabet[(triple >> 12) & 0x3F];
-    out += (i + 1 < len) ? alphabet[(triple >> 6) & 0x3F] : '=';
-    out += (i + 2 < len) ? alphabet[triple & 0x3F] : '=';
+#if TELEGRAM_LONG_POLL_S == 0
+  if ((millis() - s_last_poll_ms) < TELEGRAM_POLL_MS) {
+    return;
   }
+  s_last_poll_ms = millis();
 
-  return out;
+  if (!is_wifi_ready()) {
+    return;
+  }
+
+  int code = 0;
+  const String body = https_get(updates_url(0), &code);
+  if (code != 200 || body.length() == 0) {
+    return;
+  }
+  dispatch_updates(body, cb);
+#endif
+}
+
+bool transport_telegram_webhook_path(String &path_out) {
+  if (!webhook_enabled()) {
+    return false;
+  }
+  path_out = "/tg/" TELEGRAM_WEBHOOK_SECRET;
+  return true;
+}
+
+bool transport_telegram_receive_webhook(const String &secret_token, const String &body) {
+  if (!s_webhook_active || s_poll_cb == nullptr) {
+    return false;
+  }
+  if (secret_token != TELEGRAM_WEBHOOK_SECRET) {
+    Serial.println("[tg] webhook rejected: bad secret token");
+    return false;
+  }
+  dispatch_updates(body, s_poll_cb);
+  return true;
 }
 
+namespace {
+
+// Destination for streamed base64 text. begin() gets the final encoded length
+// so implementations can reserve their output up front.
+class Base64Sink : public Print {
+ public:
+  virtual bool begin(size_t encoded_len) {
+    (void)encoded_len;
+    return true;
+  }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t len) override = 0;
+};
+
+class StringBase64Sink : public Base64Sink {
+ public:
+  explicit StringBase64Sink(String &out) : out_(out) {}
+  bool begin(size_t encoded_len) override {
+    out_ = "";
+    return out_.reserve(encoded_len);
+  }
+  size_t write(const uint8_t *data, size_t len) override {
+    return out_.concat((const char *)data, len) ? len : 0;
+  }
+
+ private:
+  String &out_;
+};
+
+class FileBase64Sink : public Base64Sink {
+ public:
+  explicit FileBase64Sink(File &file) : file_(file) {}
+  size_t write(const uint8_t *data, size_t len) override { return file_.write(data, len); }
+
+ private:
+  File &file_;
+};
+
 static bool fetch_file_path_by_id(const String &file_id, String &path_out, String &error_out) {
   const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN +
                      "/getFile?file_id=" + url_encode(file_id);
@@ -670,10 +877,11 @@ static bool fetch_file_path_by_id(const String &file_id, String &path_out, Strin
   return true;
 }
 
-static bool fetch_binary_file(const String &url, uint8_t **data_out, size_t *len_out,
+// Download url and base64-encode it into sink as it arrives, so neither the
+// binary file nor a second copy of it ever sits in RAM.
+static bool fetch_file_base64(const String &url, size_t max_bytes, Base64Sink &sink,
                               String &error_out) {
-  *data_out = nullptr;
-  *len_out = 0;
+  static const size_t kChunkBytes = 768;
 
   WiFiClientSecure client;
   client.setInsecure();
@@ -699,70 +907,83 @@ static bool fetch_binary_file(const String &url, uint8_t **data_out, size_t *len
     error_out = "Unknown file size";
     return false;
   }
-  if ((size_t)total > kMaxMediaDownloadBytes) {
+  if ((size_t)total > max_bytes) {
     https.end();
     error_out = "File too large for ESP32 (" + String(total) + " bytes)";
     return false;
   }
-
-  uint8_t *buffer = (uint8_t *)malloc((size_t)total);
-  if (!buffer) {
+  if (!sink.begin(b64_encoded_length((size_t)total))) {
     https.end();
     error_out = "Out of memory downloading file";
     return false;
   }
 
-  WiFiClient *stream = https.getStreamPtr();
+  uint8_t raw[kChunkBytes];
+  // A full chunk plus the two bytes the encoder may hold back, padded.
+  char encoded[kChunkBytes / 3 * 4 + 4];
+  B64Encoder encoder;
   size_t offset = 0;
-  unsigned long start_ms = millis();
+  WiFiClient *stream = https.getStreamPtr();
+  unsigned long last_data_ms = millis();
   while (https.connected() && offset < (size_t)total) {
-    size_t avail = stream->available();
+    const size_t avail = stream->available();
     if (avail == 0) {
-      if ((millis() - start_ms) > 15000UL) {
+      if ((millis() - last_data_ms) > 15000UL) {
         break;
       }
       delay(2);
       continue;
     }
-    const size_t to_read = ((size_t)total - offset < avail) ? ((size_t)total - offset) : avail;
-    const int read_count = stream->readBytes(buffer + offset, to_read);
+    size_t to_read = kChunkBytes;
+    if (to_read > avail) to_read = avail;
+    if (to_read > (size_t)total - offset) to_read = (size_t)total - offset;
+    const int read_count = stream->readBytes(raw, to_read);
     if (read_count <= 0) {
       break;
     }
     offset += (size_t)read_count;
+    last_data_ms = millis();
+
+    size_t n = encoder.update(raw, (size_t)read_count, encoded);
+    if (offset == (size_t)total) {
+      n += encoder.finish(encoded + n);
+    }
+    if (n > 0 && sink.write((const uint8_t *)encoded, n) != n) {
+      https.end();
+      error_out = "Failed to store encoded file";
+      return false;
+    }
   }
 
   https.end();
 
   if (offset != (size_t)total) {
-    free(buffer);
     error_out = "Incomplete file download";
     return false;
   }
-
-  *data_out = buffer;
-  *len_out = offset;
   return true;
 }
 
-static bool telegram_file_to_base64(const String &file_id, String &base64_out, String &error_out) {
+static bool telegram_file_url(const String &file_id, String &url_out, String &error_out) {
   String file_path;
   if (!fetch_file_path_by_id(file_id, file_path, error_out)) {
     return false;
   }
+  url_out = String("https://api.telegram.org/file/bot") + TELEGRAM_BOT_TOKEN + "/" + file_path;
+  return true;
+}
 
-  const String file_url = String("https://api.telegram.org/file/bot") + TELEGRAM_BOT_TOKEN +
-                          "/" + file_path;
-
-  uint8_t *data = nullptr;
-  size_t len = 0;
-  if (!fetch_binary_file(file_url, &data, &len, error_out)) {
+static bool telegram_file_to_base64(const String &file_id, String &base64_out, String &error_out) {
+  String file_url;
+  if (!telegram_file_url(file_id, file_url, error_out)) {
     return false;
   }
 
-  base64_out = base64_encode(data, len);
-  free(data);
-
+  StringBase64Sink sink(base64_out);
+  if (!fetch_file_base64(file_url, psram_media_ram_limit(), sink, error_out)) {
+    base64_out = "";
+    return false;
+  }
   if (base64_out.length() == 0) {
     error_out = "Failed to base64 encode file";
     return false;
@@ -770,6 +991,46 @@ static bool telegram_file_to_base64(const String &file_id, String &base64_out, S
   return true;
 }
 
+static bool telegram_file_to_spool(const String &file_id, String &error_out) {
+  if (!flash_fs_begin()) {
+    error_out = FLASH_FS_NAME " not mounted";
+    return false;
+  }
+  String file_url;
+  if (!telegram_file_url(file_id, file_url, error_out)) {
+    return false;
+  }
+
+  FLASH_FS.remove(MEDIA_SPOOL_PATH);
+  // Keep some headroom for the other files; base64 is 4/3 of the download.
+  const size_t used = FLASH_FS.usedBytes();
+  const size_t free_bytes = FLASH_FS.totalBytes() > used ? FLASH_FS.totalBytes() - used : 0;
+  const size_t headroom = 16384;
+  size_t max_bytes = free_bytes > headroom ? (free_bytes - headroom) / 4 * 3 : 0;
+  if (max_bytes > MEDIA_SPOOL_MAX_BYTES) {
+    max_bytes = MEDIA_SPOOL_MAX_BYTES;
+  }
+
+  File spool = FLASH_FS.open(MEDIA_SPOOL_PATH, FILE_WRITE);
+  if (!spool) {
+    error_out = "Could not create media spool file";
+    return false;
+  }
+  FileBase64Sink sink(spool);
+  const bool ok = fetch_file_base64(file_url, max_bytes, sink, error_out);
+  const size_t spooled = spool.size();
+  spool.close();
+  if (!ok || spooled == 0) {
+    FLASH_FS.remove(MEDIA_SPOOL_PATH);
+    if (ok) {
+      error_out = "Failed to base64 encode file";
+    }
+    return false;
+  }
+  Serial.printf("[tg] Spooled %u base64 bytes to %s\n", (unsigned)spooled, MEDIA_SPOOL_PATH);
+  return true;
+}
+
 }  // namespace
 
 bool transport_telegram_get_last_photo_base64(String &mime_out, String &base64_out,
@@ -782,16 +1043,21 @@ bool transport_telegram_get_last_photo_base64(String &mime_out, String &base64_o
     }
   }
 
-  if (s_last_photo_file_id.length() == 0) {
+  media_lock();
+  const String file_id =
+      s_last_photo_chat_id == chat_scope_current() ? s_last_photo_file_id : String("");
+  mime_out = s_last_photo_mime;
+  media_unlock();
+
+  if (file_id.length() == 0) {
     error_out = "No recent photo found. Send a photo first.";
     return false;
   }
 
-  if (!telegram_file_to_base64(s_last_photo_file_id, base64_out, error_out)) {
+  if (!telegram_file_to_base64(file_id, base64_out, error_out)) {
     return false;
   }
 
-  mime_out = s_last_photo_mime;
   if (mime_out.length() == 0) {
     mime_out = "image/jpeg";
   }
@@ -808,103 +1074,130 @@ bool transport_telegram_get_last_document_base64(String &filename_out, String &m
     }
   }
 
-  if (s_last_document_file_id.length() == 0) {
+  media_lock();
+  const String file_id =
+      s_last_document_chat_id == chat_scope_current() ? s_last_document_file_id : String("");
+  filename_out = s_last_document_name;
+  mime_out = s_last_document_mime;
+  media_unlock();
+
+  if (file_id.length() == 0) {
     error_out = "No recent document found. Send a document first.";
     return false;
   }
 
-  if (!telegram_file_to_base64(s_last_document_file_id, base64_out, error_out)) {
+  if (!telegram_file_to_base64(file_id, base64_out, error_out)) {
     return false;
   }
 
-  filename_out = s_last_document_name;
-  mime_out = s_last_document_mime;
   if (mime_out.length() == 0) {
     mime_out = "application/octet-stream";
   }
   return true;
 }
 
-bool transport_telegram_send_photo_base64(const String &base64_data, const String &caption) {
+bool transport_telegram_spool_last_photo(String &mime_out, String &path_out, String &error_out) {
   if (!is_wifi_ready()) {
     ensure_wifi();
     if (!is_wifi_ready()) {
+      error_out = "WiFi not connected";
       return false;
     }
   }
 
-  const size_t decoded_len = base64_decoded_size(base64_data);
-  if (decoded_len > 200000) {
-    Serial.println("[tg] Image too large, skipping");
+  media_lock();
+  const String file_id =
+      s_last_photo_chat_id == chat_scope_current() ? s_last_photo_file_id : String("");
+  mime_out = s_last_photo_mime;
+  media_unlock();
+
+  if (file_id.length() == 0) {
+    error_out = "No recent photo found. Send a photo first.";
     return false;
   }
 
-  uint8_t *binary_data = (uint8_t *)malloc(decoded_len);
-  if (!binary_data) {
-    Serial.println("[tg] Failed to allocate memory for photo");
+  if (!telegram_file_to_spool(file_id, error_out)) {
     return false;
   }
 
-  const size_t actual_len = base64_decode(base64_data, binary_data, decoded_len);
-
-  String boundary = "----esp32photoboundary" + String((unsigned long)millis());
-
-  String headers;
-  headers.reserve(512);
-  headers += "--" + boundary + "\r\n";
-  headers += "Content-Disposition: form-data; name=\"chat_id\"\r\n\r\n";
-  headers += s_last_chat_id + "\r\n";
-
-  if (caption.length() > 0) {
-    headers += "--" + boundary + "\r\n";
-    headers += "Content-Disposition: form-data; name=\"caption\"\r\n\r\n";
-    headers += caption + "\r\n";
+  path_out = MEDIA_SPOOL_PATH;
+  if (mime_out.length() == 0) {
+    mime_out = "image/jpeg";
   }
+  return true;
+}
 
-  headers += "--" + boundary + "\r\n";
-  headers += "Content-Disposition: form-data; name=\"photo\"; filename=\"generated.png\"\r\n";
-  headers += "Content-Type: image/png\r\n\r\n";
-
-  String footer = "\r\n--" + boundary + "--\r\n";
+bool transport_telegram_spool_last_document(String &filename_out, String &mime_out,
+                                            String &path_out, String &error_out) {
+  if (!is_wifi_ready()) {
+    ensure_wifi();
+    if (!is_wifi_ready()) {
+      error_out = "WiFi not connected";
+      return false;
+    }
+  }
 
-  const size_t total_size = headers.length() + actual_len + footer.length();
+  media_lock();
+  const String file_id =
+      s_last_document_chat_id == chat_scope_current() ? s_last_document_file_id : String("");
+  filename_out = s_last_document_name;
+  mime_out = s_last_document_mime;
+  media_unlock();
 
-  uint8_t *payload = (uint8_t *)malloc(total_size);
-  if (!payload) {
-    free(binary_data);
-    Serial.println("[tg] Failed to allocate memory for photo payload");
+  if (file_id.length() == 0) {
+    error_out = "No recent document found. Send a document first.";
     return false;
   }
 
-  size_t offset = 0;
-  memcpy(payload + offset, headers.c_str(), headers.length());
-  offset += headers.length();
-  memcpy(payload + offset, binary_data, actual_len);
-  offset += actual_len;
-  memcpy(payload + offset, footer.c_str(), footer.length());
+  if (!telegram_file_to_spool(file_id, error_out)) {
+    return false;
+  }
 
-  free(binary_data);
+  path_out = MEDIA_SPOOL_PATH;
+  if (mime_out.length() == 0) {
+    mime_out = "application/octet-stream";
+  }
+  return true;
+}
 
-  const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/sendPhoto";
-  WiFiClientSecure client;
-  client.setInsecure();
+bool transport_telegram_send_photo_file(const String &path, const String &caption) {
+  if (!is_wifi_ready()) {
+    ensure_wifi();
+    if (!is_wifi_ready()) {
+      return false;
+    }
+  }
 
-  HTTPClient https;
-  if (!https.begin(client, url)) {
-    free(payload);
+  if (!flash_fs_begin()) {
+    return false;
+  }
+  File file = FLASH_FS.open(path, FILE_READ);
+  if (!file) {
+    Serial.printf("[tg] Photo file missing: %s\n", path.c_str());
+    return false;
+  }
+  // Telegram's sendPhoto limit
+  if (file.size() > 10 * 1024 * 1024) {
+    file.close();
+    Serial.println("[tg] Image too large, skipping");
     return false;
   }
 
-  https.setConnectTimeout(12000);
-  https.setTimeout(30000);
-  https.addHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
+  // Read from flash while uploading, so the image never sits in RAM.
+  MultipartBody body;
+  body.field("chat_id", chat_scope_current());
+  if (caption.length() > 0) {
+    body.field("caption", caption);
+  }
+  body.begin_file("photo", "generated.png", "image/png");
+  body.file(file);
+  body.end_file();
 
-  const int code = https.POST(payload, total_size);
-  free(payload);
+  const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/sendPhoto";
+  const int code = https_post_multipart(url, body, nullptr);
+  file.close();
 
   Serial.print("[tg] sendPhoto code=");
   Serial.println(code);
-
-  https.end();
   return code >= 200 && code < 300;
 }
@@ -2,20 +2,50 @@
 #define TRANSPORT_TELEGRAM_H
 
 #include <Arduino.h>
+#include <FS.h>
 
 typedef void (*incoming_cb_t)(const String &msg);
 
 void transport_telegram_init();
+
+// Start receiving updates: registers the webhook when TELEGRAM_WEBHOOK_URL and
+// TELEGRAM_WEBHOOK_SECRET are set, otherwise starts the long-poll task.
+void transport_telegram_start(incoming_cb_t cb);
+
+// Short polling from the main loop; only does work when TELEGRAM_LONG_POLL_S
+// is 0 and no webhook is active.
 void transport_telegram_poll(incoming_cb_t cb);
+
+// Id of the update being delivered to the incoming callback, and its chat.
+long long transport_telegram_current_update_id();
+String transport_telegram_current_chat_id();
+// Ignore updates up to this id (already recovered from the message spool).
+void transport_telegram_skip_updates_through(long long update_id);
+
+// Webhook receive path (/tg/<secret>) for the web server, false when disabled.
+bool transport_telegram_webhook_path(String &path_out);
+// Feed a webhook POST body; false when the secret-token header does not match.
+bool transport_telegram_receive_webhook(const String &secret_token, const String &body);
+// Outgoing messages, media downloads and streaming edits use the chat the
+// calling task is bound to (chat_scope.h), the owner chat by default.
 void transport_telegram_send(const String &msg);
 bool transport_telegram_send_document(const String &filename, const String &content,
                                       const String &mime_type, const String &caption);
 bool transport_telegram_send_document_base64(const String &filename, const String &base64_content,
                                              const String &mime_type, const String &caption);
+// Upload an open file (e.g. a saved project) without reading it into RAM.
+bool transport_telegram_send_document_file(const String &filename, File &file,
+                                           const String &mime_type, const String &caption);
 bool transport_telegram_get_last_photo_base64(String &mime_out, String &base64_out, String &error_out);
 bool transport_telegram_get_last_document_base64(String &filename_out, String &mime_out,
                                                  String &base64_out, String &error_out);
-bool transport_telegram_send_photo_base64(const String &base64_data, const String &caption);
+// Same as above, but the base64 text is streamed to MEDIA_SPOOL_PATH on flash
+// instead of RAM; path_out names the spool file, which the caller removes.
+bool transport_telegram_spool_last_photo(String &mime_out, String &path_out, String &error_out);
+bool transport_telegram_spool_last_document(String &filename_out, String &mime_out,
+                                            String &path_out, String &error_out);
+// Upload a binary image file from FLASH_FS as a photo.
+bool transport_telegram_send_photo_file(const String &path, const String &caption);
 
 // Streaming support
 String transport_telegram_send_streaming_start(const String &initial_msg);
@@ -2,12 +2,34 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <esp_system.h>
+
+#include "brain_config.h"
 #include "event_log.h"
 
 namespace {
 
 // NVS namespace for usage stats
 static const char *kNvsNamespace = "usage";
+// Everything below is persisted as a single blob under this key
+static const char *kNvsBlobKey = "stats";
+static const uint32_t kBlobMagic = 0x55534732;  // "USG2"
+
+enum CallType : uint8_t {
+  CALL_CHAT = 0,
+  CALL_IMAGE,
+  CALL_ROUTE,
+  CALL_MEDIA,
+  CALL_OTHER,
+  CALL_TYPE_COUNT,
+};
+
+const char *const kCallTypeNames[CALL_TYPE_COUNT] = {"chat", "image", "route", "media", "other"};
+
+// Upper bounds (ms) of the latency buckets; the last bucket is open-ended.
+const uint32_t kLatencyBounds[] = {250, 500, 1000, 2000, 3000, 5000, 8000, 12000, 20000, 30000, 60000};
+const size_t kLatencyBuckets = sizeof(kLatencyBounds) / sizeof(kLatencyBounds[0]) + 1;
+const size_t kMaxLatencySeries = 10;
 
 // Stats stored in NVS
 struct UsageStats {
@@ -19,187 +41,353 @@ struct UsageStats {
   char last_provider[32];
   char last_model[64];
   char last_call_type[32];    // chat, image, route, etc.
-  uint32_t chat_calls;
-  uint32_t image_calls;
-  uint32_t route_calls;
-  uint32_t media_calls;
-  uint32_t other_calls;
+  uint32_t calls_by_type[CALL_TYPE_COUNT];
 };
 
-static UsageStats s_stats = {};
+// Latency histogram for one (call type, provider) pair
+struct LatencySeries {
+  char provider[16];
+  uint8_t call_type;
+  uint16_t buckets[kLatencyBuckets];  // saturating counts
+};
+
+struct UsageBlob {
+  uint32_t magic;
+  UsageStats stats;
+  uint8_t series_count;
+  LatencySeries series[kMaxLatencySeries];
+};
+
+static UsageBlob s_data = {};
 static bool s_loaded = false;
+static bool s_legacy_keys = false;  // pre-blob per-field keys still in NVS
+static uint32_t s_dirty_calls = 0;
+static uint32_t s_last_flush_ms = 0;
+static bool s_flushing = false;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+CallType call_type_from_name(const char *call_type) {
+  if (call_type != nullptr) {
+    for (uint8_t i = 0; i < CALL_OTHER; i++) {
+      if (strcmp(call_type, kCallTypeNames[i]) == 0) {
+        return (CallType)i;
+      }
+    }
+  }
+  return CALL_OTHER;
+}
+
+void copy_field(char *dst, size_t cap, const char *src) {
+  if (src == nullptr || src[0] == '\0') {
+    return;
+  }
+  strncpy(dst, src, cap - 1);
+  dst[cap - 1] = '\0';
+}
+
+// Counters from firmware that wrote one NVS key per field.
+void load_legacy_stats(Preferences &prefs) {
+  UsageStats &st = s_data.stats;
+  st.total_calls = prefs.getUInt("total", 0);
+  st.successful_calls = prefs.getUInt("success", 0);
+  st.failed_calls = prefs.getUInt("failed", 0);
+  st.rate_limited = prefs.getUInt("rate_limited", 0);
+  st.last_call_time = prefs.getUInt("last_time", 0);
+
+  prefs.getString("last_provider", st.last_provider, sizeof(st.last_provider));
+  prefs.getString("last_model", st.last_model, sizeof(st.last_model));
+  prefs.getString("last_type", st.last_call_type, sizeof(st.last_call_type));
+
+  st.calls_by_type[CALL_CHAT] = prefs.getUInt("chat", 0);
+  st.calls_by_type[CALL_IMAGE] = prefs.getUInt("image", 0);
+  st.calls_by_type[CALL_ROUTE] = prefs.getUInt("route", 0);
+  st.calls_by_type[CALL_MEDIA] = prefs.getUInt("media", 0);
+  st.calls_by_type[CALL_OTHER] = prefs.getUInt("other", 0);
+  s_legacy_keys = prefs.isKey("total");
+}
 
 void load_stats() {
   if (s_loaded) {
     return;
   }
 
+  memset(&s_data, 0, sizeof(s_data));
+  s_data.magic = kBlobMagic;
+
   Preferences prefs;
   if (!prefs.begin(kNvsNamespace, true)) {
-    // No saved stats, initialize to zero
-    memset(&s_stats, 0, sizeof(s_stats));
+    // No saved stats, start from zero
     s_loaded = true;
     return;
   }
 
-  s_stats.total_calls = prefs.getUInt("total", 0);
-  s_stats.successful_calls = prefs.getUInt("success", 0);
-  s_stats.failed_calls = prefs.getUInt("failed", 0);
-  s_stats.rate_limited = prefs.getUInt("rate_limited", 0);
-  s_stats.last_call_time = prefs.getUInt("last_time", 0);
-
-  prefs.getString("last_provider", s_stats.last_provider, sizeof(s_stats.last_provider));
-  prefs.getString("last_model", s_stats.last_model, sizeof(s_stats.last_model));
-  prefs.getString("last_type", s_stats.last_call_type, sizeof(s_stats.last_call_type));
-
-  s_stats.chat_calls = prefs.getUInt("chat", 0);
-  s_stats.image_calls = prefs.getUInt("image", 0);
-  s_stats.route_calls = prefs.getUInt("route", 0);
-  s_stats.media_calls = prefs.getUInt("media", 0);
-  s_stats.other_calls = prefs.getUInt("other", 0);
+  UsageBlob blob;
+  if (prefs.getBytesLength(kNvsBlobKey) == sizeof(blob) &&
+      prefs.getBytes(kNvsBlobKey, &blob, sizeof(blob)) == sizeof(blob) &&
+      blob.magic == kBlobMagic && blob.series_count <= kMaxLatencySeries) {
+    s_data = blob;
+  } else {
+    load_legacy_stats(prefs);
+  }
 
   prefs.end();
   s_loaded = true;
 }
 
-void save_stats() {
+// Write the in-RAM counters in one NVS transaction.
+void flush_stats() {
+  UsageBlob snapshot;
+  bool clear_legacy;
+  portENTER_CRITICAL(&s_mux);
+  if (s_flushing) {
+    portEXIT_CRITICAL(&s_mux);
+    return;
+  }
+  s_flushing = true;
+  snapshot = s_data;
+  clear_legacy = s_legacy_keys;
+  s_dirty_calls = 0;
+  s_last_flush_ms = millis();
+  portEXIT_CRITICAL(&s_mux);
+
   Preferences prefs;
   if (!prefs.begin(kNvsNamespace, false)) {
-    event_log_append("USAGE: failed to save stats");
-    return;
+    event_log_record(EVT_USAGE, "failed to save stats");
+  } else {
+    if (clear_legacy) {
+      prefs.clear();
+    }
+    if (prefs.putBytes(kNvsBlobKey, &snapshot, sizeof(snapshot)) != sizeof(snapshot)) {
+      event_log_record(EVT_USAGE, "failed to save stats");
+    } else if (clear_legacy) {
+      s_legacy_keys = false;
+    }
+    prefs.end();
   }
 
-  prefs.putUInt("total", s_stats.total_calls);
-  prefs.putUInt("success", s_stats.successful_calls);
-  prefs.putUInt("failed", s_stats.failed_calls);
-  prefs.putUInt("rate_limited", s_stats.rate_limited);
-  prefs.putUInt("last_time", s_stats.last_call_time);
+  portENTER_CRITICAL(&s_mux);
+  s_flushing = false;
+  portEXIT_CRITICAL(&s_mux);
+}
 
-  prefs.putString("last_provider", s_stats.last_provider);
-  prefs.putString("last_model", s_stats.last_model);
-  prefs.putString("last_type", s_stats.last_call_type);
+void shutdown_flush() {
+  if (s_dirty_calls > 0) {
+    flush_stats();
+  }
+}
 
-  prefs.putUInt("chat", s_stats.chat_calls);
-  prefs.putUInt("image", s_stats.image_calls);
-  prefs.putUInt("route", s_stats.route_calls);
-  prefs.putUInt("media", s_stats.media_calls);
-  prefs.putUInt("other", s_stats.other_calls);
+void record_latency(CallType type, const char *provider, uint32_t latency_ms) {
+  const char *name = (provider != nullptr && provider[0] != '\0') ? provider : "unknown";
 
-  prefs.end();
+  LatencySeries *series = nullptr;
+  for (uint8_t i = 0; i < s_data.series_count; i++) {
+    LatencySeries &s = s_data.series[i];
+    if (s.call_type == type && strncmp(s.provider, name, sizeof(s.provider) - 1) == 0) {
+      series = &s;
+      break;
+    }
+  }
+  if (series == nullptr) {
+    if (s_data.series_count >= kMaxLatencySeries) {
+      return;
+    }
+    series = &s_data.series[s_data.series_count++];
+    memset(series, 0, sizeof(*series));
+    series->call_type = type;
+    copy_field(series->provider, sizeof(series->provider), name);
+  }
+
+  size_t bucket = 0;
+  while (bucket < kLatencyBuckets - 1 && latency_ms > kLatencyBounds[bucket]) {
+    bucket++;
+  }
+  if (series->buckets[bucket] < UINT16_MAX) {
+    series->buckets[bucket]++;
+  }
+}
+
+// Percentile estimate from the histogram, interpolated inside the bucket.
+// Returns false when the percentile falls in the open-ended last bucket.
+bool latency_percentile(const LatencySeries &s, uint32_t total, uint8_t pct, uint32_t &ms_out) {
+  const uint32_t rank = (total * pct + 99) / 100;
+  uint32_t seen = 0;
+  for (size_t i = 0; i < kLatencyBuckets; i++) {
+    if (s.buckets[i] == 0) {
+      continue;
+    }
+    if (seen + s.buckets[i] >= rank) {
+      if (i == kLatencyBuckets - 1) {
+        ms_out = kLatencyBounds[i - 1];
+        return false;
+      }
+      const uint32_t lo = i == 0 ? 0 : kLatencyBounds[i - 1];
+      const uint32_t hi = kLatencyBounds[i];
+      ms_out = lo + (uint32_t)((uint64_t)(hi - lo) * (rank - seen) / s.buckets[i]);
+      return true;
+    }
+    seen += s.buckets[i];
+  }
+  ms_out = 0;
+  return true;
+}
+
+String format_ms(uint32_t ms, bool bounded) {
+  String out = bounded ? "" : ">";
+  if (ms < 1000) {
+    return out + String(ms) + "ms";
+  }
+  return out + String(ms / 1000.0f, 1) + "s";
 }
 
 }  // namespace
 
 void usage_init() {
   load_stats();
+  s_last_flush_ms = millis();
+  // Counters that have not hit the flush threshold yet survive ESP.restart()
+  // and the reboot at the end of an HTTP/ArduinoOTA update.
+  esp_register_shutdown_handler(shutdown_flush);
 }
 
-void usage_record_call(const char *call_type, int http_status, const char *provider, const char *model) {
+void usage_record_call(const char *call_type, int http_status, const char *provider, const char *model,
+                       uint32_t latency_ms) {
   load_stats();
 
-  s_stats.total_calls++;
-
-  // Track call type
-  if (strcmp(call_type, "chat") == 0) {
-    s_stats.chat_calls++;
-  } else if (strcmp(call_type, "image") == 0) {
-    s_stats.image_calls++;
-  } else if (strcmp(call_type, "route") == 0) {
-    s_stats.route_calls++;
-  } else if (strcmp(call_type, "media") == 0) {
-    s_stats.media_calls++;
-  } else {
-    s_stats.other_calls++;
-  }
+  const CallType type = call_type_from_name(call_type);
+  bool flush_now;
+
+  portENTER_CRITICAL(&s_mux);
+  UsageStats &st = s_data.stats;
+  st.total_calls++;
+  st.calls_by_type[type]++;
 
   // Track success/failure
   if (http_status >= 200 && http_status < 300) {
-    s_stats.successful_calls++;
+    st.successful_calls++;
   } else {
-    s_stats.failed_calls++;
+    st.failed_calls++;
     if (http_status == 429) {
-      s_stats.rate_limited++;
+      st.rate_limited++;
     }
   }
 
-  // Update last call info
-  s_stats.last_call_time = millis() / 1000;  // Approximate uptime-based timestamp
-  if (provider != nullptr && provider[0] != '\0') {
-    strncpy(s_stats.last_provider, provider, sizeof(s_stats.last_provider) - 1);
-    s_stats.last_provider[sizeof(s_stats.last_provider) - 1] = '\0';
-  }
-  if (model != nullptr && model[0] != '\0') {
-    strncpy(s_stats.last_model, model, sizeof(s_stats.last_model) - 1);
-    s_stats.last_model[sizeof(s_stats.last_model) - 1] = '\0';
-  }
-  if (call_type != nullptr && call_type[0] != '\0') {
-    strncpy(s_stats.last_call_type, call_type, sizeof(s_stats.last_call_type) - 1);
-    s_stats.last_call_type[sizeof(s_stats.last_call_type) - 1] = '\0';
+  if (latency_ms > 0) {
+    record_latency(type, provider, latency_ms);
   }
 
-  save_stats();
+  // Update last call info
+  st.last_call_time = millis() / 1000;  // Approximate uptime-based timestamp
+  copy_field(st.last_provider, sizeof(st.last_provider), provider);
+  copy_field(st.last_model, sizeof(st.last_model), model);
+  copy_field(st.last_call_type, sizeof(st.last_call_type), call_type);
+
+  s_dirty_calls++;
+  flush_now = s_dirty_calls >= USAGE_FLUSH_DIRTY_CALLS;
+  portEXIT_CRITICAL(&s_mux);
+
+  if (flush_now) {
+    flush_stats();
+  }
 }
 
 void usage_record_error(int http_status) {
   load_stats();
   if (http_status == 429) {
-    s_stats.rate_limited++;
+    portENTER_CRITICAL(&s_mux);
+    s_data.stats.rate_limited++;
+    s_dirty_calls++;
+    portEXIT_CRITICAL(&s_mux);
+  }
+}
+
+void usage_tick() {
+  if (s_dirty_calls > 0 && millis() - s_last_flush_ms >= USAGE_FLUSH_INTERVAL_MS) {
+    flush_stats();
+  }
+}
+
+void usage_flush() {
+  if (s_loaded && s_dirty_calls > 0) {
+    flush_stats();
   }
-  save_stats();
 }
 
 void usage_get_report(String &out) {
   load_stats();
 
+  UsageBlob snap;
+  portENTER_CRITICAL(&s_mux);
+  snap = s_data;
+  portEXIT_CRITICAL(&s_mux);
+  const UsageStats &st = snap.stats;
+
   out = "📊 Usage Statistics\n\n";
 
   // Call summary
   out += "Calls:\n";
-  out += "  Total: " + String(s_stats.total_calls) + "\n";
-  out += "  Success: " + String(s_stats.successful_calls) + "\n";
-  out += "  Failed: " + String(s_stats.failed_calls) + "\n";
+  out += "  Total: " + String(st.total_calls) + "\n";
+  out += "  Success: " + String(st.successful_calls) + "\n";
+  out += "  Failed: " + String(st.failed_calls) + "\n";
 
-  if (s_stats.rate_limited > 0) {
-    out += "  ⚠️ Rate limited (429): " + String(s_stats.rate_limited) + "\n";
+  if (st.rate_limited > 0) {
+    out += "  ⚠️ Rate limited (429): " + String(st.rate_limited) + "\n";
   }
 
   // Call breakdown
   out += "\nBy type:\n";
-  if (s_stats.chat_calls > 0) {
-    out += "  Chat: " + String(s_stats.chat_calls) + "\n";
-  }
-  if (s_stats.image_calls > 0) {
-    out += "  Image: " + String(s_stats.image_calls) + "\n";
-  }
-  if (s_stats.route_calls > 0) {
-    out += "  Route: " + String(s_stats.route_calls) + "\n";
-  }
-  if (s_stats.media_calls > 0) {
-    out += "  Media: " + String(s_stats.media_calls) + "\n";
+  const char *const labels[CALL_TYPE_COUNT] = {"Chat", "Image", "Route", "Media", "Other"};
+  for (uint8_t i = 0; i < CALL_TYPE_COUNT; i++) {
+    if (st.calls_by_type[i] > 0) {
+      out += "  " + String(labels[i]) + ": " + String(st.calls_by_type[i]) + "\n";
+    }
   }
-  if (s_stats.other_calls > 0) {
-    out += "  Other: " + String(s_stats.other_calls) + "\n";
+
+  // Where the time goes
+  if (snap.series_count > 0) {
+    out += "\nLatency p50 / p95:\n";
+    for (uint8_t i = 0; i < snap.series_count; i++) {
+      const LatencySeries &s = snap.series[i];
+      uint32_t n = 0;
+      for (size_t b = 0; b < kLatencyBuckets; b++) {
+        n += s.buckets[b];
+      }
+      if (n == 0) {
+        continue;
+      }
+      uint32_t p50 = 0;
+      uint32_t p95 = 0;
+      const bool p50_bounded = latency_percentile(s, n, 50, p50);
+      const bool p95_bounded = latency_percentile(s, n, 95, p95);
+      out += "  " + String(kCallTypeNames[s.call_type]) + " · " + String(s.provider) + ": " +
+             format_ms(p50, p50_bounded) + " / " + format_ms(p95, p95_bounded) + " (n=" +
+             String(n) + ")\n";
+    }
   }
 
   // Last call info
-  if (s_stats.last_provider[0] != '\0') {
+  if (st.last_provider[0] != '\0') {
     out += "\nLast call:\n";
-    out += "  Type: " + String(s_stats.last_call_type) + "\n";
-    out += "  Provider: " + String(s_stats.last_provider) + "\n";
-    if (s_stats.last_model[0] != '\0') {
-      out += "  Model: " + String(s_stats.last_model) + "\n";
+    out += "  Type: " + String(st.last_call_type) + "\n";
+    out += "  Provider: " + String(st.last_provider) + "\n";
+    if (st.last_model[0] != '\0') {
+      out += "  Model: " + String(st.last_model) + "\n";
     }
   }
 
   // Success rate
-  if (s_stats.total_calls > 0) {
-    float success_rate = (s_stats.successful_calls * 100.0f) / s_stats.total_calls;
+  if (st.total_calls > 0) {
+    float success_rate = (st.successful_calls * 100.0f) / st.total_calls;
     out += "\nSuccess rate: " + String((int)success_rate) + "%\n";
   }
 }
 
 void usage_reset() {
-  memset(&s_stats, 0, sizeof(s_stats));
-  save_stats();
-  event_log_append("USAGE: stats reset");
+  load_stats();
+  portENTER_CRITICAL(&s_mux);
+  memset(&s_data, 0, sizeof(s_data));
+  s_data.magic = kBlobMagic;
+  s_dirty_calls = 1;
+  portEXIT_CRITICAL(&s_mux);
+  flush_stats();
+  event_log_record(EVT_USAGE, "stats reset");
 }
@@ -6,12 +6,20 @@
 // Initialize stats from NVS (or start fresh)
 void usage_init();
 
-// Record an LLM API call
-void usage_record_call(const char *call_type, int http_status, const char *provider, const char *model);
+// Record an LLM API call. Counters live in RAM and are written to NVS in
+// batches; latency_ms > 0 also feeds the per-provider latency histogram.
+void usage_record_call(const char *call_type, int http_status, const char *provider, const char *model,
+                       uint32_t latency_ms = 0);
 
 // Record an error (429, 500, etc.)
 void usage_record_error(int http_status);
 
+// Flush pending counters once USAGE_FLUSH_INTERVAL_MS has passed (main loop)
+void usage_tick();
+
+// Write pending counters now (before OTA or a deliberate reboot)
+void usage_flush();
+
 // Get formatted usage report
 void usage_get_report(String &out);
 
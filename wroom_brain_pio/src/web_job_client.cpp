@@ -7,6 +7,7 @@
 #include <WiFiClientSecure.h>
 
 #include "brain_config.h"
+#include "wifi_link.h"
 
 namespace {
 
@@ -325,7 +326,7 @@ bool tavily_search(const String &query, String &reply_out, String &error_out) {
 bool web_job_run(const String &task, const String &timezone, String &reply_out, String &error_out) {
   (void)timezone;
 
-  if (WiFi.status() != WL_CONNECTED) {
+  if (!wifi_link_ready()) {
     error_out = "WiFi not connected";
     return false;
   }
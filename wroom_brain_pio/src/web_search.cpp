@@ -1,10 +1,16 @@
 #include "web_search.h"
 
 #include "brain_config.h"
+#include "response_cache.h"
+#include "wifi_link.h"
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <new>
 
 static const int kMaxResults = 10;
 static const int kTimeoutMs = WEB_SEARCH_TIMEOUT_MS;
@@ -207,15 +213,255 @@ static bool search_tavily(const String &query, const String &api_key,
   return true;
 }
 
-// ============ MAIN SEARCH FUNCTION ============
+// ============ RESULT CACHE ============
 
-bool web_search(const String &query, SearchResult *results_out, int *results_count,
-               String &provider_used, String &error_out) {
-  if (WiFi.status() != WL_CONNECTED) {
-    error_out = "WiFi not connected";
+// Results are cached per normalised query as "Provider" then one
+// "title\x1Furl\x1Fsnippet" record per result, records split by \x1E.
+static const char kFieldSep = '\x1F';
+static const char kRecordSep = '\x1E';
+static const size_t kCachedSnippetChars = 300;
+
+static void append_cache_field(String &out, const String &value, size_t max_chars) {
+  for (size_t i = 0; i < value.length() && i < max_chars; i++) {
+    const char c = value[i];
+    out += (c == kFieldSep || c == kRecordSep) ? ' ' : c;
+  }
+}
+
+static String encode_results(const String &provider, const SearchResult *results, int count) {
+  String out;
+  out.reserve(64 + count * 200);
+  out += provider;
+  for (int i = 0; i < count; i++) {
+    out += kRecordSep;
+    append_cache_field(out, results[i].title, 200);
+    out += kFieldSep;
+    append_cache_field(out, results[i].url, 300);
+    out += kFieldSep;
+    append_cache_field(out, results[i].snippet, kCachedSnippetChars);
+  }
+  return out;
+}
+
+static void decode_results(const String &value, SearchResult *results, int *count,
+                           String &provider) {
+  int pos = value.indexOf(kRecordSep);
+  provider = pos < 0 ? value : value.substring(0, pos);
+  int idx = 0;
+  while (pos >= 0 && idx < kMaxResults) {
+    const int start = pos + 1;
+    pos = value.indexOf(kRecordSep, start);
+    const String record = pos < 0 ? value.substring(start) : value.substring(start, pos);
+    const int a = record.indexOf(kFieldSep);
+    const int b = a < 0 ? -1 : record.indexOf(kFieldSep, a + 1);
+    if (b < 0) {
+      continue;
+    }
+    results[idx].title = record.substring(0, a);
+    results[idx].url = record.substring(a + 1, b);
+    results[idx].snippet = record.substring(b + 1);
+    idx++;
+  }
+  *count = idx;
+}
+
+String web_search_normalize_query(const String &query) {
+  // Filler words that do not change what a search returns
+  static const char *const kFillers[] = {"a", "an", "the", "please", "search", "for",
+                                         "find", "look", "up", "me", "about"};
+  String lc = query;
+  lc.toLowerCase();
+
+  String out;
+  out.reserve(lc.length());
+  String word;
+  for (size_t i = 0; i <= lc.length(); i++) {
+    const char c = i < lc.length() ? lc[i] : ' ';
+    if (isalnum((unsigned char)c) || (uint8_t)c >= 0x80) {
+      word += c;
+      continue;
+    }
+    if (word.length() == 0) {
+      continue;
+    }
+    bool filler = false;
+    for (const char *f : kFillers) {
+      if (word == f) {
+        filler = true;
+        break;
+      }
+    }
+    if (!filler) {
+      if (out.length() > 0) {
+        out += ' ';
+      }
+      out += word;
+    }
+    word = "";
+  }
+  // A query made only of filler words keeps its plain form
+  return out.length() > 0 ? out : response_cache_normalize(query);
+}
+
+// ============ PROVIDER RACE ============
+// With both keys set, Serper and Tavily run at once on helper tasks and the
+// first good answer wins, so a slow or failing provider costs nothing extra.
+// An HTTP call in flight cannot be aborted; the loser runs to its own timeout
+// in the background, its result is dropped, and the last holder frees the race.
+
+typedef bool (*search_fn)(const String &query, const String &api_key, SearchResult *results,
+                          int *count, String &error_out);
+
+struct SearchAttempt {
+  search_fn fn;
+  const char *name;
+  String api_key;
+  SearchResult results[kMaxResults];
+  int count;
+  String error;
+  bool ok;
+};
+
+struct SearchRace;
+
+struct SearchJob {
+  SearchRace *race;
+  int index;
+};
+
+struct SearchRace {
+  String query;
+  SearchAttempt attempts[2];
+  SearchJob jobs[2];
+  QueueHandle_t done;  // indexes of finished attempts
+  int refs;
+};
+
+static portMUX_TYPE s_race_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void race_release(SearchRace *race) {
+  portENTER_CRITICAL(&s_race_mux);
+  const bool last = --race->refs == 0;
+  portEXIT_CRITICAL(&s_race_mux);
+  if (last) {
+    vQueueDelete(race->done);
+    delete race;
+  }
+}
+
+static void race_task(void *param) {
+  SearchJob *job = static_cast<SearchJob *>(param);
+  SearchRace *race = job->race;
+  const int index = job->index;
+  SearchAttempt &a = race->attempts[index];
+  a.count = 0;
+  a.ok = a.fn(race->query, a.api_key, a.results, &a.count, a.error);
+  xQueueSend(race->done, &index, 0);  // room for both attempts, never blocks
+  race_release(race);
+  vTaskDelete(NULL);
+}
+
+static bool race_start(SearchRace *race, int index) {
+  portENTER_CRITICAL(&s_race_mux);
+  race->refs++;
+  portEXIT_CRITICAL(&s_race_mux);
+  if (xTaskCreatePinnedToCore(race_task, "SearchRace", WEB_SEARCH_RACE_STACK, &race->jobs[index],
+                              TASK_PRIO_AGENT, NULL, TASK_CORE_NET) != pdPASS) {
+    race_release(race);
     return false;
   }
+  return true;
+}
 
+// Returns false without searching when the race cannot be set up (memory,
+// task creation); the caller then tries the providers in turn.
+static bool race_providers(const String &query, const String &serper_key,
+                           const String &tavily_key, SearchResult *results_out,
+                           int *results_count, String &provider_used, String &error_out,
+                           bool &raced) {
+  raced = false;
+  if (ESP.getFreeHeap() < WEB_SEARCH_RACE_MIN_HEAP) {
+    return false;
+  }
+  SearchRace *race = new (std::nothrow) SearchRace();
+  if (race == nullptr) {
+    return false;
+  }
+  race->done = xQueueCreate(2, sizeof(int));
+  if (race->done == nullptr) {
+    delete race;
+    return false;
+  }
+  race->query = query;
+  race->attempts[0].fn = search_serper;
+  race->attempts[0].name = "Serper";
+  race->attempts[0].api_key = serper_key;
+  race->attempts[1].fn = search_tavily;
+  race->attempts[1].name = "Tavily";
+  race->attempts[1].api_key = tavily_key;
+  for (int i = 0; i < 2; i++) {
+    race->attempts[i].ok = false;
+    race->attempts[i].count = 0;
+    race->jobs[i] = {race, i};
+  }
+  race->refs = 1;
+
+  int started = 0;
+  for (int i = 0; i < 2; i++) {
+    if (race_start(race, i)) {
+      started++;
+    }
+  }
+  if (started == 0) {
+    race_release(race);
+    return false;
+  }
+  raced = true;
+  Serial.printf("[search] Racing %d providers\n", started);
+
+  bool ok = false;
+  int empty_index = -1;
+  String errors;
+  for (int finished = 0; finished < started; finished++) {
+    int index = -1;
+    xQueueReceive(race->done, &index, portMAX_DELAY);  // HTTP timeouts bound the wait
+    const SearchAttempt &a = race->attempts[index];
+    // An empty answer only wins when the other provider has nothing either
+    if (a.ok && a.count == 0) {
+      empty_index = index;
+      continue;
+    }
+    if (a.ok) {
+      for (int i = 0; i < a.count; i++) {
+        results_out[i] = a.results[i];
+      }
+      *results_count = a.count;
+      provider_used = a.name;
+      ok = true;
+      break;
+    }
+    Serial.printf("[search] %s failed: %s\n", a.name, a.error.c_str());
+    if (errors.length() > 0) {
+      errors += "; ";
+    }
+    errors += a.error;
+  }
+
+  if (!ok && empty_index >= 0) {
+    *results_count = 0;
+    provider_used = race->attempts[empty_index].name;
+    ok = true;
+  } else if (!ok) {
+    error_out = errors;
+  }
+  race_release(race);
+  return ok;
+}
+
+// ============ MAIN SEARCH FUNCTION ============
+
+bool web_search(const String &query, SearchResult *results_out, int *results_count,
+               String &provider_used, String &error_out) {
   String provider = String(WEB_SEARCH_PROVIDER);
   provider.toLowerCase();
   if (provider.length() == 0) {
@@ -233,24 +479,58 @@ bool web_search(const String &query, SearchResult *results_out, int *results_cou
     return false;
   }
 
+  // ReAct runs often repeat a search with small wording changes
+  const uint64_t cache_key =
+      response_cache_key("search_results", web_search_normalize_query(query), provider);
+  String cached;
+  if (response_cache_get(cache_key, cached)) {
+    decode_results(cached, results_out, results_count, provider_used);
+    Serial.println("[search] Cache hit (" + provider_used + ")");
+    return true;
+  }
+
+  if (!wifi_link_ready()) {
+    error_out = "WiFi not connected";
+    return false;
+  }
+
+  const bool use_serper = provider_allows_serper && serper_key.length() > 0;
+  const bool use_tavily = provider_allows_tavily && tavily_key.length() > 0;
+
+  bool ok = false;
+  bool raced = false;
+  if (WEB_SEARCH_RACE && use_serper && use_tavily) {
+    ok = race_providers(query, serper_key, tavily_key, results_out, results_count,
+                        provider_used, error_out, raced);
+  }
+
   // Default order: Serper -> Tavily.
-  if (provider_allows_serper && serper_key.length() > 0) {
+  if (!raced && use_serper) {
     Serial.println("[search] Trying Serper...");
-    if (search_serper(query, serper_key, results_out, results_count, error_out)) {
+    ok = search_serper(query, serper_key, results_out, results_count, error_out);
+    if (ok) {
       provider_used = "Serper";
-      return true;
+    } else {
+      Serial.println("[search] Serper failed: " + error_out);
     }
-    Serial.println("[search] Serper failed: " + error_out);
   }
 
-  if (provider_allows_tavily && tavily_key.length() > 0) {
+  if (!raced && !ok && use_tavily) {
     Serial.println("[search] Trying Tavily...");
-    if (search_tavily(query, tavily_key, results_out, results_count, error_out)) {
+    ok = search_tavily(query, tavily_key, results_out, results_count, error_out);
+    if (ok) {
       provider_used = "Tavily";
-      return true;
     }
   }
 
+  if (ok) {
+    if (*results_count > 0) {
+      response_cache_put(cache_key, encode_results(provider_used, results_out, *results_count),
+                         RESPONSE_CACHE_SEARCH_TTL_MS);
+    }
+    return true;
+  }
+
   if (provider_allows_serper && serper_key.length() == 0 &&
       provider_allows_tavily && tavily_key.length() == 0) {
     error_out = "No search key found. Set SERPER_API_KEY or TAVILY_API_KEY/WEB_SEARCH_API_KEY.";
@@ -263,6 +543,12 @@ bool web_search(const String &query, SearchResult *results_out, int *results_cou
 }
 
 bool web_search_simple(const String &query, String &formatted_output, String &error_out) {
+  const uint64_t cache_key =
+      response_cache_key("web_search_simple", web_search_normalize_query(query));
+  if (response_cache_get(cache_key, formatted_output)) {
+    return true;
+  }
+
   SearchResult results[kMaxResults];
   int count = 0;
   String provider;
@@ -289,6 +575,8 @@ bool web_search_simple(const String &query, String &formatted_output, String &er
 
   if (count == 0) {
     formatted_output += "No results found.";
+  } else {
+    response_cache_put(cache_key, formatted_output, RESPONSE_CACHE_SEARCH_TTL_MS);
   }
 
   return true;
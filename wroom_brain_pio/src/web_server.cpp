@@ -2,21 +2,33 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
-#include <SPIFFS.h>
 #include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
+#include <memory>
 
 #include "transport_telegram.h"
 #include "brain_config.h"
+#include "flash_fs.h"
 #include "model_config.h"
 #include "agent_loop.h"
 #include "chat_history.h"
+#include "event_log.h"
+#include "metrics.h"
+#include "psram_alloc.h"
+#include "soak.h"
+#include "trace.h"
 
 namespace {
 
 AsyncWebServer *g_server = nullptr;
+AsyncEventSource *g_events = nullptr;
 bool g_initialized = false;
 
+// Part of every ETag. SPIFFS keeps no mtimes, so size alone would miss a
+// same-length edit; bumping this on writes (and seeding it per boot) makes
+// every old tag stale instead.
+volatile uint32_t g_etag_generation = 0;
+
 // ======================================================================================
 // HELPERS
 // ======================================================================================
@@ -43,6 +55,7 @@ void handle_api_status(AsyncWebServerRequest *request) {
   doc["uptime"] = millis() / 1000;
   doc["rssi"] = WiFi.RSSI();
   doc["heap_free"] = ESP.getFreeHeap();
+  doc["heap_largest_block"] = ESP.getMaxAllocHeap();
   doc["ip"] = WiFi.localIP().toString();
   doc["ssid"] = WiFi.SSID();
   
@@ -119,8 +132,79 @@ void handle_api_config_set(AsyncWebServerRequest *request, uint8_t *data, size_t
   send_json(request, doc);
 }
 
+String result_json(AgentResultState state, uint32_t id, const String &reply) {
+  JsonDocument doc;
+  doc["id"] = id;
+  doc["status"] = state == AGENT_RESULT_DONE ? "done" : "pending";
+  if (state == AGENT_RESULT_DONE) {
+    doc["reply"] = reply;
+  }
+  String out;
+  serializeJson(doc, out);
+  return out;
+}
+
+// GET /api/chat/<id>
+// Waits up to AGENT_WEB_RESULT_WAIT_MS for that request's reply. The async
+// server cannot block, so a chunked response answers "try again" from its
+// filler (polled by AsyncTCP) until the result is in or the wait runs out.
+void handle_api_chat_result(AsyncWebServerRequest *request, uint32_t id) {
+  String reply;
+  const AgentResultState state = agent_loop_take_result(id, reply);
+  if (state == AGENT_RESULT_UNKNOWN) {
+    send_error(request, 404, "Unknown or expired request id");
+    return;
+  }
+  if (state == AGENT_RESULT_DONE) {
+    request->send(200, "application/json", result_json(state, id, reply));
+    return;
+  }
+
+  struct Wait {
+    uint32_t id;
+    unsigned long deadline_ms;
+    bool has_body;
+    String body;
+  };
+  std::shared_ptr<Wait> wait = std::make_shared<Wait>();
+  wait->id = id;
+  wait->deadline_ms = millis() + AGENT_WEB_RESULT_WAIT_MS;
+  wait->has_body = false;
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse(
+      "application/json", [wait](uint8_t *buffer, size_t max_len, size_t index) -> size_t {
+        if (!wait->has_body) {
+          String reply;
+          const AgentResultState now = agent_loop_take_result(wait->id, reply);
+          if (now == AGENT_RESULT_PENDING && (long)(millis() - wait->deadline_ms) < 0) {
+            return RESPONSE_TRY_AGAIN;
+          }
+          // Pending past the deadline, or evicted while waiting: let the client poll again
+          wait->body = result_json(now == AGENT_RESULT_DONE ? now : AGENT_RESULT_PENDING, wait->id,
+                                   reply);
+          wait->has_body = true;
+        }
+        if (index >= wait->body.length()) {
+          return 0;
+        }
+        const size_t n = min(max_len, wait->body.length() - index);
+        memcpy(buffer, wait->body.c_str() + index, n);
+        return n;
+      });
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
+
 // GET /api/chat
 void handle_api_chat_history(AsyncWebServerRequest *request) {
+  // The /api/chat handler also receives /api/chat/<id>
+  const String url = request->url();
+  if (url.startsWith("/api/chat/")) {
+    const uint32_t id = (uint32_t)strtoul(url.c_str() + 10, nullptr, 10);
+    handle_api_chat_result(request, id);
+    return;
+  }
+
   String history, err;
   if (chat_history_get(history, err)) {
     // Wrap in JSON
@@ -132,6 +216,140 @@ void handle_api_chat_history(AsyncWebServerRequest *request) {
   }
 }
 
+// Append spans to arr; trace_id 0 takes every trace.
+void add_trace_spans(JsonArray arr, const TraceSpanRecord *spans, size_t n, uint32_t trace_id) {
+  for (size_t i = 0; i < n; i++) {
+    if (trace_id != 0 && spans[i].trace_id != trace_id) {
+      continue;
+    }
+    JsonObject span = arr.add<JsonObject>();
+    span["trace"] = spans[i].trace_id;
+    span["name"] = spans[i].name;
+    span["start_us"] = spans[i].start_us;
+    if (spans[i].open) {
+      span["open"] = true;
+    } else {
+      span["duration_us"] = spans[i].duration_us;
+    }
+  }
+}
+
+// GET /api/metrics (Prometheus text format)
+void handle_api_metrics(AsyncWebServerRequest *request) {
+  String out;
+  metrics_format_prometheus(out);
+  soak_format_prometheus(out);
+  request->send(200, "text/plain; version=0.0.4", out);
+}
+
+// POST SOAK_MOCK_PATH/api/chat
+// Ollama-shaped canned reply for soak runs, held back for the configured
+// latency. Like the /api/chat/<id> long-poll it must not block AsyncTCP, so
+// the chunked filler answers "try again" until the reply is due.
+void handle_mock_llm(AsyncWebServerRequest *request) {
+  uint32_t latency_ms = 0;
+  uint32_t reply_bytes = 0;
+  if (!soak_mock_params(latency_ms, reply_bytes)) {
+    request->send(404, "text/plain", "Mock LLM is off");
+    return;
+  }
+
+  struct Mock {
+    unsigned long due_ms;
+    uint32_t reply_bytes;
+    bool has_body;
+    String body;
+  };
+  std::shared_ptr<Mock> mock = std::make_shared<Mock>();
+  mock->due_ms = millis() + latency_ms;
+  mock->reply_bytes = reply_bytes;
+  mock->has_body = false;
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse(
+      "application/json", [mock](uint8_t *buffer, size_t max_len, size_t index) -> size_t {
+        if (!mock->has_body) {
+          if ((long)(millis() - mock->due_ms) < 0) {
+            return RESPONSE_TRY_AGAIN;
+          }
+          static const char kFiller[] = "This is a canned soak test reply. ";
+          mock->body.reserve(mock->reply_bytes + 96);
+          mock->body = "{\"model\":\"mock\",\"message\":{\"role\":\"assistant\","
+                       "\"content\":\"";
+          const size_t text_end = mock->body.length() + mock->reply_bytes;
+          while (mock->body.length() < text_end) {
+            mock->body += kFiller;
+          }
+          mock->body.remove(text_end);
+          mock->body += "\"},\"done\":true}";
+          mock->has_body = true;
+        }
+        if (index >= mock->body.length()) {
+          return 0;
+        }
+        const size_t n = min(max_len, mock->body.length() - index);
+        memcpy(buffer, mock->body.c_str() + index, n);
+        return n;
+      });
+  request->send(response);
+}
+
+// GET /api/trace
+void handle_api_trace(AsyncWebServerRequest *request) {
+  TraceSpanRecord *spans = (TraceSpanRecord *)malloc(sizeof(TraceSpanRecord) * TRACE_MAX_SPANS);
+  if (spans == nullptr) {
+    send_error(request, 500, "Out of memory");
+    return;
+  }
+  const size_t n = trace_snapshot(spans, TRACE_MAX_SPANS);
+
+  JsonDocument doc;
+  add_trace_spans(doc["spans"].to<JsonArray>(), spans, n, 0);
+  free(spans);
+  send_json(request, doc);
+}
+
+// GET /api/logs?after=<seq>
+// Event records newer than seq, oldest first; pass "next" back to page on.
+void handle_api_logs(AsyncWebServerRequest *request) {
+  static const size_t kPage = 32;
+  uint32_t after = 0;
+  if (request->hasParam("after")) {
+    after = (uint32_t)strtoul(request->getParam("after")->value().c_str(), nullptr, 10);
+  }
+  EventRecord *records = (EventRecord *)malloc(sizeof(EventRecord) * kPage);
+  if (records == nullptr) {
+    send_error(request, 500, "Out of memory");
+    return;
+  }
+  const size_t n = event_log_read(after, records, kPage);
+
+  JsonDocument doc;
+  JsonArray arr = doc["records"].to<JsonArray>();
+  uint32_t next = after;
+  for (size_t i = 0; i < n; i++) {
+    JsonObject rec = arr.add<JsonObject>();
+    rec["seq"] = records[i].seq;
+    rec["boot"] = records[i].boot;
+    rec["uptime"] = records[i].uptime_s;
+    if (records[i].epoch != 0) {
+      rec["epoch"] = records[i].epoch;
+    }
+    rec["code"] = event_log_code_name(records[i].code);
+    rec["text"] = records[i].text;
+    next = records[i].seq;
+  }
+  free(records);
+  doc["next"] = next;
+  doc["more"] = n == kPage;
+  send_json(request, doc);
+}
+
+void push_event(const char *event, const JsonDocument &doc) {
+  String payload;
+  serializeJson(doc, payload);
+  g_events->send(payload.c_str(), event, millis());
+}
+
 // POST /api/chat
 // Body: { "message": "Hello" }
 void handle_api_chat_send(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
@@ -151,14 +369,69 @@ void handle_api_chat_send(AsyncWebServerRequest *request, uint8_t *data, size_t
   
   // Send to agent loop (async queue)
   // Non-blocking to avoid WDT reset on AsyncWebServer thread
-  agent_loop_queue_message(String(msg));
-  
+  const uint32_t id = agent_loop_queue_web_message(String(msg));
+  if (id == 0) {
+    send_error(request, 503, "Agent queue full");
+    return;
+  }
+
+  // Poll GET /api/chat/<id> (or watch /api/events) for the reply
   JsonDocument resDoc;
   resDoc["status"] = "queued";
+  resDoc["id"] = id;
   send_json(request, resDoc);
 }
 
 
+// POST /tg/<secret>
+// Telegram webhook delivery; the body may arrive in several chunks.
+void handle_tg_webhook(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+  const size_t kMaxUpdateBytes = 16384;
+  if (index == 0) {
+    if (total > kMaxUpdateBytes) {
+      request->send(413, "text/plain", "Update too large");
+      return;
+    }
+    // AsyncWebServerRequest frees _tempObject when the request is destroyed
+    request->_tempObject = big_malloc(total + 1);
+  }
+  char *buf = static_cast<char *>(request->_tempObject);
+  if (buf == nullptr) {
+    return;
+  }
+  memcpy(buf + index, data, len);
+  if (index + len < total) {
+    return;
+  }
+  buf[total] = '\0';
+
+  const String secret = request->header("X-Telegram-Bot-Api-Secret-Token");
+  if (!transport_telegram_receive_webhook(secret, String(buf))) {
+    request->send(403, "text/plain", "Forbidden");
+    return;
+  }
+  request->send(200, "application/json", "{}");
+}
+
+String mime_type_for(const String &path) {
+  if (path.endsWith(".html")) return "text/html";
+  if (path.endsWith(".css")) return "text/css";
+  if (path.endsWith(".js")) return "application/javascript";
+  if (path.endsWith(".json")) return "application/json";
+  if (path.endsWith(".svg")) return "image/svg+xml";
+  if (path.endsWith(".png")) return "image/png";
+  if (path.endsWith(".ico")) return "image/x-icon";
+  return "text/plain";
+}
+
+bool etag_matches(AsyncWebServerRequest *request, const String &etag) {
+  if (!request->hasHeader("If-None-Match")) {
+    return false;
+  }
+  const String header = request->header("If-None-Match");
+  return header == "*" || header.indexOf(etag) >= 0;
+}
+
 // Handle static file requests (Fallback)
 void handle_static_file(AsyncWebServerRequest *request) {
   String path = request->url();
@@ -167,18 +440,56 @@ void handle_static_file(AsyncWebServerRequest *request) {
     path = "/index.html";
   }
 
-  if (SPIFFS.exists(path)) {
-    String mime_type = "text/plain";
-    if (path.endsWith(".html")) mime_type = "text/html";
-    else if (path.endsWith(".css")) mime_type = "text/css";
-    else if (path.endsWith(".js")) mime_type = "application/javascript";
-    else if (path.endsWith(".json")) mime_type = "application/json";
-    
-    request->send(SPIFFS, path, mime_type);
+  // Prefer a pre-compressed copy; every browser sends gzip in Accept-Encoding,
+  // and a lone .gz is served as-is rather than 404.
+  const bool accepts_gzip = request->header("Accept-Encoding").indexOf("gzip") >= 0;
+  const String gz_path = path + ".gz";
+  String file_path;
+  bool gzipped = false;
+  if (FLASH_FS.exists(gz_path) && (accepts_gzip || !FLASH_FS.exists(path))) {
+    file_path = gz_path;
+    gzipped = true;
+  } else if (FLASH_FS.exists(path)) {
+    file_path = path;
   } else {
     // 404
     request->send(404, "text/plain", "File not found");
+    return;
   }
+
+  // Metadata only; the body is read when the response streams it.
+  File f = FLASH_FS.open(file_path, "r");
+  if (!f) {
+    request->send(500, "text/plain", "Open failed");
+    return;
+  }
+  const size_t size = f.size();
+  const uint32_t mtime = (uint32_t)f.getLastWrite();
+  f.close();
+
+  char etag[40];
+  snprintf(etag, sizeof(etag), "\"%x-%x-%x%s\"", (unsigned)size, (unsigned)mtime,
+           (unsigned)g_etag_generation, gzipped ? "g" : "");
+  const char *cache_control = path.startsWith(WEB_IMMUTABLE_PREFIX)
+                                  ? "public, max-age=31536000, immutable"
+                                  : "no-cache";
+
+  if (etag_matches(request, etag)) {
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", cache_control);
+    request->send(response);
+    return;
+  }
+
+  AsyncWebServerResponse *response = request->beginResponse(FLASH_FS, file_path, mime_type_for(path));
+  if (gzipped) {
+    response->addHeader("Content-Encoding", "gzip");
+  }
+  response->addHeader("Vary", "Accept-Encoding");
+  response->addHeader("ETag", etag);
+  response->addHeader("Cache-Control", cache_control);
+  request->send(response);
 }
 
 }  // namespace
@@ -188,12 +499,13 @@ void web_server_init() {
     return;
   }
 
-  if (!SPIFFS.begin(true)) {
-    Serial.println("[web] SPIFFS mount failed");
+  if (!flash_fs_begin()) {
+    Serial.println("[web] " FLASH_FS_NAME " mount failed");
     return;
   }
-  Serial.println("[web] SPIFFS mounted");
+  Serial.println("[web] " FLASH_FS_NAME " mounted");
 
+  g_etag_generation = (uint32_t)random(0x10000) << 16;
   g_server = new AsyncWebServer(80);
 
   // API
@@ -204,12 +516,31 @@ void web_server_init() {
   g_server->on("/api/config", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL, handle_api_config_set);
   g_server->on("/api/chat", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL, handle_api_chat_send);
   g_server->on("/api/chat", HTTP_GET, handle_api_chat_history);
+  g_server->on("/api/trace", HTTP_GET, handle_api_trace);
+  g_server->on("/api/metrics", HTTP_GET, handle_api_metrics);
+  g_server->on("/api/logs", HTTP_GET, handle_api_logs);
+  g_server->on(SOAK_MOCK_PATH "/api/chat", HTTP_POST, handle_mock_llm);
+
+  // Push channel for replies, streamed tokens and traces, so the UI needs no polling
+  g_events = new AsyncEventSource("/api/events");
+  g_events->onConnect([](AsyncEventSourceClient *client) {
+    client->send("hello", "ready", millis(), 3000);
+  });
+  g_server->addHandler(g_events);
+
+  String webhook_path;
+  if (transport_telegram_webhook_path(webhook_path)) {
+    g_server->on(webhook_path.c_str(), HTTP_POST, [](AsyncWebServerRequest *request){}, NULL, handle_tg_webhook);
+  }
 
   // Static
   g_server->onNotFound(handle_static_file);
 
   g_server->begin();
   g_initialized = true;
+  // AsyncTCP starts its service task with the first server; 16 KB is its
+  // default CONFIG_ASYNC_TCP_STACK_SIZE
+  metrics_register_task(xTaskGetHandle("async_tcp"), 16384);
 
   String ip = WiFi.localIP().toString();
   Serial.println("[web] Server started at http://" + ip + "/");
@@ -226,10 +557,61 @@ bool web_server_publish_file(const String &filename, const String &content, cons
   String path = "/" + filename;
   if (!path.startsWith("/")) path = "/" + path;
   
-  File file = SPIFFS.open(path, "w");
+  File file = FLASH_FS.open(path, "w");
   if (!file) return false;
   
   size_t written = file.print(content);
   file.close();
+  web_server_invalidate_etags();
   return written > 0;
 }
+
+bool web_server_events_active() {
+  return g_initialized && g_events != nullptr && g_events->count() > 0;
+}
+
+void web_server_push_token(const String &delta) {
+  if (!web_server_events_active() || delta.length() == 0) {
+    return;
+  }
+  // The final reply event carries the whole text, so skipped tokens are not lost.
+  if (g_events->avgPacketsWaiting() >= WEB_EVENTS_MAX_BACKLOG) {
+    return;
+  }
+  JsonDocument doc;
+  doc["text"] = delta;
+  push_event("token", doc);
+}
+
+void web_server_push_reply(const char *source, const String &text, uint32_t request_id) {
+  if (!web_server_events_active()) {
+    return;
+  }
+  JsonDocument doc;
+  doc["source"] = source;
+  if (request_id != 0) {
+    doc["id"] = request_id;
+  }
+  doc["text"] = text;
+  push_event("reply", doc);
+}
+
+void web_server_push_trace(uint32_t trace_id) {
+  if (trace_id == 0 || !web_server_events_active()) {
+    return;
+  }
+  TraceSpanRecord *spans = (TraceSpanRecord *)malloc(sizeof(TraceSpanRecord) * TRACE_MAX_SPANS);
+  if (spans == nullptr) {
+    return;
+  }
+  const size_t n = trace_snapshot(spans, TRACE_MAX_SPANS);
+  JsonDocument doc;
+  doc["trace"] = trace_id;
+  add_trace_spans(doc["spans"].to<JsonArray>(), spans, n, trace_id);
+  free(spans);
+  push_event("trace", doc);
+}
+
+void web_server_invalidate_etags() {
+  g_etag_generation++;
+}
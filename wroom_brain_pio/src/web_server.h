@@ -12,4 +12,22 @@ String web_server_get_url();
 // Serve a file with content (saves to SPIFFS and makes available via web)
 bool web_server_publish_file(const String &filename, const String &content, const String &mime_type);
 
+// Call after writing a servable file outside web_server_publish_file, so
+// browsers holding an old ETag fetch the new content.
+void web_server_invalidate_etags();
+
+// Server-Sent Events on /api/events for the web UI. Each call is a no-op
+// while no browser is connected.
+bool web_server_events_active();
+
+// Streamed reply text not yet pushed; dropped while clients lag behind.
+void web_server_push_token(const String &delta);
+
+// A finished reply; source is "telegram", "web" or "scheduler", request_id
+// the one /api/chat returned (0 for other sources).
+void web_server_push_reply(const char *source, const String &text, uint32_t request_id = 0);
+
+// The spans recorded for one trace id.
+void web_server_push_trace(uint32_t trace_id);
+
 #endif
@@ -0,0 +1,299 @@
+#include "wifi_link.h"
+
+#include <Preferences.h>
+#include <WiFi.h>
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+
+#include "brain_config.h"
+#include "metrics.h"
+
+namespace {
+
+const char *kNamespace = "wifi_link";
+const uint32_t kCacheMagic = 0x57464C31;  // "WFL1"
+const EventBits_t kUpBit = 1 << 0;
+const uint32_t kTaskStack = 4096;
+
+// Last access point. RTC memory survives a software restart without a flash
+// read; NVS covers power cycles and is only written when the AP changes.
+struct ApCache {
+  uint32_t magic;
+  uint32_t ssid_hash;
+  uint8_t bssid[6];
+  uint8_t channel;
+};
+
+RTC_NOINIT_ATTR ApCache g_rtc_cache;
+ApCache g_cache{};
+bool g_cache_valid = false;
+
+TaskHandle_t g_task = nullptr;
+EventGroupHandle_t g_events = nullptr;
+volatile WifiLinkState g_state = WIFI_LINK_DOWN;
+
+// Set by the event handler, acted on by the task
+volatile bool g_attempt_pending = true;
+volatile uint32_t g_next_attempt_ms = 0;
+volatile bool g_save_pending = false;
+
+uint32_t g_backoff_ms = 0;
+uint8_t g_fast_failures = 0;
+bool g_attempt_fast = false;
+uint32_t g_attempt_start_ms = 0;
+uint32_t g_down_since_ms = 0;
+uint32_t g_reconnects = 0;
+uint32_t g_last_connect_ms = 0;
+bool g_last_connect_fast = false;
+uint8_t g_last_reason = 0;
+
+uint32_t ssid_hash() {
+  uint32_t h = 2166136261u;
+  for (const char *p = WIFI_SSID; *p; p++) {
+    h = (h ^ (uint8_t)*p) * 16777619u;
+  }
+  return h;
+}
+
+bool cache_matches(const ApCache &c) {
+  return c.magic == kCacheMagic && c.ssid_hash == ssid_hash() && c.channel >= 1 &&
+         c.channel <= 14;
+}
+
+void load_cache() {
+  if (cache_matches(g_rtc_cache)) {
+    g_cache = g_rtc_cache;
+    g_cache_valid = true;
+    return;
+  }
+  Preferences prefs;
+  if (!prefs.begin(kNamespace, true)) {
+    return;
+  }
+  ApCache c{};
+  if (prefs.getBytes("ap", &c, sizeof(c)) == sizeof(c) && cache_matches(c)) {
+    g_cache = c;
+    g_cache_valid = true;
+    g_rtc_cache = c;
+  }
+  prefs.end();
+}
+
+void save_cache() {
+  const uint8_t *bssid = WiFi.BSSID();
+  if (bssid == nullptr) {
+    return;
+  }
+  ApCache c{};
+  c.magic = kCacheMagic;
+  c.ssid_hash = ssid_hash();
+  c.channel = (uint8_t)WiFi.channel();
+  memcpy(c.bssid, bssid, sizeof(c.bssid));
+  g_rtc_cache = c;
+  if (g_cache_valid && memcmp(&c, &g_cache, sizeof(c)) == 0) {
+    return;
+  }
+  g_cache = c;
+  g_cache_valid = true;
+  Preferences prefs;
+  if (prefs.begin(kNamespace, false)) {
+    prefs.putBytes("ap", &c, sizeof(c));
+    prefs.end();
+  }
+}
+
+void apply_static_ip() {
+  if (strlen(WIFI_STATIC_IP) == 0) {
+    return;
+  }
+  IPAddress ip, gateway, subnet, dns;
+  if (!ip.fromString(WIFI_STATIC_IP) || !gateway.fromString(WIFI_GATEWAY) ||
+      !subnet.fromString(WIFI_SUBNET)) {
+    Serial.println("[wifi] invalid WIFI_STATIC_IP/GATEWAY/SUBNET, using DHCP");
+    return;
+  }
+  if (!dns.fromString(WIFI_DNS)) {
+    dns = gateway;
+  }
+  // No DHCP round trip on connect
+  WiFi.config(ip, gateway, subnet, dns);
+}
+
+void start_attempt() {
+  g_attempt_fast = g_cache_valid && g_fast_failures < WIFI_FAST_CONNECT_TRIES;
+  g_state = WIFI_LINK_CONNECTING;
+  g_attempt_start_ms = millis();
+  if (g_attempt_fast) {
+    WiFi.begin(WIFI_SSID, WIFI_PASS, g_cache.channel, g_cache.bssid, true);
+  } else {
+    WiFi.begin(WIFI_SSID, WIFI_PASS);
+  }
+}
+
+void attempt_failed() {
+  if (g_attempt_fast && g_fast_failures < 255) {
+    g_fast_failures++;
+  }
+  g_backoff_ms = g_backoff_ms == 0 ? WIFI_RECONNECT_MIN_MS : g_backoff_ms * 2;
+  if (g_backoff_ms > WIFI_RECONNECT_MAX_MS) {
+    g_backoff_ms = WIFI_RECONNECT_MAX_MS;
+  }
+  // A cached AP that just failed falls back to a scan right away
+  const bool scan_next = g_attempt_fast && g_fast_failures >= WIFI_FAST_CONNECT_TRIES;
+  g_next_attempt_ms = millis() + (scan_next ? 0 : g_backoff_ms);
+  g_attempt_pending = true;
+}
+
+// Runs on the WiFi event task: record and hand off, never block here.
+void on_event(arduino_event_id_t event, arduino_event_info_t info) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    g_last_connect_ms = millis() - g_attempt_start_ms;
+    g_last_connect_fast = g_attempt_fast;
+    g_fast_failures = 0;
+    g_backoff_ms = 0;
+    g_attempt_pending = false;
+    g_save_pending = true;
+    g_state = WIFI_LINK_UP;
+    xEventGroupSetBits(g_events, kUpBit);
+  } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+    xEventGroupClearBits(g_events, kUpBit);
+    const WifiLinkState was = g_state;
+    g_state = WIFI_LINK_DOWN;
+    g_last_reason = info.wifi_sta_disconnected.reason;
+    if (was == WIFI_LINK_UP) {
+      // A blip: try the same AP again at once
+      g_down_since_ms = millis();
+      g_reconnects++;
+      g_backoff_ms = 0;
+      g_next_attempt_ms = millis();
+      g_attempt_pending = true;
+    } else if (was == WIFI_LINK_CONNECTING) {
+      attempt_failed();
+    }
+  } else {
+    return;
+  }
+  if (g_task != nullptr) {
+    xTaskNotifyGive(g_task);
+  }
+}
+
+void link_task(void *param) {
+  (void)param;
+  while (true) {
+    uint32_t wait_ms = UINT32_MAX;
+
+    if (g_save_pending) {
+      g_save_pending = false;
+      save_cache();
+      Serial.printf("[wifi] up in %u ms (%s, ch %d), ip=%s\n", (unsigned)g_last_connect_ms,
+                    g_last_connect_fast ? "cached AP" : "scan", (int)WiFi.channel(),
+                    WiFi.localIP().toString().c_str());
+    }
+
+    if (g_state != WIFI_LINK_UP) {
+      const uint32_t now = millis();
+      if (g_attempt_pending && (int32_t)(now - g_next_attempt_ms) >= 0) {
+        g_attempt_pending = false;
+        if (g_reconnects > 0 || g_fast_failures > 0) {
+          Serial.printf("[wifi] reconnecting (%s, last reason %u)\n",
+                        g_cache_valid && g_fast_failures < WIFI_FAST_CONNECT_TRIES ? "cached AP"
+                                                                                   : "scan",
+                        (unsigned)g_last_reason);
+        }
+        start_attempt();
+      }
+
+      if (g_attempt_pending) {
+        wait_ms = g_next_attempt_ms - now;
+      } else if (g_state == WIFI_LINK_CONNECTING) {
+        // The driver reports a failed attempt with a disconnect event; this
+        // only catches one that never reports back.
+        const uint32_t elapsed = now - g_attempt_start_ms;
+        if (elapsed >= WIFI_CONNECT_TIMEOUT_MS) {
+          // DOWN first, so the disconnect event is not counted a second time
+          g_state = WIFI_LINK_DOWN;
+          WiFi.disconnect(false, false);
+          attempt_failed();
+          continue;
+        }
+        wait_ms = WIFI_CONNECT_TIMEOUT_MS - elapsed;
+      }
+    }
+
+    ulTaskNotifyTake(pdTRUE, wait_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms));
+  }
+}
+
+const char *state_name(WifiLinkState state) {
+  switch (state) {
+    case WIFI_LINK_UP: return "up";
+    case WIFI_LINK_CONNECTING: return "connecting";
+    default: return "down";
+  }
+}
+
+}  // namespace
+
+void wifi_link_begin() {
+  if (g_task != nullptr) {
+    return;
+  }
+  g_events = xEventGroupCreate();
+  if (g_events == nullptr) {
+    Serial.println("[wifi] event group alloc failed");
+    return;
+  }
+  load_cache();
+
+  Serial.print("[wifi] connecting to ");
+  Serial.print(WIFI_SSID);
+  Serial.println(g_cache_valid ? " (cached AP)" : "");
+  // The driver's own NVS copy would be rewritten on every begin()
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_STA);
+  // Reconnects are ours, with the cached AP and backoff
+  WiFi.setAutoReconnect(false);
+  apply_static_ip();
+  WiFi.onEvent(on_event);
+
+  xTaskCreatePinnedToCore(link_task, "WiFiLink", kTaskStack, NULL, TASK_PRIO_NET, &g_task,
+                          TASK_CORE_NET);
+  metrics_register_task(g_task, kTaskStack);
+}
+
+WifiLinkState wifi_link_state() {
+  return g_state;
+}
+
+bool wifi_link_wait(uint32_t timeout_ms) {
+  if (g_state == WIFI_LINK_UP) {
+    return true;
+  }
+  if (g_events == nullptr || timeout_ms == 0) {
+    return false;
+  }
+  const EventBits_t bits =
+      xEventGroupWaitBits(g_events, kUpBit, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+  return (bits & kUpBit) != 0;
+}
+
+void wifi_link_describe(String &out) {
+  const WifiLinkState state = g_state;
+  out = "WiFi: " + String(state_name(state));
+  if (state == WIFI_LINK_UP) {
+    out += " ip=" + WiFi.localIP().toString() + " rssi=" + String(WiFi.RSSI()) + " ch=" +
+           String((int)WiFi.channel());
+  } else if (g_reconnects > 0) {
+    out += " for " + String((millis() - g_down_since_ms) / 1000) + "s (reason " +
+           String((unsigned)g_last_reason) + ")";
+  }
+  out += "\nLast connect: " + String(g_last_connect_ms) + " ms (" +
+         (g_last_connect_fast ? "cached AP" : "scan") + ")";
+  out += "\nReconnects: " + String(g_reconnects);
+  if (strlen(WIFI_STATIC_IP) > 0) {
+    out += "\nStatic IP: " WIFI_STATIC_IP;
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+#include <Arduino.h>
+
+// Station connection owned by one background task. Reconnects are driven by
+// WiFi events instead of callers spinning on WiFi.status(): a drop schedules
+// an attempt with backoff, and the first attempts go straight to the last
+// access point (channel and BSSID cached in RTC memory and NVS), which skips
+// the scan and usually associates in well under a second. Other modules only
+// read the state, so an AP blip never stalls them.
+
+enum WifiLinkState : uint8_t {
+  WIFI_LINK_DOWN = 0,
+  WIFI_LINK_CONNECTING,
+  WIFI_LINK_UP,
+};
+
+// Start the task and the first connect. Call once, before anything that
+// needs the network.
+void wifi_link_begin();
+
+// Current state; never blocks.
+WifiLinkState wifi_link_state();
+inline bool wifi_link_ready() { return wifi_link_state() == WIFI_LINK_UP; }
+
+// Block up to timeout_ms for the link to come up (on an event, no polling).
+// For boot and for callers that would otherwise fail a send.
+bool wifi_link_wait(uint32_t timeout_ms);
+
+void wifi_link_describe(String &out);
+
+#endif